@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# replay-blocks.py: Record a segment of blocks and replay it on top of a
+# chainstate snapshot to benchmark block validation.
+#
+# Copyright (c) 2019 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#
+
+import argparse
+import json
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+NETMAGIC = {
+    'main': 'afeae9f7',
+    'test': '07131f03',
+}
+
+PHASES = ['extract', 'execute', 'proxy_calls', 'value_transfers', 'check_reward', 'lydra', 'receipts', 'state_root']
+
+def chain_args(chain):
+    if chain == 'test':
+        return ['-testnet']
+    if chain == 'regtest':
+        return ['-regtest']
+    return []
+
+def cli(args, datadir, method, *params, rpcport=None):
+    cmd = [args.cli, '-datadir=' + datadir] + chain_args(args.chain)
+    if rpcport is not None:
+        cmd.append('-rpcport=%d' % rpcport)
+    cmd += [method] + [str(p) for p in params]
+    return subprocess.check_output(cmd, universal_newlines=True).strip()
+
+def record(args):
+    """ Write the blocks after --height in the format -loadblock reads """
+    magic = bytes.fromhex(args.netmagic or NETMAGIC[args.chain])
+    with open(args.segment, 'wb') as f:
+        for height in range(args.height + 1, args.height + args.count + 1):
+            blockhash = cli(args, args.datadir, 'getblockhash', height)
+            block = bytes.fromhex(cli(args, args.datadir, 'getblock', blockhash, 0))
+            f.write(magic + struct.pack('<I', len(block)) + block)
+    print('Wrote blocks %d to %d to %s' % (args.height + 1, args.height + args.count, args.segment))
+
+def wait_for_rpc(args, datadir, rpcport, proc):
+    while True:
+        if proc.poll() is not None:
+            sys.exit('hydrad exited with code %d' % proc.returncode)
+        try:
+            return int(cli(args, datadir, 'getblockcount', rpcport=rpcport))
+        except subprocess.CalledProcessError:
+            time.sleep(0.1)
+
+def replay_once(args, run):
+    """ Connect the segment on a fresh copy of the snapshot, returns the elapsed time and the validation stats """
+    workdir = tempfile.mkdtemp(prefix='hydra-replay-')
+    datadir = os.path.join(workdir, 'datadir')
+    shutil.copytree(args.snapshot, datadir)
+    hydrad_args = [
+        args.hydrad, '-datadir=' + datadir, '-server', '-rpcport=%d' % args.rpcport,
+        '-connect=0', '-listen=0', '-dnsseed=0', '-staking=0', '-disablewallet',
+        '-dbcache=%d' % args.dbcache, '-par=%d' % args.par, '-printtoconsole=0',
+        '-loadblock=' + os.path.abspath(args.segment),
+    ] + chain_args(args.chain) + args.hydrad_arg
+    proc = subprocess.Popen(hydrad_args, stdout=subprocess.DEVNULL)
+    try:
+        target = args.height + args.count
+        # Blocks are connected once the node is up, the clock starts at the first tip read over RPC
+        tip = wait_for_rpc(args, datadir, args.rpcport, proc)
+        start_tip, start = tip, time.time()
+        while tip < target:
+            if proc.poll() is not None:
+                sys.exit('hydrad exited with code %d' % proc.returncode)
+            time.sleep(0.05)
+            tip = int(cli(args, datadir, 'getblockcount', rpcport=args.rpcport))
+        elapsed = time.time() - start
+        stats = json.loads(cli(args, datadir, 'getvalidationstats', rpcport=args.rpcport))
+        cli(args, datadir, 'stop', rpcport=args.rpcport)
+        proc.wait()
+    finally:
+        if proc.poll() is None:
+            proc.kill()
+            proc.wait()
+        shutil.rmtree(workdir)
+    print('run %d: blocks %d to %d in %.2fs (%.2f blocks/s)' % (run, start_tip + 1, target, elapsed, (target - start_tip) / elapsed if elapsed > 0 else 0))
+    return target - start_tip, elapsed, stats
+
+def replay(args):
+    results = [replay_once(args, run) for run in range(1, args.runs + 1)]
+    print()
+    print('%-16s %12s %12s' % ('phase', 'ms', 'ms/block'))
+    for phase in PHASES:
+        times = sorted(stats[phase]['time'] / 1000.0 for _, _, stats in results)
+        median = times[len(times) // 2]
+        blocks = max(results[0][2]['blocks'], 1)
+        print('%-16s %12.2f %12.3f' % (phase, median, median / blocks))
+    rates = sorted(blocks / elapsed for blocks, elapsed, _ in results if elapsed > 0)
+    if rates:
+        print('median throughput %.2f blocks/s over %d runs' % (rates[len(rates) // 2], len(results)))
+
+def main():
+    parser = argparse.ArgumentParser(description='Record a block segment and replay it on a chainstate snapshot')
+    parser.add_argument('--chain', choices=['main', 'test', 'regtest'], default='main')
+    parser.add_argument('--cli', default='hydra-cli', help='Path to hydra-cli')
+    parser.add_argument('--height', type=int, required=True, help='Height of the snapshot tip')
+    parser.add_argument('--count', type=int, required=True, help='Number of blocks in the segment')
+    parser.add_argument('--segment', required=True, help='Block segment file')
+    sub = parser.add_subparsers(dest='command')
+
+    p = sub.add_parser('record', help='Write the blocks after --height from a synced node')
+    p.add_argument('--datadir', required=True, help='Data directory of the running synced node')
+    p.add_argument('--netmagic', help='Network magic in hex, the default of --chain if unset')
+
+    p = sub.add_parser('replay', help='Connect the segment on copies of the snapshot')
+    p.add_argument('--snapshot', required=True, help='Data directory of a stopped node at --height')
+    p.add_argument('--hydrad', default='hydrad', help='Path to hydrad')
+    p.add_argument('--runs', type=int, default=3)
+    p.add_argument('--rpcport', type=int, default=13399)
+    p.add_argument('--dbcache', type=int, default=450)
+    p.add_argument('--par', type=int, default=0)
+    p.add_argument('--hydrad-arg', action='append', default=[], help='Extra hydrad argument, may be repeated')
+
+    args = parser.parse_args()
+    if args.command == 'record':
+        record(args)
+    elif args.command == 'replay':
+        replay(args)
+    else:
+        parser.print_help()
+
+if __name__ == '__main__':
+    main()
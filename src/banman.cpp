@@ -12,7 +12,7 @@
 
 
 BanMan::BanMan(fs::path ban_file, CClientUIInterface* client_interface, int64_t default_ban_time)
-    : m_client_interface(client_interface), m_ban_db(std::move(ban_file)), m_default_ban_time(default_ban_time)
+    : m_banned_snapshot(std::make_shared<const banmap_t>()), m_client_interface(client_interface), m_ban_db(std::move(ban_file)), m_default_ban_time(default_ban_time)
 {
     if (m_client_interface) m_client_interface->InitMessage(_("Loading banlist..."));
 
@@ -62,11 +62,22 @@ void BanMan::ClearBanned()
         LOCK(m_cs_banned);
         m_banned.clear();
         m_is_dirty = true;
+        PublishBanned();
     }
     DumpBanlist(); //store banlist to disk
     if (m_client_interface) m_client_interface->BannedListChanged();
 }
 
+std::shared_ptr<const banmap_t> BanMan::GetBannedSnapshot() const
+{
+    return std::atomic_load(&m_banned_snapshot);
+}
+
+void BanMan::PublishBanned()
+{
+    std::atomic_store(&m_banned_snapshot, std::make_shared<const banmap_t>(m_banned));
+}
+
 int BanMan::IsBannedLevel(CNetAddr net_addr)
 {
     // Returns the most severe level of banning that applies to this address.
@@ -75,10 +86,10 @@ int BanMan::IsBannedLevel(CNetAddr net_addr)
     // 2 - Any other ban
     int level = 0;
     auto current_time = GetTime();
-    LOCK(m_cs_banned);
-    for (const auto& it : m_banned) {
-        CSubNet sub_net = it.first;
-        CBanEntry ban_entry = it.second;
+    const std::shared_ptr<const banmap_t> banned = GetBannedSnapshot();
+    for (const auto& it : *banned) {
+        const CSubNet& sub_net = it.first;
+        const CBanEntry& ban_entry = it.second;
 
         if (current_time < ban_entry.nBanUntil && sub_net.Match(net_addr)) {
             if (ban_entry.banReason != BanReasonNodeMisbehaving) return 2;
@@ -91,10 +102,10 @@ int BanMan::IsBannedLevel(CNetAddr net_addr)
 bool BanMan::IsBanned(CNetAddr net_addr)
 {
     auto current_time = GetTime();
-    LOCK(m_cs_banned);
-    for (const auto& it : m_banned) {
-        CSubNet sub_net = it.first;
-        CBanEntry ban_entry = it.second;
+    const std::shared_ptr<const banmap_t> banned = GetBannedSnapshot();
+    for (const auto& it : *banned) {
+        const CSubNet& sub_net = it.first;
+        const CBanEntry& ban_entry = it.second;
 
         if (current_time < ban_entry.nBanUntil && sub_net.Match(net_addr)) {
             return true;
@@ -106,10 +117,10 @@ bool BanMan::IsBanned(CNetAddr net_addr)
 bool BanMan::IsBanned(CSubNet sub_net)
 {
     auto current_time = GetTime();
-    LOCK(m_cs_banned);
-    banmap_t::iterator i = m_banned.find(sub_net);
-    if (i != m_banned.end()) {
-        CBanEntry ban_entry = (*i).second;
+    const std::shared_ptr<const banmap_t> banned = GetBannedSnapshot();
+    banmap_t::const_iterator i = banned->find(sub_net);
+    if (i != banned->end()) {
+        const CBanEntry& ban_entry = (*i).second;
         if (current_time < ban_entry.nBanUntil) {
             return true;
         }
@@ -140,6 +151,7 @@ void BanMan::Ban(const CSubNet& sub_net, const BanReason& ban_reason, int64_t ba
         if (m_banned[sub_net].nBanUntil < ban_entry.nBanUntil) {
             m_banned[sub_net] = ban_entry;
             m_is_dirty = true;
+            PublishBanned();
         } else
             return;
     }
@@ -161,6 +173,7 @@ bool BanMan::Unban(const CSubNet& sub_net)
         LOCK(m_cs_banned);
         if (m_banned.erase(sub_net) == 0) return false;
         m_is_dirty = true;
+        PublishBanned();
     }
     if (m_client_interface) m_client_interface->BannedListChanged();
     DumpBanlist(); //store banlist to disk immediately
@@ -180,6 +193,7 @@ void BanMan::SetBanned(const banmap_t& banmap)
     LOCK(m_cs_banned);
     m_banned = banmap;
     m_is_dirty = true;
+    PublishBanned();
 }
 
 void BanMan::SweepBanned()
@@ -200,6 +214,7 @@ void BanMan::SweepBanned()
             } else
                 ++it;
         }
+        if (notify_ui) PublishBanned();
     }
     // update UI
     if (notify_ui && m_client_interface) {
@@ -57,9 +57,15 @@ private:
     void SetBannedSetDirty(bool dirty = true);
     //!clean unused entries (if bantime has expired)
     void SweepBanned();
+    //!replace the snapshot the ban checks read with a copy of m_banned
+    void PublishBanned() EXCLUSIVE_LOCKS_REQUIRED(m_cs_banned);
+    //!the banlist the ban checks read, updated on every change so the checks of incoming connections take no lock
+    std::shared_ptr<const banmap_t> GetBannedSnapshot() const;
 
     CCriticalSection m_cs_banned;
     banmap_t m_banned GUARDED_BY(m_cs_banned);
+    //!only accessed through std::atomic_load and std::atomic_store
+    std::shared_ptr<const banmap_t> m_banned_snapshot;
     bool m_is_dirty GUARDED_BY(m_cs_banned);
     CClientUIInterface* m_client_interface = nullptr;
     CBanDB m_ban_db;
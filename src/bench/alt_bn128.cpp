@@ -0,0 +1,57 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <libff/algebra/curves/alt_bn128/alt_bn128_pairing.hpp>
+#include <libff/algebra/curves/alt_bn128/alt_bn128_pp.hpp>
+#include <libff/common/profiling.hpp>
+
+#include <vector>
+
+// The work of the alt_bn128 precompiles of the EVM, ecmul and the pairing
+// check of a Groth16 proof verification, which multiplies four pairings.
+
+static void InitAltBn128()
+{
+    static bool fInit = false;
+    if (!fInit) {
+        libff::inhibit_profiling_info = true;
+        libff::inhibit_profiling_counters = true;
+        libff::alt_bn128_pp::init_public_params();
+        fInit = true;
+    }
+}
+
+static void AltBn128Mul(benchmark::State& state)
+{
+    InitAltBn128();
+    libff::alt_bn128_G1 p = libff::alt_bn128_G1::one();
+    libff::alt_bn128_Fr s = libff::alt_bn128_Fr("21888242871839275222246405745257275088548364400416034343698204186575808495616");
+    while (state.KeepRunning()) {
+        p = s * p;
+    }
+}
+
+static void AltBn128Pairing_4(benchmark::State& state)
+{
+    InitAltBn128();
+    std::vector<libff::alt_bn128_G1> g1;
+    std::vector<libff::alt_bn128_G2> g2;
+    for (int i = 1; i <= 4; i++) {
+        g1.push_back(libff::alt_bn128_Fr(i) * libff::alt_bn128_G1::one());
+        g2.push_back(libff::alt_bn128_Fr(i + 4) * libff::alt_bn128_G2::one());
+    }
+    while (state.KeepRunning()) {
+        libff::alt_bn128_Fq12 x = libff::alt_bn128_Fq12::one();
+        for (size_t i = 0; i < g1.size(); i++) {
+            x = x * libff::alt_bn128_miller_loop(libff::alt_bn128_precompute_G1(g1[i]), libff::alt_bn128_precompute_G2(g2[i]));
+        }
+        libff::alt_bn128_GT result = libff::alt_bn128_final_exponentiation(x);
+        (void)result;
+    }
+}
+
+BENCHMARK(AltBn128Mul, 2000);
+BENCHMARK(AltBn128Pairing_4, 50);
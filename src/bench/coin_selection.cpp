@@ -59,6 +59,45 @@ static void CoinSelection(benchmark::State& state)
     }
 }
 
+// Coin selection on a wallet with 100k coins of spread out values, the size of pools
+// the knapsack solver is not used for
+static void CoinSelectionLarge(benchmark::State& state, bool use_bnb)
+{
+    auto chain = interfaces::MakeChain();
+    const CWallet wallet(*chain, WalletLocation(), WalletDatabase::CreateDummy());
+    std::vector<std::unique_ptr<CWalletTx>> wtxs;
+    LOCK(wallet.cs_wallet);
+
+    FastRandomContext rand(true);
+    CAmount total = 0;
+    for (int i = 0; i < 100000; ++i) {
+        CAmount value = (1 + rand.randrange(10000)) * COIN / 100;
+        addCoin(value, wallet, wtxs);
+        total += value;
+    }
+
+    std::vector<OutputGroup> groups;
+    for (const auto& wtx : wtxs) {
+        COutput output(wtx.get(), 0 /* iIn */, 6 * 24 /* nDepthIn */, true /* spendable */, true /* solvable */, true /* safe */);
+        groups.emplace_back(output.GetInputCoin(), 6, false, 0, 0);
+    }
+
+    const CoinEligibilityFilter filter_standard(1, 6, 0);
+    const CoinSelectionParams coin_selection_params(use_bnb, 34, 148, CFeeRate(0), 0);
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool bnb_used;
+        bool success = wallet.SelectCoinsMinConf(total / 10, filter_standard, groups, setCoinsRet, nValueRet, coin_selection_params, bnb_used) ||
+                       wallet.SelectCoinsMinConf(total / 10, filter_standard, groups, setCoinsRet, nValueRet, CoinSelectionParams(false, 34, 148, CFeeRate(0), 0), bnb_used);
+        assert(success);
+        assert(nValueRet >= total / 10);
+    }
+}
+
+static void CoinSelectionLargeBnB(benchmark::State& state) { CoinSelectionLarge(state, true); }
+static void CoinSelectionLargeSorted(benchmark::State& state) { CoinSelectionLarge(state, false); }
+
 typedef std::set<CInputCoin> CoinSet;
 static auto testChain = interfaces::MakeChain();
 static const CWallet testWallet(*testChain, WalletLocation(), WalletDatabase::CreateDummy());
@@ -108,3 +147,5 @@ static void BnBExhaustion(benchmark::State& state)
 
 BENCHMARK(CoinSelection, 650);
 BENCHMARK(BnBExhaustion, 650);
+BENCHMARK(CoinSelectionLargeBnB, 5);
+BENCHMARK(CoinSelectionLargeSorted, 5);
@@ -10,6 +10,7 @@
 #include <random.h>
 #include <uint256.h>
 #include <util/time.h>
+#include <crypto/keccak.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -61,6 +62,44 @@ static void SHA256D64_1024(benchmark::State& state)
     }
 }
 
+static void SHA256DMany_1024(benchmark::State& state)
+{
+    // Stake kernel sized inputs
+    std::vector<uint8_t> in(1024 * 76, 0);
+    std::vector<const unsigned char*> ins(1024);
+    std::vector<size_t> lens(1024, 76);
+    for (size_t i = 0; i < ins.size(); i++) {
+        ins[i] = in.data() + 76 * i;
+    }
+    std::vector<uint8_t> out(1024 * 32);
+    while (state.KeepRunning()) {
+        SHA256DMany(out.data(), ins.data(), lens.data(), ins.size());
+    }
+}
+
+static void Keccak256(benchmark::State& state)
+{
+    uint8_t hash[CKeccak256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(BUFFER_SIZE,0);
+    while (state.KeepRunning())
+        CKeccak256().Write(in.data(), in.size()).Finalize(hash);
+}
+
+static void Keccak256Many_1024(benchmark::State& state)
+{
+    // Trie node sized inputs
+    std::vector<uint8_t> in(1024 * 100, 0);
+    std::vector<const unsigned char*> ins(1024);
+    std::vector<size_t> lens(1024, 100);
+    for (size_t i = 0; i < ins.size(); i++) {
+        ins[i] = in.data() + 100 * i;
+    }
+    std::vector<uint8_t> out(1024 * 32);
+    while (state.KeepRunning()) {
+        Keccak256Many(out.data(), ins.data(), lens.data(), ins.size());
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -98,9 +137,12 @@ BENCHMARK(RIPEMD160, 440);
 BENCHMARK(SHA1, 570);
 BENCHMARK(SHA256, 340);
 BENCHMARK(SHA512, 330);
+BENCHMARK(Keccak256, 340);
+BENCHMARK(Keccak256Many_1024, 7400);
 
 BENCHMARK(SHA256_32b, 4700 * 1000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(SHA256DMany_1024, 7400);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
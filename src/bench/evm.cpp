@@ -0,0 +1,270 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <bench/bench.h>
+#include <bench/evm.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <crypto/common.h>
+#include <qtum/qtumDGP.h>
+#include <qtum/storageresults.h>
+#include <random.h>
+#include <txdb.h>
+#include <util/convert.h>
+#include <util/strencodings.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+/*
+    Runtime code of the synthetic contracts, each behind an init code that returns it:
+
+    Storage: stores i at the slot calldata[0..32] + i for i from 0 to 31
+        PUSH1 0 JUMPDEST DUP1 DUP1 PUSH1 0 CALLDATALOAD ADD SSTORE
+        PUSH1 1 ADD DUP1 PUSH1 0x20 GT PUSH1 2 JUMPI STOP
+
+    Token: moves calldata[32..64] from the balance of the caller to the balance of
+    calldata[0..32] and logs a QRC20 Transfer(caller, to, amount) event
+*/
+static const valtype STORAGE_CODE(ParseHex("601580600b6000396000f360005b808060003501556001018060201160025700"));
+static const valtype TOKEN_CODE(ParseHex("604180600b6000396000f360203580335403335580600035540160003555600052600035337fddf252ad1be2c89b69c2b068fc378daa952ba7f163c4a11628f55a4df523b3ef60206000a300"));
+
+static const dev::Address SENDER("0101010101010101010101010101010101010101");
+static const dev::u256 GAS_LIMIT(1000000);
+
+EVMBenchSetup::EVMBenchSetup()
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const CChainParams& chainparams = Params();
+    UnloadBlockIndex();
+
+    m_state_dir = GetDataDir() / strprintf("stateEVMBench%d", GetRand(1000000));
+    {
+        LOCK(cs_main);
+        ::pblocktree.reset(new CBlockTreeDB(1 << 20, true));
+        ::pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true));
+        ::pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+
+        const std::string dirQtum(m_state_dir.string());
+        const dev::h256 hashDB(dev::sha3(dev::rlp("")));
+        ::globalState = std::unique_ptr<QtumState>(new QtumState(dev::u256(0), QtumState::openDB(dirQtum, hashDB, dev::WithExisting::Trust), dirQtum, dev::eth::BaseState::Empty));
+        dev::eth::ChainParams cp((chainparams.EVMGenesisInfo(dev::eth::Network::qtumMainNetwork)));
+        ::globalSealEngine = std::unique_ptr<dev::eth::SealEngineFace>(cp.createSealEngine());
+        ::pstorageresult.reset(new StorageResults(dirQtum));
+
+        ::globalState->setRoot(dev::sha3(dev::rlp("")));
+        ::globalState->setRootUTXO(uintToh256(chainparams.GenesisBlock().hashUTXORoot));
+        ::globalState->populateFrom(cp.genesisState);
+        ::globalState->db().commit();
+        ::globalState->dbUtxo().commit();
+    }
+
+    m_thread_group.create_thread(std::bind(&CScheduler::serviceQueue, &m_scheduler));
+    GetMainSignals().RegisterBackgroundSignalScheduler(m_scheduler);
+    LoadGenesisBlock(chainparams);
+    CValidationState state;
+    ActivateBestChain(state, chainparams);
+    assert(::chainActive.Tip() != nullptr);
+}
+
+EVMBenchSetup::~EVMBenchSetup()
+{
+    m_thread_group.interrupt_all();
+    m_thread_group.join_all();
+    GetMainSignals().FlushBackgroundCallbacks();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+
+    UnloadBlockIndex();
+    ::pblocktree.reset();
+    ::pcoinsTip.reset();
+    ::pcoinsdbview.reset();
+    ::pstorageresult.reset();
+    ::globalState.reset();
+    ::globalSealEngine.reset();
+    fs::remove_all(m_state_dir);
+}
+
+static CBlock generateBlock()
+{
+    CBlock block;
+    CMutableTransaction tx;
+    tx.vout.push_back(CTxOut(0, CScript() << OP_DUP << OP_HASH160 << SENDER.asBytes() << OP_EQUALVERIFY << OP_CHECKSIG));
+    block.vtx.push_back(MakeTransactionRef(CTransaction(tx)));
+    return block;
+}
+
+static QtumTransaction createQtumTransaction(const valtype& data, const dev::Address& recipient, uint64_t n)
+{
+    QtumTransaction txEth;
+    if (recipient == dev::Address()) {
+        txEth = QtumTransaction(dev::u256(0), dev::u256(1), GAS_LIMIT, data, dev::u256(0));
+    } else {
+        txEth = QtumTransaction(dev::u256(0), dev::u256(1), GAS_LIMIT, recipient, data, dev::u256(0));
+    }
+    txEth.forceSender(SENDER);
+    txEth.setHashWith(uintToh256(ArithToUint256(arith_uint256(n))));
+    txEth.setNVout(0);
+    txEth.setVersion(VersionVM::GetEVMDefault());
+    return txEth;
+}
+
+static std::vector<ResultExecute> executeBlock(const std::vector<QtumTransaction>& txs)
+{
+    LOCK(cs_main);
+    CBlock block(generateBlock());
+    QtumDGP qtumDGP(globalState.get(), fGettingValuesDGP);
+    uint64_t blockGasLimit = qtumDGP.getBlockGasLimit(chainActive.Tip()->nHeight + 1);
+    ByteCodeExec exec(block, txs, blockGasLimit, chainActive.Tip());
+    bool ret = exec.performByteCode();
+    assert(ret);
+    return exec.getResult();
+}
+
+static dev::Address createContract(const valtype& code, uint64_t n)
+{
+    std::vector<ResultExecute> res = executeBlock(std::vector<QtumTransaction>(1, createQtumTransaction(code, dev::Address(), n)));
+    assert(res.size() == 1 && res[0].execRes.excepted == dev::eth::TransactionException::None);
+    return res[0].execRes.newAddress;
+}
+
+static valtype transferData(uint64_t to, uint64_t amount)
+{
+    valtype data(64, 0);
+    WriteBE64(data.data() + 24, to);
+    WriteBE64(data.data() + 56, amount);
+    return data;
+}
+
+// Execute blocks of 100 contract creations
+static void EVMCreateContracts(benchmark::State& state)
+{
+    EVMBenchSetup setup;
+    uint64_t n = 0;
+    while (state.KeepRunning()) {
+        std::vector<QtumTransaction> txs;
+        for (int i = 0; i < 100; ++i) {
+            txs.push_back(createQtumTransaction(STORAGE_CODE, dev::Address(), ++n));
+        }
+        executeBlock(txs);
+    }
+}
+
+// Execute blocks of 1000 token transfers to new receivers
+static void EVMTokenTransfers(benchmark::State& state)
+{
+    EVMBenchSetup setup;
+    uint64_t n = 0;
+    dev::Address token = createContract(TOKEN_CODE, ++n);
+    while (state.KeepRunning()) {
+        std::vector<QtumTransaction> txs;
+        for (int i = 0; i < 1000; ++i) {
+            ++n;
+            txs.push_back(createQtumTransaction(transferData(n, 1), token, n));
+        }
+        executeBlock(txs);
+    }
+}
+
+// Execute blocks of 100 calls that each write 32 new storage slots
+static void EVMStorageCalls(benchmark::State& state)
+{
+    EVMBenchSetup setup;
+    uint64_t n = 0;
+    dev::Address contract = createContract(STORAGE_CODE, ++n);
+    while (state.KeepRunning()) {
+        std::vector<QtumTransaction> txs;
+        for (int i = 0; i < 100; ++i) {
+            ++n;
+            valtype data(32, 0);
+            WriteBE64(data.data() + 24, n << 8);
+            txs.push_back(createQtumTransaction(data, contract, n));
+        }
+        executeBlock(txs);
+    }
+}
+
+// Extract the contract transactions of a block of 1000 token transfer transactions
+static void EVMExtractTransactions(benchmark::State& state)
+{
+    EVMBenchSetup setup;
+    const CScript senderScript = CScript() << OP_DUP << OP_HASH160 << SENDER.asBytes() << OP_EQUALVERIFY << OP_CHECKSIG;
+    const valtype tokenAddress(20, 0xab);
+
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    std::vector<CTransaction> txs;
+    for (uint64_t i = 0; i < 1000; ++i) {
+        COutPoint prevout(ArithToUint256(arith_uint256(i + 1)), 0);
+        view.AddCoin(prevout, Coin(CTxOut(COIN, senderScript), 1, false, false), false);
+
+        CMutableTransaction tx;
+        tx.vin.push_back(CTxIn(prevout));
+        tx.vout.push_back(CTxOut(0, CScript() << CScriptNum(VersionVM::GetEVMDefault().toRaw()) << CScriptNum(int64_t(GAS_LIMIT)) << CScriptNum(1) << transferData(i, 1) << tokenAddress << OP_CALL));
+        tx.vout.push_back(CTxOut(COIN / 2, senderScript));
+        txs.emplace_back(tx);
+    }
+
+    while (state.KeepRunning()) {
+        for (const CTransaction& tx : txs) {
+            QtumTxConverter converter(tx, &view);
+            ExtractQtumTX qtumTx;
+            bool ret = converter.extractionQtumTransactions(qtumTx);
+            assert(ret && qtumTx.first.size() == 1);
+        }
+    }
+}
+
+// Latency of a read-only call on the tip state
+static void EVMCallContract(benchmark::State& state)
+{
+    EVMBenchSetup setup;
+    uint64_t n = 0;
+    dev::Address token = createContract(TOKEN_CODE, ++n);
+    valtype data = transferData(1, 1);
+    while (state.KeepRunning()) {
+        std::vector<ResultExecute> res = CallContract(token, data, SENDER);
+        assert(res.size() == 1);
+    }
+}
+
+// Add, commit and read back the receipts of blocks of 1000 transactions
+static void EVMStorageResults(benchmark::State& state)
+{
+    fs::path dir = GetDataDir() / strprintf("storageResultsBench%d", GetRand(1000000));
+    fs::create_directories(dir);
+    {
+        StorageResults results(dir.string());
+        FastRandomContext rand(true);
+        while (state.KeepRunning()) {
+            std::vector<dev::h256> hashes;
+            for (int i = 0; i < 1000; ++i) {
+                TransactionReceiptInfo tri;
+                tri.blockHash = rand.rand256();
+                tri.blockNumber = 1;
+                tri.transactionHash = rand.rand256();
+                tri.transactionIndex = i;
+                tri.gasUsed = 21000;
+                tri.cumulativeGasUsed = 21000 * (i + 1);
+                tri.excepted = dev::eth::TransactionException::None;
+                tri.logs.push_back(dev::eth::LogEntry(SENDER, {dev::h256(uintToh256(rand.rand256()))}, dev::bytes(32)));
+                std::vector<TransactionReceiptInfo> tris(1, tri);
+                hashes.push_back(uintToh256(tri.transactionHash));
+                results.addResult(hashes.back(), tris);
+            }
+            results.commitResults();
+            for (const dev::h256& hash : hashes) {
+                assert(results.readCommittedResult(hash).size() == 1);
+            }
+        }
+    }
+    fs::remove_all(dir);
+}
+
+BENCHMARK(EVMCreateContracts, 5);
+BENCHMARK(EVMTokenTransfers, 2);
+BENCHMARK(EVMStorageCalls, 5);
+BENCHMARK(EVMExtractTransactions, 5);
+BENCHMARK(EVMCallContract, 500);
+BENCHMARK(EVMStorageResults, 5);
@@ -0,0 +1,29 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_EVM_H
+#define BITCOIN_BENCH_EVM_H
+
+#include <fs.h>
+#include <scheduler.h>
+
+#include <boost/thread.hpp>
+
+/**
+ * Regtest chain at the genesis block with the EVM state in a new directory of the bench datadir,
+ * set up the way block_assemble does it and torn down at the end of the bench
+ */
+class EVMBenchSetup
+{
+public:
+    EVMBenchSetup();
+    ~EVMBenchSetup();
+
+private:
+    fs::path m_state_dir;
+    boost::thread_group m_thread_group;
+    CScheduler m_scheduler;
+};
+
+#endif // BITCOIN_BENCH_EVM_H
@@ -0,0 +1,118 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/evm.h>
+#include <chainparams.h>
+#include <locktrip/dgp.h>
+#include <locktrip/economy.h>
+#include <locktrip/lydra.h>
+#include <locktrip/price-oracle.h>
+#include <util/strencodings.h>
+#include <validation.h>
+
+static const std::string HOLDER("0101010101010101010101010101010101010101");
+
+// Lydra proxy with the call data encoders exposed
+class BenchLydra : public Lydra
+{
+public:
+    using Lydra::generateCallString;
+    using Lydra::generateCallData;
+};
+
+// DGP parameter read, as done for the gas price, burn rate and block limits of every block
+static void LockTripDgpParam(benchmark::State& state)
+{
+    EVMBenchSetup setup;
+    Dgp dgp;
+    while (state.KeepRunning()) {
+        uint64_t value;
+        dgp.getDgpParam(FIAT_GAS_PRICE, value);
+    }
+}
+
+// Price oracle call for the gas price, and the same price through the per chain state cache
+static void LockTripOracleGetPrice(benchmark::State& state)
+{
+    EVMBenchSetup setup;
+    PriceOracle oracle;
+    while (state.KeepRunning()) {
+        uint64_t gasPrice;
+        oracle.getPrice(gasPrice);
+    }
+}
+
+static void LockTripOracleCachedPrice(benchmark::State& state)
+{
+    EVMBenchSetup setup;
+    while (state.KeepRunning()) {
+        uint64_t gasPrice;
+        GetCachedOracleGasPrice(gasPrice);
+    }
+}
+
+// Owner lookup of the economy contract, done for the dividends of the contract transactions
+static void LockTripEconomyContractOwner(benchmark::State& state)
+{
+    EVMBenchSetup setup;
+    Economy economy;
+    bool deployed;
+    {
+        LOCK(cs_main);
+        deployed = globalState->addressInUse(LockTripEconomyContract);
+    }
+    while (state.KeepRunning()) {
+        // The owner lookup expects the contract output, skip it on a chain without the contract
+        if (!deployed)
+            continue;
+        dev::Address owner;
+        economy.getContractOwner(dev::Address(HOLDER), owner);
+    }
+}
+
+// Locked HYDRA of an address on the Lydra contract
+static void LockTripLydraLockedAmount(benchmark::State& state)
+{
+    EVMBenchSetup setup;
+    Lydra lydra;
+    while (state.KeepRunning()) {
+        uint64_t amount;
+        lydra.getLockedHydraAmountPerAddress(HOLDER, amount);
+    }
+}
+
+// Call data of a getter built from the ABI strings and hex, and straight from the selector
+static void LockTripCallString(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    BenchLydra lydra;
+    while (state.KeepRunning()) {
+        std::vector<std::vector<std::string>> values{{HOLDER}};
+        std::string callString;
+        lydra.generateCallString(values, callString, LOCKED_BALANCE);
+        dev::bytes callData = ParseHex(callString);
+        assert(callData.size() == 36);
+    }
+}
+
+static void LockTripCallData(benchmark::State& state)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    BenchLydra lydra;
+    const dev::h256 holder(dev::Address(HOLDER), dev::h256::AlignRight);
+    while (state.KeepRunning()) {
+        dev::bytes callData;
+        lydra.generateCallData({holder}, callData, LOCKED_BALANCE);
+        assert(callData.size() == 36);
+    }
+}
+
+BENCHMARK(LockTripDgpParam, 5000);
+BENCHMARK(LockTripOracleGetPrice, 500);
+BENCHMARK(LockTripOracleCachedPrice, 5000);
+BENCHMARK(LockTripEconomyContractOwner, 500);
+BENCHMARK(LockTripLydraLockedAmount, 5000);
+BENCHMARK(LockTripCallString, 50000);
+BENCHMARK(LockTripCallData, 500000);
@@ -0,0 +1,117 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <interfaces/chain.h>
+#include <key.h>
+#include <key_io.h>
+#include <random.h>
+#include <util/strencodings.h>
+#include <wallet/wallet.h>
+
+#include <map>
+#include <vector>
+
+// Fill the wallet with coins paying to its own keys, the way the staker finds them in mapWallet
+static std::vector<uint256> addStakingCoins(CWallet& wallet, int nKeys, int nCoins)
+{
+    std::vector<CScript> scripts;
+    for (int i = 0; i < nKeys; ++i) {
+        CKey key;
+        key.MakeNewKey(true);
+        CPubKey pubkey = key.GetPubKey();
+        wallet.LoadKey(key, pubkey);
+        scripts.push_back(GetScriptForDestination(pubkey.GetID()));
+    }
+
+    FastRandomContext rand(true);
+    std::vector<uint256> txs;
+    for (int i = 0; i < nCoins; ++i) {
+        CMutableTransaction tx;
+        tx.nLockTime = i; // so all transactions get different hashes
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(rand.rand256(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = (1 + rand.randrange(1000)) * COIN;
+        tx.vout[0].scriptPubKey = scripts[i % nKeys];
+        CWalletTx wtx(&wallet, MakeTransactionRef(std::move(tx)));
+        wallet.LoadToWallet(wtx);
+        txs.push_back(wtx.GetHash());
+    }
+    return txs;
+}
+
+// Look up the stakeable coins of a wallet with many utxos, with the script data of the
+// coins computed again each time (cold) or taken from the wallet cache (warm)
+static void AvailableCoinsForStaking(benchmark::State& state, int nCoins, bool warm)
+{
+    auto chain = interfaces::MakeChain();
+    CWallet wallet(*chain, WalletLocation(), WalletDatabase::CreateDummy());
+    wallet.m_staker_max_utxo_script_cache = nCoins;
+    auto locked_chain = chain->lock();
+    LOCK(wallet.cs_wallet);
+    std::vector<uint256> maturedTx = addStakingCoins(wallet, 1000, nCoins);
+
+    const std::map<COutPoint, uint32_t> immatureStakes;
+    while (state.KeepRunning()) {
+        std::vector<std::pair<const CWalletTx*, unsigned int>> vCoins;
+        std::map<COutPoint, CScriptCache> scriptCache;
+        wallet.AvailableCoinsForStaking(*locked_chain, maturedTx, 0, maturedTx.size(), immatureStakes, vCoins, warm ? nullptr : &scriptCache);
+        assert(vCoins.size() == maturedTx.size());
+    }
+}
+
+static void AvailableCoinsForStaking10k(benchmark::State& state) { AvailableCoinsForStaking(state, 10000, false); }
+static void AvailableCoinsForStaking100k(benchmark::State& state) { AvailableCoinsForStaking(state, 100000, false); }
+static void AvailableCoinsForStaking100kCached(benchmark::State& state) { AvailableCoinsForStaking(state, 100000, true); }
+
+static CTokenTx makeTokenTx(FastRandomContext& rand, const std::vector<std::string>& contracts, const std::vector<std::string>& addresses, int n)
+{
+    CTokenTx tokenTx;
+    tokenTx.strContractAddress = contracts[n % contracts.size()];
+    tokenTx.strSenderAddress = addresses[rand.randrange(addresses.size())];
+    tokenTx.strReceiverAddress = addresses[rand.randrange(addresses.size())];
+    tokenTx.nValue = rand.rand256();
+    tokenTx.transactionHash = rand.rand256();
+    tokenTx.blockNumber = n;
+    return tokenTx;
+}
+
+// Token transaction bookkeeping: add the token transfers of a block to a wallet that
+// already has 100k of them, and list the transfers of one contract and address
+static void TokenTxEntries(benchmark::State& state)
+{
+    auto chain = interfaces::MakeChain();
+    CWallet wallet(*chain, WalletLocation(), WalletDatabase::CreateDummy());
+
+    FastRandomContext rand(true);
+    std::vector<std::string> contracts;
+    for (int i = 0; i < 100; ++i) {
+        contracts.push_back(HexStr(rand.randbytes(20)));
+    }
+    std::vector<std::string> addresses;
+    for (int i = 0; i < 1000; ++i) {
+        addresses.push_back(EncodeDestination(CKeyID(uint160(rand.randbytes(20)))));
+    }
+
+    int n = 0;
+    for (; n < 100000; ++n) {
+        wallet.AddTokenTxEntry(makeTokenTx(rand, contracts, addresses, n), false);
+    }
+
+    while (state.KeepRunning()) {
+        for (int i = 0; i < 100; ++i) {
+            bool ret = wallet.AddTokenTxEntry(makeTokenTx(rand, contracts, addresses, n++), false);
+            assert(ret);
+        }
+
+        std::vector<CTokenTx> entries = wallet.GetTokenTxEntries(contracts[0], addresses[0]);
+        assert(entries.size() <= (size_t)n);
+    }
+}
+
+BENCHMARK(AvailableCoinsForStaking10k, 20);
+BENCHMARK(AvailableCoinsForStaking100k, 2);
+BENCHMARK(AvailableCoinsForStaking100kCached, 5);
+BENCHMARK(TokenTxEntries, 50);
@@ -0,0 +1,695 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#include <chainparamsbase.h>
+#include <clientversion.h>
+#include <fs.h>
+#include <rpc/protocol.h>
+#include <util/strencodings.h>
+#include <util/system.h>
+#include <util/time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <tuple>
+
+#include <event2/buffer.h>
+#include <event2/keyvalq_struct.h>
+#include <support/events.h>
+
+#include <univalue.h>
+
+#include <boost/algorithm/string.hpp>
+
+const std::function<std::string(const char*)> G_TRANSLATION_FUN = nullptr;
+
+static const char DEFAULT_RPCCONNECT[] = "127.0.0.1";
+static const int DEFAULT_HTTP_CLIENT_TIMEOUT = 900;
+static const int DEFAULT_RATE = 10;
+static const int DEFAULT_DURATION = 60;
+static const int DEFAULT_THREADS = 4;
+static const char DEFAULT_MIX[] = "transfer=7,token=2,create=1";
+static const int DEFAULT_SENDERS = 10;
+static const char DEFAULT_SENDER_FUNDS[] = "100";
+static const char DEFAULT_TRANSFER_AMOUNT[] = "0.01";
+static const int DEFAULT_BLOCK_INTERVAL = 0;
+static const int DEFAULT_INCLUSION_WAIT = 120;
+static const int DEFAULT_DELEGATION_FEE = 10;
+static const int64_t TOKEN_GAS_LIMIT = 100000;
+static const int64_t CREATE_GAS_LIMIT = 2500000;
+
+// A token with only a transfer: any call moves the amount in the second argument from the caller to the address
+// in the first argument and logs a QRC20 Transfer event. Nothing is checked, so any sender can call it.
+static const char TOKEN_BYTECODE[] = "67ffffffffffffffff33556041601760003960416000f360243533548190033355600435805482019055600052600435337fddf252ad1be2c89b69c2b068fc378daa952ba7f163c4a11628f55a4df523b3ef60206000a300";
+static const char TOKEN_TRANSFER_SELECTOR[] = "a9059cbb";
+
+enum class LoadKind { TRANSFER, TOKEN, CREATE, DELEGATE };
+static const std::vector<std::pair<LoadKind, std::string>> LOAD_KIND_NAMES = {
+    {LoadKind::TRANSFER, "transfer"},
+    {LoadKind::TOKEN, "token"},
+    {LoadKind::CREATE, "create"},
+    {LoadKind::DELEGATE, "delegate"},
+};
+
+static void SetupLoadgenArgs()
+{
+    SetupHelpOptions(gArgs);
+
+    const auto defaultBaseParams = CreateBaseChainParams(CBaseChainParams::MAIN);
+    const auto testnetBaseParams = CreateBaseChainParams(CBaseChainParams::TESTNET);
+    const auto regtestBaseParams = CreateBaseChainParams(CBaseChainParams::REGTEST);
+
+    gArgs.AddArg("-version", "Print version and exit", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-conf=<file>", strprintf("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-datadir=<dir>", "Specify data directory", false, OptionsCategory::OPTIONS);
+    SetupChainParamsBaseOptions();
+    gArgs.AddArg("-rpcclienttimeout=<n>", strprintf("Timeout in seconds during HTTP requests, or 0 for no timeout. (default: %d)", DEFAULT_HTTP_CLIENT_TIMEOUT), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-rpcconnect=<ip>", strprintf("Send commands to node running on <ip> (default: %s)", DEFAULT_RPCCONNECT), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-rpccookiefile=<loc>", "Location of the auth cookie. Relative paths will be prefixed by a net-specific datadir location. (default: data dir)", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-rpcpassword=<pw>", "Password for JSON-RPC connections", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-rpcport=<port>", strprintf("Connect to JSON-RPC on <port> (default: %u, testnet: %u, regtest: %u)", defaultBaseParams->RPCPort(), testnetBaseParams->RPCPort(), regtestBaseParams->RPCPort()), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-rpcuser=<user>", "Username for JSON-RPC connections", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-rpcwallet=<walletname>", "Wallet of the node the transactions are funded and signed with", false, OptionsCategory::OPTIONS);
+
+    gArgs.AddArg("-blockinterval=<n>", strprintf("Generate a block every <n> seconds, for regtest nodes nobody else mines on, 0 to wait for the network (default: %d)", DEFAULT_BLOCK_INTERVAL), false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-count=<n>", "Number of transactions to send, instead of sending for -duration", false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-delegationstaker=<address>", "Staker the delegations of the delegate transactions are for, required when the mix has delegate transactions", false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-duration=<n>", strprintf("Seconds to send transactions for (default: %d)", DEFAULT_DURATION), false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-inclusionwait=<n>", strprintf("Seconds to wait for the sent transactions to be included in blocks after the last one is sent (default: %d)", DEFAULT_INCLUSION_WAIT), false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-mix=<kind=weight,...>", strprintf("Relative rates of the kinds of transactions: transfer, token (a call of a QRC20 transfer), create (a contract creation) and delegate (default: %s)", DEFAULT_MIX), false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-rate=<n>", strprintf("Transactions to send per second (default: %d)", DEFAULT_RATE), false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-senderfunds=<amt>", strprintf("Amount the wallet sends to each sender address before the load starts (default: %s)", DEFAULT_SENDER_FUNDS), false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-senders=<n>", strprintf("Sender addresses of the contract transactions, and delegating addresses, the unconfirmed transactions of an address chain (default: %d)", DEFAULT_SENDERS), false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-threads=<n>", strprintf("Number of RPC connections sending transactions in parallel (default: %d)", DEFAULT_THREADS), false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-token=<address>", "Contract the token transactions call, by default a token is created before the load starts", false, OptionsCategory::COMMANDS);
+    gArgs.AddArg("-transferamount=<amt>", strprintf("Amount of the transfer transactions (default: %s)", DEFAULT_TRANSFER_AMOUNT), false, OptionsCategory::COMMANDS);
+}
+
+/** libevent event log callback */
+static void libevent_log_cb(int severity, const char *msg)
+{
+#ifndef EVENT_LOG_ERR // EVENT_LOG_ERR was added in 2.0.19; but before then _EVENT_LOG_ERR existed.
+# define EVENT_LOG_ERR _EVENT_LOG_ERR
+#endif
+    // Ignore everything other than errors
+    if (severity >= EVENT_LOG_ERR) {
+        throw std::runtime_error(strprintf("libevent error: %s", msg));
+    }
+}
+
+static bool AppInitLoadgen(int argc, char* argv[], int& ret)
+{
+    SetupLoadgenArgs();
+    std::string error;
+    if (!gArgs.ParseParameters(argc, argv, error)) {
+        tfm::format(std::cerr, "Error parsing command line arguments: %s\n", error.c_str());
+        ret = EXIT_FAILURE;
+        return false;
+    }
+    if (HelpRequested(gArgs) || gArgs.IsArgSet("-version")) {
+        std::string strUsage = PACKAGE_NAME " load generator version " + FormatFullVersion() + "\n";
+        if (!gArgs.IsArgSet("-version")) {
+            strUsage += "\n"
+                "Usage:  hydra-loadgen [options]  Send transactions funded and signed by the wallet of a regtest or testnet " PACKAGE_NAME " node\n"
+                "at a given rate over RPC, and report their admission latency, inclusion delay and reject reasons as JSON\n";
+            strUsage += "\n" + gArgs.GetHelpMessage();
+        }
+        tfm::format(std::cout, "%s", strUsage.c_str());
+        ret = EXIT_SUCCESS;
+        return false;
+    }
+    if (!fs::is_directory(GetDataDir(false))) {
+        tfm::format(std::cerr, "Error: Specified data directory \"%s\" does not exist.\n", gArgs.GetArg("-datadir", "").c_str());
+        ret = EXIT_FAILURE;
+        return false;
+    }
+    if (!gArgs.ReadConfigFiles(error, true)) {
+        tfm::format(std::cerr, "Error reading configuration file: %s\n", error.c_str());
+        ret = EXIT_FAILURE;
+        return false;
+    }
+    try {
+        SelectBaseParams(gArgs.GetChainName());
+    } catch (const std::exception& e) {
+        tfm::format(std::cerr, "Error: %s\n", e.what());
+        ret = EXIT_FAILURE;
+        return false;
+    }
+    return true;
+}
+
+/** Reply structure for request_done to fill in */
+struct HTTPReply
+{
+    HTTPReply(): status(0), error(-1) {}
+
+    int status;
+    int error;
+    std::string body;
+};
+
+static void http_request_done(struct evhttp_request *req, void *ctx)
+{
+    HTTPReply *reply = static_cast<HTTPReply*>(ctx);
+
+    if (req == nullptr) {
+        reply->status = 0;
+        return;
+    }
+
+    reply->status = evhttp_request_get_response_code(req);
+
+    struct evbuffer *buf = evhttp_request_get_input_buffer(req);
+    if (buf)
+    {
+        size_t size = evbuffer_get_length(buf);
+        const char *data = (const char*)evbuffer_pullup(buf, size);
+        if (data)
+            reply->body = std::string(data, size);
+        evbuffer_drain(buf, size);
+    }
+}
+
+#if LIBEVENT_VERSION_NUMBER >= 0x02010300
+static void http_error_cb(enum evhttp_request_error err, void *ctx)
+{
+    HTTPReply *reply = static_cast<HTTPReply*>(ctx);
+    reply->error = err;
+}
+#endif
+
+/** Error returned by the node for a call, as opposed to a failure to reach it */
+class RPCCallError : public std::runtime_error
+{
+public:
+    explicit RPCCallError(const std::string& msg) : std::runtime_error(msg) {}
+};
+
+/** Call a method of the node, a connection per call as hydra-cli makes, so calls of different threads do not wait for each other */
+static UniValue CallRPCParams(const std::string& strMethod, const UniValue& params)
+{
+    std::string host;
+    int port = BaseParams().RPCPort();
+    SplitHostPort(gArgs.GetArg("-rpcconnect", DEFAULT_RPCCONNECT), port, host);
+    port = gArgs.GetArg("-rpcport", port);
+
+    raii_event_base base = obtain_event_base();
+    raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), host, port);
+    evhttp_connection_set_timeout(evcon.get(), gArgs.GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
+
+    HTTPReply response;
+    raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
+    if (req == nullptr)
+        throw std::runtime_error("create http request failed");
+#if LIBEVENT_VERSION_NUMBER >= 0x02010300
+    evhttp_request_set_error_cb(req.get(), http_error_cb);
+#endif
+
+    std::string strRPCUserColonPass;
+    if (gArgs.GetArg("-rpcpassword", "") == "") {
+        if (!GetAuthCookie(&strRPCUserColonPass)) {
+            throw std::runtime_error("Could not locate RPC credentials. No authentication cookie could be found, and RPC password is not set.");
+        }
+    } else {
+        strRPCUserColonPass = gArgs.GetArg("-rpcuser", "") + ":" + gArgs.GetArg("-rpcpassword", "");
+    }
+
+    struct evkeyvalq* output_headers = evhttp_request_get_output_headers(req.get());
+    assert(output_headers);
+    evhttp_add_header(output_headers, "Host", host.c_str());
+    evhttp_add_header(output_headers, "Connection", "close");
+    evhttp_add_header(output_headers, "Authorization", (std::string("Basic ") + EncodeBase64(strRPCUserColonPass)).c_str());
+
+    std::string strRequest = JSONRPCRequestObj(strMethod, params, 1).write() + "\n";
+    struct evbuffer* output_buffer = evhttp_request_get_output_buffer(req.get());
+    assert(output_buffer);
+    evbuffer_add(output_buffer, strRequest.data(), strRequest.size());
+
+    std::string endpoint = "/";
+    if (!gArgs.GetArgs("-rpcwallet").empty()) {
+        std::string walletName = gArgs.GetArg("-rpcwallet", "");
+        char *encodedURI = evhttp_uriencode(walletName.c_str(), walletName.size(), false);
+        if (!encodedURI) {
+            throw std::runtime_error("uri-encode failed");
+        }
+        endpoint = "/wallet/" + std::string(encodedURI);
+        free(encodedURI);
+    }
+    int r = evhttp_make_request(evcon.get(), req.get(), EVHTTP_REQ_POST, endpoint.c_str());
+    req.release(); // ownership moved to evcon in above call
+    if (r != 0) {
+        throw std::runtime_error("send http request failed");
+    }
+
+    event_base_dispatch(base.get());
+
+    if (response.status == 0) {
+        throw std::runtime_error(strprintf("Could not connect to the server %s:%d (error code %d)", host, port, response.error));
+    } else if (response.status == HTTP_UNAUTHORIZED) {
+        throw std::runtime_error("Authorization failed: Incorrect rpcuser or rpcpassword");
+    } else if (response.status >= 400 && response.status != HTTP_BAD_REQUEST && response.status != HTTP_NOT_FOUND && response.status != HTTP_INTERNAL_SERVER_ERROR) {
+        throw std::runtime_error(strprintf("server returned HTTP error %d", response.status));
+    } else if (response.body.empty()) {
+        throw std::runtime_error("no response from server");
+    }
+
+    UniValue reply;
+    if (!reply.read(response.body) || !reply.isObject())
+        throw std::runtime_error("couldn't parse reply from server");
+    const UniValue& error = find_value(reply, "error");
+    if (!error.isNull()) {
+        const UniValue& message = find_value(error, "message");
+        throw RPCCallError(message.isStr() ? message.get_str() : error.write());
+    }
+    return find_value(reply, "result");
+}
+
+static UniValue CallRPC(const std::string& strMethod, std::vector<UniValue> args = {})
+{
+    UniValue params(UniValue::VARR);
+    for (UniValue& arg : args) {
+        params.push_back(std::move(arg));
+    }
+    return CallRPCParams(strMethod, params);
+}
+
+/** Amounts are passed as strings, the node parses them without rounding */
+static UniValue AmountArg(const std::string& name, const char* defaultValue)
+{
+    UniValue amount(UniValue::VNUM);
+    if (!amount.setNumStr(gArgs.GetArg(name, defaultValue)))
+        throw std::runtime_error(strprintf("Invalid amount for %s", name));
+    return amount;
+}
+
+/** The txid in the result of one of the send methods */
+static std::string ResultTxid(const UniValue& result)
+{
+    if (result.isStr())
+        return result.get_str();
+    if (result.isArray() && !result.empty())
+        return ResultTxid(result[0]);
+    const UniValue& txid = find_value(result, "txid");
+    if (!txid.isStr())
+        throw std::runtime_error("no txid in the result " + result.write());
+    return txid.get_str();
+}
+
+static std::string Uint256Hex(uint64_t value)
+{
+    return strprintf("%064x", value);
+}
+
+/** Sorted samples, summarized by their percentiles */
+static UniValue SummarizeSamples(std::vector<int64_t> samples, int64_t unit)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("count", (int64_t)samples.size());
+    if (samples.empty())
+        return ret;
+    std::sort(samples.begin(), samples.end());
+    int64_t sum = 0;
+    for (int64_t sample : samples)
+        sum += sample;
+    auto percentile = [&](int p) { return (double)samples[std::min(samples.size() - 1, samples.size() * p / 100)] / unit; };
+    ret.pushKV("avg", (double)sum / samples.size() / unit);
+    ret.pushKV("p50", percentile(50));
+    ret.pushKV("p90", percentile(90));
+    ret.pushKV("p99", percentile(99));
+    ret.pushKV("max", (double)samples.back() / unit);
+    return ret;
+}
+
+class LoadGenerator
+{
+public:
+    void Setup();
+    void Run();
+    UniValue Report() const;
+
+private:
+    struct KindStats {
+        int64_t nSent = 0;
+        int64_t nAccepted = 0;
+        //! Microseconds from the call to its reply, the wallet funds and signs the transaction before the mempool admits it
+        std::vector<int64_t> vLatencies;
+        //! Seconds from the reply to the first block with the transaction
+        std::vector<int64_t> vInclusionDelays;
+    };
+
+    struct Pending {
+        LoadKind kind;
+        int64_t nTimeAccepted;
+    };
+
+    std::vector<LoadKind> m_schedule;
+    std::vector<std::string> m_receivers;
+    std::vector<std::string> m_senders;
+    std::string m_token;
+    std::string m_staker;
+    UniValue m_accept_stats_start;
+
+    int64_t m_rate = DEFAULT_RATE;
+    int64_t m_count = 0;
+    int64_t m_time_start = 0;
+    int64_t m_time_end = 0;
+
+    mutable std::mutex m_mutex;
+    int64_t m_next = 0;
+    std::atomic<int> m_sending{0};
+    std::map<LoadKind, KindStats> m_stats;
+    std::map<std::string, Pending> m_pending;
+    std::map<std::string, int64_t> m_rejects;
+    int m_last_height = 0;
+    int64_t m_last_block_time = 0;
+
+    void ParseMix();
+    void WaitForConfirmation(const std::vector<std::string>& txids);
+    void PollBlocks();
+    bool NextSlot(int64_t& index, int64_t& due);
+    std::string Send(LoadKind kind, int64_t index);
+    void ThreadSend();
+};
+
+void LoadGenerator::ParseMix()
+{
+    std::vector<std::string> parts;
+    boost::split(parts, gArgs.GetArg("-mix", DEFAULT_MIX), boost::is_any_of(","));
+    for (const std::string& part : parts) {
+        size_t pos = part.find('=');
+        int32_t weight = 0;
+        if (pos == std::string::npos || !ParseInt32(part.substr(pos + 1), &weight) || weight < 0)
+            throw std::runtime_error(strprintf("Invalid -mix entry %s", part));
+        auto kind = std::find_if(LOAD_KIND_NAMES.begin(), LOAD_KIND_NAMES.end(), [&](const std::pair<LoadKind, std::string>& name) { return name.second == part.substr(0, pos); });
+        if (kind == LOAD_KIND_NAMES.end())
+            throw std::runtime_error(strprintf("Unknown transaction kind in -mix entry %s", part));
+        m_schedule.insert(m_schedule.end(), weight, kind->first);
+    }
+    if (m_schedule.empty())
+        throw std::runtime_error("-mix has no transactions");
+    // Spread the kinds over the schedule instead of sending them in runs
+    std::vector<LoadKind> spread;
+    std::map<LoadKind, size_t> counts;
+    for (LoadKind kind : m_schedule)
+        counts[kind]++;
+    for (size_t i = 0; i < m_schedule.size(); i++) {
+        LoadKind best = counts.begin()->first;
+        double bestDeficit = -1;
+        for (const auto& count : counts) {
+            size_t done = std::count(spread.begin(), spread.end(), count.first);
+            double deficit = (double)count.second * (i + 1) / m_schedule.size() - done;
+            if (deficit > bestDeficit) {
+                best = count.first;
+                bestDeficit = deficit;
+            }
+        }
+        spread.push_back(best);
+    }
+    m_schedule = spread;
+}
+
+void LoadGenerator::WaitForConfirmation(const std::vector<std::string>& txids)
+{
+    const int64_t nBlockInterval = gArgs.GetArg("-blockinterval", DEFAULT_BLOCK_INTERVAL);
+    const int64_t nTimeout = GetTime() + 3600;
+    for (const std::string& txid : txids) {
+        while (true) {
+            const UniValue tx = CallRPC("gettransaction", {txid});
+            if (find_value(tx, "confirmations").get_int() > 0)
+                break;
+            if (GetTime() > nTimeout)
+                throw std::runtime_error(strprintf("Transaction %s of the setup was not confirmed", txid));
+            if (nBlockInterval > 0) {
+                CallRPC("generatetoaddress", {1, m_receivers[0]});
+            } else {
+                MilliSleep(1000);
+            }
+        }
+    }
+}
+
+void LoadGenerator::Setup()
+{
+    const UniValue chain = CallRPC("getblockchaininfo");
+    if (find_value(chain, "chain").get_str() == CBaseChainParams::MAIN)
+        throw std::runtime_error("hydra-loadgen only sends transactions on regtest and testnet");
+    m_last_height = find_value(chain, "blocks").get_int();
+    m_last_block_time = GetTime();
+
+    ParseMix();
+    m_rate = std::max<int64_t>(1, gArgs.GetArg("-rate", DEFAULT_RATE));
+    m_count = gArgs.GetArg("-count", 0);
+    m_staker = gArgs.GetArg("-delegationstaker", "");
+    if (m_staker.empty() && std::count(m_schedule.begin(), m_schedule.end(), LoadKind::DELEGATE))
+        throw std::runtime_error("-delegationstaker is required for delegate transactions");
+
+    for (int i = 0; i < 20; i++)
+        m_receivers.push_back(CallRPC("getnewaddress").get_str());
+
+    // The contract transactions and delegations are sent from addresses, which need coins of their own
+    bool fSenders = std::any_of(m_schedule.begin(), m_schedule.end(), [](LoadKind kind) { return kind != LoadKind::TRANSFER; });
+    std::vector<std::string> setupTxids;
+    if (fSenders) {
+        UniValue amounts(UniValue::VOBJ);
+        for (int64_t i = 0; i < std::max<int64_t>(1, gArgs.GetArg("-senders", DEFAULT_SENDERS)); i++) {
+            m_senders.push_back(CallRPC("getnewaddress").get_str());
+            amounts.pushKV(m_senders.back(), AmountArg("-senderfunds", DEFAULT_SENDER_FUNDS));
+        }
+        tfm::format(std::cerr, "Funding %u sender addresses\n", m_senders.size());
+        setupTxids.push_back(CallRPC("sendmany", {"", amounts}).get_str());
+    }
+    m_token = gArgs.GetArg("-token", "");
+    if (m_token.empty() && std::count(m_schedule.begin(), m_schedule.end(), LoadKind::TOKEN)) {
+        const UniValue created = CallRPC("createcontract", {TOKEN_BYTECODE, CREATE_GAS_LIMIT});
+        m_token = find_value(created, "address").get_str();
+        setupTxids.push_back(ResultTxid(created));
+        tfm::format(std::cerr, "Creating token %s\n", m_token);
+    }
+    WaitForConfirmation(setupTxids);
+
+    try {
+        m_accept_stats_start = CallRPC("getmempoolacceptstats");
+    } catch (const RPCCallError&) {
+        // Older nodes do not keep admission statistics
+    }
+}
+
+std::string LoadGenerator::Send(LoadKind kind, int64_t index)
+{
+    const std::string& sender = m_senders.empty() ? std::string() : m_senders[index % m_senders.size()];
+    switch (kind) {
+    case LoadKind::TRANSFER:
+        return ResultTxid(CallRPC("sendtoaddress", {m_receivers[index % m_receivers.size()], AmountArg("-transferamount", DEFAULT_TRANSFER_AMOUNT)}));
+    case LoadKind::TOKEN: {
+        const std::string receiver = CallRPC("gethexaddress", {m_receivers[index % m_receivers.size()]}).get_str();
+        const std::string data = TOKEN_TRANSFER_SELECTOR + std::string(24, '0') + receiver + Uint256Hex(1);
+        return ResultTxid(CallRPC("sendtocontract", {m_token, data, 0, TOKEN_GAS_LIMIT, sender}));
+    }
+    case LoadKind::CREATE:
+        return ResultTxid(CallRPC("createcontract", {TOKEN_BYTECODE, CREATE_GAS_LIMIT, sender}));
+    case LoadKind::DELEGATE:
+        return ResultTxid(CallRPC("setdelegateforaddress", {m_staker, DEFAULT_DELEGATION_FEE, sender}));
+    }
+    assert(false);
+}
+
+bool LoadGenerator::NextSlot(int64_t& index, int64_t& due)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    index = m_next;
+    due = m_time_start + index * 1000000 / m_rate;
+    if (m_count > 0 ? index >= m_count : due >= m_time_end)
+        return false;
+    m_next++;
+    return true;
+}
+
+void LoadGenerator::ThreadSend()
+{
+    int64_t index, due;
+    while (NextSlot(index, due)) {
+        const int64_t now = GetTimeMicros();
+        if (due > now)
+            MilliSleep((due - now) / 1000);
+
+        const LoadKind kind = m_schedule[index % m_schedule.size()];
+        const int64_t nTimeSend = GetTimeMicros();
+        std::string txid, reject;
+        try {
+            txid = Send(kind, index);
+        } catch (const RPCCallError& e) {
+            reject = e.what();
+        } catch (const std::exception& e) {
+            reject = std::string("connection: ") + e.what();
+        }
+        const int64_t nTimeReply = GetTimeMicros();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        KindStats& stats = m_stats[kind];
+        stats.nSent++;
+        if (reject.empty()) {
+            stats.nAccepted++;
+            stats.vLatencies.push_back(nTimeReply - nTimeSend);
+            m_pending[txid] = Pending{kind, nTimeReply};
+        } else {
+            m_rejects[reject]++;
+        }
+    }
+    m_sending--;
+}
+
+void LoadGenerator::PollBlocks()
+{
+    const int64_t nBlockInterval = gArgs.GetArg("-blockinterval", DEFAULT_BLOCK_INTERVAL);
+    if (nBlockInterval > 0 && GetTime() - m_last_block_time >= nBlockInterval) {
+        CallRPC("generatetoaddress", {1, m_receivers[0]});
+        m_last_block_time = GetTime();
+    }
+
+    const int height = CallRPC("getblockcount").get_int();
+    for (int h = m_last_height + 1; h <= height; h++) {
+        const UniValue block = CallRPC("getblock", {CallRPC("getblockhash", {h}).get_str()});
+        const int64_t nTimeBlock = GetTimeMicros();
+        const UniValue& txs = find_value(block, "tx");
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (size_t i = 0; i < txs.size(); i++) {
+            auto it = m_pending.find(txs[i].get_str());
+            if (it == m_pending.end())
+                continue;
+            m_stats[it->second.kind].vInclusionDelays.push_back(nTimeBlock - it->second.nTimeAccepted);
+            m_pending.erase(it);
+        }
+    }
+    if (height > m_last_height)
+        m_last_block_time = GetTime();
+    m_last_height = std::max(m_last_height, height);
+}
+
+void LoadGenerator::Run()
+{
+    m_time_start = GetTimeMicros();
+    m_time_end = m_time_start + gArgs.GetArg("-duration", DEFAULT_DURATION) * 1000000;
+
+    const int64_t nThreads = std::max<int64_t>(1, gArgs.GetArg("-threads", DEFAULT_THREADS));
+    m_sending = nThreads;
+    std::vector<std::thread> threads;
+    for (int64_t i = 0; i < nThreads; i++)
+        threads.emplace_back(&LoadGenerator::ThreadSend, this);
+
+    // Blocks are polled while sending, a block found after a reply is timed when it is seen, up to a second late
+    const int64_t nInclusionWait = gArgs.GetArg("-inclusionwait", DEFAULT_INCLUSION_WAIT);
+    int64_t nTimeDoneSending = 0;
+    while (true) {
+        PollBlocks();
+        if (m_sending == 0) {
+            if (nTimeDoneSending == 0)
+                nTimeDoneSending = GetTimeMicros();
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_pending.empty() || GetTimeMicros() > nTimeDoneSending + nInclusionWait * 1000000)
+                break;
+        }
+        MilliSleep(1000);
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    PollBlocks();
+}
+
+UniValue LoadGenerator::Report() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    UniValue ret(UniValue::VOBJ);
+    int64_t nSent = 0, nAccepted = 0;
+    UniValue kinds(UniValue::VOBJ);
+    for (const auto& name : LOAD_KIND_NAMES) {
+        auto it = m_stats.find(name.first);
+        if (it == m_stats.end())
+            continue;
+        const KindStats& stats = it->second;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("sent", stats.nSent);
+        obj.pushKV("accepted", stats.nAccepted);
+        obj.pushKV("latency_ms", SummarizeSamples(stats.vLatencies, 1000));
+        obj.pushKV("inclusion_delay_s", SummarizeSamples(stats.vInclusionDelays, 1000000));
+        kinds.pushKV(name.second, obj);
+        nSent += stats.nSent;
+        nAccepted += stats.nAccepted;
+    }
+    const double seconds = (double)(GetTimeMicros() - m_time_start) / 1000000;
+    ret.pushKV("sent", nSent);
+    ret.pushKV("accepted", nAccepted);
+    ret.pushKV("not_included", (int64_t)m_pending.size());
+    ret.pushKV("seconds", seconds);
+    ret.pushKV("kinds", kinds);
+    UniValue rejects(UniValue::VOBJ);
+    for (const auto& reject : m_rejects)
+        rejects.pushKV(reject.first, reject.second);
+    ret.pushKV("rejects", rejects);
+
+    // The admission work of the node itself, without the wallet and RPC work in the latencies
+    if (!m_accept_stats_start.isNull()) {
+        try {
+            const UniValue end = CallRPC("getmempoolacceptstats");
+            UniValue admission(UniValue::VOBJ);
+            for (const std::string& type : end.getKeys()) {
+                const UniValue& start = find_value(m_accept_stats_start, type);
+                auto delta = [&](const std::string& key) {
+                    return end[type][key].get_int64() - (start.isNull() ? 0 : start[key].get_int64());
+                };
+                const int64_t nTime = end[type]["total"]["time"].get_int64() - (start.isNull() ? 0 : start["total"]["time"].get_int64());
+                UniValue obj(UniValue::VOBJ);
+                obj.pushKV("accepted", delta("accepted"));
+                obj.pushKV("rejected", delta("rejected"));
+                obj.pushKV("time_us", nTime);
+                admission.pushKV(type, obj);
+            }
+            ret.pushKV("node_admission", admission);
+        } catch (const std::exception& e) {
+            tfm::format(std::cerr, "Admission statistics not read: %s\n", e.what());
+        }
+    }
+    return ret;
+}
+
+int main(int argc, char* argv[])
+{
+#ifdef WIN32
+    util::WinCmdLineArgs winArgs;
+    std::tie(argc, argv) = winArgs.get();
+#endif
+    SetupEnvironment();
+    if (!SetupNetworking()) {
+        tfm::format(std::cerr, "Error: Initializing networking failed\n");
+        return EXIT_FAILURE;
+    }
+    event_set_log_callback(&libevent_log_cb);
+
+    try {
+        int ret;
+        if (!AppInitLoadgen(argc, argv, ret))
+            return ret;
+
+        LoadGenerator generator;
+        generator.Setup();
+        tfm::format(std::cerr, "Sending transactions\n");
+        generator.Run();
+        tfm::format(std::cout, "%s\n", generator.Report().write(2));
+    } catch (const std::exception& e) {
+        tfm::format(std::cerr, "Error: %s\n", e.what());
+        return EXIT_FAILURE;
+    } catch (...) {
+        PrintExceptionContinue(nullptr, "hydra-loadgen");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
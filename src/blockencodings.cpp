@@ -18,13 +18,21 @@
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID) :
         nonce(GetRand(std::numeric_limits<uint64_t>::max())),
-        shorttxids(block.vtx.size() - 1), prefilledtxn(1), header(block) {
+        header(block) {
     FillShortTxIDSelector();
-    //TODO: Use our mempool prior to block acceptance to predictively fill more than just the coinbase
-    prefilledtxn[0] = {0, block.vtx[0]};
-    for (size_t i = 1; i < block.vtx.size(); i++) {
+    // The coinbase, the coinstake and the value transfers of the contract executions are created
+    // with the block and are never in the mempool of the peers, send them prefilled
+    shorttxids.reserve(block.vtx.size() - 1);
+    int32_t lastprefilledindex = -1;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
         const CTransaction& tx = *block.vtx[i];
-        shorttxids[i - 1] = GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash());
+        if (i == 0 || tx.IsCoinStake() || tx.HasOpSpend()) {
+            // Prefilled indexes are differentially encoded
+            prefilledtxn.push_back({(uint16_t)(i - lastprefilledindex - 1), block.vtx[i]});
+            lastprefilledindex = i;
+        } else {
+            shorttxids.push_back(GetShortID(fUseWTXID ? tx.GetWitnessHash() : tx.GetHash()));
+        }
     }
 }
 
@@ -26,6 +26,144 @@ public:
     }
 };
 
+/**
+ * Compact encoding of a run of block headers, used by the headers2 message.
+ *
+ * Each header starts with a flags byte. The version, nBits and state roots are
+ * omitted when they equal those of the previous header in the message, the
+ * hashPrevBlock when it is the hash of the previous header, and the
+ * prevoutStake of a proof-of-work header. The time is a varint delta from the
+ * previous header when it is not earlier, the nonce and the stake output index
+ * are varints. The merkle root and the signature are always written.
+ */
+class CCompactHeaderCodec
+{
+    enum Flags : uint8_t {
+        VERSION_SAME    = (1 << 0),
+        PREV_IMPLIED    = (1 << 1),
+        BITS_SAME       = (1 << 2),
+        ROOTS_SAME      = (1 << 3),
+        PROOF_OF_STAKE  = (1 << 4),
+        TIME_DELTA      = (1 << 5),
+        KNOWN_FLAGS     = (1 << 6) - 1,
+    };
+
+    bool m_has_prev = false;
+    CBlockHeader m_prev;
+    uint256 m_prev_hash;
+
+    void SetPrevious(const CBlockHeader& header)
+    {
+        m_has_prev = true;
+        m_prev = header;
+        m_prev_hash = header.GetHash();
+    }
+
+public:
+    template <typename Stream>
+    void Write(Stream& s, const CBlockHeader& header)
+    {
+        uint8_t flags = 0;
+        if (m_has_prev) {
+            if (header.nVersion == m_prev.nVersion) flags |= VERSION_SAME;
+            if (header.hashPrevBlock == m_prev_hash) flags |= PREV_IMPLIED;
+            if (header.nBits == m_prev.nBits) flags |= BITS_SAME;
+            if (header.hashStateRoot == m_prev.hashStateRoot && header.hashUTXORoot == m_prev.hashUTXORoot) flags |= ROOTS_SAME;
+            if (header.nTime >= m_prev.nTime) flags |= TIME_DELTA;
+        }
+        if (header.IsProofOfStake()) flags |= PROOF_OF_STAKE;
+
+        s << flags;
+        if (!(flags & VERSION_SAME)) s << header.nVersion;
+        if (!(flags & PREV_IMPLIED)) s << header.hashPrevBlock;
+        s << header.hashMerkleRoot;
+        if (flags & TIME_DELTA) {
+            s << VARINT(header.nTime - m_prev.nTime);
+        } else {
+            s << header.nTime;
+        }
+        if (!(flags & BITS_SAME)) s << header.nBits;
+        s << VARINT(header.nNonce);
+        if (!(flags & ROOTS_SAME)) s << header.hashStateRoot << header.hashUTXORoot;
+        if (flags & PROOF_OF_STAKE) s << header.prevoutStake.hash << VARINT(header.prevoutStake.n);
+        s << header.vchBlockSigDlgt;
+
+        SetPrevious(header);
+    }
+
+    template <typename Stream>
+    void Read(Stream& s, CBlockHeader& header)
+    {
+        uint8_t flags;
+        s >> flags;
+        if ((flags & ~KNOWN_FLAGS) || (!m_has_prev && (flags & (VERSION_SAME | PREV_IMPLIED | BITS_SAME | ROOTS_SAME | TIME_DELTA)))) {
+            throw std::ios_base::failure("invalid compact header flags");
+        }
+
+        if (flags & VERSION_SAME) {
+            header.nVersion = m_prev.nVersion;
+        } else {
+            s >> header.nVersion;
+        }
+        if (flags & PREV_IMPLIED) {
+            header.hashPrevBlock = m_prev_hash;
+        } else {
+            s >> header.hashPrevBlock;
+        }
+        s >> header.hashMerkleRoot;
+        if (flags & TIME_DELTA) {
+            uint32_t delta;
+            s >> VARINT(delta);
+            header.nTime = m_prev.nTime + delta;
+        } else {
+            s >> header.nTime;
+        }
+        if (flags & BITS_SAME) {
+            header.nBits = m_prev.nBits;
+        } else {
+            s >> header.nBits;
+        }
+        s >> VARINT(header.nNonce);
+        if (flags & ROOTS_SAME) {
+            header.hashStateRoot = m_prev.hashStateRoot;
+            header.hashUTXORoot = m_prev.hashUTXORoot;
+        } else {
+            s >> header.hashStateRoot >> header.hashUTXORoot;
+        }
+        if (flags & PROOF_OF_STAKE) {
+            s >> header.prevoutStake.hash >> VARINT(header.prevoutStake.n);
+            if (header.prevoutStake.IsNull()) {
+                throw std::ios_base::failure("compact header stake output is null");
+            }
+        } else {
+            header.prevoutStake.SetNull();
+        }
+        s >> header.vchBlockSigDlgt;
+
+        SetPrevious(header);
+    }
+};
+
+/** The headers of a headers2 message. The receiver reads the count and the headers itself, to bound the count first */
+template <typename Header>
+class CCompactHeaders
+{
+    const std::vector<Header>& m_headers;
+
+public:
+    explicit CCompactHeaders(const std::vector<Header>& headers) : m_headers(headers) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        WriteCompactSize(s, m_headers.size());
+        CCompactHeaderCodec codec;
+        for (const Header& header : m_headers) {
+            codec.Write(s, header);
+        }
+    }
+};
+
 class BlockTransactionsRequest {
 public:
     // A BlockTransactionsRequest message
@@ -85,14 +85,56 @@ uint64_t GCSFilter::HashToRange(const Element& element) const
     return MapIntoRange(hash, m_F);
 }
 
+/// Below this many elements a comparison sort is faster than the radix sort.
+static constexpr size_t GCS_RADIX_SORT_MIN = 512;
+
+/**
+ * Sort hashed elements, which are all below range. Large sets are sorted with
+ * an LSD radix sort on bytes, skipping the high bytes the range leaves zero.
+ */
+static void SortHashedSet(std::vector<uint64_t>& values, uint64_t range)
+{
+    if (values.size() < GCS_RADIX_SORT_MIN) {
+        std::sort(values.begin(), values.end());
+        return;
+    }
+
+    int passes = 0;
+    for (uint64_t max = range - 1; max > 0; max >>= 8) {
+        ++passes;
+    }
+
+    std::vector<uint64_t> buffer(values.size());
+    for (int pass = 0; pass < passes; ++pass) {
+        const int shift = 8 * pass;
+        size_t offsets[256] = {};
+        for (uint64_t value : values) {
+            ++offsets[(value >> shift) & 0xff];
+        }
+        size_t total = 0;
+        for (size_t& offset : offsets) {
+            size_t count = offset;
+            offset = total;
+            total += count;
+        }
+        for (uint64_t value : values) {
+            buffer[offsets[(value >> shift) & 0xff]++] = value;
+        }
+        values.swap(buffer);
+    }
+}
+
 std::vector<uint64_t> GCSFilter::BuildHashedSet(const ElementSet& elements) const
 {
+    // The keys are the same for every element, seed the hasher once
+    const CSipHasher hasher(m_params.m_siphash_k0, m_params.m_siphash_k1);
     std::vector<uint64_t> hashed_elements;
     hashed_elements.reserve(elements.size());
     for (const Element& element : elements) {
-        hashed_elements.push_back(HashToRange(element));
+        uint64_t hash = CSipHasher(hasher).Write(element.data(), element.size()).Finalize();
+        hashed_elements.push_back(MapIntoRange(hash, m_F));
     }
-    std::sort(hashed_elements.begin(), hashed_elements.end());
+    SortHashedSet(hashed_elements, m_F);
     return hashed_elements;
 }
 
@@ -232,20 +274,26 @@ BlockFilter::BlockFilter(BlockFilterType filter_type, const uint256& block_hash,
     m_filter = GCSFilter(params, std::move(filter));
 }
 
-BlockFilter::BlockFilter(BlockFilterType filter_type, const CBlock& block, const CBlockUndo& block_undo)
+BlockFilter::BlockFilter(BlockFilterType filter_type, const CBlock& block, const CBlockUndo& block_undo,
+                         const GCSFilter::ElementSet& contract_elements)
     : m_filter_type(filter_type), m_block_hash(block.GetHash())
 {
     GCSFilter::Params params;
     if (!BuildParams(params)) {
         throw std::invalid_argument("unknown filter_type");
     }
-    m_filter = GCSFilter(params, BasicFilterElements(block, block_undo));
+    GCSFilter::ElementSet elements = BasicFilterElements(block, block_undo);
+    if (filter_type == BlockFilterType::CONTRACT) {
+        elements.insert(contract_elements.begin(), contract_elements.end());
+    }
+    m_filter = GCSFilter(params, elements);
 }
 
 bool BlockFilter::BuildParams(GCSFilter::Params& params) const
 {
     switch (m_filter_type) {
     case BlockFilterType::BASIC:
+    case BlockFilterType::CONTRACT:
         params.m_siphash_k0 = m_block_hash.GetUint64(0);
         params.m_siphash_k1 = m_block_hash.GetUint64(1);
         params.m_P = BASIC_FILTER_P;
@@ -256,6 +304,45 @@ bool BlockFilter::BuildParams(GCSFilter::Params& params) const
     return false;
 }
 
+const std::string& BlockFilterTypeName(BlockFilterType filter_type)
+{
+    static const std::string basic = "basic";
+    static const std::string contract = "contract";
+    static const std::string unknown;
+    switch (filter_type) {
+    case BlockFilterType::BASIC: return basic;
+    case BlockFilterType::CONTRACT: return contract;
+    }
+    return unknown;
+}
+
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filter_type)
+{
+    for (BlockFilterType type : AllBlockFilterTypes()) {
+        if (BlockFilterTypeName(type) == name) {
+            filter_type = type;
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::vector<BlockFilterType>& AllBlockFilterTypes()
+{
+    static const std::vector<BlockFilterType> types = {BlockFilterType::BASIC, BlockFilterType::CONTRACT};
+    return types;
+}
+
+std::string ListBlockFilterTypes()
+{
+    std::string ret;
+    for (BlockFilterType filter_type : AllBlockFilterTypes()) {
+        if (!ret.empty()) ret += ", ";
+        ret += BlockFilterTypeName(filter_type);
+    }
+    return ret;
+}
+
 uint256 BlockFilter::GetHash() const
 {
     const std::vector<unsigned char>& data = GetEncodedFilter();
@@ -174,7 +174,7 @@ std::vector<unsigned char> CBlockIndex::GetBlockSignature() const
 {
     if(vchBlockSigDlgt.size() < 2 * CPubKey::COMPACT_SIGNATURE_SIZE)
     {
-        return vchBlockSigDlgt;
+        return std::vector<unsigned char>(vchBlockSigDlgt.begin(), vchBlockSigDlgt.end());
     }
 
     return std::vector<unsigned char>(vchBlockSigDlgt.begin(), vchBlockSigDlgt.end() - CPubKey::COMPACT_SIGNATURE_SIZE );
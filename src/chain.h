@@ -9,9 +9,12 @@
 #include <arith_uint256.h>
 #include <consensus/params.h>
 #include <primitives/block.h>
+#include <prevector.h>
 #include <tinyformat.h>
 #include <uint256.h>
 
+#include <memory>
+#include <type_traits>
 #include <vector>
 
 /**
@@ -168,8 +171,13 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_OPT_WITNESS       =   128, //!< block data in blk*.data was received with a witness-enforcing client
+
+    BLOCK_UNDO_COMPRESSED   =   256, //!< undo data in rev*.dat is stored zlib compressed
 };
 
+/** Bytes of the block signature stored inside CBlockIndex, enough for a DER signature without proof of delegation */
+static const unsigned int BLOCK_SIG_INLINE_SIZE = 72;
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block. A blockindex may have multiple pprev pointing
@@ -225,8 +233,6 @@ public:
     uint32_t nNonce;
     uint256 hashStateRoot; // qtum
     uint256 hashUTXORoot; // qtum
-    // block signature - proof-of-stake protect the block by signing the block using a stake holder private key
-    std::vector<unsigned char> vchBlockSigDlgt;
     uint256 nStakeModifier;
     // proof-of-stake specific fields
     COutPoint prevoutStake;
@@ -240,6 +246,10 @@ public:
     //! (memory only) Maximum nTime in the chain up to and including this block.
     unsigned int nTimeMax;
 
+    // block signature - proof-of-stake protect the block by signing the block using a stake holder private key
+    // Kept last and inline: a plain signature needs no allocation of its own, one with a proof of delegation spills to the heap
+    prevector<BLOCK_SIG_INLINE_SIZE, unsigned char> vchBlockSigDlgt;
+
     void SetNull()
     {
         phashBlock = nullptr;
@@ -293,7 +303,7 @@ public:
         nStakeModifier = uint256();
         hashProof = uint256(); 
         prevoutStake   = block.prevoutStake; // qtum
-        vchBlockSigDlgt = block.vchBlockSigDlgt; // qtum
+        vchBlockSigDlgt.assign(block.vchBlockSigDlgt.begin(), block.vchBlockSigDlgt.end()); // qtum
     }
 
     CDiskBlockPos GetBlockPos() const {
@@ -326,7 +336,7 @@ public:
         block.nNonce         = nNonce;
         block.hashStateRoot  = hashStateRoot; // qtum
         block.hashUTXORoot   = hashUTXORoot; // qtum
-        block.vchBlockSigDlgt    = vchBlockSigDlgt; // qtum
+        block.vchBlockSigDlgt.assign(vchBlockSigDlgt.begin(), vchBlockSigDlgt.end()); // qtum
         block.prevoutStake   = prevoutStake;
         return block;
     }
@@ -493,7 +503,7 @@ public:
         block.nNonce          = nNonce;
         block.hashStateRoot   = hashStateRoot; // qtum
         block.hashUTXORoot    = hashUTXORoot; // qtum
-        block.vchBlockSigDlgt     = vchBlockSigDlgt;
+        block.vchBlockSigDlgt.assign(vchBlockSigDlgt.begin(), vchBlockSigDlgt.end());
         block.prevoutStake    = prevoutStake;
         return block.GetHash();
     }
@@ -510,6 +520,58 @@ public:
     }
 };
 
+/**
+ * Allocates block index entries from large slabs instead of one heap
+ * allocation each. This saves the per allocation overhead across millions of
+ * entries, and entries created in height order, as when loading the index,
+ * end up next to each other for pprev and pskip walks. Deleted entries are
+ * reused by later allocations; slabs are only released by Clear.
+ */
+class CBlockIndexArena
+{
+public:
+    template <typename... Args>
+    CBlockIndex* New(Args&&... args)
+    {
+        void* mem;
+        if (!m_free.empty()) {
+            mem = m_free.back();
+            m_free.pop_back();
+        } else {
+            if (m_slabs.empty() || m_slab_used == SLAB_ENTRIES) {
+                m_slabs.emplace_back(new Slot[SLAB_ENTRIES]);
+                m_slab_used = 0;
+            }
+            mem = &m_slabs.back()[m_slab_used++];
+        }
+        return new (mem) CBlockIndex(std::forward<Args>(args)...);
+    }
+
+    void Delete(CBlockIndex* pindex)
+    {
+        pindex->~CBlockIndex();
+        m_free.push_back(pindex);
+    }
+
+    /** Release all memory. Every entry must have been deleted. */
+    void Clear()
+    {
+        m_slabs.clear();
+        m_free.clear();
+        m_slab_used = 0;
+    }
+
+    size_t DynamicMemoryUsage() const { return m_slabs.size() * SLAB_ENTRIES * sizeof(Slot) + m_free.capacity() * sizeof(CBlockIndex*); }
+
+private:
+    static const size_t SLAB_ENTRIES = 4096;
+    typedef std::aligned_storage<sizeof(CBlockIndex), alignof(CBlockIndex)>::type Slot;
+
+    std::vector<std::unique_ptr<Slot[]>> m_slabs;
+    size_t m_slab_used{0};
+    std::vector<CBlockIndex*> m_free;
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
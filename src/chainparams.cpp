@@ -271,6 +271,9 @@ public:
 
         // By default assume that the signatures in ancestors of this block are valid.
         consensus.defaultAssumeValid = uint256S("0x0x92660e79da8f13d05ec97a4ecede44aa66d379b4592feebe9fbea769435de17b"); //1176400
+
+        // The state roots in the header of this block are the contract state -assumevalidstate starts executing from
+        consensus.defaultAssumeValidState = uint256S("0x92660e79da8f13d05ec97a4ecede44aa66d379b4592feebe9fbea769435de17b"); //1176400
     }
 };
 
@@ -380,6 +383,9 @@ public:
 
         // By default assume that the signatures in ancestors of this block are valid.
         consensus.defaultAssumeValid = uint256S("0x3f9e68d1bea7ad90511ab5279b28561920acd6ebb374bddc17ec8f86029b0c71"); //1050000
+
+        // The state roots in the header of this block are the contract state -assumevalidstate starts executing from
+        consensus.defaultAssumeValidState = uint256S("0x3f9e68d1bea7ad90511ab5279b28561920acd6ebb374bddc17ec8f86029b0c71"); //1050000
     }
 };
 
@@ -438,6 +444,7 @@ public:
         consensus.nMinerConfirmationWindow = 144; // Faster than normal for regtest (144 instead of 2016)
         // By default assume that the signatures in ancestors of this block are valid.
         consensus.defaultAssumeValid = uint256S("0x00");
+        consensus.defaultAssumeValidState = uint256S("0x00");
     }
 
 };
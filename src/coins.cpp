@@ -35,7 +35,7 @@ SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<ui
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
-    return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
+    return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage + memusage::DynamicUsage(setPinnedCoins);
 }
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
@@ -203,12 +203,37 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlockIn
 }
 
 bool CCoinsViewCache::Flush() {
+    // Pinned coins that are still unspent are put back unmodified once they are written
+    std::vector<std::pair<COutPoint, Coin>> vPinned;
+    for (auto it = setPinnedCoins.begin(); it != setPinnedCoins.end();) {
+        CCoinsMap::const_iterator itCoin = cacheCoins.find(*it);
+        if (itCoin == cacheCoins.end() || itCoin->second.coin.IsSpent()) {
+            it = setPinnedCoins.erase(it);
+        } else {
+            vPinned.emplace_back(*it, itCoin->second.coin);
+            ++it;
+        }
+    }
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
     cacheCoins.clear();
     cachedCoinsUsage = 0;
+    for (std::pair<COutPoint, Coin>& pinned : vPinned) {
+        CCoinsCacheEntry& entry = cacheCoins[pinned.first];
+        entry.coin = std::move(pinned.second);
+        cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
+    }
     return fOk;
 }
 
+bool CCoinsViewCache::PinCoin(const COutPoint& outpoint) {
+    if (setPinnedCoins.count(outpoint))
+        return true;
+    if (setPinnedCoins.size() >= MAX_PINNED_COINS || !HaveCoin(outpoint))
+        return false;
+    setPinnedCoins.insert(outpoint);
+    return true;
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -12,12 +12,14 @@
 #include <crypto/siphash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <support/allocators/largepages.h>
 #include <uint256.h>
 
 #include <assert.h>
 #include <stdint.h>
 
 #include <unordered_map>
+#include <unordered_set>
 
 ////////////////////////////////////////////////////////////////// // qtum
 struct CSpentIndexKey {
@@ -201,7 +203,9 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/** The nodes and buckets of the coins cache go to huge pages with -largepages */
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher, std::equal_to<COutPoint>,
+                           large_page_allocator<std::pair<const COutPoint, CCoinsCacheEntry>>> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -293,7 +297,13 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Coins kept in the cache across flushes, like the likely stake inputs. */
+    std::unordered_set<COutPoint, SaltedOutpointHasher> setPinnedCoins;
+
 public:
+    //! Maximum number of coins pinned in the cache
+    static const size_t MAX_PINNED_COINS = 10000;
+
     CCoinsViewCache(CCoinsView *baseIn);
 
     /**
@@ -350,6 +360,12 @@ public:
      */
     bool Flush();
 
+    /**
+     * Keep the UTXO with the given outpoint in the cache when it is flushed, until it is spent.
+     * Returns false if too many coins are pinned already.
+     */
+    bool PinCoin(const COutPoint &outpoint);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
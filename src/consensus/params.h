@@ -116,6 +116,8 @@ struct Params {
     int64_t nRBTPowTargetTimespanV2;
     uint256 nMinimumChainWork;
     uint256 defaultAssumeValid;
+    /** Block whose ancestors -assumevalidstate connects with the contract state roots of their headers */
+    uint256 defaultAssumeValidState;
     int nLastPOWBlock;
     CAmount totalCoinsSupply;
     CAmount initialCoinsSupply;
@@ -22,8 +22,22 @@ UniValue ValueFromAmount(const CAmount& amount)
     int64_t n_abs = (sign ? -amount : amount);
     int64_t quotient = n_abs / COIN;
     int64_t remainder = n_abs % COIN;
-    return UniValue(UniValue::VNUM,
-            strprintf("%s%d.%08d", sign ? "-" : "", quotient, remainder));
+    // Same as strprintf("%s%d.%08d"), written backwards into a buffer
+    char buf[32];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    for (int i = 0; i < 8; i++) {
+        *--p = '0' + remainder % 10;
+        remainder /= 10;
+    }
+    *--p = '.';
+    do {
+        *--p = '0' + quotient % 10;
+        quotient /= 10;
+    } while (quotient);
+    if (sign)
+        *--p = '-';
+    return UniValue(UniValue::VNUM, std::string(p, end));
 }
 
 std::string FormatScript(const CScript& script)
@@ -0,0 +1,294 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/keccak.h>
+#include <crypto/common.h>
+
+#include <assert.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(USE_ASM)
+#include <cpuid.h>
+#endif
+#endif
+
+namespace keccak_avx2
+{
+void KeccakF1600_4way(uint64_t* s);
+}
+
+// Internal implementation code.
+namespace
+{
+/// Internal Keccak-f[1600] implementation.
+namespace keccak
+{
+const uint64_t RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+    0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+    0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL,
+};
+
+/** Rotation offsets and lane order of the combined rho and pi steps */
+const int ROTC[24] = {1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44};
+const int PILN[24] = {10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1};
+
+uint64_t inline Rotl(uint64_t x, int n) { return (x << n) | (x >> (64 - n)); }
+
+void KeccakF1600(uint64_t* s)
+{
+    uint64_t bc[5];
+    for (int round = 0; round < 24; round++) {
+        // Theta
+        for (int i = 0; i < 5; i++) {
+            bc[i] = s[i] ^ s[i + 5] ^ s[i + 10] ^ s[i + 15] ^ s[i + 20];
+        }
+        for (int i = 0; i < 5; i++) {
+            uint64_t t = bc[(i + 4) % 5] ^ Rotl(bc[(i + 1) % 5], 1);
+            for (int j = 0; j < 25; j += 5) {
+                s[j + i] ^= t;
+            }
+        }
+        // Rho and pi
+        uint64_t t = s[1];
+        for (int i = 0; i < 24; i++) {
+            int j = PILN[i];
+            uint64_t tmp = s[j];
+            s[j] = Rotl(t, ROTC[i]);
+            t = tmp;
+        }
+        // Chi
+        for (int j = 0; j < 25; j += 5) {
+            for (int i = 0; i < 5; i++) {
+                bc[i] = s[j + i];
+            }
+            for (int i = 0; i < 5; i++) {
+                s[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+            }
+        }
+        // Iota
+        s[0] ^= RC[round];
+    }
+}
+
+const size_t RATE = 136;
+
+void Absorb(uint64_t* s, const unsigned char* block)
+{
+    for (size_t i = 0; i < RATE / 8; i++) {
+        s[i] ^= ReadLE64(block + 8 * i);
+    }
+}
+
+void Squeeze(const uint64_t* s, unsigned char* out)
+{
+    for (int i = 0; i < 4; i++) {
+        WriteLE64(out + 8 * i, s[i]);
+    }
+}
+
+/** Copy the last, padded block of a message of len bytes */
+void LastBlock(unsigned char* block, const unsigned char* in, size_t len)
+{
+    size_t rem = len % RATE;
+    memset(block, 0, RATE);
+    memcpy(block, in + len - rem, rem);
+    block[rem] ^= 0x01;
+    block[RATE - 1] ^= 0x80;
+}
+
+/** Hash up to four messages with the 4-way permutation, the state words of the lanes are interleaved. */
+void Keccak256Group(void (*permute)(uint64_t*), unsigned char* out, const unsigned char* const* in, const size_t* lens, size_t n)
+{
+    uint64_t s[100] = {};
+    size_t blocks[4] = {};
+    size_t maxBlocks = 0;
+    for (size_t lane = 0; lane < n; lane++) {
+        blocks[lane] = lens[lane] / RATE + 1;
+        maxBlocks = std::max(maxBlocks, blocks[lane]);
+    }
+    unsigned char last[RATE];
+    for (size_t b = 0; b < maxBlocks; b++) {
+        for (size_t lane = 0; lane < n; lane++) {
+            if (b >= blocks[lane]) continue;
+            const unsigned char* block = in[lane] + b * RATE;
+            if (b + 1 == blocks[lane]) {
+                LastBlock(last, in[lane], lens[lane]);
+                block = last;
+            }
+            for (size_t i = 0; i < RATE / 8; i++) {
+                s[4 * i + lane] ^= ReadLE64(block + 8 * i);
+            }
+        }
+        permute(s);
+        // A lane that is done is permuted along with the others, its hash is taken now
+        for (size_t lane = 0; lane < n; lane++) {
+            if (b + 1 != blocks[lane]) continue;
+            for (int i = 0; i < 4; i++) {
+                WriteLE64(out + 32 * lane + 8 * i, s[4 * i + lane]);
+            }
+        }
+    }
+}
+
+typedef void (*PermuteFn)(uint64_t*);
+PermuteFn Permute4way = nullptr;
+
+bool SelfTest()
+{
+    // Keccak-256 of "", "abc" and of a message longer than the rate
+    static const unsigned char empty[32] = {0xc5, 0xd2, 0x46, 0x01, 0x86, 0xf7, 0x23, 0x3c, 0x92, 0x7e, 0x7d, 0xb2, 0xdc, 0xc7, 0x03, 0xc0, 0xe5, 0x00, 0xb6, 0x53, 0xca, 0x82, 0x27, 0x3b, 0x7b, 0xfa, 0xd8, 0x04, 0x5d, 0x85, 0xa4, 0x70};
+    static const unsigned char abc[32] = {0x4e, 0x03, 0x65, 0x7a, 0xea, 0x45, 0xa9, 0x4f, 0xc7, 0xd4, 0x7b, 0xa8, 0x26, 0xc8, 0xd6, 0x67, 0xc0, 0xd1, 0xe6, 0xe3, 0x3a, 0x64, 0xa0, 0x36, 0xec, 0x44, 0xf5, 0x8f, 0xa1, 0x2d, 0x6c, 0x45};
+    unsigned char out[32];
+    CKeccak256().Finalize(out);
+    if (!std::equal(out, out + 32, empty)) return false;
+    CKeccak256().Write((const unsigned char*)"abc", 3).Finalize(out);
+    if (!std::equal(out, out + 32, abc)) return false;
+
+    // The multi-buffer hashes of messages of different lengths match the one at a time hashes
+    if (Permute4way) {
+        unsigned char data[400];
+        for (size_t i = 0; i < sizeof(data); i++) {
+            data[i] = i * 7 + 3;
+        }
+        const unsigned char* in[4] = {data, data + 1, data + 2, data + 3};
+        const size_t lens[4] = {0, 135, 136, 396};
+        unsigned char many[128];
+        Keccak256Group(Permute4way, many, in, lens, 4);
+        for (int i = 0; i < 4; i++) {
+            CKeccak256().Write(in[i], lens[i]).Finalize(out);
+            if (!std::equal(out, out + 32, many + 32 * i)) return false;
+        }
+    }
+    return true;
+}
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+// We can't use cpuid.h's __get_cpuid as it does not support subleafs.
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+#ifdef __GNUC__
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+#else
+  __asm__ ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(leaf), "2"(subleaf));
+#endif
+}
+
+/** Check whether the OS has enabled AVX registers. */
+bool AVXEnabled()
+{
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    return (a & 6) == 6;
+}
+#endif
+
+} // namespace keccak
+} // namespace
+
+CKeccak256::CKeccak256()
+{
+    Reset();
+}
+
+CKeccak256& CKeccak256::Write(const unsigned char* data, size_t len)
+{
+    const unsigned char* end = data + len;
+    if (bufsize && bufsize + len >= RATE) {
+        // Fill the buffer, and process it.
+        memcpy(buf + bufsize, data, RATE - bufsize);
+        data += RATE - bufsize;
+        keccak::Absorb(s, buf);
+        keccak::KeccakF1600(s);
+        bufsize = 0;
+    }
+    while ((size_t)(end - data) >= RATE) {
+        // Process full blocks directly from the input.
+        keccak::Absorb(s, data);
+        keccak::KeccakF1600(s);
+        data += RATE;
+    }
+    if (end > data) {
+        // Fill the buffer with what remains.
+        memcpy(buf + bufsize, data, end - data);
+        bufsize += end - data;
+    }
+    return *this;
+}
+
+void CKeccak256::Finalize(unsigned char hash[OUTPUT_SIZE])
+{
+    memset(buf + bufsize, 0, RATE - bufsize);
+    buf[bufsize] ^= 0x01;
+    buf[RATE - 1] ^= 0x80;
+    keccak::Absorb(s, buf);
+    keccak::KeccakF1600(s);
+    keccak::Squeeze(s, hash);
+}
+
+CKeccak256& CKeccak256::Reset()
+{
+    memset(s, 0, sizeof(s));
+    bufsize = 0;
+    return *this;
+}
+
+void Keccak256Many(unsigned char* out, const unsigned char* const* in, const size_t* lens, size_t n)
+{
+    if (keccak::Permute4way) {
+        while (n >= 2) {
+            size_t group = std::min<size_t>(n, 4);
+            keccak::Keccak256Group(keccak::Permute4way, out, in, lens, group);
+            out += 32 * group;
+            in += group;
+            lens += group;
+            n -= group;
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        CKeccak256().Write(in[i], lens[i]).Finalize(out + 32 * i);
+    }
+}
+
+std::string KeccakAutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+    bool have_xsave = false;
+    bool have_avx = false;
+    bool have_avx2 = false;
+    bool enabled_avx = false;
+
+    (void)keccak::AVXEnabled;
+    (void)have_avx;
+    (void)have_avx2;
+    (void)enabled_avx;
+
+    uint32_t eax, ebx, ecx, edx;
+    keccak::cpuid(1, 0, eax, ebx, ecx, edx);
+    have_xsave = (ecx >> 27) & 1;
+    have_avx = (ecx >> 28) & 1;
+    if (have_xsave && have_avx) {
+        enabled_avx = keccak::AVXEnabled();
+    }
+    keccak::cpuid(7, 0, eax, ebx, ecx, edx);
+    have_avx2 = (ebx >> 5) & 1;
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
+    if (have_avx2 && have_avx && enabled_avx) {
+        keccak::Permute4way = keccak_avx2::KeccakF1600_4way;
+        ret += ",avx2(4way)";
+    }
+#endif
+#endif
+
+    assert(keccak::SelfTest());
+    return ret;
+}
@@ -0,0 +1,41 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_KECCAK_H
+#define BITCOIN_CRYPTO_KECCAK_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** A hasher class for Keccak-256, with the original Keccak padding used by the EVM. */
+class CKeccak256
+{
+private:
+    static const size_t RATE = 136;
+
+    uint64_t s[25];
+    unsigned char buf[RATE];
+    size_t bufsize;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    CKeccak256();
+    CKeccak256& Write(const unsigned char* data, size_t len);
+    void Finalize(unsigned char hash[OUTPUT_SIZE]);
+    CKeccak256& Reset();
+};
+
+/** Autodetect the best available Keccak-f[1600] implementations. Returns their name. */
+std::string KeccakAutoDetect();
+
+/**
+ * Compute the Keccak-256 hashes of n messages into out, 32 bytes each.
+ * With a multi-buffer implementation messages are hashed four at a time,
+ * which suits hashing the many nodes of a trie commit in one call.
+ */
+void Keccak256Many(unsigned char* out, const unsigned char* const* in, const size_t* lens, size_t n);
+
+#endif // BITCOIN_CRYPTO_KECCAK_H
@@ -0,0 +1,77 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace keccak_avx2 {
+namespace {
+
+const uint64_t RC[24] = {
+    0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+    0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+    0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+    0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+    0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+    0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL,
+};
+
+const int ROTC[24] = {1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44};
+const int PILN[24] = {10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1};
+
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline AndNot(__m256i x, __m256i y) { return _mm256_andnot_si256(x, y); }
+__m256i inline Rotl(__m256i x, int n) { return _mm256_or_si256(_mm256_slli_epi64(x, n), _mm256_srli_epi64(x, 64 - n)); }
+
+}
+
+/** Keccak-f[1600] on four states, word i of lane l at s[4 * i + l] */
+void KeccakF1600_4way(uint64_t* s)
+{
+    __m256i a[25];
+    __m256i bc[5];
+    for (int i = 0; i < 25; i++) {
+        a[i] = _mm256_loadu_si256((const __m256i*)(s + 4 * i));
+    }
+    for (int round = 0; round < 24; round++) {
+        // Theta
+        for (int i = 0; i < 5; i++) {
+            bc[i] = Xor(Xor(Xor(a[i], a[i + 5]), Xor(a[i + 10], a[i + 15])), a[i + 20]);
+        }
+        for (int i = 0; i < 5; i++) {
+            __m256i t = Xor(bc[(i + 4) % 5], Rotl(bc[(i + 1) % 5], 1));
+            for (int j = 0; j < 25; j += 5) {
+                a[j + i] = Xor(a[j + i], t);
+            }
+        }
+        // Rho and pi
+        __m256i t = a[1];
+        for (int i = 0; i < 24; i++) {
+            int j = PILN[i];
+            __m256i tmp = a[j];
+            a[j] = Rotl(t, ROTC[i]);
+            t = tmp;
+        }
+        // Chi
+        for (int j = 0; j < 25; j += 5) {
+            for (int i = 0; i < 5; i++) {
+                bc[i] = a[j + i];
+            }
+            for (int i = 0; i < 5; i++) {
+                a[j + i] = Xor(a[j + i], AndNot(bc[(i + 1) % 5], bc[(i + 2) % 5]));
+            }
+        }
+        // Iota
+        a[0] = Xor(a[0], _mm256_set1_epi64x(RC[round]));
+    }
+    for (int i = 0; i < 25; i++) {
+        _mm256_storeu_si256((__m256i*)(s + 4 * i), a[i]);
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,181 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <string.h>
+
+namespace {
+
+/** 2^3072 - the prime, so 2^3072 is MAX_PRIME_DIFF modulo the prime */
+const uint32_t MAX_PRIME_DIFF = 1103717;
+
+} // namespace
+
+Num3072::Num3072()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++) {
+        limbs[i] = 0;
+    }
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; i++) {
+        limbs[i] = ReadLE32(data + 4 * i);
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+bool Num3072::IsOverflow() const
+{
+    if (limbs[0] <= 0xFFFFFFFFu - MAX_PRIME_DIFF) return false;
+    for (int i = 1; i < LIMBS; i++) {
+        if (limbs[i] != 0xFFFFFFFFu) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // The number is at least the prime and below 2^3072, subtracting the prime adds MAX_PRIME_DIFF and drops 2^3072
+    uint64_t acc = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; i++) {
+        acc += limbs[i];
+        limbs[i] = (uint32_t)acc;
+        acc >>= 32;
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    uint32_t product[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            carry += (uint64_t)limbs[i] * a.limbs[j] + product[i + j];
+            product[i + j] = (uint32_t)carry;
+            carry >>= 32;
+        }
+        product[i + LIMBS] = (uint32_t)carry;
+    }
+
+    // Fold the upper half onto the lower one, multiplied by MAX_PRIME_DIFF
+    uint64_t carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        carry += (uint64_t)product[i + LIMBS] * MAX_PRIME_DIFF + product[i];
+        limbs[i] = (uint32_t)carry;
+        carry >>= 32;
+    }
+    while (carry != 0) {
+        uint64_t acc = carry * MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && acc != 0; i++) {
+            acc += limbs[i];
+            limbs[i] = (uint32_t)acc;
+            acc >>= 32;
+        }
+        carry = acc;
+    }
+    if (IsOverflow()) FullReduce();
+}
+
+void Num3072::SetToInverse()
+{
+    // Fermat: the inverse is the number to the power of the prime minus 2, by windows of 4 bits
+    Num3072 powers[16];
+    powers[1] = *this;
+    for (int i = 2; i < 16; i++) {
+        powers[i] = powers[i - 1];
+        powers[i].Multiply(*this);
+    }
+
+    Num3072 result;
+    for (int i = LIMBS - 1; i >= 0; i--) {
+        uint32_t exponent = i == 0 ? (uint32_t)(0x100000000ull - MAX_PRIME_DIFF - 2) : 0xFFFFFFFFu;
+        for (int window = 7; window >= 0; window--) {
+            for (int j = 0; j < 4; j++) {
+                result.Multiply(result);
+            }
+            result.Multiply(powers[(exponent >> (4 * window)) & 15]);
+        }
+    }
+    *this = result;
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE]) const
+{
+    for (int i = 0; i < LIMBS; i++) {
+        WriteLE32(out + 4 * i, limbs[i]);
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(const unsigned char* data, size_t len)
+{
+    // The element is hashed, and the hash keys a ChaCha20 stream as long as a number
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(hash);
+    unsigned char stream[Num3072::BYTE_SIZE];
+    ChaCha20(hash, sizeof(hash)).Output(stream, sizeof(stream));
+    return Num3072(stream);
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul)
+{
+    numerator.Multiply(mul.numerator);
+    denominator.Multiply(mul.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div)
+{
+    numerator.Multiply(div.denominator);
+    denominator.Multiply(div.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(uint256& out) const
+{
+    Num3072 result = denominator;
+    result.SetToInverse();
+    result.Multiply(numerator);
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    result.ToBytes(data);
+    CSHA256().Write(data, sizeof(data)).Finalize(out.begin());
+}
+
+void MuHash3072::ToBytes(unsigned char (&out)[SERIALIZED_SIZE]) const
+{
+    unsigned char num[Num3072::BYTE_SIZE];
+    numerator.ToBytes(num);
+    memcpy(out, num, sizeof(num));
+    denominator.ToBytes(num);
+    memcpy(out + Num3072::BYTE_SIZE, num, sizeof(num));
+}
+
+void MuHash3072::FromBytes(const unsigned char (&in)[SERIALIZED_SIZE])
+{
+    unsigned char num[Num3072::BYTE_SIZE];
+    memcpy(num, in, sizeof(num));
+    numerator = Num3072(num);
+    memcpy(num, in + Num3072::BYTE_SIZE, sizeof(num));
+    denominator = Num3072(num);
+}
@@ -0,0 +1,76 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_MUHASH_H
+#define BITCOIN_CRYPTO_MUHASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <uint256.h>
+
+/** A number modulo the prime 2^3072 - 1103717, in little endian 32 bit limbs */
+class Num3072
+{
+public:
+    static const size_t BYTE_SIZE = 384;
+    static const int LIMBS = 96;
+
+    uint32_t limbs[LIMBS];
+
+    /** The number one */
+    Num3072();
+    /** The number in BYTE_SIZE little endian bytes, reduced modulo the prime */
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    void Multiply(const Num3072& a);
+    /** Replace the number by its multiplicative inverse, it must not be zero */
+    void SetToInverse();
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]) const;
+
+private:
+    bool IsOverflow() const;
+    void FullReduce();
+};
+
+/**
+ * A hash of a set of byte strings, the MuHash of Bellare and Micciancio's "A New Paradigm for
+ * Collision-free Hashing: Incrementality at Reduced Cost": every element is hashed to a number
+ * modulo a 3072 bit prime and the set hash is their product. Elements are added and removed
+ * in any order, and the hashes of two sets combine into the hash of their union, so the hash
+ * of a growing and shrinking set is kept without visiting the set. Removals are kept in a
+ * separate denominator, so the only inversion is made by Finalize.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    /** The hash of the empty set */
+    MuHash3072() {}
+
+    /** Add an element to the set */
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    /** Remove an element of the set */
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    /** Add the elements of the set of mul and remove those it removed */
+    MuHash3072& operator*=(const MuHash3072& mul);
+    /** Undo operator*= of div */
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    /** The 256 bit hash of the set */
+    void Finalize(uint256& out) const;
+
+    static const size_t SERIALIZED_SIZE = 2 * Num3072::BYTE_SIZE;
+    /** The numerator and denominator, to be restored by FromBytes */
+    void ToBytes(unsigned char (&out)[SERIALIZED_SIZE]) const;
+    void FromBytes(const unsigned char (&in)[SERIALIZED_SIZE]);
+};
+
+#endif // BITCOIN_CRYPTO_MUHASH_H
@@ -7,6 +7,7 @@
 
 #include <assert.h>
 #include <string.h>
+#include <algorithm>
 #include <atomic>
 
 #if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
@@ -29,6 +30,11 @@ namespace sha256d64_avx2
 void Transform_8way(unsigned char* out, const unsigned char* in);
 }
 
+namespace sha256_avx2
+{
+void Transform_8way(uint32_t* s, const unsigned char* const* chunks);
+}
+
 namespace sha256d64_shani
 {
 void Transform_2way(unsigned char* out, const unsigned char* in);
@@ -461,6 +467,75 @@ TransformD64Type TransformD64 = sha256::TransformD64;
 TransformD64Type TransformD64_2way = nullptr;
 TransformD64Type TransformD64_4way = nullptr;
 TransformD64Type TransformD64_8way = nullptr;
+typedef void (*TransformMultiType)(uint32_t*, const unsigned char* const*);
+TransformMultiType TransformMulti_8way = nullptr;
+
+/** Double-SHA256 of up to 8 messages, one lane each, filling the lanes block by block */
+void SHA256DGroup(unsigned char* out, const unsigned char* const* in, const size_t* lens, size_t n)
+{
+    uint32_t s[64];
+    size_t blocks[8] = {};
+    size_t maxBlocks = 0;
+    // Lanes are interleaved, word i of lane l is at s[8 * i + l]
+    uint32_t init[8];
+    sha256::Initialize(init);
+    for (int i = 0; i < 8; i++) {
+        for (int l = 0; l < 8; l++) {
+            s[8 * i + l] = init[i];
+        }
+    }
+    for (size_t l = 0; l < n; l++) {
+        blocks[l] = (lens[l] + 8) / 64 + 1;
+        maxBlocks = std::max(maxBlocks, blocks[l]);
+    }
+    static const unsigned char zero[64] = {};
+    unsigned char tail[8][128];
+    unsigned char inner[8][64];
+    const unsigned char* chunks[8];
+    for (size_t b = 0; b < maxBlocks; b++) {
+        for (size_t l = 0; l < 8; l++) {
+            chunks[l] = zero;
+            if (l >= n || b >= blocks[l]) continue;
+            size_t full = lens[l] / 64;
+            if (b < full) {
+                chunks[l] = in[l] + 64 * b;
+                continue;
+            }
+            if (b == full) {
+                // The padding takes one or two blocks after the last full one
+                size_t rem = lens[l] % 64;
+                memset(tail[l], 0, sizeof(tail[l]));
+                memcpy(tail[l], in[l] + 64 * full, rem);
+                tail[l][rem] = 0x80;
+                WriteBE64(tail[l] + 64 * (blocks[l] - full) - 8, (uint64_t)lens[l] << 3);
+            }
+            chunks[l] = tail[l] + 64 * (b - full);
+        }
+        TransformMulti_8way(s, chunks);
+        for (size_t l = 0; l < n; l++) {
+            if (b + 1 != blocks[l]) continue;
+            for (int i = 0; i < 8; i++) {
+                WriteBE32(inner[l] + 4 * i, s[8 * i + l]);
+            }
+        }
+    }
+    // The second hash is one block for every lane
+    for (size_t l = 0; l < 8; l++) {
+        memset(inner[l] + 32, 0, 32);
+        inner[l][32] = 0x80;
+        WriteBE64(inner[l] + 56, 256);
+        chunks[l] = inner[l];
+        for (int i = 0; i < 8; i++) {
+            s[8 * i + l] = init[i];
+        }
+    }
+    TransformMulti_8way(s, chunks);
+    for (size_t l = 0; l < n; l++) {
+        for (int i = 0; i < 8; i++) {
+            WriteBE32(out + 32 * l + 4 * i, s[8 * i + l]);
+        }
+    }
+}
 
 bool SelfTest() {
     // Input state (equal to the initial SHA256 state)
@@ -544,6 +619,20 @@ bool SelfTest() {
         if (!std::equal(out, out + 256, result_d64)) return false;
     }
 
+    // Test TransformMulti_8way on messages that end in each way the padding does, if available.
+    if (TransformMulti_8way) {
+        const unsigned char* in[8] = {data, data + 1, data + 2, data + 3, data + 4, data + 5, data + 6, data + 7};
+        const size_t lens[8] = {0, 1, 55, 56, 63, 64, 119, 200};
+        unsigned char out[256];
+        unsigned char hash[32];
+        SHA256DGroup(out, in, lens, 8);
+        for (int i = 0; i < 8; i++) {
+            CSHA256().Write(in[i], lens[i]).Finalize(hash);
+            CSHA256().Write(hash, 32).Finalize(hash);
+            if (!std::equal(hash, hash + 32, out + 32 * i)) return false;
+        }
+    }
+
     return true;
 }
 
@@ -629,6 +718,7 @@ std::string SHA256AutoDetect()
 #if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
     if (have_avx2 && have_avx && enabled_avx) {
         TransformD64_8way = sha256d64_avx2::Transform_8way;
+        TransformMulti_8way = sha256_avx2::Transform_8way;
         ret += ",avx2(8way)";
     }
 #endif
@@ -728,3 +818,27 @@ void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
         --blocks;
     }
 }
+
+bool SHA256DManyIsBatched()
+{
+    return TransformMulti_8way != nullptr;
+}
+
+void SHA256DMany(unsigned char* out, const unsigned char* const* in, const size_t* lens, size_t n)
+{
+    if (TransformMulti_8way) {
+        while (n >= 2) {
+            size_t group = std::min<size_t>(n, 8);
+            SHA256DGroup(out, in, lens, group);
+            out += 32 * group;
+            in += group;
+            lens += group;
+            n -= group;
+        }
+    }
+    unsigned char hash[CSHA256::OUTPUT_SIZE];
+    for (size_t i = 0; i < n; i++) {
+        CSHA256().Write(in[i], lens[i]).Finalize(hash);
+        CSHA256().Write(hash, CSHA256::OUTPUT_SIZE).Finalize(out + 32 * i);
+    }
+}
@@ -38,4 +38,16 @@ std::string SHA256AutoDetect();
  */
 void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
 
+/** Compute the double-SHA256's of messages of any length.
+ *  output:  pointer to a n*32 byte output buffer
+ *  input:   pointers to the n messages
+ *  lens:    the lengths of the n messages
+ *  With a multi-way implementation the lanes are filled across messages,
+ *  otherwise the messages are hashed one at a time.
+ */
+void SHA256DMany(unsigned char* output, const unsigned char* const* input, const size_t* lens, size_t n);
+
+/** Whether SHA256DMany hashes several messages at a time */
+bool SHA256DManyIsBatched();
+
 #endif // BITCOIN_CRYPTO_SHA256_H
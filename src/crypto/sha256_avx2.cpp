@@ -322,4 +322,65 @@ void Transform_8way(unsigned char* out, const unsigned char* in)
 
 }
 
+namespace sha256_avx2 {
+namespace {
+
+const uint32_t KT[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+};
+
+using namespace sha256d64_avx2;
+
+}
+
+/** Compress one 64-byte chunk per lane into the states of 8 lanes, word i of lane l at s[8 * i + l] */
+void Transform_8way(uint32_t* s, const unsigned char* const* chunks)
+{
+    __m256i st[8];
+    for (int i = 0; i < 8; i++) {
+        st[i] = _mm256_loadu_si256((const __m256i*)(s + 8 * i));
+    }
+    __m256i w[16];
+    for (int i = 0; i < 16; i++) {
+        w[i] = _mm256_set_epi32(ReadBE32(chunks[7] + 4 * i), ReadBE32(chunks[6] + 4 * i), ReadBE32(chunks[5] + 4 * i), ReadBE32(chunks[4] + 4 * i),
+                                ReadBE32(chunks[3] + 4 * i), ReadBE32(chunks[2] + 4 * i), ReadBE32(chunks[1] + 4 * i), ReadBE32(chunks[0] + 4 * i));
+    }
+    __m256i a = st[0], b = st[1], c = st[2], d = st[3], e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int r = 0; r < 64; r++) {
+        if (r >= 16) {
+            Inc(w[r & 15], sigma1(w[(r - 2) & 15]), w[(r - 7) & 15], sigma0(w[(r - 15) & 15]));
+        }
+        __m256i t1 = Add(h, Sigma1(e), Ch(e, f, g), Add(K(KT[r]), w[r & 15]));
+        __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = Add(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = Add(t1, t2);
+    }
+    st[0] = Add(st[0], a);
+    st[1] = Add(st[1], b);
+    st[2] = Add(st[2], c);
+    st[3] = Add(st[3], d);
+    st[4] = Add(st[4], e);
+    st[5] = Add(st[5], f);
+    st[6] = Add(st[6], g);
+    st[7] = Add(st[7], h);
+    for (int i = 0; i < 8; i++) {
+        _mm256_storeu_si256((__m256i*)(s + 8 * i), st[i]);
+    }
+}
+
+}
+
 #endif
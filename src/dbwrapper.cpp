@@ -97,13 +97,20 @@ static void SetMaxOpenFiles(leveldb::Options *options) {
              options->max_open_files, default_open_files);
 }
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+leveldb::Options GetDBOptions(size_t nCacheSize, const DBProfile& profile)
 {
     leveldb::Options options;
     options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
     options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
+    options.block_size = profile.block_size;
+    int bloom_bits = profile.bloom_bits;
+    if (bloom_bits < 0) {
+        bloom_bits = std::max<int64_t>(0, std::min<int64_t>(gArgs.GetArg("-dbbloombits", DEFAULT_DB_BLOOM_BITS), 32));
+    }
+    if (bloom_bits > 0) {
+        options.filter_policy = leveldb::NewBloomFilterPolicy(bloom_bits);
+    }
+    options.compression = profile.compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -114,7 +121,7 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const DBProfile& profile)
     : m_name(fs::basename(path))
 {
     penv = nullptr;
@@ -122,7 +129,7 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetDBOptions(nCacheSize, profile);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -139,6 +146,8 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
     LogPrintf("Opened LevelDB successfully\n");
+    LogPrint(BCLog::LEVELDB, "LevelDB %s: block_size=%u, filter=%s, compression=%s\n", m_name, options.block_size,
+             options.filter_policy ? options.filter_policy->Name() : "none", profile.compression ? "snappy" : "none");
 
     if (gArgs.GetBoolArg("-forcecompactdb", false)) {
         LogPrintf("Starting database compaction of %s\n", path.string());
@@ -168,6 +177,9 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
 
 CDBWrapper::~CDBWrapper()
 {
+    if (LogAcceptCategory(BCLog::LEVELDB)) {
+        LogStats();
+    }
     delete pdb;
     pdb = nullptr;
     delete options.filter_policy;
@@ -193,10 +205,26 @@ bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
         double mem_after = DynamicMemoryUsage() / 1024.0 / 1024;
         LogPrint(BCLog::LEVELDB, "WriteBatch memory usage: db=%s, before=%.1fMiB, after=%.1fMiB\n",
                  m_name, mem_before, mem_after);
+        int64_t now = GetTime();
+        if (now - m_last_stats_time >= DB_STATS_LOG_INTERVAL) {
+            m_last_stats_time = now;
+            LogStats();
+        }
     }
     return true;
 }
 
+void CDBWrapper::LogStats() const
+{
+    std::string stats;
+    if (!pdb->GetProperty("leveldb.stats", &stats)) {
+        LogPrint(BCLog::LEVELDB, "Failed to get stats property\n");
+        return;
+    }
+    LogPrint(BCLog::LEVELDB, "LevelDB stats of %s, memory=%.1fMiB:\n%s", m_name,
+             DynamicMemoryUsage() / 1024.0 / 1024, stats);
+}
+
 size_t CDBWrapper::DynamicMemoryUsage() const {
     std::string memory;
     if (!pdb->GetProperty("leveldb.approximate-memory-usage", &memory)) {
@@ -236,7 +264,9 @@ bool CDBWrapper::IsEmpty()
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() const { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
+void CDBIterator::SeekToLast() { piter->SeekToLast(); }
 void CDBIterator::Next() { piter->Next(); }
+void CDBIterator::Prev() { piter->Prev(); }
 
 namespace dbwrapper_private {
 
@@ -18,6 +18,38 @@
 
 static const size_t DBWRAPPER_PREALLOC_KEY_SIZE = 64;
 static const size_t DBWRAPPER_PREALLOC_VALUE_SIZE = 1024;
+//! -dbbloombits default (bits per key of the bloom filter of point lookup databases)
+static const int DEFAULT_DB_BLOOM_BITS = 10;
+//! Block size of the databases that are mostly range scanned
+static const size_t DB_RANGE_SCAN_BLOCK_SIZE = 64 * 1024;
+//! Seconds between two leveldb statistics reports of a database with -debug=leveldb
+static const int64_t DB_STATS_LOG_INTERVAL = 10 * 60;
+
+/**
+ * How a database is accessed, used to pick its leveldb table options.
+ */
+struct DBProfile {
+    //! Uncompressed size of a table block; larger blocks make range scans cheaper
+    size_t block_size;
+    //! Bits per key of the bloom filter, 0 to go without one. Negative means -dbbloombits.
+    int bloom_bits;
+    //! Whether to snappy compress table blocks. leveldb stores a block uncompressed when
+    //! it was built without snappy or the block does not shrink.
+    bool compression;
+
+    //! Mostly gets of single keys, like the coins database
+    static DBProfile PointLookups() { return DBProfile{4 * 1024, -1, false}; }
+    //! Mostly iteration over key ranges, like the block tree with its address and height indexes
+    static DBProfile RangeScans() { return DBProfile{DB_RANGE_SCAN_BLOCK_SIZE, DEFAULT_DB_BLOOM_BITS, true}; }
+    //! Point lookups of large, compressible values like the transaction receipts
+    static DBProfile CompressedLookups() { return DBProfile{16 * 1024, -1, true}; }
+};
+
+/**
+ * leveldb options for a database with the given cache size and profile. The caller
+ * owns the block cache, filter policy and info log of the result.
+ */
+leveldb::Options GetDBOptions(size_t nCacheSize, const DBProfile& profile);
 
 class dbwrapper_error : public std::runtime_error
 {
@@ -134,6 +166,8 @@ public:
 
     void SeekToFirst();
 
+    void SeekToLast();
+
     template<typename K> void Seek(const K& key) {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
@@ -144,6 +178,8 @@ public:
 
     void Next();
 
+    void Prev();
+
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
@@ -201,6 +237,9 @@ private:
     //! the name of this database
     std::string m_name;
 
+    //! when the leveldb statistics of this database were last logged
+    int64_t m_last_stats_time = 0;
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
@@ -220,8 +259,10 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] profile     Table options matching how the database is accessed.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false,
+               const DBProfile& profile = DBProfile::PointLookups());
     ~CDBWrapper();
 
     CDBWrapper(const CDBWrapper&) = delete;
@@ -293,6 +334,9 @@ public:
     // Get an estimate of LevelDB memory usage (in bytes).
     size_t DynamicMemoryUsage() const;
 
+    // Log the leveldb statistics of this database to the leveldb debug category.
+    void LogStats() const;
+
     // not available for LevelDB; provide for compatibility with BDB
     bool Flush()
     {
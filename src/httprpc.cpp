@@ -19,12 +19,28 @@
 #include <stdio.h>
 
 #include <memory>
+#include <set>
 
 #include <boost/algorithm/string.hpp> // boost::trim
 
 /** WWW-Authenticate to present with 401 Unauthorized response */
 static const char* WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
 
+/** How much of a request body is searched for method names to pick its worker pool */
+static const size_t MAX_CLASSIFY_BODY_SIZE = 4096;
+
+/** Methods that wait for new blocks or logs, run by the long-poll workers */
+static const std::set<std::string> setLongPollMethods = {
+    "waitforlogs", "waitfornewblock", "waitforblock", "waitforblockheight", "getblocktemplate",
+};
+
+/** Methods that scan many blocks, receipts or coins, run by the heavy workers */
+static const std::set<std::string> setHeavyMethods = {
+    "searchlogs", "callcontractbatch", "gettxoutsetinfo", "dumptxoutset", "scantxoutset", "verifychain", "getblockstats",
+    "getaddresstxids", "getaddressdeltas", "getaddressutxos", "rescanblockchain", "importmulti",
+    "importprivkey", "importaddress", "importpubkey", "importwallet", "dumpwallet",
+};
+
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wallet.
  */
@@ -131,7 +147,7 @@ static bool multiUserAuthorized(std::string strUserPass)
     return false;
 }
 
-static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUsernameOut)
+bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUsernameOut)
 {
     if (strRPCUserColonPass.empty()) // Belt-and-suspenders measure if InitRPCAuthentication was not called
         return false;
@@ -151,6 +167,36 @@ static bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUserna
     return multiUserAuthorized(strUserPass);
 }
 
+/**
+ * Pick the worker pool of a JSON-RPC request, or batch, from the method names at the start of its
+ * body. This runs on the event loop thread, so the body is only searched rather than parsed; a
+ * request that is misjudged is still served, just by other workers.
+ */
+static HTTPWorkClass JSONRPCWorkClass(HTTPRequest* req, const std::string &)
+{
+    const std::string body = req->PeekBody(MAX_CLASSIFY_BODY_SIZE);
+    HTTPWorkClass work_class = HTTPWorkClass::LIGHT;
+    size_t pos = 0;
+    while ((pos = body.find("\"method\"", pos)) != std::string::npos) {
+        pos = body.find_first_not_of(" \t\r\n", pos + 8);
+        if (pos == std::string::npos || body[pos] != ':')
+            continue;
+        pos = body.find_first_not_of(" \t\r\n", pos + 1);
+        if (pos == std::string::npos || body[pos] != '"')
+            continue;
+        size_t end = body.find('"', pos + 1);
+        if (end == std::string::npos)
+            break;
+        const std::string method = body.substr(pos + 1, end - pos - 1);
+        if (setLongPollMethods.count(method))
+            return HTTPWorkClass::LONGPOLL;
+        if (setHeavyMethods.count(method))
+            work_class = HTTPWorkClass::HEAVY;
+        pos = end;
+    }
+    return work_class;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -194,21 +240,35 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
+            jreq.rawResult = std::make_shared<std::string>();
+            jreq.blockWait = std::make_shared<RPCBlockWait>();
 
             UniValue result = tableRPC.execute(jreq);
 
+            if (jreq.blockWait->condition) {
+                // Reply once the tip gets there, without keeping this worker thread
+                RPCBlockWait wait = *jreq.blockWait;
+                UniValue id = jreq.id;
+                req->Defer([wait, id](std::unique_ptr<HTTPRequest> deferred) {
+                    RPCDeferBlockWait(std::move(deferred), id, wait);
+                });
+                return true;
+            }
+
             if (jreq.isLongPolling) {
                 jreq.PollReply(result);
                 return true;
             }
 
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            // Send reply, writing the result as text saves copying it into a reply object
+            strReply = JSONRPCRawReply(jreq.rawResult->empty() ? result.write() : *jreq.rawResult, jreq.id);
+            strReply += "\n";
 
         // array of requests
-        } else if (valRequest.isArray())
+        } else if (valRequest.isArray()) {
+            jreq.rawResult = std::make_shared<std::string>();
             strReply = JSONRPCExecBatch(jreq, valRequest.get_array());
-        else
+        } else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
 
         req->WriteHeader("Content-Type", "application/json");
@@ -251,9 +311,9 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, JSONRPCWorkClass);
     if (g_wallet_init_interface.HasWalletSupport()) {
-        RegisterHTTPHandler("/wallet/", false, HTTPReq_JSONRPC);
+        RegisterHTTPHandler("/wallet/", false, HTTPReq_JSONRPC, JSONRPCWorkClass);
     }
     struct event_base* eventBase = EventBase();
     assert(eventBase);
@@ -20,6 +20,9 @@ void InterruptHTTPRPC();
  */
 void StopHTTPRPC();
 
+/** Check the credentials of an Authorization header against -rpcuser/-rpcpassword, -rpcauth or the cookie */
+bool RPCAuthorized(const std::string& strAuth, std::string& strAuthUsernameOut);
+
 /** Start HTTP REST subsystem.
  * Precondition; HTTP and RPC has been started.
  */
@@ -15,6 +15,7 @@
 #include <sync.h>
 #include <ui_interface.h>
 
+#include <algorithm>
 #include <deque>
 #include <memory>
 #include <stdio.h>
@@ -54,6 +55,12 @@ public:
     void operator()() override
     {
         func(req.get(), path);
+        if (req->continuation) {
+            // The handler deferred its reply, hand the request over now that this thread is done with it
+            std::function<void(std::unique_ptr<HTTPRequest>)> continuation = std::move(req->continuation);
+            req->continuation = nullptr;
+            continuation(std::move(req));
+        }
     }
 
     std::unique_ptr<HTTPRequest> req;
@@ -126,13 +133,24 @@ public:
 
 struct HTTPPathHandler
 {
-    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler):
-        prefix(_prefix), exactMatch(_exactMatch), handler(_handler)
+    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler, HTTPWorkClassifier _classifier):
+        prefix(_prefix), exactMatch(_exactMatch), handler(_handler), classifier(_classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPWorkClassifier classifier;
+};
+
+/** Worker threads and work queue of one HTTPWorkClass */
+struct HTTPWorkPool
+{
+    const char* name;
+    const char* threadsArg;
+    int defaultThreads;
+    WorkQueue<HTTPClosure>* queue;
+    std::vector<std::thread> threads;
 };
 
 /** HTTP module state */
@@ -143,15 +161,19 @@ static struct event_base* eventBase = nullptr;
 struct evhttp* eventHTTP = nullptr;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
-//! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = nullptr;
+//! Work queues for handling longer requests off the event loop thread, indexed by HTTPWorkClass
+static HTTPWorkPool workPools[] = {
+    {"light", "-rpcthreads", DEFAULT_HTTP_THREADS, nullptr, {}},
+    {"heavy", "-rpcheavythreads", DEFAULT_HTTP_HEAVY_THREADS, nullptr, {}},
+    {"longpoll", "-rpclongpollthreads", DEFAULT_HTTP_LONGPOLL_THREADS, nullptr, {}},
+};
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
 std::vector<evhttp_bound_socket *> boundSockets;
 
 /** Check if a network address is allowed to access the HTTP server */
-static bool ClientAllowed(const CNetAddr& netaddr)
+bool ClientAllowed(const CNetAddr& netaddr)
 {
     if (!netaddr.IsValid())
         return false;
@@ -263,12 +285,13 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        HTTPWorkPool& pool = workPools[static_cast<int>(i->classifier ? i->classifier(hreq.get(), path) : HTTPWorkClass::LIGHT)];
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
-        assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        assert(pool.queue);
+        if (pool.queue->Enqueue(item.get()))
             item.release(); /* if true, queue took ownership */
         else {
-            LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+            LogPrintf("WARNING: request rejected because http %s work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n", pool.name);
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
         }
     } else {
@@ -398,9 +421,11 @@ bool InitHTTPServer()
 
     LogPrint(BCLog::HTTP, "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)gArgs.GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
-    LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
+    LogPrintf("HTTP: creating work queues of depth %d\n", workQueueDepth);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    for (HTTPWorkPool& pool : workPools) {
+        pool.queue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    }
     // transfer ownership to eventBase/HTTP via .release()
     eventBase = base_ctr.release();
     eventHTTP = http_ctr.release();
@@ -422,17 +447,18 @@ bool UpdateHTTPServerLogging(bool enable) {
 }
 
 std::thread threadHTTP;
-static std::vector<std::thread> g_thread_http_workers;
 
 void StartHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Starting HTTP server\n");
-    int rpcThreads = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
-    LogPrintf("HTTP: starting %d worker threads\n", rpcThreads);
     threadHTTP = std::thread(ThreadHTTP, eventBase);
 
-    for (int i = 0; i < rpcThreads; i++) {
-        g_thread_http_workers.emplace_back(HTTPWorkQueueRun, workQueue);
+    for (HTTPWorkPool& pool : workPools) {
+        int rpcThreads = std::max((long)gArgs.GetArg(pool.threadsArg, pool.defaultThreads), 1L);
+        LogPrintf("HTTP: starting %d %s worker threads\n", rpcThreads, pool.name);
+        for (int i = 0; i < rpcThreads; i++) {
+            pool.threads.emplace_back(HTTPWorkQueueRun, pool.queue);
+        }
     }
 }
 
@@ -443,21 +469,25 @@ void InterruptHTTPServer()
         // Reject requests on current connections
         evhttp_set_gencb(eventHTTP, http_reject_request_cb, nullptr);
     }
-    if (workQueue)
-        workQueue->Interrupt();
+    for (HTTPWorkPool& pool : workPools) {
+        if (pool.queue)
+            pool.queue->Interrupt();
+    }
 }
 
 void StopHTTPServer()
 {
     LogPrint(BCLog::HTTP, "Stopping HTTP server\n");
-    if (workQueue) {
-        LogPrint(BCLog::HTTP, "Waiting for HTTP worker threads to exit\n");
-        for (auto& thread: g_thread_http_workers) {
+    for (HTTPWorkPool& pool : workPools) {
+        if (!pool.queue)
+            continue;
+        LogPrint(BCLog::HTTP, "Waiting for HTTP %s worker threads to exit\n", pool.name);
+        for (auto& thread: pool.threads) {
             thread.join();
         }
-        g_thread_http_workers.clear();
-        delete workQueue;
-        workQueue = nullptr;
+        pool.threads.clear();
+        delete pool.queue;
+        pool.queue = nullptr;
     }
     // Unlisten sockets, these are what make the event loop running, which means
     // that after this and all connections are closed the event loop will quit.
@@ -621,10 +651,27 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+std::string HTTPRequest::PeekBody(size_t maxSize) const
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    std::string rv(std::min(maxSize, evbuffer_get_length(buf)), '\0');
+    ev_ssize_t copied = evbuffer_copyout(buf, &rv[0], rv.size());
+    rv.resize(copied < 0 ? 0 : copied);
+    return rv;
+}
+
 bool HTTPRequest::ReplySent() {
     return replySent;
 }
 
+void HTTPRequest::Defer(std::function<void(std::unique_ptr<HTTPRequest>)> _continuation)
+{
+    assert(!replySent && !startedChunkTransfer);
+    continuation = std::move(_continuation);
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -750,10 +797,10 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod() const
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPWorkClassifier &classifier)
 {
     LogPrint(BCLog::HTTP, "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
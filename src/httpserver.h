@@ -8,15 +8,19 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <condition_variable>
 
 static const int DEFAULT_HTTP_THREADS=4;
+static const int DEFAULT_HTTP_HEAVY_THREADS=2;
+static const int DEFAULT_HTTP_LONGPOLL_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
 struct evhttp_request;
 struct event_base;
+class CNetAddr;
 class CService;
 class HTTPRequest;
 
@@ -38,16 +42,29 @@ void StopHTTPServer();
  * libevent doesn't support debug logging.*/
 bool UpdateHTTPServerLogging(bool enable);
 
+/** Worker pools of the HTTP server, each with its own threads and work queue so that
+ * slow requests cannot starve quick ones */
+enum class HTTPWorkClass {
+    LIGHT,    //!< quick lookups, run by -rpcthreads
+    HEAVY,    //!< scans over many blocks or receipts, run by -rpcheavythreads
+    LONGPOLL, //!< calls waiting for new blocks or logs, run by -rpclongpollthreads
+};
+
 /** Handler for requests to a certain HTTP path */
 typedef std::function<bool(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Picks the worker pool of a request on the event loop thread, before it is handled */
+typedef std::function<HTTPWorkClass(HTTPRequest* req, const std::string &)> HTTPWorkClassifier;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Without a classifier requests run in the light pool.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPWorkClassifier &classifier = nullptr);
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** Whether -rpcallowip allows connections from the address */
+bool ClientAllowed(const CNetAddr& netaddr);
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -67,9 +84,13 @@ private:
     std::mutex cs;
     std::condition_variable closeCv;
 
+    std::function<void(std::unique_ptr<HTTPRequest>)> continuation;
+
     void startDetectClientClose();
     void waitClientClose();
 
+    friend class HTTPWorkItem;
+
 public:
     explicit HTTPRequest(struct evhttp_request* req);
     ~HTTPRequest();
@@ -112,6 +133,11 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Copy at most maxSize bytes from the start of the request body, without consuming it.
+     */
+    std::string PeekBody(size_t maxSize) const;
+
     /**
      * Write output header.
      *
@@ -143,6 +169,13 @@ public:
      * Is reply sent?
      */
     bool ReplySent();
+
+    /**
+     * Keep the request open after the handler returns, to reply from another thread later
+     * without holding a worker thread. The continuation is given ownership of the request once
+     * the worker is done with it and must eventually send the reply.
+     */
+    void Defer(std::function<void(std::unique_ptr<HTTPRequest>)> _continuation);
 };
 
 /** Event handler closure.
@@ -0,0 +1,268 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/addressindex.h>
+#include <script/standard.h>
+#include <txdb.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <boost/thread.hpp>
+
+constexpr char DB_TIMESTAMPINDEX = 'S';
+constexpr char DB_BLOCKHASHINDEX = 'z';
+constexpr char DB_SPENTINDEX = 'p';
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+/**
+ * Access to the address index database (indexes/addressindex/)
+ *
+ * The keys and values are the ones of the block tree DB, the entries of a
+ * block are written in a single batch.
+ */
+class AddressIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Write the entries of a connected block.
+    bool WriteBlock(const std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex,
+                    const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>>& spentIndex,
+                    const CTimestampIndexKey& timestampIndex,
+                    const CTimestampBlockIndexKey& blockhashIndex, const CTimestampBlockIndexValue& logicalts);
+
+    /// Erase the entries of a disconnected block. The timestamp entries are kept, like the block tree DB does.
+    bool EraseBlock(const std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex,
+                    const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>>& spentIndex);
+
+    bool ReadTimestampBlockIndex(const uint256& hash, unsigned int& logicalTS) const;
+};
+
+AddressIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "addressindex", n_cache_size, f_memory, f_wipe, false, DBProfile::RangeScans())
+{}
+
+bool AddressIndex::DB::WriteBlock(const std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex,
+                                  const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>>& spentIndex,
+                                  const CTimestampIndexKey& timestampIndex,
+                                  const CTimestampBlockIndexKey& blockhashIndex, const CTimestampBlockIndexValue& logicalts)
+{
+    CDBBatch batch(*this);
+    WriteAddressIndexEntries(batch, addressIndex);
+    for (const auto& entry : spentIndex) {
+        batch.Write(std::make_pair(DB_SPENTINDEX, entry.first), entry.second);
+    }
+    batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
+    batch.Write(std::make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
+    return WriteBatch(batch);
+}
+
+bool AddressIndex::DB::EraseBlock(const std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex,
+                                  const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>>& spentIndex)
+{
+    CDBBatch batch(*this);
+    EraseAddressIndexEntries(batch, addressIndex);
+    for (const auto& entry : spentIndex) {
+        batch.Erase(std::make_pair(DB_SPENTINDEX, entry.first));
+    }
+    return WriteBatch(batch);
+}
+
+bool AddressIndex::DB::ReadTimestampBlockIndex(const uint256& hash, unsigned int& logicalTS) const
+{
+    CTimestampBlockIndexValue lts;
+    if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts)) {
+        return false;
+    }
+    logicalTS = lts.ltimestamp;
+    return true;
+}
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<AddressIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+AddressIndex::~AddressIndex() {}
+
+bool AddressIndex::Init()
+{
+    // The address history of older versions is converted before the index resumes
+    if (!UpgradeAddressIndex(*m_db)) {
+        return error("%s: Failed to upgrade the address index", __func__);
+    }
+    return BaseIndex::Init();
+}
+
+/**
+ * Collect the address history and spent entries of a block, the spent outputs come from its undo data.
+ * These are the entries ConnectBlock writes to the block tree DB when the index is not enabled.
+ */
+static bool BuildIndexEntries(const CBlock& block, const CBlockIndex* pindex,
+                              std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex,
+                              std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>>& spentIndex)
+{
+    CBlockUndo blockUndo;
+    if (pindex->nHeight > 0) {
+        if (!UndoReadFromDisk(blockUndo, pindex)) {
+            return error("%s: Failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: block and undo data inconsistent", __func__);
+        }
+    }
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *(block.vtx[i]);
+        const uint256 hash = tx.GetHash();
+
+        if (i > 0) {
+            const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size()) {
+                return error("%s: transaction and undo data inconsistent", __func__);
+            }
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxIn& input = tx.vin[j];
+                const CTxOut& prevout = txundo.vprevout[j].out;
+
+                CTxDestination dest;
+                if (ExtractDestination(input.prevout, prevout.scriptPubKey, dest)) {
+                    valtype bytesID(boost::apply_visitor(DataVisitor(), dest));
+                    if (bytesID.empty()) {
+                        continue;
+                    }
+                    valtype addressBytes(32);
+                    std::copy(bytesID.begin(), bytesID.end(), addressBytes.begin());
+                    // record spending activity
+                    addressIndex.push_back(std::make_pair(CAddressIndexKey(dest.which(), uint256(addressBytes), pindex->nHeight, i, hash, j, true), prevout.nValue * -1));
+                    spentIndex.push_back(std::make_pair(CSpentIndexKey(input.prevout.hash, input.prevout.n), CSpentIndexValue(hash, j, pindex->nHeight, prevout.nValue, dest.which(), uint256(addressBytes))));
+                }
+            }
+        }
+
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut& out = tx.vout[k];
+
+            CTxDestination dest;
+            if (ExtractDestination({hash, k}, out.scriptPubKey, dest)) {
+                valtype bytesID(boost::apply_visitor(DataVisitor(), dest));
+                if (bytesID.empty()) {
+                    continue;
+                }
+                valtype addressBytes(32);
+                std::copy(bytesID.begin(), bytesID.end(), addressBytes.begin());
+                // record receiving activity
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(dest.which(), uint256(addressBytes), pindex->nHeight, i, hash, k, false), out.nValue));
+            }
+        }
+    }
+
+    return true;
+}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>> spentIndex;
+    if (!BuildIndexEntries(block, pindex, addressIndex, spentIndex)) {
+        return false;
+    }
+
+    unsigned int logicalTS = pindex->nTime;
+    unsigned int prevLogicalTS = 0;
+
+    // retrieve logical timestamp of the previous block
+    if (pindex->pprev)
+        if (!m_db->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+            LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
+
+    if (logicalTS <= prevLogicalTS) {
+        logicalTS = prevLogicalTS + 1;
+    }
+
+    return m_db->WriteBlock(addressIndex, spentIndex,
+                            CTimestampIndexKey(logicalTS, pindex->GetBlockHash()),
+                            CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS));
+}
+
+bool AddressIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: Failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
+        std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>> spentIndex;
+        if (!BuildIndexEntries(block, pindex, addressIndex, spentIndex)) {
+            return false;
+        }
+        if (!m_db->EraseBlock(addressIndex, spentIndex)) {
+            return error("%s: Failed to erase the entries of block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& AddressIndex::GetDB() const { return *m_db; }
+
+bool AddressIndex::ReadAddressIndex(const uint256& addressHash, int type,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex,
+                                    int start, int end) const
+{
+    CAddressIndexRange range;
+    if (start > 0 && end > 0) {
+        range.start = start;
+    }
+    range.end = end;
+    return ReadAddressIndex(addressHash, type, range, addressIndex);
+}
+
+bool AddressIndex::ReadAddressIndex(const uint256& addressHash, int type, const CAddressIndexRange& range,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex) const
+{
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
+    return ReadAddressIndexRange(*m_db, *pcursor, addressHash, type, range, addressIndex);
+}
+
+bool AddressIndex::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value) const
+{
+    return m_db->Read(std::make_pair(DB_SPENTINDEX, key), value);
+}
+
+bool AddressIndex::ReadTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
+                                      std::vector<std::pair<uint256, unsigned int>>& hashes) const
+{
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_TIMESTAMPINDEX, CTimestampIndexIteratorKey(low)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CTimestampIndexKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_TIMESTAMPINDEX && key.second.timestamp < high) {
+            if (fActiveOnly) {
+                LOCK(cs_main);
+                const CBlockIndex* pblockindex = LookupBlockIndex(key.second.blockHash);
+                if (pblockindex && chainActive.Contains(pblockindex)) {
+                    hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
+                }
+            } else {
+                hashes.push_back(std::make_pair(key.second.blockHash, key.second.timestamp));
+            }
+
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
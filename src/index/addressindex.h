@@ -0,0 +1,60 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_ADDRESSINDEX_H
+#define BITCOIN_INDEX_ADDRESSINDEX_H
+
+#include <chain.h>
+#include <index/base.h>
+#include <validation.h>
+
+/**
+ * AddressIndex keeps the block explorer indexes that validation does not
+ * need: the address history, the spent outputs and the block timestamps.
+ * It is built in the background from blocks and undo data, so connecting a
+ * block does not wait for these writes. The address unspent index stays in
+ * the block tree DB, ConnectBlock reads it.
+ */
+class AddressIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool Init() override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "addressindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~AddressIndex() override;
+
+    /// Same semantics as the CBlockTreeDB methods of the same name.
+    bool ReadAddressIndex(const uint256& addressHash, int type,
+                          std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex,
+                          int start = 0, int end = 0) const;
+    bool ReadAddressIndex(const uint256& addressHash, int type, const CAddressIndexRange& range,
+                          std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex) const;
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value) const;
+    bool ReadTimestampIndex(unsigned int high, unsigned int low, bool fActiveOnly,
+                            std::vector<std::pair<uint256, unsigned int>>& hashes) const;
+};
+
+/// The global address index, used by GetAddressIndex, GetSpentIndex and GetTimestampIndex. May be null,
+/// the entries are then kept by the block tree DB.
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // BITCOIN_INDEX_ADDRESSINDEX_H
@@ -0,0 +1,181 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/blockfilterindex.h>
+#include <undo.h>
+#include <util/convert.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <map>
+
+constexpr char DB_FILTER = 'f';
+
+static std::map<BlockFilterType, BlockFilterIndex> g_filter_indexes;
+
+namespace {
+
+struct DBVal {
+    uint256 header;
+    std::vector<unsigned char> encoded_filter;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(header);
+        READWRITE(encoded_filter);
+    }
+};
+
+} // namespace
+
+/**
+ * Access to a block filter index database (indexes/blockfilter/<filter_type>/)
+ *
+ * The database stores, by block hash, the filter header and the encoded
+ * filter of each block the index was synced through.
+ */
+class BlockFilterIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(const fs::path& path, size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadFilter(const uint256& block_hash, DBVal& value) const;
+
+    bool WriteFilter(const uint256& block_hash, const DBVal& value);
+};
+
+BlockFilterIndex::DB::DB(const fs::path& path, size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(path, n_cache_size, f_memory, f_wipe)
+{}
+
+bool BlockFilterIndex::DB::ReadFilter(const uint256& block_hash, DBVal& value) const
+{
+    return Read(std::make_pair(DB_FILTER, block_hash), value);
+}
+
+bool BlockFilterIndex::DB::WriteFilter(const uint256& block_hash, const DBVal& value)
+{
+    return Write(std::make_pair(DB_FILTER, block_hash), value);
+}
+
+BlockFilterIndex::BlockFilterIndex(BlockFilterType filter_type,
+                                   size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_filter_type(filter_type)
+{
+    const std::string& filter_name = BlockFilterTypeName(filter_type);
+    if (filter_name.empty()) throw std::invalid_argument("unknown filter_type");
+
+    m_name = filter_name + " block filter index";
+    m_db = MakeUnique<BlockFilterIndex::DB>(GetDataDir() / "indexes" / "blockfilter" / filter_name,
+                                            n_cache_size, f_memory, f_wipe);
+}
+
+BlockFilterIndex::~BlockFilterIndex() {}
+
+/** The contract addresses, call targets, log addresses and log topics in the receipts of a block */
+static GCSFilter::ElementSet ContractFilterElements(const CBlock& block)
+{
+    GCSFilter::ElementSet elements;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!tx->HasCreateOrCall()) {
+            continue;
+        }
+        for (const TransactionReceiptInfo& receipt : pstorageresult->getResult(uintToh256(tx->GetHash()))) {
+            if (receipt.contractAddress != dev::Address()) {
+                elements.emplace(receipt.contractAddress.begin(), receipt.contractAddress.end());
+            }
+            if (receipt.to != dev::Address()) {
+                elements.emplace(receipt.to.begin(), receipt.to.end());
+            }
+            for (const dev::eth::LogEntry& log : receipt.logs) {
+                elements.emplace(log.address.begin(), log.address.end());
+                for (const dev::h256& topic : log.topics) {
+                    elements.emplace(topic.begin(), topic.end());
+                }
+            }
+        }
+    }
+    return elements;
+}
+
+bool BlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CBlockUndo block_undo;
+    uint256 prev_header;
+
+    if (pindex->nHeight > 0) {
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+
+        DBVal prev_value;
+        if (!m_db->ReadFilter(pindex->pprev->GetBlockHash(), prev_value)) {
+            return error("%s: previous block %s is not indexed", __func__, pindex->pprev->GetBlockHash().ToString());
+        }
+        prev_header = prev_value.header;
+    }
+
+    GCSFilter::ElementSet contract_elements;
+    if (m_filter_type == BlockFilterType::CONTRACT && fLogEvents) {
+        contract_elements = ContractFilterElements(block);
+    }
+
+    BlockFilter filter(m_filter_type, block, block_undo, contract_elements);
+
+    DBVal value;
+    value.header = filter.ComputeHeader(prev_header);
+    value.encoded_filter = filter.GetEncodedFilter();
+    return m_db->WriteFilter(pindex->GetBlockHash(), value);
+}
+
+BaseIndex::DB& BlockFilterIndex::GetDB() const { return *m_db; }
+
+bool BlockFilterIndex::LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const
+{
+    DBVal value;
+    if (!m_db->ReadFilter(block_index->GetBlockHash(), value)) {
+        return false;
+    }
+    filter_out = BlockFilter(m_filter_type, block_index->GetBlockHash(), std::move(value.encoded_filter));
+    return true;
+}
+
+bool BlockFilterIndex::LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const
+{
+    DBVal value;
+    if (!m_db->ReadFilter(block_index->GetBlockHash(), value)) {
+        return false;
+    }
+    header_out = value.header;
+    return true;
+}
+
+BlockFilterIndex* GetBlockFilterIndex(BlockFilterType filter_type)
+{
+    auto it = g_filter_indexes.find(filter_type);
+    return it != g_filter_indexes.end() ? &it->second : nullptr;
+}
+
+void ForEachBlockFilterIndex(std::function<void (BlockFilterIndex&)> fn)
+{
+    for (auto& entry : g_filter_indexes) fn(entry.second);
+}
+
+bool InitBlockFilterIndex(BlockFilterType filter_type,
+                          size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    auto result = g_filter_indexes.emplace(std::piecewise_construct,
+                                           std::forward_as_tuple(filter_type),
+                                           std::forward_as_tuple(filter_type,
+                                                                 n_cache_size, f_memory, f_wipe));
+    return result.second;
+}
+
+void DestroyAllBlockFilterIndexes()
+{
+    g_filter_indexes.clear();
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_BLOCKFILTERINDEX_H
+#define BITCOIN_INDEX_BLOCKFILTERINDEX_H
+
+#include <blockfilter.h>
+#include <chain.h>
+#include <index/base.h>
+
+#include <functional>
+
+/**
+ * BlockFilterIndex is used to store and retrieve block filters, and their
+ * filter headers, of one filter type for blocks in the chain. The filters
+ * are keyed by block hash, so the entries of a disconnected block stay
+ * valid and a rewind only moves the best block back.
+ *
+ * Filters of type CONTRACT also commit to the contract addresses and log
+ * topics of the block, read from the transaction receipts.
+ */
+class BlockFilterIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    BlockFilterType m_filter_type;
+    std::string m_name;
+    std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return m_name.c_str(); }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit BlockFilterIndex(BlockFilterType filter_type,
+                              size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~BlockFilterIndex() override;
+
+    BlockFilterType GetFilterType() const { return m_filter_type; }
+
+    /// Get a single filter by block. Returns false if the block is not indexed.
+    bool LookupFilter(const CBlockIndex* block_index, BlockFilter& filter_out) const;
+
+    /// Get a single filter header by block. Returns false if the block is not indexed.
+    bool LookupFilterHeader(const CBlockIndex* block_index, uint256& header_out) const;
+};
+
+/// Get a block filter index by type. Returns nullptr if the index for the type is not running.
+BlockFilterIndex* GetBlockFilterIndex(BlockFilterType filter_type);
+
+/// Iterate over all running block filter indexes.
+void ForEachBlockFilterIndex(std::function<void (BlockFilterIndex&)> fn);
+
+/// Initialize a block filter index for the given type if one does not already exist. Returns true if
+/// a new index is created and false if one has already been initialized.
+bool InitBlockFilterIndex(BlockFilterType filter_type,
+                          size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+/// Destroy all block filter indexes.
+void DestroyAllBlockFilterIndexes();
+
+#endif // BITCOIN_INDEX_BLOCKFILTERINDEX_H
@@ -0,0 +1,199 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/contracttxindex.h>
+#include <qtum/qtumstate.h>
+#include <undo.h>
+#include <util/convert.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <boost/thread.hpp>
+
+constexpr char DB_CONTRACTTX = 'c';
+constexpr char DB_SENDERTX = 's';
+
+std::unique_ptr<ContractTxIndex> g_contracttxindex;
+
+typedef std::vector<std::pair<CContractTxIndexKey, CContractTxIndexValue>> ContractTxEntries;
+
+/**
+ * Access to the contract transaction index database (indexes/contracttxindex/)
+ *
+ * The executions are stored twice, under the contract and under the sender, the
+ * entries of a block are written in a single batch.
+ */
+class ContractTxIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Write the entries of a connected block.
+    bool WriteBlock(const ContractTxEntries& contractEntries, const ContractTxEntries& senderEntries);
+
+    /// Erase the entries of a disconnected block.
+    bool EraseBlock(const ContractTxEntries& contractEntries, const ContractTxEntries& senderEntries);
+};
+
+ContractTxIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "contracttxindex", n_cache_size, f_memory, f_wipe, false, DBProfile::RangeScans())
+{}
+
+bool ContractTxIndex::DB::WriteBlock(const ContractTxEntries& contractEntries, const ContractTxEntries& senderEntries)
+{
+    CDBBatch batch(*this);
+    for (const auto& entry : contractEntries) {
+        batch.Write(std::make_pair(DB_CONTRACTTX, entry.first), entry.second);
+    }
+    for (const auto& entry : senderEntries) {
+        batch.Write(std::make_pair(DB_SENDERTX, entry.first), entry.second);
+    }
+    return WriteBatch(batch);
+}
+
+bool ContractTxIndex::DB::EraseBlock(const ContractTxEntries& contractEntries, const ContractTxEntries& senderEntries)
+{
+    CDBBatch batch(*this);
+    for (const auto& entry : contractEntries) {
+        batch.Erase(std::make_pair(DB_CONTRACTTX, entry.first));
+    }
+    for (const auto& entry : senderEntries) {
+        batch.Erase(std::make_pair(DB_SENDERTX, entry.first));
+    }
+    return WriteBatch(batch);
+}
+
+ContractTxIndex::ContractTxIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<ContractTxIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+ContractTxIndex::~ContractTxIndex() {}
+
+/**
+ * Collect the executions of the contract transactions of a block under their contract and
+ * their sender. The spent coins of the undo data give the converter the senders ConnectBlock saw.
+ */
+static bool BuildIndexEntries(const CBlock& block, const CBlockIndex* pindex,
+                              ContractTxEntries& contractEntries, ContractTxEntries& senderEntries)
+{
+    bool fContracts = false;
+    for (const CTransactionRef& tx : block.vtx) {
+        fContracts |= tx->HasCreateOrCall() || tx->HasOpCoinstakeCall();
+    }
+    if (!fContracts)
+        return true;
+
+    CBlockUndo blockUndo;
+    if (!UndoReadFromDisk(blockUndo, pindex)) {
+        return error("%s: Failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (blockUndo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: block and undo data inconsistent", __func__);
+    }
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTxUndo& txundo = blockUndo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != block.vtx[i]->vin.size()) {
+            return error("%s: transaction and undo data inconsistent", __func__);
+        }
+        for (size_t j = 0; j < txundo.vprevout.size(); j++) {
+            view.AddCoin(block.vtx[i]->vin[j].prevout, Coin(txundo.vprevout[j]), true);
+        }
+    }
+
+    unsigned int contractflags = GetContractScriptFlags(pindex->nHeight, Params().GetConsensus());
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *(block.vtx[i]);
+        if (!tx.HasCreateOrCall() && !tx.HasOpCoinstakeCall())
+            continue;
+
+        QtumTxConverter convert(tx, &view, &block.vtx, contractflags);
+        ExtractQtumTX resultConvertQtumTX;
+        if (!convert.extractionQtumTransactions(resultConvertQtumTX)) {
+            LogPrintf("%s: Failed to extract the executions of %s, they are not indexed\n", __func__, tx.GetHash().ToString());
+            continue;
+        }
+        const uint256 hash = tx.GetHash();
+        for (const QtumTransaction& qtumTx : resultConvertQtumTX.first) {
+            bool fCreate = qtumTx.isCreation();
+            uint160 contract = h160Touint(fCreate ? QtumState::createQtumAddress(qtumTx.getHashWith(), qtumTx.getNVout()) : qtumTx.receiveAddress());
+            uint160 sender = h160Touint(qtumTx.sender());
+            contractEntries.push_back(std::make_pair(CContractTxIndexKey(contract, pindex->nHeight, i, qtumTx.getNVout()), CContractTxIndexValue(hash, sender, fCreate)));
+            // A sender that is not a key hash is recorded as zero, it is only listed under the contract
+            if (!sender.IsNull()) {
+                senderEntries.push_back(std::make_pair(CContractTxIndexKey(sender, pindex->nHeight, i, qtumTx.getNVout()), CContractTxIndexValue(hash, contract, fCreate)));
+            }
+        }
+    }
+
+    return true;
+}
+
+bool ContractTxIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    ContractTxEntries contractEntries;
+    ContractTxEntries senderEntries;
+    if (!BuildIndexEntries(block, pindex, contractEntries, senderEntries)) {
+        return false;
+    }
+    if (contractEntries.empty()) {
+        return true;
+    }
+    return m_db->WriteBlock(contractEntries, senderEntries);
+}
+
+bool ContractTxIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    for (const CBlockIndex* pindex = current_tip; pindex != new_tip; pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: Failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        ContractTxEntries contractEntries;
+        ContractTxEntries senderEntries;
+        if (!BuildIndexEntries(block, pindex, contractEntries, senderEntries)) {
+            return false;
+        }
+        if (!contractEntries.empty() && !m_db->EraseBlock(contractEntries, senderEntries)) {
+            return error("%s: Failed to erase the entries of block %s", __func__, pindex->GetBlockHash().ToString());
+        }
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB& ContractTxIndex::GetDB() const { return *m_db; }
+
+bool ContractTxIndex::ReadContractTxs(const uint160& address, bool fSender, int nStartHeight, int nEndHeight, size_t nLimit,
+                                      std::vector<std::pair<CContractTxIndexKey, CContractTxIndexValue>>& entries) const
+{
+    const char prefix = fSender ? DB_SENDERTX : DB_CONTRACTTX;
+    std::unique_ptr<CDBIterator> pcursor(m_db->NewIterator());
+    pcursor->Seek(std::make_pair(prefix, CContractTxIndexKey(address, std::max(nStartHeight, 0))));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CContractTxIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != prefix || key.second.address != address ||
+            (nEndHeight >= 0 && key.second.blockHeight > (unsigned int)nEndHeight)) {
+            break;
+        }
+        if (nLimit > 0 && entries.size() >= nLimit) {
+            break;
+        }
+        CContractTxIndexValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("failed to get contract tx index value");
+        }
+        entries.push_back(std::make_pair(key.second, value));
+        pcursor->Next();
+    }
+
+    return true;
+}
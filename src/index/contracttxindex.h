@@ -0,0 +1,105 @@
+// Copyright (c) 2017-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_CONTRACTTXINDEX_H
+#define BITCOIN_INDEX_CONTRACTTXINDEX_H
+
+#include <chain.h>
+#include <index/base.h>
+#include <serialize.h>
+#include <uint256.h>
+
+/**
+ * Key of a contract execution in the contract transaction index, under the address of
+ * the contract or of the sender. The height and positions are big endian, so the
+ * executions of an address are iterated in chain order.
+ */
+struct CContractTxIndexKey {
+    uint160 address;
+    unsigned int blockHeight;
+    unsigned int txIndex;
+    unsigned int nVout;
+
+    CContractTxIndexKey() : blockHeight(0), txIndex(0), nVout(0) {}
+    CContractTxIndexKey(const uint160& _address, unsigned int _blockHeight, unsigned int _txIndex = 0, unsigned int _nVout = 0) :
+        address(_address), blockHeight(_blockHeight), txIndex(_txIndex), nVout(_nVout) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        address.Serialize(s);
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txIndex);
+        ser_writedata32be(s, nVout);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        address.Unserialize(s);
+        blockHeight = ser_readdata32be(s);
+        txIndex = ser_readdata32be(s);
+        nVout = ser_readdata32be(s);
+    }
+};
+
+/** The transaction of an execution, and the address on its other end: the sender under a contract, the contract under a sender */
+struct CContractTxIndexValue {
+    uint256 txid;
+    uint160 counterpart;
+    bool fCreate;
+
+    CContractTxIndexValue() : fCreate(false) {}
+    CContractTxIndexValue(const uint256& _txid, const uint160& _counterpart, bool _fCreate) :
+        txid(_txid), counterpart(_counterpart), fCreate(_fCreate) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(counterpart);
+        READWRITE(fCreate);
+    }
+};
+
+/**
+ * ContractTxIndex records the contract executions of the connected blocks under the
+ * contract they call or create and under their sender, so the calls into a contract or
+ * sent by an address are listed without scanning receipts. The executions are extracted
+ * with QtumTxConverter, the senders come from the coins in the undo data of the block.
+ * The index is built in the background, does not need -logevents and is kept in
+ * indexes/contracttxindex.
+ */
+class ContractTxIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "contracttxindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit ContractTxIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~ContractTxIndex() override;
+
+    /// The executions of a contract (fSender false) or sent by an address (fSender true) between
+    /// the heights, at most nLimit of them when it is not 0, in chain order.
+    bool ReadContractTxs(const uint160& address, bool fSender, int nStartHeight, int nEndHeight, size_t nLimit,
+                         std::vector<std::pair<CContractTxIndexKey, CContractTxIndexValue>>& entries) const;
+};
+
+/// The global contract transaction index, set by -contracttxindex. May be null.
+extern std::unique_ptr<ContractTxIndex> g_contracttxindex;
+
+#endif // BITCOIN_INDEX_CONTRACTTXINDEX_H
@@ -21,12 +21,18 @@
 #include <checkpoints.h>
 #include <compat/sanity.h>
 #include <consensus/validation.h>
+#include <crypto/keccak.h>
 #include <fs.h>
 #include <httpserver.h>
 #include <httprpc.h>
 #include <interfaces/chain.h>
+#include <index/addressindex.h>
+#include <index/contracttxindex.h>
+#include <index/blockfilterindex.h>
 #include <index/txindex.h>
 #include <key.h>
+#include <locktrip/dgpcache.h>
+#include <metrics.h>
 #include <validation.h>
 #include <miner.h>
 #include <netbase.h>
@@ -37,6 +43,7 @@
 #include <policy/policy.h>
 #include <rpc/server.h>
 #include <rpc/register.h>
+#include <rpc/resultcache.h>
 #include <rpc/blockchain.h>
 #include <rpc/util.h>
 #include <script/standard.h>
@@ -44,15 +51,23 @@
 #include <scheduler.h>
 #include <shutdown.h>
 #include <timedata.h>
+#include <support/largepages.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
 #include <torcontrol.h>
 #include <ui_interface.h>
 #include <util/system.h>
 #include <util/moneystr.h>
 #include <util/convert.h>
+#include <qtum/statepruning.h>
+#include <qtum/codecache.h>
+#include <qtum/contractexecutor.h>
+#include <qtum/contractprofiler.h>
+#include <qtum/vmlogwriter.h>
 #include <logging.h>
 #include <validationinterface.h>
+#include <websocket.h>
 #ifdef ENABLE_WALLET
 #include <wallet/wallet.h>
 #endif
@@ -65,6 +80,7 @@
 #ifndef WIN32
 #include <attributes.h>
 #include <cerrno>
+#include <set>
 #include <signal.h>
 #include <sys/stat.h>
 #endif
@@ -85,6 +101,9 @@ bool fFeeEstimatesInitialized = false;
 static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
+//! Threads servicing the scheduler, they run the callback queues of the validation interface subscribers
+static const int DEFAULT_SCHEDULER_THREADS = 2;
+static const int MAX_SCHEDULER_THREADS = 16;
 
 // Dump addresses to banlist.dat every 15 minutes (900s)
 static constexpr int DUMP_BANS_INTERVAL = 60 * 15;
@@ -181,6 +200,7 @@ public:
 
 static std::unique_ptr<CCoinsViewErrorCatcher> pcoinscatcher;
 static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
+static std::set<BlockFilterType> g_enabled_filter_types;
 
 static boost::thread_group threadGroup;
 static CScheduler scheduler;
@@ -198,6 +218,13 @@ void Interrupt()
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_addressindex) {
+        g_addressindex->Interrupt();
+    }
+    if (g_contracttxindex) {
+        g_contracttxindex->Interrupt();
+    }
+    ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Interrupt(); });
 }
 
 void Shutdown(InitInterfaces& interfaces)
@@ -225,8 +252,18 @@ void Shutdown(InitInterfaces& interfaces)
 
     StopHTTPRPC();
     StopREST();
+    StopMetrics();
     StopRPC();
+    StopWebSocketServer();
     StopHTTPServer();
+    if (g_contract_call_executor) {
+        g_contract_call_executor->Stop();
+        g_contract_call_executor.reset();
+    }
+    if (g_rpc_result_cache) {
+        UnregisterValidationInterface(g_rpc_result_cache.get());
+        g_rpc_result_cache.reset();
+    }
     for (const auto& client : interfaces.chain_clients) {
         client->flush();
     }
@@ -235,6 +272,10 @@ void Shutdown(InitInterfaces& interfaces)
     // Because these depend on each-other, we make sure that neither can be
     // using the other before destroying them.
     if (peerLogic) UnregisterValidationInterface(peerLogic.get());
+    if (g_dgp_cache_updater) {
+        UnregisterValidationInterface(g_dgp_cache_updater.get());
+        g_dgp_cache_updater.reset();
+    }
     if (g_connman) g_connman->Stop();
 
     StopTorControl();
@@ -280,6 +321,20 @@ void Shutdown(InitInterfaces& interfaces)
         g_txindex->Stop();
         g_txindex.reset();
     }
+    if (g_addressindex) {
+        g_addressindex->Stop();
+        g_addressindex.reset();
+    }
+    if (g_contracttxindex) {
+        g_contracttxindex->Stop();
+        g_contracttxindex.reset();
+    }
+    ForEachBlockFilterIndex([](BlockFilterIndex& index) { index.Stop(); });
+    DestroyAllBlockFilterIndexes();
+    if (g_vmlog_writer) {
+        g_vmlog_writer->Stop();
+        g_vmlog_writer.reset();
+    }
 
     // Any future callbacks will be dropped. This should absolutely be safe - if
     // missing a callback results in an unrecoverable situation, unclean shutdown
@@ -291,8 +346,10 @@ void Shutdown(InitInterfaces& interfaces)
         LOCK(cs_main);
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
+            WriteBlockIndexSnapshot();
         }
         pcoinsTip.reset();
+        pcoinsflush.reset();
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
@@ -396,6 +453,10 @@ void SetupServerArgs()
 
     gArgs.AddArg("-version", "Print version and exit", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-assumevalidstate", strprintf("Connect the proof-of-stake blocks up to the built-in block (mainnet: %s, testnet: %s) without executing their contract transactions, "
+            "when the contract state their headers commit to is already in the database, e.g. a stateHYDRA directory copied from a trusted node. "
+            "Execution resumes at the first block whose state is missing. The log indexes and the contract index are not built for the blocks connected this way (default: %u)",
+            defaultChainParams->GetConsensus().defaultAssumeValidState.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValidState.GetHex(), DEFAULT_ASSUME_VALID_STATE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksdir=<dir>", "Specify blocks directory (default: <datadir>/blocks)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", false, OptionsCategory::OPTIONS);
@@ -404,7 +465,12 @@ void SetupServerArgs()
     gArgs.AddArg("-conf=<file>", strprintf("Specify configuration file. Relative paths will be prefixed by datadir location. (default: %s)", BITCOIN_CONF_FILENAME), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-datadir=<dir>", "Specify data directory", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize), true, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-dbbloombits=<n>", strprintf("Bits per key of the bloom filter of the coins, transaction index and receipts databases, 0 to disable (0 to 32, default: %d)", DEFAULT_DB_BLOOM_BITS), true, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-addressindexcache=<n>", strprintf("Maximum size in MiB of the address index writes buffered during initial block download (default: %d)", nDefaultAddressIndexCache), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-dbcache=<n>", strprintf("Maximum database cache size <n> MiB (%d to %d, default: %d). In addition, unused mempool memory is shared for this cache (see -maxmempool).", nMinDbCache, nMaxDbCache, nDefaultDbCache), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blocktreedbcache=<n>", "Share of -dbcache in MiB given to the block index database, which also holds the address and log indexes (default: 3/4 of -dbcache with -addrindex or -logevents, otherwise up to 1/8)", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-receiptsdbcache=<n>", strprintf("Share of -dbcache in MiB given to the transaction receipts database (default: up to 1/16 of the rest of -dbcache, at most %d)", nMaxReceiptsDBCache), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-largepages", strprintf("Place the in-memory UTXO set on huge pages, explicit ones while the kernel has them reserved, otherwise transparent ones (Linux only, default: %u)", DEFAULT_LARGE_PAGES), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-debuglogfile=<file>", strprintf("Specify location of debug log file. Relative paths will be prefixed by a net-specific datadir location. (-nodebuglogfile to disable; default: %s)", DEFAULT_DEBUGLOGFILE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", false, OptionsCategory::OPTIONS);
@@ -415,19 +481,44 @@ void SetupServerArgs()
     gArgs.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-schedulerthreads=<n>", strprintf("Set the number of threads running background tasks and the per subscriber validation notification queues, one more thread only runs the tip notifications of net processing, the wallets and the DGP cache (1 to %d, default: %d)",
+        MAX_SCHEDULER_THREADS, DEFAULT_SCHEDULER_THREADS), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", BITCOIN_PID_FILENAME), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
+            "The receipts and log indexes of pruned blocks are erased with them, and the contract state is pruned at startup as with -prunestate=%u. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
-            "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), false, OptionsCategory::OPTIONS);
+            "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >=%u = automatically prune block files to stay under the specified target size in MiB)", MIN_STATE_BLOCKS_TO_KEEP, MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-compressundo", strprintf("Store newly written undo data in rev*.dat files zlib compressed. Undo data written this way cannot be read by versions without this option. (default: %u)", DEFAULT_COMPRESS_UNDO), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex", "Rebuild chain state and block index from the blk*.dat files on disk", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-reindex-chainstate", "Rebuild chain state from the currently indexed blocks. When in pruning mode or if blocks on disk might be corrupted, use full -reindex instead.", false, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-record-log-opcodes", "Logs all EVM LOG opcode operations to the file vmExecLogs.json", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-prunestate=<n>", strprintf("Erase the contract state of all but the last <n> blocks (at least %u) at startup and compact the contract state databases. "
+            "Reorganizations deeper than <n> blocks and historical contract queries below that height fail afterwards.", MIN_STATE_BLOCKS_TO_KEEP), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-rebuildreceipts=<n>", "Re-execute the contract transactions from block height <n> at startup to rebuild their receipts and log indexes, on one thread per core. "
+            "The coins and the contract state are left alone. To recover a damaged receipts database, delete stateHYDRA/resultsDB first (default: 0 = from the first block)", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-receiptcache=<n>", strprintf("Maximum size in MiB of the cache of decoded transaction receipts (default: %d)", DEFAULT_RECEIPT_CACHE), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-record-log-opcodes", "Logs all EVM LOG opcode operations to the file vmExecLogs.jsonl, one execution per line", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-vm=<kind>", strprintf("EVM implementation to execute the contracts on, legacy or the EVMC interpreter. The interpreter does not report the storage accesses of -contractprofile (default: %s)", DEFAULT_EVM_KIND), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-evmqueue=<n>", strprintf("Refuse read-only contract calls of RPC or of the wallet while <n> of them wait for an EVM worker (default: %d)", DEFAULT_EVM_QUEUE), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-evmthreads=<n>", strprintf("Run the read-only contract calls of RPC and of the wallet on <n> EVM workers, RPC calls first, 0 runs them on the threads asking for them (default: %d)", DEFAULT_EVM_THREADS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-evmtimeout=<n>", strprintf("Fail read-only contract calls that wait more than <n> milliseconds for an EVM worker (default: %d)", DEFAULT_EVM_TIMEOUT), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-contractcodecache=<n>", strprintf("Maximum size in MiB of the cache of contract code shared by all contract executions, 0 disables it (default: %d)", DEFAULT_CONTRACT_CODE_CACHE), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-contractprofile=<n>", strprintf("Profile the gas, time and storage accesses of each contract over the last <n> connected blocks, see getcontractprofile (default: %u)", DEFAULT_CONTRACT_PROFILE_BLOCKS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-vmlogmaxsize=<n>", strprintf("Size in MiB vmExecLogs.jsonl is rotated at (default: %u)", DEFAULT_VMLOG_MAX_SIZE), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-logtopicindex", strprintf("Maintain an index of transactions by log topic to speed up searchlogs with topics, only covers blocks connected while enabled (default: %u)", DEFAULT_LOGTOPICINDEX), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-upgradereceiptsdb", "Rewrite the transaction receipts database in the current format on startup (default: 0)", false, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg("-sysperms", "Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)", false, OptionsCategory::OPTIONS);
 #else
     hidden_args.emplace_back("-sysperms");
 #endif
+    gArgs.AddArg("-asyncaddressindex", strprintf("Build the address history, spent and timestamp indexes in the background in indexes/addressindex instead of while connecting blocks. Going back to the block tree DB entries afterwards requires -reindex (default: %u)", DEFAULT_ASYNCADDRESSINDEX), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockfilterindex=<type>",
+                 strprintf("Maintain an index of compact filters by block (default: %s, values: %s).", DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
+                 " If <type> is not supplied or if <type> = 1, indexes for all known types are enabled. The contract type also commits to the contract addresses and log topics of the block.",
+                 false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-contracttxindex", strprintf("Maintain an index of the contract executions by contract and by sender in indexes/contracttxindex, used by the listcontracttxs rpc call (default: %u)", DEFAULT_CONTRACTTXINDEX), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-utxosethash", strprintf("Maintain a rolling hash of the UTXO set with the chain tip, so gettxoutsetinfo can return it without scanning the coins (default: %u)", DEFAULT_UTXOSETHASH), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-txindex", strprintf("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)", DEFAULT_TXINDEX), false, OptionsCategory::OPTIONS);
 
     gArgs.AddArg("-deleteblockchaindata", "Delete the local copy of the block chain data", false, OptionsCategory::OPTIONS);
@@ -454,6 +545,7 @@ void SetupServerArgs()
     gArgs.AddArg("-onion=<ip:port>", "Use separate SOCKS5 proxy to reach peers via Tor hidden services, set -noonion to disable (default: -proxy)", false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onlynet=<net>", "Make outgoing connections only through network <net> (ipv4, ipv6 or onion). Incoming connections are not affected by this option. This option can be specified multiple times to allow multiple networks.", false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-peerbloomfilters", strprintf("Support filtering of blocks and transaction with bloom filters (default: %u)", DEFAULT_PEERBLOOMFILTERS), false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-txreconciliation", strprintf("Relay transactions to peers that support it by reconciling sets of short ids, announcing them only to a share of the outbound peers (default: %u)", DEFAULT_TXRECONCILIATION_ENABLE), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-permitbaremultisig", strprintf("Relay non-P2SH multisig (default: %u)", DEFAULT_PERMIT_BAREMULTISIG), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-port=<port>", strprintf("Listen for connections on <port> (default: %u, testnet: %u, regtest: %u)", defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort(), regtestChainParams->GetDefaultPort()), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-proxy=<ip:port>", "Connect through SOCKS5 proxy, set -noproxy to disable (default: disabled)", false, OptionsCategory::CONNECTION);
@@ -485,19 +577,35 @@ void SetupServerArgs()
     gArgs.AddArg("-zmqpubhashtx=<address>", "Enable publish hash transaction in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblock=<address>", "Enable publish raw block in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtx=<address>", "Enable publish raw transaction in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubcontractlog=<address>", "Enable publish contract log entries of connected blocks and the hash of disconnected blocks in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubcontractlogaddress=<hex>", "Only publish contract log entries of this contract address. Can be specified multiple times", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubcontractlogtopic=<hex>", "Only publish contract log entries carrying this topic. Can be specified multiple times", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubrawreceipt=<address>", "Enable publish the receipts of connected blocks and the hash of disconnected blocks in <address>", false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubdgpupdate=<address>", "Enable publish the DGP parameters when a block finishes a vote or changes them in <address>", false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashblockhwm=<n>", strprintf("Set publish hash block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashtxhwm=<n>", strprintf("Set publish hash transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawblockhwm=<n>", strprintf("Set publish raw block outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubrawtxhwm=<n>", strprintf("Set publish raw transaction outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubcontractloghwm=<n>", strprintf("Set publish contract log outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubrawreceipthwm=<n>", strprintf("Set publish raw receipt outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
+    gArgs.AddArg("-zmqpubdgpupdatehwm=<n>", strprintf("Set publish DGP update outbound message high water mark (default: %d)", CZMQAbstractNotifier::DEFAULT_ZMQ_SNDHWM), false, OptionsCategory::ZMQ);
 #else
     hidden_args.emplace_back("-zmqpubhashblock=<address>");
     hidden_args.emplace_back("-zmqpubhashtx=<address>");
     hidden_args.emplace_back("-zmqpubrawblock=<address>");
     hidden_args.emplace_back("-zmqpubrawtx=<address>");
+    hidden_args.emplace_back("-zmqpubcontractlog=<address>");
+    hidden_args.emplace_back("-zmqpubcontractlogaddress=<hex>");
+    hidden_args.emplace_back("-zmqpubcontractlogtopic=<hex>");
+    hidden_args.emplace_back("-zmqpubrawreceipt=<address>");
+    hidden_args.emplace_back("-zmqpubdgpupdate=<address>");
     hidden_args.emplace_back("-zmqpubhashblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubhashtxhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawblockhwm=<n>");
     hidden_args.emplace_back("-zmqpubrawtxhwm=<n>");
+    hidden_args.emplace_back("-zmqpubcontractloghwm=<n>");
+    hidden_args.emplace_back("-zmqpubrawreceipthwm=<n>");
+    hidden_args.emplace_back("-zmqpubdgpupdatehwm=<n>");
 #endif
 
     gArgs.AddArg("-checkblocks=<n>", strprintf("How many blocks to check at startup (default: %u, 0 = all)", DEFAULT_CHECKBLOCKS), true, OptionsCategory::DEBUG_TEST);
@@ -505,10 +613,11 @@ void SetupServerArgs()
         "level 0 reads the blocks from disk, "
         "level 1 verifies block validity, "
         "level 2 verifies undo data, "
-        "level 3 checks disconnection of tip blocks, "
-        "and level 4 tries to reconnect the blocks, "
+        "level 3 checks disconnection of tip blocks and that their contract state is stored, "
+        "and level 4 tries to reconnect the blocks, executing their contracts again, "
         "each level includes the checks of the previous levels "
         "(0-4, default: %u)", DEFAULT_CHECKLEVEL), true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-deferreconnectcheck", strprintf("Run the reconnect of -checklevel=4 in the background once the node is up instead of before (default: %u)", DEFAULT_DEFER_RECONNECT_CHECK), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. (default: %u, regtest: %u)", defaultChainParams->DefaultConsistencyChecks(), regtestChainParams->DefaultConsistencyChecks()), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u, regtest: %u)", defaultChainParams->DefaultConsistencyChecks(), regtestChainParams->DefaultConsistencyChecks()), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED), true, OptionsCategory::DEBUG_TEST);
@@ -556,6 +665,7 @@ void SetupServerArgs()
 
     gArgs.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-blocktemplatefeeincrease=<amt>", strprintf("Fees (in %s) of the transactions added to the mempool since the last block template that make getblocktemplate assemble a new one and return its long polls, 0 to wait for a new block or a minute (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_TEMPLATE_FEE_INCREASE)), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", true, OptionsCategory::BLOCK_CREATION);
 
     gArgs.AddArg("-staker-min-tx-gas-price=<amt>", "Any contract execution with a gas price below this will not be included in a block (defaults to the value specified by the DGP)", false, OptionsCategory::BLOCK_CREATION);
@@ -564,19 +674,30 @@ void SetupServerArgs()
     gArgs.AddArg("-aggressive-staking", "Check more often to publish immediately when valid block is found.", false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-emergencystaking", "Emergency staking without blockchain synchronization.", false, OptionsCategory::BLOCK_CREATION);
 
+    gArgs.AddArg("-metrics", strprintf("Serve node metrics in the Prometheus text format at /metrics, without authentication (default: %u)", DEFAULT_METRICS_ENABLE), false, OptionsCategory::RPC);
     gArgs.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcallowip=<ip>", "Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times", false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcauth=<userpw>", "Username and HMAC-SHA-256 hashed password for JSON-RPC connections. The field <userpw> comes in the format: <USERNAME>:<SALT>$<HASH>. A canonical python script is included in share/rpcauth. The client then connects normally using the rpcuser=<USERNAME>/rpcpassword=<PASSWORD> pair of arguments. This option can be specified multiple times", false, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcbatchconcurrency=<n>", strprintf("Set the most read-only calls of one JSON-RPC batch that run at the same time, at most one more than -rpcbatchthreads (default: %d)", DEFAULT_RPC_BATCH_CONCURRENCY), false, OptionsCategory::RPC);
+    gArgs.AddArg("-rpccachesize=<n>", strprintf("Keep up to <n> MiB of results of getblock, getblockheader and getrawtransaction without verbose output and of gettransactionreceipt for blocks deeper than the reorg window, 0 to disable (default: %d)", DEFAULT_RPC_CACHE_SIZE), false, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcbatchthreads=<n>", strprintf("Set the number of threads that run the read-only calls of JSON-RPC batches next to the thread that received the batch, 0 runs them in order (default: %d)", DEFAULT_RPC_BATCH_THREADS), false, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcheavythreads=<n>", strprintf("Set the number of threads to service RPC calls that scan many blocks, receipts or coins, such as searchlogs (default: %d)", DEFAULT_HTTP_HEAVY_THREADS), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcbind=<addr>[:port]", "Bind to given address to listen for JSON-RPC connections. Do not expose the RPC server to untrusted networks such as the public internet! This option is ignored unless -rpcallowip is also passed. Port is optional and overrides -rpcport. Use [host]:port notation for IPv6. This option can be specified multiple times (default: 127.0.0.1 and ::1 i.e., localhost)", false, OptionsCategory::RPC);
     gArgs.AddArg("-rpccookiefile=<loc>", "Location of the auth cookie. Relative paths will be prefixed by a net-specific datadir location. (default: data dir)", false, OptionsCategory::RPC);
+    gArgs.AddArg("-rpclongpollthreads=<n>", strprintf("Set the number of threads to service RPC calls that wait for new blocks or logs, such as waitforlogs (default: %d)", DEFAULT_HTTP_LONGPOLL_THREADS), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcpassword=<pw>", "Password for JSON-RPC connections", false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcport=<port>", strprintf("Listen for JSON-RPC connections on <port> (default: %u, testnet: %u, regtest: %u)", defaultBaseParams->RPCPort(), testnetBaseParams->RPCPort(), regtestBaseParams->RPCPort()), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcserialversion", strprintf("Sets the serialization of raw transaction or block hex returned in non-verbose mode, non-segwit(0) or segwit(1) (default: %d)", DEFAULT_RPC_SERIALIZE_VERSION), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT), true, OptionsCategory::RPC);
     gArgs.AddArg("-rpcthreads=<n>", strprintf("Set the number of threads to service RPC calls (default: %d)", DEFAULT_HTTP_THREADS), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcuser=<user>", "Username for JSON-RPC connections", false, OptionsCategory::RPC);
-    gArgs.AddArg("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE), true, OptionsCategory::RPC);
+    gArgs.AddArg("-rpcworkqueue=<n>", strprintf("Set the depth of each of the work queues to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE), true, OptionsCategory::RPC);
     gArgs.AddArg("-server", "Accept command line and JSON-RPC commands", false, OptionsCategory::RPC);
+    gArgs.AddArg("-ws", strprintf("Accept WebSocket subscriptions to new headers, mempool transactions, receipts and logs, with the JSON-RPC credentials (default: %u)", DEFAULT_WEBSOCKET_ENABLE), false, OptionsCategory::RPC);
+    gArgs.AddArg("-wsbind=<addr>[:port]", "Bind to given address to listen for WebSocket connections. This option is ignored unless -rpcallowip is also passed. Port is optional and overrides -wsport. This option can be specified multiple times (default: 127.0.0.1 and ::1 i.e., localhost)", false, OptionsCategory::RPC);
+    gArgs.AddArg("-wsmaxbuffer=<n>", strprintf("Drop a WebSocket client with more than <n> MiB of notifications waiting to be sent to it (default: %d)", DEFAULT_WEBSOCKET_MAX_BUFFER), false, OptionsCategory::RPC);
+    gArgs.AddArg("-wsmaxconnections=<n>", strprintf("Maintain at most <n> WebSocket connections (default: %d)", DEFAULT_WEBSOCKET_MAX_CONNECTIONS), false, OptionsCategory::RPC);
+    gArgs.AddArg("-wsport=<port>", "Listen for WebSocket connections on <port> (default: one above -rpcport's default for the network)", false, OptionsCategory::RPC);
 
 #if HAVE_DECL_DAEMON
     gArgs.AddArg("-daemon", "Run in the background as a daemon and accept commands", false, OptionsCategory::OPTIONS);
@@ -729,18 +850,7 @@ static void ThreadImport(std::vector<fs::path> vImportFiles)
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            if (!fs::exists(GetBlockPosFilename(pos, "blk")))
-                break; // No block files left to reindex
-            FILE *file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            nFile++;
-        }
+        ReindexBlockFiles(chainparams);
         pblocktree->WriteReindexing(false);
         fReindex = false;
         LogPrintf("Reindexing finished\n");
@@ -828,11 +938,19 @@ static bool AppInitServers()
     RPCServer::OnStopped(&OnRPCStopped);
     if (!InitHTTPServer())
         return false;
+    int64_t rpc_cache_size = gArgs.GetArg("-rpccachesize", DEFAULT_RPC_CACHE_SIZE);
+    if (rpc_cache_size > 0) {
+        g_rpc_result_cache = MakeUnique<RPCResultCache>(rpc_cache_size << 20);
+        RegisterValidationInterface(g_rpc_result_cache.get());
+    }
     StartRPC();
     if (!StartHTTPRPC())
         return false;
     if (gArgs.GetBoolArg("-rest", DEFAULT_REST_ENABLE)) StartREST();
+    if (gArgs.GetBoolArg("-metrics", DEFAULT_METRICS_ENABLE)) StartMetrics();
     StartHTTPServer();
+    if (gArgs.GetBoolArg("-ws", DEFAULT_WEBSOCKET_ENABLE) && !StartWebSocketServer())
+        return InitError(_("Unable to bind the WebSocket server, check -wsbind and -wsport"));
     return true;
 }
 
@@ -899,7 +1017,20 @@ void InitParameterInteraction()
             LogPrintf("%s: parameter interaction: -whitelistforcerelay=1 -> setting -whitelistrelay=1\n", __func__);
     }
 
+    // A pruned node can not reorganize past the blocks it keeps, so the contract state of older blocks is unreachable
+    if (gArgs.GetArg("-prune", 0) > 0) {
+        if (gArgs.SoftSetArg("-prunestate", std::to_string(MIN_STATE_BLOCKS_TO_KEEP)))
+            LogPrintf("%s: parameter interaction: -prune set -> setting -prunestate=%u\n", __func__, MIN_STATE_BLOCKS_TO_KEEP);
+    }
+
     #ifdef ENABLE_WALLET
+    // The staking ledger only stakes delegated coins
+    if(gArgs.GetBoolArg("-stakingledger", DEFAULT_STAKING_LEDGER))
+    {
+        if (gArgs.SoftSetBoolArg("-superstaking", true))
+            LogPrintf("%s: parameter interaction: -stakingledger=1 -> setting -superstaking=1\n", __func__);
+    }
+
     // Set the required parameters for super staking
     if(gArgs.GetBoolArg("-superstaking", DEFAULT_SUPER_STAKE))
     {
@@ -1036,10 +1167,37 @@ bool AppInitParameterInteraction()
         return InitError(strprintf(_("Specified blocks directory \"%s\" does not exist."), gArgs.GetArg("-blocksdir", "").c_str()));
     }
 
+    if (!SelectEVMKind(gArgs.GetArg("-vm", DEFAULT_EVM_KIND))) {
+        return InitError(strprintf(_("Unknown -vm value %s."), gArgs.GetArg("-vm", DEFAULT_EVM_KIND)));
+    }
+
+    // parse and validate enabled filter types
+    std::string blockfilterindex_value = gArgs.GetArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
+    if (blockfilterindex_value == "" || blockfilterindex_value == "1") {
+        g_enabled_filter_types.insert(AllBlockFilterTypes().begin(), AllBlockFilterTypes().end());
+    } else if (blockfilterindex_value != "0") {
+        const std::vector<std::string> names = gArgs.GetArgs("-blockfilterindex");
+        for (const auto& name : names) {
+            BlockFilterType filter_type;
+            if (!BlockFilterTypeByName(name, filter_type)) {
+                return InitError(strprintf(_("Unknown -blockfilterindex value %s."), name));
+            }
+            g_enabled_filter_types.insert(filter_type);
+        }
+    }
+
     // if using block pruning, then disallow txindex
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-asyncaddressindex", DEFAULT_ASYNCADDRESSINDEX))
+            return InitError(_("Prune mode is incompatible with -asyncaddressindex."));
+        if (gArgs.GetBoolArg("-contracttxindex", DEFAULT_CONTRACTTXINDEX))
+            return InitError(_("Prune mode is incompatible with -contracttxindex."));
+        if (!g_enabled_filter_types.empty())
+            return InitError(_("Prune mode is incompatible with -blockfilterindex."));
+        if (gArgs.IsArgSet("-rebuildreceipts"))
+            return InitError(_("Prune mode is incompatible with -rebuildreceipts."));
     }
 
     // -bind and -whitebind can't be set when not listening
@@ -1105,6 +1263,11 @@ bool AppInitParameterInteraction()
     else
         LogPrintf("Validating signatures for all blocks.\n");
 
+    if (gArgs.GetBoolArg("-assumevalidstate", DEFAULT_ASSUME_VALID_STATE))
+        hashAssumeValidState = chainparams.GetConsensus().defaultAssumeValidState;
+    if (!hashAssumeValidState.IsNull())
+        LogPrintf("Assuming ancestors of block %s with their contract state in the database have valid contract executions.\n", hashAssumeValidState.GetHex());
+
     if (gArgs.IsArgSet("-minimumchainwork")) {
         const std::string minChainWorkStr = gArgs.GetArg("-minimumchainwork", "");
         if (!IsHexNumber(minChainWorkStr)) {
@@ -1161,6 +1324,8 @@ bool AppInitParameterInteraction()
         fPruneMode = true;
     }
 
+    fCompressUndo = gArgs.GetBoolArg("-compressundo", DEFAULT_COMPRESS_UNDO);
+
     nConnectTimeout = gArgs.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0) {
         nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
@@ -1192,6 +1357,12 @@ bool AppInitParameterInteraction()
         if (!ParseMoney(gArgs.GetArg("-blockmintxfee", ""), n))
             return InitError(AmountErrMsg("blockmintxfee", gArgs.GetArg("-blockmintxfee", "")));
     }
+    if (gArgs.IsArgSet("-blocktemplatefeeincrease"))
+    {
+        CAmount n = 0;
+        if (!ParseMoney(gArgs.GetArg("-blocktemplatefeeincrease", ""), n))
+            return InitError(AmountErrMsg("blocktemplatefeeincrease", gArgs.GetArg("-blocktemplatefeeincrease", "")));
+    }
 
     // Feerate used to define dust.  Shouldn't be changed lightly as old
     // implementations may inadvertently create non-standard transactions
@@ -1236,6 +1407,9 @@ bool AppInitParameterInteraction()
     if (gArgs.GetBoolArg("-peerbloomfilters", DEFAULT_PEERBLOOMFILTERS))
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
 
+    if (gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION_ENABLE) && !gArgs.GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY))
+        nLocalServices = ServiceFlags(nLocalServices | NODE_TXRECONCILIATION);
+
     if (gArgs.GetArg("-rpcserialversion", DEFAULT_RPC_SERIALIZE_VERSION) < 0)
         return InitError("rpcserialversion must be non-negative.");
 
@@ -1297,6 +1471,8 @@ bool AppInitSanityChecks()
     // Initialize elliptic curve code
     std::string sha256_algo = SHA256AutoDetect();
     LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string keccak_algo = KeccakAutoDetect();
+    LogPrintf("Using the '%s' Keccak implementation\n", keccak_algo);
     RandomInit();
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1389,9 +1565,14 @@ bool AppInitMain(InitInterfaces& interfaces)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
-    // Start the lightweight task scheduler thread
+    // Start the lightweight task scheduler threads
     CScheduler::Function serviceLoop = std::bind(&CScheduler::serviceQueue, &scheduler);
-    threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    int nSchedulerThreads = std::max(1, std::min(MAX_SCHEDULER_THREADS, (int)gArgs.GetArg("-schedulerthreads", DEFAULT_SCHEDULER_THREADS)));
+    for (int i = 0; i < nSchedulerThreads; i++)
+        threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
+    // One more thread only runs the high priority lane, so tip notifications never wait behind a slow flush or dump
+    CScheduler::Function serviceHighLoop = std::bind(&CScheduler::serviceHighPriorityQueue, &scheduler);
+    threadGroup.create_thread(std::bind(&TraceThread<CScheduler::Function>, "schedhigh", serviceHighLoop));
 
     GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
     GetMainSignals().RegisterWithMempoolSignals(mempool);
@@ -1414,6 +1595,17 @@ bool AppInitMain(InitInterfaces& interfaces)
     RegisterZMQRPCCommands(tableRPC);
 #endif
 
+    // With more than one EVM worker the wallet gets at most half of them, so its calls never hold back all of the RPC ones
+    int evm_threads = std::min(std::max((int)gArgs.GetArg("-evmthreads", DEFAULT_EVM_THREADS), 0), 64);
+    if (evm_threads > 0) {
+        const size_t evm_queue = std::max<int64_t>(gArgs.GetArg("-evmqueue", DEFAULT_EVM_QUEUE), 1);
+        const int64_t evm_timeout = std::max<int64_t>(gArgs.GetArg("-evmtimeout", DEFAULT_EVM_TIMEOUT), 1);
+        g_contract_call_executor = MakeUnique<ContractCallExecutor>(evm_threads);
+        g_contract_call_executor->SetLimits(ContractCallClass::RPC, {(size_t)evm_threads, evm_queue, evm_timeout});
+        g_contract_call_executor->SetLimits(ContractCallClass::WALLET, {(size_t)std::max(evm_threads / 2, 1), evm_queue, evm_timeout});
+        LogPrintf("Using %d EVM threads for read-only contract calls\n", evm_threads);
+    }
+
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
      * that the server is there and will be ready later).  Warmup mode will
@@ -1445,7 +1637,10 @@ bool AppInitMain(InitInterfaces& interfaces)
     g_connman = std::unique_ptr<CConnman>(new CConnman(GetRand(std::numeric_limits<uint64_t>::max()), GetRand(std::numeric_limits<uint64_t>::max())));
 
     peerLogic.reset(new PeerLogicValidation(g_connman.get(), g_banman.get(), scheduler, gArgs.GetBoolArg("-enablebip61", DEFAULT_ENABLE_BIP61)));
-    RegisterValidationInterface(peerLogic.get());
+    RegisterValidationInterface(peerLogic.get(), true);
+
+    g_dgp_cache_updater = MakeUnique<DgpCacheUpdater>();
+    RegisterValidationInterface(g_dgp_cache_updater.get(), true);
 
 #ifdef ENABLE_WALLET
     CWallet::defaultConnman = g_connman.get();
@@ -1561,26 +1756,73 @@ bool AppInitMain(InitInterfaces& interfaces)
     int64_t nTotalCache = (gArgs.GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greater than nMaxDbcache
+    // The address and log indexes live in the block tree database, which then gets most of the budget
     int64_t nBlockTreeDBCache = std::min(nTotalCache / 8, nMaxBlockDBCache << 20);
-    nBlockTreeDBCache = nTotalCache * 3 / 4;
-
+    if (gArgs.GetBoolArg("-addrindex", DEFAULT_ADDRINDEX) || gArgs.GetBoolArg("-logevents", DEFAULT_LOGEVENTS))
+        nBlockTreeDBCache = nTotalCache * 3 / 4;
+    if (gArgs.IsArgSet("-blocktreedbcache"))
+        nBlockTreeDBCache = std::min(nTotalCache * 3 / 4, std::max<int64_t>(0, gArgs.GetArg("-blocktreedbcache", 0)) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nReceiptsDBCache = std::min(nTotalCache / 16, nMaxReceiptsDBCache << 20);
+    if (gArgs.IsArgSet("-receiptsdbcache"))
+        nReceiptsDBCache = std::min(nTotalCache / 2, std::max<int64_t>(0, gArgs.GetArg("-receiptsdbcache", 0)) << 20);
+    nTotalCache -= nReceiptsDBCache;
     int64_t nTxIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxTxIndexCache << 20 : 0);
     nTotalCache -= nTxIndexCache;
+    int64_t nAddressIndexDBCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-asyncaddressindex", DEFAULT_ASYNCADDRESSINDEX) ? nMaxTxIndexCache << 20 : 0);
+    nTotalCache -= nAddressIndexDBCache;
+    int64_t nContractTxIndexCache = std::min(nTotalCache / 8, gArgs.GetBoolArg("-contracttxindex", DEFAULT_CONTRACTTXINDEX) ? nMaxTxIndexCache << 20 : 0);
+    nTotalCache -= nContractTxIndexCache;
+    int64_t filter_index_cache = 0;
+    if (!g_enabled_filter_types.empty()) {
+        size_t n_indexes = g_enabled_filter_types.size();
+        int64_t max_cache = std::min(nTotalCache / 8, max_filter_index_cache << 20);
+        filter_index_cache = max_cache / n_indexes;
+        nTotalCache -= filter_index_cache * n_indexes;
+    }
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
+    g_dbcache_sizes.block_tree_db = nBlockTreeDBCache;
+    g_dbcache_sizes.tx_index = nTxIndexCache;
+    g_dbcache_sizes.address_index = nAddressIndexDBCache;
+    g_dbcache_sizes.receipts_db = nReceiptsDBCache;
+    g_dbcache_sizes.coins_db = nCoinDBCache;
+    nAddressIndexCacheSize = std::max<int64_t>(0, gArgs.GetArg("-addressindexcache", nDefaultAddressIndexCache)) << 20;
     int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1f MiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
         LogPrintf("* Using %.1f MiB for transaction index database\n", nTxIndexCache * (1.0 / 1024 / 1024));
     }
+    if (gArgs.GetBoolArg("-asyncaddressindex", DEFAULT_ASYNCADDRESSINDEX)) {
+        LogPrintf("* Using %.1f MiB for address index database\n", nAddressIndexDBCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-contracttxindex", DEFAULT_CONTRACTTXINDEX)) {
+        LogPrintf("* Using %.1f MiB for contract transaction index database\n", nContractTxIndexCache * (1.0 / 1024 / 1024));
+    }
+    for (BlockFilterType filter_type : g_enabled_filter_types) {
+        LogPrintf("* Using %.1f MiB for %s block filter index database\n",
+                  filter_index_cache * (1.0 / 1024 / 1024), BlockFilterTypeName(filter_type));
+    }
+    LogPrintf("* Using %.1f MiB for transaction receipts database\n", nReceiptsDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1f MiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1f MiB for in-memory UTXO set (plus up to %.1f MiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    LogPrintf("* Using up to %.1f MiB for buffered address index writes\n", nAddressIndexCacheSize * (1.0 / 1024 / 1024));
+    // Before the coins caches are created, so that all their nodes are on huge pages
+    if (gArgs.GetBoolArg("-largepages", DEFAULT_LARGE_PAGES)) {
+        if (LargePagePool::Instance().Enable()) {
+            LogPrintf("* Using huge pages for the in-memory UTXO set\n");
+        } else {
+            InitWarning(_("Huge pages are not supported on this system, -largepages is ignored."));
+        }
+    }
 
     bool fLoaded = false;
+    // Startup checks the levels below 4, the contracts are executed again once the node is up
+    const bool fDeferReconnectCheck = gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL) >= 4 &&
+        gArgs.GetBoolArg("-deferreconnectcheck", DEFAULT_DEFER_RECONNECT_CHECK);
     while (!fLoaded && !ShutdownRequested()) {
         bool fReset = fReindex;
         std::string strLoadError;
@@ -1594,6 +1836,7 @@ bool AppInitMain(InitInterfaces& interfaces)
                 LOCK(cs_main);
                 UnloadBlockIndex();
                 pcoinsTip.reset();
+                pcoinsflush.reset();
                 pcoinsdbview.reset();
                 pcoinscatcher.reset();
                 // new CBlockTreeDB tries to delete the existing file, which
@@ -1628,6 +1871,12 @@ bool AppInitMain(InitInterfaces& interfaces)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
                 }
 
+                // If necessary, upgrade the address history from older database format
+                if (!UpgradeAddressIndex(*pblocktree)) {
+                    strLoadError = _("Error upgrading address index");
+                    break;
+                }
+
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
                 if (fHavePruned && !fPruneMode) {
@@ -1664,7 +1913,8 @@ bool AppInitMain(InitInterfaces& interfaces)
                 }
 
                 // The on-disk coinsdb is now in a good state, create the cache
-                pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
+                pcoinsflush.reset(new CCoinsViewBackgroundFlush(pcoinscatcher.get(), pcoinsdbview.get()));
+                pcoinsTip.reset(new CCoinsViewCache(pcoinsflush.get()));
 
                 is_coinsview_empty = fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull();
                 if (!is_coinsview_empty) {
@@ -1695,6 +1945,18 @@ bool AppInitMain(InitInterfaces& interfaces)
                 const std::string dirQtum(qtumStateDir.string());
                 const dev::h256 hashDB(dev::sha3(dev::rlp("")));
                 dev::eth::BaseState existsQtumstate = fStatus ? dev::eth::BaseState::PreExisting : dev::eth::BaseState::Empty;
+                if (fStatus && !fReset && gArgs.IsArgSet("-prunestate") && chainActive.Tip() != nullptr) {
+                    uiInterface.InitMessage(_("Pruning contract state..."));
+                    int nKeep = std::max<int64_t>(MIN_STATE_BLOCKS_TO_KEEP, gArgs.GetArg("-prunestate", 0));
+                    std::vector<StateRoots> roots;
+                    for (const CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->nHeight > chainActive.Height() - nKeep; pindex = pindex->pprev) {
+                        roots.push_back(StateRoots{uintToh256(pindex->hashStateRoot), uintToh256(pindex->hashUTXORoot)});
+                    }
+                    if (!PruneStateDB(qtumStateDir, roots)) {
+                        strLoadError = _("Error pruning contract state database");
+                        break;
+                    }
+                }
                 globalState = std::unique_ptr<QtumState>(new QtumState(dev::u256(0), QtumState::openDB(dirQtum, hashDB, dev::WithExisting::Trust), dirQtum, existsQtumstate));
                 dev::eth::ChainParams cp((chainparams.EVMGenesisInfo(dev::eth::Network::qtumMainNetwork)));
 
@@ -1703,9 +1965,15 @@ bool AppInitMain(InitInterfaces& interfaces)
 
                 globalSealEngine = std::unique_ptr<dev::eth::SealEngineFace>(cp.createSealEngine());
 
-                pstorageresult.reset(new StorageResults(qtumStateDir.string()));
+                pstorageresult.reset(new StorageResults(qtumStateDir.string(), std::max<int64_t>(0, gArgs.GetArg("-receiptcache", DEFAULT_RECEIPT_CACHE)) << 20, nReceiptsDBCache));
                 if (fReset) {
                     pstorageresult->wipeResults();
+                } else if (gArgs.GetBoolArg("-upgradereceiptsdb", false)) {
+                    uiInterface.InitMessage(_("Upgrading receipts database..."));
+                    if (!pstorageresult->upgradeResults()) {
+                        strLoadError = _("Error upgrading receipts database");
+                        break;
+                    }
                 }
 
                 if(chainActive.Tip() != nullptr){
@@ -1720,7 +1988,21 @@ bool AppInitMain(InitInterfaces& interfaces)
                 globalState->dbUtxo().commit();
 
                 fRecordLogOpcodes = gArgs.IsArgSet("-record-log-opcodes");
-                fIsVMlogFile = fs::exists(GetDataDir() / "vmExecLogs.json");
+                fLogTopicIndex = gArgs.GetBoolArg("-logtopicindex", DEFAULT_LOGTOPICINDEX);
+                fUTXOSetHash = gArgs.GetBoolArg("-utxosethash", DEFAULT_UTXOSETHASH);
+                if (!fLogTopicIndex) {
+                    // Blocks connected from now on are not indexed, coverage restarts when it is enabled again
+                    pblocktree->EraseTopicIndexStart();
+                }
+                if (fRecordLogOpcodes && !g_vmlog_writer) {
+                    g_vmlog_writer = MakeUnique<VMLogWriter>(GetDataDir(), (uint64_t)std::max<int64_t>(1, gArgs.GetArg("-vmlogmaxsize", DEFAULT_VMLOG_MAX_SIZE)) << 20);
+                }
+                if (gArgs.GetArg("-contractcodecache", DEFAULT_CONTRACT_CODE_CACHE) > 0 && !g_contract_code_cache) {
+                    g_contract_code_cache = MakeUnique<ContractCodeCache>(gArgs.GetArg("-contractcodecache", DEFAULT_CONTRACT_CODE_CACHE) << 20);
+                }
+                if (gArgs.GetArg("-contractprofile", DEFAULT_CONTRACT_PROFILE_BLOCKS) > 0 && !g_contract_profiler) {
+                    g_contract_profiler = MakeUnique<ContractProfiler>(gArgs.GetArg("-contractprofile", DEFAULT_CONTRACT_PROFILE_BLOCKS));
+                }
                 ///////////////////////////////////////////////////////////
 
             if (!fReset) {
@@ -1756,7 +2038,7 @@ bool AppInitMain(InitInterfaces& interfaces)
                         break;
                     }
 
-                    if (!CVerifyDB().VerifyDB(chainparams, pcoinsdbview.get(), gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL),
+                    if (!CVerifyDB().VerifyDB(chainparams, pcoinsdbview.get(), fDeferReconnectCheck ? 3 : gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL),
                                   gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
                         strLoadError = _("Corrupted block database detected");
                         break;
@@ -1768,6 +2050,9 @@ bool AppInitMain(InitInterfaces& interfaces)
                 break;
             }
 
+            // After the verification, which moves the state to the roots of older blocks
+            globalState->buildUTXOFilter();
+
             fLoaded = true;
             LogPrintf(" block index %15dms\n", GetTimeMillis() - load_block_index_start_time);
         } while(false);
@@ -1800,6 +2085,17 @@ bool AppInitMain(InitInterfaces& interfaces)
         return false;
     }
 
+    // A reindex connects the blocks again, which writes the receipts anyway
+    if (gArgs.IsArgSet("-rebuildreceipts") && !fReindex) {
+        if (!RebuildReceipts(chainparams, gArgs.GetArg("-rebuildreceipts", 0), GetNumCores())) {
+            if (ShutdownRequested()) {
+                LogPrintf("Shutdown requested. Exiting.\n");
+                return false;
+            }
+            return InitError(_("Error rebuilding the receipts. See debug.log for details."));
+        }
+    }
+
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     //CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
     // Allowed to fail as this file IS missing on first startup.
@@ -1812,6 +2108,28 @@ bool AppInitMain(InitInterfaces& interfaces)
         g_txindex = MakeUnique<TxIndex>(nTxIndexCache, false, fReindex);
         g_txindex->Start();
     }
+    if (fAddressIndex && gArgs.GetBoolArg("-asyncaddressindex", DEFAULT_ASYNCADDRESSINDEX)) {
+        g_addressindex = MakeUnique<AddressIndex>(nAddressIndexDBCache, false, fReindex);
+        g_addressindex->Start();
+    }
+    if (gArgs.GetBoolArg("-contracttxindex", DEFAULT_CONTRACTTXINDEX)) {
+        g_contracttxindex = MakeUnique<ContractTxIndex>(nContractTxIndexCache, false, fReindex);
+        g_contracttxindex->Start();
+    }
+
+    for (const auto& filter_type : g_enabled_filter_types) {
+        InitBlockFilterIndex(filter_type, filter_index_cache, false, fReindex);
+        GetBlockFilterIndex(filter_type)->Start();
+    }
+    if (!InitAddressBalanceIndex()) {
+        return InitError(_("Failed to build the address totals"));
+    }
+    if (!InitContractIndex()) {
+        return InitError(_("Failed to build the contract index"));
+    }
+    if (!InitUTXOSetHash()) {
+        return InitError(_("Failed to compute the UTXO set hash"));
+    }
 
     // ********************************************************* Step 9: load wallet
     for (const auto& client : interfaces.chain_clients) {
@@ -1983,6 +2301,15 @@ bool AppInitMain(InitInterfaces& interfaces)
         g_banman->DumpBanlist();
     }, DUMP_BANS_INTERVAL * 1000);
 
+    if (gArgs.GetBoolArg("-metrics", DEFAULT_METRICS_ENABLE)) {
+        scheduler.scheduleEvery([] { SampleMetrics(scheduler); }, METRICS_SAMPLE_INTERVAL);
+    }
+
+    if (fDeferReconnectCheck) {
+        const int nCheckDepth = gArgs.GetArg("-checkblocks", DEFAULT_CHECKBLOCKS);
+        scheduler.scheduleFromNow([nCheckDepth] { VerifyDBReconnect(Params(), nCheckDepth); }, 0);
+    }
+
     return true;
 }
 
@@ -18,6 +18,7 @@ class CBlock;
 class CScheduler;
 class uint256;
 struct CBlockLocator;
+struct TipSnapshot;
 class CTransaction;
 
 using CTransactionRef = std::shared_ptr<const CTransaction>;
@@ -121,6 +122,12 @@ public:
     //! behavior while code is transitioned to use the Chain::Lock interface.
     virtual std::unique_ptr<Lock> assumeLocked() = 0;
 
+    //! Return the tip height, hash, times, bits, state roots and DGP cache
+    //! values as of the last tip change, without locking the chain. Null
+    //! before the chain is loaded. The tip may have moved on by the time the
+    //! snapshot is used, code that needs a consistent view must lock().
+    virtual std::shared_ptr<const TipSnapshot> getTipSnapshot() = 0;
+
     //! Return whether node has the block and optionally return block metadata
     //! or contents.
     //!
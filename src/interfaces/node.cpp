@@ -21,12 +21,14 @@
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <primitives/block.h>
+#include <rpc/contract_util.h>
 #include <rpc/server.h>
 #include <scheduler.h>
 #include <shutdown.h>
 #include <sync.h>
 #include <txmempool.h>
 #include <ui_interface.h>
+#include <util/strencodings.h>
 #include <util/system.h>
 #include "../validation.h"
 #include <warnings.h>
@@ -178,14 +180,13 @@ public:
     }
     int getNumBlocks() override
     {
-        LOCK(::cs_main);
-        return ::chainActive.Height();
+        std::shared_ptr<const TipSnapshot> tip = GetTipSnapshot();
+        return tip ? tip->nHeight : -1;
     }
     int64_t getLastBlockTime() override
     {
-        LOCK(::cs_main);
-        if (::chainActive.Tip()) {
-            return ::chainActive.Tip()->GetBlockTime();
+        if (std::shared_ptr<const TipSnapshot> tip = GetTipSnapshot()) {
+            return tip->nTime;
         }
         return Params().GenesisBlock().GetBlockTime(); // Genesis block's time of current network
     }
@@ -320,6 +321,60 @@ public:
     {
         return pindexBestHeader ? pindexBestHeader->nMoneySupply / COIN : 0;
     }
+    bool searchLogs(int64_t fromBlock, int64_t toBlock, int64_t minconf, const std::vector<std::string>& addresses,
+        const std::vector<std::string>& topics, size_t limit, LogSearchCursor& cursor, std::vector<ContractLogReceipt>& receipts) override
+    {
+        receipts.clear();
+        if (cursor.complete || limit == 0 || minconf < 0) {
+            return false;
+        }
+
+        std::set<dev::h160> addressSet;
+        for (const std::string& address : addresses) {
+            if (address.size() != 40 || !IsHex(address)) {
+                return false;
+            }
+            addressSet.insert(dev::h160(address));
+        }
+        std::vector<boost::optional<dev::h256>> topicList;
+        for (const std::string& topic : topics) {
+            if (topic.empty()) {
+                topicList.push_back(boost::optional<dev::h256>());
+            } else if (topic.size() == 64 && IsHex(topic)) {
+                topicList.push_back(dev::h256(topic));
+            } else {
+                return false;
+            }
+        }
+
+        int height = cursor.height == -1 ? fromBlock : cursor.height;
+        std::vector<TransactionReceiptInfo> infos;
+        if (!SearchLogsPage(toBlock, minconf, addressSet, topicList, limit, height, cursor.skip, infos)) {
+            return false;
+        }
+        cursor.height = height;
+        cursor.complete = height == -1;
+
+        receipts.reserve(infos.size());
+        for (const TransactionReceiptInfo& info : infos) {
+            ContractLogReceipt receipt;
+            receipt.block_hash = info.blockHash;
+            receipt.block_number = info.blockNumber;
+            receipt.transaction_hash = info.transactionHash;
+            receipt.contract_address = info.contractAddress.hex();
+            for (const dev::eth::LogEntry& entry : info.logs) {
+                ContractLog log;
+                log.address = entry.address.hex();
+                for (const dev::h256& topic : entry.topics) {
+                    log.topics.push_back(topic.hex());
+                }
+                log.data = HexStr(entry.data);
+                receipt.logs.push_back(std::move(log));
+            }
+            receipts.push_back(std::move(receipt));
+        }
+        return true;
+    }
     std::unique_ptr<Wallet> loadWallet(const std::string& name, std::string& error, std::string& warning) override
     {
         return MakeWallet(LoadWallet(*m_interfaces.chain, name, error, warning));
@@ -375,6 +430,10 @@ public:
                     GuessVerificationProgress(Params().TxData(), block));
             }));
     }
+    std::unique_ptr<Handler> handleNotifyDgpCacheChanged(NotifyDgpCacheChangedFn fn) override
+    {
+        return MakeHandler(::uiInterface.NotifyDgpCacheChanged_connect(fn));
+    }
     InitInterfaces m_interfaces;
 };
 
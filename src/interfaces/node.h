@@ -31,6 +31,8 @@ struct CNodeStateStats;
 namespace interfaces {
 class Handler;
 class Wallet;
+struct ContractLogReceipt;
+struct LogSearchCursor;
 
 //! Top-level interface for a bitcoin node (bitcoind process).
 class Node
@@ -219,6 +221,12 @@ public:
     //! Get the money supply
     virtual int64_t getMoneySupply() = 0;
 
+    //! Search a page of at most limit receipts with logs of the contract addresses, matching any of the
+    //! topics at its position (an empty topic matches all), from the cursor position up to toBlock.
+    //! Needs -logevents.
+    virtual bool searchLogs(int64_t fromBlock, int64_t toBlock, int64_t minconf, const std::vector<std::string>& addresses,
+        const std::vector<std::string>& topics, size_t limit, LogSearchCursor& cursor, std::vector<ContractLogReceipt>& receipts) = 0;
+
     //! Attempts to load a wallet from file or directory.
     //! The loaded wallet is also notified to handlers previously registered
     //! with handleLoadWallet.
@@ -273,6 +281,39 @@ public:
     using NotifyHeaderTipFn =
         std::function<void(bool initial_download, int height, int64_t block_time, double verification_progress)>;
     virtual std::unique_ptr<Handler> handleNotifyHeaderTip(NotifyHeaderTipFn fn) = 0;
+
+    //! Register handler for DGP cache messages, sent when the node refreshed the DGP_CACHE values and one changed.
+    using NotifyDgpCacheChangedFn = std::function<void()>;
+    virtual std::unique_ptr<Handler> handleNotifyDgpCacheChanged(NotifyDgpCacheChangedFn fn) = 0;
+};
+
+//! Contract log, with the hex of its fields.
+struct ContractLog
+{
+    std::string address;
+    std::vector<std::string> topics;
+    std::string data;
+};
+
+//! Receipt of a contract transaction with logs, found by Node::searchLogs.
+struct ContractLogReceipt
+{
+    uint256 block_hash;
+    int block_number = 0;
+    uint256 transaction_hash;
+    std::string contract_address;
+    std::vector<ContractLog> logs;
+};
+
+//! Position Node::searchLogs resumes a search from.
+struct LogSearchCursor
+{
+    //! Block the next page starts at, -1 for the first page
+    int height = -1;
+    //! Matching receipts of that block returned before
+    size_t skip = 0;
+    //! Set when the search reached its last block
+    bool complete = false;
 };
 
 //! Return implementation of Node interface.
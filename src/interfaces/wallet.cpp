@@ -24,6 +24,7 @@
 #include <timedata.h>
 #include <ui_interface.h>
 #include <uint256.h>
+#include <util/convert.h>
 #include <util/system.h>
 #include <validation.h>
 #include <wallet/feebumper.h>
@@ -806,6 +807,15 @@ public:
     {
         return m_wallet->AddTokenTxEntry(MakeTokenTx(tokenTx), fFlushOnClose);
     }
+    bool addTokenTxEntries(const std::vector<TokenTx>& tokenTxs, bool fFlushOnClose) override
+    {
+        std::vector<CTokenTx> wtokenTxs;
+        wtokenTxs.reserve(tokenTxs.size());
+        for (const TokenTx& tokenTx : tokenTxs) {
+            wtokenTxs.push_back(MakeTokenTx(tokenTx));
+        }
+        return m_wallet->AddTokenTxEntries(wtokenTxs, fFlushOnClose);
+    }
     bool existTokenEntry(const TokenInfo &token) override
     {
         auto locked_chain = m_wallet->chain().lock();
@@ -872,6 +882,15 @@ public:
         }
         return {};
     }
+    bool getTokenBalance(const uint256& id, std::string& balance) override
+    {
+        uint256 value;
+        if (!m_wallet->GetTokenBalance(id, value)) {
+            return false;
+        }
+        balance = uintTou256(value).str();
+        return true;
+    }
     std::vector<TokenInfo> getTokens() override
     {
         auto locked_chain = m_wallet->chain().lock();
@@ -1099,6 +1118,19 @@ public:
         }
         return result;
     }
+    bool getDelegationChanges(uint64_t& version, std::vector<std::string>& delegates) override
+    {
+        auto locked_chain = m_wallet->chain().lock();
+
+        std::map<uint160, Delegation> changes;
+        bool fKnown = DelegationIndex().GetDelegationChanges(version, changes);
+        delegates.clear();
+        delegates.reserve(changes.size());
+        for (const auto& item : changes) {
+            delegates.push_back(KeyIdToString(item.first));
+        }
+        return fKnown;
+    }
     bool removeDelegationEntry(const std::string &sHash) override
     {
         return m_wallet->RemoveDelegationEntry(uint256S(sHash), true);
@@ -1385,6 +1417,11 @@ public:
         return MakeHandler(m_wallet->NotifyTokenChanged.connect(
             [fn](CWallet*, const uint256& id, ChangeType status) { fn(id, status); }));
     }
+    std::unique_ptr<Handler> handleTokenBalanceChanged(TokenBalanceChangedFn fn) override
+    {
+        return MakeHandler(m_wallet->NotifyTokenBalanceChanged.connect(
+            [fn](CWallet*, const uint256& id) { fn(id); }));
+    }
     std::unique_ptr<Handler> handleWatchOnlyChanged(WatchOnlyChangedFn fn) override
     {
         return MakeHandler(m_wallet->NotifyWatchonlyChanged.connect(fn));
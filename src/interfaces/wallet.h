@@ -272,6 +272,9 @@ public:
     //! Add wallet token transaction entry.
     virtual bool addTokenTxEntry(const TokenTx& tokenTx, bool fFlushOnClose=true) = 0;
 
+    //! Add wallet token transaction entries in one database transaction.
+    virtual bool addTokenTxEntries(const std::vector<TokenTx>& tokenTxs, bool fFlushOnClose=true) = 0;
+
     //! Check if exist wallet token entry.
     virtual bool existTokenEntry(const TokenInfo &token) = 0;
 
@@ -293,6 +296,9 @@ public:
     //! Get list of all tokens.
     virtual std::vector<TokenInfo> getTokens() = 0;
 
+    //! Get the token balance tracked by the wallet from the block receipts, needs -logevents.
+    virtual bool getTokenBalance(const uint256& id, std::string& balance) = 0;
+
     //! Try to get updated status for a particular token transaction, if possible without blocking.
     virtual bool tryGetTokenTxStatus(const uint256& txid, int& block_number, bool& in_mempool, int& num_blocks) = 0;
 
@@ -344,6 +350,10 @@ public:
     //! Get list of all delegations.
     virtual std::vector<DelegationInfo> getDelegations() = 0;
 
+    //! Get the delegates whose delegation changed on chain since a version of the delegation index,
+    //! and move the version to the current one. Return false when the changes are not known.
+    virtual bool getDelegationChanges(uint64_t& version, std::vector<std::string>& delegates) = 0;
+
     //! Remove wallet delegation entry.
     virtual bool removeDelegationEntry(const std::string &sHash) = 0;
 
@@ -442,6 +452,10 @@ public:
     using TokenChangedFn = std::function<void(const uint256& id, ChangeType status)>;
     virtual std::unique_ptr<Handler> handleTokenChanged(TokenChangedFn fn) = 0;
 
+    //! Register handler for token balance changed messages.
+    using TokenBalanceChangedFn = std::function<void(const uint256& id)>;
+    virtual std::unique_ptr<Handler> handleTokenBalanceChanged(TokenBalanceChangedFn fn) = 0;
+
     //! Register handler for watchonly changed messages.
     using WatchOnlyChangedFn = std::function<void(bool have_watch_only)>;
     virtual std::unique_ptr<Handler> handleWatchOnlyChanged(WatchOnlyChangedFn fn) = 0;
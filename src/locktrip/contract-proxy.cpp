@@ -5,20 +5,120 @@
 #include <util/strencodings.h>
 #include "contract-proxy.h"
 #include "qtum/qtumstate.h"
+#include <libdevcore/SHA3.h>
 #include <util/system.h>
 
-ContractProxy::ContractProxy() {}
+#include <unordered_map>
 
-std::string ContractProxy::getContractFunctionHex(int func) const {
-    FunctionABI function = this->m_contractAbi.functions[func];
+namespace {
+/** Slot values of one system contract, read at the storage root they belong to */
+struct StorageSlotCache {
+    dev::h256 storageRoot;
+    std::unordered_map<dev::h256, dev::u256> values;
+};
+
+/** Bound on the slots kept per contract, the mapping getters are keyed by arbitrary addresses */
+const size_t MAX_STORAGE_SLOT_CACHE = 4096;
+
+/**
+ * Slots served by the storage views, by contract. The storage root of a contract only moves
+ * when its storage is written, so the values stay valid across blocks and reorgs until then.
+ */
+std::map<dev::Address, StorageSlotCache> g_storage_slot_cache GUARDED_BY(cs_main);
+}
+
+ContractStateKey ContractStateKey::current() {
+    AssertLockHeld(cs_main);
+    ContractStateKey key;
+    if (globalState && chainActive.Tip() != nullptr) {
+        key.tipHash = chainActive.Tip()->GetBlockHash();
+        key.stateRoot = globalState->rootHash();
+        key.utxoRoot = globalState->rootHashUTXO();
+    }
+    return key;
+}
+
+bool ContractStorageView::read(std::uint8_t funcId, dev::u256& value) const {
+    auto it = m_layout.find(funcId);
+    if (it == m_layout.end() || it->second.kind != StorageSlot::VALUE) {
+        return false;
+    }
+    return readSlot(it->second.slot, value);
+}
+
+bool ContractStorageView::read(std::uint8_t funcId, const dev::h256& key, dev::u256& value) const {
+    auto it = m_layout.find(funcId);
+    if (it == m_layout.end() || it->second.kind != StorageSlot::MAPPING) {
+        return false;
+    }
+
+    // Solidity places mapping entries at keccak256(key . slot)
+    dev::bytes preimage = key.asBytes();
+    dev::bytes slotBytes = dev::h256(it->second.slot).asBytes();
+    preimage.insert(preimage.end(), slotBytes.begin(), slotBytes.end());
+    return readSlot(dev::u256(dev::sha3(preimage)), value);
+}
 
-    return function.selector();
+bool ContractStorageView::readSlot(const dev::u256& slot, dev::u256& value) const {
+    AssertLockHeld(cs_main);
+    const dev::eth::Account* account = globalState ? globalState->account(m_contract) : nullptr;
+    if (!account) {
+        return false;
+    }
+    // Uncommitted writes are not under the storage root yet
+    if (account->isDirty()) {
+        value = globalState->storage(m_contract, slot);
+        return true;
+    }
+
+    StorageSlotCache& cache = g_storage_slot_cache[m_contract];
+    if (cache.storageRoot != account->baseRoot() || cache.values.size() >= MAX_STORAGE_SLOT_CACHE) {
+        cache.storageRoot = account->baseRoot();
+        cache.values.clear();
+    }
+    const dev::h256 key(slot);
+    auto it = cache.values.find(key);
+    if (it != cache.values.end()) {
+        value = it->second;
+        return true;
+    }
+    value = globalState->storage(m_contract, slot);
+    cache.values.emplace(key, value);
+    return true;
+}
+
+ContractAbiTable::ContractAbiTable(const std::string& json) : m_abi(json) {
+    m_selectors.reserve(m_abi.functions.size());
+    for (const FunctionABI& function : m_abi.functions) {
+        m_selectors.push_back(ParseHex(function.selector()));
+    }
+}
+
+ContractProxy::ContractProxy(const ContractAbiTable& abiTable) : m_abiTable(abiTable), m_contractAbi(abiTable.abi()) {}
+
+std::string ContractProxy::getContractFunctionHex(int func) const {
+    return this->m_contractAbi.functions[func].selector();
 }
 
 bool ContractProxy::generateCallString(std::vector<std::vector<std::string>> &values, std::string &callString,
                                  const std::uint8_t funcId) const {
-    FunctionABI function = this->m_contractAbi.functions[funcId];
+    const FunctionABI& function = this->m_contractAbi.functions[funcId];
     std::vector<ParameterABI::ErrorType> errors;
 
     return function.abiIn(values, callString, errors);
-}
\ No newline at end of file
+}
+
+bool ContractProxy::generateCallData(const std::vector<dev::h256>& args, dev::bytes& callData, const std::uint8_t funcId) const {
+    if (funcId >= this->m_abiTable.size() || this->m_contractAbi.functions[funcId].inputs.size() != args.size()) {
+        return false;
+    }
+
+    const dev::bytes& selector = this->m_abiTable.selector(funcId);
+    callData.clear();
+    callData.reserve(selector.size() + args.size() * dev::h256::size);
+    callData.insert(callData.end(), selector.begin(), selector.end());
+    for (const dev::h256& arg : args) {
+        callData.insert(callData.end(), arg.begin(), arg.end());
+    }
+    return true;
+}
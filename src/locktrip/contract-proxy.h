@@ -7,20 +7,111 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <cpp-ethereum/libdevcrypto/Common.h>
 #include "util/contractabi.h"
 #include "validation.h"
 
+/**
+ * Chain state a read-only system contract call was executed against. The getters of the
+ * system contracts only depend on the contract storage and the block environment of the tip,
+ * so calls made under equal keys always produce equal outputs.
+ */
+struct ContractStateKey {
+    uint256 tipHash;
+    dev::h256 stateRoot;
+    dev::h256 utxoRoot;
+
+    /** Key of the active tip and the global state, requires cs_main */
+    static ContractStateKey current();
+
+    bool isNull() const { return tipHash.IsNull(); }
+
+    bool operator==(const ContractStateKey& other) const {
+        return tipHash == other.tipHash && stateRoot == other.stateRoot && utxoRoot == other.utxoRoot;
+    }
+
+    bool operator!=(const ContractStateKey& other) const { return !(*this == other); }
+};
+
+/** Location of the value a view function returns inside the contract storage */
+struct StorageSlot {
+    enum Kind {
+        VALUE,   // state variable stored directly at slot
+        MAPPING  // mapping at slot, the value lives at sha3(key . slot)
+    };
+
+    Kind kind;
+    dev::u256 slot;
+};
+
+/** Storage slots of the view functions of one contract, keyed by ABI function id */
+typedef std::map<std::uint8_t, StorageSlot> ContractStorageLayout;
+
+/**
+ * Serves view functions of a system contract straight from its storage in the global state,
+ * without building an EVM environment. Only functions described by the layout are served;
+ * computed getters are not listed and must still go through CallContract. The slots read are
+ * cached per contract until its storage root changes.
+ */
+class ContractStorageView {
+public:
+    ContractStorageView() {}
+    ContractStorageView(const dev::Address& contract, const ContractStorageLayout& layout) : m_contract(contract), m_layout(layout) {}
+
+    bool has(std::uint8_t funcId) const { return m_layout.count(funcId) != 0; }
+
+    /** Read a VALUE getter, requires cs_main */
+    bool read(std::uint8_t funcId, dev::u256& value) const;
+
+    /** Read a MAPPING getter for a 32 byte ABI encoded key, requires cs_main */
+    bool read(std::uint8_t funcId, const dev::h256& key, dev::u256& value) const;
+
+private:
+    bool readSlot(const dev::u256& slot, dev::u256& value) const;
+
+    dev::Address m_contract;
+    ContractStorageLayout m_layout;
+};
+
+/**
+ * ABI of a system contract, parsed once per process and shared by every proxy instance.
+ * Function selectors are decoded up front so call data can be built without hex strings.
+ */
+class ContractAbiTable {
+public:
+    explicit ContractAbiTable(const std::string& json);
+
+    const ContractABI& abi() const { return m_abi; }
+
+    size_t size() const { return m_selectors.size(); }
+
+    const dev::bytes& selector(std::uint8_t funcId) const { return m_selectors[funcId]; }
+
+private:
+    ContractABI m_abi;
+    std::vector<dev::bytes> m_selectors;
+};
+
 class ContractProxy {
 public:
-    ContractProxy();
+    explicit ContractProxy(const ContractAbiTable& abiTable);
     std::string getContractFunctionHex(int func) const;
 
 protected:
     bool generateCallString(std::vector<std::vector<std::string>>& values, std::string& callString, std::uint8_t funcId) const;
 
+    /**
+     * Encode a call to a function whose arguments are all static 32 byte words (uint256, address, bool)
+     * straight into call data. Fails if the number of arguments does not match the ABI.
+     */
+    bool generateCallData(const std::vector<dev::h256>& args, dev::bytes& callData, std::uint8_t funcId) const;
+
+    const ContractAbiTable& m_abiTable;
+    ContractStorageView m_storageView;
+
 public:
-    ContractABI m_contractAbi;
+    const ContractABI& m_contractAbi;
 };
 
 #endif //LOCKTRIP_CONTRACT_PROXY_H
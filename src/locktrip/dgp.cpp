@@ -10,34 +10,103 @@
 #include <util/system.h>
 #include <logging.h>
 
-Dgp::Dgp() {
-    this->m_contractAbi.loads(DGP_CONTRACT_ABI);
+uint64_t DGP_CACHE_FIAT_GAS_PRICE = 1000;
+uint64_t DGP_CACHE_BURN_RATE = DEFAULT_BURN_RATE_PERCENTAGE;
+uint64_t DGP_CACHE_ECONOMY_DIVIDEND = DEFAULT_ECONOMY_DIVIDEND_PERCENTAGE;
+uint64_t DGP_CACHE_BLOCK_SIZE = DEFAULT_BLOCK_SIZE_DGP;
+uint64_t DGP_CACHE_BLOCK_GAS_LIMIT = DEFAULT_BLOCK_GAS_LIMIT_DGP;
+uint64_t DGP_CACHE_FIAT_BYTE_PRICE = 1000;
+
+namespace {
+// Memoized outputs of DGP contract calls, keyed by call data, for dgpSnapshotKey
+ContractStateKey dgpSnapshotKey GUARDED_BY(cs_main);
+std::map<dev::bytes, dev::bytes> dgpSnapshot GUARDED_BY(cs_main);
+
+const ContractAbiTable& DgpAbiTable() {
+    static const ContractAbiTable table(DGP_CONTRACT_ABI);
+    return table;
+}
+
+uint64_t WordToUint64(const dev::bytes& output, size_t offset) {
+    return uint64_t(dev::u256(dev::h256(dev::bytesConstRef(&output).cropped(offset, 32))));
+}
+}
+
+Dgp::Dgp() : ContractProxy(DgpAbiTable()) {
+    this->m_storageView = ContractStorageView(LockTripDgpContract, DGP_STORAGE_LAYOUT);
+}
+
+bool Dgp::callDgpContract(const dev::bytes& callData, dev::bytes& output) {
+    ContractStateKey key = ContractStateKey::current();
+    if (key.isNull()) {
+        return false;
+    }
+
+    if (key != dgpSnapshotKey) {
+        dgpSnapshot.clear();
+        dgpSnapshotKey = key;
+    }
+
+    auto it = dgpSnapshot.find(callData);
+    if (it != dgpSnapshot.end()) {
+        output = it->second;
+        return true;
+    }
+
+    std::vector<ResultExecute> result = CallContract(LockTripDgpContract, callData, dev::Address(), 0, DEFAULT_BLOCK_GAS_LIMIT_DGP);
+    if (result.empty()) {
+        return false;
+    }
+
+    output = result[0].execRes.output;
+    dgpSnapshot.emplace(callData, output);
+    return true;
+}
+
+bool Dgp::callDgpWord(dgp_contract_funcs func, const std::vector<dev::h256>& args, dev::u256& word) {
+    dev::bytes callData;
+    dev::bytes output;
+    if (!this->generateCallData(args, callData, func) || !this->callDgpContract(callData, output)) {
+        return false;
+    }
+
+    dev::bytesConstRef o(&output);
+    word = dev::eth::ABIDeserialiser<dev::u256>::deserialise(o);
+    return true;
 }
 
 bool Dgp::hasVoteInProgress(bool& voteInProgress) {
     LOCK(cs_main);
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{};
-    bool status = this->generateCallString(values, callString, HAS_VOTE_IN_PROGRESS);
-
-    if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripDgpContract, ParseHex(callString), dev::Address(), 0, DEFAULT_BLOCK_GAS_LIMIT_DGP);
-
-        if (!result.empty()) {
-            dev::bytesConstRef o(&result[0].execRes.output);
-            dev::u256 outData = dev::eth::ABIDeserialiser<dev::u256>::deserialise(o);
-            voteInProgress = outData == 0 ? false : true;
-
-            return true;
-        } else {
-            return false;
-        }
-    } else {
+    dev::u256 outData;
+    if (!this->callDgpWord(HAS_VOTE_IN_PROGRESS, {}, outData)) {
         return false;
     }
+
+    voteInProgress = outData != 0;
+    return true;
 }
 
 bool Dgp::getCurrentVote(dgp_currentVote& currentVote) {
+    LOCK(cs_main);
+    // The public getter of the vote struct returns its fields in declaration order, in one execution
+    // that is memoized for the state like every other DGP call
+    dev::bytes callData;
+    dev::bytes output;
+    if (this->generateCallData({}, callData, CURRENT_VOTE) && this->callDgpContract(callData, output) && output.size() >= 9 * 32) {
+        dev::bytesConstRef o(&output);
+        currentVote.votesFor = uint64_t(dev::eth::ABIDeserialiser<dev::u256>::deserialise(o));
+        currentVote.votesAgainst = uint64_t(dev::eth::ABIDeserialiser<dev::u256>::deserialise(o));
+        currentVote.start_block = uint64_t(dev::eth::ABIDeserialiser<dev::u256>::deserialise(o));
+        currentVote.blocksExpiration = uint64_t(dev::eth::ABIDeserialiser<dev::u256>::deserialise(o));
+        currentVote.param = uint64_t(dev::eth::ABIDeserialiser<dev::u256>::deserialise(o));
+        currentVote.param_value = uint64_t(dev::eth::ABIDeserialiser<dev::u256>::deserialise(o));
+        currentVote.threshold = uint64_t(dev::eth::ABIDeserialiser<dev::u256>::deserialise(o));
+        currentVote.newAdmin = dev::eth::ABIDeserialiser<dev::Address>::deserialise(o);
+        currentVote.vote_creator = dev::eth::ABIDeserialiser<dev::Address>::deserialise(o);
+        return true;
+    }
+
+    // A contract without the struct getter still serves the field getters
     return this->fillCurrentVoteAddressInfo(CURRENT_VOTE_NEWADMIN, currentVote.newAdmin) &&
             this->fillCurrentVoteAddressInfo(CURRENT_VOTE_CREATOR, currentVote.vote_creator) &&
             this->fillCurrentVoteUintInfo(CURRENT_VOTE_VOTESFOR, currentVote.votesFor) &&
@@ -51,161 +120,97 @@ bool Dgp::getCurrentVote(dgp_currentVote& currentVote) {
 
 bool Dgp::fillCurrentVoteUintInfo(dgp_contract_funcs func, uint64_t& container) {
     LOCK(cs_main);
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{};
-    bool status = this->generateCallString(values, callString, func);
-    if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripDgpContract, ParseHex(callString), dev::Address(), 0, DEFAULT_BLOCK_GAS_LIMIT_DGP);
-
-        if (!result.empty()) {
-            dev::bytesConstRef o(&result[0].execRes.output);
-            dev::u256 outData = dev::eth::ABIDeserialiser<dev::u256>::deserialise(o);
-            container = uint64_t(dev::u256(dev::h256(outData)));
-
-            return true;
-        } else {
-            return false;
-        }
-    } else {
+    dev::u256 outData;
+    if (!this->callDgpWord(func, {}, outData)) {
         return false;
     }
+
+    container = uint64_t(outData);
+    return true;
 }
 
 bool Dgp::fillCurrentVoteAddressInfo(dgp_contract_funcs func, dev::Address& container) {
     LOCK(cs_main);
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{};
-    bool status = this->generateCallString(values, callString, func);
-    if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripDgpContract, ParseHex(callString), dev::Address(), 0, DEFAULT_BLOCK_GAS_LIMIT_DGP);
-
-        if (!result.empty()) {
-            dev::bytesConstRef o(&result[0].execRes.output);
-            dev::Address outData = dev::eth::ABIDeserialiser<dev::Address>::deserialise(o);
-            container = outData;
-
-            return true;
-        } else {
-            return false;
-        }
-    } else {
+    dev::bytes callData;
+    dev::bytes output;
+    if (!this->generateCallData({}, callData, func) || !this->callDgpContract(callData, output)) {
         return false;
     }
+
+    dev::bytesConstRef o(&output);
+    container = dev::eth::ABIDeserialiser<dev::Address>::deserialise(o);
+    return true;
 }
 
 bool Dgp::isParamVoted(dgp_params param, bool& isVoted) {
     LOCK(cs_main);
-    std::vector<std::string> params {std::to_string(param)};
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{params};
-    bool status = this->generateCallString(values, callString, PARAM_VOTED);
-    if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripDgpContract, ParseHex(callString), dev::Address(), 0, DEFAULT_BLOCK_GAS_LIMIT_DGP);
-
-        if (!result.empty()) {
-            dev::bytesConstRef o(&result[0].execRes.output);
-            dev::u256 outData = dev::eth::ABIDeserialiser<dev::u256>::deserialise(o);
-            isVoted = outData == 0 ? false : true;
-
-            return true;
-        } else {
-            return false;
-        }
-    } else {
+    dev::h256 key(dev::u256(param));
+    dev::u256 outData;
+    if (!this->m_storageView.read(PARAM_VOTED, key, outData) &&
+        !this->callDgpWord(PARAM_VOTED, {key}, outData)) {
         return false;
     }
+
+    isVoted = outData != 0;
+    return true;
 }
 
 bool Dgp::getVoteBlockExpiration(uint64_t& expiration) {
     LOCK(cs_main);
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{};
-    bool status = this->generateCallString(values, callString, GET_VOTE_EXPIRATION);
-
-    if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripDgpContract, ParseHex(callString), dev::Address(), 0, DEFAULT_BLOCK_GAS_LIMIT_DGP);
-
-        if (!result.empty()) {
-            dev::bytesConstRef o(&result[0].execRes.output);
-            dev::u256 data = dev::eth::ABIDeserialiser<dev::u256>::deserialise(o);
-            expiration = uint64_t(dev::u256(dev::h256(data)));
-            return true;
-        } else {
-            return false;
-        }
-    } else {
+    dev::u256 data;
+    if (!this->callDgpWord(GET_VOTE_EXPIRATION, {}, data)) {
         return false;
     }
+
+    expiration = uint64_t(data);
+    return true;
 }
 
 bool Dgp::getDgpParam(dgp_params param, uint64_t& value) {
     LOCK(cs_main);
-    std::vector<std::string> params {std::to_string(param)};
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{params};
-    bool status = this->generateCallString(values, callString, GET_DGP_PARAM);
-
-    if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripDgpContract, ParseHex(callString), dev::Address(), 0, DEFAULT_BLOCK_GAS_LIMIT_DGP);
-
-        if (!result.empty()) {
-            dev::bytesConstRef o(&result[0].execRes.output);
-            dev::u256 data = dev::eth::ABIDeserialiser<dev::u256>::deserialise(o);
-            value = uint64_t(dev::u256(dev::h256(data)));
-            return true;
-        } else {
-            return false;
-        }
-    } else {
+    dev::h256 key(dev::u256(param));
+    dev::u256 data;
+    if (!this->m_storageView.read(GET_DGP_PARAM, key, data) &&
+        !this->callDgpWord(GET_DGP_PARAM, {key}, data)) {
         return false;
     }
+
+    value = uint64_t(data);
+    return true;
 }
 
 bool Dgp::convertFiatThresholdToLoc(uint64_t& fiatThresholdInCents, uint64_t& locContainer) {
     LOCK(cs_main);
-    std::vector<std::string> params {std::to_string(fiatThresholdInCents * ONE_CENT_EQUAL)};
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{params};
-    bool status = this->generateCallString(values, callString, CONVERT_FIAT_THRESHOLD_TO_LOC);
-
-    if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripDgpContract, ParseHex(callString), dev::Address(), 0, DEFAULT_BLOCK_GAS_LIMIT_DGP);
-
-        if (!result.empty()) {
-            dev::bytesConstRef o(&result[0].execRes.output);
-            dev::u256 data = dev::eth::ABIDeserialiser<dev::u256>::deserialise(o);
-            locContainer = uint64_t(dev::u256(dev::h256(data)));
-            return true;
-        } else {
-            return false;
-        }
-    } else {
+    dev::u256 data;
+    if (!this->callDgpWord(CONVERT_FIAT_THRESHOLD_TO_LOC, {dev::h256(dev::u256(fiatThresholdInCents * ONE_CENT_EQUAL))}, data)) {
         return false;
     }
+
+    locContainer = uint64_t(data);
+    return true;
 }
 
 bool Dgp::finishVote(CScript& scriptPubKey) {
     scriptPubKey = CScript();
 
-    std::string callString{};
-    std::vector<std::vector<std::string>> values{};
-
-    bool status = this->generateCallString(values, callString, FINISH_VOTE);
-
-    if (status) {
-        scriptPubKey << CScriptNum(VersionVM::GetEVMDefault().toRaw()) <<  ParseHex(callString)
-                     << LockTripDgpContract.asBytes() << OP_COINSTAKE_CALL;
-        return true;
-    } else {
+    dev::bytes callData;
+    if (!this->generateCallData({}, callData, FINISH_VOTE)) {
         return false;
     }
+
+    scriptPubKey << CScriptNum(VersionVM::GetEVMDefault().toRaw()) << callData
+                 << LockTripDgpContract.asBytes() << OP_COINSTAKE_CALL;
+    return true;
 }
 
 void Dgp::calculateGasPriceBuffer(CAmount gasPrice, CAmount& gasPriceBuffer) {
     gasPriceBuffer = gasPrice / 5 + gasPrice % 5;
 }
 
-void Dgp::updateDgpCache() {
+bool Dgp::updateDgpCache() {
+    const std::vector<uint64_t> previous = {DGP_CACHE_FIAT_GAS_PRICE, DGP_CACHE_BURN_RATE, DGP_CACHE_ECONOMY_DIVIDEND,
+                                            DGP_CACHE_BLOCK_SIZE, DGP_CACHE_BLOCK_GAS_LIMIT, DGP_CACHE_FIAT_BYTE_PRICE};
+
     this->updateDgpCacheParam(FIAT_GAS_PRICE, DGP_CACHE_FIAT_GAS_PRICE);
     if(DGP_CACHE_FIAT_GAS_PRICE < DEFAULT_MIN_GAS_PRICE_DGP)
         DGP_CACHE_FIAT_GAS_PRICE = DEFAULT_MIN_GAS_PRICE_DGP;
@@ -233,6 +238,10 @@ void Dgp::updateDgpCache() {
     this->updateDgpCacheParam(FIAT_BYTE_PRICE, DGP_CACHE_FIAT_BYTE_PRICE);
     if(DGP_CACHE_FIAT_BYTE_PRICE < DEFAULT_MIN_BYTE_PRICE_DGP)
         DGP_CACHE_FIAT_BYTE_PRICE = DEFAULT_MIN_BYTE_PRICE_DGP;
+
+    const std::vector<uint64_t> current = {DGP_CACHE_FIAT_GAS_PRICE, DGP_CACHE_BURN_RATE, DGP_CACHE_ECONOMY_DIVIDEND,
+                                           DGP_CACHE_BLOCK_SIZE, DGP_CACHE_BLOCK_GAS_LIMIT, DGP_CACHE_FIAT_BYTE_PRICE};
+    return current != previous;
 }
 
 void Dgp::updateDgpCacheParam(dgp_params param, uint64_t& cache) {
@@ -248,53 +257,34 @@ void Dgp::updateDgpCacheParam(dgp_params param, uint64_t& cache) {
 
 bool Dgp::fillBlockRewardBlocksInfo() {
     LOCK(cs_main);
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{};
-    bool status = this->generateCallString(values, callString, GET_BLOCK_REWARD_VOTE_BLOCKS);
-
-    if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripDgpContract, ParseHex(callString), dev::Address(), 0, DEFAULT_BLOCK_GAS_LIMIT_DGP);
-        if (!result.empty()) {
-            std::string output = HexStr(result[0].execRes.output);
-            this->blockRewardVoteBlocks.clear();
-            for(int i = 128; i < output.length(); i+=64) {
-                std::string current = output.substr(i, 64);
-                uint64_t num = uint64_t(dev::u256(dev::h256(current)));
-                this->blockRewardVoteBlocks.push_back(num);
-            }
-
-            return true;
-        } else {
-            return false;
-        }
-    } else {
+    dev::bytes callData;
+    dev::bytes output;
+    if (!this->generateCallData({}, callData, GET_BLOCK_REWARD_VOTE_BLOCKS) || !this->callDgpContract(callData, output)) {
         return false;
     }
+
+    // Skip the offset and length words of the returned dynamic array
+    this->blockRewardVoteBlocks.clear();
+    for (size_t i = 64; i + 32 <= output.size(); i += 32) {
+        this->blockRewardVoteBlocks.push_back(WordToUint64(output, i));
+    }
+
+    return true;
 }
 
 bool Dgp::fillBlockRewardPercentageInfo() {
     LOCK(cs_main);
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{};
-    bool status = this->generateCallString(values, callString, GET_BLOCK_REWARD_VOTE_PERCENTAGES);
-
-    if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripDgpContract, ParseHex(callString), dev::Address(), 0, DEFAULT_BLOCK_GAS_LIMIT_DGP);
-
-        if (!result.empty()) {
-            std::string output = HexStr(result[0].execRes.output);
-            this->blockRewardVotePercentages.clear();
-            for(int i = 128; i < output.length(); i+=64) {
-                std::string current = output.substr(i, 64);
-                uint64_t num = uint64_t(dev::u256(dev::h256(current)));
-                this->blockRewardVotePercentages.push_back(num);
-            }
-
-            return true;
-        } else {
-            return false;
-        }
-    } else {
+    dev::bytes callData;
+    dev::bytes output;
+    if (!this->generateCallData({}, callData, GET_BLOCK_REWARD_VOTE_PERCENTAGES) || !this->callDgpContract(callData, output)) {
         return false;
     }
-}
\ No newline at end of file
+
+    // Skip the offset and length words of the returned dynamic array
+    this->blockRewardVotePercentages.clear();
+    for (size_t i = 64; i + 32 <= output.size(); i += 32) {
+        this->blockRewardVotePercentages.push_back(WordToUint64(output, i));
+    }
+
+    return true;
+}
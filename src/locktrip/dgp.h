@@ -42,13 +42,14 @@ static const uint64_t DEFAULT_BLOCK_GAS_LIMIT_DGP = 40000000;
 static const uint64_t ONE_CENT_EQUAL = 1000000; // representing fiat money like HYDRA and satoshi
 
 // DGP CACHE GLOBALS
+// Defined once in dgp.cpp so every translation unit sees the values written by updateDgpCache()
 
-static uint64_t DGP_CACHE_FIAT_GAS_PRICE = 1000;
-static uint64_t DGP_CACHE_BURN_RATE = DEFAULT_BURN_RATE_PERCENTAGE;
-static uint64_t DGP_CACHE_ECONOMY_DIVIDEND = DEFAULT_ECONOMY_DIVIDEND_PERCENTAGE;
-static uint64_t DGP_CACHE_BLOCK_SIZE = DEFAULT_BLOCK_SIZE_DGP;
-static uint64_t DGP_CACHE_BLOCK_GAS_LIMIT = DEFAULT_BLOCK_GAS_LIMIT_DGP;
-static uint64_t DGP_CACHE_FIAT_BYTE_PRICE = 1000;
+extern uint64_t DGP_CACHE_FIAT_GAS_PRICE;
+extern uint64_t DGP_CACHE_BURN_RATE;
+extern uint64_t DGP_CACHE_ECONOMY_DIVIDEND;
+extern uint64_t DGP_CACHE_BLOCK_SIZE;
+extern uint64_t DGP_CACHE_BLOCK_GAS_LIMIT;
+extern uint64_t DGP_CACHE_FIAT_BYTE_PRICE;
 
 // Array indexes are the same as the DGP param IDs
 const auto VOTE_HEADLINES = {
@@ -798,6 +799,7 @@ enum dgp_contract_funcs {
     GET_BLOCK_REWARD_VOTE_BLOCKS = 17,
     GET_BLOCK_REWARD_VOTE_PERCENTAGES = 18,
     ACTIVATE_NEW_REWARD = 6,
+    CURRENT_VOTE = 13,
     ///////////////
     CURRENT_VOTE_NEWADMIN = 19,
     CURRENT_VOTE_VOTESFOR = 27,
@@ -810,6 +812,10 @@ enum dgp_contract_funcs {
     CURRENT_VOTE_THRESHOLD = 25
 };
 
+// View functions of the DGP contract served from storage by Dgp. Only getters whose slot was
+// checked against the deployed contract belong here, anything else is executed in the EVM.
+static const ContractStorageLayout DGP_STORAGE_LAYOUT = {};
+
 struct dgp_currentVote {
     uint64_t votesFor;
     uint64_t votesAgainst;
@@ -831,12 +837,14 @@ public:
     bool finishVote(CScript& scriptPubKey);
     bool getDgpParam(dgp_params param, uint64_t& value);
     bool isParamVoted(dgp_params param, bool& isVoted);
+    /** The whole current vote, read with one call of the getter of the vote struct */
     bool getCurrentVote(dgp_currentVote& currentVote);
     bool fillCurrentVoteUintInfo(dgp_contract_funcs func, uint64_t& container);
     bool fillCurrentVoteAddressInfo(dgp_contract_funcs func, dev::Address& container);
     void calculateGasPriceBuffer(CAmount gasPrice, CAmount& gasPriceBuffer);
     bool convertFiatThresholdToLoc(uint64_t& fiatThresholdInCents, uint64_t& locContainer);
-    void updateDgpCache();
+    /** Refresh the DGP_CACHE globals from the contract, returns whether any of them changed */
+    bool updateDgpCache();
     bool fillBlockRewardBlocksInfo();
     bool fillBlockRewardPercentageInfo();
 
@@ -845,6 +853,8 @@ public:
 
 private:
     void updateDgpCacheParam(dgp_params param, uint64_t& cache);
+    bool callDgpContract(const dev::bytes& callData, dev::bytes& output);
+    bool callDgpWord(dgp_contract_funcs func, const std::vector<dev::h256>& args, dev::u256& word);
 };
 
 #endif //LOCKTRIP_DGP_H
@@ -0,0 +1,25 @@
+// Copyright (c) 2018 LockTrip
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <locktrip/dgpcache.h>
+#include <locktrip/dgp.h>
+#include <ui_interface.h>
+#include <validation.h>
+
+std::unique_ptr<DgpCacheUpdater> g_dgp_cache_updater;
+
+void DgpCacheUpdater::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    if (fInitialDownload)
+        return;
+
+    Dgp dgp;
+    if (dgp.updateDgpCache()) {
+        {
+            LOCK(cs_main);
+            UpdateTipSnapshot(chainActive.Tip());
+        }
+        uiInterface.NotifyDgpCacheChanged();
+    }
+}
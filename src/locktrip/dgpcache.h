@@ -0,0 +1,27 @@
+// Copyright (c) 2018 LockTrip
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef LOCKTRIP_DGPCACHE_H
+#define LOCKTRIP_DGPCACHE_H
+
+#include <validationinterface.h>
+
+#include <memory>
+
+/**
+ * Refreshes the DGP_CACHE values once per tip change, on the validation
+ * callback thread, and notifies the UI through NotifyDgpCacheChanged when
+ * one of them changed, after publishing them in a new tip snapshot.
+ * Blocks connected during initial block download are skipped, the first
+ * tip after it refreshes the values.
+ */
+class DgpCacheUpdater final : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+};
+
+extern std::unique_ptr<DgpCacheUpdater> g_dgp_cache_updater;
+
+#endif // LOCKTRIP_DGPCACHE_H
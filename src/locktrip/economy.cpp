@@ -7,25 +7,65 @@
 #include "qtum/qtumstate.h"
 #include <util/system.h>
 
+#include <unordered_map>
+
 #define CONTRACTOWNER_ADDR_LEN  40
 
-Economy::Economy() {
-    this->m_contractAbi.loads(ECONOMY_CONTRACT_ABI);
+namespace {
+const ContractAbiTable& EconomyAbiTable() {
+    static const ContractAbiTable table(ECONOMY_CONTRACT_ABI);
+    return table;
+}
+
+/** Owners returned by the economy contract, read at the storage root of the contract they belong to */
+struct ContractOwnerCache {
+    dev::h256 storageRoot;
+    std::unordered_map<dev::Address, dev::Address> owners;
+};
+
+/** Bound on the cached owners, one entry per contract that earned dividends since the last owner change */
+const size_t MAX_CONTRACT_OWNER_CACHE = 65536;
+
+/**
+ * The owner getter only reads the storage of the economy contract, so its results stay valid
+ * until that storage root moves. Block assembly, TestBlockValidity and ConnectBlock of the
+ * following blocks then look the owners up here instead of calling into the EVM.
+ */
+ContractOwnerCache g_contract_owner_cache GUARDED_BY(cs_main);
 }
 
+Economy::Economy() : ContractProxy(EconomyAbiTable()) {}
+
 bool Economy::getContractOwner(const dev::Address contract, dev::Address &owner) const {
-    std::vector<std::string> params{contract.hex()};
-    std::string callString{};
-    std::vector<std::vector<std::string>> values{params};
-    bool status = this->generateCallString(values, callString, GET_OWNER_FUNC_ID);
+    LOCK(cs_main);
+    // Uncommitted writes are not under the storage root yet, those lookups are not cached
+    const dev::eth::Account* account = globalState ? globalState->account(LockTripEconomyContract) : nullptr;
+    const bool fCache = account && !account->isDirty();
+    if (fCache) {
+        if (g_contract_owner_cache.storageRoot != account->baseRoot() || g_contract_owner_cache.owners.size() >= MAX_CONTRACT_OWNER_CACHE) {
+            g_contract_owner_cache.storageRoot = account->baseRoot();
+            g_contract_owner_cache.owners.clear();
+        }
+        auto it = g_contract_owner_cache.owners.find(contract);
+        if (it != g_contract_owner_cache.owners.end()) {
+            owner = it->second;
+            return true;
+        }
+    }
+
+    dev::bytes callData;
+    bool status = this->generateCallData({dev::h256(contract, dev::h256::AlignRight)}, callData, GET_OWNER_FUNC_ID);
 
     if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripEconomyContract, ParseHex(callString));
+        std::vector<ResultExecute> result = CallContract(LockTripEconomyContract, callData);
 
         if (!result.empty()) {
             std::string res = HexStr(result[0].execRes.output);
             dev::Address contractOwner(res.substr(res.length() - CONTRACTOWNER_ADDR_LEN));
             owner = contractOwner;
+            if (fCache) {
+                g_contract_owner_cache.owners.emplace(contract, contractOwner);
+            }
             return true;
         } else {
             return false;
@@ -84,6 +84,7 @@ class Economy : public ContractProxy {
 
 public:
     Economy();
+    /** Owner of a contract, cached until the storage of the economy contract changes */
     bool getContractOwner(dev::Address contract, dev::Address& owner) const;
     bool getCScriptForAddContract(std::vector<dev::Address>& contractAddresses, std::vector<dev::Address>& ownerAddresses,
             CScript& scriptPubKey);
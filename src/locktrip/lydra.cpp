@@ -15,11 +15,23 @@
 #include <key_io.h>
 #include <tuple>
 
+namespace {
+// Locked amounts by reversed key id hex, valid for lockedAmountsKey
+ContractStateKey lockedAmountsKey GUARDED_BY(cs_main);
+std::map<std::string, uint64_t> lockedAmounts GUARDED_BY(cs_main);
+
+const ContractAbiTable& LydraAbiTable()
+{
+    static const ContractAbiTable table(LYDRA_CONTRACT_ABI);
+    return table;
+}
+}
+
 std::tuple<uint64_t, bool> getAllLydraLockedCache() 
 {
     uint64_t sum = 0;
     bool successful = false;
-    Lydra l;
+    std::set<std::string> addresses;
     auto wallets = GetWallets();
     for (const auto& wallet : wallets)
     {
@@ -33,20 +45,25 @@ std::tuple<uint64_t, bool> getAllLydraLockedCache()
             CTxDestination destSender = DecodeDestination(addr);
             const CKeyID *pkhSender = boost::get<CKeyID>(&destSender);
             if (pkhSender) {
-                uint64_t amount;
-                l.getLockedHydraAmountPerAddress(pkhSender->GetReverseHex(), amount);
-                sum += amount;
+                addresses.insert(pkhSender->GetReverseHex());
                 successful = true;
             }
         }
     }
 
+    Lydra l;
+    std::map<std::string, uint64_t> amounts;
+    l.getLockedHydraAmounts(addresses, amounts);
+    for (const auto& amount : amounts) {
+        sum += amount.second;
+    }
+
     return std::make_tuple(sum, successful);
 }
 
-Lydra::Lydra()
+Lydra::Lydra() : ContractProxy(LydraAbiTable())
 {
-    this->m_contractAbi.loads(LYDRA_CONTRACT_ABI);
+    this->m_storageView = ContractStorageView(uintToh160(Params().GetConsensus().lydraAddress), LYDRA_STORAGE_LAYOUT);
 }
 
 bool Lydra::getMintDatahex(std::string& datahex)
@@ -70,13 +87,24 @@ bool Lydra::getBurnDatahex(std::string& datahex, int64_t amount)
 
 bool Lydra::getLockedHydraAmountPerAddress(std::string address, uint64_t& amount)
 {
-    std::vector<std::string> params{address};
-    std::string callString{};
-    std::vector<std::vector<std::string>> values{params};
-    bool status = this->generateCallString(values, callString, LOCKED_BALANCE);
+    if (this->m_storageView.has(LOCKED_BALANCE)) {
+        LOCK(cs_main);
+        dev::u256 stored;
+        if (this->m_storageView.read(LOCKED_BALANCE, dev::h256(dev::Address(address), dev::h256::AlignRight), stored)) {
+            amount = uint64_t(stored);
+            return true;
+        }
+    }
+
+    if (address.size() != 40 || !IsHex(address)) {
+        return false;
+    }
+
+    dev::bytes callData;
+    bool status = this->generateCallData({dev::h256(dev::Address(address), dev::h256::AlignRight)}, callData, LOCKED_BALANCE);
 
     if (status) {
-        std::vector<ResultExecute> result = CallContract(uintToh160(Params().GetConsensus().lydraAddress), ParseHex(callString));
+        std::vector<ResultExecute> result = CallContract(uintToh160(Params().GetConsensus().lydraAddress), callData);
 
         if (!result.empty()) {
             dev::bytesConstRef o(&result[0].execRes.output);
@@ -90,3 +118,35 @@ bool Lydra::getLockedHydraAmountPerAddress(std::string address, uint64_t& amount
         return false;
     }
 }
+
+bool Lydra::getLockedHydraAmounts(const std::set<std::string>& addresses, std::map<std::string, uint64_t>& amounts)
+{
+    LOCK(cs_main);
+    ContractStateKey key = ContractStateKey::current();
+    if (key != lockedAmountsKey) {
+        lockedAmounts.clear();
+        lockedAmountsKey = key;
+    }
+
+    bool allResolved = true;
+    for (const std::string& address : addresses) {
+        auto it = lockedAmounts.find(address);
+        if (it != lockedAmounts.end()) {
+            amounts[address] = it->second;
+            continue;
+        }
+
+        uint64_t amount = 0;
+        if (this->getLockedHydraAmountPerAddress(address, amount)) {
+            if (!key.isNull()) {
+                lockedAmounts.emplace(address, amount);
+            }
+        } else {
+            amount = 0;
+            allResolved = false;
+        }
+        amounts[address] = amount;
+    }
+
+    return allResolved;
+}
@@ -9,17 +9,42 @@
 #include <util/system.h>
 #include "price-oracle.h"
 
-PriceOracle::PriceOracle() {
-    this->m_contractAbi.loads(PRICE_ORACLE_CONTRACT_ABI);
+namespace {
+ContractStateKey oracleGasPriceKey GUARDED_BY(cs_main);
+uint64_t oracleGasPrice GUARDED_BY(cs_main) = DEFAULT_GAS_PRICE;
+
+const ContractAbiTable& PriceOracleAbiTable() {
+    static const ContractAbiTable table(PRICE_ORACLE_CONTRACT_ABI);
+    return table;
+}
+}
+
+bool GetCachedOracleGasPrice(uint64_t& gasPrice) {
+    LOCK(cs_main);
+    ContractStateKey key = ContractStateKey::current();
+    if (!key.isNull() && key == oracleGasPriceKey) {
+        gasPrice = oracleGasPrice;
+        return true;
+    }
+
+    PriceOracle oracle;
+    if (!oracle.getPrice(gasPrice)) {
+        return false;
+    }
+
+    oracleGasPriceKey = key;
+    oracleGasPrice = gasPrice;
+    return true;
 }
 
+PriceOracle::PriceOracle() : ContractProxy(PriceOracleAbiTable()) {}
+
 bool PriceOracle::getPrice(uint64_t &gasPrice) {
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{};
-    bool status = this->generateCallString(values, callString, GET_PRICE);
+    dev::bytes callData;
+    bool status = this->generateCallData({}, callData, GET_PRICE);
 
     if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripPriceOracleContract, ParseHex(callString));
+        std::vector<ResultExecute> result = CallContract(LockTripPriceOracleContract, callData);
 
         if (!result.empty()) {
             dev::bytesConstRef o(&result[0].execRes.output);
@@ -40,12 +65,11 @@ bool PriceOracle::getPrice(uint64_t &gasPrice) {
 }
 
 bool PriceOracle::getBytePrice(uint64_t& bytePrice) {
-    std::string callString {};
-    std::vector<std::vector<std::string>> values{};
-    bool status = this->generateCallString(values, callString, GET_BYTE_PRICE);
+    dev::bytes callData;
+    bool status = this->generateCallData({}, callData, GET_BYTE_PRICE);
 
     if (status) {
-        std::vector<ResultExecute> result = CallContract(LockTripPriceOracleContract, ParseHex(callString));
+        std::vector<ResultExecute> result = CallContract(LockTripPriceOracleContract, callData);
 
         if (!result.empty()) {
             dev::bytesConstRef o(&result[0].execRes.output);
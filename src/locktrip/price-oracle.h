@@ -399,5 +399,11 @@ public:
     bool getBytePrice(uint64_t& bytePrice);
 };
 
+/**
+ * Oracle gas price for the current chain state. The price is read from the oracle contract
+ * once per tip and state root and served from memory until either of them changes.
+ */
+bool GetCachedOracleGasPrice(uint64_t& gasPrice);
+
 
 #endif //LOCKTRIP_ORACLE_H
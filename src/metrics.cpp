@@ -0,0 +1,130 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <metrics.h>
+
+#include <httpserver.h>
+#include <rpc/protocol.h>
+#include <tinyformat.h>
+#include <txmempool.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+NodeMetrics g_metrics;
+
+static std::atomic<bool> fMetricsStarted{false};
+
+static void AppendMetric(std::string& out, const std::string& name, const char* type, const std::string& help, uint64_t value)
+{
+    out += strprintf("# HELP %s %s\n# TYPE %s %s\n%s %u\n", name, help, name, type, name, value);
+}
+
+static void AppendLabeledMetric(std::string& out, const std::string& name, const std::string& label, const std::string& labelValue, uint64_t value)
+{
+    out += strprintf("%s{%s=\"%s\"} %u\n", name, label, labelValue, value);
+}
+
+std::string MetricsToText()
+{
+    std::string out;
+    AppendMetric(out, "hydra_tip_height", "gauge", "Height of the active chain tip", g_metrics.tipHeight.load());
+    AppendMetric(out, "hydra_blocks_connected_total", "counter", "Blocks connected since startup", g_metrics.blocksConnected.load());
+    AppendMetric(out, "hydra_contract_txs_total", "counter", "Contract transactions executed in connected blocks", g_metrics.contractTxs.load());
+    AppendMetric(out, "hydra_evm_microseconds_total", "counter", "Contract execution time of connected blocks in microseconds", g_metrics.evmTime.load());
+
+    AppendMetric(out, "hydra_mempool_txs", "gauge", "Transactions in the mempool", g_metrics.mempoolTxs.load());
+    AppendMetric(out, "hydra_mempool_bytes", "gauge", "Virtual size of the mempool transactions", g_metrics.mempoolBytes.load());
+    AppendMetric(out, "hydra_mempool_usage_bytes", "gauge", "Memory usage of the mempool", g_metrics.mempoolUsage.load());
+
+    out += "# HELP hydra_mempool_accepts_total Mempool admission attempts\n# TYPE hydra_mempool_accepts_total counter\n";
+    for (int type = 0; type < MEMPOOL_TX_TYPES; type++) {
+        AppendLabeledMetric(out, "hydra_mempool_accepts_total", "type", MempoolTxTypeName(type), g_metrics.mempoolAccepts[type].load());
+    }
+    out += "# HELP hydra_mempool_accept_microseconds_total Time of the mempool admission stages in microseconds\n# TYPE hydra_mempool_accept_microseconds_total counter\n";
+    for (int type = 0; type < MEMPOOL_TX_TYPES; type++) {
+        for (int stage = 0; stage < MEMPOOL_STAGES; stage++) {
+            out += strprintf("hydra_mempool_accept_microseconds_total{type=\"%s\",stage=\"%s\"} %u\n", MempoolTxTypeName(type), MempoolAcceptStageName(stage), g_metrics.mempoolAcceptTime[type][stage].load());
+        }
+    }
+
+    AppendMetric(out, "hydra_validation_queue_callbacks", "gauge", "Validation notifications queued for all subscribers", g_metrics.validationQueueTotal.load());
+    AppendMetric(out, "hydra_validation_queue_depth", "gauge", "Validation notifications queued for the subscriber furthest behind", g_metrics.validationQueueDeepest.load());
+
+    static const char* const laneNames[CScheduler::PRIORITY_COUNT] = {"normal", "high"};
+    out += "# HELP hydra_scheduler_tasks_total Tasks run by the scheduler\n# TYPE hydra_scheduler_tasks_total counter\n";
+    for (int lane = 0; lane < CScheduler::PRIORITY_COUNT; lane++) {
+        AppendLabeledMetric(out, "hydra_scheduler_tasks_total", "lane", laneNames[lane], g_metrics.schedulerTasks[lane].load());
+    }
+    out += "# HELP hydra_scheduler_task_microseconds_total Run time of the scheduler tasks in microseconds\n# TYPE hydra_scheduler_task_microseconds_total counter\n";
+    for (int lane = 0; lane < CScheduler::PRIORITY_COUNT; lane++) {
+        AppendLabeledMetric(out, "hydra_scheduler_task_microseconds_total", "lane", laneNames[lane], g_metrics.schedulerRunTime[lane].load());
+    }
+    out += "# HELP hydra_scheduler_delay_microseconds_total Delay of the scheduler tasks past their scheduled time in microseconds\n# TYPE hydra_scheduler_delay_microseconds_total counter\n";
+    for (int lane = 0; lane < CScheduler::PRIORITY_COUNT; lane++) {
+        AppendLabeledMetric(out, "hydra_scheduler_delay_microseconds_total", "lane", laneNames[lane], g_metrics.schedulerDelay[lane].load());
+    }
+
+    AppendMetric(out, "hydra_stake_attempts_total", "counter", "Blocks the staker tried to sign", g_metrics.stakeAttempts.load());
+    AppendMetric(out, "hydra_stake_hits_total", "counter", "Staked blocks accepted", g_metrics.stakeHits.load());
+    AppendMetric(out, "hydra_kernel_checks_total", "counter", "Stake kernel hashes checked by the staker", g_metrics.kernelChecks.load());
+
+    out += "# HELP hydra_db_cache_bytes Memory usage of the database caches\n# TYPE hydra_db_cache_bytes gauge\n";
+    AppendLabeledMetric(out, "hydra_db_cache_bytes", "db", "coins", g_metrics.coinsCacheUsage.load());
+    AppendLabeledMetric(out, "hydra_db_cache_bytes", "db", "blocktree", g_metrics.blockTreeDBUsage.load());
+    AppendLabeledMetric(out, "hydra_db_cache_bytes", "db", "chainstate", g_metrics.chainstateDBUsage.load());
+    AppendLabeledMetric(out, "hydra_db_cache_bytes", "db", "receipts", g_metrics.receiptsDBUsage.load());
+
+    out += "# HELP hydra_peers Connected peers\n# TYPE hydra_peers gauge\n";
+    AppendLabeledMetric(out, "hydra_peers", "direction", "inbound", g_metrics.peersInbound.load());
+    AppendLabeledMetric(out, "hydra_peers", "direction", "outbound", g_metrics.peersOutbound.load());
+    out += "# HELP hydra_net_messages_total P2P messages\n# TYPE hydra_net_messages_total counter\n";
+    AppendLabeledMetric(out, "hydra_net_messages_total", "direction", "received", g_metrics.messagesReceived.load());
+    AppendLabeledMetric(out, "hydra_net_messages_total", "direction", "sent", g_metrics.messagesSent.load());
+    out += "# HELP hydra_net_bytes_total P2P traffic\n# TYPE hydra_net_bytes_total counter\n";
+    AppendLabeledMetric(out, "hydra_net_bytes_total", "direction", "received", g_metrics.bytesReceived.load());
+    AppendLabeledMetric(out, "hydra_net_bytes_total", "direction", "sent", g_metrics.bytesSent.load());
+    return out;
+}
+
+static bool HTTPReq_Metrics(HTTPRequest* req, const std::string&)
+{
+    if (req->GetRequestMethod() != HTTPRequest::GET) {
+        req->WriteReply(HTTP_BAD_METHOD, "Metrics are only served for GET requests");
+        return false;
+    }
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, MetricsToText());
+    return true;
+}
+
+void SampleMetrics(const CScheduler& scheduler)
+{
+    if (!fMetricsStarted)
+        return;
+    g_metrics.mempoolTxs = mempool.size();
+    g_metrics.mempoolBytes = mempool.GetTotalTxSize();
+    g_metrics.mempoolUsage = mempool.DynamicMemoryUsage();
+    g_metrics.validationQueueTotal = GetMainSignals().CallbacksPendingTotal();
+    g_metrics.validationQueueDeepest = GetMainSignals().CallbacksPending();
+    for (int lane = 0; lane < CScheduler::PRIORITY_COUNT; lane++) {
+        const CScheduler::LaneStats& stats = scheduler.getLaneStats((CScheduler::Priority)lane);
+        g_metrics.schedulerTasks[lane] = stats.nTasks.load();
+        g_metrics.schedulerRunTime[lane] = stats.nRunTime.load();
+        g_metrics.schedulerDelay[lane] = stats.nDelay.load();
+    }
+}
+
+void StartMetrics()
+{
+    RegisterHTTPHandler("/metrics", true, HTTPReq_Metrics, [](HTTPRequest*, const std::string&) { return HTTPWorkClass::LIGHT; });
+    fMetricsStarted = true;
+}
+
+void StopMetrics()
+{
+    if (!fMetricsStarted)
+        return;
+    fMetricsStarted = false;
+    UnregisterHTTPHandler("/metrics", true);
+}
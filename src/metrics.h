@@ -0,0 +1,78 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_METRICS_H
+#define BITCOIN_METRICS_H
+
+#include <scheduler.h>
+#include <validation.h>
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+/** Default for -metrics, serving the node metrics at /metrics on the RPC port */
+static const bool DEFAULT_METRICS_ENABLE = false;
+/** Interval in milliseconds the mempool metrics are sampled at */
+static const int64_t METRICS_SAMPLE_INTERVAL = 1000;
+
+/**
+ * Counters and gauges of the node internals, in the Prometheus text format at /metrics.
+ *
+ * They are set where the events happen, mostly on paths that already hold the
+ * lock of the value, so a scrape only reads atomics and takes no lock.
+ */
+struct NodeMetrics {
+    std::atomic<int> tipHeight{0};
+    //! GetTimeMicros of the last tip change
+    std::atomic<int64_t> tipTime{0};
+    std::atomic<uint64_t> blocksConnected{0};
+    std::atomic<uint64_t> contractTxs{0};
+    //! Contract execution time of the connected blocks in microseconds
+    std::atomic<uint64_t> evmTime{0};
+
+    std::atomic<uint64_t> mempoolTxs{0};
+    std::atomic<uint64_t> mempoolBytes{0};
+    std::atomic<uint64_t> mempoolUsage{0};
+    //! Admission attempts and the time of each admission stage in microseconds, by transaction type
+    std::atomic<uint64_t> mempoolAccepts[MEMPOOL_TX_TYPES] = {};
+    std::atomic<uint64_t> mempoolAcceptTime[MEMPOOL_TX_TYPES][MEMPOOL_STAGES] = {};
+    //! Validation notifications queued for all subscribers, and for the subscriber furthest behind
+    std::atomic<uint64_t> validationQueueTotal{0};
+    std::atomic<uint64_t> validationQueueDeepest{0};
+    //! Tasks run by the scheduler, their run time and their delay past the scheduled time in microseconds, by lane
+    std::atomic<uint64_t> schedulerTasks[CScheduler::PRIORITY_COUNT] = {};
+    std::atomic<uint64_t> schedulerRunTime[CScheduler::PRIORITY_COUNT] = {};
+    std::atomic<uint64_t> schedulerDelay[CScheduler::PRIORITY_COUNT] = {};
+
+    std::atomic<uint64_t> stakeAttempts{0};
+    std::atomic<uint64_t> stakeHits{0};
+    std::atomic<uint64_t> kernelChecks{0};
+
+    std::atomic<uint64_t> coinsCacheUsage{0};
+    std::atomic<uint64_t> blockTreeDBUsage{0};
+    std::atomic<uint64_t> chainstateDBUsage{0};
+    std::atomic<uint64_t> receiptsDBUsage{0};
+
+    std::atomic<uint64_t> peersInbound{0};
+    std::atomic<uint64_t> peersOutbound{0};
+    std::atomic<uint64_t> messagesReceived{0};
+    std::atomic<uint64_t> messagesSent{0};
+    std::atomic<uint64_t> bytesReceived{0};
+    std::atomic<uint64_t> bytesSent{0};
+};
+
+extern NodeMetrics g_metrics;
+
+/** The metrics in the Prometheus text exposition format */
+std::string MetricsToText();
+
+/** Register the /metrics handler. Precondition: the HTTP server has been initialized and not started */
+void StartMetrics();
+/** Update the metrics that are sampled instead of set where they change, run every METRICS_SAMPLE_INTERVAL */
+void SampleMetrics(const CScheduler& scheduler);
+/** Unregister the /metrics handler */
+void StopMetrics();
+
+#endif // BITCOIN_METRICS_H
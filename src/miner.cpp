@@ -8,12 +8,15 @@
 #include <amount.h>
 #include <chain.h>
 #include <chainparams.h>
+#include <checkqueue.h>
 #include <coins.h>
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/sha256.h>
 #include <hash.h>
+#include <metrics.h>
 #include <net.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
@@ -272,16 +275,14 @@ bool BlockAssembler::ExecuteCoinstakeContractCalls(CWallet& wallet, int64_t* pTo
     if (!exec.performByteCode()) {
         LogPrintf("ERROR: %s - Error performing byte code\n", __func__);
         //error, don't add contract
-        globalState->setRoot(oldHashStateRoot);
-        globalState->setRootUTXO(oldHashUTXORoot);
+        globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
         return false;
     }
 
     ByteCodeExecResult testExecResult;
     if(!exec.processingResults(testExecResult)){
         LogPrintf("ERROR: %s - Error processing results\n", __func__);
-        globalState->setRoot(oldHashStateRoot);
-        globalState->setRootUTXO(oldHashUTXORoot);
+        globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
         return false;
     }
 
@@ -294,8 +295,7 @@ bool BlockAssembler::ExecuteCoinstakeContractCalls(CWallet& wallet, int64_t* pTo
 
     if(hasExceptions){
         LogPrintf("ERROR: %s - exception raised during contract executions\n", __func__);
-        globalState->setRoot(oldHashStateRoot);
-        globalState->setRootUTXO(oldHashUTXORoot);
+        globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
         return false;
     }
 
@@ -418,7 +418,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     //////////////////////////////////////////////////////// qtum
     QtumDGP qtumDGP(globalState.get(), fGettingValuesDGP);
     globalSealEngine->setQtumSchedule(qtumDGP.getGasSchedule(nHeight, chainparams.GetConsensus(), chainparams.NetworkIDString()));
-    uint32_t blockSizeDGP = qtumDGP.getBlockSize(nHeight);
+    const CBlockDGPParams& dgpParams = GetBlockDGPParams(pindexPrev, nHeight);
+    uint32_t blockSizeDGP = dgpParams.blockSize;
     minGasPrice = qtumDGP.getMinGasPrice(nHeight);
     if(gArgs.IsArgSet("-staker-min-tx-gas-price")) {
         CAmount stakerMinGasPrice;
@@ -426,7 +427,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
             minGasPrice = std::max(minGasPrice, (uint64_t)stakerMinGasPrice);
         }
     }
-    hardBlockGasLimit = qtumDGP.getBlockGasLimit(nHeight);
+    hardBlockGasLimit = dgpParams.blockGasLimit;
     softBlockGasLimit = gArgs.GetArg("-staker-soft-block-gas-limit", hardBlockGasLimit);
     softBlockGasLimit = std::min(softBlockGasLimit, hardBlockGasLimit);
     txGasLimit = gArgs.GetArg("-staker-max-tx-gas-limit", softBlockGasLimit);
@@ -444,13 +445,8 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
 
-    Dgp dgp;
-    bool voteInProgress;
-    dgp.hasVoteInProgress(voteInProgress);
-    if(voteInProgress) {
-        uint64_t expiration;
-        dgp.getVoteBlockExpiration(expiration);
-        if (nHeight < expiration) {
+    if(dgpParams.voteInProgress) {
+        if (nHeight < dgpParams.voteExpiration) {
             // If there will be a DGP vote finishing, don't add transactions
             addPackageTxs(nPackagesSelected, nDescendantsUpdated, minGasPrice);
         }
@@ -464,8 +460,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if(fProofOfStake) {
         if(bceResult.contractAddresses.size() != bceResult.contractOwners.size())
         {
-            globalState->setRoot(oldHashStateRoot);
-            globalState->setRootUTXO(oldHashUTXORoot);
+            globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
             LogPrintf("ERROR: %s - Contract addresses and contract owners are with different count in the block\n", __func__);
             return nullptr;
         }
@@ -510,8 +505,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     if(fProofOfStake && hasCoinstakeCall) {
         if(!ExecuteCoinstakeContractCalls(*wallet, pTotalFees, txProofTime, setCoins, setSelectedCoins, setDelegateCoins)) {
-            globalState->setRoot(oldHashStateRoot);
-            globalState->setRootUTXO(oldHashUTXORoot);
+            globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
             LogPrintf("ERROR: %s - Execution of coinstake contract calls failed!\n");
             return nullptr;
         }
@@ -519,8 +513,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     pblock->hashStateRoot = uint256(h256Touint(dev::h256(globalState->rootHash())));
     pblock->hashUTXORoot = uint256(h256Touint(dev::h256(globalState->rootHashUTXO())));
-    globalState->setRoot(oldHashStateRoot);
-    globalState->setRootUTXO(oldHashUTXORoot);
+    globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
 
     CValidationState state;
     if (!fProofOfStake && !TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
@@ -788,6 +781,15 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     return true;
 }
 
+bool BlockAssembler::TestPackageGas(const CTxMemPool::setEntries& package) const
+{
+    uint64_t packageGas = 0;
+    for (CTxMemPool::txiter it : package) {
+        packageGas += it->GetGasLimit();
+    }
+    return packageGas == 0 || bceResult.usedGas + packageGas <= softBlockGasLimit;
+}
+
 bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64_t minGasPrice) {
     /*if (nTimeLimit != 0 && GetAdjustedTime() >= nTimeLimit - nBytecodeTimeBuffer) {
 		LogPrintf("FAIL BYTECODE BUFFER\n");
@@ -798,7 +800,18 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
         // Contract staking is disabled for the staker
         return false;
     }
-    
+
+    // Check the gas price and the gas limit kept for the tx when it entered the mempool
+    // before converting and executing it, they do not depend on the block state
+    if(iter->GetMinGasPrice() < (CAmount)minGasPrice){
+        LogPrintf("AttemptToAddContractToBlock(): The gas price is less than -staker-min-tx-gas-price for the contract tx %s\n", iter->GetTx().GetHash().ToString());
+        return false;
+    }
+    if(iter->GetGasLimit() > txGasLimit) {
+        LogPrintf("AttemptToAddContractToBlock(): The gas needed is bigger than -staker-max-tx-gas-limit for the contract tx %s\n", iter->GetTx().GetHash().ToString());
+        return false;
+    }
+
     dev::h256 oldHashStateRoot(globalState->rootHash());
     dev::h256 oldHashUTXORoot(globalState->rootHashUTXO());
     // operate on local vars first, then later apply to `this`
@@ -806,7 +819,7 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
     uint64_t nBlockSigOpsCost = this->nBlockSigOpsCost;
 
     unsigned int contractflags = GetContractScriptFlags(nHeight, chainparams.GetConsensus());
-    QtumTxConverter convert(iter->GetTx(), NULL, &pblock->vtx, contractflags);
+    QtumTxConverter convert(iter->GetTx(), NULL, &pblock->vtx, contractflags, iter->GetContractOutputs());
 
     ExtractQtumTX resultConverter;
     if(!convert.extractionQtumTransactions(resultConverter)){
@@ -844,24 +857,21 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
     ByteCodeExec exec(*pblock, qtumTransactions, hardBlockGasLimit, chainActive.Tip());
     if(!exec.performByteCode()){
         //error, don't add contract
-        globalState->setRoot(oldHashStateRoot);
-        globalState->setRootUTXO(oldHashUTXORoot);
+        globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
         LogPrintf("AttemptToAddContractToBlock(): Perform byte code fails for the contract tx %s\n", iter->GetTx().GetHash().ToString());
         return false;
     }
 
     ByteCodeExecResult testExecResult;
     if(!exec.processingResults(testExecResult)){
-        globalState->setRoot(oldHashStateRoot);
-        globalState->setRootUTXO(oldHashUTXORoot);
+        globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
         LogPrintf("AttemptToAddContractToBlock(): Processing results fails for the contract tx %s\n", iter->GetTx().GetHash().ToString());
         return false;
     }
 
     if(bceResult.usedGas + testExecResult.usedGas > softBlockGasLimit){
         // If this transaction could cause block gas limit to be exceeded, then don't add it
-        globalState->setRoot(oldHashStateRoot);
-        globalState->setRootUTXO(oldHashUTXORoot);
+        globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
         // Log if the contract is the only contract tx
         if(bceResult.usedGas == 0)
             LogPrintf("AttemptToAddContractToBlock(): The gas used is bigger than -staker-soft-block-gas-limit for the contract tx %s\n", iter->GetTx().GetHash().ToString());
@@ -872,9 +882,9 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
     nBlockWeight += iter->GetTxWeight();
     nBlockSigOpsCost += iter->GetSigOpCost();
     //apply value-transfer txs to local state
-    for (CTransaction &t : testExecResult.valueTransfers) {
-        nBlockWeight += GetTransactionWeight(t);
-        nBlockSigOpsCost += GetLegacySigOpCount(t);
+    for (const CTransactionRef& t : testExecResult.valueTransfers) {
+        nBlockWeight += GetTransactionWeight(*t);
+        nBlockSigOpsCost += GetLegacySigOpCount(*t);
     }
 
     int proofTx = pblock->IsProofOfStake() ? 1 : 0;
@@ -900,8 +910,7 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
     if (nBlockSigOpsCost * WITNESS_SCALE_FACTOR > (uint64_t)dgpMaxBlockSigOps ||
             nBlockWeight > dgpMaxBlockWeight) {
         //contract will not be added to block, so revert state to before we tried
-        globalState->setRoot(oldHashStateRoot);
-        globalState->setRootUTXO(oldHashUTXORoot);
+        globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
 		LogPrintf("FAIL GLOBAL STATE\n");
         return false;
     }
@@ -942,10 +951,10 @@ bool BlockAssembler::AttemptToAddContractToBlock(CTxMemPool::txiter iter, uint64
     nFees += iter->GetFee();
     inBlock.insert(iter);
 
-    for (CTransaction &t : bceResult.valueTransfers) {
-        pblock->vtx.emplace_back(MakeTransactionRef(std::move(t)));
-        this->nBlockWeight += GetTransactionWeight(t);
-        this->nBlockSigOpsCost += GetLegacySigOpCount(t);
+    for (const CTransactionRef& t : bceResult.valueTransfers) {
+        pblock->vtx.emplace_back(t);
+        this->nBlockWeight += GetTransactionWeight(*t);
+        this->nBlockSigOpsCost += GetLegacySigOpCount(*t);
         ++nBlockTx;
     }
     //calculate sigops from new refund/proof tx
@@ -1154,6 +1163,15 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             continue;
         }
 
+        // Skip the package before executing its contracts if their gas limits do not fit the block
+        if (!TestPackageGas(ancestors)) {
+            if (fUsingModified) {
+                mapModifiedTx.get<ancestor_score_or_gas_price>().erase(modit);
+                failedTx.insert(iter);
+            }
+            continue;
+        }
+
         if (!CheckTransactionLydraSpending(ancestors)) {
             if (fUsingModified) {
                 mapModifiedTx.get<ancestor_score_or_gas_price>().erase(modit);
@@ -1271,7 +1289,6 @@ public:
     };
     DelegationsStaker(CWallet *_pwallet):
         pwallet(_pwallet),
-        cacheHeight(0),
         type(StakerType::STAKER_NORMAL)
     {
         // Get white list
@@ -1348,54 +1365,36 @@ public:
 
     void Update(int32_t nHeight)
     {
-        if(pwallet->fUpdatedSuperStaker)
+        // Apply the delegations changed since the last update, get them all again when the changes
+        // are not known or keys were added that can make more delegations match
+        std::map<uint160, Delegation> changes;
+        size_t nKeys = pwallet->GetKeyStoreSize();
+        bool fChanges = DelegationIndex().GetDelegationChanges(pwallet->m_delegations_staker_version, changes) &&
+                pwallet->m_delegations_staker_keys == nKeys;
+        pwallet->m_delegations_staker_keys = nKeys;
+        if(fChanges)
         {
-            // Clear cache if updated
-            cacheHeight = 0;
-            cacheDelegationsStaker.clear();
-            pwallet->fUpdatedSuperStaker = false;
-        }
-
-        std::map<uint160, Delegation> delegations_staker;
-        int checkpointSpan = Params().GetConsensus().CheckpointSpan(nHeight);
-        if(nHeight <= checkpointSpan)
-        {
-            // Get delegations from events
-            std::vector<DelegationEvent> events;
-            qtumDelegations.FilterDelegationEvents(events, *this);
-            delegations_staker = qtumDelegations.DelegationsFromEvents(events);
-        }
-        else
-        {
-            // Update the cached delegations for the staker, older then the sync checkpoint (500 blocks)
-            int cpsHeight = nHeight - checkpointSpan;
-            if(cacheHeight < cpsHeight)
+            for(auto& item : changes)
             {
-                std::vector<DelegationEvent> events;
-                qtumDelegations.FilterDelegationEvents(events, *this, cacheHeight, cpsHeight);
-                qtumDelegations.UpdateDelegationsFromEvents(events, cacheDelegationsStaker);
-                cacheHeight = cpsHeight;
+                DelegationEvent event;
+                static_cast<Delegation&>(event.item) = item.second;
+                event.item.delegate = item.first;
+                event.type = DELEGATION_ADD;
+                if(!item.second.IsNull() && !Match(event))
+                    item.second = Delegation();
             }
-
-            // Update the wallet delegations
-            std::vector<DelegationEvent> events;
-            qtumDelegations.FilterDelegationEvents(events, *this, cacheHeight + 1);
-            delegations_staker = cacheDelegationsStaker;
-            qtumDelegations.UpdateDelegationsFromEvents(events, delegations_staker);
+            pwallet->updateDelegationsStakerChanges(changes);
+            return;
         }
-        pwallet->updateDelegationsStaker(delegations_staker);
-    }
 
-    void UpdateDelegationsAddress()
-    {
-        qtumDelegations.UpdateDelegationsAddress();
+        // Get the delegations for the staker from the delegations index
+        std::map<uint160, Delegation> delegations_staker;
+        DelegationIndex().GetDelegations(*this, delegations_staker);
+        pwallet->updateDelegationsStaker(delegations_staker);
     }
 
 private:
     CWallet *pwallet;
-    QtumDelegation qtumDelegations;
-    int32_t cacheHeight;
-    std::map<uint160, Delegation> cacheDelegationsStaker;
     std::vector<uint160> whiteList;
     std::vector<uint160> blackList;
     int type;
@@ -1419,33 +1418,8 @@ public:
     {
         if(fLogEvents)
         {
-            // When log events are enabled, search the log events to get complete list of my delegations
-            int checkpointSpan = Params().GetConsensus().CheckpointSpan(nHeight);
-            if(nHeight <= checkpointSpan)
-            {
-                // Get delegations from events
-                std::vector<DelegationEvent> events;
-                qtumDelegations.FilterDelegationEvents(events, *this);
-                pwallet->m_my_delegations = qtumDelegations.DelegationsFromEvents(events);
-            }
-            else
-            {
-                // Update the cached delegations for the staker, older then the sync checkpoint (500 blocks)
-                int cpsHeight = nHeight - checkpointSpan;
-                if(cacheHeight < cpsHeight)
-                {
-                    std::vector<DelegationEvent> events;
-                    qtumDelegations.FilterDelegationEvents(events, *this, cacheHeight, cpsHeight);
-                    qtumDelegations.UpdateDelegationsFromEvents(events, cacheMyDelegations);
-                    cacheHeight = cpsHeight;
-                }
-
-                // Update the wallet delegations
-                std::vector<DelegationEvent> events;
-                qtumDelegations.FilterDelegationEvents(events, *this, cacheHeight + 1);
-                pwallet->m_my_delegations = cacheMyDelegations;
-                qtumDelegations.UpdateDelegationsFromEvents(events, pwallet->m_my_delegations);
-            }
+            // When log events are enabled, get the complete list of my delegations from the delegations index
+            DelegationIndex().GetDelegations(*this, pwallet->m_my_delegations);
         }
         else
         {
@@ -1588,6 +1562,25 @@ bool SleepStaker(CWallet *pwallet, u_int64_t milliseconds)
     return !pwallet->IsStakeClosing();
 }
 
+bool SleepStakerUntilNewTip(CWallet *pwallet, u_int64_t milliseconds)
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{milliseconds};
+
+    // The best block is updated and notified as soon as the tip changes
+    WAIT_LOCK(g_best_block_mutex, lock);
+    const uint256 hashTip = g_best_block;
+    while(!pwallet->IsStakeClosing() && g_best_block == hashTip)
+    {
+        // Wake up at least every second to check if the staker is closing
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if(now >= deadline)
+            break;
+        g_best_block_cv.wait_until(lock, std::min(deadline, now + std::chrono::seconds{1}));
+    }
+
+    return !pwallet->IsStakeClosing();
+}
+
 /**
  * @brief The IStakeMiner class Miner interface
  */
@@ -1626,6 +1619,76 @@ public:
     bool delegate = false;
 };
 
+/**
+ * Kernel search over a range of the staking coins for a set of block times, run by the staker thread pool.
+ * Every check writes to its own result buffer, the staker merges the buffers once all checks are done.
+ */
+class CStakeKernelCheck
+{
+private:
+    CBlockIndex* pindexPrev = nullptr;
+    unsigned int nBits = 0;
+    const std::vector<uint32_t>* blockTimes = nullptr;
+    const std::vector<COutPoint>* prevouts = nullptr;
+    const std::vector<CStakeCache>* stakes = nullptr;
+    size_t delegateSize = 0;
+    size_t from = 0;
+    size_t to = 0;
+    std::vector<std::pair<uint256, SolveItem>>* result = nullptr;
+
+public:
+    CStakeKernelCheck() {}
+    CStakeKernelCheck(CBlockIndex* _pindexPrev, unsigned int _nBits, const std::vector<uint32_t>* _blockTimes,
+                      const std::vector<COutPoint>* _prevouts, const std::vector<CStakeCache>* _stakes,
+                      size_t _delegateSize, size_t _from, size_t _to, std::vector<std::pair<uint256, SolveItem>>* _result):
+        pindexPrev(_pindexPrev), nBits(_nBits), blockTimes(_blockTimes), prevouts(_prevouts), stakes(_stakes),
+        delegateSize(_delegateSize), from(_from), to(_to), result(_result)
+    {}
+
+    bool operator()()
+    {
+        if(SHA256DManyIsBatched())
+        {
+            // Fill the lanes of the multi-way SHA256 with the kernels of all the coins of the range
+            std::vector<std::pair<size_t, std::pair<uint32_t, uint256>>> solved;
+            CheckKernelCache(pindexPrev, nBits, *blockTimes, *prevouts, *stakes, from, to, solved);
+            for(const auto& item : solved)
+            {
+                result->push_back(std::make_pair(item.second.second, SolveItem((*prevouts)[item.first], item.second.first, item.first < delegateSize)));
+            }
+        }
+        else
+        {
+            std::vector<std::pair<uint32_t, uint256>> solved;
+            for(size_t i = from; i < to; i++)
+            {
+                const COutPoint &prevoutStake = (*prevouts)[i];
+                solved.clear();
+                CheckKernelCache(pindexPrev, nBits, *blockTimes, prevoutStake, (*stakes)[i], solved);
+                for(const auto& item : solved)
+                {
+                    result->push_back(std::make_pair(item.second, SolveItem(prevoutStake, item.first, i < delegateSize)));
+                }
+            }
+        }
+        g_metrics.kernelChecks += (to - from) * blockTimes->size();
+        return true;
+    }
+
+    void swap(CStakeKernelCheck& check)
+    {
+        std::swap(pindexPrev, check.pindexPrev);
+        std::swap(nBits, check.nBits);
+        std::swap(blockTimes, check.blockTimes);
+        std::swap(prevouts, check.prevouts);
+        std::swap(stakes, check.stakes);
+        std::swap(delegateSize, check.delegateSize);
+        std::swap(from, check.from);
+        std::swap(to, check.to);
+        std::swap(result, check.result);
+    }
+};
+
 class StakeMinerPriv
 {
 public:
@@ -1643,7 +1706,7 @@ public:
     bool fError = false;
     int numThreads = 1;
     boost::thread_group threads;
-    mutable RecursiveMutex cs_worker;
+    CCheckQueue<CStakeKernelCheck> kernelQueue{128};
 
 public:
     DelegationsStaker delegationsStaker;
@@ -1663,11 +1726,13 @@ public:
     std::vector<COutPoint> setDelegateCoins;
     std::vector<COutPoint> prevouts;
     std::map<uint32_t, bool> mapSolveBlockTime;
-    std::multimap<uint256, SolveItem> mapSolvedBlock;
     std::map<uint32_t, std::vector<COutPoint>> mapSolveSelectedCoins;
     std::map<uint32_t, std::vector<COutPoint>> mapSolveDelegateCoins;
     uint32_t beginningTime = 0;
     uint32_t endingTime = 0;
+    uint32_t lastSolvedTime = 0;
+    bool fTipScanned = false;
+    int64_t nScannedTipTime = 0;
     uint32_t waitBestHeaderAttempts = 0;
 
     std::shared_ptr<CBlock> pblock;
@@ -1704,6 +1769,21 @@ public:
             waitBestHeaderAttempts = maxWaitForBestHeader / nMinerWaitBestBlockHeader;
         }
         if(pwallet) numThreads = pwallet->m_num_threads;
+
+        // The staker thread joins the workers while waiting for a kernel search
+        for(int i = 0; i < numThreads - 1; i++)
+        {
+            threads.create_thread([this, threadName]{
+                RenameThread((threadName + "-kernel").c_str());
+                kernelQueue.Thread();
+            });
+        }
+    }
+
+    ~StakeMinerPriv()
+    {
+        threads.interrupt_all();
+        threads.join_all();
     }
 
     void clearCache()
@@ -1721,11 +1801,12 @@ public:
         setDelegateCoins.clear();
         prevouts.clear();
         mapSolveBlockTime.clear();
-        mapSolvedBlock.clear();
         mapSolveSelectedCoins.clear();
         mapSolveDelegateCoins.clear();
         beginningTime = 0;
         endingTime = 0;
+        lastSolvedTime = 0;
+        fTipScanned = false;
 
         pblock.reset();
         pblocktemplate.reset();
@@ -1753,7 +1834,6 @@ public:
             if (d->fDelegationsContract) {
                 if (chainActive.Height() >= Params().GetConsensus().nDelegationsGasFixHeight)
                 {
-                    d->delegationsStaker.UpdateDelegationsAddress();
                     d->myDelegations.UpdateDelegationsAddress();
                 }
             }
@@ -1771,6 +1851,10 @@ public:
                 d->beginningTime = GetAdjustedTime();
                 d->beginningTime &= ~d->stakeTimestampMask;
                 d->endingTime = d->beginningTime + nMaxStakeLookahead;
+                if(d->lastSolvedTime != 0 && d->beginningTime > d->lastSolvedTime + d->stakeTimestampMask+1)
+                {
+                    d->pwallet->m_staker_stats.nMissedSlots += (d->beginningTime - d->lastSolvedTime) / (d->stakeTimestampMask+1) - 1;
+                }
 
                 for(uint32_t blockTime = d->beginningTime; blockTime < d->endingTime; blockTime += d->stakeTimestampMask+1)
                 {
@@ -1793,8 +1877,8 @@ public:
                 }
             }
 
-            // Miner sleep before the next try
-            Sleep(nMinerSleep);
+            // Miner sleep before the next try, a new tip starts the next try at once
+            SleepUntilNewTip(nMinerSleep);
         }
     }
 
@@ -1818,14 +1902,19 @@ protected:
         return SleepStaker(d->pwallet, milliseconds);
     }
 
+    bool SleepUntilNewTip(u_int64_t milliseconds)
+    {
+        return SleepStakerUntilNewTip(d->pwallet, milliseconds);
+    }
+
     bool IsStale(std::shared_ptr<CBlock> pblock)
     {
         if(d->pwallet->IsStakeClosing())
             return false;
 
-        auto locked_chain = d->pwallet->chain().lock();
-        CBlockIndex* tip = chainActive.Tip();
-        return tip != d->pindexPrev || tip->GetBlockHash() != pblock->hashPrevBlock;
+        // Checked while searching for a kernel, read the tip without locking the chain
+        std::shared_ptr<const TipSnapshot> tip = d->pwallet->chain().getTipSnapshot();
+        return !tip || !d->pindexPrev || tip->hash != d->pindexPrev->GetBlockHash() || tip->hash != pblock->hashPrevBlock;
     }
 
     bool IsReady()
@@ -1843,7 +1932,7 @@ protected:
         blokTime &= ~d->stakeTimestampMask;
         if(!IsCachedDataOld() && d->endingTime >= blokTime)
         {
-            Sleep(100);
+            SleepUntilNewTip(100);
             return false;
         }
 
@@ -1891,8 +1980,8 @@ protected:
     {
         if(d->pwallet->IsStakeClosing()) return false;
         if(d->pindexPrev == 0 || d->forceUpdate) return true;
-        auto locked_chain = d->pwallet->chain().lock();
-        return chainActive.Tip() != d->pindexPrev;
+        std::shared_ptr<const TipSnapshot> tip = d->pwallet->chain().getTipSnapshot();
+        return !tip || tip->hash != d->pindexPrev->GetBlockHash();
     }
 
     bool WaitBestHeader()
@@ -1993,8 +2082,14 @@ protected:
     {
         if(IsCachedDataOld())
         {
+            int64_t nStart = GetTimeMicros();
             if(!UpdateData())
                 return false;
+            int64_t nTime = GetTimeMicros() - nStart;
+            StakerStats& stats = d->pwallet->m_staker_stats;
+            stats.nUpdates++;
+            stats.nUpdateTime += nTime;
+            stats.nLastUpdateTime = nTime;
         }
 
         return !d->pwallet->IsStakeClosing();
@@ -2014,56 +2109,83 @@ protected:
         if(searchInterval > 0) d->pwallet->m_last_coin_stake_search_interval = searchInterval;
     }
 
-    void SloveBlock(uint32_t blockTime, size_t delegateSize, size_t from, size_t to)
+    void SloveBlock(const uint32_t& blockTime)
     {
-        std::multimap<uint256, SolveItem> tmpSolvedBlock;
-        for(size_t i = from; i < to; i++)
+        // Init variables
+        size_t listSize = d->prevouts.size();
+        size_t delegateSize = d->setDelegateCoins.size();
+
+        // Search the next timeslots in the same pass over the coins
+        std::vector<uint32_t> blockTimes;
+        for(uint32_t nTime = blockTime; nTime < d->endingTime && blockTimes.size() < (size_t)MAX_STAKE_SOLVE_SLOTS; nTime += d->stakeTimestampMask+1)
         {
-            const COutPoint &prevoutStake = d->prevouts[i];
-            uint256 hashProofOfStake;
-            if (CheckKernelCache(d->pindexPrev, d->pblock->nBits, blockTime, prevoutStake, d->pwallet->minerStakeCache, hashProofOfStake))
+            if(d->mapSolveBlockTime.find(nTime) == d->mapSolveBlockTime.end())
             {
-                bool delegate = i < delegateSize;
-                tmpSolvedBlock.insert(std::make_pair(hashProofOfStake, SolveItem(prevoutStake, blockTime, delegate)));
+                blockTimes.push_back(nTime);
+                d->mapSolveBlockTime[nTime] = false;
             }
         }
-
-        if(tmpSolvedBlock.size() > 0)
+        if(blockTimes.empty())
         {
-            LOCK(d->cs_worker);
-            d->mapSolveBlockTime[blockTime] = true;
-            d->mapSolvedBlock.insert(tmpSolvedBlock.begin(), tmpSolvedBlock.end());
+            blockTimes.push_back(blockTime);
+            d->mapSolveBlockTime[blockTime] = false;
         }
-    }
-
-    void SloveBlock(const uint32_t& blockTime)
-    {
-        // Init variables
-        size_t listSize = d->prevouts.size();
-        size_t delegateSize = d->setDelegateCoins.size();
 
         // Solve block
-        int numThreads = std::min(d->numThreads, (int)listSize);
-        if(listSize < 1000 || numThreads < 2)
+        StakerStats& stats = d->pwallet->m_staker_stats;
+        int64_t nStart = GetTimeMicros();
+        if(!d->fTipScanned)
+        {
+            d->fTipScanned = true;
+            // Refreshes without a tip change are not counted
+            int64_t nTipTime = g_metrics.tipTime;
+            if(nTipTime != 0 && nTipTime != d->nScannedTipTime && nStart >= nTipTime)
+            {
+                d->nScannedTipTime = nTipTime;
+                stats.nTipScans++;
+                stats.nTipDelayTime += nStart - nTipTime;
+                stats.nLastTipDelay = nStart - nTipTime;
+            }
+        }
+        size_t numChecks = 1;
+        if(listSize >= 1000 && d->numThreads > 1)
         {
-            SloveBlock(blockTime, delegateSize, 0, listSize);
+            // A few checks per thread keep the workers busy until the end
+            numChecks = std::min((size_t)d->numThreads * 4, listSize / 250);
+        }
+        std::vector<std::vector<std::pair<uint256, SolveItem>>> results(numChecks);
+        if(numChecks == 1)
+        {
+            CStakeKernelCheck(d->pindexPrev, d->pblock->nBits, &blockTimes, &d->prevouts, &d->pwallet->minerStakeTable, delegateSize, 0, listSize, &results[0])();
         }
         else
         {
-            size_t chunk = listSize / numThreads;
-            for(int i = 0; i < numThreads; i++)
+            CCheckQueueControl<CStakeKernelCheck> control(&d->kernelQueue);
+            std::vector<CStakeKernelCheck> vChecks;
+            size_t chunk = listSize / numChecks;
+            for(size_t i = 0; i < numChecks; i++)
             {
                 size_t from = i * chunk;
-                size_t to = i == (numThreads -1) ? listSize : from + chunk;
-                d->threads.create_thread([this, blockTime, delegateSize, from, to]{SloveBlock(blockTime, delegateSize, from, to);});
+                size_t to = i == (numChecks -1) ? listSize : from + chunk;
+                vChecks.emplace_back(d->pindexPrev, d->pblock->nBits, &blockTimes, &d->prevouts, &d->pwallet->minerStakeTable, delegateSize, from, to, &results[i]);
             }
-            d->threads.join_all();
+            control.Add(vChecks);
+            control.Wait();
         }
+        stats.nKernelChecks += listSize * blockTimes.size();
+        stats.nKernelTime += GetTimeMicros() - nStart;
+        d->lastSolvedTime = std::max(d->lastSolvedTime, blockTimes.back());
 
-        // Populate the list with the potential solwed blocks
-        for (auto it = d->mapSolvedBlock.begin(); it != d->mapSolvedBlock.end(); ++it)
+        // Populate the list with the potential solved blocks, ordered by proof of stake hash
+        std::multimap<uint256, SolveItem> mapSolvedBlock;
+        for(const auto& result : results)
+        {
+            mapSolvedBlock.insert(result.begin(), result.end());
+        }
+        for (auto it = mapSolvedBlock.begin(); it != mapSolvedBlock.end(); ++it)
         {
             const SolveItem& item = (*it).second;
+            d->mapSolveBlockTime[item.blockTime] = true;
             if(item.delegate)
             {
                 d->mapSolveDelegateCoins[item.blockTime].push_back(item.prevoutStake);
@@ -2080,7 +2202,6 @@ protected:
         d->pblock->nTime = blockTime;
         if(d->mapSolveBlockTime.find(blockTime) == d->mapSolveBlockTime.end())
         {
-            d->mapSolveBlockTime[blockTime] = false;
             SloveBlock(blockTime);
         }
 
@@ -2103,6 +2224,7 @@ protected:
             return false;
 
         // Create a block that's properly populated with transactions
+        int64_t nStart = GetTimeMicros();
         d->pblocktemplatefilled = std::unique_ptr<CBlockTemplate>(
                 BlockAssembler(Params(), d->pwallet).CreateNewBlock(d->pblock->vtx[1]->vout[1].scriptPubKey, true, true, &(d->nTotalFees),
                                                         blockTime, FutureDrift(GetAdjustedTime(), d->nHeight, d->consensusParams) - nStakeTimeBuffer,
@@ -2111,6 +2233,11 @@ protected:
             d->fError = true;
             return false;
         }
+        int64_t nTime = GetTimeMicros() - nStart;
+        StakerStats& stats = d->pwallet->m_staker_stats;
+        stats.nTemplates++;
+        stats.nTemplateTime += nTime;
+        stats.nLastTemplateTime = nTime;
 
         if (IsStale(d->pblock)) {
             //another block was received while building ours, scrap progress
@@ -2128,8 +2255,17 @@ protected:
     {
         // Try to sign the block once at specific time with the same cached data
         d->mapSolveBlockTime[blockTime] = false;
+        g_metrics.stakeAttempts++;
+
+        int64_t nStart = GetTimeMicros();
+        bool fSigned = SignBlock(d->pblockfilled, *(d->pwallet), d->nTotalFees, blockTime, d->setCoins, d->mapSolveSelectedCoins[blockTime], d->mapSolveDelegateCoins[blockTime], true);
+        int64_t nTime = GetTimeMicros() - nStart;
+        StakerStats& stats = d->pwallet->m_staker_stats;
+        stats.nSignatures++;
+        stats.nSignTime += nTime;
+        stats.nLastSignTime = nTime;
 
-        if (SignBlock(d->pblockfilled, *(d->pwallet), d->nTotalFees, blockTime, d->setCoins, d->mapSolveSelectedCoins[blockTime], d->mapSolveDelegateCoins[blockTime], true)) {
+        if (fSigned) {
             // Should always reach here unless we spent too much time processing transactions and the timestamp is now invalid
             // CheckStake also does CheckBlock and AcceptBlock to propogate it to the network
             bool validBlock = false;
@@ -2164,6 +2300,8 @@ protected:
             if(validBlock) {
                 if(!CheckStake(d->pblockfilled, *(d->pwallet)))
                     d->forceUpdate = true;
+                else
+                    g_metrics.stakeHits++;
                 // Update the search time when new valid block is created, needed for status bar icon
                 d->pwallet->m_last_coin_stake_search_time = d->pblockfilled->GetBlockTime();
             }
@@ -2183,11 +2321,10 @@ IStakeMiner *createMiner()
 
 void ThreadStakeMiner(CWallet *pwallet, CConnman* connman)
 {
-    IStakeMiner* miner = createMiner();
+    // The miner owns the kernel search threads, release it also when the thread is interrupted
+    std::unique_ptr<IStakeMiner> miner(createMiner());
     miner->Init(pwallet, connman);
     miner->Run();
-    delete miner;
-    miner = 0;
 }
 
 void StakeQtums(bool fStake, CWallet *pwallet, CConnman* connman, boost::thread_group*& stakeThread)
@@ -2230,9 +2367,7 @@ void RefreshDelegates(CWallet *pwallet, bool refreshMyDelegates, bool refreshSta
 
             if(refreshStakerDelegates)
             {
-                bool fUpdatedSuperStaker = pwallet->fUpdatedSuperStaker;
                 delegationsStaker.Update(nHeight);
-                pwallet->fUpdatedSuperStaker = fUpdatedSuperStaker;
             }
         }
     }
@@ -38,6 +38,9 @@ static const bool DEFAULT_SUPER_STAKE = false;
 //Reduce this to reduce computational waste for stakers, increase this to increase the amount of time available to construct full blocks
 static const int32_t MAX_STAKE_LOOKAHEAD = 16 * 3;
 
+//How many of the look ahead timeslots the staker searches for a kernel in one pass over its coins
+static const int32_t MAX_STAKE_SOLVE_SLOTS = 4;
+
 //Will not add any more contracts when GetAdjustedTime() >= nTimeLimit-BYTECODE_TIME_BUFFER
 //This does not affect non-contract transactions
 static const int32_t BYTECODE_TIME_BUFFER = 6;
@@ -64,6 +67,9 @@ static const int32_t DEFAULT_MAX_STAKER_WAIT_FOR_BEST_BLOCK_HEADER = 4000;
 //How much time to spend trying to process transactions when using the generate RPC call
 static const int32_t POW_MINER_MAX_TIME = 60;
 
+//Fees of new mempool transactions that make getblocktemplate assemble a new template and wake its long polls
+static const CAmount DEFAULT_BLOCK_TEMPLATE_FEE_INCREASE = COIN / 100;
+
 struct CBlockTemplate
 {
     CBlock block;
@@ -334,6 +340,8 @@ private:
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries& package);
+    /** Test if the gas limits of the contract txs in a package fit the gas left in the block */
+    bool TestPackageGas(const CTxMemPool::setEntries& package) const;
     /** Return true if given transaction from mapTx has already been evaluated,
       * or if the transaction's cached data in mapTx is incorrect. */
     bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
@@ -15,6 +15,7 @@
 #include <consensus/consensus.h>
 #include <crypto/common.h>
 #include <crypto/sha256.h>
+#include <metrics.h>
 #include <primitives/transaction.h>
 #include <netbase.h>
 #include <scheduler.h>
@@ -25,12 +26,17 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -70,6 +76,9 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+// Maximum number of queued buffers passed to one gathered send
+static const size_t MAX_SEND_IOVECS = 64;
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -515,6 +524,10 @@ void CNode::copyStats(CNodeStats &stats)
     }
     X(fInbound);
     X(m_manual_connection);
+    {
+        LOCK(cs_inventory);
+        stats.m_tx_reconciliation = m_tx_reconciliation != nullptr;
+    }
     X(nStartingHeight);
     {
         LOCK(cs_vSend);
@@ -694,26 +707,50 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert(it->size() > pnode->nSendOffset);
+        size_t nRequested = 0;
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            nRequested = it->size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(it->data()) + pnode->nSendOffset, nRequested, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Hand the message headers and payloads to the kernel in one call instead of one send per buffer
+            struct iovec iov[MAX_SEND_IOVECS];
+            size_t nIov = 0;
+            for (auto itIov = it; itIov != pnode->vSendMsg.end() && nIov < MAX_SEND_IOVECS; itIov++, nIov++) {
+                size_t nOffset = nIov == 0 ? pnode->nSendOffset : 0;
+                iov[nIov].iov_base = const_cast<unsigned char*>(itIov->data()) + nOffset;
+                iov[nIov].iov_len = itIov->size() - nOffset;
+                nRequested += iov[nIov].iov_len;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nIov;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            size_t nRemaining = nBytes;
+            while (nRemaining > 0) {
+                size_t nLeft = it->size() - pnode->nSendOffset;
+                if (nRemaining < nLeft) {
+                    pnode->nSendOffset += nRemaining;
+                    break;
+                }
+                nRemaining -= nLeft;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= it->size();
                 it++;
-            } else {
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nRequested) {
                 // could not send full message; stop sending more
                 break;
             }
@@ -1039,10 +1076,17 @@ void CConnman::DisconnectNodes()
 void CConnman::NotifyNumConnectionsChanged()
 {
     size_t vNodesSize;
+    size_t nInbound = 0;
     {
         LOCK(cs_vNodes);
         vNodesSize = vNodes.size();
+        for (const CNode* pnode : vNodes) {
+            if (pnode->fInbound)
+                nInbound++;
+        }
     }
+    g_metrics.peersInbound = nInbound;
+    g_metrics.peersOutbound = vNodesSize - nInbound;
     if(vNodesSize != nPrevNodeCount) {
         nPrevNodeCount = vNodesSize;
         if(clientInterface)
@@ -1083,10 +1127,11 @@ void CConnman::InactivityCheck(CNode *pnode)
     }
 }
 
-bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set, std::map<SOCKET, NodeId> *socket_nodes)
 {
     for (const ListenSocket& hListenSocket : vhListenSocket) {
         recv_set.insert(hListenSocket.socket);
+        if (socket_nodes) (*socket_nodes)[hListenSocket.socket] = -1;
     }
 
     {
@@ -1116,6 +1161,7 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
                 continue;
 
             error_set.insert(pnode->hSocket);
+            if (socket_nodes) (*socket_nodes)[pnode->hSocket] = pnode->GetId();
             if (select_send) {
                 send_set.insert(pnode->hSocket);
                 continue;
@@ -1129,7 +1175,75 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
     return !recv_set.empty() || !send_set.empty() || !error_set.empty();
 }
 
-#ifdef USE_POLL
+#ifdef USE_EPOLL
+void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    std::map<SOCKET, NodeId> socket_nodes;
+    if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set, &socket_nodes)) {
+        interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    if (m_epoll_fd == -1) {
+        m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_fd == -1) {
+            LogPrintf("epoll_create1 failed with error %s\n", NetworkErrorString(errno));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+            return;
+        }
+    }
+
+    // EPOLLERR and EPOLLHUP are always reported, the error set needs no event of its own
+    std::map<SOCKET, uint32_t> events;
+    for (SOCKET socket_id : error_select_set) events[socket_id] = 0;
+    for (SOCKET socket_id : recv_select_set) events[socket_id] |= EPOLLIN;
+    for (SOCKET socket_id : send_select_set) events[socket_id] |= EPOLLOUT;
+
+    // The sockets stay registered across the iterations, only the changes are passed to the kernel.
+    // A closed socket leaves the epoll set with its last descriptor, so a registration made for
+    // another node is stale even if the descriptor number was reused.
+    for (auto it = m_epoll_events.begin(); it != m_epoll_events.end();) {
+        auto itNode = socket_nodes.find(it->first);
+        if (itNode == socket_nodes.end() || itNode->second != it->second.first) {
+            if (itNode == socket_nodes.end())
+                epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, it->first, nullptr);
+            it = m_epoll_events.erase(it);
+        } else {
+            it++;
+        }
+    }
+    for (const auto& event : events) {
+        auto itRegistered = m_epoll_events.find(event.first);
+        if (itRegistered != m_epoll_events.end() && itRegistered->second.second == event.second)
+            continue;
+        struct epoll_event ev = {};
+        ev.events = event.second;
+        ev.data.fd = event.first;
+        int op = itRegistered != m_epoll_events.end() ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(m_epoll_fd, op, event.first, &ev) != 0) {
+            // The kernel view can differ from ours when a descriptor was closed and reused
+            op = op == EPOLL_CTL_ADD ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+            if (epoll_ctl(m_epoll_fd, op, event.first, &ev) != 0)
+                continue;
+        }
+        m_epoll_events[event.first] = std::make_pair(socket_nodes[event.first], event.second);
+    }
+
+    std::vector<struct epoll_event> vevents(std::max<size_t>(m_epoll_events.size(), 1));
+    int nEvents = epoll_wait(m_epoll_fd, vevents.data(), vevents.size(), SELECT_TIMEOUT_MILLISECONDS);
+    if (nEvents < 0) return;
+
+    if (interruptNet) return;
+
+    for (int i = 0; i < nEvents; i++) {
+        SOCKET socket_id = vevents[i].data.fd;
+        if (vevents[i].events & EPOLLIN)              recv_set.insert(socket_id);
+        if (vevents[i].events & EPOLLOUT)             send_set.insert(socket_id);
+        if (vevents[i].events & (EPOLLERR|EPOLLHUP))  error_set.insert(socket_id);
+    }
+}
+#elif defined(USE_POLL)
 void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
@@ -2353,6 +2467,13 @@ void CConnman::Stop()
     vNodes.clear();
     vNodesDisconnected.clear();
     vhListenSocket.clear();
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+    m_epoll_events.clear();
+#endif
     semOutbound.reset();
     semAddnode.reset();
 }
@@ -2493,12 +2614,14 @@ void CConnman::RecordBytesRecv(uint64_t bytes)
 {
     LOCK(cs_totalBytesRecv);
     nTotalBytesRecv += bytes;
+    g_metrics.bytesReceived += bytes;
 }
 
 void CConnman::RecordBytesSent(uint64_t bytes)
 {
     LOCK(cs_totalBytesSent);
     nTotalBytesSent += bytes;
+    g_metrics.bytesSent += bytes;
 
     uint64_t now = GetTime();
     if (nMaxOutboundCycleStartTime + nMaxOutboundTimeframe < now)
@@ -2694,6 +2817,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     size_t nMessageSize = msg.data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
+    g_metrics.messagesSent++;
 
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
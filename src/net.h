@@ -22,6 +22,7 @@
 #include <sync.h>
 #include <uint256.h>
 #include <threadinterrupt.h>
+#include <txreconciliation.h>
 
 #include <atomic>
 #include <deque>
@@ -336,7 +337,7 @@ private:
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode *pnode);
-    bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+    bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set, std::map<SOCKET, NodeId> *socket_nodes = nullptr);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketHandler();
     void ThreadSocketHandler();
@@ -430,6 +431,13 @@ private:
 
     CThreadInterrupt interruptNet;
 
+#ifdef USE_EPOLL
+    /** epoll instance of the socket handler */
+    int m_epoll_fd{-1};
+    /** Events each socket is registered for, with the node that owned the socket then (-1 for the listen sockets) */
+    std::map<SOCKET, std::pair<NodeId, uint32_t>> m_epoll_events;
+#endif
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
@@ -566,6 +574,7 @@ public:
     double dPingWait;
     double dMinPing;
     CAmount minFeeFilter;
+    bool m_tx_reconciliation;
     // Our address, as reported by the peer
     std::string addrLocal;
     // Address of this peer
@@ -722,6 +731,10 @@ public:
     std::vector<uint256> vBlockHashesToAnnounce GUARDED_BY(cs_inventory);
     // Used for BIP35 mempool sending
     bool fSendMempool GUARDED_BY(cs_inventory){false};
+    // Our salt of the short ids of reconciliation, 0 until we sent sendrecon
+    uint64_t m_recon_salt GUARDED_BY(cs_inventory){0};
+    // Transactions reconciled with the peer rather than announced, once both sides sent sendrecon
+    std::unique_ptr<TxReconciliationState> m_tx_reconciliation GUARDED_BY(cs_inventory);
 
     // Last time a "MEMPOOL" request was serviced.
     std::atomic<int64_t> timeLastMempoolReq{0};
@@ -844,6 +857,9 @@ public:
         {
             LOCK(cs_inventory);
             filterInventoryKnown.insert(inv.hash);
+            if (m_tx_reconciliation) {
+                m_tx_reconciliation->m_local_set.erase(inv.hash);
+            }
         }
     }
 
@@ -852,7 +868,11 @@ public:
         LOCK(cs_inventory);
         if (inv.type == MSG_TX) {
             if (!filterInventoryKnown.contains(inv.hash)) {
-                setInventoryTxToSend.insert(inv.hash);
+                if (m_tx_reconciliation && m_tx_reconciliation->ShouldReconcile(inv.hash, fInbound)) {
+                    m_tx_reconciliation->m_local_set.insert(inv.hash);
+                } else {
+                    setInventoryTxToSend.insert(inv.hash);
+                }
             }
         } else if (inv.type == MSG_BLOCK) {
             vInventoryBlockToSend.push_back(inv.hash);
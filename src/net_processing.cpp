@@ -12,8 +12,10 @@
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
+#include <memusage.h>
 #include <validation.h>
 #include <merkleblock.h>
+#include <metrics.h>
 #include <netmessagemaker.h>
 #include <netbase.h>
 #include <policy/fees.h>
@@ -25,6 +27,7 @@
 #include <scheduler.h>
 #include <tinyformat.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
 #include <ui_interface.h>
 #include <util/system.h>
 #include <util/moneystr.h>
@@ -46,6 +49,10 @@
 static constexpr int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 /** Minimum time between orphan transactions expire time checks in seconds */
 static constexpr int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/** Expiration time for orphan blocks in seconds */
+static constexpr int64_t ORPHAN_BLOCK_EXPIRE_TIME = 20 * 60;
+/** Share of -maxorphanblocksmib that the orphan blocks of a single peer may use, in percent */
+static constexpr size_t ORPHAN_BLOCKS_PEER_SHARE = 25;
 /** Headers download timeout expressed in microseconds
  *  Timeout = base + per_header * (expected number of headers) */
 static constexpr int64_t HEADERS_DOWNLOAD_TIMEOUT_BASE = 15 * 60 * 1000000; // 15 minutes
@@ -88,11 +95,17 @@ struct COrphanBlock {
     uint256 hashPrev;
     std::pair<COutPoint, unsigned int> stake;
     std::vector<unsigned char> vchBlock;
+    NodeId fromPeer;
+    int64_t nTimeExpire;
+    //! Memory used by the orphan block and its entries in the orphan maps
+    size_t nUsage;
 };
 std::map<uint256, COrphanBlock*> mapOrphanBlocks GUARDED_BY(cs_main);
 std::multimap<uint256, COrphanBlock*> mapOrphanBlocksByPrev GUARDED_BY(cs_main);
 std::set<std::pair<COutPoint, unsigned int>> setStakeSeenOrphan GUARDED_BY(cs_main);
 size_t nOrphanBlocksSize = 0;
+/** Memory used by the orphan blocks of each peer */
+std::map<NodeId, size_t> mapOrphanBlocksPeerSize GUARDED_BY(cs_main);
 
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch, const std::string& message="") EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -147,6 +160,19 @@ namespace {
     std::unique_ptr<CRollingBloomFilter> recentRejects GUARDED_BY(cs_main);
     uint256 hashRecentRejectsChainTip GUARDED_BY(cs_main);
 
+    /**
+     * Filter for contract transactions that were rejected for a reason that
+     * does not depend on the chain tip: malformed contract outputs, an invalid
+     * OP_SENDER signature or gas values outside the fixed bounds.
+     *
+     * Unlike recentRejects it is not reset when the tip changes, so a contract
+     * tx repeated by many peers during a burst is dropped by AlreadyHave
+     * before the contract pre-checks run again.
+     *
+     * Memory used: 0.5 MB
+     */
+    std::unique_ptr<CRollingBloomFilter> recentContractRejects GUARDED_BY(cs_main);
+
     /** Blocks that are in flight, and that are in the queue to be downloaded. */
     struct QueuedBlock {
         uint256 hash;
@@ -206,6 +232,7 @@ class CNodeHeaders
 {
 public:
     CNodeHeaders():
+        nHeaders(0),
         maxSize(0),
         maxAvg(0)
     {
@@ -241,13 +268,6 @@ public:
         if(size == 0)
             return ret;
 
-        // Compute the number of the received headers
-        size_t nHeaders = 0;
-        for(auto point : points)
-        {
-            nHeaders += point.second;
-        }
-
         // Compute the average value per height
         double nAvgValue = (double)nHeaders / size;
 
@@ -259,32 +279,38 @@ public:
         {
             // Clear the points and ban the node
             points.clear();
+            nHeaders = 0;
             return state.DoS(100, false, REJECT_INVALID, "header-spam", false, "ban node for sending spam");
         }
 
         return ret;
     }
 
+    //! Number of the heights in the list
+    size_t getHeights() const { return points.size(); }
+
+    //! Number of the received headers for the heights in the list
+    size_t getHeaders() const { return nHeaders; }
+
 private:
     void addPoint(int height)
     {
         // Erace the last element in the list
         if(points.size() == maxSize)
         {
+            nHeaders -= points.begin()->second;
             points.erase(points.begin());
         }
 
         // Add the point to the list
-        int occurrence = 0;
-        auto mi = points.find(height);
-        if (mi != points.end())
-            occurrence = (*mi).second;
-        occurrence++;
-        points[height] = occurrence;
+        points[height]++;
+        nHeaders++;
     }
 
 private:
     std::map<int,int> points;
+    //! Sum of the occurrences in points, kept up to date so the average is computed in constant time
+    size_t nHeaders;
     size_t maxSize;
     size_t maxAvg;
 };
@@ -329,12 +355,18 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Moving average of the time the peer takes to deliver the first entry in vBlocksInFlight, in microseconds.
+    int64_t nBlockDeliveryUsec;
+    //! Number of blocks that can be requested from this peer at once.
+    int nMaxBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
     bool fPreferHeaders;
     //! Whether this peer wants invs or cmpctblocks (when possible) for block announcements.
     bool fPreferHeaderAndIDs;
+    //! Whether this peer wants the headers we send in headers2 rather than headers messages.
+    bool fPreferHeaders2;
     /**
       * Whether this peer will send us cmpctblocks if we request them.
       * This is not used to gate request logic, as we really only care about fSupportsDesiredCmpctVersion,
@@ -396,9 +428,12 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlockDeliveryUsec = 0;
+        nMaxBlocksInFlight = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
+        fPreferHeaders2 = false;
         fProvidesHeaderAndIDs = false;
         fHaveWitness = false;
         fWantsCmpctWitness = false;
@@ -419,11 +454,14 @@ static CNodeState *State(NodeId pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     return &it->second;
 }
 
-static CNodeHeaders &ServiceHeaders(const CService& address) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+static CService ServiceHeadersAddress(const CService& address) {
     unsigned short port =
             gArgs.GetBoolArg("-headerspamfilterignoreport", DEFAULT_HEADER_SPAM_FILTER_IGNORE_PORT) ? 0 : address.GetPort();
-    CService addr(address, port);
-    return mapServiceHeaders[addr];
+    return CService(address, port);
+}
+
+static CNodeHeaders &ServiceHeaders(const CService& address) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    return mapServiceHeaders[ServiceHeadersAddress(address)];
 }
 
 static void CleanAddressHeaders(const CAddress& addr) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
@@ -500,7 +538,12 @@ static bool MarkBlockAsReceived(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs
         }
         if (state->vBlocksInFlight.begin() == itInFlight->second.second) {
             // First block on the queue was received, update the start download time for the next one
-            state->nDownloadingSince = std::max(state->nDownloadingSince, GetTimeMicros());
+            int64_t nNow = GetTimeMicros();
+            if (state->nDownloadingSince > 0 && nNow > state->nDownloadingSince) {
+                int64_t nDeliveryUsec = nNow - state->nDownloadingSince;
+                state->nBlockDeliveryUsec = state->nBlockDeliveryUsec ? (state->nBlockDeliveryUsec * 7 + nDeliveryUsec) / 8 : nDeliveryUsec;
+            }
+            state->nDownloadingSince = std::max(state->nDownloadingSince, nNow);
         }
         state->vBlocksInFlight.erase(itInFlight->second.second);
         state->nBlocksInFlight--;
@@ -648,6 +691,20 @@ static bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex) EXCLUSIV
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
+/**
+ * Number of blocks to keep in flight from a peer so that it has blocks to send
+ * for a whole round trip. Blocks are small and frequent on a PoS chain, so the
+ * fixed limit leaves initial block download bound by latency instead of by the
+ * link. Outside initial block download the fixed limit is kept.
+ */
+static int GetMaxBlocksInFlight(const CNodeState& state, int64_t nPingUsec) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!IsInitialBlockDownload() || state.nBlockDeliveryUsec <= 0 || nPingUsec <= 0 || nPingUsec == std::numeric_limits<int64_t>::max())
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    int64_t nBlocks = 2 * nPingUsec / state.nBlockDeliveryUsec;
+    return std::max<int64_t>(MAX_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER, nBlocks));
+}
+
 static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     if (count == 0)
@@ -679,10 +736,12 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
 
     std::vector<const CBlockIndex*> vToFetch;
     const CBlockIndex *pindexWalk = state->pindexLastCommonBlock;
-    // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
+    // Never fetch further than the best block we know the peer has, or more than the download window + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
-    // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    // download that next block if the window were 1 larger. The window grows with the number of blocks the peer can
+    // keep in flight, so that the lookahead keeps up with a fast pipeline of small blocks.
+    int nWindow = std::min<int>(MAX_BLOCK_DOWNLOAD_WINDOW, BLOCK_DOWNLOAD_WINDOW * state->nMaxBlocksInFlight / MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + nWindow;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
@@ -812,6 +871,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    auto itHeaders = mapServiceHeaders.find(ServiceHeadersAddress(state->address));
+    if (itHeaders != mapServiceHeaders.end()) {
+        stats.nHeaderSpamHeights = itHeaders->second.getHeights();
+        stats.nHeaderSpamHeaders = itHeaders->second.getHeaders();
+    }
     return true;
 }
 
@@ -1000,6 +1064,7 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, BanMan* banman, CS
     : connman(connmanIn), m_banman(banman), m_stale_tip_check_time(0), m_enable_bip61(enable_bip61) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    recentContractRejects.reset(new CRollingBloomFilter(50000, 0.000001));
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
@@ -1203,6 +1268,7 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
             }
 
             return recentRejects->contains(inv.hash) ||
+                   recentContractRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
                    pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
                    pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
@@ -1215,6 +1281,34 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     return true;
 }
 
+/** Reject reasons of contract transactions that stay valid on any chain tip */
+static bool IsPersistentContractReject(const std::string& strRejectReason)
+{
+    static const std::set<std::string> setReasons = {
+        "bad-tx-bad-contract-format",
+        "bad-txns-invalid-sender",
+        "bad-tx-gas-stipend-overflow",
+        "bad-tx-version-format",
+        "bad-tx-version-rootvm",
+        "bad-tx-version-vmversion",
+        "bad-tx-version-flags",
+        "bad-tx-too-little-mempool-gas",
+        "bad-tx-too-little-gas",
+        "bad-tx-too-much-gas",
+    };
+    return setReasons.count(strRejectReason) != 0;
+}
+
+static void AddToRecentRejects(const CTransaction& tx, const CValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    assert(recentRejects);
+    recentRejects->insert(tx.GetHash());
+    if (tx.HasCreateOrCall() && IsPersistentContractReject(state.GetRejectReason())) {
+        assert(recentContractRejects);
+        recentContractRejects->insert(tx.GetHash());
+    }
+}
+
 static void RelayTransaction(const CTransaction& tx, CConnman* connman)
 {
     CInv inv(MSG_TX, tx.GetHash());
@@ -1297,121 +1391,144 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
         }
     }
 
-    LOCK(cs_main);
-    const CBlockIndex* pindex = LookupBlockIndex(inv.hash);
-    if (pindex) {
-        send = BlockRequestAllowed(pindex, consensusParams);
-        if (!send) {
-            LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
-        }
-    }
-    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
-    // disconnect node in case we have reached the outbound limit for serving historical blocks
-    // never disconnect whitelisted nodes
-    if (send && connman->OutboundTargetReached(true) && ( ((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
+    // Decide under cs_main, but read and serialize the block without it: serving historical
+    // blocks to a syncing peer would otherwise stall validation and transaction relay.
+    CDiskBlockPos blockPos;
+    uint256 hashBlock;
+    uint256 hashTip;
+    bool fCanSendCmpct = false;
+    bool fPeerWantsWitness = false;
     {
-        LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(inv.hash);
+        if (pindex) {
+            send = BlockRequestAllowed(pindex, consensusParams);
+            if (!send) {
+                LogPrint(BCLog::NET, "%s: ignoring request from peer=%i for old block that isn't in the main chain\n", __func__, pfrom->GetId());
+            }
+        }
+        // disconnect node in case we have reached the outbound limit for serving historical blocks
+        // never disconnect whitelisted nodes
+        if (send && connman->OutboundTargetReached(true) && ( ((pindexBestHeader != nullptr) && (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() > HISTORICAL_BLOCK_AGE)) || inv.type == MSG_FILTERED_BLOCK) && !pfrom->fWhitelisted)
+        {
+            LogPrint(BCLog::NET, "historical block serving limit reached, disconnect peer=%d\n", pfrom->GetId());
 
-        //disconnect node
-        pfrom->fDisconnect = true;
-        send = false;
-    }
-    // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
-    if (send && !pfrom->fWhitelisted && (
-            (((pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom->GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (chainActive.Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
-       )) {
-        LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom->GetId());
+            //disconnect node
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Avoid leaking prune-height by never sending blocks below the NODE_NETWORK_LIMITED threshold
+        if (send && !pfrom->fWhitelisted && (
+                (((pfrom->GetLocalServices() & NODE_NETWORK_LIMITED) == NODE_NETWORK_LIMITED) && ((pfrom->GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) && (chainActive.Tip()->nHeight - pindex->nHeight > (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2 /* add two blocks buffer extension for possible races */) )
+           )) {
+            LogPrint(BCLog::NET, "Ignore block request below NODE_NETWORK_LIMITED threshold from peer=%d\n", pfrom->GetId());
 
-        //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
-        pfrom->fDisconnect = true;
-        send = false;
+            //disconnect node and prevent it from stalling (would otherwise wait for the missing block)
+            pfrom->fDisconnect = true;
+            send = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether
+        // it's available before trying to send.
+        if (!send || !(pindex->nStatus & BLOCK_HAVE_DATA))
+            return;
+
+        blockPos = pindex->GetBlockPos();
+        hashBlock = pindex->GetBlockHash();
+        hashTip = chainActive.Tip()->GetBlockHash();
+        if (inv.type == MSG_CMPCT_BLOCK) {
+            fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
+            fCanSendCmpct = CanDirectFetch(consensusParams) && pindex->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH;
+        }
+    } // release cs_main before reading the block
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    std::shared_ptr<const CBlock> pblock;
+    if (a_recent_block && a_recent_block->GetHash() == hashBlock) {
+        pblock = a_recent_block;
+    } else if (inv.type == MSG_WITNESS_BLOCK) {
+        // Fast-path: in this case it is possible to serve the block directly from disk,
+        // as the network format matches the format on disk. The block is read straight into
+        // the message buffer, which is then moved into the send queue without another copy.
+        CSerializedNetMsg msg;
+        msg.command = NetMsgType::BLOCK;
+        if (!ReadRawBlockFromDisk(msg.data, blockPos, chainparams.MessageStart())) {
+            // The block may have been pruned since cs_main was released
+            LogPrint(BCLog::NET, "cannot load block %s from disk for peer=%d\n", hashBlock.ToString(), pfrom->GetId());
+            return;
+        }
+        connman->PushMessage(pfrom, std::move(msg));
+        // Don't set pblock as we've sent the block
+    } else {
+        // Send block from disk
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, blockPos, consensusParams) || pblockRead->GetHash() != hashBlock) {
+            // The block may have been pruned since cs_main was released
+            LogPrint(BCLog::NET, "cannot load block %s from disk for peer=%d\n", hashBlock.ToString(), pfrom->GetId());
+            return;
+        }
+        pblock = pblockRead;
     }
-    // Pruned nodes may have deleted the block, so check whether
-    // it's available before trying to send.
-    if (send && (pindex->nStatus & BLOCK_HAVE_DATA))
-    {
-        std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
-            pblock = a_recent_block;
-        } else if (inv.type == MSG_WITNESS_BLOCK) {
-            // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
-                assert(!"cannot load block from disk");
-            }
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
-            // Don't set pblock as we've sent the block
-        } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
-                assert(!"cannot load block from disk");
-            pblock = pblockRead;
-        }
-        if (pblock) {
-            if (inv.type == MSG_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
-            else if (inv.type == MSG_WITNESS_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
-            else if (inv.type == MSG_FILTERED_BLOCK)
+    if (pblock) {
+        if (inv.type == MSG_BLOCK)
+            connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
+        else if (inv.type == MSG_WITNESS_BLOCK)
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+        else if (inv.type == MSG_FILTERED_BLOCK)
+        {
+            bool sendMerkleBlock = false;
+            CMerkleBlock merkleBlock;
             {
-                bool sendMerkleBlock = false;
-                CMerkleBlock merkleBlock;
-                {
-                    LOCK(pfrom->cs_filter);
-                    if (pfrom->pfilter) {
-                        sendMerkleBlock = true;
-                        merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
-                    }
+                LOCK(pfrom->cs_filter);
+                if (pfrom->pfilter) {
+                    sendMerkleBlock = true;
+                    merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
                 }
-                if (sendMerkleBlock) {
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                    // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
-                    // This avoids hurting performance by pointlessly requiring a round-trip
-                    // Note that there is currently no way for a node to request any single transactions we didn't send here -
-                    // they must either disconnect and retry or request the full block.
-                    // Thus, the protocol spec specified allows for us to provide duplicate txn here,
-                    // however we MUST always provide at least what the remote peer needs
-                    typedef std::pair<unsigned int, uint256> PairType;
-                    for (PairType& pair : merkleBlock.vMatchedTxn)
-                        connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
-                }
-                // else
-                    // no response
             }
-            else if (inv.type == MSG_CMPCT_BLOCK)
-            {
-                // If a peer is asking for old blocks, we're almost guaranteed
-                // they won't have a useful mempool to match against a compact block,
-                // and we don't feel like constructing the object for them, so
-                // instead we respond with the full, non-compact block.
-                bool fPeerWantsWitness = State(pfrom->GetId())->fWantsCmpctWitness;
-                int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
-                if (CanDirectFetch(consensusParams) && pindex->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                    if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
-                        connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
-                    } else {
-                        CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
-                        connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
-                    }
+            if (sendMerkleBlock) {
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
+                // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                // This avoids hurting performance by pointlessly requiring a round-trip
+                // Note that there is currently no way for a node to request any single transactions we didn't send here -
+                // they must either disconnect and retry or request the full block.
+                // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                // however we MUST always provide at least what the remote peer needs
+                typedef std::pair<unsigned int, uint256> PairType;
+                for (PairType& pair : merkleBlock.vMatchedTxn)
+                    connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::TX, *pblock->vtx[pair.first]));
+            }
+            // else
+                // no response
+        }
+        else if (inv.type == MSG_CMPCT_BLOCK)
+        {
+            // If a peer is asking for old blocks, we're almost guaranteed
+            // they won't have a useful mempool to match against a compact block,
+            // and we don't feel like constructing the object for them, so
+            // instead we respond with the full, non-compact block.
+            int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+            if (fCanSendCmpct) {
+                if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == hashBlock) {
+                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
                 } else {
-                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
+                    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
                 }
+            } else {
+                connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
             }
         }
+    }
 
-        // Trigger the peer node to send a getblocks request for the next batch of inventory
-        if (inv.hash == pfrom->hashContinue)
-        {
-            // Bypass PushInventory, this must send even if redundant,
-            // and we want it right after the last block so they don't
-            // wait for other stuff first.
-            std::vector<CInv> vInv;
-            vInv.push_back(CInv(MSG_BLOCK, chainActive.Tip()->GetBlockHash()));
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
-            pfrom->hashContinue.SetNull();
-        }
+    // Trigger the peer node to send a getblocks request for the next batch of inventory
+    if (inv.hash == pfrom->hashContinue)
+    {
+        // Bypass PushInventory, this must send even if redundant,
+        // and we want it right after the last block so they don't
+        // wait for other stuff first.
+        std::vector<CInv> vInv;
+        vInv.push_back(CInv(MSG_BLOCK, hashTip));
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+        pfrom->hashContinue.SetNull();
     }
 }
 
@@ -1775,8 +1892,7 @@ void static ProcessOrphanTx(CConnman* connman, std::set<uint256>& orphan_work_se
                 // Do not use rejection cache for witness transactions or
                 // witness-stripped transactions, as they can have been malleated.
                 // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                assert(recentRejects);
-                recentRejects->insert(orphanHash);
+                AddToRecentRejects(orphanTx, stateDummy);
             }
             EraseOrphanTx(orphanHash);
             done = true;
@@ -2142,6 +2258,25 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // nodes)
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDHEADERS));
         }
+        if (pfrom->nVersion >= COMPACT_HEADERS_VERSION) {
+            // Tell our peer we can read headers in the compact encoding
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDHEADERS2));
+        }
+        bool fRelayTxes;
+        {
+            LOCK(pfrom->cs_filter);
+            fRelayTxes = pfrom->fRelayTxes;
+        }
+        if (pfrom->nVersion >= TXRECONCILIATION_VERSION && (pfrom->GetLocalServices() & NODE_TXRECONCILIATION) &&
+            (pfrom->nServices & NODE_TXRECONCILIATION) && fRelayTxes && g_relay_txes) {
+            // Offer to reconcile transactions, which starts once the peer offers it too
+            uint64_t salt = GetRand(std::numeric_limits<uint64_t>::max());
+            {
+                LOCK(pfrom->cs_inventory);
+                pfrom->m_recon_salt = salt;
+            }
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDRECON, TXRECONCILIATION_PROTOCOL_VERSION, salt));
+        }
         if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
             // Tell our peer we are willing to provide version 1 or 2 cmpctblocks
             // However, we do not request new block announcements using
@@ -2223,6 +2358,135 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         return true;
     }
 
+    if (strCommand == NetMsgType::SENDHEADERS2) {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fPreferHeaders2 = true;
+        return true;
+    }
+
+    if (strCommand == NetMsgType::SENDRECON) {
+        uint32_t nReconVersion = 0;
+        uint64_t nRemoteSalt = 0;
+        vRecv >> nReconVersion >> nRemoteSalt;
+        LOCK(pfrom->cs_inventory);
+        // Only when we offered reconciliation too, and only once
+        if (pfrom->m_recon_salt == 0 || pfrom->m_tx_reconciliation || nReconVersion < TXRECONCILIATION_PROTOCOL_VERSION) {
+            return true;
+        }
+        pfrom->m_tx_reconciliation.reset(new TxReconciliationState(!pfrom->fInbound, pfrom->m_recon_salt, nRemoteSalt));
+        LogPrint(BCLog::NET, "reconciling transactions with peer=%d\n", pfrom->GetId());
+        return true;
+    }
+
+    if (strCommand == NetMsgType::REQRECON) {
+        uint16_t nRemoteSetSize = 0;
+        uint16_t nQ = 0;
+        vRecv >> nRemoteSetSize >> nQ;
+        std::vector<unsigned char> vSketch;
+        {
+            LOCK(pfrom->cs_inventory);
+            TxReconciliationState* recon = pfrom->m_tx_reconciliation.get();
+            if (!recon || recon->m_we_initiate) {
+                return true;
+            }
+            // A reconciliation the peer gave up on, announce what it was about
+            for (const auto& entry : recon->m_snapshot) {
+                pfrom->setInventoryTxToSend.insert(entry.second);
+            }
+            recon->Snapshot();
+            uint32_t nCapacity = EstimateSketchCapacity(recon->m_snapshot.size(), nRemoteSetSize, nQ);
+            if (nCapacity <= MAX_SKETCH_CAPACITY) {
+                vSketch = recon->SketchSnapshot(nCapacity).Serialize();
+            }
+        }
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, vSketch));
+        return true;
+    }
+
+    if (strCommand == NetMsgType::SKETCH) {
+        std::vector<unsigned char> vSketch;
+        vRecv >> vSketch;
+        PinSketch remote(0);
+        if (vSketch.size() > MAX_SKETCH_CAPACITY * 4 || !PinSketch::Deserialize(vSketch, remote)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20, strprintf("sketch message size = %u", vSketch.size()));
+            return false;
+        }
+        bool fSuccess = false;
+        std::vector<uint32_t> vAskShortIds;
+        {
+            LOCK(pfrom->cs_inventory);
+            TxReconciliationState* recon = pfrom->m_tx_reconciliation.get();
+            if (!recon || !recon->m_we_initiate || recon->m_request_time == 0) {
+                return true;
+            }
+            recon->m_request_time = 0;
+            std::vector<uint32_t> vDifferences;
+            if (remote.GetCapacity() > 0) {
+                PinSketch local = recon->SketchSnapshot(remote.GetCapacity());
+                local.Merge(remote);
+                fSuccess = local.Decode(vDifferences);
+            }
+            if (fSuccess) {
+                // Announce what only we have, ask for what only the peer has, and the rest the peer has too
+                for (uint32_t nShortId : vDifferences) {
+                    auto it = recon->m_snapshot.find(nShortId);
+                    if (it == recon->m_snapshot.end()) {
+                        vAskShortIds.push_back(nShortId);
+                    } else {
+                        pfrom->setInventoryTxToSend.insert(it->second);
+                        recon->m_snapshot.erase(it);
+                    }
+                }
+                for (const auto& entry : recon->m_snapshot) {
+                    pfrom->filterInventoryKnown.insert(entry.second);
+                }
+            } else {
+                for (const auto& entry : recon->m_snapshot) {
+                    pfrom->setInventoryTxToSend.insert(entry.second);
+                }
+            }
+            recon->m_snapshot.clear();
+        }
+        LogPrint(BCLog::NET, "reconciliation with peer=%d %s, asking for %u transactions\n", pfrom->GetId(), fSuccess ? "succeeded" : "failed", vAskShortIds.size());
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, fSuccess, vAskShortIds));
+        return true;
+    }
+
+    if (strCommand == NetMsgType::RECONCILDIFF) {
+        bool fSuccess = false;
+        std::vector<uint32_t> vAskShortIds;
+        vRecv >> fSuccess >> vAskShortIds;
+        if (vAskShortIds.size() > MAX_SKETCH_CAPACITY) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 20, strprintf("reconcildiff message size = %u", vAskShortIds.size()));
+            return false;
+        }
+        LOCK(pfrom->cs_inventory);
+        TxReconciliationState* recon = pfrom->m_tx_reconciliation.get();
+        if (!recon || recon->m_we_initiate) {
+            return true;
+        }
+        if (fSuccess) {
+            for (uint32_t nShortId : vAskShortIds) {
+                auto it = recon->m_snapshot.find(nShortId);
+                if (it != recon->m_snapshot.end()) {
+                    pfrom->setInventoryTxToSend.insert(it->second);
+                    recon->m_snapshot.erase(it);
+                }
+            }
+            for (const auto& entry : recon->m_snapshot) {
+                pfrom->filterInventoryKnown.insert(entry.second);
+            }
+        } else {
+            for (const auto& entry : recon->m_snapshot) {
+                pfrom->setInventoryTxToSend.insert(entry.second);
+            }
+        }
+        recon->m_snapshot.clear();
+        return true;
+    }
+
     if (strCommand == NetMsgType::SENDCMPCT) {
         bool fAnnounceUsingCMPCTBLOCK = false;
         uint64_t nCMPCTBLOCKVersion = 0;
@@ -2505,7 +2769,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // will re-announce the new block via headers (or compact blocks again)
         // in the SendMessages logic.
         nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
-        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+        if (nodestate->fPreferHeaders2) {
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS2, CCompactHeaders<CBlock>(vHeaders)));
+        } else {
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+        }
         return true;
     }
 
@@ -2593,8 +2861,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 // Do not use rejection cache for witness transactions or
                 // witness-stripped transactions, as they can have been malleated.
                 // See https://github.com/bitcoin/bitcoin/issues/8279 for details.
-                assert(recentRejects);
-                recentRejects->insert(tx.GetHash());
+                AddToRecentRejects(tx, state);
                 if (RecursiveDynamicUsage(*ptx) < 100000) {
                     AddToCompactExtraTransactions(ptx);
                 }
@@ -2954,7 +3221,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         return true;
     }
 
-    if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
+    if ((strCommand == NetMsgType::HEADERS || strCommand == NetMsgType::HEADERS2) && !fImporting && !fReindex) // Ignore headers received while importing
     {
         std::vector<CBlockHeader> headers;
 
@@ -2962,13 +3229,20 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         unsigned int nCount = ReadCompactSize(vRecv);
         if (nCount > MAX_HEADERS_RESULTS) {
             LOCK(cs_main);
-            Misbehaving(pfrom->GetId(), 20, strprintf("headers message size = %u", nCount));
+            Misbehaving(pfrom->GetId(), 20, strprintf("%s message size = %u", strCommand, nCount));
             return false;
         }
         headers.resize(nCount);
-        for (unsigned int n = 0; n < nCount; n++) {
-            vRecv >> headers[n];
-            ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+        if (strCommand == NetMsgType::HEADERS2) {
+            CCompactHeaderCodec codec;
+            for (unsigned int n = 0; n < nCount; n++) {
+                codec.Read(vRecv, headers[n]);
+            }
+        } else {
+            for (unsigned int n = 0; n < nCount; n++) {
+                vRecv >> headers[n];
+                ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+            }
         }
 
         // Headers received via a HEADERS message should be valid, and reflect
@@ -3296,6 +3570,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
     CNetMessage& msg(msgs.front());
+    g_metrics.messagesReceived++;
 
     msg.SetVersion(pfrom->GetRecvVersion());
     // Scan for message start
@@ -3753,7 +4028,11 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n", __func__,
                                 vHeaders.front().GetHash().ToString(), pto->GetId());
                     }
-                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                    if (state.fPreferHeaders2) {
+                        connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS2, CCompactHeaders<CBlock>(vHeaders)));
+                    } else {
+                        connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                    }
                     state.pindexBestHeaderSent = pBestIndex;
                 } else
                     fRevertToInv = true;
@@ -3920,6 +4199,25 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                     pto->filterInventoryKnown.insert(hash);
                 }
             }
+
+            // Ask outbound reconciling peers for the sketch of their set, announcing ours if they never answered
+            TxReconciliationState* recon = pto->m_tx_reconciliation.get();
+            if (recon && recon->m_we_initiate) {
+                if (recon->m_request_time && recon->m_request_time + RECON_RESPONSE_TIMEOUT * 1000000 < nNow) {
+                    for (const auto& entry : recon->m_snapshot) {
+                        pto->setInventoryTxToSend.insert(entry.second);
+                    }
+                    recon->m_snapshot.clear();
+                    recon->m_request_time = 0;
+                }
+                if (!recon->m_request_time && recon->m_next_request < nNow) {
+                    recon->Snapshot();
+                    recon->m_request_time = nNow;
+                    recon->m_next_request = nNow + RECON_REQUEST_INTERVAL * 1000000;
+                    uint16_t nSetSize = std::min<size_t>(recon->m_snapshot.size(), std::numeric_limits<uint16_t>::max());
+                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::REQRECON, nSetSize, (uint16_t)(RECON_DEFAULT_Q * Q_PRECISION)));
+                }
+            }
         }
         if (!vInv.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
@@ -3989,10 +4287,11 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        state.nMaxBlocksInFlight = GetMaxBlocksInFlight(state, pto->nMinPingUsecTime);
+        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !IsInitialBlockDownload()) && state.nBlocksInFlight < state.nMaxBlocksInFlight) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), state.nMaxBlocksInFlight - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -4093,6 +4392,64 @@ uint256 WantedByOrphan(const COrphanBlock* pblockOrphan)
     return pblockOrphan->hashPrev;
 }
 
+static void AddOrphanBlockSize(const COrphanBlock* pblockOrphan) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    nOrphanBlocksSize += pblockOrphan->nUsage;
+    mapOrphanBlocksPeerSize[pblockOrphan->fromPeer] += pblockOrphan->nUsage;
+}
+
+static void RemoveOrphanBlockSize(const COrphanBlock* pblockOrphan) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    nOrphanBlocksSize -= pblockOrphan->nUsage;
+    auto it = mapOrphanBlocksPeerSize.find(pblockOrphan->fromPeer);
+    if (it != mapOrphanBlocksPeerSize.end()) {
+        it->second -= pblockOrphan->nUsage;
+        if (it->second == 0)
+            mapOrphanBlocksPeerSize.erase(it);
+    }
+}
+
+// Remove an orphan block, the orphans that depend on it stay indexed by their previous block.
+static void EraseOrphanBlock(std::map<uint256, COrphanBlock*>::iterator it) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    COrphanBlock* pblockOrphan = it->second;
+    auto range = mapOrphanBlocksByPrev.equal_range(pblockOrphan->hashPrev);
+    for (auto itPrev = range.first; itPrev != range.second; ++itPrev) {
+        if (itPrev->second == pblockOrphan) {
+            mapOrphanBlocksByPrev.erase(itPrev);
+            break;
+        }
+    }
+    setStakeSeenOrphan.erase(pblockOrphan->stake);
+    RemoveOrphanBlockSize(pblockOrphan);
+    mapOrphanBlocks.erase(it);
+    delete pblockOrphan;
+}
+
+// Remove the expired orphan blocks, and the oldest orphan blocks of a peer until a new orphan of nUsage fits in its share.
+void static LimitOrphanBlocks(NodeId peer, size_t nUsage) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    int64_t nNow = GetTime();
+    for (auto it = mapOrphanBlocks.begin(); it != mapOrphanBlocks.end();) {
+        auto itErase = it++;
+        if (itErase->second->nTimeExpire <= nNow)
+            EraseOrphanBlock(itErase);
+    }
+
+    size_t nMaxPeerSize = gArgs.GetArg("-maxorphanblocksmib", DEFAULT_MAX_ORPHAN_BLOCKS) * ((size_t) 1 << 20) * ORPHAN_BLOCKS_PEER_SHARE / 100;
+    while (mapOrphanBlocksPeerSize.count(peer) && mapOrphanBlocksPeerSize[peer] + nUsage > nMaxPeerSize)
+    {
+        auto itOldest = mapOrphanBlocks.end();
+        for (auto it = mapOrphanBlocks.begin(); it != mapOrphanBlocks.end(); ++it) {
+            if (it->second->fromPeer == peer && (itOldest == mapOrphanBlocks.end() || it->second->nTimeExpire < itOldest->second->nTimeExpire))
+                itOldest = it;
+        }
+        if (itOldest == mapOrphanBlocks.end())
+            break;
+        EraseOrphanBlock(itOldest);
+    }
+}
+
 // Remove a random orphan block (which does not have any dependent orphans).
 void static PruneOrphanBlocks()
 {
@@ -4113,12 +4470,7 @@ void static PruneOrphanBlocks()
             it = it2;
         } while(1);
 
-        setStakeSeenOrphan.erase(it->second->stake);
-        uint256 hash = it->second->hashBlock;
-        nOrphanBlocksSize -= it->second->vchBlock.size();
-        delete it->second;
-        mapOrphanBlocksByPrev.erase(it);
-        mapOrphanBlocks.erase(hash);
+        EraseOrphanBlock(mapOrphanBlocks.find(it->second->hashBlock));
     }
 }
 
@@ -4209,7 +4561,13 @@ bool ProcessNetBlock(const CChainParams& chainparams, const std::shared_ptr<cons
                 pblock2->hashBlock = hash;
                 pblock2->hashPrev = pblock->hashPrevBlock;
                 pblock2->stake = pblock->GetProofOfStake();
-                nOrphanBlocksSize += pblock2->vchBlock.size();
+                pblock2->fromPeer = pfrom->GetId();
+                pblock2->nTimeExpire = GetTime() + ORPHAN_BLOCK_EXPIRE_TIME;
+                // The block and its node in each of the two orphan maps
+                pblock2->nUsage = memusage::MallocUsage(sizeof(COrphanBlock)) + memusage::DynamicUsage(pblock2->vchBlock) +
+                        2 * memusage::MallocUsage(sizeof(std::pair<const uint256, COrphanBlock*>) + 4 * sizeof(void*));
+                LimitOrphanBlocks(pblock2->fromPeer, pblock2->nUsage);
+                AddOrphanBlockSize(pblock2);
                 mapOrphanBlocks.insert(std::make_pair(hash, pblock2));
                 mapOrphanBlocksByPrev.insert(std::make_pair(pblock2->hashPrev, pblock2));
                 if (pblock->IsProofOfStake())
@@ -4253,7 +4611,7 @@ bool ProcessNetBlock(const CChainParams& chainparams, const std::shared_ptr<cons
             LOCK(cs_main);
             mapOrphanBlocks.erase(mi->second->hashBlock);
             setStakeSeenOrphan.erase(block.GetProofOfStake());
-            nOrphanBlocksSize -= mi->second->vchBlock.size();
+            RemoveOrphanBlockSize(mi->second);
             delete mi->second;
         }
 
@@ -4296,12 +4654,7 @@ bool NeedToEraseBlockIndex(const CBlockIndex *pindex, const CBlockIndex *pindexC
     if(!chainActive.Contains(pindex))
     {
         if(pindex->nHeight <= pindexCheck->nHeight) return true;
-        const CBlockIndex *pindexBlock = pindex;
-        while(pindexBlock)
-        {
-            pindexBlock = pindexBlock->pprev;
-            if(pindexBlock->nHeight == pindexCheck->nHeight) return pindexBlock != pindexCheck;
-        }
+        return pindex->GetAncestor(pindexCheck->nHeight) != pindexCheck;
     }
     return false;
 }
@@ -4313,10 +4666,14 @@ bool RemoveBlockIndex(CBlockIndex *pindex)
     return ret;
 }
 
+/** Number of stale block indexes removed per cs_main lock by the block index cleanup */
+static const size_t CLEAN_BLOCK_INDEX_BATCH_SIZE = 1000;
+
 void CleanBlockIndex()
 {
     unsigned int cleanTimeout = gArgs.GetArg("-cleanblockindextimeout", DEFAULT_CLEANBLOCKINDEXTIMEOUT) * 1000;
     if(cleanTimeout == 0) cleanTimeout = DEFAULT_CLEANBLOCKINDEXTIMEOUT * 1000;
+    bool fScannedBlockIndex = false;
 
     while(!ShutdownRequested())
     {
@@ -4330,31 +4687,51 @@ void CleanBlockIndex()
                 int checkpointSpan = Params().GetConsensus().CheckpointSpan(nHeight);
                 const CBlockIndex *pindexCheck = chainActive[nHeight - checkpointSpan -1];
                 if (pindexCheck) {
-                    for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); it++) {
-                        CBlockIndex *pindex = (*it).second;
+                    // The indexes loaded or received during the initial block download are scanned once,
+                    // the indexes added later are tracked in setRecentBlockIndex when they are created
+                    if (!fScannedBlockIndex) {
+                        for (BlockMap::iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); it++) {
+                            CBlockIndex *pindex = (*it).second;
+                            if (pindex->nHeight > pindexCheck->nHeight || !chainActive.Contains(pindex)) {
+                                setRecentBlockIndex.insert(std::make_pair(pindex->nHeight, pindex));
+                            }
+                        }
+                        fScannedBlockIndex = true;
+                    }
+                    for (auto it = setRecentBlockIndex.begin(); it != setRecentBlockIndex.end();) {
+                        CBlockIndex *pindex = it->second;
                         if (NeedToEraseBlockIndex(pindex, pindexCheck)) {
                             indexNeedErase.push_back(pindex->GetBlockHash());
+                            it++;
+                        } else if (pindex->nHeight <= pindexCheck->nHeight) {
+                            // On the main chain below the checkpoint span, it can't become stale anymore
+                            it = setRecentBlockIndex.erase(it);
+                        } else {
+                            it++;
                         }
                     }
                 }
             }
 
-            // Delete selected block indexes
-            if(indexNeedErase.size() > 0)
+            // Delete selected block indexes, a batch at a time to not hold cs_main for long
+            for(size_t nBatch = 0; nBatch < indexNeedErase.size(); nBatch += CLEAN_BLOCK_INDEX_BATCH_SIZE)
             {
-                SyncWithValidationInterfaceQueue();
+                if(nBatch == 0)
+                    SyncWithValidationInterfaceQueue();
 
                 LOCK(cs_main);
                 std::vector<uint256> indexEraseDB;
-                for(uint256 blockHash : indexNeedErase)
+                size_t nBatchEnd = std::min(indexNeedErase.size(), nBatch + CLEAN_BLOCK_INDEX_BATCH_SIZE);
+                for(size_t i = nBatch; i < nBatchEnd; i++)
                 {
+                    const uint256& blockHash = indexNeedErase[i];
                     BlockMap::iterator it=mapBlockIndex.find(blockHash);
                     if(it!=mapBlockIndex.end())
                     {
                         CBlockIndex *pindex = (*it).second;
                         if(RemoveBlockIndex(pindex))
                         {
-                            delete pindex;
+                            g_block_index_arena.Delete(pindex);
                             mapBlockIndex.erase(it);
                             indexEraseDB.push_back(blockHash);
                         }
@@ -4391,5 +4768,6 @@ public:
         mapOrphanBlocks.clear();
         mapOrphanBlocksByPrev.clear();
         setStakeSeenOrphan.clear();
+        mapOrphanBlocksPeerSize.clear();
     }
 } instance_of_cnetprocessingcleanup;
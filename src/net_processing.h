@@ -101,6 +101,8 @@ struct CNodeStateStats {
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    size_t nHeaderSpamHeights = 0;
+    size_t nHeaderSpamHeaders = 0;
 };
 
 /** Get statistics from node state */
@@ -0,0 +1,127 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blockfilereader.h>
+
+#include <crypto/common.h>
+#include <fs.h>
+#include <serialize.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+BlockFileReader g_block_file_reader;
+
+/** Size of the message start and length header written in front of each record */
+static const size_t RECORD_HEADER_SIZE = 8;
+
+MappedBlockFile::~MappedBlockFile()
+{
+#ifndef WIN32
+    munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+}
+
+std::shared_ptr<const MappedBlockFile> BlockFileReader::GetFile(const char* prefix, int nFile, size_t min_size)
+{
+    if (m_max_files == 0) return nullptr;
+
+    const FileKey key(prefix, nFile);
+    {
+        LOCK(m_mutex);
+        auto it = m_files.find(key);
+        if (it != m_files.end()) {
+            if ((size_t)it->second.file->Data().size() >= min_size) {
+                it->second.last_used = ++m_use_counter;
+                return it->second.file;
+            }
+            // The file has grown since it was mapped
+            m_files.erase(it);
+        }
+    }
+
+    auto file = MapFile(prefix, nFile, min_size);
+    if (!file) return nullptr;
+
+    LOCK(m_mutex);
+    if (m_files.size() >= m_max_files) {
+        auto oldest = m_files.begin();
+        for (auto it = m_files.begin(); it != m_files.end(); ++it) {
+            if (it->second.last_used < oldest->second.last_used) oldest = it;
+        }
+        m_files.erase(oldest);
+    }
+    m_files[key] = Entry{file, ++m_use_counter};
+    return file;
+}
+
+std::shared_ptr<const MappedBlockFile> BlockFileReader::MapFile(const char* prefix, int nFile, size_t min_size)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    // A 32 bit address space cannot hold many 128 MiB block files
+    if (sizeof(void*) < 8) return nullptr;
+
+    fs::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), prefix);
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size < min_size) {
+        close(fd);
+        return nullptr;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        LogPrintf("%s: mmap of %s failed: %s\n", __func__, path.string(), strerror(errno));
+        return nullptr;
+    }
+    return std::make_shared<const MappedBlockFile>(static_cast<const unsigned char*>(data), st.st_size);
+#endif
+}
+
+bool BlockFileReader::ReadRecord(const char* prefix, const CDiskBlockPos& pos, size_t extra_size,
+                                 std::shared_ptr<const MappedBlockFile>& file, Span<const unsigned char>& record)
+{
+    if (pos.IsNull() || pos.nPos < RECORD_HEADER_SIZE) return false;
+
+    file = GetFile(prefix, pos.nFile, pos.nPos);
+    if (!file) return false;
+
+    Span<const unsigned char> data = file->Data();
+    uint64_t size = ReadLE32(data.data() + pos.nPos - 4);
+    if (size > MAX_SIZE) return false;
+    uint64_t end = (uint64_t)pos.nPos + size + extra_size;
+    if (end > (uint64_t)data.size()) {
+        // The record was appended after the file was mapped
+        file = GetFile(prefix, pos.nFile, end);
+        if (!file) return false;
+        data = file->Data();
+    }
+    record = data.subspan(pos.nPos, size + extra_size);
+    return true;
+}
+
+void BlockFileReader::Invalidate(int nFile)
+{
+    LOCK(m_mutex);
+    m_files.erase(FileKey("blk", nFile));
+    m_files.erase(FileKey("rev", nFile));
+}
+
+void BlockFileReader::Clear()
+{
+    LOCK(m_mutex);
+    m_files.clear();
+}
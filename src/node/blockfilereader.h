@@ -0,0 +1,96 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKFILEREADER_H
+#define BITCOIN_NODE_BLOCKFILEREADER_H
+
+#include <span.h>
+#include <sync.h>
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <utility>
+
+struct CDiskBlockPos;
+
+/** Number of blk/rev files kept mapped at the same time */
+static const size_t DEFAULT_MAPPED_BLOCK_FILES = 16;
+
+/** A read-only memory mapping of a whole blk?????.dat or rev?????.dat file */
+class MappedBlockFile
+{
+public:
+    MappedBlockFile(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+    ~MappedBlockFile();
+
+    MappedBlockFile(const MappedBlockFile&) = delete;
+    MappedBlockFile& operator=(const MappedBlockFile&) = delete;
+
+    Span<const unsigned char> Data() const { return Span<const unsigned char>(m_data, m_size); }
+
+private:
+    const unsigned char* const m_data;
+    const size_t m_size;
+};
+
+/**
+ * Cache of read-only mappings of the block and undo files.
+ *
+ * Reading a record returns a span pointing into the mapping, so blocks are
+ * deserialized straight from the page cache without opening, seeking and
+ * reading the file on every call. Mappings are shared with the readers still
+ * using them, so evicting or invalidating a file never unmaps memory that is
+ * being deserialized. A file that grows past its mapping is mapped again;
+ * files that are truncated or deleted must be invalidated.
+ */
+class BlockFileReader
+{
+public:
+    explicit BlockFileReader(size_t max_files = DEFAULT_MAPPED_BLOCK_FILES) : m_max_files(max_files) {}
+
+    /**
+     * Map the record stored at pos in the file with the given prefix ("blk"
+     * or "rev"). The record is the serialized object whose size is given in
+     * the 8 byte header preceding pos, followed by extra_size bytes.
+     *
+     * @param[out] file  The mapping the record points into, to be kept while reading it
+     * @param[out] record  The record bytes
+     * @return false if memory mapping is unavailable or the file or record could not be mapped
+     */
+    bool ReadRecord(const char* prefix, const CDiskBlockPos& pos, size_t extra_size,
+                    std::shared_ptr<const MappedBlockFile>& file, Span<const unsigned char>& record);
+
+    /**
+     * Map a whole file without adding it to the cache, for a single pass over
+     * it such as the reindex import. Returns nullptr if it cannot be mapped.
+     */
+    static std::shared_ptr<const MappedBlockFile> MapFile(const char* prefix, int nFile, size_t min_size = 0);
+
+    /** Drop the mappings of file number nFile, after it was truncated or removed */
+    void Invalidate(int nFile);
+
+    /** Drop all mappings */
+    void Clear();
+
+private:
+    typedef std::pair<std::string, int> FileKey;
+
+    struct Entry {
+        std::shared_ptr<const MappedBlockFile> file;
+        uint64_t last_used;
+    };
+
+    std::shared_ptr<const MappedBlockFile> GetFile(const char* prefix, int nFile, size_t min_size);
+
+    const size_t m_max_files;
+    Mutex m_mutex;
+    std::map<FileKey, Entry> m_files GUARDED_BY(m_mutex);
+    uint64_t m_use_counter GUARDED_BY(m_mutex){0};
+};
+
+extern BlockFileReader g_block_file_reader;
+
+#endif // BITCOIN_NODE_BLOCKFILEREADER_H
@@ -0,0 +1,55 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_UTXO_SNAPSHOT_H
+#define BITCOIN_NODE_UTXO_SNAPSHOT_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+/**
+ * Metadata describing a serialized version of a UTXO set from which a
+ * chainstate can be constructed.
+ *
+ * The contract state is not part of the snapshot. The state trie root and
+ * the UTXO trie root of the base block are recorded so that a contract state
+ * obtained separately can be checked against the snapshot.
+ */
+class SnapshotMetadata
+{
+public:
+    //! The hash of the block that reflects the tip of the chain for the
+    //! UTXO set contained in this snapshot.
+    uint256 m_base_blockhash;
+
+    //! The height of the base block.
+    int m_base_height = 0;
+
+    //! The number of coins in the UTXO set contained in this snapshot. Used
+    //! during snapshot load to estimate progress of UTXO set reconstruction.
+    uint64_t m_coins_count = 0;
+
+    //! The serialized hash of the UTXO set, as reported by gettxoutsetinfo.
+    uint256 m_hash_serialized;
+
+    //! The contract state roots of the base block.
+    uint256 m_state_root;
+    uint256 m_utxo_root;
+
+    SnapshotMetadata() { }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(m_base_blockhash);
+        READWRITE(m_base_height);
+        READWRITE(m_coins_count);
+        READWRITE(m_hash_serialized);
+        READWRITE(m_state_root);
+        READWRITE(m_utxo_root);
+    }
+};
+
+#endif // BITCOIN_NODE_UTXO_SNAPSHOT_H
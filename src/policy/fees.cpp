@@ -504,6 +504,14 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     }
 }
 
+/** Gas price the fee of a contract tx pays for its gas limit, 0 for txs without gas */
+static double GetEntryGasPrice(const CTxMemPoolEntry& entry)
+{
+    if (!entry.GetTx().HasCreateOrCall() || entry.GetGasLimit() == 0)
+        return 0;
+    return (double)entry.GetFee() / entry.GetGasLimit();
+}
+
 // This function is called from CTxMemPool::removeUnchecked to ensure
 // txs removed from the mempool for any reason are no longer
 // tracked. Txs that were part of a block have already been removed in
@@ -517,6 +525,9 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
         feeStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         shortStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
         longStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex, inBlock);
+        if (pos->second.fGasTracked) {
+            gasStats->removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.gasBucketIndex, inBlock);
+        }
         mapMemPoolTxs.erase(hash);
         return true;
     } else {
@@ -540,6 +551,18 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     feeStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
     shortStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
     longStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+
+    static_assert(MIN_BUCKET_GASPRICE > 0, "Min gas price must be nonzero");
+    size_t gasBucketIndex = 0;
+    for (double bucketBoundary = MIN_BUCKET_GASPRICE; bucketBoundary <= MAX_BUCKET_GASPRICE; bucketBoundary *= FEE_SPACING, gasBucketIndex++) {
+        gasBuckets.push_back(bucketBoundary);
+        gasBucketMap[bucketBoundary] = gasBucketIndex;
+    }
+    gasBuckets.push_back(INF_FEERATE);
+    gasBucketMap[INF_FEERATE] = gasBucketIndex;
+    assert(gasBucketMap.size() == gasBuckets.size());
+
+    gasStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(gasBuckets, gasBucketMap, GAS_BLOCK_PERIODS, GAS_DECAY, GAS_SCALE));
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
@@ -583,6 +606,12 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     assert(bucketIndex == bucketIndex2);
     unsigned int bucketIndex3 = longStats->NewTx(txHeight, (double)feeRate.GetFeePerK());
     assert(bucketIndex == bucketIndex3);
+
+    double gasPrice = GetEntryGasPrice(entry);
+    if (gasPrice > 0) {
+        mapMemPoolTxs[hash].fGasTracked = true;
+        mapMemPoolTxs[hash].gasBucketIndex = gasStats->NewTx(txHeight, gasPrice);
+    }
 }
 
 bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry)
@@ -592,11 +621,6 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
         return false;
     }
 
-    if(entry->GetTx().HasCreateOrCall()){
-    	//Exclude contract transactions
-    	return false;
-    }
-
     // How many blocks did it take for miners to include this transaction?
     // blocksToConfirm is 1-based, so a transaction included in the earliest
     // possible block has confirmation count of 1
@@ -608,6 +632,15 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
         return false;
     }
 
+    if(entry->GetTx().HasCreateOrCall()){
+        // Contract transactions are excluded from the feerate stats, the gas price stats count them
+        double gasPrice = GetEntryGasPrice(*entry);
+        if (gasPrice <= 0)
+            return false;
+        gasStats->Record(blocksToConfirm, gasPrice);
+        return true;
+    }
+
     // Feerates are stored and reported as BTC-per-kb:
     CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
 
@@ -639,11 +672,13 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
     feeStats->ClearCurrent(nBlockHeight);
     shortStats->ClearCurrent(nBlockHeight);
     longStats->ClearCurrent(nBlockHeight);
+    gasStats->ClearCurrent(nBlockHeight);
 
     // Decay all exponential averages
     feeStats->UpdateMovingAverages();
     shortStats->UpdateMovingAverages();
     longStats->UpdateMovingAverages();
+    gasStats->UpdateMovingAverages();
 
     unsigned int countedTxs = 0;
     // Update averages with data points from current block
@@ -901,6 +936,34 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation
     return CFeeRate(llround(median));
 }
 
+/** estimateGasPrice returns the max of the gas prices calculated with the same
+ * thresholds as estimateSmartFee, from the gas price stats only.
+ */
+CAmount CBlockPolicyEstimator::estimateGasPrice(int confTarget, int *returnedTarget) const
+{
+    LOCK(m_cs_fee_estimator);
+
+    // It's not possible to get reasonable estimates for confTarget of 1
+    if (confTarget < 2) confTarget = 2;
+
+    unsigned int maxUsableEstimate = std::min(gasStats->GetMaxConfirms(), std::max(BlockSpan(), HistoricalBlockSpan()) / 2);
+    if ((unsigned int)confTarget > maxUsableEstimate) {
+        confTarget = maxUsableEstimate;
+    }
+    if (returnedTarget) *returnedTarget = confTarget;
+
+    if (confTarget <= 1) return 0; // error condition
+
+    double median = gasStats->EstimateMedianVal(confTarget / 2, SUFFICIENT_FEETXS, HALF_SUCCESS_PCT, true, nBestSeenHeight);
+    median = std::max(median, gasStats->EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, SUCCESS_PCT, true, nBestSeenHeight));
+    if ((unsigned int)(2 * confTarget) <= gasStats->GetMaxConfirms()) {
+        median = std::max(median, gasStats->EstimateMedianVal(2 * confTarget, SUFFICIENT_FEETXS, DOUBLE_SUCCESS_PCT, true, nBestSeenHeight));
+    }
+
+    if (median < 0) return 0; // error condition
+
+    return (CAmount)ceil(median);
+}
 
 bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
 {
@@ -919,6 +982,9 @@ bool CBlockPolicyEstimator::Write(CAutoFile& fileout) const
         feeStats->Write(fileout);
         shortStats->Write(fileout);
         longStats->Write(fileout);
+        // Appended after the feerate stats, so older versions still read the file
+        fileout << gasBuckets;
+        gasStats->Write(fileout);
     }
     catch (const std::exception&) {
         LogPrintf("CBlockPolicyEstimator::Write(): unable to write policy estimator data (non-fatal)\n");
@@ -978,6 +1044,27 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+
+            // Files written before the gas price stats were added end here
+            try {
+                std::vector<double> fileGasBuckets;
+                filein >> fileGasBuckets;
+                size_t numGasBuckets = fileGasBuckets.size();
+                if (numGasBuckets <= 1 || numGasBuckets > 1000)
+                    throw std::runtime_error("Corrupt estimates file. Must have between 2 and 1000 gas price buckets");
+
+                std::unique_ptr<TxConfirmStats> fileGasStats(new TxConfirmStats(gasBuckets, gasBucketMap, GAS_BLOCK_PERIODS, GAS_DECAY, GAS_SCALE));
+                fileGasStats->Read(filein, nVersionThatWrote, numGasBuckets);
+
+                gasBuckets = fileGasBuckets;
+                gasBucketMap.clear();
+                for (unsigned int i = 0; i < gasBuckets.size(); i++) {
+                    gasBucketMap[gasBuckets[i]] = i;
+                }
+                gasStats = std::move(fileGasStats);
+            } catch (const std::exception& e) {
+                LogPrint(BCLog::ESTIMATEFEE, "CBlockPolicyEstimator::Read(): no gas price estimator data: %s\n", e.what());
+            }
         }
     }
     catch (const std::exception& e) {
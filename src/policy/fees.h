@@ -184,6 +184,15 @@ private:
      */
     static constexpr double FEE_SPACING = 1.05;
 
+    /** Track confirm delays of contract txs up to 48 blocks, with the medium horizon decay */
+    static constexpr unsigned int GAS_BLOCK_PERIODS = MED_BLOCK_PERIODS;
+    static constexpr unsigned int GAS_SCALE = MED_SCALE;
+    static constexpr double GAS_DECAY = MED_DECAY;
+
+    /** Minimum and Maximum values for tracking gas prices, in satoshis per gas, spaced by FEE_SPACING */
+    static constexpr double MIN_BUCKET_GASPRICE = 1;
+    static constexpr double MAX_BUCKET_GASPRICE = 1e6;
+
 public:
     /** Create new BlockPolicyEstimator and initialize stats tracking classes with default values */
     CBlockPolicyEstimator();
@@ -215,6 +224,13 @@ public:
      */
     CFeeRate estimateRawFee(int confTarget, double successThreshold, FeeEstimateHorizon horizon, EstimationResult *result = nullptr) const;
 
+    /** Estimate the gas price, in satoshis per gas, the fee of a contract tx needs to pay for its
+     *  gas limit to be included in a block within confTarget blocks. The target is clamped to the
+     *  targets the gas price stats can answer, returnedTarget is set to the one used. Returns 0
+     *  when there is not enough data.
+     */
+    CAmount estimateGasPrice(int confTarget, int *returnedTarget) const;
+
     /** Write estimation data to a file */
     bool Write(CAutoFile& fileout) const;
 
@@ -239,7 +255,9 @@ private:
     {
         unsigned int blockHeight;
         unsigned int bucketIndex;
-        TxStatsInfo() : blockHeight(0), bucketIndex(0) {}
+        bool fGasTracked;
+        unsigned int gasBucketIndex;
+        TxStatsInfo() : blockHeight(0), bucketIndex(0), fGasTracked(false), gasBucketIndex(0) {}
     };
 
     // map of txids to information about that transaction
@@ -249,12 +267,19 @@ private:
     std::unique_ptr<TxConfirmStats> feeStats PT_GUARDED_BY(m_cs_fee_estimator);
     std::unique_ptr<TxConfirmStats> shortStats PT_GUARDED_BY(m_cs_fee_estimator);
     std::unique_ptr<TxConfirmStats> longStats PT_GUARDED_BY(m_cs_fee_estimator);
+    /** Confirmations of contract txs by the gas price their fee pays for their gas limit.
+     *  Their gas is charged at the oracle price and the miner orders them by gas price,
+     *  not by feerate, so they are kept out of the feerate stats.
+     */
+    std::unique_ptr<TxConfirmStats> gasStats PT_GUARDED_BY(m_cs_fee_estimator);
 
     unsigned int trackedTxs GUARDED_BY(m_cs_fee_estimator);
     unsigned int untrackedTxs GUARDED_BY(m_cs_fee_estimator);
 
     std::vector<double> buckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap GUARDED_BY(m_cs_fee_estimator); // Map of bucket upper-bound to index into all vectors by bucket
+    std::vector<double> gasBuckets GUARDED_BY(m_cs_fee_estimator); // The upper-bound of the range for the gas price bucket (inclusive)
+    std::map<double, unsigned int> gasBucketMap GUARDED_BY(m_cs_fee_estimator); // Map of gas price bucket upper-bound to index into the gas stats
 
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
@@ -13,7 +13,10 @@
 #include <timedata.h>
 #include <chainparams.h>
 #include <script/sign.h>
+#include <script/sigcache.h>
 #include <consensus/consensus.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
 #include <util/signstr.h>
 #include <qtum/qtumdelegation.h>
 
@@ -161,6 +164,20 @@ bool GetStakeCoin(const COutPoint& prevout, Coin& coinPrev, CBlockIndex*& blockF
 }
 
 // Check kernel hash target and coinstake signature
+/** Verify a proof of delegation, the key recovered from it goes through the recovered key cache */
+static bool VerifyProofOfDelegation(const CKeyID& keyID, const std::string& strStaker, const std::vector<unsigned char>& vchPoD)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << SignStr::strMessageMagic;
+    ss << strStaker;
+
+    CPubKey pubkey;
+    if (!CachedRecoverCompact(ss.GetHash(), vchPoD, pubkey))
+        return false;
+
+    return pubkey.GetID() == keyID;
+}
+
 bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const CTransaction& tx, unsigned int nBits, uint32_t nTimeBlock, const std::vector<unsigned char>& vchPoD,  const COutPoint& headerPrevout, uint256& hashProofOfStake, uint256& targetProofOfStake, CCoinsViewCache& view)
 {
     if (!tx.IsCoinStake())
@@ -240,7 +257,7 @@ bool CheckProofOfStake(CBlockIndex* pindexPrev, CValidationState& state, const C
             // Check that the staker have the permission to use that coin to create the coinstake transaction
             CScript stakerPubKey = tx.vout[1].scriptPubKey;
             uint160 staker = uint160(ExtractPublicKeyHash(stakerPubKey));
-            if(!SignStr::VerifyMessage(CKeyID(address), staker.GetReverseHex(), vchPoD))
+            if(!VerifyProofOfDelegation(CKeyID(address), staker.GetReverseHex(), vchPoD))
                 return state.DoS(100, error("CheckProofOfStake() : VerifyDelegation failed on coinstake %s", tx.GetHash().ToString()));
 
             // Check the super staker min utxo value
@@ -328,12 +345,40 @@ bool CheckBlockInputPubKeyMatchesOutputPubKey(const CBlock& block, CCoinsViewCac
     return true;
 }
 
+// Kernel coins found by the header checks, keyed by the previous block hash and the prevout
+static const size_t MAX_KERNEL_COIN_CACHE = 10000;
+static std::map<std::pair<uint256, COutPoint>, Coin> mapKernelCoinCache GUARDED_BY(cs_main);
+
+// Get the kernel coin of a header on top of pindexPrev, the coin is looked up at the tip
+// and in the main chain blocks after the fork, so the result is kept for the next checks
+static bool GetKernelCoin(CBlockIndex* pindexPrev, const COutPoint& prevout, CCoinsViewCache& view, Coin& coin)
+{
+    AssertLockHeld(cs_main);
+
+    std::pair<uint256, COutPoint> key(pindexPrev->GetBlockHash(), prevout);
+    auto it = mapKernelCoinCache.find(key);
+    if(it != mapKernelCoinCache.end()) {
+        coin = it->second;
+        return true;
+    }
+
+    if(!view.GetCoin(prevout, coin)){
+        if(!GetSpentCoinFromMainChain(pindexPrev, prevout, &coin)) {
+            return false;
+        }
+    }
+
+    if(mapKernelCoinCache.size() > MAX_KERNEL_COIN_CACHE) {
+        mapKernelCoinCache.clear();
+    }
+    mapKernelCoinCache[key] = coin;
+    return true;
+}
+
 bool CheckRecoveredPubKeyFromBlockSignature(CBlockIndex* pindexPrev, const CBlockHeader& block, CCoinsViewCache& view) {
     Coin coinPrev;
-    if(!view.GetCoin(block.prevoutStake, coinPrev)){
-        if(!GetSpentCoinFromMainChain(pindexPrev, block.prevoutStake, &coinPrev)) {
-            return error("CheckRecoveredPubKeyFromBlockSignature(): Could not find %s and it was not at the tip", block.prevoutStake.hash.GetHex());
-        }
+    if(!GetKernelCoin(pindexPrev, block.prevoutStake, view, coinPrev)){
+        return error("CheckRecoveredPubKeyFromBlockSignature(): Could not find %s and it was not at the tip", block.prevoutStake.hash.GetHex());
     }
 
     uint256 hash = block.GetHashWithoutSign();
@@ -355,10 +400,10 @@ bool CheckRecoveredPubKeyFromBlockSignature(CBlockIndex* pindexPrev, const CBloc
             // Has delegation
             CTxDestination address;
             txnouttype txType=TX_NONSTANDARD;
-            if(pubkey.RecoverCompact(hash, vchBlockSig) &&
+            if(RecoverBlockSignatureKey(block, pubkey) &&
                     ExtractDestination(coinPrev.out.scriptPubKey, address, &txType)){
                 if ((txType == TX_PUBKEY || txType == TX_PUBKEYHASH) && address.type() == typeid(CKeyID)) {
-                    if(SignStr::VerifyMessage(CKeyID(boost::get<CKeyID>(address)), pubkey.GetID().GetReverseHex(), vchPoD)) {
+                    if(VerifyProofOfDelegation(CKeyID(boost::get<CKeyID>(address)), pubkey.GetID().GetReverseHex(), vchPoD)) {
                         return true;
                     }
                 }
@@ -369,7 +414,7 @@ bool CheckRecoveredPubKeyFromBlockSignature(CBlockIndex* pindexPrev, const CBloc
             // No delegation
             CTxDestination address;
             txnouttype txType=TX_NONSTANDARD;
-            if(pubkey.RecoverCompact(hash, vchBlockSig) &&
+            if(RecoverBlockSignatureKey(block, pubkey) &&
                     ExtractDestination(coinPrev.out.scriptPubKey, address, &txType)){
                 if ((txType == TX_PUBKEY || txType == TX_PUBKEYHASH) && address.type() == typeid(CKeyID)) {
                     if(pubkey.GetID() == boost::get<CKeyID>(address)) {
@@ -418,10 +463,8 @@ bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBloc
     if(it == cache.end()) {
         //not found in cache (shouldn't happen during staking, only during verification which does not use cache)
         Coin coinPrev;
-        if(!view.GetCoin(prevout, coinPrev)){
-            if(!GetSpentCoinFromMainChain(pindexPrev, prevout, &coinPrev)) {
-                return error("CheckKernel(): Could not find coin and it was not at the tip");
-            }
+        if(!GetKernelCoin(pindexPrev, prevout, view, coinPrev)){
+            return error("CheckKernel(): Could not find coin and it was not at the tip");
         }
 
         int nHeight = pindexPrev->nHeight + 1;
@@ -463,6 +506,121 @@ bool CheckKernelCache(CBlockIndex *pindexPrev, unsigned int nBits, uint32_t nTim
     return false;
 }
 
+void CheckKernelCache(CBlockIndex* pindexPrev, unsigned int nBits, const std::vector<uint32_t>& vTimeBlock, const COutPoint& prevout, const std::map<COutPoint, CStakeCache>& cache, std::vector<std::pair<uint32_t, uint256>>& solved)
+{
+    auto it=cache.find(prevout);
+    if(it != cache.end())
+        CheckKernelCache(pindexPrev, nBits, vTimeBlock, prevout, it->second, solved);
+}
+
+void CheckKernelCache(CBlockIndex* pindexPrev, unsigned int nBits, const std::vector<uint32_t>& vTimeBlock, const COutPoint& prevout, const CStakeCache& stake, std::vector<std::pair<uint32_t, uint256>>& solved)
+{
+    if(stake.amount <= 0)
+        return;
+
+    // Same target as CheckStakeKernelHash
+    int nHeight = pindexPrev->nHeight + 1;
+    bool fNoBNOverflow = nHeight >= Params().GetConsensus().nReduceBlocktimeHeight;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits);
+    arith_uint256 bnWeight = arith_uint256(stake.amount);
+    if(!fNoBNOverflow)
+        bnTarget *= bnWeight;
+
+    // The kernel is the stake modifier, block from time, prevout hash, prevout n and block time, 76 bytes.
+    // Only the second SHA256 block of the first hash depends on the block time.
+    unsigned char kernel[76];
+    memcpy(kernel, pindexPrev->nStakeModifier.begin(), 32);
+    WriteLE32(kernel + 32, stake.blockFromTime);
+    memcpy(kernel + 36, prevout.hash.begin(), 32);
+    WriteLE32(kernel + 68, prevout.n);
+    CSHA256 midstate;
+    midstate.Write(kernel, 64);
+
+    for(const uint32_t& nTimeBlock : vTimeBlock)
+    {
+        if(nTimeBlock < stake.blockFromTime)
+            continue;
+
+        WriteLE32(kernel + 72, nTimeBlock);
+        unsigned char inner[CSHA256::OUTPUT_SIZE];
+        uint256 hashProofOfStake;
+        CSHA256(midstate).Write(kernel + 64, 12).Finalize(inner);
+        CSHA256().Write(inner, CSHA256::OUTPUT_SIZE).Finalize(hashProofOfStake.begin());
+
+        arith_uint256 bnProofOfStake = UintToArith256(hashProofOfStake);
+        if(fNoBNOverflow)
+            bnProofOfStake /= bnWeight;
+        if(bnProofOfStake <= bnTarget)
+            solved.push_back(std::make_pair(nTimeBlock, hashProofOfStake));
+    }
+}
+
+void CheckKernelCache(CBlockIndex* pindexPrev, unsigned int nBits, const std::vector<uint32_t>& vTimeBlock, const std::vector<COutPoint>& prevouts, const std::vector<CStakeCache>& stakes, size_t from, size_t to, std::vector<std::pair<size_t, std::pair<uint32_t, uint256>>>& solved)
+{
+    // Same target as CheckStakeKernelHash
+    int nHeight = pindexPrev->nHeight + 1;
+    bool fNoBNOverflow = nHeight >= Params().GetConsensus().nReduceBlocktimeHeight;
+    arith_uint256 bnTargetBase;
+    bnTargetBase.SetCompact(nBits);
+
+    // The kernels are hashed in batches, a multiple of the lanes of the multi-way transform
+    static const size_t KERNEL_BATCH = 64;
+    unsigned char kernels[KERNEL_BATCH][76];
+    const unsigned char* in[KERNEL_BATCH];
+    size_t lens[KERNEL_BATCH];
+    std::pair<size_t, uint32_t> items[KERNEL_BATCH];
+    unsigned char out[KERNEL_BATCH * CSHA256::OUTPUT_SIZE];
+    size_t count = 0;
+
+    auto check = [&]() {
+        SHA256DMany(out, in, lens, count);
+        for(size_t k = 0; k < count; k++)
+        {
+            const CStakeCache& stake = stakes[items[k].first];
+            uint256 hashProofOfStake;
+            memcpy(hashProofOfStake.begin(), out + k * CSHA256::OUTPUT_SIZE, CSHA256::OUTPUT_SIZE);
+            arith_uint256 bnWeight = arith_uint256(stake.amount);
+            arith_uint256 bnTarget = bnTargetBase;
+            arith_uint256 bnProofOfStake = UintToArith256(hashProofOfStake);
+            if(fNoBNOverflow)
+                bnProofOfStake /= bnWeight;
+            else
+                bnTarget *= bnWeight;
+            if(bnProofOfStake <= bnTarget)
+                solved.push_back(std::make_pair(items[k].first, std::make_pair(items[k].second, hashProofOfStake)));
+        }
+        count = 0;
+    };
+
+    for(size_t i = from; i < to; i++)
+    {
+        const CStakeCache& stake = stakes[i];
+        if(stake.amount <= 0)
+            continue;
+
+        for(const uint32_t& nTimeBlock : vTimeBlock)
+        {
+            if(nTimeBlock < stake.blockFromTime)
+                continue;
+
+            unsigned char* kernel = kernels[count];
+            memcpy(kernel, pindexPrev->nStakeModifier.begin(), 32);
+            WriteLE32(kernel + 32, stake.blockFromTime);
+            memcpy(kernel + 36, prevouts[i].hash.begin(), 32);
+            WriteLE32(kernel + 68, prevouts[i].n);
+            WriteLE32(kernel + 72, nTimeBlock);
+            in[count] = kernel;
+            lens[count] = 76;
+            items[count] = std::make_pair(i, nTimeBlock);
+            if(++count == KERNEL_BATCH)
+                check();
+        }
+    }
+    if(count > 0)
+        check();
+}
+
 void CacheKernel(std::map<COutPoint, CStakeCache>& cache, const COutPoint& prevout, CBlockIndex* pindexPrev, CCoinsViewCache& view){
     if(cache.find(prevout) != cache.end()){
         //already in cache
@@ -486,6 +644,9 @@ void CacheKernel(std::map<COutPoint, CStakeCache>& cache, const COutPoint& prevo
 
     CStakeCache c(blockFrom->nTime, coinPrev.out.nValue);
     cache.insert({prevout, c});
+
+    // The staker checks the coin for every new block, keep it cached across flushes
+    view.PinCoin(prevout);
 }
 
 /**
@@ -503,16 +664,20 @@ void CacheKernel(std::map<COutPoint, CStakeCache>& cache, const COutPoint& prevo
         hasDelegate(false)
     {}
 };
-struct ScriptsElement{
-    BlockScript script;
+struct MPoSScriptEntry{
+    int nHeight = -1;
     uint256 hash;
+    BlockScript script;
 };
 
 /**
- * Cache of the recent mpos scripts for the block reward recipients
- * The max size of the map is 2 * nCacheScripts - nMPoSRewardRecipients, so in this case it is 20
+ * Ring buffer of the mpos scripts of the recent blocks, the script of height h is in slot h % size.
+ * The stakers are added when their block is connected and removed when it is disconnected, the size
+ * covers the coinbase maturity and the reward recipients, so the recipients of the next block are
+ * always in the ring once the node has connected that many blocks. An entry is only used when its
+ * block is still the one in the active chain at its height.
  */
-std::map<int, ScriptsElement> scriptsMap;
+static std::vector<MPoSScriptEntry> mposScriptRing;
 
 unsigned int GetStakeMaxCombineInputs() { return 100; }
 
@@ -567,64 +732,72 @@ bool GetDelegationFeeFromContract(const uint160& address, uint8_t& fee)
     return ret;
 }
 
-bool NeedToEraseScriptFromCache(int nBlockHeight, int nCacheScripts, int nScriptHeight, const ScriptsElement& scriptElement)
+static size_t GetMPoSScriptRingSize(const Consensus::Params& consensusParams)
 {
-    // Erase element from cache if not in range [nBlockHeight - nCacheScripts, nBlockHeight + nCacheScripts]
-    if(nScriptHeight < (nBlockHeight - nCacheScripts) ||
-            nScriptHeight > (nBlockHeight + nCacheScripts))
-        return true;
-
-    // Erase element from cache if hash different
-    CBlockIndex* pblockindex = chainActive[nScriptHeight];
-    if(pblockindex && pblockindex->GetBlockHash() != scriptElement.hash)
-        return true;
-
-    return false;
+    return std::max(consensusParams.nCoinbaseMaturity, consensusParams.nRBTCoinbaseMaturity) + consensusParams.nMPoSRewardRecipients;
 }
 
-void CleanScriptCache(int nHeight, const Consensus::Params& consensusParams)
+static MPoSScriptEntry& GetMPoSScriptSlot(int nHeight, const Consensus::Params& consensusParams)
 {
-    int nCacheScripts = consensusParams.nMPoSRewardRecipients * 1.5;
-
-    // Remove the scripts from cache that are not used
-    for (std::map<int, ScriptsElement>::iterator it=scriptsMap.begin(); it!=scriptsMap.end();){
-        if(NeedToEraseScriptFromCache(nHeight, nCacheScripts, it->first, it->second))
-        {
-            it = scriptsMap.erase(it);
-        }
-        else{
-            it++;
-        }
+    size_t nSize = GetMPoSScriptRingSize(consensusParams);
+    if(mposScriptRing.size() != nSize)
+    {
+        mposScriptRing.assign(nSize, MPoSScriptEntry());
     }
+    return mposScriptRing[nHeight % nSize];
+}
+
+static void AddToScriptCache(const BlockScript& script, const CBlockIndex* pblockindex, const Consensus::Params& consensusParams)
+{
+    MPoSScriptEntry& entry = GetMPoSScriptSlot(pblockindex->nHeight, consensusParams);
+    entry.nHeight = pblockindex->nHeight;
+    entry.hash = pblockindex->GetBlockHash();
+    entry.script = script;
 }
 
-bool ReadFromScriptCache(BlockScript &script, CBlockIndex* pblockindex, int nHeight, const Consensus::Params& consensusParams)
+static BlockScript MakeMPoSScript(const uint160& stakeAddress, bool hasDelegate, const uint160& delegateAddress, uint8_t fee)
 {
-    CleanScriptCache(nHeight, consensusParams);
+    BlockScript blockScript;
+    if(stakeAddress == uint160())
+    {
+        LogPrint(BCLog::COINSTAKE, "Fail to solve script for mpos reward recipient\n");
+        //This should never fail, but in case it somehow did we don't want it to bring the network to a halt
+        //So, use an OP_RETURN script to burn the coins for the unknown staker
+        blockScript = CScript() << OP_RETURN;
+    }else{
+        // Make public key hash script
+        blockScript = CScript() << OP_DUP << OP_HASH160 << ToByteVector(stakeAddress) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
 
-    // Find the script in the cache
-    std::map<int, ScriptsElement>::iterator it = scriptsMap.find(nHeight);
-    if(it != scriptsMap.end())
+    if(hasDelegate)
     {
-        if(it->second.hash == pblockindex->GetBlockHash())
+        if(delegateAddress == uint160())
         {
-            script = it->second.script;
-            return true;
+            LogPrint(BCLog::COINSTAKE, "Fail to solve script for mpos delegate reward recipient\n");
+            blockScript.delegateScript = CScript() << OP_RETURN;
+        }else{
+            // Make public key hash script
+            blockScript.delegateScript = CScript() << OP_DUP << OP_HASH160 << ToByteVector(delegateAddress) << OP_EQUALVERIFY << OP_CHECKSIG;
         }
-    }
 
-    return false;
+        blockScript.fee = fee;
+        blockScript.hasDelegate = true;
+    }
+    return blockScript;
 }
 
-void AddToScriptCache(BlockScript script, CBlockIndex* pblockindex, int nHeight, const Consensus::Params& consensusParams)
+void ConnectMPoSScript(const CBlockIndex* pindex, const uint160& stakeAddress, bool hasDelegate, const uint160& delegateAddress, uint8_t fee, const Consensus::Params& consensusParams)
 {
-    CleanScriptCache(nHeight, consensusParams);
+    AddToScriptCache(MakeMPoSScript(stakeAddress, hasDelegate, delegateAddress, fee), pindex, consensusParams);
+}
 
-    // Add the script into the cache
-    ScriptsElement listElement;
-    listElement.script = script;
-    listElement.hash = pblockindex->GetBlockHash();
-    scriptsMap.insert(std::pair<int, ScriptsElement>(nHeight, listElement));
+void DisconnectMPoSScript(const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    MPoSScriptEntry& entry = GetMPoSScriptSlot(pindex->nHeight, consensusParams);
+    if(entry.nHeight == pindex->nHeight)
+    {
+        entry = MPoSScriptEntry();
+    }
 }
 
 bool AddMPoSScript(std::vector<BlockScript> &mposScriptList, int nHeight, const Consensus::Params& consensusParams)
@@ -637,15 +810,16 @@ bool AddMPoSScript(std::vector<BlockScript> &mposScriptList, int nHeight, const
         return false;
     }
 
-    // Try find the script from the cache
-    BlockScript blockScript;
-    if(ReadFromScriptCache(blockScript, pblockindex, nHeight, consensusParams))
+    // Try find the script in the ring, it has the stakers of the blocks connected since startup
+    const MPoSScriptEntry& entry = GetMPoSScriptSlot(nHeight, consensusParams);
+    if(entry.nHeight == nHeight && entry.hash == pblockindex->GetBlockHash())
     {
-        mposScriptList.push_back(blockScript);
+        mposScriptList.push_back(entry.script);
         return true;
     }
 
-    // Read the block
+    // Read the stake index
+    BlockScript blockScript;
     uint160 stakeAddress;
     if(!pblocktree->ReadStakeIndex(nHeight, stakeAddress)){
         return false;
@@ -654,43 +828,19 @@ bool AddMPoSScript(std::vector<BlockScript> &mposScriptList, int nHeight, const
     // The block reward for PoS is in the second transaction (coinstake) and the second or third output
     if(pblockindex->IsProofOfStake())
     {
-        if(stakeAddress == uint160())
-        {
-            LogPrint(BCLog::COINSTAKE, "Fail to solve script for mpos reward recipient\n");
-            //This should never fail, but in case it somehow did we don't want it to bring the network to a halt
-            //So, use an OP_RETURN script to burn the coins for the unknown staker
-            blockScript = CScript() << OP_RETURN;
-        }else{
-            // Make public key hash script
-            blockScript = CScript() << OP_DUP << OP_HASH160 << ToByteVector(stakeAddress) << OP_EQUALVERIFY << OP_CHECKSIG;
-        }
-
-        if(pblockindex->HasProofOfDelegation())
-        {
-            uint160 delegateAddress;
-            uint8_t fee;
-            if(!pblocktree->ReadDelegateIndex(nHeight, delegateAddress, fee)){
-                return false;
-            }
-
-            if(delegateAddress == uint160())
-            {
-                LogPrint(BCLog::COINSTAKE, "Fail to solve script for mpos delegate reward recipient\n");
-                blockScript.delegateScript = CScript() << OP_RETURN;
-            }else{
-                // Make public key hash script
-                blockScript.delegateScript = CScript() << OP_DUP << OP_HASH160 << ToByteVector(delegateAddress) << OP_EQUALVERIFY << OP_CHECKSIG;
-            }
-
-            blockScript.fee = fee;
-            blockScript.hasDelegate = true;
+        uint160 delegateAddress;
+        uint8_t fee = 0;
+        bool hasDelegate = pblockindex->HasProofOfDelegation();
+        if(hasDelegate && !pblocktree->ReadDelegateIndex(nHeight, delegateAddress, fee)){
+            return false;
         }
+        blockScript = MakeMPoSScript(stakeAddress, hasDelegate, delegateAddress, fee);
 
         // Add the script into the list
         mposScriptList.push_back(blockScript);
 
         // Update script cache
-        AddToScriptCache(blockScript, pblockindex, nHeight, consensusParams);
+        AddToScriptCache(blockScript, pblockindex, consensusParams);
     }
     else
     {
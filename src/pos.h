@@ -17,6 +17,8 @@
 #include <consensus/consensus.h>
 
 struct CStakeCache{
+    CStakeCache() : blockFromTime(0), amount(0){
+    }
     CStakeCache(uint32_t blockFromTime_, CAmount amount_) : blockFromTime(blockFromTime_), amount(amount_){
     }
     uint32_t blockFromTime;
@@ -52,6 +54,16 @@ bool CheckRecoveredPubKeyFromBlockSignature(CBlockIndex* pindexPrev, const CBloc
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBlock, const COutPoint& prevout, CCoinsViewCache& view);
 bool CheckKernel(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBlock, const COutPoint& prevout, CCoinsViewCache& view, const std::map<COutPoint, CStakeCache>& cache);
 bool CheckKernelCache(CBlockIndex* pindexPrev, unsigned int nBits, uint32_t nTimeBlock, const COutPoint& prevout, const std::map<COutPoint, CStakeCache>& cache, uint256& hashProofOfStake);
+// Staker variant of CheckKernelCache for several block times of one kernel input
+// The part of the kernel that does not depend on the block time is hashed once
+// Adds the block times that meet the target to solved, with their proof of stake hash
+void CheckKernelCache(CBlockIndex* pindexPrev, unsigned int nBits, const std::vector<uint32_t>& vTimeBlock, const COutPoint& prevout, const std::map<COutPoint, CStakeCache>& cache, std::vector<std::pair<uint32_t, uint256>>& solved);
+// Same as above with the cache entry of the kernel input already looked up, an empty entry never meets the target
+void CheckKernelCache(CBlockIndex* pindexPrev, unsigned int nBits, const std::vector<uint32_t>& vTimeBlock, const COutPoint& prevout, const CStakeCache& stake, std::vector<std::pair<uint32_t, uint256>>& solved);
+// Variant for the kernel inputs from to to of prevouts, hashing the kernels of all inputs and block times together
+// with SHA256DMany, only faster than the variant above when SHA256DManyIsBatched()
+// Adds the index of the input, the block time and the proof of stake hash of the kernels that meet the target to solved
+void CheckKernelCache(CBlockIndex* pindexPrev, unsigned int nBits, const std::vector<uint32_t>& vTimeBlock, const std::vector<COutPoint>& prevouts, const std::vector<CStakeCache>& stakes, size_t from, size_t to, std::vector<std::pair<size_t, std::pair<uint32_t, uint256>>>& solved);
 
 unsigned int GetStakeMaxCombineInputs();
 
@@ -69,6 +81,12 @@ unsigned int GetStakeSplitOutputs();
 
 int64_t GetStakeSplitThreshold();
 
+// Record the staker, and the delegate when hasDelegate, of a connected block in the cache of the MPoS reward recipients
+void ConnectMPoSScript(const CBlockIndex* pindex, const uint160& stakeAddress, bool hasDelegate, const uint160& delegateAddress, uint8_t fee, const Consensus::Params& consensusParams);
+
+// Remove the staker of a disconnected block from the cache of the MPoS reward recipients
+void DisconnectMPoSScript(const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+
 bool GetMPoSOutputs(std::vector<CTxOut>& mposOutputList, int64_t nRewardPiece, int nHeight, const Consensus::Params& consensusParams);
 
 bool CreateMPoSOutputs(CMutableTransaction& txNew, int64_t nRewardPiece, int nHeight, const Consensus::Params& consensusParams);
@@ -325,6 +325,21 @@ public:
         _size += increase;
     }
 
+    // resize_uninitialized changes the size of the prevector but does not initialize it.
+    // If size < new_size, the added elements must be initialized explicitly.
+    void resize_uninitialized(size_type new_size) {
+        if (capacity() < new_size) {
+            change_capacity(new_size);
+            _size += new_size - size();
+            return;
+        }
+        if (new_size < size()) {
+            erase(item_ptr(new_size), end());
+        } else {
+            _size += new_size - size();
+        }
+    }
+
     void reserve(size_type new_capacity) {
         if (new_capacity > capacity()) {
             change_capacity(new_capacity);
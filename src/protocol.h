@@ -238,6 +238,43 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Indicates that a node prefers to receive "headers2" messages rather than
+ * "headers" messages, for block announcements and getheaders replies.
+ * @since protocol version 70025.
+ */
+extern const char *SENDHEADERS2;
+/**
+ * The headers2 message carries the same headers as a headers message, in the
+ * compact encoding of CCompactHeaders: the fields a header shares with the
+ * previous one in the message are omitted and the small ones are varints.
+ * @since protocol version 70025.
+ */
+extern const char *HEADERS2;
+/**
+ * Offers transaction reconciliation (see txreconciliation.h) to a peer that
+ * advertised NODE_TXRECONCILIATION, with our salt of the short transaction ids.
+ * @since protocol version 70026.
+ */
+extern const char *SENDRECON;
+/**
+ * Asks the peer for the sketch of the transactions it reconciles with us, with
+ * the size of our own set and the expected share of it that differs.
+ * @since protocol version 70026.
+ */
+extern const char *REQRECON;
+/**
+ * The sketch of the short ids of the set a reqrecon asked for, empty if the
+ * difference is too large to decode.
+ * @since protocol version 70026.
+ */
+extern const char *SKETCH;
+/**
+ * Whether the sketch could be decoded, and the short ids of the transactions
+ * the sender lacks. The transactions only the sender had are announced in invs.
+ * @since protocol version 70026.
+ */
+extern const char *RECONCILDIFF;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -268,6 +305,9 @@ enum ServiceFlags : uint64_t {
     // serving the last 288 (2 day) blocks
     // See BIP159 for details on how this is implemented.
     NODE_NETWORK_LIMITED = (1 << 10),
+    // NODE_TXRECONCILIATION means the node relays transactions to peers that also set it by
+    // reconciling sets of short transaction ids rather than announcing every transaction.
+    NODE_TXRECONCILIATION = (1 << 11),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -143,11 +143,11 @@ QString ClientModel::getStatusBarWarnings() const
 
 void ClientModel::getGasInfo(uint64_t& blockGasLimit, uint64_t& minGasPrice, uint64_t& nGasPrice) const
 {
-    LOCK(cs_main);
-
-    blockGasLimit = DGP_CACHE_BLOCK_GAS_LIMIT;
-    minGasPrice = CAmount(DGP_CACHE_FIAT_GAS_PRICE);
+    std::shared_ptr<const TipSnapshot> tip = GetTipSnapshot();
+    blockGasLimit = tip ? tip->nDgpBlockGasLimit : DGP_CACHE_BLOCK_GAS_LIMIT;
+    minGasPrice = CAmount(tip ? tip->nDgpFiatGasPrice : DGP_CACHE_FIAT_GAS_PRICE);
 
+    LOCK(cs_main);
     PriceOracle oracle;
     oracle.getPrice(nGasPrice);
 }
@@ -231,6 +231,12 @@ static void BannedListChanged(ClientModel *clientmodel)
     QMetaObject::invokeMethod(clientmodel, "updateBanlist", Qt::QueuedConnection);
 }
 
+static void DgpCacheChanged(ClientModel *clientmodel)
+{
+    // The node refreshed the DGP values, publish the new gas info
+    QMetaObject::invokeMethod(clientmodel, "updateTip", Qt::QueuedConnection);
+}
+
 static void BlockTipChanged(ClientModel *clientmodel, bool initialSync, int height, int64_t blockTime, double verificationProgress, bool fHeader)
 {
     // Wallet batch mode checks
@@ -288,6 +294,7 @@ void ClientModel::subscribeToCoreSignals()
     m_handler_banned_list_changed = m_node.handleBannedListChanged(boost::bind(BannedListChanged, this));
     m_handler_notify_block_tip = m_node.handleNotifyBlockTip(boost::bind(BlockTipChanged, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4, false));
     m_handler_notify_header_tip = m_node.handleNotifyHeaderTip(boost::bind(BlockTipChanged, this, boost::placeholders::_1, boost::placeholders::_2, boost::placeholders::_3, boost::placeholders::_4, true));
+    m_handler_notify_dgp_cache_changed = m_node.handleNotifyDgpCacheChanged(boost::bind(DgpCacheChanged, this));
 }
 
 void ClientModel::unsubscribeFromCoreSignals()
@@ -300,6 +307,7 @@ void ClientModel::unsubscribeFromCoreSignals()
     m_handler_banned_list_changed->disconnect();
     m_handler_notify_block_tip->disconnect();
     m_handler_notify_header_tip->disconnect();
+    m_handler_notify_dgp_cache_changed->disconnect();
 }
 
 bool ClientModel::getProxyInfo(std::string& ip_port) const
@@ -11,6 +11,7 @@
 #include <QFont>
 #include <QDebug>
 #include <QThread>
+#include <QSet>
 
 class DelegationItemEntry
 {
@@ -313,10 +314,15 @@ DelegationItemModel::DelegationItemModel(WalletModel *parent):
     QAbstractItemModel(parent),
     walletModel(parent),
     priv(0),
-    worker(0)
+    worker(0),
+    cachedDelegationsVersion(0)
 {
     columns << tr("Delegate") << tr("Staker Name") << tr("Staker Address") << tr("Fee") << tr("Height") << tr("Time");
 
+    // Only the delegations changed after the first refresh are checked again
+    std::vector<std::string> delegates;
+    walletModel->wallet().getDelegationChanges(cachedDelegationsVersion, delegates);
+
     priv = new DelegationItemPriv(this);
     priv->refreshDelegationItem(walletModel->wallet());
 
@@ -468,16 +474,29 @@ void DelegationItemModel::updateDelegationData(const QString &hash, int status,
     priv->updateEntry(delegationEntry, status);
 }
 
-void DelegationItemModel::checkDelegationChanged()
+void DelegationItemModel::checkDelegationChanged(bool balanceChanged)
 {
     if(!priv)
         return;
 
-    // Update delegation from contract
+    // Get the delegates changed on chain since the last check
+    std::vector<std::string> delegates;
+    bool fKnown = walletModel->wallet().getDelegationChanges(cachedDelegationsVersion, delegates);
+    QSet<QString> changed;
+    for(const std::string& delegate : delegates)
+    {
+        changed.insert(QString::fromStdString(delegate));
+    }
+
+    // Update from contract the delegations that changed or have transactions pending,
+    // all of them when the changes are not known or the wallet balance changed
     for(int i = 0; i < priv->cachedDelegationItem.size(); i++)
     {
-        DelegationItemEntry delegationEntry = priv->cachedDelegationItem[i];
-        updateDelegationData(delegationEntry);
+        const DelegationItemEntry& delegationEntry = priv->cachedDelegationItem[i];
+        if(!fKnown || balanceChanged || delegationEntry.status != CreateTxConfirmed || changed.contains(delegationEntry.delegateAddress))
+        {
+            updateDelegationData(delegationEntry);
+        }
     }
 }
 
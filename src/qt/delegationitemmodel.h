@@ -7,6 +7,7 @@
 #include <QtGlobal>
 
 #include <memory>
+#include <stdint.h>
 
 namespace interfaces {
 class Handler;
@@ -74,7 +75,7 @@ public:
     void join();
 
 public Q_SLOTS:
-    void checkDelegationChanged();
+    void checkDelegationChanged(bool balanceChanged);
     void itemChanged(QString hash, qint64 balance, qint64 stake, qint64 weight, qint32 status);
 
 private Q_SLOTS:
@@ -92,6 +93,7 @@ private:
     DelegationItemPriv* priv;
     DelegationWorker* worker;
     QThread t;
+    uint64_t cachedDelegationsVersion;
     std::unique_ptr<interfaces::Handler> m_handler_delegation_changed;
 
     friend class DelegationItemPriv;
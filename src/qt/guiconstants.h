@@ -8,8 +8,11 @@
 /* Milliseconds between model updates */
 static const int MODEL_UPDATE_DELAY = 2000;
 
-/* Milliseconds between DGP cache updates */
-static const int DGP_CACHE_UPDATE_DELAY = 300000;
+/* Token transaction list -- Records decoded per page */
+static const int TOKEN_TX_FETCH_SIZE = 500;
+
+/* Contract event log -- Receipts read from the log search at a time */
+static const int EVENT_LOG_PAGE_SIZE = 500;
 
 /* AskPassphraseDialog -- Maximum passphrase length */
 static const int MAX_PASSPHRASE_SIZE = 1024;
@@ -218,7 +218,8 @@ SuperStakerItemModel::SuperStakerItemModel(WalletModel *parent):
     QAbstractItemModel(parent),
     walletModel(parent),
     priv(0),
-    worker(0)
+    worker(0),
+    cachedStaking(false)
 {
     columns << tr("Staker Name") << tr("Staker Address") << tr("Minimum Fee") << tr("Staking");
 
@@ -365,11 +366,18 @@ void SuperStakerItemModel::updateSuperStakerData(const QString &hash, int status
     priv->updateEntry(superStakerEntry, status);
 }
 
-void SuperStakerItemModel::checkSuperStakerChanged()
+void SuperStakerItemModel::checkSuperStakerChanged(bool balanceChanged)
 {
     if(!priv)
         return;
 
+    // The wallet notifies the super stakers whose delegations weight changed,
+    // update them all only when the balance changed or staking started or stopped
+    bool staking = walletModel->wallet().getEnabledStaking() && walletModel->wallet().getLastCoinStakeSearchInterval();
+    if(!balanceChanged && staking == cachedStaking)
+        return;
+    cachedStaking = staking;
+
     // Update superStaker from contract
     for(int i = 0; i < priv->cachedSuperStakerItem.size(); i++)
     {
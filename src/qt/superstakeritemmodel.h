@@ -60,7 +60,7 @@ public:
     void join();
 
 public Q_SLOTS:
-    void checkSuperStakerChanged();
+    void checkSuperStakerChanged(bool balanceChanged);
     void itemChanged(QString hash, qint64 balance, qint64 stake, qint64 weight, qint64 delegationsWeight, bool staking);
 
 private Q_SLOTS:
@@ -78,6 +78,7 @@ private:
     SuperStakerItemPriv* priv;
     SuperStakerWorker* worker;
     QThread t;
+    bool cachedStaking;
     std::unique_ptr<interfaces::Handler> m_handler_superstaker_changed;
 
     friend class SuperStakerItemPriv;
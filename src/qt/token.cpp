@@ -129,46 +129,45 @@ bool Token::exec(const bool &sendTo, const std::map<std::string, std::string> &l
 
 bool Token::execEvents(const int64_t &fromBlock, const int64_t &toBlock, const int64_t &minconf, const std::string &eventName, const std::string &contractAddress, const std::string &senderAddress, const int &numTopics, std::vector<TokenEvent> &result)
 {
-    QVariant resultVar;
-    if(!(d->eventLog->searchTokenTx(d->model->node(), d->model, fromBlock, toBlock, minconf, eventName, contractAddress, senderAddress, numTopics, resultVar)))
-        return false;
-
-    QList<QVariant> list = resultVar.toList();
-    for(int i = 0; i < list.size(); i++)
+    interfaces::LogSearchCursor cursor;
+    std::vector<interfaces::ContractLogReceipt> receipts;
+    while(!cursor.complete)
     {
-        // Search the log for events
-        QVariantMap variantMap = list[i].toMap();
-        QList<QVariant> listLog = variantMap.value("log").toList();
-        for(int i = 0; i < listLog.size(); i++)
+        if(!(d->eventLog->searchTokenTx(d->model->node(), fromBlock, toBlock, minconf, eventName, contractAddress, senderAddress, numTopics, cursor, receipts)))
+            return false;
+
+        for(const interfaces::ContractLogReceipt& receipt : receipts)
         {
-            // Skip the not needed events
-            QVariantMap variantLog = listLog[i].toMap();
-            QList<QVariant> topicsList = variantLog.value("topics").toList();
-            if(topicsList.count() < numTopics) continue;
-            if(topicsList[0].toString().toStdString() != eventName) continue;
-
-            // Create new event
-            TokenEvent tokenEvent;
-            tokenEvent.address = variantMap.value("contractAddress").toString().toStdString();
-            if(numTopics > 1)
+            // Search the log for events
+            for(const interfaces::ContractLog& log : receipt.logs)
             {
-                tokenEvent.sender = topicsList[1].toString().toStdString().substr(24);
-                Token::ToQtumAddress(tokenEvent.sender, tokenEvent.sender);
+                // Skip the not needed events
+                const std::vector<std::string>& topicsList = log.topics;
+                if((int)topicsList.size() < numTopics) continue;
+                if(topicsList[0] != eventName) continue;
+
+                // Create new event
+                TokenEvent tokenEvent;
+                tokenEvent.address = receipt.contract_address;
+                if(numTopics > 1)
+                {
+                    tokenEvent.sender = topicsList[1].substr(24);
+                    Token::ToQtumAddress(tokenEvent.sender, tokenEvent.sender);
+                }
+                if(numTopics > 2)
+                {
+                    tokenEvent.receiver = topicsList[2].substr(24);
+                    Token::ToQtumAddress(tokenEvent.receiver, tokenEvent.receiver);
+                }
+                tokenEvent.blockHash = receipt.block_hash;
+                tokenEvent.blockNumber = receipt.block_number;
+                tokenEvent.transactionHash = receipt.transaction_hash;
+
+                // Parse data
+                tokenEvent.value = Token::ToUint256(log.data);
+
+                result.push_back(tokenEvent);
             }
-            if(numTopics > 2)
-            {
-                tokenEvent.receiver = topicsList[2].toString().toStdString().substr(24);
-                Token::ToQtumAddress(tokenEvent.receiver, tokenEvent.receiver);
-            }
-            tokenEvent.blockHash = uint256S(variantMap.value("blockHash").toString().toStdString());
-            tokenEvent.blockNumber = variantMap.value("blockNumber").toLongLong();
-            tokenEvent.transactionHash = uint256S(variantMap.value("transactionHash").toString().toStdString());
-
-            // Parse data
-            std::string data = variantLog.value("data").toString().toStdString();
-            tokenEvent.value = Token::ToUint256(data);
-
-            result.push_back(tokenEvent);
         }
     }
 
@@ -4,6 +4,7 @@
 #include <interfaces/wallet.h>
 #include <validation.h>
 #include <qt/bitcoinunits.h>
+#include <qt/guiconstants.h>
 #include <interfaces/node.h>
 #include <interfaces/handler.h>
 #include <algorithm>
@@ -13,6 +14,7 @@
 #include <QFont>
 #include <QDebug>
 #include <QThread>
+#include <QTimer>
 
 class TokenItemEntry
 {
@@ -126,6 +128,7 @@ private Q_SLOTS:
             tokenAbi.setSender(tokenInfo.sender_address);
             tokenAbi.transferEvents(tokenEvents, fromBlock, toBlock);
             tokenAbi.burnEvents(tokenEvents, fromBlock, toBlock);
+            std::vector<interfaces::TokenTx> tokenTxs;
             for(size_t i = 0; i < tokenEvents.size(); i++)
             {
                 TokenEvent event = tokenEvents[i];
@@ -137,8 +140,9 @@ private Q_SLOTS:
                 tokenTx.tx_hash = event.transactionHash;
                 tokenTx.block_hash = event.blockHash;
                 tokenTx.block_number = event.blockNumber;
-                walletModel->wallet().addTokenTxEntry(tokenTx, false);
+                tokenTxs.push_back(tokenTx);
             }
+            walletModel->wallet().addTokenTxEntries(tokenTxs, false);
 
             walletModel->wallet().addTokenEntry(tokenInfo);
         }
@@ -157,10 +161,16 @@ private Q_SLOTS:
         if(walletModel && walletModel->node().shutdownRequested())
             return;
             
-        tokenAbi.setAddress(contractAddress.toStdString());
-        tokenAbi.setSender(senderAddress.toStdString());
+        // Use the balance the wallet tracks from the block receipts, call the contract only without it
         std::string strBalance;
-        if(tokenAbi.balanceOf(strBalance))
+        bool found = walletModel && walletModel->wallet().getTokenBalance(uint256S(hash.toStdString()), strBalance);
+        if(!found)
+        {
+            tokenAbi.setAddress(contractAddress.toStdString());
+            tokenAbi.setSender(senderAddress.toStdString());
+            found = tokenAbi.balanceOf(strBalance);
+        }
+        if(found)
         {
             QString balance = QString::fromStdString(strBalance);
             Q_EMIT balanceChanged(hash, balance);
@@ -287,6 +297,17 @@ public:
         return -1;
     }
 
+    TokenItemEntry *find(const uint256 &hash)
+    {
+        QList<TokenItemEntry>::iterator lower = qLowerBound(
+            cachedTokenItem.begin(), cachedTokenItem.end(), hash, TokenItemEntryLessThan());
+        if(lower != cachedTokenItem.end() && lower->hash == hash)
+        {
+            return &(*lower);
+        }
+        return 0;
+    }
+
     int size()
     {
         return cachedTokenItem.size();
@@ -310,6 +331,7 @@ TokenItemModel::TokenItemModel(WalletModel *parent):
     walletModel(parent),
     priv(0),
     worker(0),
+    balanceTimer(0),
     tokenTxCleaned(false)
 {
     columns << tr("Token Name") << tr("Token Symbol") << tr("Balance");
@@ -324,6 +346,12 @@ TokenItemModel::TokenItemModel(WalletModel *parent):
 
     t.start();
 
+    // Balance changes of consecutive blocks are read together
+    balanceTimer = new QTimer(this);
+    balanceTimer->setSingleShot(true);
+    balanceTimer->setInterval(MODEL_UPDATE_DELAY);
+    connect(balanceTimer, SIGNAL(timeout()), this, SLOT(updatePendingBalances()));
+
     subscribeToCoreSignals();
 }
 
@@ -447,11 +475,14 @@ void TokenItemModel::checkTokenBalanceChanged()
     if(!priv)
         return;
 
-    // Update token balance
-    for(int i = 0; i < priv->cachedTokenItem.size(); i++)
+    // Update token balance, with log events the wallet announces the changes instead
+    if(!fLogEvents)
     {
-        TokenItemEntry tokenEntry = priv->cachedTokenItem[i];
-        updateBalance(tokenEntry);
+        for(int i = 0; i < priv->cachedTokenItem.size(); i++)
+        {
+            TokenItemEntry tokenEntry = priv->cachedTokenItem[i];
+            updateBalance(tokenEntry);
+        }
     }
 
     // Update token transactions
@@ -509,16 +540,46 @@ static void NotifyTokenChanged(TokenItemModel *tim, const uint256 &hash, ChangeT
     notification.invoke(tim);
 }
 
+static void NotifyTokenBalanceChanged(TokenItemModel *tim, const uint256 &hash)
+{
+    QMetaObject::invokeMethod(tim, "tokenBalanceChanged", Qt::QueuedConnection,
+                              Q_ARG(QString, QString::fromStdString(hash.GetHex())));
+}
+
 void TokenItemModel::subscribeToCoreSignals()
 {
     // Connect signals to wallet
     m_handler_token_changed = walletModel->wallet().handleTokenChanged(boost::bind(NotifyTokenChanged, this, boost::placeholders::_1, boost::placeholders::_2));
+    m_handler_token_balance_changed = walletModel->wallet().handleTokenBalanceChanged(boost::bind(NotifyTokenBalanceChanged, this, boost::placeholders::_1));
 }
 
 void TokenItemModel::unsubscribeFromCoreSignals()
 {
     // Disconnect signals from wallet
     m_handler_token_changed->disconnect();
+    m_handler_token_balance_changed->disconnect();
+}
+
+void TokenItemModel::tokenBalanceChanged(const QString &hash)
+{
+    pendingBalances.insert(hash);
+    if(!balanceTimer->isActive())
+    {
+        balanceTimer->start();
+    }
+}
+
+void TokenItemModel::updatePendingBalances()
+{
+    for(const QString &hash : pendingBalances)
+    {
+        TokenItemEntry *tokenEntry = priv->find(uint256S(hash.toStdString()));
+        if(tokenEntry)
+        {
+            updateBalance(*tokenEntry);
+        }
+    }
+    pendingBalances.clear();
 }
 
 void TokenItemModel::balanceChanged(QString hash, QString balance)
@@ -2,6 +2,7 @@
 #define TOKENITEMMODEL_H
 
 #include <QAbstractItemModel>
+#include <QSet>
 #include <QStringList>
 #include <QThread>
 
@@ -11,6 +12,7 @@ namespace interfaces {
 class Handler;
 }
 
+class QTimer;
 class WalletModel;
 class Token;
 class TokenItemPriv;
@@ -60,6 +62,8 @@ public Q_SLOTS:
 
 private Q_SLOTS:
     void updateToken(const QString &hash, int status, bool showToken);
+    void tokenBalanceChanged(const QString &hash);
+    void updatePendingBalances();
 
 private:
     /** Notify listeners that data changed. */
@@ -74,6 +78,10 @@ private:
     TokenTxWorker* worker;
     QThread t;
     std::unique_ptr<interfaces::Handler> m_handler_token_changed;
+    std::unique_ptr<interfaces::Handler> m_handler_token_balance_changed;
+    // Tokens the wallet announced a balance change for, read together when the timer fires
+    QSet<QString> pendingBalances;
+    QTimer *balanceTimer;
     bool tokenTxCleaned;
 
     friend class TokenItemPriv;
@@ -32,6 +32,7 @@ QList<TokenTransactionRecord> TokenTransactionRecord::decomposeTransaction(inter
         rec.tokenSymbol = tokenSymbol;
         rec.decimals = decimals;
         rec.label = wtx.label;
+        rec.blockNumber = wtx.block_number;
         dev::s256 net = rec.credit + rec.debit;
 
         // Determine type
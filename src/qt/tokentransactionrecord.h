@@ -65,7 +65,7 @@ public:
     static const int RecommendedNumConfirmations = 10;
 
     TokenTransactionRecord():
-            hash(), txid(), time(0), type(Other), address(""), debit(0), credit(0), label("")
+            hash(), txid(), time(0), type(Other), address(""), debit(0), credit(0), label(""), blockNumber(-1)
     {
     }
 
@@ -85,6 +85,8 @@ public:
     std::string tokenSymbol;
     uint8_t decimals;
     std::string label;
+    /** Height of the block, -1 when not in a block */
+    int64_t blockNumber;
     /**@}*/
 
     /** Return the unique identifier for this transaction (part) */
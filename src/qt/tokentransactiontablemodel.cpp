@@ -24,6 +24,10 @@
 #include <QIcon>
 #include <QList>
 
+#include <algorithm>
+#include <map>
+#include <set>
+
 // Amount column is right-aligned it contains numbers
 static int column_alignments[] = {
         Qt::AlignLeft|Qt::AlignVCenter, /* status */
@@ -34,21 +38,17 @@ static int column_alignments[] = {
         Qt::AlignRight|Qt::AlignVCenter /* amount */
     };
 
-// Comparison operator for sort/binary search of model tx list
-struct TokenTxLessThan
+// A token transaction notification, handled on the GUI thread
+struct TokenTransactionNotification
 {
-    bool operator()(const TokenTransactionRecord &a, const TokenTransactionRecord &b) const
-    {
-        return a.hash < b.hash;
-    }
-    bool operator()(const TokenTransactionRecord &a, const uint256 &b) const
-    {
-        return a.hash < b;
-    }
-    bool operator()(const uint256 &a, const TokenTransactionRecord &b) const
-    {
-        return a < b.hash;
-    }
+public:
+    TokenTransactionNotification() {}
+    TokenTransactionNotification(uint256 _hash, ChangeType _status, bool _showTransaction):
+        hash(_hash), status(_status), showTransaction(_showTransaction) {}
+
+    uint256 hash;
+    ChangeType status;
+    bool showTransaction;
 };
 
 // Private implementation
@@ -62,33 +62,81 @@ public:
 
     TokenTransactionTableModel *parent;
 
-    /* Local cache of wallet.
-     * As it is in the same order as the CWallet, by definition
-     * this is sorted by sha256.
+    /* Local cache of wallet, in the order the records were loaded.
+     * rowByHash finds the row of a token transaction.
      */
     QList<TokenTransactionRecord> cachedWallet;
+    std::map<uint256, int> rowByHash;
+
+    /* Token transactions of the wallet not decoded into records yet, the
+     * newest last. A hash that left unfetchedHashes was added through a
+     * notification in the meantime and is skipped.
+     */
+    std::vector<interfaces::TokenTx> unfetched;
+    std::set<uint256> unfetchedHashes;
+
+    /* Notifications waiting for the GUI thread */
+    Mutex cs_pending;
+    std::vector<TokenTransactionNotification> pending GUARDED_BY(cs_pending);
 
-    /* Query entire wallet anew from core.
+    /* Query entire wallet anew from core, only the newest page is decoded.
      */
     void refreshWallet(interfaces::Node& node, interfaces::Wallet& wallet)
     {
         qDebug() << "TokenTransactionTablePriv::refreshWallet";
         cachedWallet.clear();
+        rowByHash.clear();
+        unfetched = wallet.getTokenTxs();
+        std::sort(unfetched.begin(), unfetched.end(), [](const interfaces::TokenTx& a, const interfaces::TokenTx& b) {
+            return a.time < b.time;
+        });
+        unfetchedHashes.clear();
+        for(const interfaces::TokenTx& wtokenTx : unfetched)
         {
-            for(interfaces::TokenTx wtokenTx : wallet.getTokenTxs())
-            {
-                // Update token transaction time if the block time is changed
-                int64_t time = node.getBlockTime(wtokenTx.block_number);
-                if(time && time != wtokenTx.time)
-                {
-                    wtokenTx.time = time;
-                    wallet.addTokenTxEntry(wtokenTx, false);
-                }
+            unfetchedHashes.insert(wtokenTx.hash);
+        }
+        fetch(node, wallet);
+    }
 
-                // Add token tx to the cache
-                cachedWallet.append(TokenTransactionRecord::decomposeTransaction(wallet, wtokenTx));
+    /* Decode the next page of token transactions and append them to the model.
+     */
+    void fetch(interfaces::Node& node, interfaces::Wallet& wallet)
+    {
+        QList<TokenTransactionRecord> toInsert;
+        std::vector<interfaces::TokenTx> updatedTokenTxs;
+        while(!unfetched.empty() && toInsert.size() < TOKEN_TX_FETCH_SIZE)
+        {
+            interfaces::TokenTx wtokenTx = std::move(unfetched.back());
+            unfetched.pop_back();
+            if(!unfetchedHashes.erase(wtokenTx.hash))
+                continue;
+
+            // Update token transaction time if the block time is changed
+            int64_t time = node.getBlockTime(wtokenTx.block_number);
+            if(time && time != wtokenTx.time)
+            {
+                wtokenTx.time = time;
+                updatedTokenTxs.push_back(wtokenTx);
             }
+
+            toInsert.append(TokenTransactionRecord::decomposeTransaction(wallet, wtokenTx));
         }
+        wallet.addTokenTxEntries(updatedTokenTxs, false);
+        append(toInsert);
+    }
+
+    void append(const QList<TokenTransactionRecord> &toInsert)
+    {
+        if(toInsert.isEmpty())
+            return;
+        int first = cachedWallet.size();
+        parent->beginInsertRows(QModelIndex(), first, first + toInsert.size() - 1);
+        for(const TokenTransactionRecord &rec : toInsert)
+        {
+            rowByHash[rec.hash] = cachedWallet.size();
+            cachedWallet.append(rec);
+        }
+        parent->endInsertRows();
     }
 
     /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -100,14 +148,13 @@ public:
     {
         qDebug() << "TokenTransactionTablePriv::updateWallet: " + QString::fromStdString(hash.ToString()) + " " + QString::number(status);
 
-        // Find bounds of this transaction in model
-        QList<TokenTransactionRecord>::iterator lower = qLowerBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TokenTxLessThan());
-        QList<TokenTransactionRecord>::iterator upper = qUpperBound(
-            cachedWallet.begin(), cachedWallet.end(), hash, TokenTxLessThan());
-        int lowerIndex = (lower - cachedWallet.begin());
-        int upperIndex = (upper - cachedWallet.begin());
-        bool inModel = (lower != upper);
+        // A transaction not fetched yet is taken from the wallet now
+        unfetchedHashes.erase(hash);
+
+        // Find this transaction in model
+        auto it = rowByHash.find(hash);
+        bool inModel = it != rowByHash.end();
+        int row = inModel ? it->second : -1;
 
         // Find transaction in wallet
         interfaces::TokenTx wtokenTx = wallet.getTokenTx(hash);
@@ -129,7 +176,7 @@ public:
         }
 
         qDebug() << "    inModel=" + QString::number(inModel) +
-                    " Index=" + QString::number(lowerIndex) + "-" + QString::number(upperIndex) +
+                    " Index=" + QString::number(row) +
                     " showTransaction=" + QString::number(showTransaction) + " derivedStatus=" + QString::number(status);
 
         switch(status)
@@ -147,20 +194,8 @@ public:
                     qWarning() << "TokenTransactionTablePriv::updateWallet: Warning: Got CT_NEW, but transaction is not in wallet";
                     break;
                 }
-                // Added -- insert at the right position
-                QList<TokenTransactionRecord> toInsert =
-                        TokenTransactionRecord::decomposeTransaction(wallet, wtokenTx);
-                if(!toInsert.isEmpty()) /* only if something to insert */
-                {
-                    parent->beginInsertRows(QModelIndex(), lowerIndex, lowerIndex+toInsert.size()-1);
-                    int insert_idx = lowerIndex;
-                    Q_FOREACH(const TokenTransactionRecord &rec, toInsert)
-                    {
-                        cachedWallet.insert(insert_idx, rec);
-                        insert_idx += 1;
-                    }
-                    parent->endInsertRows();
-                }
+                // Added -- append, the view sorts the rows
+                append(TokenTransactionRecord::decomposeTransaction(wallet, wtokenTx));
             }
             break;
         case CT_DELETED:
@@ -169,9 +204,15 @@ public:
                 qWarning() << "TokenTransactionTablePriv::updateWallet: Warning: Got CT_DELETED, but transaction is not in model";
                 break;
             }
-            // Removed -- remove entire transaction from table
-            parent->beginRemoveRows(QModelIndex(), lowerIndex, upperIndex-1);
-            cachedWallet.erase(lower, upper);
+            // Removed -- remove entire transaction from table, the rows after it move up
+            parent->beginRemoveRows(QModelIndex(), row, row);
+            cachedWallet.removeAt(row);
+            rowByHash.erase(it);
+            for(auto& entry : rowByHash)
+            {
+                if(entry.second > row)
+                    entry.second -= 1;
+            }
             parent->endRemoveRows();
             break;
         case CT_UPDATED:
@@ -192,13 +233,8 @@ public:
                         TokenTransactionRecord::decomposeTransaction(wallet, wtokenTx);
                 if(!toUpdate.isEmpty()) /* only if something to insert */
                 {
-                    int update_idx = lowerIndex;
-                    Q_FOREACH(const TokenTransactionRecord &rec, toUpdate)
-                    {
-                        cachedWallet[update_idx] = rec;
-                        parent->emitDataChanged(update_idx);
-                        update_idx += 1;
-                    }
+                    cachedWallet[row] = toUpdate.front();
+                    parent->emitDataChanged(row);
                 }
             }
             break;
@@ -210,24 +246,17 @@ public:
         return cachedWallet.size();
     }
 
-    TokenTransactionRecord *index(interfaces::Wallet& wallet, int idx)
+    TokenTransactionRecord *index(int idx, int numBlocks)
     {
         if(idx >= 0 && idx < cachedWallet.size())
         {
             TokenTransactionRecord *rec = &cachedWallet[idx];
 
-            // Get required locks upfront. This avoids the GUI from getting
-            // stuck if the core is holding the locks for a longer time - for
-            // example, during a wallet rescan.
-            //
-            // If a status update is needed (blocks came in since last check),
-            //  update the status of this transaction from the wallet. Otherwise,
-            // simply re-use the cached status.
-            int blockNumber = -1;
-            bool inMempool = false;
-            int numBlocks = -1;
-            if (wallet.tryGetTokenTxStatus(rec->hash, blockNumber, inMempool, numBlocks) && rec->statusUpdateNeeded(numBlocks)) {
-                rec->updateStatus(blockNumber, numBlocks);
+            // The status only depends on the height of the record and the
+            // chain, so it is computed here without asking the wallet.
+            if(rec->statusUpdateNeeded(numBlocks))
+            {
+                rec->updateStatus(rec->blockNumber, numBlocks);
             }
             return rec;
         }
@@ -260,7 +289,8 @@ TokenTransactionTableModel::TokenTransactionTableModel(const PlatformStyle *_pla
         walletModel(parent),
         priv(new TokenTransactionTablePriv(this)),
         fProcessingQueuedTransactions(false),
-        platformStyle(_platformStyle)
+        platformStyle(_platformStyle),
+        cachedNumBlocks(parent->node().getNumBlocks())
 {
     columns << QString() << tr("Date") << tr("Type") << tr("Label") << tr("Name") << tr("Amount");
     priv->refreshWallet(walletModel->node(), walletModel->wallet());
@@ -282,12 +312,44 @@ void TokenTransactionTableModel::updateTransaction(const QString &hash, int stat
     priv->updateWallet(walletModel->wallet(), updated, status, showTransaction);
 }
 
-void TokenTransactionTableModel::updateConfirmations()
+void TokenTransactionTableModel::processPendingTransactions()
+{
+    std::vector<TokenTransactionNotification> pending;
+    {
+        LOCK(priv->cs_pending);
+        pending.swap(priv->pending);
+    }
+    for(const TokenTransactionNotification &notification : pending)
+    {
+        priv->updateWallet(walletModel->wallet(), notification.hash, notification.status, notification.showTransaction);
+    }
+}
+
+bool TokenTransactionTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+    return !priv->unfetchedHashes.empty();
+}
+
+void TokenTransactionTableModel::fetchMore(const QModelIndex &parent)
+{
+    Q_UNUSED(parent);
+    // Loading older history is not news, do not notify about the rows
+    bool fProcessing = fProcessingQueuedTransactions;
+    fProcessingQueuedTransactions = true;
+    priv->fetch(walletModel->node(), walletModel->wallet());
+    fProcessingQueuedTransactions = fProcessing;
+}
+
+void TokenTransactionTableModel::updateConfirmations(int numBlocks)
 {
     // Blocks came in since last poll.
     // Invalidate status (number of confirmations) and (possibly) description
     //  for all rows. Qt is smart enough to only actually request the data for the
     //  visible rows.
+    cachedNumBlocks = numBlocks;
+    if(priv->size() == 0)
+        return;
     Q_EMIT dataChanged(index(0, Status), index(priv->size()-1, Status));
     Q_EMIT dataChanged(index(0, ToAddress), index(priv->size()-1, ToAddress));
 }
@@ -656,7 +718,7 @@ QVariant TokenTransactionTableModel::headerData(int section, Qt::Orientation ori
 QModelIndex TokenTransactionTableModel::index(int row, int column, const QModelIndex &parent) const
 {
     Q_UNUSED(parent);
-    TokenTransactionRecord *data = priv->index(walletModel->wallet(), row);
+    TokenTransactionRecord *data = priv->index(row, cachedNumBlocks);
     if(data)
     {
         return createIndex(row, column, data);
@@ -669,42 +731,42 @@ void TokenTransactionTableModel::emitDataChanged(int idx)
     Q_EMIT dataChanged(index(idx, 0, QModelIndex()), index(idx, columns.length()-1, QModelIndex()));
 }
 
-// queue notifications to show a non freezing progress dialog e.g. for rescan
-struct TokenTransactionNotification
+// Notifications are handled in one batch per turn of the GUI event loop
+static void QueueTokenTransactionNotification(TokenTransactionTableModel *ttm, TokenTransactionTablePriv *priv, const TokenTransactionNotification &notification)
 {
-public:
-    TokenTransactionNotification() {}
-    TokenTransactionNotification(uint256 _hash, ChangeType _status, bool _showTransaction):
-        hash(_hash), status(_status), showTransaction(_showTransaction) {}
-
-    void invoke(QObject *ttm)
+    bool fFirst;
     {
-        QString strHash = QString::fromStdString(hash.GetHex());
-        qDebug() << "NotifyTokenTransactionChanged: " + strHash + " status= " + QString::number(status);
-        QMetaObject::invokeMethod(ttm, "updateTransaction", Qt::QueuedConnection,
-                                  Q_ARG(QString, strHash),
-                                  Q_ARG(int, status),
-                                  Q_ARG(bool, showTransaction));
+        LOCK(priv->cs_pending);
+        fFirst = priv->pending.empty();
+        priv->pending.push_back(notification);
     }
-private:
-    uint256 hash;
-    ChangeType status;
-    bool showTransaction;
-};
+    if (fFirst)
+        QMetaObject::invokeMethod(ttm, "processPendingTransactions", Qt::QueuedConnection);
+}
 
+static void InvokeTokenTransactionNotification(TokenTransactionTableModel *ttm, const TokenTransactionNotification &notification)
+{
+    QMetaObject::invokeMethod(ttm, "updateTransaction", Qt::QueuedConnection,
+                              Q_ARG(QString, QString::fromStdString(notification.hash.GetHex())),
+                              Q_ARG(int, notification.status),
+                              Q_ARG(bool, notification.showTransaction));
+}
+
+// queue notifications to show a non freezing progress dialog e.g. for rescan
 static bool fQueueNotifications = false;
 static std::vector< TokenTransactionNotification > vQueueNotifications;
 
-static void NotifyTokenTransactionChanged(TokenTransactionTableModel *ttm, const uint256 &hash, ChangeType status)
+static void NotifyTokenTransactionChanged(TokenTransactionTableModel *ttm, TokenTransactionTablePriv *priv, const uint256 &hash, ChangeType status)
 {
     TokenTransactionNotification notification(hash, status, true);
+    qDebug() << "NotifyTokenTransactionChanged: " + QString::fromStdString(hash.GetHex()) + " status= " + QString::number(status);
 
     if (fQueueNotifications)
     {
         vQueueNotifications.push_back(notification);
         return;
     }
-    notification.invoke(ttm);
+    QueueTokenTransactionNotification(ttm, priv, notification);
 }
 
 static void ShowProgress(TokenTransactionTableModel *ttm, const std::string &title, int nProgress)
@@ -722,7 +784,7 @@ static void ShowProgress(TokenTransactionTableModel *ttm, const std::string &tit
             if (vQueueNotifications.size() - i <= 10)
                 QMetaObject::invokeMethod(ttm, "setProcessingQueuedTransactions", Qt::QueuedConnection, Q_ARG(bool, false));
 
-            vQueueNotifications[i].invoke(ttm);
+            InvokeTokenTransactionNotification(ttm, vQueueNotifications[i]);
         }
         std::vector<TokenTransactionNotification >().swap(vQueueNotifications); // clear
     }
@@ -731,7 +793,7 @@ static void ShowProgress(TokenTransactionTableModel *ttm, const std::string &tit
 void TokenTransactionTableModel::subscribeToCoreSignals()
 {
     // Connect signals to wallet
-    m_handler_token_transaction_changed = walletModel->wallet().handleTokenTransactionChanged(boost::bind(NotifyTokenTransactionChanged, this, boost::placeholders::_1, boost::placeholders::_2));
+    m_handler_token_transaction_changed = walletModel->wallet().handleTokenTransactionChanged(boost::bind(NotifyTokenTransactionChanged, this, priv, boost::placeholders::_1, boost::placeholders::_2));
     m_handler_show_progress = walletModel->wallet().handleShowProgress(boost::bind(ShowProgress, this, boost::placeholders::_1, boost::placeholders::_2));
 }
 
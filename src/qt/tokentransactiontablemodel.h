@@ -77,6 +77,8 @@ public:
     QVariant data(const QModelIndex &index, int role) const;
     QVariant headerData(int section, Qt::Orientation orientation, int role) const;
     QModelIndex index(int row, int column, const QModelIndex & parent = QModelIndex()) const;
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
     bool processingQueuedTransactions() { return fProcessingQueuedTransactions; }
 
 private:
@@ -87,6 +89,8 @@ private:
     TokenTransactionTablePriv *priv;
     bool fProcessingQueuedTransactions;
     const PlatformStyle *platformStyle;
+    // Chain height the status of the records is computed against
+    int cachedNumBlocks;
 
     void subscribeToCoreSignals();
     void unsubscribeFromCoreSignals();
@@ -109,7 +113,9 @@ public Q_SLOTS:
     void emitDataChanged(int index);
     /* New transaction, or transaction changed status */
     void updateTransaction(const QString &hash, int status, bool showTransaction);
-    void updateConfirmations();
+    /* Handle the notifications queued since the last call */
+    void processPendingTransactions();
+    void updateConfirmations(int numBlocks);
     /* Needed to update fProcessingQueuedTransactions through a QueuedConnection */
     void setProcessingQueuedTransactions(bool value) { fProcessingQueuedTransactions = value; }
 
@@ -277,6 +277,39 @@ bool TransactionRecord::statusUpdateNeeded(int numBlocks) const
     return status.cur_num_blocks != numBlocks || status.needsUpdate;
 }
 
+bool TransactionRecord::updateStatusDepth(int numBlocks)
+{
+    // The depth and maturity of a final transaction in the main chain only follow the tip,
+    // anything else or a lower tip can change in ways only the wallet knows
+    if(status.needsUpdate || status.cur_num_blocks < 0 || numBlocks < status.cur_num_blocks || status.depth <= 0)
+        return false;
+
+    int blocks = numBlocks - status.cur_num_blocks;
+    switch(status.status)
+    {
+    case TransactionStatus::Immature:
+        status.matures_in -= blocks;
+        if(status.matures_in <= 0)
+        {
+            status.matures_in = 0;
+            status.status = TransactionStatus::Confirmed;
+            status.countsForBalance = true;
+        }
+        break;
+    case TransactionStatus::Confirming:
+        if(status.depth + blocks >= RecommendedNumConfirmations)
+            status.status = TransactionStatus::Confirmed;
+        break;
+    case TransactionStatus::Confirmed:
+        break;
+    default:
+        return false;
+    }
+    status.depth += blocks;
+    status.cur_num_blocks = numBlocks;
+    return true;
+}
+
 QString TransactionRecord::getTxHash() const
 {
     return QString::fromStdString(hash.ToString());
@@ -25,7 +25,8 @@ class TransactionStatus
 public:
     TransactionStatus():
         countsForBalance(false), sortKey(""),
-        matures_in(0), status(Unconfirmed), depth(0), open_for(0), cur_num_blocks(-1)
+        matures_in(0), status(Unconfirmed), depth(0), open_for(0), cur_num_blocks(-1),
+        needsUpdate(false)
     { }
 
     enum Status {
@@ -145,6 +146,11 @@ public:
     /** Return whether a status update is needed.
      */
     bool statusUpdateNeeded(int numBlocks) const;
+
+    /** Move the status of a transaction in the main chain to a higher tip without asking the wallet.
+        Return false when the status has to be updated from the wallet.
+     */
+    bool updateStatusDepth(int numBlocks);
 };
 
 #endif // BITCOIN_QT_TRANSACTIONRECORD_H
@@ -75,6 +75,8 @@ public:
      */
     QList<TransactionRecord> cachedWallet;
     bool isDataLoading = true;
+    /* Tip height the status of the records is computed for */
+    int cachedNumBlocks = -1;
 
     /* Query entire wallet anew from core.
      */
@@ -190,19 +192,19 @@ public:
         {
             TransactionRecord *rec = &cachedWallet[idx];
 
-            if(!isDataLoading)
+            // If a status update is needed (blocks came in since last check),
+            // move the confirmations of a transaction in the main chain to the tip,
+            // and only update the status of the others from the wallet.
+            // Otherwise, simply re-use the cached status.
+            if(!isDataLoading && rec->statusUpdateNeeded(cachedNumBlocks) && !rec->updateStatusDepth(cachedNumBlocks))
             {
                 // Get required locks upfront. This avoids the GUI from getting
                 // stuck if the core is holding the locks for a longer time - for
                 // example, during a wallet rescan.
-                //
-                // If a status update is needed (blocks came in since last check),
-                //  update the status of this transaction from the wallet. Otherwise,
-                // simply re-use the cached status.
                 interfaces::WalletTxStatus wtx;
                 int numBlocks;
                 int64_t adjustedTime;
-                if (wallet.tryGetTxStatus(rec->hash, wtx, numBlocks, adjustedTime) && rec->statusUpdateNeeded(numBlocks)) {
+                if (wallet.tryGetTxStatus(rec->hash, wtx, numBlocks, adjustedTime)) {
                     rec->updateStatus(wtx, numBlocks, adjustedTime);
                 }
             }
@@ -264,17 +266,47 @@ void TransactionTableModel::updateTransaction(const QString &hash, int status, b
     priv->updateWallet(walletModel->wallet(), updated, status, showTransaction);
 }
 
-void TransactionTableModel::updateConfirmations()
+void TransactionTableModel::updateConfirmations(int numBlocks)
 {
     // Blocks came in since last poll.
-    // Invalidate status (number of confirmations) and (possibly) description
-    //  for all rows. Qt is smart enough to only actually request the data for the
-    //  visible rows.
+    // The status is computed for the cached tip when a row is requested, so
+    // only the rows whose displayed status can change are invalidated: the ones
+    // marked for update and the shown ones not yet confirmed, or all of them
+    // when the tip went back.
+    int prevNumBlocks = priv->cachedNumBlocks;
+    priv->cachedNumBlocks = numBlocks;
     if(priv->isDataLoading)
+    {
+        // Nothing has a status yet, invalidate all rows once.
+        // Qt is smart enough to only actually request the data for the visible rows.
         priv->isDataLoading = false;
-        
-    modelDataChanged(Status);
-    modelDataChanged(ToAddress);
+        modelDataChanged(Status);
+        modelDataChanged(ToAddress);
+        return;
+    }
+
+    QPointer<TransactionTableModel> model = this;
+    int from = -1;
+    for(int i = 0; model && i <= priv->size(); i++)
+    {
+        bool changed = false;
+        if(i < priv->size())
+        {
+            const TransactionStatus& status = priv->cachedWallet[i].status;
+            changed = status.needsUpdate ||
+                    (status.cur_num_blocks != -1 && (status.status != TransactionStatus::Confirmed || numBlocks < prevNumBlocks));
+        }
+        if(changed && from == -1)
+        {
+            from = i;
+        }
+        else if(from != -1 && (!changed || i - from == dataChangedChunk))
+        {
+            Q_EMIT dataChanged(index(from, Status), index(i-1, ToAddress));
+            from = changed ? i : -1;
+            if(qApp) qApp->processEvents();
+        }
+    }
 }
 
 int TransactionTableModel::rowCount(const QModelIndex &parent) const
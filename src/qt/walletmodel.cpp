@@ -100,10 +100,6 @@ WalletModel::WalletModel(std::unique_ptr<interfaces::Wallet> wallet, interfaces:
     connect(pollTimer, SIGNAL(timeout()), worker, SLOT(updateModel()));
     pollTimer->start(MODEL_UPDATE_DELAY);
 
-    dgpCacheTimer = new QTimer(this);
-    connect(dgpCacheTimer, SIGNAL(timeout()), this, SLOT(updateDgpCache()));
-    dgpCacheTimer->start(DGP_CACHE_UPDATE_DELAY);
-
     connect(addressTableModel, SIGNAL(rowsInserted(QModelIndex,int,int)), this, SLOT(checkCoinAddresses()));
     connect(addressTableModel, SIGNAL(rowsRemoved(QModelIndex,int,int)), this, SLOT(checkCoinAddresses()));
 
@@ -126,12 +122,6 @@ void WalletModel::updateStatus()
     }
 }
 
-void WalletModel::updateDgpCache() {
-    //Update DGP cache
-    Dgp dgp;
-    dgp.updateDgpCache();
-}
-
 void WalletModel::pollBalanceChanged()
 {
     // Get node synchronization information
@@ -162,16 +152,16 @@ void WalletModel::pollBalanceChanged()
 
         bool balanceChanged = checkBalanceChanged(new_balances);
         if(transactionTableModel)
-            transactionTableModel->updateConfirmations();
+            transactionTableModel->updateConfirmations(numBlocks);
 
         if(tokenTransactionTableModel)
-            tokenTransactionTableModel->updateConfirmations();
+            tokenTransactionTableModel->updateConfirmations(numBlocks);
 
         if(cachedNumBlocksChanged)
         {
             checkTokenBalanceChanged();
-            checkDelegationChanged();
-            checkSuperStakerChanged();
+            checkDelegationChanged(balanceChanged);
+            checkSuperStakerChanged(balanceChanged);
         }
 
         if(balanceChanged)
@@ -211,19 +201,19 @@ void WalletModel::checkTokenBalanceChanged()
     }
 }
 
-void WalletModel::checkDelegationChanged()
+void WalletModel::checkDelegationChanged(bool balanceChanged)
 {
     if(delegationItemModel)
     {
-        delegationItemModel->checkDelegationChanged();
+        delegationItemModel->checkDelegationChanged(balanceChanged);
     }
 }
 
-void WalletModel::checkSuperStakerChanged()
+void WalletModel::checkSuperStakerChanged(bool balanceChanged)
 {
     if(superStakerItemModel)
     {
-        superStakerItemModel->checkSuperStakerChanged();
+        superStakerItemModel->checkSuperStakerChanged(balanceChanged);
     }
 }
 
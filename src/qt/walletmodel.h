@@ -271,7 +271,6 @@ private:
     int pollNum = 0;
 
     QTimer *pollTimer;
-    QTimer *dgpCacheTimer;
 
     QString restorePath;
     QString restoreParam;
@@ -286,8 +285,8 @@ private:
     void unsubscribeFromCoreSignals();
     bool checkBalanceChanged(const interfaces::WalletBalances& new_balances);
     void checkTokenBalanceChanged();
-    void checkDelegationChanged();
-    void checkSuperStakerChanged();
+    void checkDelegationChanged(bool balanceChanged);
+    void checkSuperStakerChanged(bool balanceChanged);
 
 Q_SIGNALS:
     // Signal that balance in wallet changed
@@ -330,8 +329,6 @@ public Q_SLOTS:
     void updateWatchOnlyFlag(bool fHaveWatchonly);
     /* Current, immature or unconfirmed balance might have changed - emit 'balanceChanged' if so */
     void pollBalanceChanged();
-    /* Update DGP cached params*/
-    void updateDgpCache();
     /* New, updated or removed contract book entry */
     void updateContractBook(const QString &address, const QString &label, const QString &abi, int status);
     /* Set that update for coin address is needed */
@@ -0,0 +1,52 @@
+#include <qtum/codecache.h>
+
+std::unique_ptr<ContractCodeCache> g_contract_code_cache;
+
+/** Approximate memory used by a cache entry, the list node, the index node and the code */
+static size_t CodeUsage(const dev::bytes& code)
+{
+    return 128 + code.capacity();
+}
+
+ContractCodeCache::ContractCodeCache(size_t nMaxUsage) : m_max_usage(nMaxUsage) {}
+
+std::shared_ptr<const dev::bytes> ContractCodeCache::Get(const dev::h256& codeHash)
+{
+    LOCK(m_cs);
+    auto it = m_index.find(codeHash);
+    if (it == m_index.end()) {
+        m_misses++;
+        return nullptr;
+    }
+    m_hits++;
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    return it->second->second;
+}
+
+void ContractCodeCache::Insert(const dev::h256& codeHash, const dev::bytes& code)
+{
+    size_t usage = CodeUsage(code);
+    if (code.empty() || usage > m_max_usage)
+        return;
+    std::shared_ptr<const dev::bytes> entry = std::make_shared<const dev::bytes>(code);
+
+    LOCK(m_cs);
+    if (m_index.count(codeHash))
+        return;
+    m_lru.emplace_front(codeHash, std::move(entry));
+    m_index[codeHash] = m_lru.begin();
+    m_usage += usage;
+
+    while (m_usage > m_max_usage) {
+        auto& last = m_lru.back();
+        m_usage -= CodeUsage(*last.second);
+        m_index.erase(last.first);
+        m_lru.pop_back();
+    }
+}
+
+ContractCodeCacheStats ContractCodeCache::GetStats() const
+{
+    LOCK(m_cs);
+    return ContractCodeCacheStats{m_hits, m_misses, m_lru.size(), m_usage, m_max_usage};
+}
@@ -0,0 +1,57 @@
+#ifndef QTUM_CODECACHE_H
+#define QTUM_CODECACHE_H
+
+#include <libdevcore/Common.h>
+#include <libdevcore/FixedHash.h>
+#include <sync.h>
+
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+/** Default for -contractcodecache, in MiB, 0 disables it */
+static const int64_t DEFAULT_CONTRACT_CODE_CACHE = 16;
+
+struct ContractCodeCacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    size_t entries;
+    size_t usage;
+    size_t maxUsage;
+};
+
+/**
+ * Bounded LRU of contract code by code hash.
+ *
+ * The account cache of a QtumState is dropped on every commit, so without it
+ * the code of a contract is read from the state database again for each
+ * transaction calling it. Code never changes for a hash, so the entries are
+ * never stale and globalState, its snapshots and the RPC executions share them.
+ */
+class ContractCodeCache
+{
+public:
+    explicit ContractCodeCache(size_t nMaxUsage);
+
+    //! The code with the hash, null when it is not cached
+    std::shared_ptr<const dev::bytes> Get(const dev::h256& codeHash);
+    void Insert(const dev::h256& codeHash, const dev::bytes& code);
+
+    ContractCodeCacheStats GetStats() const;
+
+private:
+    typedef std::list<std::pair<dev::h256, std::shared_ptr<const dev::bytes>>> CodeList;
+
+    mutable Mutex m_cs;
+    CodeList m_lru GUARDED_BY(m_cs);
+    std::unordered_map<dev::h256, CodeList::iterator> m_index GUARDED_BY(m_cs);
+    size_t m_usage GUARDED_BY(m_cs) = 0;
+    const size_t m_max_usage;
+    uint64_t m_hits GUARDED_BY(m_cs) = 0;
+    uint64_t m_misses GUARDED_BY(m_cs) = 0;
+};
+
+/** Set by -contractcodecache */
+extern std::unique_ptr<ContractCodeCache> g_contract_code_cache;
+
+#endif // QTUM_CODECACHE_H
@@ -0,0 +1,152 @@
+#include <qtum/contractexecutor.h>
+#include <util/system.h>
+
+#include <algorithm>
+#include <chrono>
+
+std::unique_ptr<ContractCallExecutor> g_contract_call_executor;
+
+ContractCallExecutor::ContractCallExecutor(int threads)
+{
+    for (size_t i = 0; i < CONTRACT_CALL_CLASSES; i++) {
+        m_limits[i] = Limits{(size_t)threads, (size_t)DEFAULT_EVM_QUEUE, DEFAULT_EVM_TIMEOUT};
+    }
+    for (int i = 0; i < threads; i++) {
+        m_threads.emplace_back(&ContractCallExecutor::ThreadWorker, this);
+    }
+}
+
+ContractCallExecutor::~ContractCallExecutor()
+{
+    Stop();
+}
+
+void ContractCallExecutor::SetLimits(ContractCallClass cls, const Limits& limits)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_limits[(size_t)cls] = limits;
+    m_work_cond.notify_all();
+}
+
+bool ContractCallExecutor::Run(ContractCallClass cls, const std::function<void()>& fn, std::string& error)
+{
+    const size_t index = (size_t)cls;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::deque<std::shared_ptr<Task>>& queue = m_queue[index];
+    if (m_stopping) {
+        error = "Contract call workers are stopping";
+        return false;
+    }
+    if (queue.size() >= m_limits[index].max_queued) {
+        m_stats[index].refused++;
+        error = "Too many contract calls waiting, try again later";
+        return false;
+    }
+
+    std::shared_ptr<Task> task = std::make_shared<Task>();
+    task->fn = &fn;
+    queue.push_back(task);
+    m_work_cond.notify_one();
+
+    // Only the wait for a worker times out, fn references the caller's stack so a started call is waited for
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_limits[index].timeout_ms);
+    while (!task->done) {
+        if (!task->started && (m_stopping || std::chrono::steady_clock::now() >= deadline)) {
+            queue.erase(std::find(queue.begin(), queue.end(), task));
+            if (m_stopping) {
+                error = "Contract call workers are stopping";
+            } else {
+                m_stats[index].timedout++;
+                error = "Contract call timed out waiting for an EVM worker";
+            }
+            return false;
+        }
+        if (task->started) {
+            m_done_cond.wait(lock);
+        } else {
+            m_done_cond.wait_until(lock, deadline);
+        }
+    }
+    lock.unlock();
+
+    if (task->exception) {
+        std::rethrow_exception(task->exception);
+    }
+    return true;
+}
+
+void ContractCallExecutor::ThreadWorker()
+{
+    RenameThread("bitcoin-evm");
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        // The first class, in priority order, with a call waiting and a free slot
+        size_t index = CONTRACT_CALL_CLASSES;
+        for (size_t i = 0; i < CONTRACT_CALL_CLASSES && !m_stopping; i++) {
+            if (!m_queue[i].empty() && m_stats[i].running < m_limits[i].max_running) {
+                index = i;
+                break;
+            }
+        }
+        if (m_stopping) {
+            return;
+        }
+        if (index == CONTRACT_CALL_CLASSES) {
+            m_work_cond.wait(lock);
+            continue;
+        }
+
+        std::shared_ptr<Task> task = m_queue[index].front();
+        m_queue[index].pop_front();
+        task->started = true;
+        m_stats[index].running++;
+        lock.unlock();
+
+        try {
+            (*task->fn)();
+        } catch (...) {
+            task->exception = std::current_exception();
+        }
+
+        lock.lock();
+        m_stats[index].running--;
+        m_stats[index].completed++;
+        task->done = true;
+        m_done_cond.notify_all();
+        // The slot of the class is free again, a worker waiting for it may go on
+        m_work_cond.notify_one();
+    }
+}
+
+void ContractCallExecutor::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_work_cond.notify_all();
+        m_done_cond.notify_all();
+    }
+    for (std::thread& thread : m_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    m_threads.clear();
+}
+
+ContractCallClassStats ContractCallExecutor::GetStats(ContractCallClass cls) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ContractCallClassStats stats = m_stats[(size_t)cls];
+    stats.queued = m_queue[(size_t)cls].size();
+    return stats;
+}
+
+bool RunContractCall(ContractCallClass cls, const std::function<void()>& fn, std::string& error)
+{
+    if (!g_contract_call_executor) {
+        fn();
+        return true;
+    }
+    return g_contract_call_executor->Run(cls, fn, error);
+}
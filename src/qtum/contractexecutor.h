@@ -0,0 +1,104 @@
+#ifndef QTUM_CONTRACTEXECUTOR_H
+#define QTUM_CONTRACTEXECUTOR_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Default for -evmthreads, 0 runs the read-only contract calls on the threads asking for them */
+static const int DEFAULT_EVM_THREADS = 2;
+/** Default for -evmqueue, calls of a class waiting for a worker before new ones are refused */
+static const int DEFAULT_EVM_QUEUE = 64;
+/** Default for -evmtimeout, in milliseconds a call may wait for a worker */
+static const int64_t DEFAULT_EVM_TIMEOUT = 10000;
+
+/** Who asks for a read-only contract call, in the order the workers take them */
+enum class ContractCallClass {
+    RPC,
+    WALLET,
+};
+static const size_t CONTRACT_CALL_CLASSES = 2;
+
+struct ContractCallClassStats {
+    size_t queued;
+    size_t running;
+    uint64_t completed;
+    uint64_t refused;
+    uint64_t timedout;
+};
+
+/**
+ * Workers for the read-only contract calls of RPC and the wallet, which run on snapshots of the
+ * contract state and so do not need cs_main.
+ *
+ * Without them every RPC thread and the GUI could run the EVM at the same time, and a burst of
+ * heavy callcontract requests took the cores validation and staking need. The workers bound the
+ * EVM threads, take the classes in priority order, and each class has a limit of running calls, a
+ * bounded queue past which calls are refused, and a timeout for the wait in the queue. A call that
+ * started runs to the end, its gas limit bounds it.
+ *
+ * Validation, block assembly and the staker do not go through the workers, their calls read the
+ * state they are building and run inline on globalState.
+ */
+class ContractCallExecutor
+{
+public:
+    struct Limits {
+        size_t max_running;
+        size_t max_queued;
+        int64_t timeout_ms;
+    };
+
+    explicit ContractCallExecutor(int threads);
+    ~ContractCallExecutor();
+
+    void SetLimits(ContractCallClass cls, const Limits& limits);
+
+    /**
+     * Run fn on a worker and wait for it. Returns false with the reason in error when the queue of
+     * the class is full, or the call times out or the executor stops before it started. Exceptions
+     * thrown by fn are rethrown here.
+     */
+    bool Run(ContractCallClass cls, const std::function<void()>& fn, std::string& error);
+
+    /** Refuse new calls, drop the waiting ones and join the workers after their current call */
+    void Stop();
+
+    ContractCallClassStats GetStats(ContractCallClass cls) const;
+
+private:
+    struct Task {
+        const std::function<void()>* fn;
+        bool started{false};
+        bool done{false};
+        std::exception_ptr exception;
+    };
+
+    void ThreadWorker();
+
+    mutable std::mutex m_mutex;
+    /** Signals the workers that a call is waiting or a slot of a class is free */
+    std::condition_variable m_work_cond;
+    /** Signals the callers that a call is done */
+    std::condition_variable m_done_cond;
+    std::deque<std::shared_ptr<Task>> m_queue[CONTRACT_CALL_CLASSES];
+    Limits m_limits[CONTRACT_CALL_CLASSES];
+    ContractCallClassStats m_stats[CONTRACT_CALL_CLASSES] = {};
+    bool m_stopping{false};
+    std::vector<std::thread> m_threads;
+};
+
+/** Set by -evmthreads */
+extern std::unique_ptr<ContractCallExecutor> g_contract_call_executor;
+
+/** Run fn on g_contract_call_executor at the priority of cls, or inline when there are no workers */
+bool RunContractCall(ContractCallClass cls, const std::function<void()>& fn, std::string& error);
+
+#endif // QTUM_CONTRACTEXECUTOR_H
@@ -0,0 +1,119 @@
+#include <qtum/contractprofiler.h>
+
+#include <algorithm>
+
+std::unique_ptr<ContractProfiler> g_contract_profiler;
+
+void ContractProfileEntry::Add(const ContractProfileEntry& entry)
+{
+    nGasUsed += entry.nGasUsed;
+    nTime += entry.nTime;
+    nStorageReads += entry.nStorageReads;
+    nStorageWrites += entry.nStorageWrites;
+    nCalls += entry.nCalls;
+}
+
+void ContractProfileEntry::Subtract(const ContractProfileEntry& entry)
+{
+    nGasUsed -= entry.nGasUsed;
+    nTime -= entry.nTime;
+    nStorageReads -= entry.nStorageReads;
+    nStorageWrites -= entry.nStorageWrites;
+    nCalls -= entry.nCalls;
+}
+
+ContractProfiler::ContractProfiler(unsigned int nBlocks) : m_max_blocks(std::max(1u, nBlocks)) {}
+
+void ContractProfiler::BeginBlock()
+{
+    m_block.clear();
+}
+
+OnOpFunc ContractProfiler::StorageCounter()
+{
+    return [this](uint64_t, uint64_t, dev::eth::Instruction inst, dev::bigint, dev::bigint, dev::bigint, dev::eth::VMFace const*, dev::eth::ExtVMFace const* ext) {
+        if (inst == dev::eth::Instruction::SLOAD) {
+            m_block[ext->myAddress].nStorageReads++;
+        } else if (inst == dev::eth::Instruction::SSTORE) {
+            m_block[ext->myAddress].nStorageWrites++;
+        }
+    };
+}
+
+void ContractProfiler::AddExecution(const dev::Address& address, uint64_t nGasUsed, int64_t nTime)
+{
+    ContractProfileEntry& entry = m_block[address];
+    entry.nGasUsed += nGasUsed;
+    entry.nTime += nTime;
+    entry.nCalls++;
+}
+
+void ContractProfiler::PopBlock(bool fBack)
+{
+    const ContractProfile& block = fBack ? m_window.back().second : m_window.front().second;
+    for (const auto& item : block) {
+        auto it = m_totals.find(item.first);
+        it->second.Subtract(item.second);
+        if (it->second.nCalls == 0 && it->second.nStorageReads == 0 && it->second.nStorageWrites == 0)
+            m_totals.erase(it);
+    }
+    if (fBack) {
+        m_window.pop_back();
+    } else {
+        m_window.pop_front();
+    }
+}
+
+void ContractProfiler::ConnectBlock(int nHeight)
+{
+    LOCK(m_cs);
+    // Blocks of a reorganized branch leave the window
+    while (!m_window.empty() && m_window.back().first >= nHeight) {
+        PopBlock(true);
+    }
+    for (const auto& item : m_block) {
+        m_totals[item.first].Add(item.second);
+    }
+    m_window.emplace_back(nHeight, std::move(m_block));
+    m_block.clear();
+    while (m_window.size() > m_max_blocks) {
+        PopBlock(false);
+    }
+}
+
+static uint64_t SortValue(const ContractProfileEntry& entry, const std::string& strSortBy)
+{
+    if (strSortBy == "gas")
+        return entry.nGasUsed;
+    if (strSortBy == "calls")
+        return entry.nCalls;
+    if (strSortBy == "reads")
+        return entry.nStorageReads;
+    if (strSortBy == "writes")
+        return entry.nStorageWrites;
+    return entry.nTime;
+}
+
+std::vector<std::pair<dev::Address, ContractProfileEntry>> ContractProfiler::GetTop(size_t nCount, const std::string& strSortBy) const
+{
+    std::vector<std::pair<dev::Address, ContractProfileEntry>> top;
+    {
+        LOCK(m_cs);
+        top.assign(m_totals.begin(), m_totals.end());
+    }
+    auto greater = [&strSortBy](const std::pair<dev::Address, ContractProfileEntry>& a, const std::pair<dev::Address, ContractProfileEntry>& b) {
+        return SortValue(a.second, strSortBy) > SortValue(b.second, strSortBy);
+    };
+    nCount = std::min(nCount, top.size());
+    std::partial_sort(top.begin(), top.begin() + nCount, top.end(), greater);
+    top.resize(nCount);
+    return top;
+}
+
+void ContractProfiler::GetWindow(int& nFirstHeight, int& nLastHeight, size_t& nBlocks) const
+{
+    LOCK(m_cs);
+    nBlocks = m_window.size();
+    nFirstHeight = m_window.empty() ? 0 : m_window.front().first;
+    nLastHeight = m_window.empty() ? 0 : m_window.back().first;
+}
@@ -0,0 +1,74 @@
+#ifndef QTUM_CONTRACTPROFILER_H
+#define QTUM_CONTRACTPROFILER_H
+
+#include <qtum/qtumstate.h>
+#include <sync.h>
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** Default for -contractprofile, the number of blocks the profile covers, 0 disables it */
+static const unsigned int DEFAULT_CONTRACT_PROFILE_BLOCKS = 0;
+
+/** Resources the executions of a contract used */
+struct ContractProfileEntry {
+    uint64_t nGasUsed = 0;
+    //! Wall time in microseconds
+    int64_t nTime = 0;
+    uint64_t nStorageReads = 0;
+    uint64_t nStorageWrites = 0;
+    uint64_t nCalls = 0;
+
+    void Add(const ContractProfileEntry& entry);
+    void Subtract(const ContractProfileEntry& entry);
+};
+
+using ContractProfile = std::map<dev::Address, ContractProfileEntry>;
+
+/**
+ * Per contract profile of the executions of the connected blocks.
+ *
+ * ByteCodeExec records the gas, time and call count of each transaction under
+ * the contract it calls or creates, and counts SLOAD and SSTORE under the
+ * contract that runs them, including contracts reached through inner calls.
+ * The totals cover a rolling window of the last blocks; a block connected at
+ * a height already in the window replaces it and the blocks after it.
+ */
+class ContractProfiler
+{
+public:
+    explicit ContractProfiler(unsigned int nBlocks);
+
+    //! Drop what was recorded for a block that failed to connect
+    void BeginBlock();
+    //! VM step callback counting the storage accesses of an execution into the current block
+    OnOpFunc StorageCounter();
+    //! Record a transaction execution of the current block
+    void AddExecution(const dev::Address& address, uint64_t nGasUsed, int64_t nTime);
+    //! Move the current block into the window
+    void ConnectBlock(int nHeight);
+
+    //! The contracts of the window with the highest value of the sort key
+    std::vector<std::pair<dev::Address, ContractProfileEntry>> GetTop(size_t nCount, const std::string& strSortBy) const;
+    //! First and last height of the window, and the number of blocks in it
+    void GetWindow(int& nFirstHeight, int& nLastHeight, size_t& nBlocks) const;
+
+private:
+    const unsigned int m_max_blocks;
+    //! Only used by the validation thread
+    ContractProfile m_block;
+
+    mutable CCriticalSection m_cs;
+    std::deque<std::pair<int, ContractProfile>> m_window GUARDED_BY(m_cs);
+    ContractProfile m_totals GUARDED_BY(m_cs);
+
+    void PopBlock(bool fBack) EXCLUSIVE_LOCKS_REQUIRED(m_cs);
+};
+
+/** Set by -contractprofile */
+extern std::unique_ptr<ContractProfiler> g_contract_profiler;
+
+#endif // QTUM_CONTRACTPROFILER_H
@@ -6,6 +6,7 @@
 #include <util/signstr.h>
 #include <util/strencodings.h>
 #include <libdevcore/Common.h>
+#include <libdevcore/SHA3.h>
 
 const std::string strDelegationsABI = "[{\"anonymous\":false,\"inputs\":[{\"indexed\":true,\"internalType\":\"address\",\"name\":\"_staker\",\"type\":\"address\"},{\"indexed\":true,\"internalType\":\"address\",\"name\":\"_delegate\",\"type\":\"address\"},{\"indexed\":false,\"internalType\":\"uint8\",\"name\":\"fee\",\"type\":\"uint8\"},{\"indexed\":false,\"internalType\":\"uint256\",\"name\":\"blockHeight\",\"type\":\"uint256\"},{\"indexed\":false,\"internalType\":\"bytes\",\"name\":\"PoD\",\"type\":\"bytes\"}],\"name\":\"AddDelegation\",\"type\":\"event\"},{\"anonymous\":false,\"inputs\":[{\"indexed\":true,\"internalType\":\"address\",\"name\":\"_staker\",\"type\":\"address\"},{\"indexed\":true,\"internalType\":\"address\",\"name\":\"_delegate\",\"type\":\"address\"}],\"name\":\"RemoveDelegation\",\"type\":\"event\"},{\"constant\":false,\"inputs\":[{\"internalType\":\"address\",\"name\":\"_staker\",\"type\":\"address\"},{\"internalType\":\"uint8\",\"name\":\"_fee\",\"type\":\"uint8\"},{\"internalType\":\"bytes\",\"name\":\"_PoD\",\"type\":\"bytes\"}],\"name\":\"addDelegation\",\"outputs\":[],\"payable\":false,\"stateMutability\":\"nonpayable\",\"type\":\"function\"},{\"constant\":true,\"inputs\":[{\"internalType\":\"address\",\"name\":\"\",\"type\":\"address\"}],\"name\":\"delegations\",\"outputs\":[{\"internalType\":\"address\",\"name\":\"staker\",\"type\":\"address\"},{\"internalType\":\"uint8\",\"name\":\"fee\",\"type\":\"uint8\"},{\"internalType\":\"uint256\",\"name\":\"blockHeight\",\"type\":\"uint256\"},{\"internalType\":\"bytes\",\"name\":\"PoD\",\"type\":\"bytes\"}],\"payable\":false,\"stateMutability\":\"view\",\"type\":\"function\"},{\"constant\":false,\"inputs\":[],\"name\":\"removeDelegation\",\"outputs\":[],\"payable\":false,\"stateMutability\":\"nonpayable\",\"type\":\"function\"}]";
 const ContractABI contractDelegationABI = strDelegationsABI;
@@ -153,6 +154,62 @@ public:
         return true;
     }
 
+    /**
+     * Read the delegation of an address straight from the storage of the delegations contract,
+     * without running the delegations getter. The contract keeps mapping(address => Delegation)
+     * in slot 0, the struct takes three slots: the staker packed with the fee, the block height
+     * and the PoD bytes in the solidity layout of dynamic bytes.
+     */
+    bool ReadDelegationFromStorage(const uint160 &address, Delegation &delegation) const
+    {
+        LOCK(cs_main);
+        if(!globalState || !globalState->addressInUse(delegationsAddress))
+            return false;
+
+        // The entry of the address is at keccak256(address . slot)
+        dev::bytes preimage = dev::h256(uintToh160(address), dev::h256::AlignRight).asBytes();
+        dev::bytes slotBytes = dev::h256().asBytes();
+        preimage.insert(preimage.end(), slotBytes.begin(), slotBytes.end());
+        dev::u256 entry = dev::u256(dev::sha3(preimage));
+
+        dev::u256 stakerAndFee = globalState->storage(delegationsAddress, entry);
+        dev::u256 blockHeight = globalState->storage(delegationsAddress, entry + 1);
+        dev::u256 podSlot = globalState->storage(delegationsAddress, entry + 2);
+        if(stakerAndFee == 0 || blockHeight > std::numeric_limits<uint32_t>::max())
+            return false;
+
+        dev::bytes pod;
+        if(podSlot & 1)
+        {
+            // Long bytes: the slot holds length * 2 + 1, the data starts at keccak256(slot)
+            dev::u256 length = (podSlot - 1) / 2;
+            if(length > 1024)
+                return false;
+            dev::u256 dataSlot = dev::u256(dev::sha3(dev::h256(entry + 2)));
+            for(size_t i = 0; i * 32 < length; i++)
+            {
+                dev::bytes word = dev::h256(globalState->storage(delegationsAddress, dataSlot + i)).asBytes();
+                pod.insert(pod.end(), word.begin(), word.end());
+            }
+            pod.resize((size_t)length);
+        }
+        else
+        {
+            // Short bytes: the data is left aligned in the slot and the low byte holds length * 2
+            size_t length = (size_t)(podSlot & 0xff) / 2;
+            if(length > 31)
+                return false;
+            dev::bytes word = dev::h256(podSlot).asBytes();
+            pod.assign(word.begin(), word.begin() + length);
+        }
+
+        delegation.staker = h160Touint(dev::right160(dev::h256(stakerAndFee)));
+        delegation.fee = (uint8_t)((stakerAndFee >> 160) & 0xff);
+        delegation.blockHeight = (uint32_t)blockHeight;
+        delegation.PoD = pod;
+        return true;
+    }
+
     FunctionABI* m_pfDelegations;
     FunctionABI* m_pfAddDelegationEvent;
     FunctionABI* m_pfRemoveDelegationEvent;
@@ -187,6 +244,12 @@ bool QtumDelegation::GetDelegation(const uint160 &address, Delegation &delegatio
     if(!priv->m_pfDelegations)
         return error("Get delegation ABI does not exist");
 
+    // The storage read is only trusted when it gives a delegation the staker signed, anything
+    // else, like no delegation or a contract with another layout, goes through the getter
+    if(priv->ReadDelegationFromStorage(address, delegation) && VerifyDelegation(address, delegation))
+        return true;
+    delegation = Delegation();
+
     // Serialize the input parameters for get delegation
     std::vector<std::vector<std::string>> inputValues;
     std::vector<std::string> paramAddress;
@@ -322,6 +385,30 @@ bool QtumDelegation::FilterDelegationEvents(std::vector<DelegationEvent> &events
     return true;
 }
 
+void QtumDelegation::GetDelegationEvents(const std::vector<uint256> &txHashes, std::vector<DelegationEvent> &events) const
+{
+    // A transaction is listed once for each of its logs
+    std::set<uint256> dupes;
+    for(const uint256& hashTx : txHashes)
+    {
+        if(!dupes.insert(hashTx).second) {
+            continue;
+        }
+
+        std::vector<TransactionReceiptInfo> receipts = pstorageresult->getResult(uintToh256(hashTx));
+        for(const auto& receipt : receipts) {
+            for(const dev::eth::LogEntry& log : receipt.logs)
+            {
+                DelegationEvent event;
+                if(priv->GetDelegationEvent(log, event))
+                {
+                    events.push_back(event);
+                }
+            }
+        }
+    }
+}
+
 std::map<uint160, Delegation> QtumDelegation::DelegationsFromEvents(const std::vector<DelegationEvent> &events)
 {
     std::map<uint160, Delegation> delegations;
@@ -416,3 +503,252 @@ bool QtumDelegation::IsAddBytecode(const std::vector<unsigned char> &data)
         return false;
     return true;
 }
+
+/**
+ * Number of the last blocks that can be disconnected without loading the delegations again
+ */
+static const size_t MAX_DELEGATION_UNDO_BLOCKS = 1000;
+
+class AllDelegationsFilter : public IDelegationFilter
+{
+public:
+    bool Match(const DelegationEvent& event) const
+    {
+        return true;
+    }
+};
+
+QtumDelegationIndex::QtumDelegationIndex():
+    fLoaded(false),
+    nVersion(0),
+    nVersionOldest(1)
+{}
+
+void QtumDelegationIndex::ConnectBlock(int height, const uint256 &hashBlock, const uint256 &hashPrevBlock, const std::vector<uint256> &txHashes)
+{
+    AssertLockHeld(cs_main);
+
+    if(!fLoaded)
+        return;
+
+    // A new delegation contract is deployed at the gas fix height, its delegations are loaded when used
+    if(hashPrevBlock != hashBest || height == Params().GetConsensus().nDelegationsGasFixHeight)
+    {
+        Unload();
+        return;
+    }
+
+    std::vector<DelegationEvent> events;
+    if(txHashes.size() > 0)
+    {
+        QtumDelegation qtumDelegation;
+        qtumDelegation.GetDelegationEvents(txHashes, events);
+    }
+
+    // Apply the events and keep the previous delegations to revert them
+    std::vector<std::pair<uint160, Delegation>> undo;
+    for(const DelegationEvent& event : events)
+    {
+        const uint160& delegate = event.item.delegate;
+        if(event.type != DELEGATION_ADD && event.type != DELEGATION_REMOVE)
+            continue;
+
+        auto it = mapDelegations.find(delegate);
+        undo.push_back(std::make_pair(delegate, it != mapDelegations.end() ? it->second : Delegation()));
+
+        if(event.type == DELEGATION_ADD)
+            AddDelegation(delegate, event.item);
+        else
+            RemoveDelegation(delegate);
+    }
+
+    LogChanges(undo);
+    blocksUndo.push_back(std::make_pair(hashBlock, undo));
+    if(blocksUndo.size() > MAX_DELEGATION_UNDO_BLOCKS)
+        blocksUndo.pop_front();
+    hashBest = hashBlock;
+}
+
+void QtumDelegationIndex::DisconnectBlock(const uint256 &hashBlock, const uint256 &hashPrevBlock)
+{
+    AssertLockHeld(cs_main);
+
+    if(!fLoaded)
+        return;
+
+    if(hashBlock != hashBest || blocksUndo.empty() || blocksUndo.back().first != hashBlock)
+    {
+        Unload();
+        return;
+    }
+
+    // Restore the previous delegations in reverse order
+    const std::vector<std::pair<uint160, Delegation>>& undo = blocksUndo.back().second;
+    for(auto it = undo.rbegin(); it != undo.rend(); it++)
+    {
+        if(it->second.IsNull())
+            RemoveDelegation(it->first);
+        else
+            AddDelegation(it->first, it->second);
+    }
+
+    LogChanges(undo);
+    blocksUndo.pop_back();
+    hashBest = hashPrevBlock;
+}
+
+bool QtumDelegationIndex::GetDelegationsForStaker(const uint160 &staker, std::map<uint160, Delegation> &delegations)
+{
+    if(!Load())
+        return false;
+
+    delegations.clear();
+    auto it = mapStakerDelegates.find(staker);
+    if(it != mapStakerDelegates.end())
+    {
+        for(const uint160& delegate : it->second)
+        {
+            delegations[delegate] = mapDelegations[delegate];
+        }
+    }
+
+    return true;
+}
+
+bool QtumDelegationIndex::GetDelegations(const IDelegationFilter &filter, std::map<uint160, Delegation> &delegations)
+{
+    if(!Load())
+        return false;
+
+    delegations.clear();
+    for(const auto& item : mapDelegations)
+    {
+        DelegationEvent event;
+        static_cast<Delegation&>(event.item) = item.second;
+        event.item.delegate = item.first;
+        event.type = DELEGATION_ADD;
+        if(filter.Match(event))
+        {
+            delegations[item.first] = item.second;
+        }
+    }
+
+    return true;
+}
+
+bool QtumDelegationIndex::GetDelegationChanges(uint64_t &version, std::map<uint160, Delegation> &changes)
+{
+    changes.clear();
+    if(!Load())
+        return false;
+
+    bool fKnown = version >= nVersionOldest;
+    if(fKnown)
+    {
+        for(auto it = versionChanges.rbegin(); it != versionChanges.rend() && it->first > version; it++)
+        {
+            for(const uint160& delegate : it->second)
+            {
+                auto itDelegation = mapDelegations.find(delegate);
+                changes[delegate] = itDelegation != mapDelegations.end() ? itDelegation->second : Delegation();
+            }
+        }
+    }
+    version = nVersion;
+
+    return fKnown;
+}
+
+bool QtumDelegationIndex::Load()
+{
+    AssertLockHeld(cs_main);
+
+    CBlockIndex* pindexTip = chainActive.Tip();
+    if(!pindexTip)
+        return false;
+
+    if(fLoaded && hashBest == pindexTip->GetBlockHash())
+        return true;
+
+    // Load the delegations of the delegation contract for the tip from the log events
+    Unload();
+    QtumDelegation qtumDelegation;
+    std::vector<DelegationEvent> events;
+    if(!qtumDelegation.FilterDelegationEvents(events, AllDelegationsFilter()))
+        return false;
+
+    for(const DelegationEvent& event : events)
+    {
+        if(event.type == DELEGATION_ADD)
+            AddDelegation(event.item.delegate, event.item);
+        else if(event.type == DELEGATION_REMOVE)
+            RemoveDelegation(event.item.delegate);
+    }
+
+    // The changes before loading are not known
+    nVersion++;
+    nVersionOldest = nVersion;
+    hashBest = pindexTip->GetBlockHash();
+    fLoaded = true;
+
+    return true;
+}
+
+void QtumDelegationIndex::Unload()
+{
+    fLoaded = false;
+    hashBest.SetNull();
+    mapDelegations.clear();
+    mapStakerDelegates.clear();
+    blocksUndo.clear();
+    versionChanges.clear();
+    nVersionOldest = nVersion + 1;
+}
+
+void QtumDelegationIndex::LogChanges(const std::vector<std::pair<uint160, Delegation>>& undo)
+{
+    if(undo.empty())
+        return;
+
+    std::vector<uint160> delegates;
+    for(const auto& item : undo)
+    {
+        delegates.push_back(item.first);
+    }
+    nVersion++;
+    versionChanges.push_back(std::make_pair(nVersion, delegates));
+    if(versionChanges.size() > MAX_DELEGATION_UNDO_BLOCKS)
+    {
+        versionChanges.pop_front();
+        nVersionOldest = versionChanges.front().first - 1;
+    }
+}
+
+void QtumDelegationIndex::AddDelegation(const uint160 &delegate, const Delegation &delegation)
+{
+    RemoveDelegation(delegate);
+    mapDelegations[delegate] = delegation;
+    mapStakerDelegates[delegation.staker].insert(delegate);
+}
+
+void QtumDelegationIndex::RemoveDelegation(const uint160 &delegate)
+{
+    auto it = mapDelegations.find(delegate);
+    if(it == mapDelegations.end())
+        return;
+
+    auto itStaker = mapStakerDelegates.find(it->second.staker);
+    if(itStaker != mapStakerDelegates.end())
+    {
+        itStaker->second.erase(delegate);
+        if(itStaker->second.empty())
+            mapStakerDelegates.erase(itStaker);
+    }
+    mapDelegations.erase(it);
+}
+
+QtumDelegationIndex& DelegationIndex()
+{
+    static QtumDelegationIndex delegationIndex;
+    return delegationIndex;
+}
@@ -2,7 +2,9 @@
 #define QTUMDELEGATION_H
 #include <string>
 #include <vector>
+#include <deque>
 #include <map>
+#include <set>
 #include <stdint.h>
 #include <uint256.h>
 
@@ -130,6 +132,13 @@ public:
      */
     bool FilterDelegationEvents(std::vector<DelegationEvent>& events, const IDelegationFilter& filter, int fromBlock = 0, int toBlock = -1, int minconf = 0) const;
 
+    /**
+     * @brief GetDelegationEvents Get the delegation events from the receipts of transactions
+     * @param txHashes Transactions with logs from the delegation contract
+     * @param events Output list of delegation events
+     */
+    void GetDelegationEvents(const std::vector<uint256>& txHashes, std::vector<DelegationEvent>& events) const;
+
     /**
      * @brief DelegationsFromEvents Get the delegations from the events
      * @param events Delegation event list
@@ -179,4 +188,81 @@ private:
     QtumDelegation& operator=(const QtumDelegation&);
     QtumDelegationPriv* priv;
 };
+
+/**
+ * @brief The QtumDelegationIndex class Delegations of the active chain
+ * The delegations are loaded from the log events when first used,
+ * then updated with the delegation events of the connected and disconnected blocks.
+ * All the methods require cs_main.
+ */
+class QtumDelegationIndex {
+
+public:
+    QtumDelegationIndex();
+
+    /**
+     * @brief ConnectBlock Apply the delegation events of a connected block
+     * @param height Block height
+     * @param hashBlock Block hash
+     * @param hashPrevBlock Previous block hash
+     * @param txHashes Transactions of the block with logs from the delegation contract
+     */
+    void ConnectBlock(int height, const uint256& hashBlock, const uint256& hashPrevBlock, const std::vector<uint256>& txHashes);
+
+    /**
+     * @brief DisconnectBlock Revert the delegation events of a disconnected block
+     * @param hashBlock Block hash
+     * @param hashPrevBlock Previous block hash
+     */
+    void DisconnectBlock(const uint256& hashBlock, const uint256& hashPrevBlock);
+
+    /**
+     * @brief GetDelegationsForStaker Get the delegations for a staker
+     * @param staker Staker address
+     * @param delegations Output list of delegations by delegate address
+     * @return true/false
+     */
+    bool GetDelegationsForStaker(const uint160& staker, std::map<uint160, Delegation>& delegations);
+
+    /**
+     * @brief GetDelegations Get the delegations that match a filter
+     * @param filter Delegation filter, applied to the delegations as add delegation events
+     * @param delegations Output list of delegations by delegate address
+     * @return true/false
+     */
+    bool GetDelegations(const IDelegationFilter& filter, std::map<uint160, Delegation>& delegations);
+
+    /**
+     * @brief GetDelegationChanges Get the delegations changed since a version of the index
+     * @param version Version of the index the caller is up to date with, set to the current version
+     * @param changes Output list of the current delegations of the changed delegates, null for removed ones
+     * @return true when the changes are known, false when the delegations need to be fetched again
+     */
+    bool GetDelegationChanges(uint64_t& version, std::map<uint160, Delegation>& changes);
+
+private:
+    bool Load();
+    void Unload();
+    void AddDelegation(const uint160& delegate, const Delegation& delegation);
+    void RemoveDelegation(const uint160& delegate);
+    void LogChanges(const std::vector<std::pair<uint160, Delegation>>& undo);
+
+    bool fLoaded;
+    uint256 hashBest;
+    // Delegation of each delegate, and the delegates of each staker
+    std::map<uint160, Delegation> mapDelegations;
+    std::map<uint160, std::set<uint160>> mapStakerDelegates;
+    // Previous delegations of the delegates changed by the last blocks
+    std::deque<std::pair<uint256, std::vector<std::pair<uint160, Delegation>>>> blocksUndo;
+    // Version advanced by every change, the oldest version the changes are known from and the changed delegates of each version
+    uint64_t nVersion;
+    uint64_t nVersionOldest;
+    std::deque<std::pair<uint64_t, std::vector<uint160>>> versionChanges;
+};
+
+/**
+ * @brief DelegationIndex Get the delegation index of the active chain
+ * @return Delegation index
+ */
+QtumDelegationIndex& DelegationIndex();
 #endif
@@ -1,15 +1,77 @@
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <util/system.h>
 #include <validation.h>
 #include <chainparams.h>
 #include <script/script.h>
 #include <qtum/qtumstate.h>
+#include <qtum/codecache.h>
 #include <libevm/VMFace.h>
+#include <libevm/VMFactory.h>
+
+#include <boost/program_options.hpp>
 
 using namespace std;
 using namespace dev;
 using namespace dev::eth;
 
+bool SelectEVMKind(const std::string& name)
+{
+    // The bundled VMs only, the loader of external EVMC libraries is not built
+    if (name != "legacy" && name != "interpreter")
+        return false;
+
+    // The kind Executive creates is only settable through the aleth VM options
+    namespace po = boost::program_options;
+    const std::vector<std::string> args{"--vm", name};
+    po::variables_map vm;
+    try {
+        po::store(po::command_line_parser(args).options(dev::eth::vmProgramOptions()).run(), vm);
+        po::notify(vm);
+    } catch (const po::error&) {
+        return false;
+    }
+    return true;
+}
+
+UTXOAddressFilter::UTXOAddressFilter(size_t nElements, dev::h256 const& root) :
+    bits(std::max<size_t>(nElements * 16, 1 << 20) / 64) {
+    coverRoot(root);
+}
+
+size_t UTXOAddressFilter::bitIndex(dev::Address const& address, int n) const {
+    uint32_t word;
+    memcpy(&word, address.data() + n * sizeof(word), sizeof(word));
+    return word % (bits.size() * 64);
+}
+
+void UTXOAddressFilter::insert(dev::Address const& address) {
+    for (int n = 0; n < 4; n++) {
+        size_t index = bitIndex(address, n);
+        bits[index / 64] |= uint64_t(1) << (index % 64);
+    }
+}
+
+bool UTXOAddressFilter::mightContain(dev::Address const& address) const {
+    for (int n = 0; n < 4; n++) {
+        size_t index = bitIndex(address, n);
+        if (!(bits[index / 64] & (uint64_t(1) << (index % 64))))
+            return false;
+    }
+    return true;
+}
+
+void UTXOAddressFilter::coverRoot(dev::h256 const& root) {
+    if (!roots.insert(root).second)
+        return;
+    rootsOrder.push_back(root);
+    if (rootsOrder.size() > MAX_ROOTS) {
+        roots.erase(rootsOrder.front());
+        rootsOrder.pop_front();
+    }
+}
+
 QtumState::QtumState(u256 const& _accountStartNonce, OverlayDB const& _db, const string& _path, BaseState _bs) :
         State(_accountStartNonce, _db, _bs) {
             dbUTXO = QtumState::openDB(_path + "/hydraDB", sha3(rlp("")), WithExisting::Trust);
@@ -21,7 +83,18 @@ QtumState::QtumState() : dev::eth::State(dev::Invalid256, dev::OverlayDB(), dev:
     stateUTXO = SecureTrieDB<Address, OverlayDB>(&dbUTXO);
 }
 
-ResultExecute QtumState::execute(EnvInfo const& _envInfo, SealEngineFace const& _sealEngine, QtumTransaction const& _t, Permanence _p, OnOpFunc const& _onOp){
+QtumState::QtumState(QtumState const& _state) : dev::eth::State(_state), dbUTXO(_state.dbUTXO), cacheUTXO(_state.cacheUTXO), pendingUTXO(_state.pendingUTXO), deferUTXOCommit(_state.deferUTXOCommit) {
+    stateUTXO = SecureTrieDB<Address, OverlayDB>(&dbUTXO);
+    stateUTXO.setRoot(_state.stateUTXO.root());
+}
+
+QtumExecutionContext::QtumExecutionContext(int _nHeight) : nHeight(_nHeight) {
+    const Consensus::Params& consensusParams = Params().GetConsensus();
+    fValidateTransfers = nHeight >= consensusParams.QIP7Height;
+    fCommitOnException = nHeight < consensusParams.nFixUTXOCacheHFHeight;
+}
+
+ResultExecute QtumState::execute(EnvInfo const& _envInfo, SealEngineFace const& _sealEngine, QtumTransaction const& _t, QtumExecutionContext const& _context, Permanence _p, OnOpFunc const& _onOp){
 
     assert(_t.getVersion().toRaw() == VersionVM::GetEVMDefault().toRaw());
 
@@ -30,6 +103,9 @@ ResultExecute QtumState::execute(EnvInfo const& _envInfo, SealEngineFace const&
 
     _sealEngine.deleteAddresses.insert({_t.sender(), _envInfo.author()});
 
+    if (!_t.isCreation())
+        loadCode(_t.receiveAddress());
+
     h256 oldStateRoot = rootHash();
     h256 oldUTXORoot = rootHashUTXO();
     bool voutLimit = false;
@@ -48,7 +124,7 @@ ResultExecute QtumState::execute(EnvInfo const& _envInfo, SealEngineFace const&
 
     CTransactionRef tx;
     u256 startGasUsed;
-    const Consensus::Params& consensusParams = Params().GetConsensus();
+    std::vector<Address> createdContracts;
     try{
         if (_t.isCreation() && _t.value())
             BOOST_THROW_EXCEPTION(CreateWithValue());
@@ -58,7 +134,7 @@ ResultExecute QtumState::execute(EnvInfo const& _envInfo, SealEngineFace const&
         startGasUsed = _envInfo.gasUsed();
         if (!e.execute()){
             e.go(onOp);
-            if(chainActive.Height() >= consensusParams.QIP7Height){
+            if(_context.fValidateTransfers){
                 validateTransfersWithChangeLog();
             }
         } else {
@@ -74,29 +150,36 @@ ResultExecute QtumState::execute(EnvInfo const& _envInfo, SealEngineFace const&
             deleteAccounts(_sealEngine.deleteAddresses);
             if(res.excepted == TransactionException::None){
                 CondensingTX ctx(this, transfers, _t, _sealEngine.deleteAddresses);
-                tx = MakeTransactionRef(ctx.createCondensingTX());
+                tx = ctx.createCondensingTX();
                 if(ctx.reachedVoutLimit()){
                     voutLimit = true;
                     e.revert();
                     throw Exception();
                 }
-                std::unordered_map<dev::Address, Vin> vins = ctx.createVin(*tx);
-                updateUTXO(vins);
+                updateUTXO(ctx.createVin(*tx));
             } else {
                 printfErrorLog(res.excepted);
             }
             
-            qtum::commit(cacheUTXO, stateUTXO, m_cache);
-            cacheUTXO.clear();
+            // The accounts created by the transaction, including by contracts it called, are only in the change log until the commit
+            for (const auto& change : m_changeLog) {
+                if (change.kind == Change::Create)
+                    createdContracts.push_back(change.address);
+            }
+
+            commitUTXOCache();
             bool removeEmptyAccounts = _envInfo.number() >= _sealEngine.chainParams().EIP158ForkBlock;
             commit(removeEmptyAccounts ? State::CommitBehaviour::RemoveEmptyAccounts : State::CommitBehaviour::KeepEmptyAccounts);
+
+            createdContracts.erase(std::remove_if(createdContracts.begin(), createdContracts.end(),
+                [this](const Address& address) { return !addressHasCode(address); }), createdContracts.end());
         }
     }
     catch(Exception const& _e){
         printfErrorLog(dev::eth::toTransactionException(_e));
         res.excepted = dev::eth::toTransactionException(_e);
         res.gasUsed = _t.gas();
-        if(chainActive.Height() < consensusParams.nFixUTXOCacheHFHeight  && _p != Permanence::Reverted){
+        if(_context.fCommitOnException && _p != Permanence::Reverted){
             deleteAccounts(_sealEngine.deleteAddresses);
             commit(CommitBehaviour::RemoveEmptyAccounts);
         } else {
@@ -128,10 +211,27 @@ ResultExecute QtumState::execute(EnvInfo const& _envInfo, SealEngineFace const&
         //make sure to use empty transaction if no vouts made
         return ResultExecute{ex, QtumTransactionReceipt(oldStateRoot, oldUTXORoot, gas, e.logs()), refund.vout.empty() ? CTransaction() : CTransaction(refund)};
     }else{
-        return ResultExecute{res, QtumTransactionReceipt(rootHash(), rootHashUTXO(), startGasUsed + e.gasUsed(), e.logs()), tx ? *tx : CTransaction()};
+        return ResultExecute{res, QtumTransactionReceipt(rootHash(), rootHashUTXO(), startGasUsed + e.gasUsed(), e.logs()), tx ? *tx : CTransaction(), createdContracts};
     }
 }
 
+h256 QtumState::storagePage(Address const& _addr, h256 const& _start, size_t _limit, std::map<h256, std::pair<u256, u256>>& _entries) const
+{
+    h256 root = storageRoot(_addr);
+    if (!root || root == EmptyTrie)
+        return h256();
+    // Read only, as in State::storage
+    SecureTrieDB<h256, OverlayDB> memdb(const_cast<OverlayDB*>(&db()), root);
+    size_t count = 0;
+    for (auto it = memdb.hashedLowerBound(_start); it != memdb.hashedEnd(); ++it, ++count) {
+        h256 const hashedKey((*it).first);
+        if (count == _limit)
+            return hashedKey;
+        _entries[hashedKey] = std::make_pair(u256(h256(it.key())), RLP((*it).second).toInt<u256>());
+    }
+    return h256();
+}
+
 std::unordered_map<dev::Address, Vin> QtumState::vins() const // temp
 {
     std::unordered_map<dev::Address, Vin> ret;
@@ -162,6 +262,17 @@ Vin* QtumState::vin(dev::Address const& _addr)
 {
     auto it = cacheUTXO.find(_addr);
     if (it == cacheUTXO.end()){
+        // A deferred change reads like the trie entry it replaces, a spent one like a removed entry
+        auto pending = pendingUTXO.find(_addr);
+        if (pending != pendingUTXO.end()){
+            if (!pending->second.alive)
+                return nullptr;
+            return &cacheUTXO.emplace(_addr, pending->second).first->second;
+        }
+
+        if (utxoFilter && !utxoFilter->mightContain(_addr))
+            return nullptr;
+
         std::string stateBack = stateUTXO.at(_addr);
         if (stateBack.empty())
             return nullptr;
@@ -177,6 +288,58 @@ Vin* QtumState::vin(dev::Address const& _addr)
     return &it->second;
 }
 
+void QtumState::commitUTXOCache()
+{
+    if (deferUTXOCommit){
+        for (auto const& i : cacheUTXO)
+            pendingUTXO[i.first] = i.second;
+    } else {
+        writeUTXO(cacheUTXO);
+    }
+    cacheUTXO.clear();
+}
+
+void QtumState::commitUTXO()
+{
+    writeUTXO(pendingUTXO);
+    pendingUTXO.clear();
+}
+
+void QtumState::writeUTXO(std::unordered_map<dev::Address, Vin> const& _cache)
+{
+    qtum::commit(_cache, stateUTXO, m_cache);
+    if (utxoFilter){
+        for (auto const& i : _cache){
+            if (i.second.alive)
+                utxoFilter->insert(i.first);
+        }
+        utxoFilter->coverRoot(stateUTXO.root());
+    }
+}
+
+void QtumState::setRootUTXO(dev::h256 const& _r)
+{
+    cacheUTXO.clear();
+    pendingUTXO.clear();
+    stateUTXO.setRoot(_r);
+    if (utxoFilter && !utxoFilter->covers(_r)){
+        LogPrintf("Contract UTXO filter does not cover root %s, disabled\n", _r.hex());
+        utxoFilter.reset();
+    }
+}
+
+void QtumState::buildUTXOFilter()
+{
+    std::vector<dev::Address> addresses;
+    for (auto const& i : stateUTXO)
+        addresses.push_back(i.first);
+    // Room for the entries written from now on, a fuller filter only costs more trie lookups
+    utxoFilter.reset(new UTXOAddressFilter(addresses.size() * 2, stateUTXO.root()));
+    for (dev::Address const& address : addresses)
+        utxoFilter->insert(address);
+    LogPrintf("Indexed %u contract UTXO addresses\n", addresses.size());
+}
+
 // void QtumState::commit(CommitBehaviour _commitBehaviour)
 // {
 //     if (_commitBehaviour == CommitBehaviour::RemoveEmptyAccounts)
@@ -242,7 +405,7 @@ void QtumState::deleteAccounts(std::set<dev::Address>& addrs){
     }
 }
 
-void QtumState::updateUTXO(const std::unordered_map<dev::Address, Vin>& vins){
+void QtumState::updateUTXO(const std::vector<std::pair<dev::Address, Vin>>& vins){
     for(auto& v : vins){
         Vin* vi = const_cast<Vin*>(vin(v.first));
 
@@ -257,6 +420,19 @@ void QtumState::updateUTXO(const std::unordered_map<dev::Address, Vin>& vins){
     }
 }
 
+void QtumState::loadCode(dev::Address const& _addr){
+    if (!g_contract_code_cache)
+        return;
+    dev::eth::Account* a = account(_addr);
+    if (!a || a->codeHash() == EmptySHA3 || !a->code().empty())
+        return;
+    if (std::shared_ptr<const bytes> code = g_contract_code_cache->Get(a->codeHash())) {
+        a->noteCode(bytesConstRef(code.get()));
+    } else {
+        g_contract_code_cache->Insert(a->codeHash(), State::code(_addr));
+    }
+}
+
 void QtumState::printfErrorLog(const dev::eth::TransactionException er){
     std::stringstream ss;
     ss << er;
@@ -302,85 +478,108 @@ void QtumState::deployDelegationsContract(int height){
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////
-CTransaction CondensingTX::createCondensingTX(){
-    selectionVin();
-    calculatePlusAndMinus();
+CTransactionRef CondensingTX::createCondensingTX(){
+    collectTransfers();
     if(!createNewBalances())
-        return CTransaction();
+        return MakeTransactionRef(CTransaction());
     CMutableTransaction tx;
-    tx.vin = createVins();;
+    tx.vin = createVins();
     tx.vout = createVout();
-    return !tx.vin.size() || !tx.vout.size() ? CTransaction() : CTransaction(tx);
+    // The execution is reverted, so the transaction is not built
+    if(voutOverflow)
+        return nullptr;
+    if(tx.vin.empty() || tx.vout.empty())
+        return MakeTransactionRef(CTransaction());
+    return MakeTransactionRef(std::move(tx));
 }
 
-std::unordered_map<dev::Address, Vin> CondensingTX::createVin(const CTransaction& tx){
-    std::unordered_map<dev::Address, Vin> vins;
-    for(auto& b : balances){
-        if(b.first == transaction.sender())
+std::vector<std::pair<dev::Address, Vin>> CondensingTX::createVin(const CTransaction& tx) const{
+    std::vector<std::pair<dev::Address, Vin>> vins;
+    vins.reserve(nBalances);
+    const dev::h256 hashTx = uintToh256(tx.GetHash());
+    for(size_t i = 0; i < nBalances; i++){
+        const Entry& e = entries[i];
+        if(e.address == transaction.sender())
             continue;
 
-        if(b.second > 0){
-            vins[b.first] = Vin{uintToh256(tx.GetHash()), nVouts[b.first], b.second, 1};
+        if(e.balance > 0){
+            vins.emplace_back(e.address, Vin{hashTx, e.nVout, e.balance, 1});
         } else {
-            vins[b.first] = Vin{uintToh256(tx.GetHash()), 0, 0, 0};
+            vins.emplace_back(e.address, Vin{hashTx, 0, 0, 0});
         }
     }
     return vins;
 }
 
-void CondensingTX::selectionVin(){
-    for(const TransferInfo& ti : transfers){
-        if(!vins.count(ti.from)){
-            if(auto a = state->vin(ti.from))
-                vins[ti.from] = *a;
-            if(ti.from == transaction.sender() && transaction.value() > 0){
-                vins[ti.from] = Vin{transaction.getHashWith(), transaction.getNVout(), transaction.value(), 1};
-            }
-        }
+CondensingTX::Entry& CondensingTX::entry(dev::Address const& addr){
+    auto it = std::lower_bound(entries.begin(), entries.end(), addr, [](const Entry& e, dev::Address const& a) { return e.address < a; });
+    assert(it != entries.end() && it->address == addr);
+    return *it;
+}
 
-        if(!vins.count(ti.to)){
-            if(auto a = state->vin(ti.to))
-                vins[ti.to] = *a;
+void CondensingTX::selectVin(Entry& e, bool fSpendsTxValue){
+    // The first UTXO found for an address is the one it spends
+    if(e.hasVin)
+        return;
+    if(!e.stateChecked){
+        e.stateChecked = true;
+        if(auto a = state->vin(e.address)){
+            e.vin = *a;
+            e.hasVin = true;
         }
     }
+    if(fSpendsTxValue){
+        e.vin = Vin{transaction.getHashWith(), transaction.getNVout(), transaction.value(), 1};
+        e.hasVin = true;
+    }
 }
 
-void CondensingTX::calculatePlusAndMinus(){
+void CondensingTX::collectTransfers(){
+    std::vector<dev::Address> addresses;
+    addresses.reserve(transfers.size() * 2);
     for(const TransferInfo& ti : transfers){
-        if(!plusMinusInfo.count(ti.from)){
-            plusMinusInfo[ti.from] = std::make_pair(0, ti.value);
-        } else {
-            plusMinusInfo[ti.from] = std::make_pair(plusMinusInfo[ti.from].first, plusMinusInfo[ti.from].second + ti.value);
-        }
+        addresses.push_back(ti.from);
+        addresses.push_back(ti.to);
+    }
+    std::sort(addresses.begin(), addresses.end());
+    addresses.erase(std::unique(addresses.begin(), addresses.end()), addresses.end());
+    entries.resize(addresses.size());
+    for(size_t i = 0; i < addresses.size(); i++)
+        entries[i].address = addresses[i];
 
-        if(!plusMinusInfo.count(ti.to)){
-            plusMinusInfo[ti.to] = std::make_pair(ti.value, 0);
-        } else {
-            plusMinusInfo[ti.to] = std::make_pair(plusMinusInfo[ti.to].first + ti.value, plusMinusInfo[ti.to].second);
-        }
+    const bool fTxValue = transaction.value() > 0;
+    for(const TransferInfo& ti : transfers){
+        Entry& from = entry(ti.from);
+        selectVin(from, fTxValue && ti.from == transaction.sender());
+        from.minus += ti.value;
+
+        Entry& to = entry(ti.to);
+        selectVin(to, false);
+        to.plus += ti.value;
     }
 }
 
 bool CondensingTX::createNewBalances(){
-    for(auto& p : plusMinusInfo){
+    for(Entry& e : entries){
         dev::u256 balance = 0;
-        if((vins.count(p.first) && vins[p.first].alive) || (!vins[p.first].alive && !checkDeleteAddress(p.first))){
-            balance = vins[p.first].value;
+        if(e.hasVin && (e.vin.alive || !checkDeleteAddress(e.address))){
+            balance = e.vin.value;
         }
-        balance += p.second.first;
-        if(balance < p.second.second)
+        balance += e.plus;
+        if(balance < e.minus)
             return false;
-        balance -= p.second.second;
-        balances[p.first] = balance;
+        e.balance = balance - e.minus;
+        nBalances++;
     }
     return true;
 }
 
 std::vector<CTxIn> CondensingTX::createVins(){
     std::vector<CTxIn> ins;
-    for(auto& v : vins){
-        if((v.second.value > 0 && v.second.alive) || (v.second.value > 0 && !vins[v.first].alive && !checkDeleteAddress(v.first)))
-            ins.push_back(CTxIn(h256Touint(v.second.hash), v.second.nVout, CScript() << OP_SPEND));
+    ins.reserve(entries.size());
+    for(const Entry& e : entries){
+        if(e.hasVin && e.vin.value > 0 && (e.vin.alive || !checkDeleteAddress(e.address)))
+            ins.push_back(CTxIn(h256Touint(e.vin.hash), e.vin.nVout, CScript() << OP_SPEND));
     }
     return ins;
 }
@@ -388,18 +587,19 @@ std::vector<CTxIn> CondensingTX::createVins(){
 std::vector<CTxOut> CondensingTX::createVout(){
     size_t count = 0;
     std::vector<CTxOut> outs;
-    for(auto& b : balances){
-        if(b.second > 0){
+    outs.reserve(std::min(entries.size(), MAX_CONTRACT_VOUTS + 1));
+    for(Entry& e : entries){
+        if(e.balance > 0){
             CScript script;
-            auto* a = state->account(b.first);
+            auto* a = state->account(e.address);
             if(a && a->isAlive()){
                 //create a no-exec contract output
-                script = CScript() << valtype{0} << valtype{0} << valtype{0} << b.first.asBytes() << OP_CALL;
+                script = CScript() << valtype{0} << valtype{0} << valtype{0} << e.address.asBytes() << OP_CALL;
             } else {
-                script = CScript() << OP_DUP << OP_HASH160 << b.first.asBytes() << OP_EQUALVERIFY << OP_CHECKSIG;
+                script = CScript() << OP_DUP << OP_HASH160 << e.address.asBytes() << OP_EQUALVERIFY << OP_CHECKSIG;
             }
-            outs.push_back(CTxOut(CAmount(b.second), script));
-            nVouts[b.first] = count;
+            outs.push_back(CTxOut(CAmount(e.balance), script));
+            e.nVout = count;
             count++;
         }
         if(count > MAX_CONTRACT_VOUTS){
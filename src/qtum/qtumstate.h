@@ -9,15 +9,25 @@
 #include <util/convert.h>
 #include <primitives/transaction.h>
 #include <qtum/qtumtransaction.h>
+#include <qtum/qtumutils.h>
 
 #include <libethereum/Executive.h>
 #include <libethcore/SealEngine.h>
 
+#include <deque>
+#include <unordered_set>
+
 using OnOpFunc = std::function<void(uint64_t, uint64_t, dev::eth::Instruction, dev::bigint, dev::bigint, 
     dev::bigint, dev::eth::VMFace const*, dev::eth::ExtVMFace const*)>;
 using plusAndMinus = std::pair<dev::u256, dev::u256>;
 using valtype = std::vector<unsigned char>;
 
+/** Default for -vm, the EVM implementation the contracts are executed on */
+static const char* const DEFAULT_EVM_KIND = "legacy";
+
+/** Make the Executive create the named VM, "legacy" or the EVMC "interpreter". Returns false for an unknown name */
+bool SelectEVMKind(const std::string& name);
+
 struct TransferInfo{
     dev::Address from;
     dev::Address to;
@@ -42,10 +52,25 @@ private:
     dev::h256 m_utxoRoot;
 };
 
+/** The chain context of contract executions. The caller sets it up, so execute() reads no chain globals
+ *  and can run on snapshots and worker threads without cs_main */
+struct QtumExecutionContext{
+    //! Height of the active chain when the executions are set up, the parent of a block being connected
+    int nHeight;
+    //! QIP7, the transfers of an execution are validated against its change log
+    bool fValidateTransfers;
+    //! Before nFixUTXOCacheHFHeight a failed execution still commits the state it left
+    bool fCommitOnException;
+
+    explicit QtumExecutionContext(int _nHeight);
+};
+
 struct ResultExecute{
     dev::eth::ExecutionResult execRes;
     QtumTransactionReceipt txRec;
     CTransaction tx;
+    //! Contracts created by the transaction and the contracts it called
+    std::vector<dev::Address> createdContracts;
 };
 
 namespace qtum{
@@ -67,6 +92,40 @@ namespace qtum{
     }
 }
 
+/**
+ * Approximate set of the addresses with an entry in the UTXO trie, for the roots it covers: the
+ * root it was built from and the roots written on top of it since. An address it does not contain
+ * has no entry under those roots, so the trie lookup can be skipped.
+ */
+class UTXOAddressFilter{
+
+public:
+
+    UTXOAddressFilter(size_t nElements, dev::h256 const& root);
+
+    void insert(dev::Address const& address);
+
+    bool mightContain(dev::Address const& address) const;
+
+    /** Record a root written on top of a covered one, the oldest are forgotten past MAX_ROOTS */
+    void coverRoot(dev::h256 const& root);
+
+    bool covers(dev::h256 const& root) const { return roots.count(root) != 0; }
+
+    static const size_t MAX_ROOTS = 50000;
+
+private:
+
+    //! Contract addresses are hashes, so disjoint bytes of the address serve as the bit indexes
+    size_t bitIndex(dev::Address const& address, int n) const;
+
+    std::vector<uint64_t> bits;
+
+    std::unordered_set<dev::h256> roots;
+
+    std::deque<dev::h256> rootsOrder;
+};
+
 class CondensingTX;
 
 class QtumState : public dev::eth::State {
@@ -77,9 +136,30 @@ public:
 
     QtumState(dev::u256 const& _accountStartNonce, dev::OverlayDB const& _db, const std::string& _path, dev::eth::BaseState _bs = dev::eth::BaseState::PreExisting);
 
-    ResultExecute execute(dev::eth::EnvInfo const& _envInfo, dev::eth::SealEngineFace const& _sealEngine, QtumTransaction const& _t, dev::eth::Permanence _p = dev::eth::Permanence::Committed, dev::eth::OnOpFunc const& _onOp = OnOpFunc());
+    /** Copy the state at its current roots, the copy shares the databases but never writes to them unless committed */
+    QtumState(QtumState const& _state);
+
+    ResultExecute execute(dev::eth::EnvInfo const& _envInfo, dev::eth::SealEngineFace const& _sealEngine, QtumTransaction const& _t, QtumExecutionContext const& _context, dev::eth::Permanence _p = dev::eth::Permanence::Committed, dev::eth::OnOpFunc const& _onOp = OnOpFunc());
+
+    void setRootUTXO(dev::h256 const& _r);
 
-    void setRootUTXO(dev::h256 const& _r) { cacheUTXO.clear(); stateUTXO.setRoot(_r); }
+    /** Go back to the given roots after speculative execution. A root that did not move is left alone so its caches stay warm */
+    void restoreRoots(dev::h256 const& _stateRoot, dev::h256 const& _utxoRoot) {
+        if (rootHash() != _stateRoot) setRoot(_stateRoot);
+        if (rootHashUTXO() != _utxoRoot || !pendingUTXO.empty()) setRootUTXO(_utxoRoot);
+    }
+
+    /** Keep the UTXO changes of the executions in memory instead of writing them to the UTXO trie after each
+     *  transaction. rootHashUTXO() and the receipts stay at the last written root until commitUTXO().
+     *  Turning it off drops the changes that were not committed */
+    void setDeferUTXOCommit(bool _defer) { deferUTXOCommit = _defer; if (!_defer) pendingUTXO.clear(); }
+
+    /** Write the deferred UTXO changes to the UTXO trie */
+    void commitUTXO();
+
+    /** Index the addresses of the current UTXO trie, so that vin() skips the trie for addresses without an entry.
+     *  The filter is dropped when the root is set to one it does not cover, and is not copied with the state */
+    void buildUTXOFilter();
 
     void setCacheUTXO(dev::Address const& address, Vin const& vin) { cacheUTXO.insert(std::make_pair(address, vin)); }
 
@@ -87,25 +167,16 @@ public:
 
     std::unordered_map<dev::Address, Vin> vins() const; // temp
 
+    /** Add up to _limit storage entries of the account to _entries, walking its committed storage trie in the
+     *  order of the hashed slots from _start. Returns the hashed slot of the next entry, zero at the end */
+    dev::h256 storagePage(dev::Address const& _addr, dev::h256 const& _start, size_t _limit, std::map<dev::h256, std::pair<dev::u256, dev::u256>>& _entries) const;
+
     dev::OverlayDB const& dbUtxo() const { return dbUTXO; }
 
     dev::OverlayDB& dbUtxo() { return dbUTXO; }
 
     static const dev::Address createQtumAddress(dev::h256 hashTx, uint32_t voutNumber){
-        uint256 hashTXid(h256Touint(hashTx));
-        std::vector<unsigned char> txIdAndVout(hashTXid.begin(), hashTXid.end());
-        std::vector<unsigned char> voutNumberChrs;
-        if (voutNumberChrs.size() < sizeof(voutNumber))voutNumberChrs.resize(sizeof(voutNumber));
-        std::memcpy(voutNumberChrs.data(), &voutNumber, sizeof(voutNumber));
-        txIdAndVout.insert(txIdAndVout.end(),voutNumberChrs.begin(),voutNumberChrs.end());
-
-        std::vector<unsigned char> SHA256TxVout(32);
-        CSHA256().Write(txIdAndVout.data(), txIdAndVout.size()).Finalize(SHA256TxVout.data());
-
-        std::vector<unsigned char> hashTxIdAndVout(20);
-        CRIPEMD160().Write(SHA256TxVout.data(), SHA256TxVout.size()).Finalize(hashTxIdAndVout.data());
-
-        return dev::Address(hashTxIdAndVout);
+        return qtumutils::contract_address(hashTx, voutNumber);
     }
 
     void deployDelegationsContract(int height);
@@ -130,10 +201,13 @@ private:
 
     void deleteAccounts(std::set<dev::Address>& addrs);
 
-    void updateUTXO(const std::unordered_map<dev::Address, Vin>& vins);
+    void updateUTXO(const std::vector<std::pair<dev::Address, Vin>>& vins);
 
     void printfErrorLog(const dev::eth::TransactionException er);
 
+    /** Note the code of the account from g_contract_code_cache instead of the state database */
+    void loadCode(dev::Address const& _addr);
+
     dev::Address newAddress;
 
     std::vector<TransferInfo> transfers;
@@ -144,6 +218,17 @@ private:
 
 	std::unordered_map<dev::Address, Vin> cacheUTXO;
 
+    //! UTXO changes of the committed transactions not yet in stateUTXO, spent entries are kept with alive unset
+    std::unordered_map<dev::Address, Vin> pendingUTXO;
+
+    bool deferUTXOCommit = false;
+
+    void commitUTXOCache();
+
+    void writeUTXO(std::unordered_map<dev::Address, Vin> const& _cache);
+
+    std::unique_ptr<UTXOAddressFilter> utxoFilter;
+
     void validateTransfersWithChangeLog();
 };
 
@@ -160,13 +245,11 @@ struct TemporaryState{
                 
     void SetRoot(dev::h256 newHashStateRoot, dev::h256 newHashUTXORoot)
     {
-        globalStateRef->setRoot(newHashStateRoot);
-        globalStateRef->setRootUTXO(newHashUTXORoot);
+        globalStateRef->restoreRoots(newHashStateRoot, newHashUTXORoot);
     }
 
     ~TemporaryState(){
-        globalStateRef->setRoot(oldHashStateRoot);
-        globalStateRef->setRootUTXO(oldHashUTXORoot);
+        globalStateRef->restoreRoots(oldHashStateRoot, oldHashUTXORoot);
     }
     TemporaryState() = delete;
     TemporaryState(const TemporaryState&) = delete;
@@ -175,6 +258,20 @@ struct TemporaryState{
     TemporaryState& operator=(TemporaryState&&) = delete;
 };
 
+/** Defer the UTXO trie writes of a state for its lifetime, the changes are dropped unless committed */
+struct DeferredUTXOCommit{
+    QtumState& state;
+
+    DeferredUTXOCommit(QtumState& _state, bool _defer) : state(_state) { state.setDeferUTXOCommit(_defer); }
+
+    ~DeferredUTXOCommit(){
+        state.setDeferUTXOCommit(false);
+    }
+    DeferredUTXOCommit() = delete;
+    DeferredUTXOCommit(const DeferredUTXOCommit&) = delete;
+    DeferredUTXOCommit& operator=(const DeferredUTXOCommit&) = delete;
+};
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////
 class CondensingTX{
@@ -183,17 +280,35 @@ public:
 
     CondensingTX(QtumState* _state, const std::vector<TransferInfo>& _transfers, const QtumTransaction& _transaction, std::set<dev::Address> _deleteAddresses = std::set<dev::Address>()) : transfers(_transfers), deleteAddresses(_deleteAddresses), transaction(_transaction), state(_state){}
 
-    CTransaction createCondensingTX();
+    /** The transaction spending the UTXOs of the addresses the transfers touch and paying their new balances,
+     *  null when it would have more than MAX_CONTRACT_VOUTS outputs */
+    CTransactionRef createCondensingTX();
 
-    std::unordered_map<dev::Address, Vin> createVin(const CTransaction& tx);
+    /** The UTXO each address is left with once tx, the result of createCondensingTX, is in the block */
+    std::vector<std::pair<dev::Address, Vin>> createVin(const CTransaction& tx) const;
 
     bool reachedVoutLimit(){ return voutOverflow; }
 
 private:
 
-    void selectionVin();
+    /** An address the transfers touch. The entries are sorted by address, the order the inputs and outputs are in */
+    struct Entry{
+        dev::Address address;
+        //! The UTXO the address spends, if any
+        Vin vin{};
+        bool hasVin = false;
+        bool stateChecked = false;
+        dev::u256 plus = 0;
+        dev::u256 minus = 0;
+        dev::u256 balance = 0;
+        uint32_t nVout = 0;
+    };
+
+    Entry& entry(dev::Address const& addr);
+
+    void selectVin(Entry& e, bool fSpendsTxValue);
 
-    void calculatePlusAndMinus();
+    void collectTransfers();
 
     bool createNewBalances();
 
@@ -203,13 +318,10 @@ private:
 
     bool checkDeleteAddress(dev::Address addr);
 
-    std::map<dev::Address, plusAndMinus> plusMinusInfo;
-
-    std::map<dev::Address, dev::u256> balances;
-
-    std::map<dev::Address, uint32_t> nVouts;
+    std::vector<Entry> entries;
 
-    std::map<dev::Address, Vin> vins;
+    //! Number of entries, from the first, whose balance was set
+    size_t nBalances = 0;
 
     const std::vector<TransferInfo>& transfers;
 
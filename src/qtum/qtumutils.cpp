@@ -1,6 +1,10 @@
 #include <qtum/qtumutils.h>
 #include <libdevcore/CommonData.h>
+#include <crypto/common.h>
+#include <crypto/ripemd160.h>
+#include <crypto/sha256.h>
 #include <pubkey.h>
+#include <sync.h>
 #include <util/convert.h>
 
 using namespace dev;
@@ -36,4 +40,49 @@ bool qtumutils::btc_ecrecover(const dev::h256 &hash, const dev::u256 &v, const d
     }
 
     return false;
-}
\ No newline at end of file
+}
+
+namespace {
+//! Direct mapped memo of the recent contract address derivations
+const size_t CONTRACT_ADDRESS_CACHE_SIZE = 1024;
+
+struct ContractAddressEntry {
+    dev::h256 hashTx;
+    uint32_t voutNumber = 0;
+    bool fValid = false;
+    dev::Address address;
+};
+
+Mutex cs_contract_address;
+ContractAddressEntry contractAddressCache[CONTRACT_ADDRESS_CACHE_SIZE] GUARDED_BY(cs_contract_address);
+}
+
+dev::Address qtumutils::contract_address(const dev::h256 &hashTx, uint32_t voutNumber)
+{
+    size_t index = (ReadLE64(hashTx.data()) ^ voutNumber) % CONTRACT_ADDRESS_CACHE_SIZE;
+    {
+        LOCK(cs_contract_address);
+        const ContractAddressEntry& entry = contractAddressCache[index];
+        if(entry.fValid && entry.voutNumber == voutNumber && entry.hashTx == hashTx)
+            return entry.address;
+    }
+
+    // The txid in the byte order of uint256 followed by the vout in host byte order
+    unsigned char txIdAndVout[36];
+    uint256 hashTXid(h256Touint(hashTx));
+    memcpy(txIdAndVout, hashTXid.begin(), 32);
+    memcpy(txIdAndVout + 32, &voutNumber, sizeof(voutNumber));
+
+    unsigned char SHA256TxVout[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(txIdAndVout, sizeof(txIdAndVout)).Finalize(SHA256TxVout);
+    dev::Address address;
+    CRIPEMD160().Write(SHA256TxVout, sizeof(SHA256TxVout)).Finalize(address.data());
+
+    LOCK(cs_contract_address);
+    ContractAddressEntry& entry = contractAddressCache[index];
+    entry.hashTx = hashTx;
+    entry.voutNumber = voutNumber;
+    entry.fValid = true;
+    entry.address = address;
+    return address;
+}
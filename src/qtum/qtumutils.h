@@ -13,6 +13,13 @@ namespace qtumutils
  * @brief btc_ecrecover Wrapper to CPubKey::RecoverCompact
  */
     bool btc_ecrecover(dev::h256 const& hash, dev::u256 const& v, dev::h256 const& r, dev::h256 const& s, dev::h256 & key);
+
+/**
+ * @brief contract_address Address of the contract created by output voutNumber of transaction hashTx,
+ * RIPEMD160(SHA256(txid || vout)); the same output is looked up in ATMP, block assembly and ConnectBlock,
+ * so the recent derivations are memoized
+ */
+    dev::Address contract_address(dev::h256 const& hashTx, uint32_t voutNumber);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,71 @@
+#include <qtum/receiptproof.h>
+#include <qtum/storageresults.h>
+#include <consensus/merkle.h>
+#include <hash.h>
+#include <util/convert.h>
+
+ReceiptLeaf::ReceiptLeaf(const TransactionReceiptInfo& receipt, uint32_t n_in) :
+    transactionHash(receipt.transactionHash),
+    n(n_in),
+    from(h160Touint(receipt.from)),
+    to(h160Touint(receipt.to)),
+    cumulativeGasUsed(receipt.cumulativeGasUsed),
+    gasUsed(receipt.gasUsed),
+    contractAddress(h160Touint(receipt.contractAddress)),
+    excepted(static_cast<uint32_t>(receipt.excepted))
+{
+    logs.reserve(receipt.logs.size());
+    for (const dev::eth::LogEntry& entry : receipt.logs) {
+        ReceiptLog log;
+        log.address = h160Touint(entry.address);
+        for (const dev::h256& topic : entry.topics) {
+            log.topics.push_back(h256Touint(topic));
+        }
+        log.data = entry.data;
+        logs.push_back(std::move(log));
+    }
+}
+
+uint256 ReceiptLeaf::GetHash() const
+{
+    // Leaves are longer than the 64 bytes of an inner node, so a leaf never passes for a subtree
+    return SerializeHash(*this);
+}
+
+uint256 ReceiptMerkleRoot(const std::vector<uint256>& leaves)
+{
+    return ComputeMerkleRoot(leaves);
+}
+
+CReceiptProof::CReceiptProof(const uint256& block_hash, const std::vector<ReceiptLeaf>& block_receipts, const std::set<uint256>& txids) :
+    hashBlock(block_hash)
+{
+    std::vector<uint256> leaves;
+    std::vector<bool> match;
+    leaves.reserve(block_receipts.size());
+    match.reserve(block_receipts.size());
+    for (const ReceiptLeaf& leaf : block_receipts) {
+        leaves.push_back(leaf.GetHash());
+        match.push_back(txids.count(leaf.transactionHash) > 0);
+        if (match.back()) {
+            receipts.push_back(leaf);
+        }
+    }
+    tree = CPartialMerkleTree(leaves, match);
+}
+
+uint256 CReceiptProof::Verify()
+{
+    std::vector<uint256> matches;
+    std::vector<unsigned int> indexes;
+    const uint256 root = tree.ExtractMatches(matches, indexes);
+    if (root.IsNull() || matches.size() != receipts.size()) {
+        return uint256();
+    }
+    for (size_t i = 0; i < receipts.size(); i++) {
+        if (receipts[i].GetHash() != matches[i]) {
+            return uint256();
+        }
+    }
+    return root;
+}
@@ -0,0 +1,102 @@
+#ifndef QTUM_RECEIPTPROOF_H
+#define QTUM_RECEIPTPROOF_H
+
+#include <merkleblock.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <set>
+#include <vector>
+
+struct TransactionReceiptInfo;
+
+/** A log of a receipt as committed in the receipt tree */
+struct ReceiptLog
+{
+    uint160 address;
+    std::vector<uint256> topics;
+    std::vector<unsigned char> data;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(address);
+        READWRITE(topics);
+        READWRITE(data);
+    }
+};
+
+/**
+ * The fields of a receipt that the execution of its transaction determines, the leaf of the receipt
+ * tree of a block. The block hash and height are left out so that the tree can be committed in the
+ * block itself, and so are the transaction index and the per receipt roots, which the sequential and
+ * the parallel execution of a block do not record alike.
+ */
+struct ReceiptLeaf
+{
+    uint256 transactionHash;
+    /** Position among the receipts of the transaction, one per contract output */
+    uint32_t n{0};
+    uint160 from;
+    uint160 to;
+    uint64_t cumulativeGasUsed{0};
+    uint64_t gasUsed{0};
+    uint160 contractAddress;
+    uint32_t excepted{0};
+    std::vector<ReceiptLog> logs;
+
+    ReceiptLeaf() {}
+    ReceiptLeaf(const TransactionReceiptInfo& receipt, uint32_t n_in);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(transactionHash);
+        READWRITE(n);
+        READWRITE(from);
+        READWRITE(to);
+        READWRITE(cumulativeGasUsed);
+        READWRITE(gasUsed);
+        READWRITE(contractAddress);
+        READWRITE(excepted);
+        READWRITE(logs);
+    }
+
+    uint256 GetHash() const;
+};
+
+/** Merkle root of the receipt leaves of a block in execution order, null for a block without receipts */
+uint256 ReceiptMerkleRoot(const std::vector<uint256>& leaves);
+
+/**
+ * Proof that some receipts are in the receipt tree of a block, the receipt counterpart of the proofs
+ * of gettxoutproof. The leaves are sent in full so that a light client can check the logs it is
+ * interested in against the root without trusting the node that served them.
+ */
+class CReceiptProof
+{
+public:
+    uint256 hashBlock;
+    CPartialMerkleTree tree;
+    std::vector<ReceiptLeaf> receipts;
+
+    CReceiptProof() {}
+    /** Prove the receipts of the transactions in txids among all the receipts of the block */
+    CReceiptProof(const uint256& block_hash, const std::vector<ReceiptLeaf>& block_receipts, const std::set<uint256>& txids);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hashBlock);
+        READWRITE(tree);
+        READWRITE(receipts);
+    }
+
+    /** The root the receipts prove inclusion in, or null if the tree is malformed or does not match them */
+    uint256 Verify();
+};
+
+#endif // QTUM_RECEIPTPROOF_H
@@ -0,0 +1,186 @@
+#include <qtum/statepruning.h>
+#include <libdevcore/RLP.h>
+#include <libdevcore/SHA3.h>
+#include <util/system.h>
+
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+
+#include <algorithm>
+#include <memory>
+#include <unordered_set>
+
+namespace {
+
+/** Trie nodes are stored under their 32 byte hash, other keys (auxiliary data) are never pruned */
+static const size_t TRIE_NODE_KEY_SIZE = 32;
+
+/** Number of deletes written in one batch */
+static const size_t PRUNE_BATCH_SIZE = 10000;
+
+enum class TrieKind {
+    ACCOUNTS, //!< Leaves are accounts referencing a storage trie and code
+    VALUES,   //!< Leaves are plain values
+};
+
+class TrieMarker
+{
+public:
+    TrieMarker(leveldb::DB* _db) : db(_db), emptyTrie(dev::sha3(dev::rlp(""))) {}
+
+    /** Mark every node reachable from a root, returns false if a referenced node is missing */
+    bool markRoot(dev::h256 const& root, TrieKind kind)
+    {
+        bool complete = true;
+        std::vector<std::pair<dev::h256, TrieKind>> pending{{root, kind}};
+        while (!pending.empty()) {
+            std::pair<dev::h256, TrieKind> next = pending.back();
+            pending.pop_back();
+            if (!marked.insert(next.first).second)
+                continue;
+            std::string value;
+            leveldb::Status status = db->Get(leveldb::ReadOptions(), leveldb::Slice((const char*)next.first.data(), next.first.size), &value);
+            if (!status.ok()) {
+                // The empty trie does not need a stored node
+                if (next.first != emptyTrie)
+                    complete = false;
+                continue;
+            }
+            markNode(dev::RLP(value), next.second, pending);
+        }
+        return complete;
+    }
+
+    std::unordered_set<dev::h256> marked;
+
+private:
+    void markRef(dev::RLP const& ref, TrieKind kind, std::vector<std::pair<dev::h256, TrieKind>>& pending)
+    {
+        if (ref.isList()) {
+            // Nodes shorter than a hash are embedded in their parent
+            markNode(ref, kind, pending);
+        } else if (ref.isData() && ref.size() == TRIE_NODE_KEY_SIZE) {
+            pending.emplace_back(ref.toHash<dev::h256>(), kind);
+        }
+    }
+
+    void markValue(dev::RLP const& value, TrieKind kind, std::vector<std::pair<dev::h256, TrieKind>>& pending)
+    {
+        if (kind != TrieKind::ACCOUNTS || value.isEmpty())
+            return;
+        dev::RLP account(value.payload());
+        if (!account.isList() || account.itemCount() < 4)
+            return;
+        pending.emplace_back(account[2].toHash<dev::h256>(), TrieKind::VALUES);
+        // The code is stored under its hash next to the trie nodes
+        marked.insert(account[3].toHash<dev::h256>());
+    }
+
+    void markNode(dev::RLP const& node, TrieKind kind, std::vector<std::pair<dev::h256, TrieKind>>& pending)
+    {
+        if (!node.isList())
+            return;
+        if (node.itemCount() == 17) {
+            for (unsigned i = 0; i < 16; i++)
+                markRef(node[i], kind, pending);
+            markValue(node[16], kind, pending);
+        } else if (node.itemCount() == 2) {
+            dev::bytesConstRef path = node[0].payload();
+            bool isLeaf = !path.empty() && (path[0] & 0x20);
+            if (isLeaf)
+                markValue(node[1], kind, pending);
+            else
+                markRef(node[1], kind, pending);
+        }
+    }
+
+    leveldb::DB* db;
+
+    const dev::h256 emptyTrie;
+};
+
+/** Find the leveldb directory named "state" below dir, skipping the given subdirectories */
+static bool FindTrieDB(const fs::path& dir, const std::vector<std::string>& skip, fs::path& result)
+{
+    for (fs::recursive_directory_iterator it(dir), end; it != end; ++it) {
+        if (!fs::is_directory(it->path()))
+            continue;
+        if (std::find(skip.begin(), skip.end(), it->path().filename().string()) != skip.end()) {
+            it.no_push();
+            continue;
+        }
+        if (it->path().filename() == "state" && fs::exists(it->path() / "CURRENT")) {
+            result = it->path();
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool SweepTrieDB(const fs::path& path, const std::vector<std::pair<dev::h256, TrieKind>>& roots)
+{
+    leveldb::DB* pdb = nullptr;
+    leveldb::Options options;
+    leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
+    if (!status.ok())
+        return error("%s: cannot open %s: %s", __func__, path.string(), status.ToString());
+    std::unique_ptr<leveldb::DB> db(pdb);
+
+    TrieMarker marker(db.get());
+    for (const auto& root : roots) {
+        if (!marker.markRoot(root.first, root.second))
+            return error("%s: state root %s is incomplete in %s, not pruning", __func__, root.first.hex(), path.string());
+    }
+    LogPrintf("Pruning %s: %u trie nodes are reachable from %u roots\n", path.string(), marker.marked.size(), roots.size());
+
+    uint64_t nKept = 0;
+    uint64_t nErased = 0;
+    leveldb::WriteBatch batch;
+    size_t nBatch = 0;
+    std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        leveldb::Slice key = it->key();
+        if (key.size() != TRIE_NODE_KEY_SIZE || marker.marked.count(dev::h256((const uint8_t*)key.data(), dev::h256::ConstructFromPointer))) {
+            nKept++;
+            continue;
+        }
+        batch.Delete(key);
+        nErased++;
+        if (++nBatch >= PRUNE_BATCH_SIZE) {
+            status = db->Write(leveldb::WriteOptions(), &batch);
+            if (!status.ok())
+                return error("%s: write to %s failed: %s", __func__, path.string(), status.ToString());
+            batch.Clear();
+            nBatch = 0;
+        }
+    }
+    if (!it->status().ok())
+        return error("%s: iteration of %s failed: %s", __func__, path.string(), it->status().ToString());
+    it.reset();
+    status = db->Write(leveldb::WriteOptions(), &batch);
+    if (!status.ok())
+        return error("%s: write to %s failed: %s", __func__, path.string(), status.ToString());
+
+    LogPrintf("Pruning %s: erased %u entries, kept %u, compacting\n", path.string(), nErased, nKept);
+    db->CompactRange(nullptr, nullptr);
+    return true;
+}
+
+} // namespace
+
+bool PruneStateDB(const fs::path& stateDir, const std::vector<StateRoots>& roots)
+{
+    fs::path stateDB, utxoDB;
+    if (!FindTrieDB(stateDir, {"hydraDB", "resultsDB"}, stateDB) || !FindTrieDB(stateDir / "hydraDB", {}, utxoDB))
+        return error("%s: contract state databases not found in %s", __func__, stateDir.string());
+
+    std::vector<std::pair<dev::h256, TrieKind>> stateRoots, utxoRoots;
+    const dev::h256 emptyTrie(dev::sha3(dev::rlp("")));
+    stateRoots.emplace_back(emptyTrie, TrieKind::ACCOUNTS);
+    utxoRoots.emplace_back(emptyTrie, TrieKind::VALUES);
+    for (const StateRoots& root : roots) {
+        stateRoots.emplace_back(root.stateRoot, TrieKind::ACCOUNTS);
+        utxoRoots.emplace_back(root.utxoRoot, TrieKind::VALUES);
+    }
+    return SweepTrieDB(stateDB, stateRoots) && SweepTrieDB(utxoDB, utxoRoots);
+}
@@ -0,0 +1,28 @@
+#ifndef QTUM_STATEPRUNING_H
+#define QTUM_STATEPRUNING_H
+
+#include <fs.h>
+#include <libdevcore/FixedHash.h>
+
+#include <vector>
+
+/** Minimum number of recent blocks whose contract state is kept by -prunestate */
+static const unsigned int MIN_STATE_BLOCKS_TO_KEEP = 288;
+
+/** Contract state roots of one block */
+struct StateRoots {
+    dev::h256 stateRoot;
+    dev::h256 utxoRoot;
+};
+
+/**
+ * Delete the trie nodes of the EVM state and the contract UTXO databases in
+ * stateDir that none of the given roots reach, then compact both databases.
+ *
+ * The databases are opened directly, so this must run before globalState
+ * opens them. States of blocks whose roots were not passed are lost: reorgs
+ * past them and historical queries such as getstorage at their height fail.
+ */
+bool PruneStateDB(const fs::path& stateDir, const std::vector<StateRoots>& roots);
+
+#endif // QTUM_STATEPRUNING_H
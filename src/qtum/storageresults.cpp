@@ -1,11 +1,30 @@
 #include <qtum/storageresults.h>
+#include <dbwrapper.h>
+#include <leveldb/cache.h>
 #include <util/convert.h>
+#include <util/strencodings.h>
 
-StorageResults::StorageResults(std::string const& _path){
+#include <algorithm>
+#include <memory>
+
+/** Approximate memory used by a receipt cache entry */
+static size_t ReceiptsUsage(std::vector<TransactionReceiptInfo> const& receipts){
+    // List node, index node and the vector itself
+    size_t usage = 96 + receipts.capacity() * sizeof(TransactionReceiptInfo);
+    for(auto const& receipt : receipts){
+        usage += receipt.exceptedMessage.capacity() + receipt.logs.capacity() * sizeof(dev::eth::LogEntry);
+        for(auto const& log : receipt.logs)
+            usage += log.topics.capacity() * sizeof(dev::h256) + log.data.capacity();
+    }
+    return usage;
+}
+
+StorageResults::StorageResults(std::string const& _path, size_t receiptCacheSize, size_t dbCacheSize) : m_receipt_cache_max(receiptCacheSize){
 	path = _path + "/resultsDB";
-    leveldb::Options options;
-    options.create_if_missing = true;
-    leveldb::Status status = leveldb::DB::Open(options, path, &db);
+    // Without a share of -dbcache keep leveldb's own 8MiB block cache and 4MiB write buffer
+    m_db_options = GetDBOptions(dbCacheSize > 0 ? dbCacheSize : (16 << 20), DBProfile::CompressedLookups());
+    m_db_options.create_if_missing = true;
+    leveldb::Status status = leveldb::DB::Open(m_db_options, path, &db);
     assert(status.ok());
     LogPrintf("Opened LevelDB successfully\n");
 }
@@ -14,14 +33,31 @@ StorageResults::~StorageResults()
 {
     delete db;
     db = NULL;
+    delete m_db_options.block_cache;
+    m_db_options.block_cache = NULL;
+    delete m_db_options.filter_policy;
+    m_db_options.filter_policy = NULL;
+    delete m_db_options.info_log;
+    m_db_options.info_log = NULL;
+}
+
+size_t StorageResults::DynamicMemoryUsage() const
+{
+    std::string memory;
+    if (!db || !db->GetProperty("leveldb.approximate-memory-usage", &memory)) {
+        return 0;
+    }
+    return stoul(memory);
 }
 
 void StorageResults::addResult(dev::h256 hashTx, std::vector<TransactionReceiptInfo>& result){
-	m_cache_result.insert(std::make_pair(hashTx, result));
+	if(m_cache_result.insert(std::make_pair(hashTx, result)).second)
+        m_pending_results.insert(hashTx);
 }
 
 void StorageResults::clearCacheResult(){
     m_cache_result.clear();
+    m_pending_results.clear();
 }
 
 void StorageResults::wipeResults(){
@@ -30,132 +66,317 @@ void StorageResults::wipeResults(){
     if (opened) {
         delete db;
     }
+    {
+        LOCK(cs_receiptCache);
+        m_receipt_lru.clear();
+        m_receipt_lru_index.clear();
+        m_receipt_cache_usage = 0;
+    }
     leveldb::Status result = leveldb::DestroyDB(path, leveldb::Options());
     if (opened) {
-        leveldb::Options options;
-        options.create_if_missing = true;
-        leveldb::Status status = leveldb::DB::Open(options, path, &db);
+        leveldb::Status status = leveldb::DB::Open(m_db_options, path, &db);
         assert(status.ok());
     }
 }
 
 void StorageResults::deleteResults(std::vector<CTransactionRef> const& txs){
 
+    leveldb::WriteBatch batch;
     for(CTransactionRef tx : txs){
         dev::h256 hashTx = uintToh256(tx->GetHash());
         m_cache_result.erase(hashTx);
-
-        std::string keyTemp = hashTx.hex();
-	    leveldb::Slice key(keyTemp);
-        leveldb::Status status = db->Delete(leveldb::WriteOptions(), key);
-        assert(status.ok());
+        m_pending_results.erase(hashTx);
+        eraseReceiptCache(hashTx);
+        batch.Delete(resultKey(hashTx));
+        batch.Delete(hashTx.hex());
     }
+    leveldb::Status status = db->Write(leveldb::WriteOptions(), &batch);
+    assert(status.ok());
 }
 
 std::vector<TransactionReceiptInfo> StorageResults::getResult(dev::h256 const& hashTx){
-    std::vector<TransactionReceiptInfo> result;
 	auto it = m_cache_result.find(hashTx);
-	if (it == m_cache_result.end()){
-		if(readResult(hashTx, result))
-			m_cache_result.insert(std::make_pair(hashTx, result));
-    } else {
-		result = it->second;
+	if (it != m_cache_result.end()){
+		return it->second;
+    }
+	return readCommittedResult(hashTx);
+}
+
+std::vector<TransactionReceiptInfo> StorageResults::readCommittedResult(dev::h256 const& hashTx){
+    std::vector<TransactionReceiptInfo> result;
+    if(lookupReceiptCache(hashTx, result))
+        return result;
+    if(readResult(hashTx, result))
+        insertReceiptCache(hashTx, result);
+    return result;
+}
+
+std::vector<std::vector<TransactionReceiptInfo>> StorageResults::readCommittedResults(std::vector<dev::h256> const& hashTxs){
+    std::vector<std::vector<TransactionReceiptInfo>> results(hashTxs.size());
+
+    std::vector<std::pair<std::string, size_t>> missing;
+    for(size_t i = 0; i < hashTxs.size(); i++){
+        if(!lookupReceiptCache(hashTxs[i], results[i]))
+            missing.emplace_back(resultKey(hashTxs[i]), i);
+    }
+    if(missing.empty())
+        return results;
+
+    // Seek in key order through one snapshot, so neighbouring keys are found in blocks already read
+    std::sort(missing.begin(), missing.end());
+    leveldb::ReadOptions options;
+    options.fill_cache = false;
+    options.snapshot = db->GetSnapshot();
+    std::unique_ptr<leveldb::Iterator> it(db->NewIterator(options));
+    for(auto const& entry : missing){
+        size_t i = entry.second;
+        it->Seek(entry.first);
+        if(it->Valid() && it->key() == entry.first){
+            if(!deserializeResult(hashTxs[i], it->value().ToString(), results[i]))
+                results[i].clear();
+        } else {
+            readResult(hashTxs[i], results[i]);
+        }
+    }
+    it.reset();
+    db->ReleaseSnapshot(options.snapshot);
+    return results;
+}
+
+ReceiptCacheStats StorageResults::getReceiptCacheStats(){
+    LOCK(cs_receiptCache);
+    return ReceiptCacheStats{m_receipt_cache_hits, m_receipt_cache_misses, m_receipt_lru.size(), m_receipt_cache_usage, m_receipt_cache_max};
+}
+
+bool StorageResults::lookupReceiptCache(dev::h256 const& hashTx, std::vector<TransactionReceiptInfo>& result){
+    LOCK(cs_receiptCache);
+    auto it = m_receipt_lru_index.find(hashTx);
+    if(it == m_receipt_lru_index.end()){
+        m_receipt_cache_misses++;
+        return false;
+    }
+    m_receipt_cache_hits++;
+    m_receipt_lru.splice(m_receipt_lru.begin(), m_receipt_lru, it->second);
+    result = it->second->second;
+    return true;
+}
+
+void StorageResults::insertReceiptCache(dev::h256 const& hashTx, std::vector<TransactionReceiptInfo> const& result){
+    size_t usage = ReceiptsUsage(result);
+    if(usage > m_receipt_cache_max)
+        return;
+
+    LOCK(cs_receiptCache);
+    auto it = m_receipt_lru_index.find(hashTx);
+    if(it != m_receipt_lru_index.end()){
+        m_receipt_cache_usage -= ReceiptsUsage(it->second->second);
+        m_receipt_lru.erase(it->second);
+        m_receipt_lru_index.erase(it);
+    }
+    m_receipt_lru.emplace_front(hashTx, result);
+    m_receipt_lru_index[hashTx] = m_receipt_lru.begin();
+    m_receipt_cache_usage += usage;
+
+    while(m_receipt_cache_usage > m_receipt_cache_max){
+        auto& last = m_receipt_lru.back();
+        m_receipt_cache_usage -= ReceiptsUsage(last.second);
+        m_receipt_lru_index.erase(last.first);
+        m_receipt_lru.pop_back();
+    }
+}
+
+void StorageResults::eraseReceiptCache(dev::h256 const& hashTx){
+    LOCK(cs_receiptCache);
+    auto it = m_receipt_lru_index.find(hashTx);
+    if(it != m_receipt_lru_index.end()){
+        m_receipt_cache_usage -= ReceiptsUsage(it->second->second);
+        m_receipt_lru.erase(it->second);
+        m_receipt_lru_index.erase(it);
     }
-	return result;
 }
 
 void StorageResults::commitResults(){
-    if(m_cache_result.size()){
-
-        for (auto const& i: m_cache_result){
-            std::string valueTemp;
-            std::string keyTemp = i.first.hex();
-            leveldb::Slice key(keyTemp);
-            leveldb::Status status = db->Get(leveldb::ReadOptions(), key, &valueTemp);
-
-            if(status.IsNotFound()){
-
-                TransactionReceiptInfoSerialized tris;
-
-                for(size_t j = 0; j < i.second.size(); j++){
-                    tris.blockHashes.push_back(uintToh256(i.second[j].blockHash));
-                    tris.blockNumbers.push_back(i.second[j].blockNumber);
-                    tris.transactionHashes.push_back(uintToh256(i.second[j].transactionHash));
-                    tris.transactionIndexes.push_back(i.second[j].transactionIndex);
-                    tris.senders.push_back(i.second[j].from);
-                    tris.receivers.push_back(i.second[j].to);
-                    tris.cumulativeGasUsed.push_back(dev::u256(i.second[j].cumulativeGasUsed));
-                    tris.gasUsed.push_back(dev::u256(i.second[j].gasUsed));
-                    tris.contractAddresses.push_back(i.second[j].contractAddress);
-                    tris.logs.push_back(logEntriesSerialization(i.second[j].logs));
-                    tris.excepted.push_back(uint32_t(static_cast<int>(i.second[j].excepted)));
-                    tris.exceptedMessage.push_back(i.second[j].exceptedMessage);
-                    tris.blooms.push_back(i.second[j].bloom);
-                    tris.stateRoots.push_back(i.second[j].stateRoot);
-                    tris.utxoRoots.push_back(i.second[j].utxoRoot);
-                }
-
-                dev::RLPStream streamRLP(15);
-                streamRLP << tris.blockHashes << tris.blockNumbers << tris.transactionHashes << tris.transactionIndexes << tris.senders;
-                streamRLP << tris.receivers << tris.cumulativeGasUsed << tris.gasUsed << tris.contractAddresses << tris.logs << tris.excepted << tris.exceptedMessage << tris.blooms << tris.stateRoots << tris.utxoRoots;
-
-                dev::bytes data = streamRLP.out();
-                std::string stringData(data.begin(), data.end());
-                leveldb::Slice value(stringData);
-                status = db->Put(leveldb::WriteOptions(), key, value);
-                assert(status.ok());
-            }
+    // Only results added since the last commit are written
+    if(m_pending_results.size()){
+
+        leveldb::WriteBatch batch;
+        for (auto const& hashTx: m_pending_results){
+            dev::bytes data = serializeResult(m_cache_result.find(hashTx)->second);
+            batch.Put(resultKey(hashTx), leveldb::Slice((const char*)data.data(), data.size()));
+        }
+        leveldb::Status status = db->Write(leveldb::WriteOptions(), &batch);
+        assert(status.ok());
+
+        // Receipts of the blocks just connected are the ones most likely to be queried next
+        for (auto const& hashTx: m_pending_results){
+            insertReceiptCache(hashTx, m_cache_result.find(hashTx)->second);
+        }
+    }
+    m_cache_result.clear();
+    m_pending_results.clear();
+}
+
+bool StorageResults::upgradeResults(){
+    const size_t batchSize = 10000;
+    size_t upgraded = 0;
+    LogPrintf("Upgrading transaction receipts in %s to format version %d\n", path, RESULTS_FORMAT_VERSION);
+
+    leveldb::WriteBatch batch;
+    size_t batchCount = 0;
+    std::unique_ptr<leveldb::Iterator> it(db->NewIterator(leveldb::ReadOptions()));
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        // Legacy records are keyed by the 64 character hex string of the transaction hash
+        if (it->key().size() != 64)
+            continue;
+        std::string keyHex = it->key().ToString();
+        if (!IsHex(keyHex))
+            continue;
+
+        std::vector<TransactionReceiptInfo> result;
+        if (!deserializeLegacyResult(it->value().ToString(), result))
+            return error("%s: unable to decode the receipts of tx %s", __func__, keyHex);
+
+        dev::bytes data = serializeResult(result);
+        batch.Put(resultKey(dev::h256(keyHex)), leveldb::Slice((const char*)data.data(), data.size()));
+        batch.Delete(it->key());
+
+        if (++batchCount == batchSize) {
+            leveldb::Status status = db->Write(leveldb::WriteOptions(), &batch);
+            if (!status.ok())
+                return error("%s: %s", __func__, status.ToString());
+            batch.Clear();
+            upgraded += batchCount;
+            batchCount = 0;
+            LogPrintf("Upgraded the receipts of %u transactions\n", upgraded);
         }
-        m_cache_result.clear();
     }
+    if (!it->status().ok())
+        return error("%s: %s", __func__, it->status().ToString());
+
+    leveldb::Status status = db->Write(leveldb::WriteOptions(), &batch);
+    if (!status.ok())
+        return error("%s: %s", __func__, status.ToString());
+    upgraded += batchCount;
+    LogPrintf("Upgraded the receipts of %u transactions, compacting the database\n", upgraded);
+    db->CompactRange(nullptr, nullptr);
+    return true;
+}
+
+std::string StorageResults::resultKey(dev::h256 const& hashTx){
+    return std::string((const char*)hashTx.data(), hashTx.size);
+}
+
+dev::bytes StorageResults::serializeResult(std::vector<TransactionReceiptInfo> const& _result){
+    // All receipts of a transaction share its block and position, so those are stored once
+    // and the transaction hash is the key. Blooms are recomputed from the logs when read.
+    TransactionReceiptInfoSerialized tris;
+    for(size_t j = 0; j < _result.size(); j++){
+        tris.senders.push_back(_result[j].from);
+        tris.receivers.push_back(_result[j].to);
+        tris.cumulativeGasUsed.push_back(dev::u256(_result[j].cumulativeGasUsed));
+        tris.gasUsed.push_back(dev::u256(_result[j].gasUsed));
+        tris.contractAddresses.push_back(_result[j].contractAddress);
+        tris.logs.push_back(logEntriesSerialization(_result[j].logs));
+        tris.excepted.push_back(uint32_t(static_cast<int>(_result[j].excepted)));
+        tris.exceptedMessage.push_back(_result[j].exceptedMessage);
+        tris.stateRoots.push_back(_result[j].stateRoot);
+        tris.utxoRoots.push_back(_result[j].utxoRoot);
+    }
+    TransactionReceiptInfo const empty{};
+    TransactionReceiptInfo const& first = _result.empty() ? empty : _result[0];
+
+    dev::RLPStream streamRLP(14);
+    streamRLP << RESULTS_FORMAT_VERSION << uintToh256(first.blockHash) << first.blockNumber << first.transactionIndex;
+    streamRLP << tris.senders << tris.receivers << tris.cumulativeGasUsed << tris.gasUsed << tris.contractAddresses;
+    streamRLP << tris.logs << tris.excepted << tris.exceptedMessage << tris.stateRoots << tris.utxoRoots;
+    return streamRLP.out();
+}
+
+bool StorageResults::deserializeResult(dev::h256 const& _key, std::string const& _value, std::vector<TransactionReceiptInfo>& _result){
+    dev::RLP state(_value);
+    if(!state.isList() || state.itemCount() != 14 || state[0].toInt<uint32_t>() != RESULTS_FORMAT_VERSION)
+        return false;
+
+    uint256 blockHash = h256Touint(state[1].toHash<dev::h256>());
+    uint32_t blockNumber = state[2].toInt<uint32_t>();
+    uint32_t transactionIndex = state[3].toInt<uint32_t>();
+    std::vector<dev::h160> senders = state[4].toVector<dev::h160>();
+    std::vector<dev::h160> receivers = state[5].toVector<dev::h160>();
+    std::vector<dev::u256> cumulativeGasUsed = state[6].toVector<dev::u256>();
+    std::vector<dev::u256> gasUsed = state[7].toVector<dev::u256>();
+    std::vector<dev::h160> contractAddresses = state[8].toVector<dev::h160>();
+    std::vector<logEntriesSerializ> logs = state[9].toVector<logEntriesSerializ>();
+    std::vector<uint32_t> excepted = state[10].toVector<uint32_t>();
+    std::vector<std::string> exceptedMessage = state[11].toVector<std::string>();
+    std::vector<dev::h256> stateRoots = state[12].toVector<dev::h256>();
+    std::vector<dev::h256> utxoRoots = state[13].toVector<dev::h256>();
+
+    for(size_t j = 0; j < senders.size(); j++){
+        dev::eth::LogEntries logEntries = logEntriesDeserialize(logs[j]);
+        dev::eth::LogBloom bloom;
+        for(dev::eth::LogEntry const& log : logEntries)
+            bloom |= log.bloom();
+        TransactionReceiptInfo tri{blockHash, blockNumber, h256Touint(_key), transactionIndex, senders[j],
+                                   receivers[j], uint64_t(cumulativeGasUsed[j]), uint64_t(gasUsed[j]), contractAddresses[j], logEntries,
+                                   static_cast<dev::eth::TransactionException>(excepted[j]), exceptedMessage[j], bloom, stateRoots[j], utxoRoots[j]};
+        _result.push_back(tri);
+    }
+    return true;
+}
+
+bool StorageResults::deserializeLegacyResult(std::string const& _value, std::vector<TransactionReceiptInfo>& _result){
+
+    TransactionReceiptInfoSerialized tris;
+
+    dev::RLP state(_value);
+    if(!state.isList() || state.itemCount() < 10)
+        return false;
+    tris.blockHashes = state[0].toVector<dev::h256>();
+    tris.blockNumbers = state[1].toVector<uint32_t>();
+    tris.transactionHashes = state[2].toVector<dev::h256>();
+    tris.transactionIndexes = state[3].toVector<uint32_t>();
+    tris.senders = state[4].toVector<dev::h160>();
+    tris.receivers = state[5].toVector<dev::h160>();
+    tris.cumulativeGasUsed = state[6].toVector<dev::u256>();
+    tris.gasUsed = state[7].toVector<dev::u256>();
+    tris.contractAddresses = state[8].toVector<dev::h160>();
+    tris.logs = state[9].toVector<logEntriesSerializ>();
+    if(state.itemCount() >= 11)
+        tris.excepted = state[10].toVector<uint32_t>();
+    if(state.itemCount() >= 12)
+        tris.exceptedMessage = state[11].toVector<std::string>();
+    if(state.itemCount() >= 13)
+        tris.blooms = state[12].toVector<dev::h2048>();
+    if(state.itemCount() >= 14)
+        tris.stateRoots = state[13].toVector<dev::h256>();
+    if(state.itemCount() >= 15)
+        tris.utxoRoots = state[14].toVector<dev::h256>();
+
+    for(size_t j = 0; j < tris.blockHashes.size(); j++){
+        TransactionReceiptInfo tri{h256Touint(tris.blockHashes[j]), tris.blockNumbers[j], h256Touint(tris.transactionHashes[j]), tris.transactionIndexes[j], tris.senders[j],
+                                   tris.receivers[j], uint64_t(tris.cumulativeGasUsed[j]), uint64_t(tris.gasUsed[j]), tris.contractAddresses[j], logEntriesDeserialize(tris.logs[j]),
+                                   state.itemCount() >= 11 ? static_cast<dev::eth::TransactionException>(tris.excepted[j]) : dev::eth::TransactionException::NoInformation,
+                                   state.itemCount() >= 12 ? tris.exceptedMessage[j] : "",
+                                   state.itemCount() >= 13 ? tris.blooms[j] : dev::h2048(),
+                                   state.itemCount() >= 14 ? tris.stateRoots[j] : dev::h256(),
+                                   state.itemCount() >= 15 ? tris.utxoRoots[j] : dev::h256()
+                                };
+        _result.push_back(tri);
+    }
+    return true;
 }
 
 bool StorageResults::readResult(dev::h256 const& _key, std::vector<TransactionReceiptInfo>& _result){
 
     std::string value;
-    std::string keyTemp = _key.hex();;
-    leveldb::Slice key(keyTemp);
-    leveldb::Status s = db->Get(leveldb::ReadOptions(), key, &value);
-
-	if(!s.IsNotFound() && s.ok()){
-        
-        TransactionReceiptInfoSerialized tris;
-
-		dev::RLP state(value);
-        tris.blockHashes = state[0].toVector<dev::h256>();
-		tris.blockNumbers = state[1].toVector<uint32_t>();
-		tris.transactionHashes = state[2].toVector<dev::h256>();
-        tris.transactionIndexes = state[3].toVector<uint32_t>();
-        tris.senders = state[4].toVector<dev::h160>();
-        tris.receivers = state[5].toVector<dev::h160>();
-        tris.cumulativeGasUsed = state[6].toVector<dev::u256>();
-        tris.gasUsed = state[7].toVector<dev::u256>();
-        tris.contractAddresses = state[8].toVector<dev::h160>();
-        tris.logs = state[9].toVector<logEntriesSerializ>();
-        if(state.itemCount() >= 11)
-            tris.excepted = state[10].toVector<uint32_t>();
-        if(state.itemCount() >= 12)
-            tris.exceptedMessage = state[11].toVector<std::string>();
-        if(state.itemCount() >= 13)
-            tris.blooms = state[12].toVector<dev::h2048>();
-        if(state.itemCount() >= 14)
-            tris.stateRoots = state[13].toVector<dev::h256>();
-        if(state.itemCount() >= 15)
-            tris.utxoRoots = state[14].toVector<dev::h256>();
-
-        for(size_t j = 0; j < tris.blockHashes.size(); j++){
-            TransactionReceiptInfo tri{h256Touint(tris.blockHashes[j]), tris.blockNumbers[j], h256Touint(tris.transactionHashes[j]), tris.transactionIndexes[j], tris.senders[j],
-                                       tris.receivers[j], uint64_t(tris.cumulativeGasUsed[j]), uint64_t(tris.gasUsed[j]), tris.contractAddresses[j], logEntriesDeserialize(tris.logs[j]),
-                                       state.itemCount() >= 11 ? static_cast<dev::eth::TransactionException>(tris.excepted[j]) : dev::eth::TransactionException::NoInformation,
-                                       state.itemCount() >= 12 ? tris.exceptedMessage[j] : "",
-                                       state.itemCount() >= 13 ? tris.blooms[j] : dev::h2048(),
-                                       state.itemCount() >= 14 ? tris.stateRoots[j] : dev::h256(),
-                                       state.itemCount() >= 15 ? tris.utxoRoots[j] : dev::h256()
-                                    };
-            _result.push_back(tri);
-        }
-		return true;
-	}
+    leveldb::Status s = db->Get(leveldb::ReadOptions(), resultKey(_key), &value);
+    if(s.ok())
+        return deserializeResult(_key, value, _result);
+
+    // Receipts written before format version 2 and not upgraded yet
+    s = db->Get(leveldb::ReadOptions(), _key.hex(), &value);
+    if(s.ok())
+        return deserializeLegacyResult(value, _result);
 	return false;
 }
 
@@ -3,6 +3,10 @@
 #include <libethereum/State.h>
 #include <libethereum/Transaction.h>
 #include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+#include <list>
+#include <unordered_set>
+#include <sync.h>
 #include <util/system.h>
 
 using logEntriesSerializ = std::vector<std::pair<dev::Address, std::pair<dev::h256s, dev::bytes>>>;
@@ -43,11 +47,29 @@ struct TransactionReceiptInfoSerialized{
     std::vector<dev::h256> utxoRoots;
 };
 
+/**
+ * On-disk format of the receipts database. Version 2 keys the receipts of a transaction by the raw
+ * transaction hash and stores its block and position once, legacy records are keyed by the hex string
+ * of the hash and remain readable until upgraded with -upgradereceiptsdb.
+ */
+static const uint32_t RESULTS_FORMAT_VERSION = 2;
+
+/** Default for -receiptcache, in MiB */
+static const int64_t DEFAULT_RECEIPT_CACHE = 32;
+
+struct ReceiptCacheStats{
+    uint64_t hits;
+    uint64_t misses;
+    size_t entries;
+    size_t usage;
+    size_t maxUsage;
+};
+
 class StorageResults{
 
 public:
 
-	StorageResults(std::string const& _path);
+	StorageResults(std::string const& _path, size_t receiptCacheSize = DEFAULT_RECEIPT_CACHE << 20, size_t dbCacheSize = 0);
     ~StorageResults();
 
 	void addResult(dev::h256 hashTx, std::vector<TransactionReceiptInfo>& result);
@@ -56,23 +78,76 @@ public:
 
     std::vector<TransactionReceiptInfo> getResult(dev::h256 const& hashTx);
 
+    /** Read committed results through the receipt cache, safe without cs_main */
+    std::vector<TransactionReceiptInfo> readCommittedResult(dev::h256 const& hashTx);
+
+    /**
+     * Read the committed results of many transactions, such as those of a block, in one pass over
+     * the database in key order. Bulk reads use the receipt cache but do not fill it, safe without cs_main.
+     */
+    std::vector<std::vector<TransactionReceiptInfo>> readCommittedResults(std::vector<dev::h256> const& hashTxs);
+
 	void commitResults();
 
     void clearCacheResult();
 
     void wipeResults();
 
+    /** Rewrite receipts stored in the legacy format to the current one, in place */
+    bool upgradeResults();
+
+    ReceiptCacheStats getReceiptCacheStats();
+
+    /** Approximate memory used by the database, including its block cache */
+    size_t DynamicMemoryUsage() const;
+
+    /** Encode the receipts of one transaction in the current on-disk format, also served by REST */
+    dev::bytes serializeResult(std::vector<TransactionReceiptInfo> const& _result);
+
 private:
 
 	bool readResult(dev::h256 const& _key, std::vector<TransactionReceiptInfo>& _result);
 
+    static std::string resultKey(dev::h256 const& hashTx);
+
+    bool deserializeResult(dev::h256 const& _key, std::string const& _value, std::vector<TransactionReceiptInfo>& _result);
+
+    bool deserializeLegacyResult(std::string const& _value, std::vector<TransactionReceiptInfo>& _result);
+
+    bool lookupReceiptCache(dev::h256 const& hashTx, std::vector<TransactionReceiptInfo>& result);
+
+    void insertReceiptCache(dev::h256 const& hashTx, std::vector<TransactionReceiptInfo> const& result);
+
+    void eraseReceiptCache(dev::h256 const& hashTx);
+
 	logEntriesSerializ logEntriesSerialization(dev::eth::LogEntries const& _logs);
 
 	dev::eth::LogEntries logEntriesDeserialize(logEntriesSerializ const& _logs);
 
 	std::string path;
 
+    leveldb::Options m_db_options;
+
     leveldb::DB* db;
 
 	std::unordered_map<dev::h256, std::vector<TransactionReceiptInfo>> m_cache_result;
+
+    std::unordered_set<dev::h256> m_pending_results;
+
+    /** Bounded LRU of decoded committed receipts, shared by the RPC threads and validation */
+    typedef std::list<std::pair<dev::h256, std::vector<TransactionReceiptInfo>>> ReceiptList;
+
+    Mutex cs_receiptCache;
+
+    ReceiptList m_receipt_lru GUARDED_BY(cs_receiptCache);
+
+    std::unordered_map<dev::h256, ReceiptList::iterator> m_receipt_lru_index GUARDED_BY(cs_receiptCache);
+
+    size_t m_receipt_cache_usage GUARDED_BY(cs_receiptCache) = 0;
+
+    const size_t m_receipt_cache_max;
+
+    uint64_t m_receipt_cache_hits GUARDED_BY(cs_receiptCache) = 0;
+
+    uint64_t m_receipt_cache_misses GUARDED_BY(cs_receiptCache) = 0;
 };
@@ -0,0 +1,137 @@
+#include <qtum/vmlogwriter.h>
+#include <univalue.h>
+#include <util/strencodings.h>
+#include <util/system.h>
+
+std::unique_ptr<VMLogWriter> g_vmlog_writer;
+
+static const char* const VMLOG_FILENAME = "vmExecLogs.jsonl";
+
+static UniValue VMLogRecordToJSON(const VMLogRecord& record)
+{
+    UniValue result(UniValue::VOBJ);
+    if (!record.txid.IsNull())
+        result.pushKV("txid", record.txid.GetHex());
+    result.pushKV("address", record.address.hex());
+    result.pushKV("time", record.time);
+    if (!record.blockhash.IsNull())
+        result.pushKV("blockhash", record.blockhash.GetHex());
+    result.pushKV("blockheight", record.height);
+    UniValue logEntries(UniValue::VARR);
+    for (const dev::eth::LogEntry& log : record.logs) {
+        UniValue logEntrie(UniValue::VOBJ);
+        logEntrie.pushKV("address", log.address.hex());
+        UniValue topics(UniValue::VARR);
+        for (const dev::h256& l : log.topics) {
+            UniValue topicPair(UniValue::VOBJ);
+            topicPair.pushKV("raw", l.hex());
+            topics.push_back(topicPair);
+        }
+        UniValue dataPair(UniValue::VOBJ);
+        dataPair.pushKV("raw", HexStr(log.data));
+        logEntrie.pushKV("data", dataPair);
+        logEntrie.pushKV("topics", topics);
+        logEntries.push_back(logEntrie);
+    }
+    result.pushKV("entries", logEntries);
+    return result;
+}
+
+static fs::path RotatedPath(const fs::path& dir, int n)
+{
+    return dir / strprintf("vmExecLogs.%d.jsonl", n);
+}
+
+VMLogWriter::VMLogWriter(const fs::path& dir, uint64_t nMaxFileSize) : m_dir(dir), m_max_file_size(nMaxFileSize)
+{
+    while (fs::exists(RotatedPath(m_dir, m_next_rotation))) {
+        m_next_rotation++;
+    }
+    OpenFile();
+    m_thread = std::thread([this] {
+        RenameThread("hydra-vmlog");
+        ThreadWrite();
+    });
+}
+
+VMLogWriter::~VMLogWriter()
+{
+    Stop();
+}
+
+bool VMLogWriter::OpenFile()
+{
+    fs::path path = m_dir / VMLOG_FILENAME;
+    m_file_size = fs::exists(path) ? fs::file_size(path) : 0;
+    m_file.open(path, std::ios::out | std::ios::app);
+    if (!m_file.is_open()) {
+        LogPrintf("%s: Unable to open %s\n", __func__, path.string());
+        return false;
+    }
+    return true;
+}
+
+void VMLogWriter::WriteLine(const std::string& line)
+{
+    if (m_file_size > 0 && m_file_size + line.size() + 1 > m_max_file_size) {
+        m_file.close();
+        fs::path path = m_dir / VMLOG_FILENAME;
+        try {
+            fs::rename(path, RotatedPath(m_dir, m_next_rotation));
+            m_next_rotation++;
+        } catch (const fs::filesystem_error& e) {
+            LogPrintf("%s: Unable to rotate %s: %s\n", __func__, path.string(), e.what());
+        }
+        OpenFile();
+    }
+    if (!m_file.is_open())
+        return;
+    m_file << line << '\n';
+    m_file_size += line.size() + 1;
+}
+
+void VMLogWriter::Push(std::vector<VMLogRecord>&& records)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this] { return m_stop || m_queue.size() < VMLOG_MAX_QUEUE; });
+        if (m_stop)
+            return;
+        for (VMLogRecord& record : records) {
+            m_queue.push_back(std::move(record));
+        }
+    }
+    m_cv.notify_all();
+}
+
+void VMLogWriter::ThreadWrite()
+{
+    while (true) {
+        std::deque<VMLogRecord> records;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+                break;
+            records.swap(m_queue);
+        }
+        m_cv.notify_all();
+
+        for (const VMLogRecord& record : records) {
+            WriteLine(VMLogRecordToJSON(record).write());
+        }
+        m_file.flush();
+    }
+}
+
+void VMLogWriter::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+    m_file.close();
+}
@@ -0,0 +1,73 @@
+#ifndef QTUM_VMLOGWRITER_H
+#define QTUM_VMLOGWRITER_H
+
+#include <fs.h>
+#include <uint256.h>
+#include <libdevcore/Address.h>
+#include <libethcore/LogEntry.h>
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** Default for -vmlogmaxsize, the size in MiB the execution log file is rotated at */
+static const unsigned int DEFAULT_VMLOG_MAX_SIZE = 1024;
+/** Number of execution results queued for the writer before block connection waits for it */
+static const size_t VMLOG_MAX_QUEUE = 10000;
+
+/** Logs of one contract execution with the transaction and block it ran in */
+struct VMLogRecord {
+    //! Null for calls outside a transaction
+    uint256 txid;
+    //! Null for calls outside a block
+    uint256 blockhash;
+    int64_t time;
+    int height;
+    dev::Address address;
+    dev::eth::LogEntries logs;
+};
+
+/**
+ * Writer of the -record-log-opcodes execution logs.
+ *
+ * Block connection queues the records and a thread writes them as newline
+ * delimited JSON, one execution per line, to vmExecLogs.jsonl in the data
+ * directory. Once the file is larger than the max size it is renamed to
+ * vmExecLogs.<n>.jsonl and a new one is started. Push waits while the queue
+ * is full, so no record is lost when the disk falls behind.
+ */
+class VMLogWriter
+{
+public:
+    VMLogWriter(const fs::path& dir, uint64_t nMaxFileSize);
+    ~VMLogWriter();
+
+    //! Queue records for writing
+    void Push(std::vector<VMLogRecord>&& records);
+    //! Write the queued records and stop the thread
+    void Stop();
+
+private:
+    void ThreadWrite();
+    bool OpenFile();
+    void WriteLine(const std::string& line);
+
+    const fs::path m_dir;
+    const uint64_t m_max_file_size;
+    fsbridge::ofstream m_file;
+    uint64_t m_file_size{0};
+    int m_next_rotation{0};
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<VMLogRecord> m_queue;
+    bool m_stop{false};
+    std::thread m_thread;
+};
+
+extern std::unique_ptr<VMLogWriter> g_vmlog_writer;
+
+#endif // QTUM_VMLOGWRITER_H
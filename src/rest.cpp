@@ -11,11 +11,14 @@
 #include <index/txindex.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
+#include <qtum/storageresults.h>
 #include <rpc/blockchain.h>
+#include <rpc/contract_util.h>
 #include <rpc/server.h>
 #include <streams.h>
 #include <sync.h>
 #include <txmempool.h>
+#include <util/convert.h>
 #include <util/strencodings.h>
 #include <validation.h>
 #include <version.h>
@@ -25,6 +28,8 @@
 #include <univalue.h>
 
 static const size_t MAX_GETUTXOS_OUTPOINTS = 15; //allow a max of 15 outpoints to be queried at once
+static const int MAX_REST_LOGS_BLOCKS = 1000; //allow a max of 1000 blocks to be searched for logs at once
+static const int REST_TIP_MAX_AGE = 10; //seconds that answers depending on the chain tip may be cached
 
 enum class RetFormat {
     UNDEF,
@@ -114,6 +119,44 @@ static bool CheckWarmup(HTTPRequest* req)
     return true;
 }
 
+static bool WriteHeaders(HTTPRequest* req, RetFormat rf, const CBlockIndex* tip, const std::vector<const CBlockIndex *>& headers)
+{
+    switch (rf) {
+    case RetFormat::BINARY: {
+        CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+        for (const CBlockIndex *pindex : headers) {
+            ssHeader << pindex->GetBlockHeader();
+        }
+
+        std::string binaryHeader = ssHeader.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryHeader);
+        return true;
+    }
+
+    case RetFormat::HEX: {
+        CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+        for (const CBlockIndex *pindex : headers) {
+            ssHeader << pindex->GetBlockHeader();
+        }
+
+        std::string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+    case RetFormat::JSON: {
+        std::string strJSON = blockheadersToJSON(tip, headers).write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex, .json)");
+    }
+    }
+}
+
 static bool rest_headers(HTTPRequest* req,
                          const std::string& strURIPart)
 {
@@ -128,7 +171,7 @@ static bool rest_headers(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "No header count specified. Use /rest/headers/<count>/<hash>.<ext>.");
 
     long count = strtol(path[0].c_str(), nullptr, 10);
-    if (count < 1 || count > 2000)
+    if (count < 1 || count > MAX_HEADERS_RANGE)
         return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[0]);
 
     std::string hashStr = path[1];
@@ -151,44 +194,45 @@ static bool rest_headers(HTTPRequest* req,
         }
     }
 
-    switch (rf) {
-    case RetFormat::BINARY: {
-        CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
-        for (const CBlockIndex *pindex : headers) {
-            ssHeader << pindex->GetBlockHeader();
-        }
+    return WriteHeaders(req, rf, tip, headers);
+}
 
-        std::string binaryHeader = ssHeader.str();
-        req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryHeader);
-        return true;
-    }
+static bool rest_headers_by_height(HTTPRequest* req,
+                                   const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
 
-    case RetFormat::HEX: {
-        CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
-        for (const CBlockIndex *pindex : headers) {
-            ssHeader << pindex->GetBlockHeader();
-        }
+    if (path.size() != 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No header count specified. Use /rest/headersbyheight/<count>/<height>.<ext>.");
 
-        std::string strHex = HexStr(ssHeader.begin(), ssHeader.end()) + "\n";
-        req->WriteHeader("Content-Type", "text/plain");
-        req->WriteReply(HTTP_OK, strHex);
-        return true;
-    }
-    case RetFormat::JSON: {
-        UniValue jsonHeaders(UniValue::VARR);
-        for (const CBlockIndex *pindex : headers) {
-            jsonHeaders.push_back(blockheaderToJSON(tip, pindex));
+    long count = strtol(path[0].c_str(), nullptr, 10);
+    if (count < 1 || count > MAX_HEADERS_RANGE)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Header count out of range: " + path[0]);
+
+    int32_t height;
+    if (!ParseInt32(path[1], &height) || height < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + path[1]);
+
+    const CBlockIndex* tip = nullptr;
+    std::vector<const CBlockIndex *> headers;
+    {
+        LOCK(cs_main);
+        if (height > chainActive.Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range: " + path[1]);
+        tip = chainActive.Tip();
+        int end = std::min<int64_t>(chainActive.Height(), (int64_t)height + count - 1);
+        headers.reserve(end - height + 1);
+        for (int i = height; i <= end; i++) {
+            headers.push_back(chainActive[i]);
         }
-        std::string strJSON = jsonHeaders.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
-        return true;
-    }
-    default: {
-        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
-    }
     }
+
+    return WriteHeaders(req, rf, tip, headers);
 }
 
 static bool rest_block(HTTPRequest* req,
@@ -621,25 +665,384 @@ static bool rest_blockhash_by_height(HTTPRequest* req,
     }
 }
 
+/**
+ * Set the caching headers of a contract route. Data of blocks deeper than the checkpoint span
+ * can no longer be reorganized away and is marked immutable, anything else only for a short while.
+ * Returns true if the client already holds this version, in which case 304 has been sent.
+ */
+static bool RESTCacheHeaders(HTTPRequest* req, const std::string& tag, bool is_final)
+{
+    const std::string etag = "\"" + tag + "\"";
+    req->WriteHeader("ETag", etag);
+    req->WriteHeader("Cache-Control", is_final ? "public, max-age=31536000, immutable" : "public, max-age=" + std::to_string(REST_TIP_MAX_AGE));
+
+    const std::pair<bool, std::string> match = req->GetHeader("If-None-Match");
+    if (match.first && (match.second.find(etag) != std::string::npos || match.second == "*")) {
+        req->WriteReply(HTTP_NOT_MODIFIED);
+        return true;
+    }
+    return false;
+}
+
+static bool IsFinalHeight(const CBlockIndex* tip, int height)
+{
+    return tip && height <= tip->nHeight && tip->nHeight - height >= Params().GetConsensus().CheckpointSpan(tip->nHeight);
+}
+
+static bool ParseContractAddress(const std::string& str)
+{
+    return str.size() == 40 && IsHex(str);
+}
+
+/** Run a read-only RPC method for a contract route, reporting its errors as HTTP errors */
+static bool RESTCallRPC(HTTPRequest* req, const std::string& method, const UniValue& params)
+{
+    JSONRPCRequest jsonRequest(req);
+    jsonRequest.strMethod = method;
+    jsonRequest.params = params;
+    jsonRequest.rawResult = std::make_shared<std::string>();
+
+    std::string strJSON;
+    try {
+        UniValue result = tableRPC.execute(jsonRequest);
+        strJSON = jsonRequest.rawResult->empty() ? result.write() : *jsonRequest.rawResult;
+    } catch (const UniValue& objError) {
+        const UniValue& code = find_value(objError, "code");
+        const UniValue& message = find_value(objError, "message");
+        enum HTTPStatusCode status = HTTP_BAD_REQUEST;
+        if (code.isNum() && code.get_int() == RPC_INVALID_ADDRESS_OR_KEY)
+            status = HTTP_NOT_FOUND;
+        else if (code.isNum() && code.get_int() == RPC_IN_WARMUP)
+            status = HTTP_SERVICE_UNAVAILABLE;
+        return RESTERR(req, status, message.isStr() ? message.get_str() : "Request failed");
+    } catch (const std::exception& e) {
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, e.what());
+    }
+
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON + "\n");
+    return true;
+}
+
+static bool rest_receipt(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string hashStr;
+    const RetFormat rf = ParseDataFormat(hashStr, strURIPart);
+
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    if (!fLogEvents)
+        return RESTERR(req, HTTP_NOT_FOUND, "Events indexing disabled");
+
+    std::vector<TransactionReceiptInfo> receipts = pstorageresult->readCommittedResult(uintToh256(hash));
+    if (receipts.empty())
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+
+    bool is_final = false;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pblockindex = LookupBlockIndex(receipts[0].blockHash);
+        if (!pblockindex || !chainActive.Contains(pblockindex))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        is_final = IsFinalHeight(chainActive.Tip(), pblockindex->nHeight);
+    }
+
+    switch (rf) {
+    case RetFormat::BINARY: {
+        if (RESTCacheHeaders(req, receipts[0].blockHash.GetHex(), is_final))
+            return true;
+        dev::bytes binaryReceipts = pstorageresult->serializeResult(receipts);
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, std::string(binaryReceipts.begin(), binaryReceipts.end()));
+        return true;
+    }
+
+    case RetFormat::HEX: {
+        if (RESTCacheHeaders(req, receipts[0].blockHash.GetHex(), is_final))
+            return true;
+        dev::bytes binaryReceipts = pstorageresult->serializeResult(receipts);
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, HexStr(binaryReceipts.begin(), binaryReceipts.end()) + "\n");
+        return true;
+    }
+
+    case RetFormat::JSON: {
+        if (RESTCacheHeaders(req, receipts[0].blockHash.GetHex(), is_final))
+            return true;
+        UniValue result(UniValue::VARR);
+        for (const TransactionReceiptInfo& t : receipts) {
+            UniValue tri(UniValue::VOBJ);
+            transactionReceiptInfoToJSON(t, tri);
+            result.push_back(tri);
+        }
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, result.write() + "\n");
+        return true;
+    }
+
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+}
+
+static bool rest_blockreceipts(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string hashStr;
+    const RetFormat rf = ParseDataFormat(hashStr, strURIPart);
+
+    uint256 hash;
+    if (!ParseHashStr(hashStr, hash))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
+
+    if (!fLogEvents)
+        return RESTERR(req, HTTP_NOT_FOUND, "Events indexing disabled");
+
+    CBlock block;
+    bool is_final = false;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pblockindex = LookupBlockIndex(hash);
+        if (!pblockindex || !chainActive.Contains(pblockindex))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        if (IsBlockPruned(pblockindex))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
+        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        is_final = IsFinalHeight(chainActive.Tip(), pblockindex->nHeight);
+    }
+
+    if (rf != RetFormat::BINARY && rf != RetFormat::HEX && rf != RetFormat::JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    if (RESTCacheHeaders(req, hash.GetHex(), is_final))
+        return true;
+
+    std::vector<std::pair<uint256, std::vector<TransactionReceiptInfo>>> receipts = ReadBlockReceipts(block);
+
+    switch (rf) {
+    case RetFormat::BINARY:
+    case RetFormat::HEX: {
+        // Each contract transaction by hash with its receipts in the encoding of /rest/receipt
+        std::vector<std::pair<uint256, std::vector<unsigned char>>> encoded;
+        for (const auto& txReceipts : receipts)
+            encoded.emplace_back(txReceipts.first, pstorageresult->serializeResult(txReceipts.second));
+        CDataStream ssReceipts(SER_NETWORK, PROTOCOL_VERSION);
+        ssReceipts << encoded;
+        if (rf == RetFormat::BINARY) {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, ssReceipts.str());
+        } else {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(ssReceipts.begin(), ssReceipts.end()) + "\n");
+        }
+        return true;
+    }
+
+    default: {
+        UniValue result(UniValue::VARR);
+        for (const auto& txReceipts : receipts) {
+            for (const TransactionReceiptInfo& t : txReceipts.second) {
+                UniValue tri(UniValue::VOBJ);
+                transactionReceiptInfoToJSON(t, tri);
+                result.push_back(tri);
+            }
+        }
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, result.write() + "\n");
+        return true;
+    }
+    }
+}
+
+static bool rest_logs(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RetFormat::JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() < 2 || path.size() > 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/logs/<from>/<to>[/<address>,...].json");
+
+    int32_t fromBlock, toBlock;
+    if (!ParseInt32(path[0], &fromBlock) || fromBlock < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + SanitizeString(path[0]));
+    if (!ParseInt32(path[1], &toBlock) || toBlock < fromBlock)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + SanitizeString(path[1]));
+    if (toBlock - fromBlock >= MAX_REST_LOGS_BLOCKS)
+        return RESTERR(req, HTTP_BAD_REQUEST, strprintf("Error: maximum number of blocks searched is %d", MAX_REST_LOGS_BLOCKS));
+
+    UniValue addresses(UniValue::VARR);
+    if (path.size() == 3) {
+        std::vector<std::string> strAddresses;
+        boost::split(strAddresses, path[2], boost::is_any_of(","));
+        for (const std::string& strAddr : strAddresses) {
+            if (!ParseContractAddress(strAddr))
+                return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + SanitizeString(strAddr));
+            addresses.push_back(strAddr);
+        }
+    }
+
+    // The logs of a range are fixed by the block that ends it
+    std::string tag;
+    bool is_final = false;
+    {
+        LOCK(cs_main);
+        if (toBlock > chainActive.Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range");
+        tag = strprintf("%s-%d", chainActive[toBlock]->GetBlockHash().GetHex(), fromBlock);
+        is_final = IsFinalHeight(chainActive.Tip(), toBlock);
+    }
+    if (RESTCacheHeaders(req, tag, is_final))
+        return true;
+
+    UniValue filter(UniValue::VOBJ);
+    filter.pushKV("addresses", addresses);
+    UniValue params(UniValue::VARR);
+    params.push_back(fromBlock);
+    params.push_back(toBlock);
+    params.push_back(filter);
+    return RESTCallRPC(req, "searchlogs", params);
+}
+
+static bool rest_storage(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RetFormat::JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() < 1 || path.size() > 2)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/storage/<address>[/<height>].json");
+
+    if (!ParseContractAddress(path[0]))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + SanitizeString(path[0]));
+
+    int32_t height = -1;
+    if (path.size() == 2 && (!ParseInt32(path[1], &height) || height < 0))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height: " + SanitizeString(path[1]));
+
+    std::string tag;
+    bool is_final = false;
+    {
+        LOCK(cs_main);
+        if (height > chainActive.Height())
+            return RESTERR(req, HTTP_NOT_FOUND, "Block height out of range");
+        const CBlockIndex* pblockindex = height < 0 ? chainActive.Tip() : chainActive[height];
+        tag = pblockindex->GetBlockHash().GetHex();
+        is_final = height >= 0 && IsFinalHeight(chainActive.Tip(), height);
+    }
+    if (RESTCacheHeaders(req, tag, is_final))
+        return true;
+
+    UniValue params(UniValue::VARR);
+    params.push_back(path[0]);
+    params.push_back(height);
+    return RESTCallRPC(req, "getstorage", params);
+}
+
+static bool rest_accountinfo(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string strAddr;
+    const RetFormat rf = ParseDataFormat(strAddr, strURIPart);
+    if (rf != RetFormat::JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+
+    if (!ParseContractAddress(strAddr))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + SanitizeString(strAddr));
+
+    std::string tag;
+    {
+        LOCK(cs_main);
+        tag = chainActive.Tip()->GetBlockHash().GetHex();
+    }
+    if (RESTCacheHeaders(req, tag, false))
+        return true;
+
+    UniValue params(UniValue::VARR);
+    params.push_back(strAddr);
+    return RESTCallRPC(req, "getaccountinfo", params);
+}
+
+static bool rest_callcontract(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RetFormat::JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() < 2 || path.size() > 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Expected /rest/callcontract/<address>/<data>[/<sender>].json");
+
+    if (!ParseContractAddress(path[0]))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + SanitizeString(path[0]));
+    if (!IsHex(path[1]))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid data (data not hex)");
+
+    std::string tag;
+    {
+        LOCK(cs_main);
+        tag = chainActive.Tip()->GetBlockHash().GetHex();
+    }
+    if (RESTCacheHeaders(req, tag, false))
+        return true;
+
+    UniValue params(UniValue::VARR);
+    for (const std::string& part : path)
+        params.push_back(part);
+    return RESTCallRPC(req, "callcontract", params);
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
+    HTTPWorkClass work_class;
 } uri_prefixes[] = {
-      {"/rest/tx/", rest_tx},
-      {"/rest/block/notxdetails/", rest_block_notxdetails},
-      {"/rest/block/", rest_block_extended},
-      {"/rest/chaininfo", rest_chaininfo},
-      {"/rest/mempool/info", rest_mempool_info},
-      {"/rest/mempool/contents", rest_mempool_contents},
-      {"/rest/headers/", rest_headers},
-      {"/rest/getutxos", rest_getutxos},
-      {"/rest/blockhashbyheight/", rest_blockhash_by_height},
+      {"/rest/tx/", rest_tx, HTTPWorkClass::LIGHT},
+      {"/rest/block/notxdetails/", rest_block_notxdetails, HTTPWorkClass::LIGHT},
+      {"/rest/block/", rest_block_extended, HTTPWorkClass::LIGHT},
+      {"/rest/chaininfo", rest_chaininfo, HTTPWorkClass::LIGHT},
+      {"/rest/mempool/info", rest_mempool_info, HTTPWorkClass::LIGHT},
+      {"/rest/mempool/contents", rest_mempool_contents, HTTPWorkClass::LIGHT},
+      {"/rest/headers/", rest_headers, HTTPWorkClass::LIGHT},
+      {"/rest/headersbyheight/", rest_headers_by_height, HTTPWorkClass::LIGHT},
+      {"/rest/getutxos", rest_getutxos, HTTPWorkClass::LIGHT},
+      {"/rest/blockhashbyheight/", rest_blockhash_by_height, HTTPWorkClass::LIGHT},
+      {"/rest/receipt/", rest_receipt, HTTPWorkClass::LIGHT},
+      {"/rest/blockreceipts/", rest_blockreceipts, HTTPWorkClass::LIGHT},
+      {"/rest/logs/", rest_logs, HTTPWorkClass::HEAVY},
+      {"/rest/storage/", rest_storage, HTTPWorkClass::LIGHT},
+      {"/rest/accountinfo/", rest_accountinfo, HTTPWorkClass::LIGHT},
+      {"/rest/callcontract/", rest_callcontract, HTTPWorkClass::LIGHT},
 };
 
 void StartREST()
 {
-    for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
-        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+    for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++) {
+        const HTTPWorkClass work_class = uri_prefixes[i].work_class;
+        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler,
+                            [work_class](HTTPRequest*, const std::string&) { return work_class; });
+    }
 }
 
 void InterruptREST()
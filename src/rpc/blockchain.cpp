@@ -14,12 +14,17 @@
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <hash.h>
+#include <index/blockfilterindex.h>
+#include <index/contracttxindex.h>
 #include <index/txindex.h>
 #include <key_io.h>
+#include <node/utxo_snapshot.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
 #include <primitives/transaction.h>
+#include <rpc/jsonstream.h>
+#include <rpc/resultcache.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
@@ -38,7 +43,9 @@
 #include <pos.h>
 #include <txdb.h>
 #include <util/convert.h>
+#include <qtum/contractprofiler.h>
 #include <qtum/qtumdelegation.h>
+#include <qtum/receiptproof.h>
 #include <util/tokenstr.h>
 #include <rpc/contract_util.h>
 
@@ -258,7 +265,8 @@ UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails)
+/** blockToJSON with an empty tx array, for the callers that write the transactions themselves */
+static UniValue blockToJSONWithoutTxs(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex)
 {
     UniValue result(UniValue::VOBJ);
     result.pushKV("hash", blockindex->GetBlockHash().GetHex());
@@ -280,19 +288,7 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIn
         result.pushKV("prevoutStakeVoutN", (int64_t)blockindex->prevoutStake.n); // qtum
     }
 
-    UniValue txs(UniValue::VARR);
-    for(const auto& tx : block.vtx)
-    {
-        if(txDetails)
-        {
-            UniValue objTx(UniValue::VOBJ);
-            TxToUniv(*tx, uint256(), objTx, true, RPCSerializationFlags());
-            txs.push_back(objTx);
-        }
-        else
-            txs.push_back(tx->GetHash().GetHex());
-    }
-    result.pushKV("tx", txs);
+    result.pushKV("tx", UniValue(UniValue::VARR));
     result.pushKV("time", block.GetBlockTime());
     result.pushKV("mediantime", (int64_t)blockindex->GetMedianTimePast());
     result.pushKV("nonce", (uint64_t)block.nNonce);
@@ -324,6 +320,36 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIn
     return result;
 }
 
+static UniValue txToBlockJSON(const CTransaction& tx, bool txDetails)
+{
+    if (!txDetails)
+        return tx.GetHash().GetHex();
+    UniValue objTx(UniValue::VOBJ);
+    TxToUniv(tx, uint256(), objTx, true, RPCSerializationFlags());
+    return objTx;
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* tip, const CBlockIndex* blockindex, bool txDetails)
+{
+    UniValue result = blockToJSONWithoutTxs(block, tip, blockindex);
+    UniValue txs(UniValue::VARR);
+    for(const auto& tx : block.vtx)
+        txs.push_back(txToBlockJSON(*tx, txDetails));
+    result.pushKV("tx", txs);
+    return result;
+}
+
+/** Write the description of a block from blockToJSONWithoutTxs with its transactions */
+static void blockToJSON(JSONStreamWriter& writer, const CBlock& block, const UniValue& blockWithoutTxs, bool txDetails)
+{
+    writer.ObjectWithMember(blockWithoutTxs, "tx", [&] {
+        writer.BeginArray();
+        for (const auto& tx : block.vtx)
+            writer.Value(txToBlockJSON(*tx, txDetails));
+        writer.EndArray();
+    });
+}
+
 UniValue getdelegationinfoforaddress(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1)
@@ -384,22 +410,6 @@ UniValue getdelegationinfoforaddress(const JSONRPCRequest& request)
     return result;
 }
 
-class DelegationsStakerFilter : public IDelegationFilter
-{
-public:
-    DelegationsStakerFilter(const uint160& _address):
-        address(_address)
-    {}
-
-    bool Match(const DelegationEvent& event) const
-    {
-        return event.item.staker == address;
-    }
-
-private:
-    uint160 address;
-};
-
 uint64_t getDelegateWeight(const uint160& keyid, const std::map<COutPoint, uint32_t>& immatureStakes, int height)
 {
     // Decode address
@@ -466,14 +476,11 @@ UniValue getdelegationsforstaker(const JSONRPCRequest& request)
     }
 
     // Get delegations for staker
-    QtumDelegation qtumDelegation;
-    std::vector<DelegationEvent> events;
     uint160 address = uint160(*keyid);
-    DelegationsStakerFilter filter(address);
-    if(!qtumDelegation.FilterDelegationEvents(events, filter)) {
+    std::map<uint160, Delegation> delegations;
+    if(!DelegationIndex().GetDelegationsForStaker(address, delegations)) {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Failed to get delegations for staker");
     }
-    std::map<uint160, Delegation> delegations = qtumDelegation.DelegationsFromEvents(events);
 
     // Get chain parameters
     std::map<COutPoint, uint32_t> immatureStakes = GetImmatureStakes();
@@ -552,8 +559,8 @@ static UniValue getblockcount(const JSONRPCRequest& request)
                 },
             }.ToString());
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    std::shared_ptr<const TipSnapshot> tip = GetTipSnapshot();
+    return tip ? tip->nHeight : -1;
 }
 
 static UniValue getbestblockhash(const JSONRPCRequest& request)
@@ -572,8 +579,7 @@ static UniValue getbestblockhash(const JSONRPCRequest& request)
                 },
             }.ToString());
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return GetTipSnapshot()->hash.GetHex();
 }
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
@@ -584,6 +590,7 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
         latestblock.height = pindex->nHeight;
     }
     cond_blockchange.notify_all();
+    RPCNotifyBlockWaits();
 }
 
 static UniValue waitfornewblock(const JSONRPCRequest& request)
@@ -613,6 +620,12 @@ static UniValue waitfornewblock(const JSONRPCRequest& request)
         timeout = request.params[0].get_int();
 
     CUpdatedBlock block;
+    if (request.blockWait) {
+        WITH_LOCK(cs_blockchange, block = latestblock);
+        request.blockWait->condition = [block](const CUpdatedBlock& latest) { return latest.height != block.height || latest.hash != block.hash; };
+        request.blockWait->timeout = timeout;
+        return NullUniValue;
+    }
     {
         WAIT_LOCK(cs_blockchange, lock);
         block = latestblock;
@@ -658,6 +671,12 @@ static UniValue waitforblock(const JSONRPCRequest& request)
     if (!request.params[1].isNull())
         timeout = request.params[1].get_int();
 
+    if (request.blockWait) {
+        request.blockWait->condition = [hash](const CUpdatedBlock& latest) { return latest.hash == hash; };
+        request.blockWait->timeout = timeout;
+        return NullUniValue;
+    }
+
     CUpdatedBlock block;
     {
         WAIT_LOCK(cs_blockchange, lock);
@@ -705,6 +724,12 @@ static UniValue waitforblockheight(const JSONRPCRequest& request)
     if (!request.params[1].isNull())
         timeout = request.params[1].get_int();
 
+    if (request.blockWait) {
+        request.blockWait->condition = [height](const CUpdatedBlock& latest) { return latest.height >= height; };
+        request.blockWait->timeout = timeout;
+        return NullUniValue;
+    }
+
     CUpdatedBlock block;
     {
         WAIT_LOCK(cs_blockchange, lock);
@@ -1109,14 +1134,16 @@ static UniValue getaccountinfo(const JSONRPCRequest& request)
                 "\nGet contract details including balance, storage data and code.\n",
                 {
                     {"address", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The contract address"},
+                    {"verbose", RPCArg::Type::BOOL, /* default */ "true", "Include the storage, code and UTXO of the contract, false returns the code hash instead"},
                 },
                 RPCResult{
                     RPCResult::Type::OBJ, "", "",
                     {
                         {RPCResult::Type::STR, "address", "The address of the contract"},
                         {RPCResult::Type::STR_AMOUNT, "balance", "The balance of the contract"},
-                        {RPCResult::Type::STR, "storage", "The storage data of the contract"},
-                        {RPCResult::Type::STR_HEX, "code", "The bytecode of the contract"},
+                        {RPCResult::Type::STR, "storage", "The storage data of the contract, with verbose"},
+                        {RPCResult::Type::STR_HEX, "code", "The bytecode of the contract, with verbose"},
+                        {RPCResult::Type::STR_HEX, "codehash", "The hash of the bytecode of the contract, without verbose"},
                     }},
                 RPCExamples{
                     HelpExampleCli("getaccountinfo", "eb23c0b3e6042821da281a2e2364feb22dd543e3")
@@ -1124,22 +1151,28 @@ static UniValue getaccountinfo(const JSONRPCRequest& request)
                 },
             }.ToString());
 
-    LOCK(cs_main);
-
     std::string strAddr = request.params[0].get_str();
     if(strAddr.size() != 40 || !CheckHex(strAddr))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Incorrect address");
 
+    // Read a copy of the tip state, the storage and UTXO walks below do not hold cs_main
+    std::unique_ptr<QtumState> state = TakeStateSnapshot();
+
     dev::Address addrAccount(strAddr);
-    if(!globalState->addressInUse(addrAccount))
+    if(!state->addressInUse(addrAccount))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Address does not exist");
     
     UniValue result(UniValue::VOBJ);
 
     result.pushKV("address", strAddr);
-    result.pushKV("balance", CAmount(globalState->balance(addrAccount)));
-    std::vector<uint8_t> code(globalState->code(addrAccount));
-    auto storage(globalState->storage(addrAccount));
+    result.pushKV("balance", CAmount(state->balance(addrAccount)));
+    if (!request.params[1].isNull() && !request.params[1].get_bool()) {
+        // Neither the storage nor the code is loaded, see getstorage for paged storage reads
+        result.pushKV("codehash", state->codeHash(addrAccount).hex());
+        return result;
+    }
+    std::vector<uint8_t> code(state->code(addrAccount));
+    auto storage(state->storage(addrAccount));
 
     UniValue storageUV(UniValue::VOBJ);
     for (auto j: storage)
@@ -1153,7 +1186,7 @@ static UniValue getaccountinfo(const JSONRPCRequest& request)
 
     result.pushKV("code", HexStr(code.begin(), code.end()));
 
-    std::unordered_map<dev::Address, Vin> vins = globalState->vins();
+    std::unordered_map<dev::Address, Vin> vins = state->vins();
     if(vins.count(addrAccount)){
         UniValue vin(UniValue::VOBJ);
         valtype vchHash(vins[addrAccount].hash.asBytes());
@@ -1174,71 +1207,98 @@ static UniValue getstorage(const JSONRPCRequest& request)
                 {
                     {"address", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The contract address"},
                     {"blockNum", RPCArg::Type::NUM,  /* default */ "latest", "Number of block to get state from."},
-                    {"index", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "Zero-based index position of the storage"},
+                    {"index", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "Zero-based index position of the storage, counted from start"},
+                    {"start", RPCArg::Type::STR_HEX, /* default */ "first slot", "Hashed storage slot to start at, the \"next\" of the previous page"},
+                    {"limit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "Return a page of at most this many entries as {\"storage\", \"next\"}, where \"next\" is the start of the next page or null after the last entry"},
                 },
                 RPCResult{
                     RPCResult::Type::STR, "", "The storage data of the contract"},
                 RPCExamples{
                     HelpExampleCli("getstorage", "eb23c0b3e6042821da281a2e2364feb22dd543e3")
+            + HelpExampleCli("getstorage", "eb23c0b3e6042821da281a2e2364feb22dd543e3 -1 null \"\" 1000")
             + HelpExampleRpc("getstorage", "eb23c0b3e6042821da281a2e2364feb22dd543e3")
                 },
             }.ToString());
 
-    LOCK(cs_main);
-
     std::string strAddr = request.params[0].get_str();
     if(strAddr.size() != 40 || !CheckHex(strAddr))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Incorrect address"); 
 
-    TemporaryState ts(globalState);
-    if (request.params.size() > 1)
+    const CBlockIndex* pindex = nullptr;
+    if (request.params.size() > 1 && !request.params[1].isNull())
     {
         if (request.params[1].isNum())
         {
             auto blockNum = request.params[1].get_int();
+            LOCK(cs_main);
             if((blockNum < 0 && blockNum != -1) || blockNum > chainActive.Height())
                 throw JSONRPCError(RPC_INVALID_PARAMS, "Incorrect block number");
 
             if(blockNum != -1)
-                ts.SetRoot(uintToh256(chainActive[blockNum]->hashStateRoot), uintToh256(chainActive[blockNum]->hashUTXORoot));
+                pindex = chainActive[blockNum];
                 
         } else {
             throw JSONRPCError(RPC_INVALID_PARAMS, "Incorrect block number");
         }
     }
 
+    // Read a copy of the state at the roots of the block, globalState stays at the tip for validation
+    std::unique_ptr<QtumState> state = TakeStateSnapshot(pindex);
+
     dev::Address addrAccount(strAddr);
-    if(!globalState->addressInUse(addrAccount))
+    if(!state->addressInUse(addrAccount))
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Address does not exist");
     
     UniValue result(UniValue::VOBJ);
 
-    bool onlyIndex = request.params.size() > 2;
+    bool onlyIndex = request.params.size() > 2 && !request.params[2].isNull();
     unsigned index = 0;
     if (onlyIndex)
         index = request.params[2].get_int();
 
-    auto storage(globalState->storage(addrAccount));
-
-    if (onlyIndex)
+    dev::h256 start;
+    if (request.params.size() > 3 && !request.params[3].isNull() && !request.params[3].get_str().empty())
     {
+        std::string strStart = request.params[3].get_str();
+        if (strStart.size() != 64 || !CheckHex(strStart))
+            throw JSONRPCError(RPC_INVALID_PARAMS, "Incorrect start slot");
+        start = dev::h256(strStart);
+    }
+
+    bool fPage = request.params.size() > 4 && !request.params[4].isNull();
+    int limit = fPage ? request.params[4].get_int() : 0;
+    if (fPage && (onlyIndex || limit <= 0))
+        throw JSONRPCError(RPC_INVALID_PARAMS, "Limit must be positive and can not be combined with index");
+
+    // Walk the storage trie only as far as the answer needs
+    std::map<dev::h256, std::pair<dev::u256, dev::u256>> storage;
+    dev::h256 next;
+    if (onlyIndex) {
+        state->storagePage(addrAccount, start, size_t(index) + 1, storage);
         if (index >= storage.size())
         {
             std::ostringstream stringStream;
             stringStream << "Storage size: " << storage.size() << " got index: " << index;
             throw JSONRPCError(RPC_INVALID_PARAMS, stringStream.str());
         }
-        auto elem = std::next(storage.begin(), index);
-        UniValue e(UniValue::VOBJ);
+        storage.erase(storage.begin(), std::prev(storage.end()));
+    } else {
+        next = state->storagePage(addrAccount, start, fPage ? limit : std::numeric_limits<size_t>::max(), storage);
+    }
 
-        storage = {{elem->first, {elem->second.first, elem->second.second}}};
-    } 
     for (const auto& j: storage)
     {
         UniValue e(UniValue::VOBJ);
         e.pushKV(dev::toHex(dev::h256(j.second.first)), dev::toHex(dev::h256(j.second.second)));
         result.pushKV(j.first.hex(), e);
     }
+    if (fPage)
+    {
+        UniValue page(UniValue::VOBJ);
+        page.pushKV("storage", result);
+        page.pushKV("next", next ? UniValue(next.hex()) : NullUniValue);
+        return page;
+    }
     return result;
 }
 
@@ -1302,6 +1362,8 @@ static UniValue getblockheader(const JSONRPCRequest& request)
 
     if (!fVerbose)
     {
+        if (request.resultBlock && tip->GetAncestor(pblockindex->nHeight) == pblockindex)
+            *request.resultBlock = RPCResultBlock{pblockindex->GetBlockHash(), pblockindex->nHeight};
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << pblockindex->GetBlockHeader();
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
@@ -1311,6 +1373,167 @@ static UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(tip, pblockindex);
 }
 
+UniValue blockheadersToJSON(const CBlockIndex* tip, const std::vector<const CBlockIndex*>& headers)
+{
+    // Chunks of headers are formatted on the batch threads, the block index entries are never modified
+    std::vector<UniValue> results(headers.size());
+    size_t chunks = (headers.size() + HEADERS_JSON_CHUNK_SIZE - 1) / HEADERS_JSON_CHUNK_SIZE;
+    RPCRunParallel(0, chunks, [&](size_t chunk) {
+        size_t end = std::min(headers.size(), (chunk + 1) * HEADERS_JSON_CHUNK_SIZE);
+        for (size_t idx = chunk * HEADERS_JSON_CHUNK_SIZE; idx < end; idx++) {
+            results[idx] = blockheaderToJSON(tip, headers[idx]);
+        }
+    });
+    UniValue jsonHeaders(UniValue::VARR);
+    jsonHeaders.push_backV(results);
+    return jsonHeaders;
+}
+
+static UniValue getblockheaders(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
+        throw std::runtime_error(
+            RPCHelpMan{"getblockheaders",
+                "\nReturns the headers of up to " + std::to_string(MAX_HEADERS_RANGE) + " consecutive blocks of the main chain, starting at the given height.\n"
+                "The range ends early at the chain tip.\n",
+                {
+                    {"height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The height of the first block"},
+                    {"count", RPCArg::Type::NUM, RPCArg::Optional::NO, "The number of headers, at most " + std::to_string(MAX_HEADERS_RANGE)},
+                    {"verbose", RPCArg::Type::BOOL, /* default */ "true", "true for json objects, false for the hex-encoded data"},
+                },
+                {
+                    RPCResult{"for verbose = true",
+                        RPCResult::Type::ARR, "", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "The header in the format of getblockheader", {}},
+                        }},
+                    RPCResult{"for verbose=false",
+                        RPCResult::Type::ARR, "", "",
+                        {
+                            {RPCResult::Type::STR_HEX, "", "The serialized, hex-encoded data of the header"},
+                        }},
+                },
+                RPCExamples{
+                    HelpExampleCli("getblockheaders", "1000 100")
+            + HelpExampleRpc("getblockheaders", "1000, 100")
+                },
+            }.ToString());
+
+    int nHeight = request.params[0].get_int();
+    int nCount = request.params[1].get_int();
+    if (nCount < 1 || nCount > MAX_HEADERS_RANGE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Header count out of range");
+
+    bool fVerbose = true;
+    if (!request.params[2].isNull())
+        fVerbose = request.params[2].get_bool();
+
+    // Only the block index pointers are collected under the lock, the formatting runs without it
+    const CBlockIndex* tip;
+    std::vector<const CBlockIndex*> headers;
+    {
+        LOCK(cs_main);
+        if (nHeight < 0 || nHeight > chainActive.Height())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        tip = chainActive.Tip();
+        int nEnd = std::min(chainActive.Height(), nHeight + nCount - 1);
+        headers.reserve(nEnd - nHeight + 1);
+        for (int i = nHeight; i <= nEnd; i++) {
+            headers.push_back(chainActive[i]);
+        }
+    }
+
+    if (!fVerbose) {
+        UniValue result(UniValue::VARR);
+        for (const CBlockIndex* pindex : headers) {
+            CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+            ssHeader << pindex->GetBlockHeader();
+            result.push_back(HexStr(ssHeader.begin(), ssHeader.end()));
+        }
+        return result;
+    }
+
+    return blockheadersToJSON(tip, headers);
+}
+
+static UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            RPCHelpMan{"getblockfilter",
+                "\nRetrieve a BIP 157 content filter for a particular block.\n",
+                {
+                    {"blockhash", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The hash of the block"},
+                    {"filtertype", RPCArg::Type::STR, /* default */ "basic", "The type name of the filter, basic or contract"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::STR_HEX, "filter", "the hex-encoded filter data"},
+                        {RPCResult::Type::STR_HEX, "header", "the hex-encoded filter header"},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+                },
+            }.ToString());
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "basic";
+    if (!request.params[1].isNull()) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        block_index = LookupBlockIndex(block_hash);
+        if (!block_index) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
 static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
 {
     CBlock block;
@@ -1389,8 +1612,6 @@ static UniValue getblock(const JSONRPCRequest& request)
                 },
             }.ToString());
 
-    LOCK(cs_main);
-
     uint256 hash(ParseHashV(request.params[0], "blockhash"));
 
     int verbosity = 1;
@@ -1401,22 +1622,38 @@ static UniValue getblock(const JSONRPCRequest& request)
             verbosity = request.params[1].get_bool() ? 1 : 0;
     }
 
-    const CBlockIndex* pblockindex = LookupBlockIndex(hash);
-    if (!pblockindex) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-    }
+    CBlock block;
+    UniValue blockWithoutTxs;
+    {
+        LOCK(cs_main);
 
-    const CBlock block = GetBlockChecked(pblockindex);
+        const CBlockIndex* pblockindex = LookupBlockIndex(hash);
+        if (!pblockindex) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
 
-    if (verbosity <= 0)
-    {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        block = GetBlockChecked(pblockindex);
+
+        if (verbosity <= 0)
+        {
+            if (request.resultBlock && chainActive.Contains(pblockindex))
+                *request.resultBlock = RPCResultBlock{pblockindex->GetBlockHash(), pblockindex->nHeight};
+            CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+            ssBlock << block;
+            std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+            return strHex;
+        }
+
+        if (!request.rawResult)
+            return blockToJSON(block, chainActive.Tip(), pblockindex, verbosity >= 2);
+
+        blockWithoutTxs = blockToJSONWithoutTxs(block, chainActive.Tip(), pblockindex);
     }
 
-    return blockToJSON(block, chainActive.Tip(), pblockindex, verbosity >= 2);
+    // The transactions do not depend on the chain, write them one at a time without cs_main
+    JSONStreamWriter writer(*request.rawResult);
+    blockToJSON(writer, block, blockWithoutTxs, verbosity >= 2);
+    return NullUniValue;
 }
 
 ////////////////////////////////////////////////////////////////////// // qtum
@@ -1474,6 +1711,134 @@ UniValue callcontract(const JSONRPCRequest& request)
     return CallToContract(request.params);
 }
 
+//! Most calls that one callcontractbatch may run
+static const size_t MAX_CALLCONTRACT_BATCH = 1000;
+
+UniValue callcontractbatch(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            RPCHelpMan{"callcontractbatch",
+                "\nCall many contract methods offline on the same tip state and block context.\n"
+                "The calls are spread over the -rpcbatchthreads threads, the results are in the order of the calls.\n",
+                {
+                    {"calls", RPCArg::Type::ARR, RPCArg::Optional::NO, "A json array of at most " + std::to_string(MAX_CALLCONTRACT_BATCH) + " calls",
+                        {
+                            {"", RPCArg::Type::OBJ, RPCArg::Optional::OMITTED, "",
+                                {
+                                    {"address", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The contract address, or empty address \"\""},
+                                    {"data", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The data hex string"},
+                                    {"senderAddress", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "The sender address string"},
+                                    {"gasLimit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED, "The gas limit for executing the contract."},
+                                    {"amount", RPCArg::Type::AMOUNT, RPCArg::Optional::OMITTED, "The amount in " + CURRENCY_UNIT + " to send. eg 0.1, default: 0"},
+                                },
+                            },
+                        },
+                    },
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "height", "The height of the tip the calls ran on"},
+                        {RPCResult::Type::STR_HEX, "blockhash", "The hash of the tip the calls ran on"},
+                        {RPCResult::Type::STR_HEX, "stateRoot", "The state root the calls ran on"},
+                        {RPCResult::Type::STR_HEX, "utxoRoot", "The UTXO root the calls ran on"},
+                        {RPCResult::Type::ARR, "results", "The results in the order of the calls",
+                            {
+                                {RPCResult::Type::OBJ, "", "",
+                                    {
+                                        {RPCResult::Type::ELISION, "", "The result of callcontract, or the address and error of a call that failed"},
+                                        {RPCResult::Type::OBJ, "error", /* optional */ true, "The error of the call",
+                                            {
+                                                {RPCResult::Type::NUM, "code", "The error code"},
+                                                {RPCResult::Type::STR, "message", "The error message"},
+                                            }},
+                                    }},
+                            }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("callcontractbatch", "'[{\"address\":\"eb23c0b3e6042821da281a2e2364feb22dd543e3\",\"data\":\"06fdde03\"},{\"address\":\"eb23c0b3e6042821da281a2e2364feb22dd543e3\",\"data\":\"95d89b41\"}]'")
+            + HelpExampleRpc("callcontractbatch", "[{\"address\":\"eb23c0b3e6042821da281a2e2364feb22dd543e3\",\"data\":\"06fdde03\"}]")
+                },
+            }.ToString());
+
+    RPCTypeCheck(request.params, {UniValue::VARR});
+    const UniValue& calls = request.params[0].get_array();
+    if (calls.size() > MAX_CALLCONTRACT_BATCH)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many calls, at most %u", MAX_CALLCONTRACT_BATCH));
+
+    // Each call is passed to CallToContract as the positional arguments of callcontract
+    const std::vector<std::string> optionalArgs = {"senderAddress", "gasLimit", "amount"};
+    std::vector<UniValue> callParams;
+    for (size_t i = 0; i < calls.size(); i++) {
+        const UniValue& call = calls[i];
+        if (!call.isObject())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Call %u is not an object", i));
+        RPCTypeCheckObj(call,
+            {
+                {"address", UniValueType(UniValue::VSTR)},
+                {"data", UniValueType(UniValue::VSTR)},
+            });
+        RPCTypeCheckObj(call,
+            {
+                {"address", UniValueType(UniValue::VSTR)},
+                {"data", UniValueType(UniValue::VSTR)},
+                {"senderAddress", UniValueType(UniValue::VSTR)},
+                {"gasLimit", UniValueType(UniValue::VNUM)},
+                {"amount", UniValueType()},
+            }, true, true);
+
+        UniValue params(UniValue::VARR);
+        params.push_back(find_value(call, "address"));
+        params.push_back(find_value(call, "data"));
+        size_t last = 0;
+        for (size_t j = 0; j < optionalArgs.size(); j++) {
+            if (!find_value(call, optionalArgs[j]).isNull())
+                last = j + 1;
+        }
+        // Arguments left out before a given one get the callcontract defaults
+        for (size_t j = 0; j < last; j++) {
+            const UniValue& value = find_value(call, optionalArgs[j]);
+            if (!value.isNull())
+                params.push_back(value);
+            else if (j == 0)
+                params.push_back("");
+            else
+                params.push_back(0);
+        }
+        callParams.push_back(params);
+    }
+
+    ContractCallSnapshot snapshot;
+    TakeContractCallSnapshot(snapshot);
+
+    std::vector<UniValue> results(callParams.size());
+    RPCRunParallel(0, callParams.size(), [&](size_t idx) {
+        UniValue error;
+        try {
+            results[idx] = CallToContract(snapshot, callParams[idx]);
+            return;
+        } catch (const UniValue& objError) {
+            error = objError;
+        } catch (const std::exception& e) {
+            error = JSONRPCError(RPC_MISC_ERROR, e.what());
+        }
+        results[idx] = UniValue(UniValue::VOBJ);
+        results[idx].pushKV("address", callParams[idx][0]);
+        results[idx].pushKV("error", error);
+    });
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("height", snapshot.pindex->nHeight);
+    ret.pushKV("blockhash", snapshot.pindex->GetBlockHash().GetHex());
+    ret.pushKV("stateRoot", snapshot.state->rootHash().hex());
+    ret.pushKV("utxoRoot", snapshot.state->rootHashUTXO().hex());
+    UniValue resultsArr(UniValue::VARR);
+    resultsArr.push_backV(results);
+    ret.pushKV("results", resultsArr);
+    return ret;
+}
+
 class WaitForLogsParams {
 public:
     int fromBlock;
@@ -1566,11 +1931,19 @@ UniValue waitforlogs(const JSONRPCRequest& request_) {
     auto& addresses = params.addresses;
     auto& filterTopics = params.topics;
 
+    // A log matches when all of the topics are found at their positions
+    std::vector<dev::h256> bloomTopics;
+    for (const auto& filterTopic : filterTopics) {
+        if (filterTopic) {
+            bloomTopics.push_back(filterTopic.get());
+        }
+    }
+
     while (curheight == 0) {
         {
             LOCK(cs_main);
             curheight = pblocktree->ReadHeightIndex(params.fromBlock, params.toBlock, params.minconf,
-                    hashesToBlock, addresses);
+                    hashesToBlock, addresses, bloomTopics, true);
         }
 
         // if curheight >= fromBlock. Blockchain extended with new log entries. Return next block height to client.
@@ -1680,13 +2053,17 @@ UniValue searchlogs(const JSONRPCRequest& request)
     if (request.fHelp || request.params.size() < 2)
         throw std::runtime_error(
             RPCHelpMan{"searchlogs",
-                "\nSearch logs, requires -logevents to be enabled.\n",
+                "\nSearch logs, requires -logevents to be enabled.\n"
+                "When limit is given, at most limit receipts are returned in an object together with a cursor\n"
+                "that resumes the search when passed back, or null once the range is exhausted.\n",
                 {
                     {"fromBlock", RPCArg::Type::NUM, RPCArg::Optional::NO, "The number of the earliest block (latest may be given to mean the most recent block)."},
                     {"toBlock", RPCArg::Type::NUM, RPCArg::Optional::NO, "The number of the latest block (-1 may be given to mean the most recent block)."},
                     {"address", RPCArg::Type::STR, RPCArg::Optional::OMITTED_NAMED_ARG, "An address or a list of addresses to only get logs from particular account(s)."},
                     {"topics", RPCArg::Type::STR, RPCArg::Optional::OMITTED_NAMED_ARG, "An array of values from which at least one must appear in the log entries. The order is important, if you want to leave topics out use null, e.g. [null, \"0x00...\"]."},
                     {"minconf", RPCArg::Type::NUM, /* default */ "0", "Minimal number of confirmations before a log is returned"},
+                    {"limit", RPCArg::Type::NUM, /* default */ "0", "Maximal number of receipts returned, 0 returns all of them at once"},
+                    {"cursor", RPCArg::Type::STR, RPCArg::Optional::OMITTED_NAMED_ARG, "The cursor returned by the previous call, to resume a search with limit"},
                 },
                 RPCResult{
                     RPCResult::Type::ARR, "", "",
@@ -1716,9 +2093,14 @@ UniValue searchlogs(const JSONRPCRequest& request)
                 RPCExamples{
                     HelpExampleCli("searchlogs", "0 100 '{\"addresses\": [\"12ae42729af478ca92c8c66773a3e32115717be4\"]}' '{\"topics\": [\"null\",\"b436c2bf863ccd7b8f63171201efd4792066b4ce8e543dde9c3e9e9ab98e216c\"]}'")
             + HelpExampleRpc("searchlogs", "0 100 '{\"addresses\": [\"12ae42729af478ca92c8c66773a3e32115717be4\"]} {\"topics\": [\"null\",\"b436c2bf863ccd7b8f63171201efd4792066b4ce8e543dde9c3e9e9ab98e216c\"]}'")
+            + HelpExampleCli("searchlogs", "0 -1 '{\"addresses\": [\"12ae42729af478ca92c8c66773a3e32115717be4\"]}' '{}' 0 100")
                 },
             }.ToString());
 
+    if (request.rawResult) {
+        JSONStreamWriter writer(*request.rawResult);
+        return SearchLogs(request.params, &writer);
+    }
     return SearchLogs(request.params);
 }
 
@@ -1777,6 +2159,24 @@ UniValue gettransactionreceipt(const JSONRPCRequest& request)
 
     std::vector<TransactionReceiptInfo> transactionReceiptInfo = pstorageresult->getResult(uintToh256(hash));
 
+    if (request.resultBlock && !transactionReceiptInfo.empty()) {
+        const CBlockIndex* pblockindex = LookupBlockIndex(transactionReceiptInfo[0].blockHash);
+        if (pblockindex && chainActive.Contains(pblockindex))
+            *request.resultBlock = RPCResultBlock{pblockindex->GetBlockHash(), pblockindex->nHeight};
+    }
+
+    if (request.rawResult) {
+        JSONStreamWriter writer(*request.rawResult);
+        writer.BeginArray();
+        for (const TransactionReceiptInfo& t : transactionReceiptInfo) {
+            UniValue tri(UniValue::VOBJ);
+            transactionReceiptInfoToJSON(t, tri);
+            writer.Value(tri);
+        }
+        writer.EndArray();
+        return NullUniValue;
+    }
+
     UniValue result(UniValue::VARR);
     for(TransactionReceiptInfo& t : transactionReceiptInfo){
         UniValue tri(UniValue::VOBJ);
@@ -1785,69 +2185,518 @@ UniValue gettransactionreceipt(const JSONRPCRequest& request)
     }
     return result;
 }
-//////////////////////////////////////////////////////////////////////
 
-UniValue listcontracts(const JSONRPCRequest& request)
+static UniValue getblockreceipts(const JSONRPCRequest& request)
 {
-	if (request.fHelp)
+    if (request.fHelp || request.params.size() != 1)
         throw std::runtime_error(
-            RPCHelpMan{"listcontracts",
-                "\nGet the contracts list.\n",
+            RPCHelpMan{"getblockreceipts",
+                "\nGet the receipts of all contract transactions of a block in one call, requires -logevents to be enabled.\n",
                 {
-                    {"start", RPCArg::Type::NUM, /* default */ "1", "The starting account index"},
-                    {"maxDisplay", RPCArg::Type::NUM, /* default */ "20", "Max accounts to list"},
+                    {"hash_or_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The block hash or height of the target block", "", {"", "string or numeric"}},
                 },
                 RPCResult{
-                    RPCResult::Type::OBJ, "", "",
+                    RPCResult::Type::ARR, "", "The receipts of the block in transaction order, as returned by gettransactionreceipt",
                     {
-                        {RPCResult::Type::NUM, "account", "The balance for the account"},
+                        {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::ELISION, "", "Same output as gettransactionreceipt"},
+                            }}
                     }
                 },
                 RPCExamples{
-                    HelpExampleCli("listcontracts", "")
-            + HelpExampleRpc("listcontracts", "")
+                    HelpExampleCli("getblockreceipts", "1000")
+            + HelpExampleCli("getblockreceipts", "'\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"'")
+            + HelpExampleRpc("getblockreceipts", "1000")
                 },
             }.ToString());
 
-	LOCK(cs_main);
-
-	int start=1;
-	if (request.params.size() > 0){
-		start = request.params[0].get_int();
-		if (start<= 0)
-			throw JSONRPCError(RPC_TYPE_ERROR, "Invalid start, min=1");
-	}
-
-	int maxDisplay=20;
-	if (request.params.size() > 1){
-		maxDisplay = request.params[1].get_int();
-		if (maxDisplay <= 0)
-			throw JSONRPCError(RPC_TYPE_ERROR, "Invalid maxDisplay");
-	}
+    if(!fLogEvents)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Events indexing disabled");
 
-	UniValue result(UniValue::VOBJ);
+    CBlock block;
+    {
+        LOCK(cs_main);
 
-	auto map = globalState->addresses();
-	int contractsCount=(int)map.size();
+        const CBlockIndex* pindex;
+        if (request.params[0].isNum()) {
+            const int height = request.params[0].get_int();
+            if (height < 0 || height > chainActive.Height())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+            pindex = chainActive[height];
+        } else {
+            const uint256 hash(ParseHashV(request.params[0], "hash_or_height"));
+            pindex = LookupBlockIndex(hash);
+            if (!pindex)
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+            if (!chainActive.Contains(pindex))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
+        }
 
-	if (contractsCount>0 && start > contractsCount)
-		throw JSONRPCError(RPC_TYPE_ERROR, "start greater than max index "+ itostr(contractsCount));
+        block = GetBlockChecked(pindex);
+    }
 
-	int itStartPos=std::min(start-1,contractsCount);
-	int i=0;
-	for (auto it = std::next(map.begin(),itStartPos); it!=map.end(); it++)
-	{
-		result.pushKV(it->first.hex(),ValueFromAmount(CAmount(globalState->balance(it->first))));
-		i++;
-		if(i==maxDisplay)break;
-	}
+    // Committed receipts are read without cs_main, all in one pass
+    std::vector<std::pair<uint256, std::vector<TransactionReceiptInfo>>> receipts = ReadBlockReceipts(block);
+
+    if (request.rawResult) {
+        JSONStreamWriter writer(*request.rawResult);
+        writer.BeginArray();
+        for (const auto& txReceipts : receipts) {
+            for (const TransactionReceiptInfo& t : txReceipts.second) {
+                UniValue tri(UniValue::VOBJ);
+                transactionReceiptInfoToJSON(t, tri);
+                writer.Value(tri);
+            }
+        }
+        writer.EndArray();
+        return NullUniValue;
+    }
 
-	return result;
+    UniValue result(UniValue::VARR);
+    for (const auto& txReceipts : receipts) {
+        for (const TransactionReceiptInfo& t : txReceipts.second) {
+            UniValue tri(UniValue::VOBJ);
+            transactionReceiptInfoToJSON(t, tri);
+            result.push_back(tri);
+        }
+    }
+    return result;
 }
+//////////////////////////////////////////////////////////////////////
 
-struct CCoinsStats
+/** The receipt tree leaves of a block in execution order */
+static std::vector<ReceiptLeaf> ReadBlockReceiptLeaves(const CBlock& block)
 {
-    int nHeight;
+    std::vector<ReceiptLeaf> leaves;
+    for (const auto& txReceipts : ReadBlockReceipts(block)) {
+        for (size_t n = 0; n < txReceipts.second.size(); n++) {
+            leaves.emplace_back(txReceipts.second[n], n);
+        }
+    }
+    return leaves;
+}
+
+static uint256 ReceiptRootOf(const std::vector<ReceiptLeaf>& leaves)
+{
+    std::vector<uint256> hashes;
+    hashes.reserve(leaves.size());
+    for (const ReceiptLeaf& leaf : leaves) {
+        hashes.push_back(leaf.GetHash());
+    }
+    return ReceiptMerkleRoot(hashes);
+}
+
+static UniValue ReceiptLeafToJSON(const ReceiptLeaf& leaf)
+{
+    UniValue entry(UniValue::VOBJ);
+    entry.pushKV("transactionHash", leaf.transactionHash.GetHex());
+    entry.pushKV("n", (int64_t)leaf.n);
+    entry.pushKV("from", HexStr(leaf.from.begin(), leaf.from.end()));
+    entry.pushKV("to", HexStr(leaf.to.begin(), leaf.to.end()));
+    entry.pushKV("cumulativeGasUsed", leaf.cumulativeGasUsed);
+    entry.pushKV("gasUsed", leaf.gasUsed);
+    entry.pushKV("contractAddress", HexStr(leaf.contractAddress.begin(), leaf.contractAddress.end()));
+    entry.pushKV("excepted", (int64_t)leaf.excepted);
+    UniValue logs(UniValue::VARR);
+    for (const ReceiptLog& log : leaf.logs) {
+        UniValue logEntry(UniValue::VOBJ);
+        logEntry.pushKV("address", HexStr(log.address.begin(), log.address.end()));
+        UniValue topics(UniValue::VARR);
+        for (const uint256& topic : log.topics) {
+            topics.push_back(HexStr(topic.begin(), topic.end()));
+        }
+        logEntry.pushKV("topics", topics);
+        logEntry.pushKV("data", HexStr(log.data));
+        logs.push_back(logEntry);
+    }
+    entry.pushKV("log", logs);
+    return entry;
+}
+
+static UniValue getreceiptroot(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            RPCHelpMan{"getreceiptroot",
+                "\nGet the merkle root of the receipts of a block, which the proofs of getreceiptproof lead to, requires -logevents to be enabled.\n"
+                "The root is not committed in the block yet, light clients should compare it between several nodes.\n",
+                {
+                    {"hash_or_height", RPCArg::Type::NUM, RPCArg::Optional::NO, "The block hash or height of the target block", "", {"", "string or numeric"}},
+                },
+                RPCResult{
+                    RPCResult::Type::STR_HEX, "", "The receipt root, all zeros for a block without receipts"
+                },
+                RPCExamples{
+                    HelpExampleCli("getreceiptroot", "1000")
+            + HelpExampleRpc("getreceiptroot", "1000")
+                },
+            }.ToString());
+
+    if(!fLogEvents)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Events indexing disabled");
+
+    CBlock block;
+    {
+        LOCK(cs_main);
+
+        const CBlockIndex* pindex;
+        if (request.params[0].isNum()) {
+            const int height = request.params[0].get_int();
+            if (height < 0 || height > chainActive.Height())
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+            pindex = chainActive[height];
+        } else {
+            const uint256 hash(ParseHashV(request.params[0], "hash_or_height"));
+            pindex = LookupBlockIndex(hash);
+            if (!pindex)
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+            if (!chainActive.Contains(pindex))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
+        }
+
+        block = GetBlockChecked(pindex);
+    }
+
+    return ReceiptRootOf(ReadBlockReceiptLeaves(block)).GetHex();
+}
+
+static UniValue getreceiptproof(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            RPCHelpMan{"getreceiptproof",
+                "\nReturns a hex-encoded proof that the receipts of the transactions \"txids\" are in the receipt tree of a block,\n"
+                "with the receipts themselves so that their logs can be checked without trusting this node. Requires -logevents to be enabled.\n",
+                {
+                    {"txids", RPCArg::Type::ARR, RPCArg::Optional::NO, "A json array of contract transaction hashes to prove the receipts of",
+                        {
+                            {"txid", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, "A transaction hash"},
+                        },
+                        },
+                    {"blockhash", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED_NAMED_ARG, "The block of the transactions, by default the block of the receipts of the first one"},
+                },
+                RPCResult{
+                    RPCResult::Type::STR, "data", "A string that is a serialized, hex-encoded data for the proof."
+                },
+                RPCExamples{
+                    HelpExampleCli("getreceiptproof", "'[\"3b04bc73afbbcf02cfef2ca1127b60fb0baf5f8946a42df67f1659671a2ec53c\"]'")
+            + HelpExampleRpc("getreceiptproof", "[\"3b04bc73afbbcf02cfef2ca1127b60fb0baf5f8946a42df67f1659671a2ec53c\"]")
+                },
+            }.ToString());
+
+    if(!fLogEvents)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Events indexing disabled");
+
+    std::set<uint256> txids;
+    const UniValue& txidsParam = request.params[0].get_array();
+    for (unsigned int idx = 0; idx < txidsParam.size(); idx++) {
+        const uint256 hash(ParseHashV(txidsParam[idx], "txid"));
+        if (!txids.insert(hash).second)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Invalid parameter, duplicated txid: ") + txidsParam[idx].get_str());
+    }
+    if (txids.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, no txids");
+
+    CBlock block;
+    {
+        LOCK(cs_main);
+
+        uint256 hashBlock;
+        if (!request.params[1].isNull()) {
+            hashBlock = ParseHashV(request.params[1], "blockhash");
+        } else {
+            const uint256 txid = ParseHashV(txidsParam[0], "txid");
+            std::vector<TransactionReceiptInfo> receipts = pstorageresult->getResult(uintToh256(txid));
+            if (receipts.empty())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction receipt not found");
+            hashBlock = receipts[0].blockHash;
+        }
+        const CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+        if (!pindex)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        if (!chainActive.Contains(pindex))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Block is not in chain %s", Params().NetworkIDString()));
+
+        block = GetBlockChecked(pindex);
+    }
+
+    const std::vector<ReceiptLeaf> leaves = ReadBlockReceiptLeaves(block);
+    std::set<uint256> found;
+    for (const ReceiptLeaf& leaf : leaves) {
+        if (txids.count(leaf.transactionHash))
+            found.insert(leaf.transactionHash);
+    }
+    if (found.size() != txids.size())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Not all transactions have receipts in the specified or retrieved block");
+
+    CDataStream ssProof(SER_NETWORK, PROTOCOL_VERSION);
+    ssProof << CReceiptProof(block.GetHash(), leaves, txids);
+    return HexStr(ssProof.begin(), ssProof.end());
+}
+
+static UniValue verifyreceiptproof(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            RPCHelpMan{"verifyreceiptproof",
+                "\nVerifies that a proof points to receipts of a block, returning the receipts it commits to\n"
+                "and throwing an RPC error if the block is not in our best chain. Requires -logevents to be enabled.\n",
+                {
+                    {"proof", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The hex-encoded proof generated by getreceiptproof"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "The receipts the proof commits to, or empty array if the proof can not be validated",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR_HEX, "transactionHash", "The transaction hash"},
+                                {RPCResult::Type::NUM, "n", "The position of the receipt among those of the transaction"},
+                                {RPCResult::Type::STR_HEX, "from", "The from address"},
+                                {RPCResult::Type::STR_HEX, "to", "The to address"},
+                                {RPCResult::Type::NUM, "cumulativeGasUsed", "The cumulative gas used"},
+                                {RPCResult::Type::NUM, "gasUsed", "The gas used"},
+                                {RPCResult::Type::STR_HEX, "contractAddress", "The contract address"},
+                                {RPCResult::Type::NUM, "excepted", "The code of the thrown exception"},
+                                {RPCResult::Type::ARR, "log", "The logs from the receipt",
+                                    {
+                                        {RPCResult::Type::STR_HEX, "address", "The contract address"},
+                                        {RPCResult::Type::ARR, "topics", "The topic",
+                                            {{RPCResult::Type::STR_HEX, "topic", "The topic"}}},
+                                        {RPCResult::Type::STR_HEX, "data", "The logged data"},
+                                    }},
+                            }}
+                    }
+                },
+                RPCExamples{""},
+            }.ToString());
+
+    if(!fLogEvents)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Events indexing disabled");
+
+    CDataStream ssProof(ParseHexV(request.params[0], "proof"), SER_NETWORK, PROTOCOL_VERSION);
+    CReceiptProof proof;
+    ssProof >> proof;
+
+    UniValue res(UniValue::VARR);
+
+    const uint256 root = proof.Verify();
+    if (root.IsNull())
+        return res;
+
+    CBlock block;
+    {
+        LOCK(cs_main);
+
+        const CBlockIndex* pindex = LookupBlockIndex(proof.hashBlock);
+        if (!pindex || !chainActive.Contains(pindex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found in chain");
+
+        block = GetBlockChecked(pindex);
+    }
+
+    const std::vector<ReceiptLeaf> leaves = ReadBlockReceiptLeaves(block);
+    if (leaves.size() != proof.tree.GetNumTransactions() || ReceiptRootOf(leaves) != root)
+        return res;
+
+    for (const ReceiptLeaf& leaf : proof.receipts) {
+        res.push_back(ReceiptLeafToJSON(leaf));
+    }
+    return res;
+}
+
+UniValue listcontracts(const JSONRPCRequest& request)
+{
+	if (request.fHelp)
+        throw std::runtime_error(
+            RPCHelpMan{"listcontracts",
+                "\nGet the contracts list, in contract address order.\n",
+                {
+                    {"start", RPCArg::Type::NUM, /* default */ "1", "The starting account index, or the hex contract address to start from"},
+                    {"maxDisplay", RPCArg::Type::NUM, /* default */ "20", "Max accounts to list"},
+                    {"verbose", RPCArg::Type::BOOL, /* default */ "false", "Also return the creation of each contract and the address the next page starts from"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "account", "The balance for the account"},
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("listcontracts", "")
+            + HelpExampleCli("listcontracts", "'\"12ae42729af478ca92c8c66773a3e32115717be4\"' 100 true")
+            + HelpExampleRpc("listcontracts", "")
+                },
+            }.ToString());
+
+	LOCK(cs_main);
+
+	uint160 startAddress;
+	int start=1;
+	if (request.params.size() > 0){
+		if (request.params[0].isStr()) {
+			std::string strAddress = request.params[0].get_str();
+			if (strAddress.size() != 40 || !IsHex(strAddress))
+				throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Incorrect contract address");
+			startAddress = uint160(ParseHex(strAddress));
+		} else {
+			start = request.params[0].get_int();
+			if (start<= 0)
+				throw JSONRPCError(RPC_TYPE_ERROR, "Invalid start, min=1");
+		}
+	}
+
+	int maxDisplay=20;
+	if (request.params.size() > 1){
+		maxDisplay = request.params[1].get_int();
+		if (maxDisplay <= 0)
+			throw JSONRPCError(RPC_TYPE_ERROR, "Invalid maxDisplay");
+	}
+
+	bool fVerbose = false;
+	if (request.params.size() > 2)
+		fVerbose = request.params[2].get_bool();
+
+	// One more contract than displayed tells where the next page starts
+	std::vector<std::pair<uint160, CContractIndexValue>> contracts;
+	if (!pblocktree->ReadContractIndex(startAddress, start - 1, (size_t)maxDisplay + 1, contracts))
+		throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the contract index");
+
+	if (contracts.empty() && start > 1)
+		throw JSONRPCError(RPC_TYPE_ERROR, "start greater than max index");
+
+	UniValue result(UniValue::VOBJ);
+	UniValue list(UniValue::VARR);
+	for (size_t i = 0; i < contracts.size() && i < (size_t)maxDisplay; i++)
+	{
+		dev::Address address = uintToh160(contracts[i].first);
+		// The contracts that destroyed themselves are indexed until their creation is disconnected
+		if (!globalState->addressInUse(address))
+			continue;
+		CAmount balance = CAmount(globalState->balance(address));
+		if (!fVerbose) {
+			result.pushKV(address.hex(), ValueFromAmount(balance));
+			continue;
+		}
+		const CContractIndexValue& value = contracts[i].second;
+		UniValue entry(UniValue::VOBJ);
+		entry.pushKV("address", address.hex());
+		entry.pushKV("balance", ValueFromAmount(balance));
+		if (value.nHeight >= 0) {
+			entry.pushKV("height", value.nHeight);
+			entry.pushKV("txid", value.txid.GetHex());
+			entry.pushKV("creator", uintToh160(value.creator).hex());
+		}
+		entry.pushKV("codehash", value.codeHash.GetHex());
+		list.push_back(entry);
+	}
+
+	if (!fVerbose)
+		return result;
+
+	result.pushKV("contracts", list);
+	if (contracts.size() > (size_t)maxDisplay)
+		result.pushKV("next", uintToh160(contracts[maxDisplay].first).hex());
+	else
+		result.pushKV("next", NullUniValue);
+	return result;
+}
+
+UniValue listcontracttxs(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 5)
+        throw std::runtime_error(
+            RPCHelpMan{"listcontracttxs",
+                "\nList the contract executions into a contract, or sent by an address, in chain order.\n"
+                "Requires -contracttxindex.\n",
+                {
+                    {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "The hex contract address, or with sent the hex or base58 address of the sender"},
+                    {"sent", RPCArg::Type::BOOL, /* default */ "false", "List the executions sent by address instead of the executions of the contract"},
+                    {"fromBlock", RPCArg::Type::NUM, /* default */ "0", "The height of the earliest block"},
+                    {"toBlock", RPCArg::Type::NUM, /* default */ "-1", "The height of the latest block, -1 for the chain tip"},
+                    {"limit", RPCArg::Type::NUM, /* default */ "0", "Maximal number of executions returned, 0 returns all of them"},
+                },
+                RPCResult{
+                    RPCResult::Type::ARR, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR_HEX, "transactionHash", "The transaction hash"},
+                                {RPCResult::Type::NUM, "outputIndex", "The output of the contract execution"},
+                                {RPCResult::Type::NUM, "blockNumber", "The block number"},
+                                {RPCResult::Type::NUM, "transactionIndex", "The transaction index"},
+                                {RPCResult::Type::STR_HEX, "from", "The sender address"},
+                                {RPCResult::Type::STR_HEX, "contractAddress", "The contract address"},
+                                {RPCResult::Type::BOOL, "create", "Whether the execution created the contract"},
+                            }}
+                    }
+                },
+                RPCExamples{
+                    HelpExampleCli("listcontracttxs", "\"12ae42729af478ca92c8c66773a3e32115717be4\"")
+            + HelpExampleCli("listcontracttxs", "\"12ae42729af478ca92c8c66773a3e32115717be4\" true 1000 -1 100")
+            + HelpExampleRpc("listcontracttxs", "\"12ae42729af478ca92c8c66773a3e32115717be4\"")
+                },
+            }.ToString());
+
+    if (!g_contracttxindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Contract transaction index not enabled, start with -contracttxindex");
+
+    bool fSender = false;
+    if (!request.params[1].isNull())
+        fSender = request.params[1].get_bool();
+
+    uint160 address;
+    std::string strAddress = request.params[0].get_str();
+    if (strAddress.size() == 40 && IsHex(strAddress)) {
+        address = uint160(ParseHex(strAddress));
+    } else {
+        CTxDestination dest = DecodeDestination(strAddress);
+        const CKeyID *keyid = boost::get<CKeyID>(&dest);
+        if (!fSender || !keyid)
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Incorrect address");
+        address = uint160(*keyid);
+    }
+
+    int nFromBlock = 0;
+    if (!request.params[2].isNull())
+        nFromBlock = request.params[2].get_int();
+    int nToBlock = -1;
+    if (!request.params[3].isNull())
+        nToBlock = request.params[3].get_int();
+    if (nFromBlock < 0 || nToBlock < -1)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block range");
+    int nLimit = 0;
+    if (!request.params[4].isNull())
+        nLimit = request.params[4].get_int();
+    if (nLimit < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid limit");
+
+    g_contracttxindex->BlockUntilSyncedToCurrentChain();
+
+    std::vector<std::pair<CContractTxIndexKey, CContractTxIndexValue>> entries;
+    if (!g_contracttxindex->ReadContractTxs(address, fSender, nFromBlock, nToBlock, nLimit, entries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read the contract transaction index");
+
+    UniValue result(UniValue::VARR);
+    for (const auto& entry : entries) {
+        const uint160& contract = fSender ? entry.second.counterpart : entry.first.address;
+        const uint160& sender = fSender ? entry.first.address : entry.second.counterpart;
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("transactionHash", entry.second.txid.GetHex());
+        obj.pushKV("outputIndex", (int64_t)entry.first.nVout);
+        obj.pushKV("blockNumber", (int64_t)entry.first.blockHeight);
+        obj.pushKV("transactionIndex", (int64_t)entry.first.txIndex);
+        obj.pushKV("from", uintToh160(sender).hex());
+        obj.pushKV("contractAddress", uintToh160(contract).hex());
+        obj.pushKV("create", entry.second.fCreate);
+        result.push_back(obj);
+    }
+    return result;
+}
+
+struct CCoinsStats
+{
+    int nHeight;
     uint256 hashBlock;
     uint64_t nTransactions;
     uint64_t nTransactionOutputs;
@@ -1975,12 +2824,14 @@ static UniValue pruneblockchain(const JSONRPCRequest& request)
 
 static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 1)
         throw std::runtime_error(
             RPCHelpMan{"gettxoutsetinfo",
                 "\nReturns statistics about the unspent transaction output set.\n"
-                "Note this call may take some time.\n",
-                {},
+                "Note this call may take some time, except with hash_type muhash.\n",
+                {
+                    {"hash_type", RPCArg::Type::STR, /* default */ "hash_serialized_2", "Which UTXO set hash should be calculated. Options: 'hash_serialized_2' (scans the UTXO set), 'muhash' (the rolling hash kept with -utxosethash, the UTXO set is not scanned and only height, bestblock, muhash, disk_size and the state roots are returned)."},
+                },
                 RPCResult{
                 RPCResult::Type::OBJ, "", "",
                 {
@@ -1989,31 +2840,69 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
                     {RPCResult::Type::NUM, "transactions", "The number of transactions with unspent outputs"},
                     {RPCResult::Type::NUM, "txouts", "The number of unspent transaction outputs"},
                     {RPCResult::Type::NUM, "bogosize", "A meaningless metric for UTXO set size"},
-                    {RPCResult::Type::STR_HEX, "hash_serialized_2", "The serialized hash"},
+                    {RPCResult::Type::STR_HEX, "hash_serialized_2", "The serialized hash (only present if 'hash_serialized_2' hash_type is chosen)"},
+                    {RPCResult::Type::STR_HEX, "muhash", "The MuHash3072 of the UTXO set (only present if 'muhash' hash_type is chosen)"},
                     {RPCResult::Type::NUM, "disk_size", "The estimated size of the chainstate on disk"},
                     {RPCResult::Type::STR_AMOUNT, "total_amount", "The total amount"},
+                    {RPCResult::Type::STR_HEX, "hash_state_root", "The contract state root of bestblock"},
+                    {RPCResult::Type::STR_HEX, "hash_utxo_root", "The contract UTXO root of bestblock"},
                 }},
                 RPCExamples{
                     HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "muhash")
             + HelpExampleRpc("gettxoutsetinfo", "")
                 },
             }.ToString());
 
+    std::string hash_type = "hash_serialized_2";
+    if (!request.params[0].isNull()) {
+        hash_type = request.params[0].get_str();
+        if (hash_type != "hash_serialized_2" && hash_type != "muhash") {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hash_type));
+        }
+    }
+
     UniValue ret(UniValue::VOBJ);
 
-    CCoinsStats stats;
-    FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
-        ret.pushKV("height", (int64_t)stats.nHeight);
-        ret.pushKV("bestblock", stats.hashBlock.GetHex());
-        ret.pushKV("transactions", (int64_t)stats.nTransactions);
-        ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
-        ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
-        ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
-        ret.pushKV("disk_size", stats.nDiskSize);
-        ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+    uint256 hashBlock;
+    if (hash_type == "muhash") {
+        if (!fUTXOSetHash) {
+            throw JSONRPCError(RPC_MISC_ERROR, "The UTXO set hash is not kept, restart with -utxosethash");
+        }
+        uint256 hash;
+        if (!GetUTXOSetHash(hashBlock, hash)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "The UTXO set hash is not known");
+        }
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+        ret.pushKV("height", (int64_t)pindex->nHeight);
+        ret.pushKV("bestblock", hashBlock.GetHex());
+        ret.pushKV("muhash", hash.GetHex());
+        ret.pushKV("disk_size", pcoinsdbview->EstimateSize());
     } else {
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        CCoinsStats stats;
+        FlushStateToDisk();
+        if (GetUTXOStats(pcoinsdbview.get(), stats)) {
+            ret.pushKV("height", (int64_t)stats.nHeight);
+            ret.pushKV("bestblock", stats.hashBlock.GetHex());
+            ret.pushKV("transactions", (int64_t)stats.nTransactions);
+            ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
+            ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
+            ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+            ret.pushKV("disk_size", stats.nDiskSize);
+            ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+            hashBlock = stats.hashBlock;
+        } else {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        }
+    }
+
+    // The contract state committed by the same block, so the coins and the contracts are checked together
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = LookupBlockIndex(hashBlock);
+        ret.pushKV("hash_state_root", pindex->hashStateRoot.GetHex());
+        ret.pushKV("hash_utxo_root", pindex->hashUTXORoot.GetHex());
     }
     return ret;
 }
@@ -2435,6 +3324,9 @@ UniValue mempoolInfoToJSON()
     ret.pushKV("maxmempool", (int64_t) maxmempool);
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(mempool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
     ret.pushKV("minrelaytxfee", ValueFromAmount(::minRelayTxFee.GetFeePerK()));
+    if (fAddressIndex) {
+        ret.pushKV("addressindexusage", (int64_t) mempool.AddressIndexUsage());
+    }
 
     return ret;
 }
@@ -2455,6 +3347,7 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM, "maxmempool", "Maximum memory usage for the mempool"},
                         {RPCResult::Type::STR_AMOUNT, "mempoolminfee", "Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee"},
                         {RPCResult::Type::STR_AMOUNT, "minrelaytxfee", "Current minimum relay fee for transactions"},
+                        {RPCResult::Type::NUM, "addressindexusage", /* optional */ true, "Memory usage of the mempool address and spent indexes, not counted in usage (only with -addressindex)"},
                     }},
                 RPCExamples{
                     HelpExampleCli("getmempoolinfo", "")
@@ -2465,6 +3358,78 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+static std::vector<RPCResult> MempoolStageDescription()
+{
+    return {
+        {RPCResult::Type::NUM, "count", "The number of admissions that reached it"},
+        {RPCResult::Type::NUM, "time", "Total time"},
+        {RPCResult::Type::NUM, "maxtime", "Longest time"},
+        {RPCResult::Type::ARR, "histogram", "Bucket i counts the times below 2^i microseconds, the last bucket counts the rest",
+            {{RPCResult::Type::NUM, "", "Admissions in the bucket"}}},
+    };
+}
+
+static UniValue MempoolStageToJSON(const MempoolStageStats& stats)
+{
+    UniValue histogram(UniValue::VARR);
+    for (uint64_t nCount : stats.histogram) {
+        histogram.push_back(nCount);
+    }
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("count", stats.nCount);
+    ret.pushKV("time", stats.nTime);
+    ret.pushKV("maxtime", stats.nMaxTime);
+    ret.pushKV("histogram", histogram);
+    return ret;
+}
+
+static UniValue getmempoolacceptstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            RPCHelpMan{"getmempoolacceptstats",
+                "\nReturns the latency of the mempool admissions since startup by transaction type and stage, times in microseconds.\n"
+                "The types are plain, create, call and lydra. The stages are prechecks, inputs, contract, policy, scripts and insert,\n"
+                "a rejected transaction counts the stages it reached.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ_DYN, "", "",
+                    {
+                        {RPCResult::Type::OBJ, "type", "",
+                        {
+                            {RPCResult::Type::NUM, "accepted", "Transactions accepted"},
+                            {RPCResult::Type::NUM, "rejected", "Transactions rejected, including orphans"},
+                            {RPCResult::Type::OBJ, "total", "The whole admission", MempoolStageDescription()},
+                            {RPCResult::Type::OBJ_DYN, "stages", "",
+                            {
+                                {RPCResult::Type::OBJ, "stage", "", MempoolStageDescription()},
+                            }},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getmempoolacceptstats", "")
+            + HelpExampleRpc("getmempoolacceptstats", "")
+                },
+            }.ToString());
+
+    std::vector<MempoolAcceptStats> vStats = GetMempoolAcceptStats();
+    UniValue ret(UniValue::VOBJ);
+    for (int type = 0; type < MEMPOOL_TX_TYPES; type++) {
+        const MempoolAcceptStats& stats = vStats[type];
+        UniValue stages(UniValue::VOBJ);
+        for (int stage = 0; stage < MEMPOOL_STAGES; stage++) {
+            stages.pushKV(MempoolAcceptStageName(stage), MempoolStageToJSON(stats.stages[stage]));
+        }
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("accepted", stats.nAccepted);
+        obj.pushKV("rejected", stats.nRejected);
+        obj.pushKV("total", MempoolStageToJSON(stats.total));
+        obj.pushKV("stages", stages);
+        ret.pushKV(MempoolTxTypeName(type), obj);
+    }
+    return ret;
+}
+
 static UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -2717,6 +3682,135 @@ static inline bool SetHasKeys(const std::set<T>& set, const Tk& key, const Args&
 // outpoint (needed for the utxo index) + nHeight + fCoinBase
 static constexpr size_t PER_UTXO_OVERHEAD = sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
 
+static UniValue ConnectBlockPhaseToJSON(const ConnectBlockPhase& phase)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("time", phase.nTime);
+    ret.pushKV("count", phase.nCount);
+    return ret;
+}
+
+static std::vector<RPCResult> ConnectBlockPhaseDescription()
+{
+    return {
+        RPCResult{RPCResult::Type::NUM, "time", "Total time spent in microseconds"},
+        RPCResult{RPCResult::Type::NUM, "count", "Number of times the phase ran"},
+    };
+}
+
+static UniValue getvalidationstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            RPCHelpMan{"getvalidationstats",
+                "\nReturns the time spent in the Hydra specific phases of block connection since startup.\n"
+                "The per block values are logged with -debug=bench.\n",
+                {},
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "blocks", "The number of blocks connected"},
+                        {RPCResult::Type::OBJ, "extract", "Contract transaction extraction and gas checks", ConnectBlockPhaseDescription()},
+                        {RPCResult::Type::OBJ, "execute", "Contract execution", ConnectBlockPhaseDescription()},
+                        {RPCResult::Type::OBJ, "proxy_calls", "DGP, oracle and Economy contract calls", ConnectBlockPhaseDescription()},
+                        {RPCResult::Type::OBJ, "value_transfers", "Gas refund, value transfer and dividend bookkeeping", ConnectBlockPhaseDescription()},
+                        {RPCResult::Type::OBJ, "check_reward", "Block reward check", ConnectBlockPhaseDescription()},
+                        {RPCResult::Type::OBJ, "lydra", "LYDRA locked amount spending checks", ConnectBlockPhaseDescription()},
+                        {RPCResult::Type::OBJ, "receipts", "Receipt staging", ConnectBlockPhaseDescription()},
+                        {RPCResult::Type::OBJ, "state_root", "State root computation and commit", ConnectBlockPhaseDescription()},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getvalidationstats", "")
+            + HelpExampleRpc("getvalidationstats", "")
+                },
+            }.ToString());
+
+    ConnectBlockStats stats = GetConnectBlockStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("blocks", stats.nBlocks);
+    ret.pushKV("extract", ConnectBlockPhaseToJSON(stats.extract));
+    ret.pushKV("execute", ConnectBlockPhaseToJSON(stats.execute));
+    ret.pushKV("proxy_calls", ConnectBlockPhaseToJSON(stats.proxyCalls));
+    ret.pushKV("value_transfers", ConnectBlockPhaseToJSON(stats.valueTransfers));
+    ret.pushKV("check_reward", ConnectBlockPhaseToJSON(stats.checkReward));
+    ret.pushKV("lydra", ConnectBlockPhaseToJSON(stats.lydra));
+    ret.pushKV("receipts", ConnectBlockPhaseToJSON(stats.receipts));
+    ret.pushKV("state_root", ConnectBlockPhaseToJSON(stats.stateRoot));
+    return ret;
+}
+
+static UniValue getcontractprofile(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            RPCHelpMan{"getcontractprofile",
+                "\nReturns the contracts that used the most resources in the blocks connected with -contractprofile.\n"
+                "Gas, time and calls are counted under the contract a transaction calls or creates, storage\n"
+                "accesses under the contract that runs them.\n",
+                {
+                    {"count", RPCArg::Type::NUM, /* default */ "10", "The number of contracts to return"},
+                    {"sortby", RPCArg::Type::STR, /* default */ "time", "The value to sort by: time, gas, calls, reads or writes"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "blocks", "The number of blocks in the window"},
+                        {RPCResult::Type::NUM, "fromheight", "The height of the first block in the window"},
+                        {RPCResult::Type::NUM, "toheight", "The height of the last block in the window"},
+                        {RPCResult::Type::ARR, "contracts", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR_HEX, "address", "The contract address"},
+                                {RPCResult::Type::NUM, "gasused", "Gas used by the transactions to the contract"},
+                                {RPCResult::Type::NUM, "time", "Execution time of the transactions to the contract in microseconds"},
+                                {RPCResult::Type::NUM, "calls", "The number of transactions to the contract"},
+                                {RPCResult::Type::NUM, "storagereads", "The number of SLOAD the contract ran"},
+                                {RPCResult::Type::NUM, "storagewrites", "The number of SSTORE the contract ran"},
+                            }},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getcontractprofile", "")
+            + HelpExampleCli("getcontractprofile", "20 gas")
+            + HelpExampleRpc("getcontractprofile", "20, \"gas\"")
+                },
+            }.ToString());
+
+    if (!g_contract_profiler)
+        throw JSONRPCError(RPC_MISC_ERROR, "Contract profiling is not enabled, start with -contractprofile=<n>");
+
+    int count = request.params[0].isNull() ? 10 : request.params[0].get_int();
+    if (count < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+    std::string sortby = request.params[1].isNull() ? "time" : request.params[1].get_str();
+    if (sortby != "time" && sortby != "gas" && sortby != "calls" && sortby != "reads" && sortby != "writes")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid sortby " + sortby);
+
+    int nFirstHeight, nLastHeight;
+    size_t nBlocks;
+    g_contract_profiler->GetWindow(nFirstHeight, nLastHeight, nBlocks);
+
+    UniValue contracts(UniValue::VARR);
+    for (const auto& item : g_contract_profiler->GetTop(count, sortby)) {
+        UniValue contract(UniValue::VOBJ);
+        contract.pushKV("address", item.first.hex());
+        contract.pushKV("gasused", item.second.nGasUsed);
+        contract.pushKV("time", item.second.nTime);
+        contract.pushKV("calls", item.second.nCalls);
+        contract.pushKV("storagereads", item.second.nStorageReads);
+        contract.pushKV("storagewrites", item.second.nStorageWrites);
+        contracts.push_back(contract);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("blocks", (uint64_t)nBlocks);
+    ret.pushKV("fromheight", nFirstHeight);
+    ret.pushKV("toheight", nLastHeight);
+    ret.pushKV("contracts", contracts);
+    return ret;
+}
+
 static UniValue getblockstats(const JSONRPCRequest& request)
 {
     const RPCHelpMan help{"getblockstats",
@@ -3011,6 +4105,107 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            RPCHelpMan{"dumptxoutset",
+                "\nWrite the serialized UTXO set to disk, with the contract state roots of its base block.\n"
+                "Note this call may take some time.\n",
+                {
+                    {"path", RPCArg::Type::STR, RPCArg::Optional::NO, "Path to the output file. If relative, will be prefixed by datadir."},
+                },
+                RPCResult{
+                RPCResult::Type::OBJ, "", "",
+                {
+                    {RPCResult::Type::NUM, "coins_written", "The number of coins written in the snapshot"},
+                    {RPCResult::Type::STR_HEX, "base_hash", "The hash of the base of the snapshot"},
+                    {RPCResult::Type::NUM, "base_height", "The height of the base of the snapshot"},
+                    {RPCResult::Type::STR_HEX, "hash_serialized_2", "The serialized hash of the UTXO set"},
+                    {RPCResult::Type::STR_HEX, "hashstateroot", "The contract state root of the base block"},
+                    {RPCResult::Type::STR_HEX, "hashutxoroot", "The contract UTXO root of the base block"},
+                    {RPCResult::Type::STR, "path", "The absolute path that the snapshot was written to"},
+                }},
+                RPCExamples{
+                    HelpExampleCli("dumptxoutset", "utxo.dat")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+                },
+            }.ToString());
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    // Write to a temporary path and then move into `path` on completion
+    // to avoid confusion due to an interruption.
+    fs::path temppath = fs::absolute(request.params[0].get_str() + ".incomplete", GetDataDir());
+
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists. If you are sure this is what you want, move it out of the way first");
+    }
+
+    FILE* file{fsbridge::fopen(temppath, "wb")};
+    CAutoFile afile{file, SER_DISK, CLIENT_VERSION};
+    if (afile.IsNull()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open snapshot file " + temppath.string());
+    }
+
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    CCoinsStats stats;
+    const CBlockIndex* tip;
+    {
+        // We need to lock cs_main to ensure that the coinsdb isn't written to
+        // between (i) flushing coins cache to disk (coinsdb), (ii) getting stats
+        // based upon the coinsdb, and (iii) constructing a cursor to the
+        // coinsdb for use below this block.
+        LOCK(cs_main);
+        FlushStateToDisk();
+
+        if (!GetUTXOStats(pcoinsdbview.get(), stats)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
+        }
+
+        pcursor = std::unique_ptr<CCoinsViewCursor>(pcoinsdbview->Cursor());
+        tip = LookupBlockIndex(stats.hashBlock);
+        assert(tip);
+    }
+
+    SnapshotMetadata metadata;
+    metadata.m_base_blockhash = tip->GetBlockHash();
+    metadata.m_base_height = tip->nHeight;
+    metadata.m_coins_count = stats.nTransactionOutputs;
+    metadata.m_hash_serialized = stats.hashSerialized;
+    metadata.m_state_root = tip->hashStateRoot;
+    metadata.m_utxo_root = tip->hashUTXORoot;
+
+    afile << metadata;
+
+    COutPoint key;
+    Coin coin;
+    unsigned int iter{0};
+
+    while (pcursor->Valid()) {
+        if (iter % 5000 == 0) boost::this_thread::interruption_point();
+        ++iter;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            afile << key;
+            afile << coin;
+        }
+
+        pcursor->Next();
+    }
+
+    afile.fclose();
+    fs::rename(temppath, path);
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("coins_written", (int64_t)stats.nTransactionOutputs);
+    result.pushKV("base_hash", tip->GetBlockHash().ToString());
+    result.pushKV("base_height", tip->nHeight);
+    result.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+    result.pushKV("hashstateroot", tip->hashStateRoot.GetHex());
+    result.pushKV("hashutxoroot", tip->hashUTXORoot.GetHex());
+    result.pushKV("path", path.string());
+    return result;
+}
+
 //! Search for a given set of pubkey scripts
 bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
     scan_progress = 0;
@@ -3549,11 +4744,15 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getblockstats",          &getblockstats,          {"hash_or_height", "stats"} },
+    { "blockchain",         "getvalidationstats",     &getvalidationstats,     {} },
+    { "blockchain",         "getcontractprofile",     &getcontractprofile,     {"count", "sortby"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
     { "blockchain",         "getblockcount",          &getblockcount,          {} },
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
+    { "blockchain",         "getblockheaders",        &getblockheaders,        {"height","count","verbose"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash","filtertype"} },
     { "blockchain",         "getcontractcode",        &getcontractcode,        {"contract_address"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
@@ -3561,17 +4760,20 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
+    { "blockchain",         "getmempoolacceptstats",  &getmempoolacceptstats,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type"} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
-    { "blockchain",         "getaccountinfo",         &getaccountinfo,         {"contract_address"} },
-    { "blockchain",         "getstorage",             &getstorage,             {"address, index, blockNum"} },
+    { "blockchain",         "getaccountinfo",         &getaccountinfo,         {"contract_address","verbose"} },
+    { "blockchain",         "getstorage",             &getstorage,             {"address","blockNum","index","start","limit"} },
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
     { "blockchain",         "scantxoutset",           &scantxoutset,           {"action", "scanobjects"} },
     { "blockchain",         "callcontract",           &callcontract,           {"address","data", "senderAddress", "gasLimit", "amount"} },
+    { "blockchain",         "callcontractbatch",      &callcontractbatch,      {"calls"} },
     { "blockchain",         "hrc20name",              &qrc20name,              {"address"} },
     { "blockchain",         "hrc20symbol",            &qrc20symbol,            {"address"} },
     { "blockchain",         "hrc20totalsupply",       &qrc20totalsupply,       {"address"} },
@@ -3586,9 +4788,14 @@ static const CRPCCommand commands[] =
     { "hidden",             "waitforblock",           &waitforblock,           {"blockhash","timeout"} },
     { "hidden",             "waitforblockheight",     &waitforblockheight,     {"height","timeout"} },
     { "hidden",             "syncwithvalidationinterfacequeue", &syncwithvalidationinterfacequeue, {} },
-    { "blockchain",         "listcontracts",          &listcontracts,          {"start", "maxDisplay"} },
+    { "blockchain",         "listcontracts",          &listcontracts,          {"start", "maxDisplay", "verbose"} },
+    { "blockchain",         "listcontracttxs",        &listcontracttxs,        {"address", "sent", "fromBlock", "toBlock", "limit"} },
     { "blockchain",         "gettransactionreceipt",  &gettransactionreceipt,  {"hash"} },
-    { "blockchain",         "searchlogs",             &searchlogs,             {"fromBlock", "toBlock", "address", "topics"} },
+    { "blockchain",         "getblockreceipts",       &getblockreceipts,       {"hash_or_height"} },
+    { "blockchain",         "getreceiptroot",         &getreceiptroot,         {"hash_or_height"} },
+    { "blockchain",         "getreceiptproof",        &getreceiptproof,        {"txids", "blockhash"} },
+    { "blockchain",         "verifyreceiptproof",     &verifyreceiptproof,     {"proof"} },
+    { "blockchain",         "searchlogs",             &searchlogs,             {"fromBlock", "toBlock", "address", "topics", "minconf", "limit", "cursor"} },
     { "blockchain",         "waitforlogs",            &waitforlogs,            {"fromBlock", "nblocks", "address", "topics"} },
     { "blockchain",         "getestimatedannualroi",  &getestimatedannualroi,  {} },
     { "blockchain",         "getdelegationinfoforaddress",  &getdelegationinfoforaddress,  {"address"} },
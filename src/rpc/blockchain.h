@@ -14,6 +14,10 @@ class CBlockIndex;
 class UniValue;
 
 static constexpr int NUM_GETBLOCKSTATS_PERCENTILES = 5;
+/** Maximum number of headers getblockheaders and /rest/headers return */
+static constexpr int MAX_HEADERS_RANGE = 2000;
+/** Number of headers a batch thread formats at a time */
+static constexpr size_t HEADERS_JSON_CHUNK_SIZE = 100;
 
 /**
  * Get the difficulty of the net wrt to the given block index.
@@ -38,6 +42,9 @@ UniValue mempoolToJSON(bool fVerbose = false);
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex* tip, const CBlockIndex* blockindex);
 
+/** Block headers to a JSON array, formatted in parallel on the batch threads. The lock of the chain is not needed */
+UniValue blockheadersToJSON(const CBlockIndex* tip, const std::vector<const CBlockIndex*>& headers);
+
 /** Used by getblockstats to get feerates at different percentiles by weight  */
 void CalculatePercentilesByWeight(CAmount result[NUM_GETBLOCKSTATS_PERCENTILES], std::vector<std::pair<CAmount, int64_t>>& scores, int64_t total_weight);
 
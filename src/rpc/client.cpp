@@ -96,6 +96,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "searchlogs", 2, "address"},
     { "searchlogs", 3, "topics"},
     { "searchlogs", 4, "minconf"},
+    { "searchlogs", 5, "limit"},
     { "waitforlogs", 0, "fromBlock"},
     { "waitforlogs", 1, "txlimit"},
     { "waitforlogs", 2, "address"},
@@ -114,7 +115,11 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblock", 1, "verbosity" },
     { "getblock", 1, "verbose" },
     { "getblockheader", 1, "verbose" },
+    { "getblockheaders", 0, "height" },
+    { "getblockheaders", 1, "count" },
+    { "getblockheaders", 2, "verbose" },
     { "getchaintxstats", 0, "nblocks" },
+    { "getcontractprofile", 0, "count" },
     { "gettransaction", 1, "include_watchonly" },
     { "gettransaction", 2, "waitconf" },
     { "getrawtransaction", 1, "verbose" },
@@ -165,10 +170,14 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "verifychain", 1, "nblocks" },
     { "getblockstats", 0, "hash_or_height" },
     { "getblockstats", 1, "stats" },
+    { "getblockreceipts", 0, "hash_or_height" },
+    { "getreceiptroot", 0, "hash_or_height" },
+    { "getreceiptproof", 0, "txids" },
     { "pruneblockchain", 0, "height" },
     { "keypoolrefill", 0, "newsize" },
     { "getrawmempool", 0, "verbose" },
     { "estimatesmartfee", 0, "conf_target" },
+    { "estimategasprice", 0, "conf_target" },
     { "estimaterawfee", 0, "conf_target" },
     { "estimaterawfee", 1, "threshold" },
     { "prioritisetransaction", 1, "dummy" },
@@ -181,6 +190,9 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "bumpfee", 1, "options" },
     { "logging", 0, "include" },
     { "logging", 1, "exclude" },
+    { "setlockprofiling", 0, "enable" },
+    { "setlockprofiling", 1, "allmutexes" },
+    { "getlockprofile", 0, "count" },
     { "disconnectnode", 1, "nodeid" },
     { "createcontract", 1, "gasLimit" },
     { "createcontract", 3, "broadcast" },
@@ -208,12 +220,20 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "hrc20burnfrom", 5, "checkOutputs" },
     { "callcontract", 3, "gasLimit" },
     { "callcontract", 4, "amount" },
+    { "callcontractbatch", 0, "calls" },
     { "reservebalance", 0, "reserve"},
     { "reservebalance", 1, "amount"},
+    { "listcontracttxs", 1, "sent" },
+    { "listcontracttxs", 2, "fromBlock" },
+    { "listcontracttxs", 3, "toBlock" },
+    { "listcontracttxs", 4, "limit" },
     { "listcontracts", 0, "start" },
     { "listcontracts", 1, "maxDisplay" },
+    { "listcontracts", 2, "verbose" },
     { "getstorage", 2, "index" },
     { "getstorage", 1, "blockNum" },
+    { "getstorage", 4, "limit" },
+    { "getaccountinfo", 1, "verbose" },
     // Echo with conversion (For testing only)
     { "echojson", 0, "arg0" },
     { "echojson", 1, "arg1" },
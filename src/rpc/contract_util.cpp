@@ -1,8 +1,12 @@
 #include <rpc/contract_util.h>
+#include <rpc/jsonstream.h>
 #include <rpc/util.h>
 #include <util/system.h>
 #include <key_io.h>
 #include <rpc/server.h>
+#include <streams.h>
+#include <util/strencodings.h>
+#include <version.h>
 
 UniValue executionResultToJSON(const dev::eth::ExecutionResult& exRes)
 {
@@ -45,10 +49,15 @@ UniValue transactionReceiptToJSON(const QtumTransactionReceipt& txRec)
     return result;
 }
 
-UniValue CallToContract(const UniValue& params)
+UniValue CallToContract(const UniValue& params, ContractCallClass cls)
 {
-    LOCK(cs_main);
+    ContractCallSnapshot snapshot;
+    TakeContractCallSnapshot(snapshot);
+    return CallToContract(snapshot, params, cls);
+}
 
+UniValue CallToContract(const ContractCallSnapshot& snapshot, const UniValue& params, ContractCallClass cls)
+{
     std::string strAddr = params[0].get_str();
     std::string data = params[1].get_str();
 
@@ -62,7 +71,7 @@ UniValue CallToContract(const UniValue& params)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Incorrect address");
 
         addrAccount = dev::Address(strAddr);
-        if(!globalState->addressInUse(addrAccount))
+        if(!snapshot.state->addressInUse(addrAccount))
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Address does not exist");
     }
 
@@ -90,9 +99,13 @@ UniValue CallToContract(const UniValue& params)
     }
 
 
-    std::vector<ResultExecute> execResults = CallContract(addrAccount, ParseHex(data), senderAddress, gasLimit, 0, nAmount);
+    std::vector<ResultExecute> execResults;
+    std::string error;
+    if (!RunContractCall(cls, [&] { execResults = CallContractOnSnapshot(snapshot, addrAccount, ParseHex(data), senderAddress, gasLimit, nAmount); }, error))
+        throw JSONRPCError(RPC_MISC_ERROR, error);
 
     if(fRecordLogOpcodes){
+        LOCK(cs_main);
         writeVMlog(execResults);
     }
 
@@ -150,6 +163,26 @@ void transactionReceiptInfoToJSON(const TransactionReceiptInfo& resExec, UniValu
     entry.pushKV("log", logEntries);
 }
 
+std::vector<std::pair<uint256, std::vector<TransactionReceiptInfo>>> ReadBlockReceipts(const CBlock& block)
+{
+    std::vector<uint256> txids;
+    std::vector<dev::h256> hashes;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (tx->HasCreateOrCall()) {
+            txids.push_back(tx->GetHash());
+            hashes.push_back(uintToh256(tx->GetHash()));
+        }
+    }
+
+    std::vector<std::vector<TransactionReceiptInfo>> results = pstorageresult->readCommittedResults(hashes);
+    std::vector<std::pair<uint256, std::vector<TransactionReceiptInfo>>> receipts;
+    for (size_t i = 0; i < txids.size(); i++) {
+        if (!results[i].empty())
+            receipts.emplace_back(txids[i], std::move(results[i]));
+    }
+    return receipts;
+}
+
 size_t parseUInt(const UniValue& val, size_t defaultVal) {
     if (val.isNull()) {
         return defaultVal;
@@ -308,28 +341,260 @@ private:
 
 };
 
-UniValue SearchLogs(const UniValue& _params)
+/** A receipt matches when one of its logs carries any of the topics at its position */
+static bool ReceiptMatchesTopics(const TransactionReceiptInfo& receipt, const std::vector<boost::optional<dev::h256>>& topics)
+{
+    if (topics.empty()) {
+        return true;
+    }
+
+    for (size_t i = 0; i < topics.size(); i++) {
+        const auto& tc = topics[i];
+
+        if (!tc) {
+            continue;
+        }
+
+        for (const auto& log: receipt.logs) {
+            if (i >= log.topics.size()) {
+                continue;
+            }
+
+            if (tc.get() == log.topics[i]) {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+/** Number of blocks of the height index read under cs_main at a time by a paginated search */
+static const int SEARCHLOGS_WINDOW = 1000;
+
+static std::string EncodeSearchLogsCursor(int height, size_t skip)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << height << uint64_t(skip);
+    return HexStr(ss.begin(), ss.end());
+}
+
+static void DecodeSearchLogsCursor(const std::string& cursor, int& height, size_t& skip)
+{
+    if (!IsHex(cursor)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    std::vector<unsigned char> data(ParseHex(cursor));
+    CDataStream ss(data, SER_NETWORK, PROTOCOL_VERSION);
+    uint64_t skip64;
+    try {
+        ss >> height >> skip64;
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    if (height < 0 || !ss.empty()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    skip = skip64;
+}
+
+bool SearchLogsPage(int toBlock, int minconf, const std::set<dev::h160>& addresses, const std::vector<boost::optional<dev::h256>>& topics,
+        size_t limit, int& height, size_t& skip, std::vector<TransactionReceiptInfo>& receipts)
+{
+    receipts.clear();
+    if (!fLogEvents || height < 0) {
+        return false;
+    }
+
+    // A log matches when any of the topics is found at its position
+    std::vector<dev::h256> bloomTopics;
+    for (const auto& topic : topics) {
+        if (topic) {
+            bloomTopics.push_back(topic.get());
+        }
+    }
+
+    // The height index is read one window at a time under cs_main and the receipts
+    // of each window are read without it, until limit receipts are found
+    while (true) {
+        std::vector<std::vector<uint256>> hashesToBlock;
+        int windowEnd;
+        {
+            LOCK(cs_main);
+            int maxHeight = chainActive.Height() - minconf;
+            if (toBlock > -1 && toBlock < maxHeight) {
+                maxHeight = toBlock;
+            }
+            if (height > maxHeight) {
+                break;
+            }
+            windowEnd = std::min(maxHeight, height + SEARCHLOGS_WINDOW - 1);
+
+            // The topic index only holds the transactions with a matching log, use it when it covers the window
+            int topicIndexStart;
+            if (fLogTopicIndex && !bloomTopics.empty() &&
+                    pblocktree->ReadTopicIndexStart(topicIndexStart) && height >= topicIndexStart) {
+                std::map<std::pair<unsigned int, dev::h160>, std::vector<uint256>> hashesByBlock;
+                for (const dev::h256& topic : bloomTopics) {
+                    if (!pblocktree->ReadTopicIndex(topic, height, windowEnd, 0, hashesByBlock, addresses)) {
+                        return false;
+                    }
+                }
+                for (const auto& e : hashesByBlock) {
+                    hashesToBlock.push_back(e.second);
+                }
+            } else if (pblocktree->ReadHeightIndex(height, windowEnd, 0, hashesToBlock, addresses, bloomTopics, false) == -1) {
+                return false;
+            }
+        }
+
+        int receiptsHeight = -1;
+        size_t receiptsAtHeight = 0;
+        std::set<uint256> dupes;
+        for (const auto& hashesTx : hashesToBlock) {
+            for (const auto& e : hashesTx) {
+                if (!dupes.insert(e).second) {
+                    continue;
+                }
+
+                for (const auto& receipt : pstorageresult->readCommittedResult(uintToh256(e))) {
+                    if (receipt.logs.empty() || !ReceiptMatchesTopics(receipt, topics)) {
+                        continue;
+                    }
+
+                    if ((int)receipt.blockNumber != receiptsHeight) {
+                        receiptsHeight = receipt.blockNumber;
+                        receiptsAtHeight = 0;
+                    }
+                    receiptsAtHeight++;
+                    if (receiptsHeight == height && receiptsAtHeight <= skip) {
+                        continue;
+                    }
+
+                    if (receipts.size() == limit) {
+                        // The page is full, resume from this receipt
+                        height = receiptsHeight;
+                        skip = receiptsAtHeight - 1;
+                        return true;
+                    }
+                    receipts.push_back(receipt);
+                }
+            }
+        }
+
+        height = windowEnd + 1;
+        skip = 0;
+    }
+
+    height = -1;
+    skip = 0;
+    return true;
+}
+
+UniValue SearchLogs(const UniValue& _params, JSONStreamWriter* writer)
 {
     if(!fLogEvents)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Events indexing disabled");
 
     int curheight = 0;
 
-    LOCK(cs_main);
-
     SearchLogsParams params(_params);
+    int fromBlock = params.fromBlock;
+    int toBlock = params.toBlock;
+
+    size_t limit = parseUInt(_params[5], 0);
+
+    // A log matches when any of the topics is found at its position
+    std::vector<dev::h256> bloomTopics;
+    for (const auto& topic : params.topics) {
+        if (topic) {
+            bloomTopics.push_back(topic.get());
+        }
+    }
+
+    auto topics = params.topics;
+
+    if (limit > 0) {
+        // Paginated search, resumed from the cursor of the previous page
+        int height = fromBlock;
+        size_t skip = 0;
+        if (_params.size() > 6 && !_params[6].isNull()) {
+            DecodeSearchLogsCursor(_params[6].get_str(), height, skip);
+        }
+
+        std::vector<TransactionReceiptInfo> receipts;
+        if (!SearchLogsPage(toBlock, params.minconf, params.addresses, topics, limit, height, skip, receipts)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect params");
+        }
+
+        UniValue cursor = NullUniValue;
+        if (height != -1) {
+            cursor = EncodeSearchLogsCursor(height, skip);
+        }
+        if (writer) {
+            writer->BeginObject();
+            writer->Key("entries");
+            writer->BeginArray();
+        }
+        UniValue entries(UniValue::VARR);
+        for (const auto& receipt : receipts) {
+            UniValue tri(UniValue::VOBJ);
+            transactionReceiptInfoToJSON(receipt, tri);
+            if (writer) {
+                writer->Value(tri);
+            } else {
+                entries.push_back(tri);
+            }
+        }
+        if (writer) {
+            writer->EndArray();
+            writer->Key("cursor");
+            writer->Value(cursor);
+            writer->EndObject();
+            return NullUniValue;
+        }
+
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("entries", entries);
+        result.pushKV("cursor", cursor);
+        return result;
+    }
 
     std::vector<std::vector<uint256>> hashesToBlock;
+    {
+        LOCK(cs_main);
+
+        // The topic index only holds the transactions with a matching log, use it when it covers the whole range
+        int topicIndexStart;
+        if (fLogTopicIndex && !bloomTopics.empty() && fromBlock >= 0 &&
+                pblocktree->ReadTopicIndexStart(topicIndexStart) && fromBlock >= topicIndexStart) {
+            if ((toBlock < fromBlock && toBlock > -1) || (toBlock == 0 && fromBlock == 0) || toBlock < -1) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect params");
+            }
 
-    curheight = pblocktree->ReadHeightIndex(params.fromBlock, params.toBlock, params.minconf, hashesToBlock, params.addresses);
+            std::map<std::pair<unsigned int, dev::h160>, std::vector<uint256>> hashesByBlock;
+            for (const dev::h256& topic : bloomTopics) {
+                if (!pblocktree->ReadTopicIndex(topic, fromBlock, toBlock, params.minconf, hashesByBlock, params.addresses)) {
+                    throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read topic index");
+                }
+            }
+            for (const auto& e : hashesByBlock) {
+                hashesToBlock.push_back(e.second);
+            }
+        } else {
+            curheight = pblocktree->ReadHeightIndex(params.fromBlock, params.toBlock, params.minconf, hashesToBlock, params.addresses, bloomTopics, false);
 
-    if (curheight == -1) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect params");
+            if (curheight == -1) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect params");
+            }
+        }
     }
 
+    // Receipts of connected blocks are committed, read them without holding cs_main
     UniValue result(UniValue::VARR);
-
-    auto topics = params.topics;
+    if (writer) {
+        writer->BeginArray();
+    }
 
     std::set<uint256> dupes;
 
@@ -343,47 +608,33 @@ UniValue SearchLogs(const UniValue& _params)
             }
             dupes.insert(e);
 
-            std::vector<TransactionReceiptInfo> receipts = pstorageresult->getResult(uintToh256(e));
+            std::vector<TransactionReceiptInfo> receipts = pstorageresult->readCommittedResult(uintToh256(e));
 
             for(const auto& receipt : receipts) {
                 if(receipt.logs.empty()) {
                     continue;
                 }
 
-                if (!topics.empty()) {
-                    for (size_t i = 0; i < topics.size(); i++) {
-                        const auto& tc = topics[i];
-
-                        if (!tc) {
-                            continue;
-                        }
-
-                        for (const auto& log: receipt.logs) {
-                            auto filterTopicContent = tc.get();
-
-                            if (i >= log.topics.size()) {
-                                continue;
-                            }
-
-                            if (filterTopicContent == log.topics[i]) {
-                                goto push;
-                            }
-                        }
-                    }
-
-                    // Skip the log if none of the topics are matched
+                // Skip the log if none of the topics are matched
+                if (!ReceiptMatchesTopics(receipt, topics)) {
                     continue;
                 }
 
-            push:
-
                 UniValue tri(UniValue::VOBJ);
                 transactionReceiptInfoToJSON(receipt, tri);
-                result.push_back(tri);
+                if (writer) {
+                    writer->Value(tri);
+                } else {
+                    result.push_back(tri);
+                }
             }
         }
     }
 
+    if (writer) {
+        writer->EndArray();
+        return NullUniValue;
+    }
     return result;
 }
 
@@ -469,49 +720,164 @@ bool CallToken::exec(const bool &sendTo, const std::map<std::string, std::string
     return true;
 }
 
+/**
+ * Decoded token events of one query (contract, event, sender and number of topics) for the
+ * blocks from fromBlock to pindexEnd, a block of the active chain when the entry was filled.
+ * Wallets query the same events over overlapping ranges, like the last blocks on each new
+ * block, so only the blocks after the cached range are searched and decoded again.
+ */
+struct TokenEventCacheEntry {
+    int fromBlock = 0;
+    const CBlockIndex* pindexEnd = nullptr;
+    std::vector<TokenEvent> events;
+};
+
+/** Bound on the cached queries, the cache is cleared when it is reached */
+static const size_t MAX_TOKEN_EVENT_QUERIES = 100;
+
+/** Receipts read from SearchLogsPage at a time when the cache is filled */
+static const size_t TOKEN_EVENT_PAGE = 1000;
+
+static Mutex cs_tokenEventCache;
+static std::map<std::string, TokenEventCacheEntry> g_token_event_cache GUARDED_BY(cs_tokenEventCache);
+
+/** The topics filter of the token events, the event type is not checked by the search */
+static UniValue TokenTxTopics(const std::string &senderAddress, const int &numTopics)
+{
+    UniValue topics(UniValue::VARR);
+    // Skip the event type check
+    static std::string nullRecord = uint256().ToString();
+    topics.push_back(nullRecord);
+    if(numTopics > 1)
+    {
+        // Match the log with sender address
+        topics.push_back(senderAddress);
+    }
+    if(numTopics > 2)
+    {
+        // Match the log with receiver address
+        topics.push_back(senderAddress);
+    }
+    return topics;
+}
+
+/** Decode the token events of a receipt found by the search */
+static void DecodeTokenEvents(const TransactionReceiptInfo& receipt, const std::string &eventName, const int &numTopics, std::vector<TokenEvent> &events)
+{
+    for(const dev::eth::LogEntry& log : receipt.logs)
+    {
+        // Skip the not needed events
+        if(log.topics.empty() || log.topics.size() < (size_t)numTopics) continue;
+        if(log.topics[0].hex() != eventName) continue;
+
+        // Create new event
+        TokenEvent tokenEvent;
+        tokenEvent.address = receipt.contractAddress.hex();
+        if(numTopics > 1)
+        {
+            tokenEvent.sender = log.topics[1].hex().substr(24);
+            QtumToken::ToQtumAddress(tokenEvent.sender, tokenEvent.sender);
+        }
+        if(numTopics > 2)
+        {
+            tokenEvent.receiver = log.topics[2].hex().substr(24);
+            QtumToken::ToQtumAddress(tokenEvent.receiver, tokenEvent.receiver);
+        }
+        tokenEvent.blockHash = receipt.blockHash;
+        tokenEvent.blockNumber = receipt.blockNumber;
+        tokenEvent.transactionHash = receipt.transactionHash;
+
+        // Parse data
+        tokenEvent.value = QtumToken::ToUint256(HexStr(log.data));
+
+        events.push_back(tokenEvent);
+    }
+}
+
 bool CallToken::execEvents(const int64_t &fromBlock, const int64_t &toBlock, const int64_t& minconf, const std::string &eventName, const std::string &contractAddress, const std::string &senderAddress, const int &numTopics, std::vector<TokenEvent> &result)
 {
-    UniValue resultVar;
-    if(!searchTokenTx(fromBlock, toBlock, minconf, eventName, contractAddress, senderAddress, numTopics, resultVar))
-        return false;
+    if(!fLogEvents)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Events indexing disabled");
+
+    if((toBlock < fromBlock && toBlock > -1) || (toBlock == 0 && fromBlock == 0) || fromBlock < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect params");
+
+    // The same filter as searchTokenTx
+    std::set<dev::h160> addresses;
+    parseParam(UniValue(contractAddress), addresses);
+    std::vector<boost::optional<dev::h256>> topics;
+    parseParam(TokenTxTopics(senderAddress, numTopics), topics);
+    std::string key = contractAddress + eventName + senderAddress + std::to_string(numTopics);
 
-    const UniValue& list = resultVar.get_array();
-    for(size_t i = 0; i < list.size(); i++)
+    TokenEventCacheEntry entry;
     {
-        // Search the log for events
-        const UniValue& eventMap = list[i].get_obj();
-        const UniValue& listLog = eventMap["log"].get_array();
-        for(size_t i = 0; i < listLog.size(); i++)
+        LOCK(cs_tokenEventCache);
+        auto it = g_token_event_cache.find(key);
+        if(it != g_token_event_cache.end())
+            entry = it->second;
+    }
+
+    int endHeight;
+    const CBlockIndex* pindexEnd;
+    {
+        LOCK(cs_main);
+        endHeight = chainActive.Height() - (int)minconf;
+        if(toBlock > -1 && toBlock < endHeight)
+            endHeight = toBlock;
+        if(endHeight < fromBlock)
+            return true;
+        pindexEnd = chainActive[endHeight];
+
+        // Drop the events of the blocks disconnected since the entry was filled
+        if(entry.pindexEnd && !chainActive.Contains(entry.pindexEnd))
         {
-            // Skip the not needed events
-            const UniValue& eventLog = listLog[i].get_obj();
-            const UniValue& topicsList = eventLog["topics"].get_array();
-            if(topicsList.size() < (size_t)numTopics) continue;
-            if(topicsList[0].get_str() != eventName) continue;
-
-            // Create new event
-            TokenEvent tokenEvent;
-            tokenEvent.address = eventMap["contractAddress"].get_str();
-            if(numTopics > 1)
-            {
-                tokenEvent.sender = topicsList[1].get_str().substr(24);
-                ToQtumAddress(tokenEvent.sender, tokenEvent.sender);
-            }
-            if(numTopics > 2)
-            {
-                tokenEvent.receiver = topicsList[2].get_str().substr(24);
-                ToQtumAddress(tokenEvent.receiver, tokenEvent.receiver);
-            }
-            tokenEvent.blockHash = uint256S(eventMap["blockHash"].get_str());
-            tokenEvent.blockNumber = eventMap["blockNumber"].get_int64();
-            tokenEvent.transactionHash = uint256S(eventMap["transactionHash"].get_str());
+            const CBlockIndex* pfork = chainActive.FindFork(entry.pindexEnd);
+            int forkHeight = pfork ? pfork->nHeight : -1;
+            entry.events.erase(std::remove_if(entry.events.begin(), entry.events.end(), [forkHeight](const TokenEvent& event) {
+                return (int64_t)event.blockNumber > forkHeight;
+            }), entry.events.end());
+            entry.pindexEnd = forkHeight >= entry.fromBlock ? pfork : nullptr;
+        }
+    }
 
-            // Parse data
-            std::string data = eventLog["data"].get_str();
-            tokenEvent.value = ToUint256(data);
+    // Extend the cached range when the query starts inside it or right after it, start over otherwise
+    int height;
+    if(entry.pindexEnd && fromBlock >= entry.fromBlock && fromBlock <= entry.pindexEnd->nHeight + 1)
+    {
+        height = entry.pindexEnd->nHeight + 1;
+    }
+    else
+    {
+        entry = TokenEventCacheEntry();
+        entry.fromBlock = fromBlock;
+        height = fromBlock;
+    }
 
-            result.push_back(tokenEvent);
+    if(height <= endHeight)
+    {
+        size_t skip = 0;
+        std::vector<TransactionReceiptInfo> receipts;
+        while(height != -1)
+        {
+            if(!SearchLogsPage(endHeight, 0, addresses, topics, TOKEN_EVENT_PAGE, height, skip, receipts))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Incorrect params");
+            for(const TransactionReceiptInfo& receipt : receipts)
+                DecodeTokenEvents(receipt, eventName, numTopics, entry.events);
         }
+        entry.pindexEnd = pindexEnd;
+    }
+
+    for(const TokenEvent& event : entry.events)
+    {
+        if((int64_t)event.blockNumber >= fromBlock && (int64_t)event.blockNumber <= endHeight)
+            result.push_back(event);
+    }
+
+    {
+        LOCK(cs_tokenEventCache);
+        if(g_token_event_cache.size() >= MAX_TOKEN_EVENT_QUERIES && !g_token_event_cache.count(key))
+            g_token_event_cache.clear();
+        g_token_event_cache[key] = std::move(entry);
     }
 
     return true;
@@ -529,22 +895,8 @@ bool CallToken::searchTokenTx(const int64_t &fromBlock, const int64_t &toBlock,
     addressesObj.pushKV("addresses", addresses);
     params.push_back(addressesObj);
 
-    UniValue topics(UniValue::VARR);
-    // Skip the event type check
-    static std::string nullRecord = uint256().ToString();
-    topics.push_back(nullRecord);
-    if(numTopics > 1)
-    {
-        // Match the log with sender address
-        topics.push_back(senderAddress);
-    }
-    if(numTopics > 2)
-    {
-        // Match the log with receiver address
-        topics.push_back(senderAddress);
-    }
     UniValue topicsObj(UniValue::VOBJ);
-    topicsObj.pushKV("topics", topics);
+    topicsObj.pushKV("topics", TokenTxTopics(senderAddress, numTopics));
     params.push_back(topicsObj);
 
     params.push_back(minconf);
@@ -3,11 +3,28 @@
 
 #include <univalue.h>
 #include <validation.h>
+#include <qtum/contractexecutor.h>
 #include <qtum/qtumtoken.h>
 
-UniValue CallToContract(const UniValue& params);
+class JSONStreamWriter;
 
-UniValue SearchLogs(const UniValue& params);
+/** Run a read-only contract call on the EVM workers at the priority of cls */
+UniValue CallToContract(const UniValue& params, ContractCallClass cls = ContractCallClass::RPC);
+
+/** Same as CallToContract, but on a snapshot taken before so that many calls see the same state */
+UniValue CallToContract(const ContractCallSnapshot& snapshot, const UniValue& params, ContractCallClass cls = ContractCallClass::RPC);
+
+/** Search logs. With writer the result is written into it one receipt at a time and NullUniValue is returned. */
+UniValue SearchLogs(const UniValue& params, JSONStreamWriter* writer = nullptr);
+
+/**
+ * Read a page of at most limit receipts with logs matching the addresses and topics, in block order up to
+ * toBlock (-1 for the tip) and minconf confirmations. The page starts at block height, after the first skip
+ * matching receipts of that block; height and skip are moved to resume after the page, height is -1 when
+ * the search is complete. Uses the topic index for the blocks it covers. Needs -logevents.
+ */
+bool SearchLogsPage(int toBlock, int minconf, const std::set<dev::h160>& addresses, const std::vector<boost::optional<dev::h256>>& topics,
+        size_t limit, int& height, size_t& skip, std::vector<TransactionReceiptInfo>& receipts);
 
 void assignJSON(UniValue& entry, const TransactionReceiptInfo& resExec);
 
@@ -16,6 +33,9 @@ void assignJSON(UniValue& logEntry, const dev::eth::LogEntry& log,
 
 void transactionReceiptInfoToJSON(const TransactionReceiptInfo& resExec, UniValue& entry);
 
+/** Read the receipts of the contract transactions of a block in one pass, listed by transaction hash. Needs -logevents. */
+std::vector<std::pair<uint256, std::vector<TransactionReceiptInfo>>> ReadBlockReceipts(const CBlock& block);
+
 size_t parseUInt(const UniValue& val, size_t defaultVal);
 
 int parseBlockHeight(const UniValue& val, int defaultVal);
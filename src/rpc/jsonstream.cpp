@@ -0,0 +1,64 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/jsonstream.h>
+
+#include <assert.h>
+
+void JSONStreamWriter::Separate()
+{
+    if (m_after_key) {
+        m_after_key = false;
+        return;
+    }
+    if (!m_empty.empty()) {
+        if (!m_empty.back()) {
+            m_out.push_back(',');
+        }
+        m_empty.back() = false;
+    }
+}
+
+void JSONStreamWriter::BeginObject()
+{
+    Separate();
+    m_out.push_back('{');
+    m_empty.push_back(true);
+}
+
+void JSONStreamWriter::EndObject()
+{
+    assert(!m_empty.empty() && !m_after_key);
+    m_empty.pop_back();
+    m_out.push_back('}');
+}
+
+void JSONStreamWriter::BeginArray()
+{
+    Separate();
+    m_out.push_back('[');
+    m_empty.push_back(true);
+}
+
+void JSONStreamWriter::EndArray()
+{
+    assert(!m_empty.empty() && !m_after_key);
+    m_empty.pop_back();
+    m_out.push_back(']');
+}
+
+void JSONStreamWriter::Key(const std::string& key)
+{
+    assert(!m_after_key);
+    Separate();
+    m_out += UniValue(key).write();
+    m_out.push_back(':');
+    m_after_key = true;
+}
+
+void JSONStreamWriter::Value(const UniValue& value)
+{
+    Separate();
+    m_out += value.write();
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <univalue.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * Writes JSON straight into a string, so that large RPC results like verbose blocks
+ * and receipt lists do not need a UniValue tree of the whole result. Elements that are
+ * already UniValues, like a single transaction, are written with Value.
+ */
+class JSONStreamWriter
+{
+public:
+    explicit JSONStreamWriter(std::string& out) : m_out(out) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    /** Start the next member of the current object, followed by its value */
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+
+    /** Write the members of obj, with the value of member key written by write_value instead */
+    template <typename F>
+    void ObjectWithMember(const UniValue& obj, const std::string& key, F write_value)
+    {
+        BeginObject();
+        const std::vector<std::string>& keys = obj.getKeys();
+        const std::vector<UniValue>& values = obj.getValues();
+        for (size_t i = 0; i < keys.size(); i++) {
+            Key(keys[i]);
+            if (keys[i] == key) {
+                write_value();
+            } else {
+                Value(values[i]);
+            }
+        }
+        EndObject();
+    }
+
+private:
+    void Separate();
+
+    std::string& m_out;
+    //! Whether the innermost open object or array has no element yet
+    std::vector<bool> m_empty;
+    bool m_after_key = false;
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
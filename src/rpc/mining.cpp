@@ -35,6 +35,8 @@
 #include <wallet/walletdb.h>
 #include <wallet/rpcwallet.h>
 #endif
+#include <algorithm>
+#include <deque>
 #include <memory>
 #include <stdint.h>
 
@@ -297,6 +299,24 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
     return obj;
 }
 
+static std::vector<RPCResult> StakerTimingDescription()
+{
+    return {
+        {RPCResult::Type::NUM, "count", "The number of times it ran"},
+        {RPCResult::Type::NUM, "average", "Average time"},
+        {RPCResult::Type::NUM, "last", "Time of the last run"},
+    };
+}
+
+static UniValue StakerTimingToJSON(uint64_t nCount, int64_t nTotal, int64_t nLast)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("count", nCount);
+    ret.pushKV("average", nCount ? nTotal / (int64_t)nCount : 0);
+    ret.pushKV("last", nLast);
+    return ret;
+}
+
 static UniValue getstakinginfo(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 0)
@@ -316,6 +336,16 @@ static UniValue getstakinginfo(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM, "weight", "The staker weight"},
                         {RPCResult::Type::NUM, "netstakeweight", "Network stake weight"},
                         {RPCResult::Type::NUM, "expectedtime", "Expected time to earn reward"},
+                        {RPCResult::Type::OBJ, "performance", "Performance of the staker of the wallet since startup, times in microseconds",
+                        {
+                            {RPCResult::Type::NUM, "kernelchecks", "Kernel hashes checked"},
+                            {RPCResult::Type::NUM, "kernelspersecond", "Kernel hashes checked per second of kernel search"},
+                            {RPCResult::Type::OBJ, "cachedata", "Refreshes of the staking coins after a tip change", StakerTimingDescription()},
+                            {RPCResult::Type::OBJ, "createblock", "Block templates built for a solved slot", StakerTimingDescription()},
+                            {RPCResult::Type::OBJ, "signblock", "Signatures of the filled blocks", StakerTimingDescription()},
+                            {RPCResult::Type::OBJ, "tipdelay", "Delay from a tip change to the first kernel search on it", StakerTimingDescription()},
+                            {RPCResult::Type::NUM, "missedslots", "Slots at the same tip that passed without a kernel search"},
+                        }},
                     }
                 },
                 RPCExamples{
@@ -330,6 +360,7 @@ static UniValue getstakinginfo(const JSONRPCRequest& request)
     uint64_t nStakerWeight = 0;
     uint64_t nDelegateWeight = 0;
     uint64_t lastCoinStakeSearchInterval = 0;
+    UniValue performance(UniValue::VOBJ);
 #ifdef ENABLE_WALLET
     std::shared_ptr<CWallet> const wallet = GetWalletForJSONRPCRequest(request);
     CWallet* const pwallet = wallet.get();
@@ -339,6 +370,16 @@ static UniValue getstakinginfo(const JSONRPCRequest& request)
         auto locked_chain = pwallet->chain().lock();
         nWeight = pwallet->GetStakeWeight(*locked_chain, &nStakerWeight, &nDelegateWeight);
         lastCoinStakeSearchInterval = pwallet->m_last_coin_stake_search_interval;
+
+        const StakerStats& stats = pwallet->m_staker_stats;
+        int64_t nKernelTime = stats.nKernelTime;
+        performance.pushKV("kernelchecks", stats.nKernelChecks.load());
+        performance.pushKV("kernelspersecond", nKernelTime > 0 ? stats.nKernelChecks * 1000000.0 / nKernelTime : 0.0);
+        performance.pushKV("cachedata", StakerTimingToJSON(stats.nUpdates, stats.nUpdateTime, stats.nLastUpdateTime));
+        performance.pushKV("createblock", StakerTimingToJSON(stats.nTemplates, stats.nTemplateTime, stats.nLastTemplateTime));
+        performance.pushKV("signblock", StakerTimingToJSON(stats.nSignatures, stats.nSignTime, stats.nLastSignTime));
+        performance.pushKV("tipdelay", StakerTimingToJSON(stats.nTipScans, stats.nTipDelayTime, stats.nLastTipDelay));
+        performance.pushKV("missedslots", stats.nMissedSlots.load());
     }
 #endif
 
@@ -365,6 +406,8 @@ static UniValue getstakinginfo(const JSONRPCRequest& request)
     obj.pushKV("netstakeweight", (uint64_t)nNetworkWeight);
 
     obj.pushKV("expectedtime", nExpectedTime);
+    if (!performance.empty())
+        obj.pushKV("performance", performance);
 
     return obj;
 }
@@ -435,6 +478,37 @@ static std::string gbt_vb_name(const Consensus::DeploymentPos pos) {
     return s;
 }
 
+/** A template served by getblocktemplate, kept to serve the deltas of later templates to it */
+struct BlockTemplateRecord
+{
+    std::string id;
+    std::string longpollid;
+    uint256 hashPrevBlock;
+    CAmount nFeesAdded; //!< CTxMemPool::GetFeesAdded() when the template was assembled
+    std::vector<uint256> vTxHashes;
+};
+
+/** Templates a delta or long poll may refer to, all producers share them */
+static const size_t MAX_BLOCK_TEMPLATE_RECORDS = 16;
+static std::deque<BlockTemplateRecord> g_block_template_records GUARDED_BY(cs_main);
+
+static const BlockTemplateRecord* FindBlockTemplateRecord(const std::string& id, bool fLongPollId) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    for (const BlockTemplateRecord& record : g_block_template_records) {
+        if ((fLongPollId ? record.longpollid : record.id) == id)
+            return &record;
+    }
+    return nullptr;
+}
+
+static CAmount GetBlockTemplateFeeIncrease()
+{
+    CAmount nFeeIncrease = DEFAULT_BLOCK_TEMPLATE_FEE_INCREASE;
+    if (gArgs.IsArgSet("-blocktemplatefeeincrease"))
+        ParseMoney(gArgs.GetArg("-blocktemplatefeeincrease", ""), nFeeIncrease);
+    return nFeeIncrease;
+}
+
 static UniValue getblocktemplate(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 1)
@@ -446,7 +520,10 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
                 "    https://github.com/bitcoin/bips/blob/master/bip-0022.mediawiki\n"
                 "    https://github.com/bitcoin/bips/blob/master/bip-0023.mediawiki\n"
                 "    https://github.com/bitcoin/bips/blob/master/bip-0009.mediawiki#getblocktemplate_changes\n"
-                "    https://github.com/bitcoin/bips/blob/master/bip-0145.mediawiki\n",
+                "    https://github.com/bitcoin/bips/blob/master/bip-0145.mediawiki\n"
+                "Templates are reassembled when the tip changes, or when the mempool changed 5 seconds after the last one or\n"
+                "its new transactions pay -blocktemplatefeeincrease in fees. Long polls return on the same events.\n"
+                "A template request with the 'templateid' of a recent template only returns the transactions missing from it.\n",
                 {
                     {"template_request", RPCArg::Type::OBJ, RPCArg::Optional::NO, "A json object in the following spec",
                         {
@@ -461,6 +538,7 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
                                     {"support", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "client side supported softfork deployment"},
                                 },
                                 },
+                            {"templateid", RPCArg::Type::STR, /* treat as named arg */ RPCArg::Optional::OMITTED_NAMED_ARG, "The templateid of a template the client has, to receive the delta to the new template"},
                         },
                         "\"template_request\""},
                 },
@@ -516,6 +594,15 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
                         {RPCResult::Type::NUM_TIME, "curtime", "current timestamp in " + UNIX_EPOCH_TIME},
                         {RPCResult::Type::STR, "bits", "compressed target of next block"},
                         {RPCResult::Type::NUM, "height", "The height of the next block"},
+                        {RPCResult::Type::STR, "templateid", "The id of the template, for delta requests"},
+                        {RPCResult::Type::ARR, "removed", "Only in a delta: the transactions of the requested template that are not in this one, 'transactions' then only has the transactions that are new",
+                            {
+                                {RPCResult::Type::STR_HEX, "", "The transaction id"},
+                            }},
+                        {RPCResult::Type::ARR, "txids", "Only in a delta: the transactions of this template in block order",
+                            {
+                                {RPCResult::Type::STR_HEX, "", "The transaction id"},
+                            }},
                     }},
                 RPCExamples{
                     HelpExampleCli("getblocktemplate", "{\"rules\": [\"segwit\"]}")
@@ -527,6 +614,7 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
 
     std::string strMode = "template";
     UniValue lpval = NullUniValue;
+    std::string strTemplateId;
     std::set<std::string> setClientRules;
     int64_t nMaxVersionPreVB = -1;
     if (!request.params[0].isNull())
@@ -542,6 +630,11 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
         else
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
         lpval = find_value(oparam, "longpollid");
+        const UniValue& templateidval = find_value(oparam, "templateid");
+        if (templateidval.isStr())
+            strTemplateId = templateidval.get_str();
+        else if (!templateidval.isNull())
+            throw JSONRPCError(RPC_TYPE_ERROR, "templateid must be a string");
 
         if (strMode == "proposal")
         {
@@ -600,13 +693,18 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "HYDRA is downloading blocks...");
 
     static unsigned int nTransactionsUpdatedLast;
+    static CAmount nFeesAddedLast;
+    const CAmount nFeeIncrease = GetBlockTemplateFeeIncrease();
 
     if (!lpval.isNull())
     {
-        // Wait to respond until either the best block changes, OR a minute has passed and there are more transactions
+        // Wait to respond until either the best block changes, OR the new transactions pay enough fees
+        // for a better template, OR a minute has passed and there are more transactions
         uint256 hashWatchedChain;
         std::chrono::steady_clock::time_point checktxtime;
         unsigned int nTransactionsUpdatedLastLP;
+        bool fWatchFees = nFeeIncrease > 0;
+        CAmount nFeesAddedLastLP = nFeesAddedLast;
 
         if (lpval.isStr())
         {
@@ -615,6 +713,12 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
 
             hashWatchedChain = ParseHashV(lpstr.substr(0, 64), "longpollid");
             nTransactionsUpdatedLastLP = atoi64(lpstr.substr(64));
+            // The fees are only known for the templates we still have
+            const BlockTemplateRecord* record = FindBlockTemplateRecord(lpstr, true);
+            if (record)
+                nFeesAddedLastLP = record->nFeesAdded;
+            else
+                fWatchFees = false;
         }
         else
         {
@@ -631,13 +735,18 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
             WAIT_LOCK(g_best_block_mutex, lock);
             while (g_best_block == hashWatchedChain && IsRPCRunning())
             {
-                if (g_best_block_cv.wait_until(lock, checktxtime) == std::cv_status::timeout)
+                // The mempool does not signal new transactions, their fees are checked every second
+                if (fWatchFees && mempool.GetFeesAdded() - nFeesAddedLastLP >= nFeeIncrease)
+                    break;
+                const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if (now >= checktxtime)
                 {
                     // Timeout: Check transactions for update
                     if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
                         break;
                     checktxtime += std::chrono::seconds(10);
                 }
+                g_best_block_cv.wait_until(lock, fWatchFees ? std::min(checktxtime, now + std::chrono::seconds(1)) : checktxtime);
             }
         }
         ENTER_CRITICAL_SECTION(cs_main);
@@ -657,14 +766,17 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
+    static uint64_t nTemplateId;
     if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
+        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
+         (GetTime() - nStart > 5 || (nFeeIncrease > 0 && mempool.GetFeesAdded() - nFeesAddedLast >= nFeeIncrease))))
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = nullptr;
 
         // Store the pindexBest used before CreateNewBlock, to avoid races
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+        nFeesAddedLast = mempool.GetFeesAdded();
         CBlockIndex* pindexPrevNew = chainActive.Tip();
         nStart = GetTime();
 
@@ -676,6 +788,19 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
 
         // Need to update only after we know CreateNewBlock succeeded
         pindexPrev = pindexPrevNew;
+
+        BlockTemplateRecord record;
+        record.id = i64tostr(++nTemplateId);
+        record.longpollid = pindexPrev->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast);
+        record.hashPrevBlock = pindexPrev->GetBlockHash();
+        record.nFeesAdded = nFeesAddedLast;
+        for (const auto& tx : pblocktemplate->block.vtx) {
+            if (!tx->IsCoinBase())
+                record.vTxHashes.push_back(tx->GetHash());
+        }
+        g_block_template_records.push_front(std::move(record));
+        if (g_block_template_records.size() > MAX_BLOCK_TEMPLATE_RECORDS)
+            g_block_template_records.pop_back();
     }
     assert(pindexPrev);
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
@@ -690,6 +815,15 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
 
     UniValue aCaps(UniValue::VARR); aCaps.push_back("proposal");
 
+    // A delta is only served on the template of the same block, the transactions the client has are left out
+    const BlockTemplateRecord* deltaBase = strTemplateId.empty() ? nullptr : FindBlockTemplateRecord(strTemplateId, false);
+    if (deltaBase && deltaBase->hashPrevBlock != pindexPrev->GetBlockHash())
+        deltaBase = nullptr;
+    std::set<uint256> setDeltaBaseTxs;
+    if (deltaBase)
+        setDeltaBaseTxs.insert(deltaBase->vTxHashes.begin(), deltaBase->vTxHashes.end());
+    UniValue txids(UniValue::VARR);
+
     UniValue transactions(UniValue::VARR);
     std::map<uint256, int64_t> setTxIndex;
     int i = 0;
@@ -701,6 +835,12 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
         if (tx.IsCoinBase())
             continue;
 
+        if (deltaBase) {
+            txids.push_back(txHash.GetHex());
+            if (setDeltaBaseTxs.erase(txHash))
+                continue;
+        }
+
         UniValue entry(UniValue::VOBJ);
 
         entry.pushKV("data", EncodeHexTx(tx));
@@ -821,6 +961,16 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     result.pushKV("curtime", pblock->GetBlockTime());
     result.pushKV("bits", strprintf("%08x", pblock->nBits));
     result.pushKV("height", (int64_t)(pindexPrev->nHeight+1));
+    result.pushKV("templateid", g_block_template_records.front().id);
+    if (deltaBase) {
+        UniValue removed(UniValue::VARR);
+        for (const uint256& txHash : deltaBase->vTxHashes) {
+            if (setDeltaBaseTxs.count(txHash))
+                removed.push_back(txHash.GetHex());
+        }
+        result.pushKV("removed", removed);
+        result.pushKV("txids", txids);
+    }
 
     if (!pblocktemplate->vchCoinbaseCommitment.empty()) {
         result.pushKV("default_witness_commitment", HexStr(pblocktemplate->vchCoinbaseCommitment.begin(), pblocktemplate->vchCoinbaseCommitment.end()));
@@ -1018,6 +1168,52 @@ static UniValue estimatesmartfee(const JSONRPCRequest& request)
     return result;
 }
 
+static UniValue estimategasprice(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            RPCHelpMan{"estimategasprice",
+                "\nEstimates the gas price the fee of a contract transaction needs to pay for its gas limit\n"
+                "to begin confirmation within conf_target blocks if possible and return the number of blocks\n"
+                "for which the estimate is valid. The gas is charged at the current gas price when the\n"
+                "contract is executed, the rest of the fee paid for the gas limit is refunded.\n",
+                {
+                    {"conf_target", RPCArg::Type::NUM, RPCArg::Optional::NO, "Confirmation target in blocks (1 - 1008)"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::NUM, "gasprice", /* optional */ true, "estimate gas price in " + CURRENCY_UNIT + " per gas (only present if no errors were encountered)"},
+                        {RPCResult::Type::ARR, "errors", "Errors encountered during processing",
+                            {
+                                {RPCResult::Type::STR, "", "error"},
+                            }},
+                        {RPCResult::Type::NUM, "blocks", "block number where estimate was found\n"
+                        "The request target will be clamped between 2 and the highest target\n"
+                        "gas price estimation is able to return based on how long it has been running."},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("estimategasprice", "6")
+                },
+            }.ToString());
+
+    RPCTypeCheck(request.params, {UniValue::VNUM});
+    unsigned int conf_target = ParseConfirmTarget(request.params[0]);
+
+    UniValue result(UniValue::VOBJ);
+    UniValue errors(UniValue::VARR);
+    int returned_target = 0;
+    CAmount gasPrice = ::feeEstimator.estimateGasPrice(conf_target, &returned_target);
+    if (gasPrice > 0) {
+        result.pushKV("gasprice", ValueFromAmount(gasPrice));
+    } else {
+        errors.push_back("Insufficient data or no gas price found");
+        result.pushKV("errors", errors);
+    }
+    result.pushKV("blocks", returned_target);
+    return result;
+}
+
 static UniValue estimaterawfee(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -1152,6 +1348,7 @@ static const CRPCCommand commands[] =
     { "generating",         "generatetoaddress",      &generatetoaddress,      {"nblocks","address","maxtries"} },
 
     { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"} },
+    { "util",               "estimategasprice",       &estimategasprice,       {"conf_target"} },
 
     { "hidden",             "estimaterawfee",         &estimaterawfee,         {"conf_target", "threshold"} },
 };
@@ -17,6 +17,7 @@
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
+#include <support/largepages.h>
 #include <timedata.h>
 #include <wallet/rpcwallet.h>
 #include <wallet/wallet.h>
@@ -30,8 +31,10 @@
 #include <warnings.h>
 
 #include <rpc/contract_util.h>
+#include <qtum/codecache.h>
 #include <util/tokenstr.h>
 #include <stdint.h>
+#include <algorithm>
 #ifdef HAVE_MALLOC_INFO
 #include <malloc.h>
 #endif
@@ -360,6 +363,189 @@ bool getAddressFromIndex(const int &type, const uint256 &hash, std::string &addr
     return true;
 }
 
+//! Most entries a page of getaddressdeltas, getaddresstxids or getaddressutxos may hold
+static const int64_t MAX_ADDRESS_INDEX_PAGE = 10000;
+
+/** Paging of the address index calls, given as limit, cursor and descending in the input object */
+struct AddressIndexPage {
+    //! Most entries of the page, 0 reads everything
+    size_t limit = 0;
+    bool descending = false;
+    //! The serialized index key of the last entry of the page before, in hex
+    std::vector<unsigned char> cursor;
+
+    bool paged() const { return limit > 0 || descending || !cursor.empty(); }
+};
+
+static AddressIndexPage getAddressIndexPageFromParams(const UniValue& params, bool allowDescending)
+{
+    AddressIndexPage page;
+    if (!params[0].isObject())
+        return page;
+
+    const UniValue& limitValue = find_value(params[0].get_obj(), "limit");
+    if (!limitValue.isNull()) {
+        int64_t limit = limitValue.get_int64();
+        if (limit <= 0 || limit > MAX_ADDRESS_INDEX_PAGE)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Limit is expected to be between 1 and %d", MAX_ADDRESS_INDEX_PAGE));
+        page.limit = limit;
+    }
+    const UniValue& descendingValue = find_value(params[0].get_obj(), "descending");
+    if (!descendingValue.isNull()) {
+        if (!allowDescending)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Descending order is not supported");
+        page.descending = descendingValue.get_bool();
+    }
+    const UniValue& cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (!cursorValue.isNull()) {
+        if (!IsHex(cursorValue.get_str()))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        page.cursor = ParseHex(cursorValue.get_str());
+    }
+    return page;
+}
+
+template <typename Key>
+static Key parseAddressIndexCursor(const AddressIndexPage& page)
+{
+    Key key;
+    try {
+        CDataStream ssKey(page.cursor, SER_DISK, CLIENT_VERSION);
+        ssKey >> key;
+        if (!ssKey.empty())
+            throw std::ios_base::failure("trailing data");
+    } catch (const std::exception&) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+    }
+    return key;
+}
+
+template <typename Key>
+static std::string addressIndexCursor(const Key& key)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << key;
+    return HexStr(ssKey.begin(), ssKey.end());
+}
+
+/** Order of the entries of several addresses in a page: the index key without the address, then the address */
+template <typename Key>
+static std::string addressIndexPageOrder(const Key& key)
+{
+    Key position = key;
+    position.type = 0;
+    position.hashBytes.SetNull();
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << position << (unsigned char)key.type << key.hashBytes;
+    return ssKey.str();
+}
+
+/**
+ * Read one page of the address history of the addresses in the order of addressIndexPageOrder, or the
+ * reverse. Each address reads at most one more entry than the page holds, so memory is bounded by the
+ * page. With wholeTransactions a transaction that crosses the end of the page is left to the next page,
+ * unless it alone fills the page. Returns the cursor of the next page, empty when no entries are left.
+ */
+static std::string getAddressIndexPage(const std::vector<std::pair<uint256, int> >& addresses, int start, int end,
+                                       const AddressIndexPage& page, bool wholeTransactions,
+                                       std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex)
+{
+    bool hasCursor = !page.cursor.empty();
+    CAddressIndexKey cursor;
+    std::string cursorOrder;
+    if (hasCursor) {
+        cursor = parseAddressIndexCursor<CAddressIndexKey>(page);
+        cursorOrder = addressIndexPageOrder(cursor);
+    }
+
+    for (const auto& address : addresses) {
+        CAddressIndexRange range;
+        range.start = start;
+        range.end = end;
+        range.limit = page.limit > 0 ? page.limit + 1 : 0;
+        range.descending = page.descending;
+        if (hasCursor) {
+            range.hasAfter = true;
+            range.after = cursor;
+            range.after.type = address.second;
+            range.after.hashBytes = address.first;
+            // An entry of this address at the cursor position is past the cursor when this address sorts past its address
+            std::string order = addressIndexPageOrder(range.after);
+            range.includeAfter = page.descending ? order < cursorOrder : order > cursorOrder;
+        }
+        if (!GetAddressIndex(address.first, address.second, range, addressIndex)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+    }
+
+    if (addresses.size() > 1) {
+        std::vector<std::pair<std::string, size_t> > order;
+        for (size_t i = 0; i < addressIndex.size(); i++)
+            order.emplace_back(addressIndexPageOrder(addressIndex[i].first), i);
+        std::sort(order.begin(), order.end());
+        if (page.descending)
+            std::reverse(order.begin(), order.end());
+        std::vector<std::pair<CAddressIndexKey, CAmount> > sorted;
+        for (const auto& entry : order)
+            sorted.push_back(addressIndex[entry.second]);
+        addressIndex.swap(sorted);
+    }
+
+    if (page.limit == 0 || addressIndex.size() <= page.limit)
+        return "";
+
+    size_t size = page.limit;
+    if (wholeTransactions) {
+        const uint256& crossing = addressIndex[page.limit].first.txhash;
+        while (size > 0 && addressIndex[size - 1].first.txhash == crossing)
+            size--;
+        if (size == 0)
+            size = page.limit;
+    }
+    addressIndex.resize(size);
+    return addressIndexCursor(addressIndex.back().first);
+}
+
+/** Read one page of the unspent outputs of the addresses in the order of addressIndexPageOrder, see getAddressIndexPage */
+static std::string getAddressUnspentPage(const std::vector<std::pair<uint256, int> >& addresses, const AddressIndexPage& page,
+                                         std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    bool hasCursor = !page.cursor.empty();
+    CAddressUnspentKey cursor;
+    std::string cursorOrder;
+    if (hasCursor) {
+        cursor = parseAddressIndexCursor<CAddressUnspentKey>(page);
+        cursorOrder = addressIndexPageOrder(cursor);
+    }
+
+    for (const auto& address : addresses) {
+        CAddressUnspentKey after = cursor;
+        after.type = address.second;
+        after.hashBytes = address.first;
+        bool includeAfter = hasCursor && addressIndexPageOrder(after) > cursorOrder;
+        if (!GetAddressUnspent(address.first, address.second, hasCursor ? &after : nullptr, includeAfter,
+                               page.limit > 0 ? page.limit + 1 : 0, unspentOutputs)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+    }
+
+    if (addresses.size() > 1) {
+        std::vector<std::pair<std::string, size_t> > order;
+        for (size_t i = 0; i < unspentOutputs.size(); i++)
+            order.emplace_back(addressIndexPageOrder(unspentOutputs[i].first), i);
+        std::sort(order.begin(), order.end());
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > sorted;
+        for (const auto& entry : order)
+            sorted.push_back(unspentOutputs[entry.second]);
+        unspentOutputs.swap(sorted);
+    }
+
+    if (page.limit == 0 || unspentOutputs.size() <= page.limit)
+        return "";
+    unspentOutputs.resize(page.limit);
+    return addressIndexCursor(unspentOutputs.back().first);
+}
+
 UniValue getaddressdeltas(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1 || !request.params[0].isObject())
@@ -377,11 +563,14 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
                         {"start", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "The start block height"},
                         {"end", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "The end block height"},
                         {"chainInfo", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED_NAMED_ARG, "Include chain info in results, only applies if start and end specified"},
+                        {"limit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "Return at most this many entries, at most " + std::to_string(MAX_ADDRESS_INDEX_PAGE) + ", and a cursor for the next ones"},
+                        {"cursor", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED_NAMED_ARG, "Continue after the page that returned this cursor, with the same other params"},
+                        {"descending", RPCArg::Type::BOOL, /* default */ "false", "Return the newest entries first"},
                     }
                 }
             },
             RPCResult{
-                RPCResult::Type::OBJ, "", "",
+                RPCResult::Type::OBJ, "", "With limit, cursor or descending an object with the deltas in \"deltas\" and the \"cursor\" of the next page if entries are left",
                 {
                     {RPCResult::Type::NUM, "satoshis", "The difference of satoshis"},
                     {RPCResult::Type::STR_HEX, "txid", "The related txid"},
@@ -428,16 +617,23 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    AddressIndexPage page = getAddressIndexPageFromParams(request.params, true);
+    std::string nextCursor;
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    if (page.paged()) {
+        nextCursor = getAddressIndexPage(addresses, start, end, page, false, addressIndex);
+    } else {
+        for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (start > 0 && end > 0) {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
+            } else {
+                if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+                }
             }
         }
     }
@@ -484,7 +680,16 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
         result.pushKV("deltas", deltas);
         result.pushKV("start", startInfo);
         result.pushKV("end", endInfo);
+        if (!nextCursor.empty()) {
+            result.pushKV("cursor", nextCursor);
+        }
 
+        return result;
+    } else if (page.paged()) {
+        result.pushKV("deltas", deltas);
+        if (!nextCursor.empty()) {
+            result.pushKV("cursor", nextCursor);
+        }
         return result;
     } else {
         return deltas;
@@ -524,23 +729,42 @@ UniValue getaddressbalance(const JSONRPCRequest& request)
 
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
+    CAmount balance = 0;
+    CAmount received = 0;
+    CAmount immature = 0;
+
+    int nHeight = chainActive.Height();
+    int nMaturity = Params().GetConsensus().CoinbaseMaturity(nHeight);
+    // With the address totals only the history of the blocks that can hold immature stakes is read
+    int start = nHeight - nMaturity + 1;
+    bool fTotals = start > 0;
+
     for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
+        CAddressBalanceValue totals;
+        if (fTotals && GetAddressBalance((*it).first, (*it).second, totals)) {
+            balance += totals.balance;
+            received += totals.received;
+            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, nHeight)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
+            continue;
+        }
+
+        std::vector<std::pair<CAddressIndexKey, CAmount> > fullIndex;
+        if (!GetAddressIndex((*it).first, (*it).second, fullIndex)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
+        for (const auto& entry : fullIndex) {
+            if (entry.second > 0) {
+                received += entry.second;
+            }
+            balance += entry.second;
+        }
+        addressIndex.insert(addressIndex.end(), fullIndex.begin(), fullIndex.end());
     }
 
-    CAmount balance = 0;
-    CAmount received = 0;
-    CAmount immature = 0;
-
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
-        }
-        balance += it->second;
-        int nHeight = chainActive.Height();
-        if (it->first.txindex == 1 && ((nHeight - it->first.blockHeight) < Params().GetConsensus().CoinbaseMaturity(nHeight)))
+        if (it->first.txindex == 1 && ((nHeight - it->first.blockHeight) < nMaturity))
             immature += it->second; //immature stake outputs
     }
 
@@ -567,11 +791,13 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
                                 }
                             },
                             {"chainInfo", RPCArg::Type::BOOL, RPCArg::Optional::OMITTED_NAMED_ARG, "Include chain info with results"},
+                            {"limit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "Return at most this many outputs, at most " + std::to_string(MAX_ADDRESS_INDEX_PAGE) + ", in txid order instead of height order, and a cursor for the next ones"},
+                            {"cursor", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED_NAMED_ARG, "Continue after the page that returned this cursor, with the same other params"},
                         }
                     }
                 },
                 RPCResult{
-                    RPCResult::Type::OBJ, "", "",
+                    RPCResult::Type::OBJ, "", "With limit or cursor an object with the outputs in \"utxos\" and the \"cursor\" of the next page if outputs are left",
                     {
                         {RPCResult::Type::STR, "address", "The address base58check encoded"},
                         {RPCResult::Type::STR_HEX, "txid", "The output txid"},
@@ -603,15 +829,23 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    AddressIndexPage page = getAddressIndexPageFromParams(request.params, false);
+    std::string nextCursor;
+
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    if (page.paged()) {
+        // Pages are in index order, the height of an output is only known from its value
+        nextCursor = getAddressUnspentPage(addresses, page, unspentOutputs);
+    } else {
+        for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+            if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+            }
         }
-    }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+        std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    }
 
     UniValue utxos(UniValue::VARR);
 
@@ -632,13 +866,18 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
         utxos.push_back(output);
     }
 
-    if (includeChainInfo) {
+    if (includeChainInfo || page.paged()) {
         UniValue result(UniValue::VOBJ);
         result.pushKV("utxos", utxos);
+        if (!nextCursor.empty()) {
+            result.pushKV("cursor", nextCursor);
+        }
 
-        LOCK(cs_main);
-        result.pushKV("hash", chainActive.Tip()->GetBlockHash().GetHex());
-        result.pushKV("height", (int)chainActive.Height());
+        if (includeChainInfo) {
+            LOCK(cs_main);
+            result.pushKV("hash", chainActive.Tip()->GetBlockHash().GetHex());
+            result.pushKV("height", (int)chainActive.Height());
+        }
         return result;
     } else {
         return utxos;
@@ -864,11 +1103,14 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
                             },
                             {"start", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "The start block height"},
                             {"end", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "The end block height"},
+                            {"limit", RPCArg::Type::NUM, RPCArg::Optional::OMITTED_NAMED_ARG, "Return at most this many address index entries, at most " + std::to_string(MAX_ADDRESS_INDEX_PAGE) + ", and a cursor for the next ones"},
+                            {"cursor", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED_NAMED_ARG, "Continue after the page that returned this cursor, with the same other params"},
+                            {"descending", RPCArg::Type::BOOL, /* default */ "false", "Return the newest entries first"},
                         }
                     }
                 },
                 RPCResult{
-                    RPCResult::Type::OBJ, "", "",
+                    RPCResult::Type::OBJ, "", "With limit, cursor or descending an object with the txids in \"txids\" and the \"cursor\" of the next page if entries are left",
                     {
                         {RPCResult::Type::STR_HEX, "transactionid", "The transaction id"},
                     }
@@ -898,6 +1140,24 @@ UniValue getaddresstxids(const JSONRPCRequest& request)
         }
     }
 
+    AddressIndexPage page = getAddressIndexPageFromParams(request.params, true);
+    if (page.paged()) {
+        // The page is in index order already, a transaction is only split over pages when it alone fills one
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        std::string nextCursor = getAddressIndexPage(addresses, start, end, page, true, addressIndex);
+        UniValue txids(UniValue::VARR);
+        for (size_t i = 0; i < addressIndex.size(); i++) {
+            if (i == 0 || addressIndex[i].first.txhash != addressIndex[i - 1].first.txhash)
+                txids.push_back(addressIndex[i].first.txhash.GetHex());
+        }
+        UniValue result(UniValue::VOBJ);
+        result.pushKV("txids", txids);
+        if (!nextCursor.empty()) {
+            result.pushKV("cursor", nextCursor);
+        }
+        return result;
+    }
+
     std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
 
     for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
@@ -1282,6 +1542,68 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCLargePagesInfo()
+{
+    LargePagePool::Stats stats = LargePagePool::Instance().stats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("enabled", LargePagePool::Instance().IsEnabled());
+    obj.pushKV("used", uint64_t(stats.used));
+    obj.pushKV("free", uint64_t(stats.free));
+    obj.pushKV("arenas", uint64_t(stats.arenas));
+    obj.pushKV("direct", uint64_t(stats.direct));
+    obj.pushKV("explicit", uint64_t(stats.explicit_pages));
+    return obj;
+}
+
+static UniValue RPCReceiptCacheInfo()
+{
+    UniValue obj(UniValue::VOBJ);
+    if (!pstorageresult) {
+        return obj;
+    }
+    ReceiptCacheStats stats = pstorageresult->getReceiptCacheStats();
+    obj.pushKV("hits", stats.hits);
+    obj.pushKV("misses", stats.misses);
+    obj.pushKV("entries", uint64_t(stats.entries));
+    obj.pushKV("usage", uint64_t(stats.usage));
+    obj.pushKV("max_usage", uint64_t(stats.maxUsage));
+    return obj;
+}
+
+static UniValue RPCContractCodeCacheInfo()
+{
+    UniValue obj(UniValue::VOBJ);
+    if (!g_contract_code_cache) {
+        return obj;
+    }
+    ContractCodeCacheStats stats = g_contract_code_cache->GetStats();
+    obj.pushKV("hits", stats.hits);
+    obj.pushKV("misses", stats.misses);
+    obj.pushKV("entries", uint64_t(stats.entries));
+    obj.pushKV("usage", uint64_t(stats.usage));
+    obj.pushKV("max_usage", uint64_t(stats.maxUsage));
+    return obj;
+}
+
+static UniValue RPCDBCacheEntry(int64_t budget, size_t usage)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("budget", budget);
+    obj.pushKV("usage", uint64_t(usage));
+    return obj;
+}
+
+static UniValue RPCDBCacheInfo()
+{
+    UniValue obj(UniValue::VOBJ);
+    LOCK(cs_main);
+    obj.pushKV("blocktree", RPCDBCacheEntry(g_dbcache_sizes.block_tree_db, pblocktree ? pblocktree->DynamicMemoryUsage() : 0));
+    obj.pushKV("chainstate", RPCDBCacheEntry(g_dbcache_sizes.coins_db, pcoinsdbview ? pcoinsdbview->DynamicMemoryUsage() : 0));
+    obj.pushKV("coins", RPCDBCacheEntry(nCoinCacheUsage, pcoinsTip ? pcoinsTip->DynamicMemoryUsage() : 0));
+    obj.pushKV("receipts", RPCDBCacheEntry(g_dbcache_sizes.receipts_db, pstorageresult ? pstorageresult->DynamicMemoryUsage() : 0));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -1328,6 +1650,42 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
                                 {RPCResult::Type::NUM, "chunks_used", "Number allocated chunks"},
                                 {RPCResult::Type::NUM, "chunks_free", "Number unused chunks"},
                             }},
+                            {RPCResult::Type::OBJ, "largepages", "Information about the huge pages of the in-memory UTXO set, see -largepages",
+                            {
+                                {RPCResult::Type::BOOL, "enabled", "Whether the UTXO set is placed on huge pages"},
+                                {RPCResult::Type::NUM, "used", "Number of bytes of the arenas used by cache entries"},
+                                {RPCResult::Type::NUM, "free", "Number of bytes of the arenas kept for reuse"},
+                                {RPCResult::Type::NUM, "arenas", "Number of bytes of the arenas the entries are allocated from"},
+                                {RPCResult::Type::NUM, "direct", "Number of bytes of large allocations, like hash table buckets, mapped on their own"},
+                                {RPCResult::Type::NUM, "explicit", "Number of bytes on explicitly reserved huge pages, the rest relies on transparent huge pages"},
+                            }},
+                            {RPCResult::Type::OBJ, "receiptcache", "Information about the cache of decoded transaction receipts",
+                            {
+                                {RPCResult::Type::NUM, "hits", "Number of receipt lookups served from the cache"},
+                                {RPCResult::Type::NUM, "misses", "Number of receipt lookups that read the database"},
+                                {RPCResult::Type::NUM, "entries", "Number of transactions whose receipts are cached"},
+                                {RPCResult::Type::NUM, "usage", "Approximate number of bytes used"},
+                                {RPCResult::Type::NUM, "max_usage", "Maximum number of bytes used, set with -receiptcache"},
+                            }},
+                            {RPCResult::Type::OBJ, "contractcodecache", "Information about the cache of contract code, empty with -contractcodecache=0",
+                            {
+                                {RPCResult::Type::NUM, "hits", "Number of contract calls whose code was served from the cache"},
+                                {RPCResult::Type::NUM, "misses", "Number of contract calls that read the code from the state database"},
+                                {RPCResult::Type::NUM, "entries", "Number of cached contract codes"},
+                                {RPCResult::Type::NUM, "usage", "Approximate number of bytes used"},
+                                {RPCResult::Type::NUM, "max_usage", "Maximum number of bytes used, set with -contractcodecache"},
+                            }},
+                            {RPCResult::Type::OBJ, "dbcache", "Share of -dbcache given to each database and the bytes it currently uses",
+                            {
+                                {RPCResult::Type::OBJ, "blocktree", "Block index database, with the address and log indexes",
+                                    {{RPCResult::Type::NUM, "budget", "Bytes given at startup"}, {RPCResult::Type::NUM, "usage", "Approximate number of bytes used"}}},
+                                {RPCResult::Type::OBJ, "chainstate", "Chain state database",
+                                    {{RPCResult::Type::NUM, "budget", "Bytes given at startup"}, {RPCResult::Type::NUM, "usage", "Approximate number of bytes used"}}},
+                                {RPCResult::Type::OBJ, "coins", "In-memory UTXO set",
+                                    {{RPCResult::Type::NUM, "budget", "Bytes given at startup"}, {RPCResult::Type::NUM, "usage", "Approximate number of bytes used"}}},
+                                {RPCResult::Type::OBJ, "receipts", "Transaction receipts database",
+                                    {{RPCResult::Type::NUM, "budget", "Bytes given at startup"}, {RPCResult::Type::NUM, "usage", "Approximate number of bytes used"}}},
+                            }},
                         }
                     },
                     RPCResult{"mode \"mallocinfo\"",
@@ -1344,6 +1702,10 @@ static UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.pushKV("locked", RPCLockedMemoryInfo());
+        obj.pushKV("largepages", RPCLargePagesInfo());
+        obj.pushKV("receiptcache", RPCReceiptCacheInfo());
+        obj.pushKV("contractcodecache", RPCContractCodeCacheInfo());
+        obj.pushKV("dbcache", RPCDBCacheInfo());
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -1445,6 +1807,128 @@ UniValue logging(const JSONRPCRequest& request)
     return result;
 }
 
+static UniValue setlockprofiling(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            RPCHelpMan{"setlockprofiling",
+                "\nTurn lock profiling on or off. While it is on, each LOCK callsite records how long it waited\n"
+                "for the mutex and how long it held it. Turning it on clears the statistics of getlockprofile.\n",
+                {
+                    {"enable", RPCArg::Type::BOOL, RPCArg::Optional::NO, "Whether lock profiling is on"},
+                    {"allmutexes", RPCArg::Type::BOOL, /* default */ "false", "Profile all mutexes instead of only cs_main"},
+                },
+                RPCResults{},
+                RPCExamples{
+                    HelpExampleCli("setlockprofiling", "true")
+            + HelpExampleCli("setlockprofiling", "true true")
+            + HelpExampleRpc("setlockprofiling", "false")
+                },
+            }.ToString());
+
+    bool fAllMutexes = request.params[1].isNull() ? false : request.params[1].get_bool();
+    SetLockProfiling(request.params[0].get_bool(), fAllMutexes);
+    return NullUniValue;
+}
+
+static int64_t LockProfileSortValue(const LockProfileEntry& entry, const std::string& strSortBy)
+{
+    if (strSortBy == "hold")
+        return entry.nHoldTotal;
+    if (strSortBy == "count")
+        return entry.nCount;
+    if (strSortBy == "contended")
+        return entry.nContended;
+    return entry.nWaitTotal;
+}
+
+static UniValue LockProfileHistogramToJSON(const std::vector<uint64_t>& vHistogram)
+{
+    UniValue histogram(UniValue::VARR);
+    for (uint64_t nCount : vHistogram) {
+        histogram.push_back(nCount);
+    }
+    return histogram;
+}
+
+static UniValue getlockprofile(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            RPCHelpMan{"getlockprofile",
+                "\nReturns the lock callsites recorded since setlockprofiling turned profiling on. Times are in microseconds.\n"
+                "Bucket i of a histogram counts the locks that waited or were held less than 2^i microseconds, the last\n"
+                "bucket counts the rest.\n",
+                {
+                    {"count", RPCArg::Type::NUM, /* default */ "20", "The number of callsites to return"},
+                    {"sortby", RPCArg::Type::STR, /* default */ "wait", "The value to sort by: wait, hold, count or contended"},
+                },
+                RPCResult{
+                    RPCResult::Type::OBJ, "", "",
+                    {
+                        {RPCResult::Type::BOOL, "enabled", "Whether lock profiling is on"},
+                        {RPCResult::Type::BOOL, "allmutexes", "Whether all mutexes are profiled instead of only cs_main"},
+                        {RPCResult::Type::ARR, "locks", "",
+                        {
+                            {RPCResult::Type::OBJ, "", "",
+                            {
+                                {RPCResult::Type::STR, "mutex", "The locked mutex"},
+                                {RPCResult::Type::STR, "location", "The file and line of the LOCK"},
+                                {RPCResult::Type::NUM, "count", "The number of times the lock was taken"},
+                                {RPCResult::Type::NUM, "contended", "The number of times the mutex was held by another thread"},
+                                {RPCResult::Type::NUM, "waittotal", "Total time waited for the mutex"},
+                                {RPCResult::Type::NUM, "waitmax", "Longest time waited for the mutex"},
+                                {RPCResult::Type::NUM, "holdtotal", "Total time the mutex was held"},
+                                {RPCResult::Type::NUM, "holdmax", "Longest time the mutex was held"},
+                                {RPCResult::Type::ARR, "waithistogram", "", {{RPCResult::Type::NUM, "", "Locks in the bucket"}}},
+                                {RPCResult::Type::ARR, "holdhistogram", "", {{RPCResult::Type::NUM, "", "Locks in the bucket"}}},
+                            }},
+                        }},
+                    }},
+                RPCExamples{
+                    HelpExampleCli("getlockprofile", "")
+            + HelpExampleCli("getlockprofile", "10 hold")
+            + HelpExampleRpc("getlockprofile", "10, \"hold\"")
+                },
+            }.ToString());
+
+    int count = request.params[0].isNull() ? 20 : request.params[0].get_int();
+    if (count < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative count");
+    std::string sortby = request.params[1].isNull() ? "wait" : request.params[1].get_str();
+    if (sortby != "wait" && sortby != "hold" && sortby != "count" && sortby != "contended")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid sortby " + sortby);
+
+    std::vector<LockProfileEntry> vEntries = GetLockProfile();
+    size_t nCount = std::min<size_t>(count, vEntries.size());
+    std::partial_sort(vEntries.begin(), vEntries.begin() + nCount, vEntries.end(), [&sortby](const LockProfileEntry& a, const LockProfileEntry& b) {
+        return LockProfileSortValue(a, sortby) > LockProfileSortValue(b, sortby);
+    });
+    vEntries.resize(nCount);
+
+    UniValue locks(UniValue::VARR);
+    for (const LockProfileEntry& entry : vEntries) {
+        UniValue lock(UniValue::VOBJ);
+        lock.pushKV("mutex", entry.name);
+        lock.pushKV("location", entry.location);
+        lock.pushKV("count", entry.nCount);
+        lock.pushKV("contended", entry.nContended);
+        lock.pushKV("waittotal", entry.nWaitTotal);
+        lock.pushKV("waitmax", entry.nWaitMax);
+        lock.pushKV("holdtotal", entry.nHoldTotal);
+        lock.pushKV("holdmax", entry.nHoldMax);
+        lock.pushKV("waithistogram", LockProfileHistogramToJSON(entry.vWaitHistogram));
+        lock.pushKV("holdhistogram", LockProfileHistogramToJSON(entry.vHoldHistogram));
+        locks.push_back(lock);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("enabled", g_lock_profiling.load());
+    ret.pushKV("allmutexes", IsLockProfilingAllMutexes());
+    ret.pushKV("locks", locks);
+    return ret;
+}
+
 static UniValue echo(const JSONRPCRequest& request)
 {
     if (request.fHelp)
@@ -1600,6 +2084,8 @@ static const CRPCCommand commands[] =
     { "control",            "getdgpinfo",             &getdgpinfo,             {}},
     { "control",            "getoracleinfo",          &getoracleinfo,          {}},
     { "control",            "logging",                &logging,                {"include", "exclude"}},
+    { "control",            "setlockprofiling",       &setlockprofiling,       {"enable", "allmutexes"}},
+    { "control",            "getlockprofile",         &getlockprofile,         {"count", "sortby"}},
     { "util",               "validateaddress",        &validateaddress,        {"address"} },
     { "util",               "createmultisig",         &createmultisig,         {"nrequired","keys","address_type"} },
     { "util",               "deriveaddresses",        &deriveaddresses,        {"descriptor", "range"} },
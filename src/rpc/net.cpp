@@ -104,6 +104,7 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                             {RPCResult::Type::NUM, "version", "The peer version, such as 70001"},
                             {RPCResult::Type::STR, "subver", "The string version"},
                             {RPCResult::Type::BOOL, "inbound", "Inbound (true) or Outbound (false)"},
+                            {RPCResult::Type::BOOL, "txreconciliation", "Whether transactions are reconciled with the peer rather than all announced, see -txreconciliation"},
                             {RPCResult::Type::BOOL, "addnode", "Whether connection was due to addnode/-connect or if it was an automatic/inbound connection"},
                             {RPCResult::Type::NUM, "startingheight", "The starting height (block) of the peer"},
                             {RPCResult::Type::NUM, "banscore", "The ban score"},
@@ -113,6 +114,8 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                             {
                                 {RPCResult::Type::NUM, "n", "The heights of blocks we're currently asking from this peer"},
                             }},
+                            {RPCResult::Type::NUM, "headerspamheights", "The number of heights the header spam filter tracks for the peer address"},
+                            {RPCResult::Type::NUM, "headerspamheaders", "The number of headers the header spam filter counted for those heights"},
                             {RPCResult::Type::BOOL, "whitelisted", "Whether the peer is whitelisted"},
                             {RPCResult::Type::NUM, "minfeefilter", "The minimum fee rate for transactions this peer accepts"},
                             {RPCResult::Type::OBJ_DYN, "bytessent_per_msg", "",
@@ -174,6 +177,7 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
         // their ver message.
         obj.pushKV("subver", stats.cleanSubVer);
         obj.pushKV("inbound", stats.fInbound);
+        obj.pushKV("txreconciliation", stats.m_tx_reconciliation);
         obj.pushKV("addnode", stats.m_manual_connection);
         obj.pushKV("startingheight", stats.nStartingHeight);
         if (fStateStats) {
@@ -185,6 +189,8 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("headerspamheights", (uint64_t)statestats.nHeaderSpamHeights);
+            obj.pushKV("headerspamheaders", (uint64_t)statestats.nHeaderSpamHeaders);
         }
         obj.pushKV("whitelisted", stats.fWhitelisted);
         obj.pushKV("minfeefilter", ValueFromAmount(stats.minFeeFilter));
@@ -48,6 +48,19 @@ std::string JSONRPCReply(const UniValue& result, const UniValue& error, const Un
     return reply.write() + "\n";
 }
 
+std::string JSONRPCRawReply(const std::string& result, const UniValue& id)
+{
+    // Same members and order as JSONRPCReplyObj
+    std::string reply;
+    reply.reserve(result.size() + 64);
+    reply += "{\"result\":";
+    reply += result;
+    reply += ",\"error\":null,\"id\":";
+    reply += id.write();
+    reply += "}";
+    return reply;
+}
+
 UniValue JSONRPCError(int code, const std::string& message)
 {
     UniValue error(UniValue::VOBJ);
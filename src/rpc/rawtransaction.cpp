@@ -20,6 +20,7 @@
 #include <primitives/transaction.h>
 #include <psbt.h>
 #include <rpc/rawtransaction.h>
+#include <rpc/resultcache.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/script.h>
@@ -360,6 +361,12 @@ static UniValue getrawtransaction(const JSONRPCRequest& request)
     }
 
     if (!fVerbose) {
+        if (request.resultBlock && !hash_block.IsNull()) {
+            LOCK(cs_main);
+            const CBlockIndex* pindex = LookupBlockIndex(hash_block);
+            if (pindex && chainActive.Contains(pindex))
+                *request.resultBlock = RPCResultBlock{pindex->GetBlockHash(), pindex->nHeight};
+        }
         return EncodeHexTx(*tx, RPCSerializationFlags());
     }
 
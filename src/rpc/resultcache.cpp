@@ -0,0 +1,91 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <rpc/resultcache.h>
+
+#include <chainparams.h>
+#include <primitives/block.h>
+#include <rpc/server.h>
+
+#include <unordered_set>
+
+std::unique_ptr<RPCResultCache> g_rpc_result_cache;
+
+/** Approximate memory used by a cache entry: list node, index node and the strings */
+static size_t EntryUsage(const std::string& key, const std::string& result)
+{
+    return 160 + 2 * key.size() + result.size();
+}
+
+RPCResultCache::RPCResultCache(size_t max_usage) : m_max_usage(max_usage) {}
+
+bool RPCResultCache::IsCacheable(const std::string& method)
+{
+    // Only the forms of the results without confirmations are filled in by these calls
+    static const std::unordered_set<std::string> methods = {
+        "getblock", "getblockheader", "getrawtransaction", "gettransactionreceipt",
+    };
+    return methods.count(method);
+}
+
+bool RPCResultCache::Lookup(const std::string& key, std::string& result)
+{
+    LOCK(cs);
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        m_misses++;
+        return false;
+    }
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    result = it->second->result;
+    m_hits++;
+    return true;
+}
+
+void RPCResultCache::Insert(const std::string& key, const RPCResultBlock& block, const std::string& result)
+{
+    int tip_height = WITH_LOCK(cs_blockchange, return latestblock.height);
+    if (block.height < 0 || block.height > tip_height ||
+        tip_height - block.height < Params().GetConsensus().CheckpointSpan(tip_height))
+        return;
+
+    size_t usage = EntryUsage(key, result);
+    if (usage > m_max_usage)
+        return;
+
+    LOCK(cs);
+    if (m_index.count(key))
+        return;
+    m_lru.push_front(Entry{key, block.hash, result});
+    m_index.emplace(key, m_lru.begin());
+    m_usage += usage;
+    while (m_usage > m_max_usage) {
+        const Entry& last = m_lru.back();
+        m_usage -= EntryUsage(last.key, last.result);
+        m_index.erase(last.key);
+        m_lru.pop_back();
+    }
+}
+
+RPCResultCacheStats RPCResultCache::GetStats()
+{
+    LOCK(cs);
+    return RPCResultCacheStats{m_hits, m_misses, m_lru.size(), m_usage, m_max_usage};
+}
+
+void RPCResultCache::BlockDisconnected(const std::shared_ptr<const CBlock>& block)
+{
+    // Disconnects are rare next to lookups, so the entries are not indexed by block
+    uint256 hash = block->GetHash();
+    LOCK(cs);
+    for (auto it = m_lru.begin(); it != m_lru.end();) {
+        if (it->block == hash) {
+            m_usage -= EntryUsage(it->key, it->result);
+            m_index.erase(it->key);
+            it = m_lru.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_RESULTCACHE_H
+#define BITCOIN_RPC_RESULTCACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+#include <validationinterface.h>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+//! -rpccachesize default in MiB, 0 disables the cache of RPC results
+static const int64_t DEFAULT_RPC_CACHE_SIZE = 0;
+
+/** The block a result depends on, filled in by calls whose result may be cached */
+struct RPCResultBlock
+{
+    uint256 hash;
+    int height = -1;
+};
+
+struct RPCResultCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    size_t entries;
+    size_t usage;
+    size_t max_usage;
+};
+
+/**
+ * Bounded LRU of the JSON text of results that only depend on one block of the active chain.
+ * A result is only kept once its block is deeper than the reorg window (CheckpointSpan), and the
+ * results of a block are dropped when the block is disconnected.
+ */
+class RPCResultCache final : public CValidationInterface
+{
+public:
+    explicit RPCResultCache(size_t max_usage);
+
+    /** Whether the results of a method may be cached, the method then fills in JSONRPCRequest::resultBlock */
+    static bool IsCacheable(const std::string& method);
+
+    bool Lookup(const std::string& key, std::string& result);
+    void Insert(const std::string& key, const RPCResultBlock& block, const std::string& result);
+    RPCResultCacheStats GetStats();
+
+protected:
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+
+private:
+    struct Entry
+    {
+        std::string key;
+        uint256 block;
+        std::string result;
+    };
+    typedef std::list<Entry> EntryList;
+
+    Mutex cs;
+    EntryList m_lru GUARDED_BY(cs);
+    std::unordered_map<std::string, EntryList::iterator> m_index GUARDED_BY(cs);
+    size_t m_usage GUARDED_BY(cs) = 0;
+    const size_t m_max_usage;
+    uint64_t m_hits GUARDED_BY(cs) = 0;
+    uint64_t m_misses GUARDED_BY(cs) = 0;
+};
+
+/** The cache of RPC results, null unless -rpccachesize is set */
+extern std::unique_ptr<RPCResultCache> g_rpc_result_cache;
+
+#endif // BITCOIN_RPC_RESULTCACHE_H
@@ -7,20 +7,27 @@
 
 #include <fs.h>
 #include <key_io.h>
+#include <qtum/contractexecutor.h>
 #include <random.h>
+#include <rpc/resultcache.h>
 #include <rpc/util.h>
+#include <scheduler.h>
 #include <shutdown.h>
 #include <sync.h>
 #include <ui_interface.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 
+#include <event2/util.h>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 
 #include <memory> // for unique_ptr
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 
 static CCriticalSection cs_rpcWarmup;
 static std::atomic<bool> g_rpc_running{false};
@@ -31,10 +38,25 @@ static RPCTimerInterface* timerInterface = nullptr;
 /* Map of name to timer. */
 static std::map<std::string, std::unique_ptr<RPCTimerBase> > deadlineTimers;
 
+/* Threads running the items of JSON-RPC batches, and how many items of one batch may run at once. */
+static CScheduler g_rpc_batch_scheduler;
+static std::vector<std::thread> g_rpc_batch_threads;
+static int g_rpc_batch_concurrency = 1;
+
 Mutex cs_blockchange;
 std::condition_variable cond_blockchange;
 CUpdatedBlock latestblock;
 
+/** An HTTP request waiting for the tip, see RPCBlockWait */
+struct RPCPendingBlockWait
+{
+    std::unique_ptr<HTTPRequest> req;
+    UniValue id;
+    std::function<bool(const CUpdatedBlock&)> condition;
+};
+static std::map<uint64_t, RPCPendingBlockWait> g_block_waits GUARDED_BY(cs_blockchange);
+static uint64_t g_block_wait_seq GUARDED_BY(cs_blockchange) = 0;
+
 struct RPCCommandExecutionInfo
 {
     std::string method;
@@ -311,6 +333,29 @@ static UniValue getrpcinfo(const JSONRPCRequest& request)
                                  {RPCResult::Type::NUM, "duration", "The running time in microseconds"},
                             }},
                         }},
+                        {RPCResult::Type::OBJ, "result_cache", /* optional */ true, "The cache of final results, with -rpccachesize",
+                        {
+                            {RPCResult::Type::NUM, "hits", "The lookups that found a result"},
+                            {RPCResult::Type::NUM, "misses", "The lookups that did not find a result"},
+                            {RPCResult::Type::NUM, "entries", "The results in the cache"},
+                            {RPCResult::Type::NUM, "usage", "The approximate memory used by the results in bytes"},
+                            {RPCResult::Type::NUM, "max_usage", "The most memory the results may use in bytes"},
+                        }},
+                        {RPCResult::Type::OBJ, "contract_calls", /* optional */ true, "The read-only contract calls run by the EVM workers, by class, with -evmthreads",
+                        {
+                            {RPCResult::Type::OBJ, "rpc", "The calls of callcontract and the other RPCs",
+                            {
+                                {RPCResult::Type::NUM, "queued", "The calls waiting for a worker"},
+                                {RPCResult::Type::NUM, "running", "The calls running"},
+                                {RPCResult::Type::NUM, "completed", "The calls run"},
+                                {RPCResult::Type::NUM, "refused", "The calls refused because the queue was full"},
+                                {RPCResult::Type::NUM, "timedout", "The calls that timed out waiting for a worker"},
+                            }},
+                            {RPCResult::Type::OBJ, "wallet", "The calls of the wallet, same fields as rpc",
+                            {
+                                {RPCResult::Type::ELISION, "", ""},
+                            }},
+                        }},
                     }
 
                 },
@@ -333,6 +378,33 @@ static UniValue getrpcinfo(const JSONRPCRequest& request)
     UniValue result(UniValue::VOBJ);
     result.pushKV("active_commands", active_commands);
 
+    if (g_rpc_result_cache) {
+        RPCResultCacheStats stats = g_rpc_result_cache->GetStats();
+        UniValue cache(UniValue::VOBJ);
+        cache.pushKV("hits", stats.hits);
+        cache.pushKV("misses", stats.misses);
+        cache.pushKV("entries", (uint64_t)stats.entries);
+        cache.pushKV("usage", (uint64_t)stats.usage);
+        cache.pushKV("max_usage", (uint64_t)stats.max_usage);
+        result.pushKV("result_cache", cache);
+    }
+
+    if (g_contract_call_executor) {
+        UniValue calls(UniValue::VOBJ);
+        const std::pair<const char*, ContractCallClass> classes[] = {{"rpc", ContractCallClass::RPC}, {"wallet", ContractCallClass::WALLET}};
+        for (const auto& cls : classes) {
+            ContractCallClassStats stats = g_contract_call_executor->GetStats(cls.second);
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("queued", (uint64_t)stats.queued);
+            entry.pushKV("running", (uint64_t)stats.running);
+            entry.pushKV("completed", stats.completed);
+            entry.pushKV("refused", stats.refused);
+            entry.pushKV("timedout", stats.timedout);
+            calls.pushKV(cls.first, entry);
+        }
+        result.pushKV("contract_calls", calls);
+    }
+
     return result;
 }
 
@@ -385,6 +457,12 @@ bool CRPCTable::appendCommand(const std::string& name, const CRPCCommand* pcmd)
 void StartRPC()
 {
     LogPrint(BCLog::RPC, "Starting RPC\n");
+    int batch_threads = std::max<int64_t>(0, gArgs.GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS));
+    g_rpc_batch_concurrency = std::max<int64_t>(1, std::min<int64_t>(gArgs.GetArg("-rpcbatchconcurrency", DEFAULT_RPC_BATCH_CONCURRENCY), batch_threads + 1));
+    for (int i = 0; i < batch_threads; i++) {
+        g_rpc_batch_threads.emplace_back(&TraceThread<std::function<void()>>, "rpcbatch",
+                                         std::function<void()>(std::bind(&CScheduler::serviceQueue, &g_rpc_batch_scheduler)));
+    }
     g_rpc_running = true;
     g_rpcSignals.Started();
 }
@@ -399,6 +477,13 @@ void InterruptRPC()
 void StopRPC()
 {
     LogPrint(BCLog::RPC, "Stopping RPC\n");
+    // Pending batch items are left to the HTTP workers that wait for them
+    g_rpc_batch_scheduler.stop(false);
+    for (std::thread& thread : g_rpc_batch_threads) {
+        thread.join();
+    }
+    g_rpc_batch_threads.clear();
+    g_rpc_batch_concurrency = 1;
     deadlineTimers.clear();
     DeleteAuthCookie();
     g_rpcSignals.Stopped();
@@ -430,6 +515,79 @@ bool RPCIsInWarmup(std::string *outStatus)
     return fRPCInWarmup;
 }
 
+static void ReplyBlockWait(RPCPendingBlockWait& wait, const CUpdatedBlock& block)
+{
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("hash", block.hash.GetHex());
+    result.pushKV("height", block.height);
+    wait.req->WriteHeader("Content-Type", "application/json");
+    wait.req->WriteReply(HTTP_OK, JSONRPCRawReply(result.write(), wait.id) + "\n");
+}
+
+/** Reply to one deferred wait when its timeout passes, unless the tip already ended it */
+static void ExpireBlockWait(uint64_t seq)
+{
+    RPCPendingBlockWait wait;
+    CUpdatedBlock block;
+    {
+        LOCK(cs_blockchange);
+        auto it = g_block_waits.find(seq);
+        if (it == g_block_waits.end())
+            return;
+        wait = std::move(it->second);
+        g_block_waits.erase(it);
+        block = latestblock;
+    }
+    ReplyBlockWait(wait, block);
+}
+
+void RPCDeferBlockWait(std::unique_ptr<HTTPRequest> req, const UniValue& id, const RPCBlockWait& wait)
+{
+    RPCPendingBlockWait pending{std::move(req), id, wait.condition};
+    CUpdatedBlock block;
+    uint64_t seq = 0;
+    {
+        LOCK(cs_blockchange);
+        block = latestblock;
+        if (IsRPCRunning() && !wait.condition(block)) {
+            seq = ++g_block_wait_seq;
+            g_block_waits.emplace(seq, std::move(pending));
+        }
+    }
+    if (seq == 0) {
+        ReplyBlockWait(pending, block);
+        return;
+    }
+    if (wait.timeout > 0) {
+        struct timeval tv;
+        tv.tv_sec = wait.timeout / 1000;
+        tv.tv_usec = (wait.timeout % 1000) * 1000;
+        HTTPEvent* ev = new HTTPEvent(EventBase(), true, nullptr, [seq] { ExpireBlockWait(seq); });
+        ev->trigger(&tv);
+    }
+}
+
+void RPCNotifyBlockWaits()
+{
+    std::vector<RPCPendingBlockWait> done;
+    CUpdatedBlock block;
+    {
+        LOCK(cs_blockchange);
+        block = latestblock;
+        for (auto it = g_block_waits.begin(); it != g_block_waits.end();) {
+            if (!IsRPCRunning() || it->second.condition(block)) {
+                done.push_back(std::move(it->second));
+                it = g_block_waits.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (RPCPendingBlockWait& wait : done) {
+        ReplyBlockWait(wait, block);
+    }
+}
+
 JSONRPCRequest::JSONRPCRequest(HTTPRequest *_req): JSONRPCRequest() {
 	req = _req;
 }
@@ -509,15 +667,22 @@ bool IsDeprecatedRPCEnabled(const std::string& method)
     return find(enabled_methods.begin(), enabled_methods.end(), method) != enabled_methods.end();
 }
 
-static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
+/** Execute one request of a batch and return its reply as JSON text */
+static std::string JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
 {
     UniValue rpc_result(UniValue::VOBJ);
 
     try {
         jreq.parse(req);
+        if (jreq.rawResult) {
+            jreq.rawResult = std::make_shared<std::string>();
+        }
 
         UniValue result = tableRPC.execute(jreq);
-        rpc_result = JSONRPCReplyObj(result, NullUniValue, jreq.id);
+        if (jreq.rawResult && !jreq.rawResult->empty()) {
+            return JSONRPCRawReply(*jreq.rawResult, jreq.id);
+        }
+        return JSONRPCRawReply(result.write(), jreq.id);
     }
     catch (const UniValue& objError)
     {
@@ -529,16 +694,119 @@ static UniValue JSONRPCExecOne(JSONRPCRequest jreq, const UniValue& req)
                                      JSONRPCError(RPC_PARSE_ERROR, e.what()), jreq.id);
     }
 
-    return rpc_result;
+    return rpc_result.write();
+}
+
+/** Calls that only read and may run in any order with the other calls of a batch */
+static const std::unordered_set<std::string> setBatchParallelMethods = {
+    "getbestblockhash", "getblock", "getblockcount", "getblockhash", "getblockhashes", "getblockheader",
+    "getblockstats", "getchaintxstats", "getdifficulty", "getrawtransaction", "decoderawtransaction",
+    "decodescript", "gettxout", "getmempoolentry", "getrawmempool", "gettransactionreceipt", "getblockreceipts", "searchlogs",
+    "callcontract", "callcontractbatch", "getaccountinfo", "getstorage", "listcontracts", "gethexaddress", "fromhexaddress",
+    "getaddressbalance", "getaddressdeltas", "getaddresstxids", "getaddressutxos", "getaddressmempool",
+    "getspentinfo", "getdelegationinfoforaddress", "getdelegationsforstaker",
+};
+
+static bool IsBatchParallelRequest(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& method = find_value(req.get_obj(), "method");
+    return method.isStr() && setBatchParallelMethods.count(method.get_str());
+}
+
+/** The items of a batch run by the calling thread and the batch threads that joined it */
+struct RPCBatchRun
+{
+    std::function<void(size_t)> item;
+    size_t end;
+
+    Mutex cs;
+    std::condition_variable cond;
+    //! Next item to run and how many threads run items, guarded by cs
+    size_t next;
+    int running = 0;
+};
+
+/**
+ * Run items of the batch until none is left. The items are only touched while some are
+ * left, a batch thread that starts after the caller returned finds none.
+ */
+static void RunBatchItems(RPCBatchRun& run)
+{
+    {
+        LOCK(run.cs);
+        if (run.next >= run.end)
+            return;
+        run.running++;
+    }
+    while (true) {
+        size_t idx;
+        {
+            LOCK(run.cs);
+            if (run.next >= run.end) {
+                if (--run.running == 0)
+                    run.cond.notify_all();
+                return;
+            }
+            idx = run.next++;
+        }
+        run.item(idx);
+    }
+}
+
+void RPCRunParallel(size_t begin, size_t end, const std::function<void(size_t)>& item)
+{
+    if (end - begin < 2 || g_rpc_batch_concurrency < 2) {
+        for (size_t idx = begin; idx < end; idx++)
+            item(idx);
+        return;
+    }
+
+    // The batch threads join in when they are free, the caller never waits for one that did not start
+    auto run = std::make_shared<RPCBatchRun>();
+    run->item = item;
+    run->next = begin;
+    run->end = end;
+    int helpers = std::min<size_t>(g_rpc_batch_concurrency, end - begin) - 1;
+    for (int i = 0; i < helpers; i++) {
+        g_rpc_batch_scheduler.schedule([run] { RunBatchItems(*run); });
+    }
+    RunBatchItems(*run);
+    WAIT_LOCK(run->cs, lock);
+    run->cond.wait(lock, [&run] { return run->running == 0; });
 }
 
 std::string JSONRPCExecBatch(JSONRPCRequest jreq, const UniValue& vReq)
 {
-    UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(jreq, vReq[reqIdx]));
+    // The replies are JSON text already, join them into the reply array
+    std::string ret = "[";
+    auto append = [&ret](const std::string& reply) {
+        if (ret.size() > 1)
+            ret.push_back(',');
+        ret += reply;
+    };
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size()) {
+        unsigned int reqEnd = reqIdx;
+        while (reqEnd < vReq.size() && IsBatchParallelRequest(vReq[reqEnd]))
+            reqEnd++;
+        if (reqEnd == reqIdx) {
+            // Calls that may write run alone, in the order of the batch
+            append(JSONRPCExecOne(jreq, vReq[reqIdx++]));
+            continue;
+        }
 
-    return ret.write() + "\n";
+        std::vector<std::string> results(reqEnd);
+        RPCRunParallel(reqIdx, reqEnd, [&](size_t idx) {
+            results[idx] = JSONRPCExecOne(jreq, vReq[idx]);
+        });
+        for (; reqIdx < reqEnd; reqIdx++)
+            append(results[reqIdx]);
+    }
+
+    ret += "]\n";
+    return ret;
 }
 
 /**
@@ -591,6 +859,24 @@ static inline JSONRPCRequest transformNamedArguments(const JSONRPCRequest& in, c
     return out;
 }
 
+static UniValue ExecuteCommand(const CRPCCommand& command, const JSONRPCRequest& request)
+{
+    try
+    {
+        RPCCommandExecution execution(request.strMethod);
+        // Execute, convert arguments to array if necessary
+        if (request.params.isObject()) {
+            return command.actor(transformNamedArguments(request, command.argNames));
+        } else {
+            return command.actor(request);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
 UniValue CRPCTable::execute(const JSONRPCRequest &request) const
 {
     // Return immediately if in warmup
@@ -605,20 +891,21 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
     if (!pcmd)
         throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
 
-    try
-    {
-        RPCCommandExecution execution(request.strMethod);
-        // Execute, convert arguments to array if necessary
-        if (request.params.isObject()) {
-            return pcmd->actor(transformNamedArguments(request, pcmd->argNames));
-        } else {
-            return pcmd->actor(request);
-        }
-    }
-    catch (const std::exception& e)
-    {
-        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    // Results written as JSON text may come from the result cache
+    if (g_rpc_result_cache && request.rawResult && RPCResultCache::IsCacheable(request.strMethod)) {
+        std::string key = request.strMethod + '\0' + request.params.write();
+        if (g_rpc_result_cache->Lookup(key, *request.rawResult))
+            return NullUniValue;
+
+        JSONRPCRequest cacheRequest = request;
+        cacheRequest.resultBlock = std::make_shared<RPCResultBlock>();
+        UniValue result = ExecuteCommand(*pcmd, cacheRequest);
+        if (cacheRequest.resultBlock->height >= 0)
+            g_rpc_result_cache->Insert(key, *cacheRequest.resultBlock, request.rawResult->empty() ? result.write() : *request.rawResult);
+        return result;
     }
+
+    return ExecuteCommand(*pcmd, request);
 }
 
 std::vector<std::string> CRPCTable::listCommands() const
@@ -10,8 +10,10 @@
 #include <rpc/protocol.h>
 #include <uint256.h>
 
+#include <functional>
 #include <list>
 #include <map>
+#include <memory>
 #include <stdint.h>
 #include <string>
 
@@ -22,6 +24,10 @@
 #include <util/system.h>
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
+//! -rpcbatchthreads default, the threads that run the items of JSON-RPC batches next to the HTTP worker
+static const int DEFAULT_RPC_BATCH_THREADS = 4;
+//! -rpcbatchconcurrency default, the most items of one batch that run at the same time
+static const int DEFAULT_RPC_BATCH_CONCURRENCY = 4;
 
 struct CUpdatedBlock
 {
@@ -33,7 +39,24 @@ extern Mutex cs_blockchange;
 extern std::condition_variable cond_blockchange;
 extern CUpdatedBlock latestblock;
 
+/**
+ * Wait of waitfornewblock, waitforblock or waitforblockheight handed back to the HTTP server.
+ * The reply is written once the tip satisfies the condition, the timeout (in milliseconds,
+ * 0 for none) passes or RPC stops, without a worker thread blocking in between.
+ */
+struct RPCBlockWait
+{
+    std::function<bool(const CUpdatedBlock&)> condition;
+    int timeout = 0;
+};
+
+/** Take over a deferred HTTP request and reply to it with the tip once its wait is over */
+void RPCDeferBlockWait(std::unique_ptr<HTTPRequest> req, const UniValue& id, const RPCBlockWait& wait);
+/** Reply to the deferred waits that are over, called whenever the tip changes or RPC stops */
+void RPCNotifyBlockWaits();
+
 class CRPCCommand;
+struct RPCResultBlock;
 
 namespace RPCServer
 {
@@ -63,6 +86,24 @@ public:
 
     bool isLongPolling;
 
+    /**
+     * Set when the reply is sent as JSON text. Calls with large results then write their
+     * result into it with a JSONStreamWriter and return NullUniValue.
+     */
+    std::shared_ptr<std::string> rawResult;
+
+    /**
+     * Set on single requests over HTTP. Calls waiting for the tip then fill in their condition
+     * and return at once, and the reply is written by RPCDeferBlockWait.
+     */
+    std::shared_ptr<RPCBlockWait> blockWait;
+
+    /**
+     * Set when the result may be kept by the RPC result cache. Calls whose result only depends
+     * on one block of the active chain fill in that block.
+     */
+    std::shared_ptr<RPCResultBlock> resultBlock;
+
     /**
      * If using batch JSON request, this object won't get the underlying HTTPRequest.
      */
@@ -261,7 +302,16 @@ extern std::string HelpExampleRpc(const std::string& methodname, const std::stri
 void StartRPC();
 void InterruptRPC();
 void StopRPC();
+/**
+ * Execute a JSON-RPC batch and return the replies in the order of the requests. Consecutive
+ * read-only calls are spread over the batch threads, the other calls run one by one in order.
+ */
 std::string JSONRPCExecBatch(JSONRPCRequest jreq, const UniValue& vReq);
+/**
+ * Call item for each index in [begin, end), spread over the calling thread and the batch
+ * threads, and return when all calls returned. The calls must not throw.
+ */
+void RPCRunParallel(size_t begin, size_t end, const std::function<void(size_t)>& item);
 
 // Retrieves any serialization flags requested in command line argument
 int RPCSerializationFlags();
@@ -7,6 +7,7 @@
 #include <random.h>
 #include <reverselock.h>
 
+#include <algorithm>
 #include <assert.h>
 #include <utility>
 
@@ -29,7 +30,18 @@ static boost::system_time toPosixTime(const boost::chrono::system_clock::time_po
 }
 #endif
 
-void CScheduler::serviceQueue()
+boost::chrono::system_clock::time_point CScheduler::firstTime(bool fHighOnly) const
+{
+    const TaskQueue& high = taskQueue[PRIORITY_HIGH];
+    const TaskQueue& normal = taskQueue[PRIORITY_NORMAL];
+    if (fHighOnly || normal.empty())
+        return high.begin()->first;
+    if (high.empty())
+        return normal.begin()->first;
+    return std::min(high.begin()->first, normal.begin()->first);
+}
+
+void CScheduler::serviceLanes(bool fHighOnly)
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
     ++nThreadsServicingQueue;
@@ -39,12 +51,12 @@ void CScheduler::serviceQueue()
     // is called.
     while (!shouldStop()) {
         try {
-            if (!shouldStop() && taskQueue.empty()) {
+            if (!shouldStop() && empty(fHighOnly)) {
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
                 // Use this chance to get more entropy
                 RandAddSeedSleep();
             }
-            while (!shouldStop() && taskQueue.empty()) {
+            while (!shouldStop() && empty(fHighOnly)) {
                 // Wait until there is something to do.
                 newTaskScheduled.wait(lock);
             }
@@ -54,32 +66,49 @@ void CScheduler::serviceQueue()
 
 // wait_until needs boost 1.50 or later; older versions have timed_wait:
 #if BOOST_VERSION < 105000
-            while (!shouldStop() && !taskQueue.empty() &&
-                   newTaskScheduled.timed_wait(lock, toPosixTime(taskQueue.begin()->first))) {
+            while (!shouldStop() && !empty(fHighOnly) &&
+                   newTaskScheduled.timed_wait(lock, toPosixTime(firstTime(fHighOnly)))) {
                 // Keep waiting until timeout
             }
 #else
             // Some boost versions have a conflicting overload of wait_until that returns void.
             // Explicitly use a template here to avoid hitting that overload.
-            while (!shouldStop() && !taskQueue.empty()) {
-                boost::chrono::system_clock::time_point timeToWaitFor = taskQueue.begin()->first;
+            while (!shouldStop() && !empty(fHighOnly)) {
+                boost::chrono::system_clock::time_point timeToWaitFor = firstTime(fHighOnly);
                 if (newTaskScheduled.wait_until<>(lock, timeToWaitFor) == boost::cv_status::timeout)
                     break; // Exit loop after timeout, it means we reached the time of the event
             }
 #endif
             // If there are multiple threads, the queue can empty while we're waiting (another
             // thread may service the task we were waiting on).
-            if (shouldStop() || taskQueue.empty())
+            if (shouldStop() || empty(fHighOnly))
                 continue;
 
-            Function f = taskQueue.begin()->second;
-            taskQueue.erase(taskQueue.begin());
+            // A due high priority task goes first. If another thread took the task we
+            // waited for, the first one left may not be due yet, so wait again.
+            boost::chrono::system_clock::time_point now = boost::chrono::system_clock::now();
+            Priority priority = PRIORITY_HIGH;
+            if (taskQueue[PRIORITY_HIGH].empty() || taskQueue[PRIORITY_HIGH].begin()->first > now) {
+                if (fHighOnly || taskQueue[PRIORITY_NORMAL].empty() || taskQueue[PRIORITY_NORMAL].begin()->first > now)
+                    continue;
+                priority = PRIORITY_NORMAL;
+            }
+
+            TaskQueue& queue = taskQueue[priority];
+            boost::chrono::system_clock::time_point scheduled = queue.begin()->first;
+            Function f = queue.begin()->second;
+            queue.erase(queue.begin());
 
             {
                 // Unlock before calling f, so it can reschedule itself or another task
                 // without deadlocking:
                 reverse_lock<boost::unique_lock<boost::mutex> > rlock(lock);
+                LaneStats& stats = laneStats[priority];
+                stats.nDelay += boost::chrono::duration_cast<boost::chrono::microseconds>(now - scheduled).count();
+                boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
                 f();
+                stats.nRunTime += boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now() - start).count();
+                stats.nTasks++;
             }
         } catch (...) {
             --nThreadsServicingQueue;
@@ -87,7 +116,7 @@ void CScheduler::serviceQueue()
         }
     }
     --nThreadsServicingQueue;
-    newTaskScheduled.notify_one();
+    newTaskScheduled.notify_all();
 }
 
 void CScheduler::stop(bool drain)
@@ -102,13 +131,14 @@ void CScheduler::stop(bool drain)
     newTaskScheduled.notify_all();
 }
 
-void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t)
+void CScheduler::schedule(CScheduler::Function f, boost::chrono::system_clock::time_point t, Priority priority)
 {
     {
         boost::unique_lock<boost::mutex> lock(newTaskMutex);
-        taskQueue.insert(std::make_pair(t, f));
+        taskQueue[priority].insert(std::make_pair(t, f));
     }
-    newTaskScheduled.notify_one();
+    // A thread servicing only the high lane cannot take a normal task, wake them all
+    newTaskScheduled.notify_all();
 }
 
 void CScheduler::scheduleFromNow(CScheduler::Function f, int64_t deltaMilliSeconds)
@@ -131,10 +161,17 @@ size_t CScheduler::getQueueInfo(boost::chrono::system_clock::time_point &first,
                              boost::chrono::system_clock::time_point &last) const
 {
     boost::unique_lock<boost::mutex> lock(newTaskMutex);
-    size_t result = taskQueue.size();
-    if (!taskQueue.empty()) {
-        first = taskQueue.begin()->first;
-        last = taskQueue.rbegin()->first;
+    size_t result = 0;
+    bool fFound = false;
+    for (const TaskQueue& queue : taskQueue) {
+        if (queue.empty())
+            continue;
+        result += queue.size();
+        if (!fFound || queue.begin()->first < first)
+            first = queue.begin()->first;
+        if (!fFound || queue.rbegin()->first > last)
+            last = queue.rbegin()->first;
+        fFound = true;
     }
     return result;
 }
@@ -154,7 +191,7 @@ void SingleThreadedSchedulerClient::MaybeScheduleProcessQueue() {
         if (m_are_callbacks_running) return;
         if (m_callbacks_pending.empty()) return;
     }
-    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this));
+    m_pscheduler->schedule(std::bind(&SingleThreadedSchedulerClient::ProcessQueue, this), boost::chrono::system_clock::now(), m_priority);
 }
 
 void SingleThreadedSchedulerClient::ProcessQueue() {
@@ -12,6 +12,7 @@
 //
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
+#include <atomic>
 #include <map>
 
 #include <sync.h>
@@ -42,8 +43,24 @@ public:
 
     typedef std::function<void()> Function;
 
+    // Lanes of the queue. Due high priority tasks run before due normal ones,
+    // and threads servicing only the high lane never wait behind a slow normal task.
+    enum Priority {
+        PRIORITY_NORMAL,
+        PRIORITY_HIGH,
+        PRIORITY_COUNT
+    };
+
+    // Tasks run and time spent in the tasks of a lane, in microseconds. The delay
+    // is the time between the scheduled time of a task and its start.
+    struct LaneStats {
+        std::atomic<uint64_t> nTasks{0};
+        std::atomic<uint64_t> nRunTime{0};
+        std::atomic<uint64_t> nDelay{0};
+    };
+
     // Call func at/after time t
-    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now());
+    void schedule(Function f, boost::chrono::system_clock::time_point t=boost::chrono::system_clock::now(), Priority priority=PRIORITY_NORMAL);
 
     // Convenience method: call f once deltaMilliSeconds from now
     void scheduleFromNow(Function f, int64_t deltaMilliSeconds);
@@ -59,7 +76,10 @@ public:
 
     // Services the queue 'forever'. Should be run in a thread,
     // and interrupted using boost::interrupt_thread
-    void serviceQueue();
+    void serviceQueue() { serviceLanes(false); }
+
+    // Same as serviceQueue, but only runs the tasks of the high priority lane
+    void serviceHighPriorityQueue() { serviceLanes(true); }
 
     // Tell any threads running serviceQueue to stop as soon as they're
     // done servicing whatever task they're currently servicing (drain=false)
@@ -74,14 +94,22 @@ public:
     // Returns true if there are threads actively running in serviceQueue()
     bool AreThreadsServicingQueue() const;
 
+    const LaneStats& getLaneStats(Priority priority) const { return laneStats[priority]; }
+
 private:
-    std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
+    typedef std::multimap<boost::chrono::system_clock::time_point, Function> TaskQueue;
+    TaskQueue taskQueue[PRIORITY_COUNT];
+    LaneStats laneStats[PRIORITY_COUNT];
     boost::condition_variable newTaskScheduled;
     mutable boost::mutex newTaskMutex;
     int nThreadsServicingQueue;
     bool stopRequested;
     bool stopWhenEmpty;
-    bool shouldStop() const { return stopRequested || (stopWhenEmpty && taskQueue.empty()); }
+    bool shouldStop() const { return stopRequested || (stopWhenEmpty && empty(false)); }
+    bool empty(bool fHighOnly) const { return taskQueue[PRIORITY_HIGH].empty() && (fHighOnly || taskQueue[PRIORITY_NORMAL].empty()); }
+    // Time of the first task a thread servicing the lanes may run. Precondition: !empty(fHighOnly)
+    boost::chrono::system_clock::time_point firstTime(bool fHighOnly) const;
+    void serviceLanes(bool fHighOnly);
 };
 
 /**
@@ -97,6 +125,7 @@ private:
 class SingleThreadedSchedulerClient {
 private:
     CScheduler *m_pscheduler;
+    const CScheduler::Priority m_priority;
 
     CCriticalSection m_cs_callbacks_pending;
     std::list<std::function<void ()>> m_callbacks_pending GUARDED_BY(m_cs_callbacks_pending);
@@ -106,7 +135,7 @@ private:
     void ProcessQueue();
 
 public:
-    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn) : m_pscheduler(pschedulerIn) {}
+    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn, CScheduler::Priority priority = CScheduler::PRIORITY_NORMAL) : m_pscheduler(pschedulerIn), m_priority(priority) {}
 
     /**
      * Add a callback to be executed. Callbacks are executed serially
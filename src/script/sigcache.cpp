@@ -14,6 +14,8 @@
 #include <cuckoocache.h>
 #include <boost/thread.hpp>
 
+#include <map>
+
 namespace {
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
@@ -59,6 +61,52 @@ public:
     }
 };
 
+/**
+ * Public keys recovered from compact block signatures, so the key of a block
+ * signature is not recovered again when the block is checked after its header
+ */
+class CRecoveredKeyCache
+{
+private:
+    //! Entries are SHA256(nonce || hash || signature)
+    uint256 nonce;
+    std::map<uint256, CPubKey> mapKeys;
+    boost::shared_mutex cs_keycache;
+
+public:
+    static const size_t MAX_ENTRIES = 10000;
+
+    CRecoveredKeyCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void
+    ComputeEntry(uint256& entry, const uint256 &hash, const std::vector<unsigned char>& vchSig)
+    {
+        CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    }
+
+    bool
+    Get(const uint256& entry, CPubKey& pubkey)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_keycache);
+        auto it = mapKeys.find(entry);
+        if (it == mapKeys.end())
+            return false;
+        pubkey = it->second;
+        return true;
+    }
+
+    void Set(const uint256& entry, const CPubKey& pubkey)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_keycache);
+        if (mapKeys.size() >= MAX_ENTRIES)
+            mapKeys.clear();
+        mapKeys[entry] = pubkey;
+    }
+};
+
 /* In previous versions of this code, signatureCache was a local static variable
  * in CachingTransactionSignatureChecker::VerifySignature.  We initialize
  * signatureCache outside of VerifySignature to avoid the atomic operation per
@@ -66,6 +114,7 @@ public:
  * signatureCache could be made local to VerifySignature.
 */
 static CSignatureCache signatureCache;
+static CRecoveredKeyCache recoveredKeyCache;
 } // namespace
 
 // To be called once in AppInitMain/BasicTestingSetup to initialize the
@@ -104,4 +153,44 @@ bool CachingTransactionSignatureOutputChecker::VerifySignature(const std::vector
     if (store)
         signatureCache.Set(entry);
     return true;
-}
\ No newline at end of file
+}
+
+bool CachedRecoverCompact(const uint256& hash, const std::vector<unsigned char>& vchSig, CPubKey& pubkey)
+{
+    uint256 entry;
+    recoveredKeyCache.ComputeEntry(entry, hash, vchSig);
+    if (recoveredKeyCache.Get(entry, pubkey))
+        return true;
+    if (!pubkey.RecoverCompact(hash, vchSig))
+        return false;
+    recoveredKeyCache.Set(entry, pubkey);
+    return true;
+}
+
+bool GetCachedRecoveredKey(const uint256& hash, const std::vector<unsigned char>& vchSig, CPubKey& pubkey)
+{
+    uint256 entry;
+    recoveredKeyCache.ComputeEntry(entry, hash, vchSig);
+    return recoveredKeyCache.Get(entry, pubkey);
+}
+
+void AddCachedRecoveredKey(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+{
+    uint256 entry;
+    recoveredKeyCache.ComputeEntry(entry, hash, vchSig);
+    recoveredKeyCache.Set(entry, pubkey);
+}
+
+bool CachedVerifySignature(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey)
+{
+    if (vchSig.empty() || !pubkey.IsValid())
+        return false;
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, hash, vchSig, pubkey);
+    if (signatureCache.Get(entry, false))
+        return true;
+    if (!pubkey.Verify(hash, vchSig))
+        return false;
+    signatureCache.Set(entry);
+    return true;
+}
@@ -18,6 +18,7 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
 class CPubKey;
+class uint256;
 
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
@@ -64,4 +65,13 @@ public:
 
 void InitSignatureCache();
 
+/** Recover the public key of a compact block signature, the recently recovered keys are cached */
+bool CachedRecoverCompact(const uint256& hash, const std::vector<unsigned char>& vchSig, CPubKey& pubkey);
+/** Look up the recovered public key of a compact block signature without recovering it */
+bool GetCachedRecoveredKey(const uint256& hash, const std::vector<unsigned char>& vchSig, CPubKey& pubkey);
+/** Add a public key recovered elsewhere to the recovered key cache */
+void AddCachedRecoveredKey(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey);
+/** Verify a block signature through the signature cache */
+bool CachedVerifySignature(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
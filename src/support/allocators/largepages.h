@@ -0,0 +1,50 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_LARGEPAGES_H
+#define BITCOIN_SUPPORT_ALLOCATORS_LARGEPAGES_H
+
+#include <support/largepages.h>
+
+#include <memory>
+
+//
+// Allocator that places its contents on huge pages once -largepages
+// enabled the shared LargePagePool, and on the general heap before.
+//
+template <typename T>
+struct large_page_allocator : public std::allocator<T> {
+    // MSVC8 default copy constructor is broken
+    typedef std::allocator<T> base;
+    typedef typename base::size_type size_type;
+    typedef typename base::difference_type difference_type;
+    typedef typename base::pointer pointer;
+    typedef typename base::const_pointer const_pointer;
+    typedef typename base::reference reference;
+    typedef typename base::const_reference const_reference;
+    typedef typename base::value_type value_type;
+    large_page_allocator() noexcept {}
+    large_page_allocator(const large_page_allocator& a) noexcept : base(a) {}
+    template <typename U>
+    large_page_allocator(const large_page_allocator<U>& a) noexcept : base(a)
+    {
+    }
+    ~large_page_allocator() noexcept {}
+    template <typename _Other>
+    struct rebind {
+        typedef large_page_allocator<_Other> other;
+    };
+
+    T* allocate(std::size_t n, const void* hint = 0)
+    {
+        return static_cast<T*>(LargePagePool::Instance().alloc(sizeof(T) * n));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        LargePagePool::Instance().free(p, sizeof(T) * n);
+    }
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_LARGEPAGES_H
@@ -0,0 +1,180 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <support/largepages.h>
+
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
+#ifndef WIN32
+#include <sys/mman.h> // for mmap
+#endif
+
+#include <algorithm>
+#include <new>
+
+/** Size of the huge pages the arenas are aligned to, the x86-64 and arm64 2 MiB ones */
+static const size_t HUGE_PAGE_SIZE = 2 << 20;
+
+static inline size_t align_up(size_t x, size_t align)
+{
+    return (x + align - 1) & ~(align - 1);
+}
+
+LargePagePool::~LargePagePool()
+{
+#ifdef __linux__
+    for (const auto& arena : m_arenas) {
+        munmap(reinterpret_cast<void*>(arena.second), arena.first - arena.second);
+    }
+    for (const auto& direct : m_direct) {
+        munmap(direct.first, direct.second);
+    }
+#endif
+}
+
+LargePagePool& LargePagePool::Instance()
+{
+    // Never destroyed, the caches using it may outlive static destruction
+    static LargePagePool* pool = new LargePagePool();
+    return *pool;
+}
+
+void* LargePagePool::MapPages(size_t size)
+{
+#ifdef __linux__
+    if (!m_explicit_failed) {
+        void* addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (addr != MAP_FAILED) {
+            m_explicit_bytes += size;
+            return addr;
+        }
+        // The reserved huge pages are used up or there are none, do not ask again
+        m_explicit_failed = true;
+    }
+    // Map a huge page more than needed and trim it, so that the range is made of whole huge pages
+    size_t mapped = size + HUGE_PAGE_SIZE;
+    void* addr = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+    char* base = static_cast<char*>(addr);
+    char* aligned = reinterpret_cast<char*>(align_up(reinterpret_cast<uintptr_t>(base), HUGE_PAGE_SIZE));
+    if (aligned > base) {
+        munmap(base, aligned - base);
+    }
+    if (base + mapped > aligned + size) {
+        munmap(aligned + size, base + mapped - (aligned + size));
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+    return aligned;
+#else
+    return nullptr;
+#endif
+}
+
+bool LargePagePool::Enable()
+{
+#ifdef __linux__
+    m_enabled = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void* LargePagePool::alloc(size_t size)
+{
+    if (!m_enabled || (size > MAX_POOLED_SIZE && size < DIRECT_SIZE)) {
+        return ::operator new(size);
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (size >= DIRECT_SIZE) {
+        size_t mapped = align_up(size, HUGE_PAGE_SIZE);
+        void* ptr = MapPages(mapped);
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        m_direct.emplace(ptr, mapped);
+        m_direct_bytes += mapped;
+        return ptr;
+    }
+
+    size = align_up(std::max<size_t>(size, 1), POOL_ALIGN);
+    void*& head = m_free[size / POOL_ALIGN];
+    if (head) {
+        void* ptr = head;
+        head = *static_cast<void**>(ptr);
+        m_free_bytes -= size;
+        m_used += size;
+        return ptr;
+    }
+    if (m_arena_end - m_arena_pos < (ptrdiff_t)size) {
+        // The rest of the current arena is too small for this size class, so it stays unused
+        void* arena = MapPages(ARENA_SIZE);
+        if (!arena) {
+            throw std::bad_alloc();
+        }
+        m_arena_pos = static_cast<char*>(arena);
+        m_arena_end = m_arena_pos + ARENA_SIZE;
+        m_arenas.emplace(reinterpret_cast<uintptr_t>(m_arena_end), reinterpret_cast<uintptr_t>(m_arena_pos));
+    }
+    void* ptr = m_arena_pos;
+    m_arena_pos += size;
+    m_used += size;
+    return ptr;
+}
+
+void LargePagePool::free(void* ptr, size_t size)
+{
+    if (!ptr) {
+        return;
+    }
+    if (!m_enabled) {
+        ::operator delete(ptr);
+        return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (size >= DIRECT_SIZE) {
+        auto it = m_direct.find(ptr);
+        if (it != m_direct.end()) {
+#ifdef __linux__
+            munmap(ptr, it->second);
+#endif
+            m_direct_bytes -= it->second;
+            m_direct.erase(it);
+            return;
+        }
+    } else if (size <= MAX_POOLED_SIZE) {
+        uintptr_t addr = reinterpret_cast<uintptr_t>(ptr);
+        auto it = m_arenas.upper_bound(addr);
+        if (it != m_arenas.end() && it->second <= addr) {
+            size = align_up(std::max<size_t>(size, 1), POOL_ALIGN);
+            void*& head = m_free[size / POOL_ALIGN];
+            *static_cast<void**>(ptr) = head;
+            head = ptr;
+            m_used -= size;
+            m_free_bytes += size;
+            return;
+        }
+    }
+    // Sizes served by the heap, or allocated before the pool was enabled
+    lock.unlock();
+    ::operator delete(ptr);
+}
+
+LargePagePool::Stats LargePagePool::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats r;
+    r.used = m_used;
+    r.free = m_free_bytes + (m_arena_end - m_arena_pos);
+    r.arenas = m_arenas.size() * ARENA_SIZE;
+    r.direct = m_direct_bytes;
+    r.explicit_pages = m_explicit_bytes;
+    return r;
+}
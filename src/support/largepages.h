@@ -0,0 +1,92 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_LARGEPAGES_H
+#define BITCOIN_SUPPORT_LARGEPAGES_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+
+/** Default for -largepages */
+static const bool DEFAULT_LARGE_PAGES = false;
+
+/**
+ * Pool of memory backed by huge pages, for the nodes of large caches whose random lookups
+ * would otherwise miss the TLB on most accesses, like the coins cache with a multi-GB -dbcache.
+ *
+ * Small allocations are carved out of ARENA_SIZE arenas and recycled through free lists per
+ * size class, allocations of at least DIRECT_SIZE are mapped on their own. Explicit huge pages
+ * (MAP_HUGETLB) are used while the kernel has reserved ones, then transparent huge pages. The
+ * pages of an arena are only placed on first touch, so with the default NUMA policy they end
+ * up on the node of the thread that fills the cache, which is the validation thread.
+ *
+ * Memory of the arenas is kept for reuse when freed, it is not returned to the system. Until
+ * Enable() is called, and on systems without huge pages, everything goes to the general heap.
+ */
+class LargePagePool
+{
+public:
+    /** Size of one arena, a multiple of the huge page size */
+    static const size_t ARENA_SIZE = 32 << 20;
+    /** Alignment and granularity of the small allocations */
+    static const size_t POOL_ALIGN = 16;
+    /** Largest allocation served from the arenas */
+    static const size_t MAX_POOLED_SIZE = 256;
+    /** Smallest allocation mapped on its own, like the bucket arrays of big hash tables */
+    static const size_t DIRECT_SIZE = 1 << 20;
+
+    struct Stats
+    {
+        size_t used;
+        size_t free;
+        size_t arenas;
+        size_t direct;
+        size_t explicit_pages;
+    };
+
+    LargePagePool() {}
+    ~LargePagePool();
+
+    LargePagePool(const LargePagePool& other) = delete;
+    LargePagePool& operator=(const LargePagePool&) = delete;
+
+    /** Serve allocations from huge pages from now on. Returns false if the system has none */
+    bool Enable();
+    bool IsEnabled() const { return m_enabled; }
+
+    /** Allocate size bytes, throwing std::bad_alloc when out of memory */
+    void* alloc(size_t size);
+    /** Free memory returned by alloc(size) */
+    void free(void* ptr, size_t size);
+
+    Stats stats() const;
+
+    /** The pool shared by the caches, see large_page_allocator */
+    static LargePagePool& Instance();
+
+private:
+    void* MapPages(size_t size);
+
+    std::atomic<bool> m_enabled{false};
+    bool m_explicit_failed{false};
+
+    mutable std::mutex m_mutex;
+    /** Free list heads, by size in POOL_ALIGN units */
+    void* m_free[MAX_POOLED_SIZE / POOL_ALIGN + 1] = {};
+    /** Unused end of the current arena */
+    char* m_arena_pos{nullptr};
+    char* m_arena_end{nullptr};
+    /** Arenas and direct mappings by their end, to tell pool memory from heap memory on free */
+    std::map<uintptr_t, uintptr_t> m_arenas;
+    std::map<void*, size_t> m_direct;
+    size_t m_used{0};
+    size_t m_free_bytes{0};
+    size_t m_direct_bytes{0};
+    size_t m_explicit_bytes{0};
+};
+
+#endif // BITCOIN_SUPPORT_LARGEPAGES_H
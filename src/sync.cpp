@@ -5,10 +5,15 @@
 #include <sync.h>
 
 #include <logging.h>
+#include <tinyformat.h>
 #include <util/strencodings.h>
 
 #include <stdio.h>
+#include <string.h>
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
@@ -24,6 +29,168 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+std::atomic<bool> g_lock_profiling{false};
+static std::atomic<bool> g_lock_profiling_all{false};
+
+static const size_t LOCK_SITE_SLOTS = 4096;
+
+enum LockSiteState : int {
+    LOCK_SITE_EMPTY,
+    LOCK_SITE_WRITING,
+    LOCK_SITE_READY,
+};
+
+struct LockSite {
+    std::atomic<int> state{LOCK_SITE_EMPTY};
+    const char* pszName = nullptr;
+    const char* pszFile = nullptr;
+    int nLine = 0;
+
+    std::atomic<uint64_t> nCount{0};
+    std::atomic<uint64_t> nContended{0};
+    std::atomic<int64_t> nWaitTotal{0};
+    std::atomic<int64_t> nWaitMax{0};
+    std::atomic<int64_t> nHoldTotal{0};
+    std::atomic<int64_t> nHoldMax{0};
+    std::atomic<uint64_t> waitHistogram[LOCK_PROFILE_BUCKETS];
+    std::atomic<uint64_t> holdHistogram[LOCK_PROFILE_BUCKETS];
+};
+
+//! Open addressing table keyed by the file and line of the callsite, slots are never freed
+static LockSite g_lock_sites[LOCK_SITE_SLOTS];
+
+static bool IsMainLock(const char* pszName)
+{
+    // The name is the stringified LOCK argument, e.g. "cs_main" or "::cs_main"
+    size_t nLen = strlen(pszName);
+    return nLen >= 7 && strcmp(pszName + nLen - 7, "cs_main") == 0;
+}
+
+LockSite* GetLockSite(const char* pszName, const char* pszFile, int nLine)
+{
+    if (!g_lock_profiling_all.load(std::memory_order_relaxed) && !IsMainLock(pszName))
+        return nullptr;
+    size_t nHash = (std::hash<const void*>()(pszFile) * 31 + nLine) % LOCK_SITE_SLOTS;
+    for (size_t i = 0; i < LOCK_SITE_SLOTS; i++) {
+        LockSite& site = g_lock_sites[(nHash + i) % LOCK_SITE_SLOTS];
+        int state = site.state.load(std::memory_order_acquire);
+        if (state == LOCK_SITE_EMPTY) {
+            if (site.state.compare_exchange_strong(state, LOCK_SITE_WRITING, std::memory_order_acquire)) {
+                site.pszName = pszName;
+                site.pszFile = pszFile;
+                site.nLine = nLine;
+                site.state.store(LOCK_SITE_READY, std::memory_order_release);
+                return &site;
+            }
+        }
+        // Another thread is claiming the slot, it may be for this callsite
+        while (state == LOCK_SITE_WRITING) {
+            state = site.state.load(std::memory_order_acquire);
+        }
+        if (site.pszFile == pszFile && site.nLine == nLine)
+            return &site;
+    }
+    // The table is full, the callsite is not profiled
+    return nullptr;
+}
+
+int64_t LockProfileTime()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int LockProfileBucket(int64_t nTime)
+{
+    int nBucket = 0;
+    while (nBucket < LOCK_PROFILE_BUCKETS - 1 && nTime >= (int64_t{1} << nBucket)) {
+        nBucket++;
+    }
+    return nBucket;
+}
+
+static void UpdateMax(std::atomic<int64_t>& nMax, int64_t nValue)
+{
+    int64_t nCurrent = nMax.load(std::memory_order_relaxed);
+    while (nValue > nCurrent && !nMax.compare_exchange_weak(nCurrent, nValue, std::memory_order_relaxed)) {
+    }
+}
+
+void LockProfileWait(LockSite* site, int64_t nWait, bool fContended)
+{
+    site->nCount.fetch_add(1, std::memory_order_relaxed);
+    if (fContended)
+        site->nContended.fetch_add(1, std::memory_order_relaxed);
+    site->nWaitTotal.fetch_add(nWait, std::memory_order_relaxed);
+    UpdateMax(site->nWaitMax, nWait);
+    site->waitHistogram[LockProfileBucket(nWait)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LockProfileHold(LockSite* site, int64_t nHold)
+{
+    site->nHoldTotal.fetch_add(nHold, std::memory_order_relaxed);
+    UpdateMax(site->nHoldMax, nHold);
+    site->holdHistogram[LockProfileBucket(nHold)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void SetLockProfiling(bool fEnable, bool fAllMutexes)
+{
+    if (fEnable) {
+        // Locks taken while the counters are cleared may be partly counted
+        for (LockSite& site : g_lock_sites) {
+            site.nCount = 0;
+            site.nContended = 0;
+            site.nWaitTotal = 0;
+            site.nWaitMax = 0;
+            site.nHoldTotal = 0;
+            site.nHoldMax = 0;
+            for (int i = 0; i < LOCK_PROFILE_BUCKETS; i++) {
+                site.waitHistogram[i] = 0;
+                site.holdHistogram[i] = 0;
+            }
+        }
+        g_lock_profiling_all = fAllMutexes;
+    }
+    g_lock_profiling = fEnable;
+}
+
+bool IsLockProfilingAllMutexes()
+{
+    return g_lock_profiling_all;
+}
+
+std::vector<LockProfileEntry> GetLockProfile()
+{
+    // The same header line can have a different __FILE__ pointer in each translation unit
+    std::map<std::string, LockProfileEntry> mapEntries;
+    for (const LockSite& site : g_lock_sites) {
+        if (site.state.load(std::memory_order_acquire) != LOCK_SITE_READY || site.nCount == 0)
+            continue;
+        std::string strLocation = strprintf("%s:%d", site.pszFile, site.nLine);
+        LockProfileEntry& entry = mapEntries[strLocation];
+        if (entry.location.empty()) {
+            entry.name = site.pszName;
+            entry.location = strLocation;
+            entry.vWaitHistogram.assign(LOCK_PROFILE_BUCKETS, 0);
+            entry.vHoldHistogram.assign(LOCK_PROFILE_BUCKETS, 0);
+        }
+        entry.nCount += site.nCount;
+        entry.nContended += site.nContended;
+        entry.nWaitTotal += site.nWaitTotal;
+        entry.nWaitMax = std::max<int64_t>(entry.nWaitMax, site.nWaitMax);
+        entry.nHoldTotal += site.nHoldTotal;
+        entry.nHoldMax = std::max<int64_t>(entry.nHoldMax, site.nHoldMax);
+        for (int i = 0; i < LOCK_PROFILE_BUCKETS; i++) {
+            entry.vWaitHistogram[i] += site.waitHistogram[i];
+            entry.vHoldHistogram[i] += site.holdHistogram[i];
+        }
+    }
+    std::vector<LockProfileEntry> vEntries;
+    for (auto& item : mapEntries) {
+        vEntries.push_back(std::move(item.second));
+    }
+    return vEntries;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
@@ -8,7 +8,11 @@
 
 #include <threadsafety.h>
 
+#include <atomic>
 #include <condition_variable>
+#include <stdint.h>
+#include <string>
+#include <vector>
 #include <thread>
 #include <mutex>
 
@@ -114,14 +118,65 @@ typedef AnnotatedMixin<std::mutex> Mutex;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Lock profiling, switched at runtime with setlockprofiling.
+ *
+ * While it is on, LOCK and WAIT_LOCK record how long they waited for the mutex
+ * and how long they held it under their file:line. Only cs_main is profiled
+ * unless all mutexes are selected. The statistics of a callsite are atomic
+ * counters and log2 histograms in a fixed table, so recording takes no lock.
+ */
+struct LockSite;
+extern std::atomic<bool> g_lock_profiling;
+/** The callsite statistics to record to, or nullptr if the lock is not profiled */
+LockSite* GetLockSite(const char* pszName, const char* pszFile, int nLine);
+int64_t LockProfileTime();
+void LockProfileWait(LockSite* site, int64_t nWait, bool fContended);
+void LockProfileHold(LockSite* site, int64_t nHold);
+
+/** Buckets of the lock profile histograms, bucket i counts durations below 2^i microseconds */
+static const int LOCK_PROFILE_BUCKETS = 24;
+
+/** Statistics of a lock callsite, times in microseconds */
+struct LockProfileEntry {
+    std::string name;
+    std::string location;
+    uint64_t nCount = 0;
+    uint64_t nContended = 0;
+    int64_t nWaitTotal = 0;
+    int64_t nWaitMax = 0;
+    int64_t nHoldTotal = 0;
+    int64_t nHoldMax = 0;
+    std::vector<uint64_t> vWaitHistogram;
+    std::vector<uint64_t> vHoldHistogram;
+};
+
+/** Turn lock profiling on or off. Turning it on clears the statistics. */
+void SetLockProfiling(bool fEnable, bool fAllMutexes);
+bool IsLockProfilingAllMutexes();
+/** The statistics recorded since profiling was turned on, one entry per callsite */
+std::vector<LockProfileEntry> GetLockProfile();
+
 /** Wrapper around std::unique_lock style lock for Mutex. */
 template <typename Mutex, typename Base = typename Mutex::UniqueLock>
 class SCOPED_LOCKABLE UniqueLock : public Base
 {
 private:
+    LockSite* m_site = nullptr;
+    int64_t m_locked_at = 0;
+
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(Base::mutex()));
+        if (g_lock_profiling.load(std::memory_order_relaxed) && (m_site = GetLockSite(pszName, pszFile, nLine))) {
+            int64_t nStart = LockProfileTime();
+            bool fContended = !Base::try_lock();
+            if (fContended)
+                Base::lock();
+            m_locked_at = LockProfileTime();
+            LockProfileWait(m_site, m_locked_at - nStart, fContended);
+            return;
+        }
 #ifdef DEBUG_LOCKCONTENTION
         if (!Base::try_lock()) {
             PrintLockContention(pszName, pszFile, nLine);
@@ -163,8 +218,11 @@ public:
 
     ~UniqueLock() UNLOCK_FUNCTION()
     {
-        if (Base::owns_lock())
+        if (Base::owns_lock()) {
+            if (m_site)
+                LockProfileHold(m_site, LockProfileTime() - m_locked_at);
             LeaveCritical();
+        }
     }
 
     operator bool()
@@ -5,6 +5,7 @@
 #include <util/system.h>
 
 #include <support/allocators/secure.h>
+#include <support/largepages.h>
 #include <test/test_bitcoin.h>
 
 #include <memory>
@@ -233,4 +234,47 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(largepagepool_tests)
+{
+    LargePagePool pool;
+    // Before the pool is enabled, memory comes from the heap and may be freed once it is
+    void *heap = pool.alloc(48);
+    BOOST_CHECK(heap);
+    BOOST_CHECK(pool.stats().used == 0);
+    if (!pool.Enable()) {
+        pool.free(heap, 48);
+        return;
+    }
+
+    void *a0 = pool.alloc(40);
+    void *a1 = pool.alloc(48);
+    BOOST_CHECK(a0 && a1 && a0 != a1);
+    BOOST_CHECK((uintptr_t)a0 % LargePagePool::POOL_ALIGN == 0);
+    BOOST_CHECK(pool.stats().used == 96);
+    BOOST_CHECK(pool.stats().arenas == LargePagePool::ARENA_SIZE);
+    memset(a0, 0x5a, 40);
+    pool.free(heap, 48);
+    BOOST_CHECK(pool.stats().used == 96);
+
+    // Freed memory is reused by the next allocation of its size class
+    pool.free(a0, 40);
+    BOOST_CHECK(pool.stats().used == 48);
+    BOOST_CHECK(pool.alloc(33) == a0);
+    pool.free(a0, 33);
+    pool.free(a1, 48);
+    BOOST_CHECK(pool.stats().used == 0);
+    BOOST_CHECK(pool.stats().arenas == LargePagePool::ARENA_SIZE);
+
+    // Sizes between the pooled and the direct ones are left to the heap
+    void *mid = pool.alloc(4096);
+    BOOST_CHECK(pool.stats().used == 0);
+    pool.free(mid, 4096);
+
+    void *direct = pool.alloc(LargePagePool::DIRECT_SIZE + 1);
+    BOOST_CHECK(pool.stats().direct >= LargePagePool::DIRECT_SIZE + 1);
+    memset(direct, 0x5a, LargePagePool::DIRECT_SIZE + 1);
+    pool.free(direct, LargePagePool::DIRECT_SIZE + 1);
+    BOOST_CHECK(pool.stats().direct == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -321,6 +321,45 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest)
     }
 }
 
+BOOST_AUTO_TEST_CASE(GeneratedTxPrefilledRoundTripTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+
+    // A contract value transfer spends the contract coins with OP_SPEND
+    CMutableTransaction transfer;
+    transfer.vin.resize(1);
+    transfer.vin[0].prevout.hash = InsecureRand256();
+    transfer.vin[0].prevout.n = 0;
+    transfer.vin[0].scriptSig = CScript() << OP_SPEND;
+    transfer.vout.resize(1);
+    transfer.vout[0].nValue = 42;
+    block.vtx.insert(block.vtx.begin() + 2, MakeTransactionRef(std::move(transfer)));
+
+    LOCK2(cs_main, pool.cs);
+    pool.addUnchecked(entry.FromTx(block.vtx[1]));
+    pool.addUnchecked(entry.FromTx(block.vtx[3]));
+
+    TestHeaderAndShortIDs shortIDs(block);
+    BOOST_CHECK_EQUAL(shortIDs.prefilledtxn.size(), 2U);
+    BOOST_CHECK_EQUAL(shortIDs.shorttxids.size(), 2U);
+    BOOST_CHECK_EQUAL(shortIDs.prefilledtxn[1].index, 1); // id == 1 as it is 1 after index 0
+    BOOST_CHECK(shortIDs.prefilledtxn[1].tx->GetHash() == block.vtx[2]->GetHash());
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << shortIDs;
+
+    CBlockHeaderAndShortTxIDs shortIDs2;
+    stream >> shortIDs2;
+
+    // The value transfer is prefilled at its position, the other txs come from the mempool
+    PartiallyDownloadedBlock partialBlock(&pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs2, extra_txn) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++)
+        BOOST_CHECK(partialBlock.IsTxAvailable(i));
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = InsecureRand256();
@@ -389,4 +428,51 @@ BOOST_AUTO_TEST_CASE(TransactionsRequestDeserializationOverflowTest) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(CompactHeadersRoundTrip) {
+    // A chain of headers: proof-of-work, then proof-of-stake with a state root change and a time going back
+    std::vector<CBlockHeader> headers(5);
+    uint256 hashPrev = InsecureRand256();
+    for (size_t i = 0; i < headers.size(); i++) {
+        CBlockHeader& header = headers[i];
+        header.nVersion = 4;
+        header.hashPrevBlock = hashPrev;
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = 1500000000 + 128 * i;
+        header.nBits = 0x207fffff;
+        header.nNonce = i < 2 ? InsecureRand32() : 0;
+        header.hashStateRoot = i < 3 ? uint256S("01") : uint256S("02");
+        header.hashUTXORoot = uint256S("03");
+        if (i >= 2) {
+            header.prevoutStake = COutPoint(InsecureRand256(), i);
+            header.vchBlockSigDlgt.assign(72, (unsigned char)i);
+        }
+        hashPrev = header.GetHash();
+    }
+    headers[3].nTime = headers[2].nTime - 16;
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CCompactHeaders<CBlockHeader>(headers);
+    size_t nCompactSize = stream.size();
+    CDataStream fullStream(SER_NETWORK, PROTOCOL_VERSION);
+    fullStream << headers;
+    BOOST_CHECK(nCompactSize < fullStream.size());
+
+    BOOST_CHECK_EQUAL(ReadCompactSize(stream), headers.size());
+    CCompactHeaderCodec codec;
+    for (const CBlockHeader& expected : headers) {
+        CBlockHeader header;
+        codec.Read(stream, header);
+        BOOST_CHECK_EQUAL(header.GetHash().ToString(), expected.GetHash().ToString());
+        BOOST_CHECK(header.prevoutStake == expected.prevoutStake);
+    }
+    BOOST_CHECK(stream.empty());
+
+    // The first header of a message cannot refer to a previous one
+    CDataStream badStream(SER_NETWORK, PROTOCOL_VERSION);
+    badStream << (uint8_t)0x02;
+    CBlockHeader header;
+    CCompactHeaderCodec badCodec;
+    BOOST_CHECK_THROW(badCodec.Read(badStream, header), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -39,6 +39,25 @@ BOOST_AUTO_TEST_CASE(gcsfilter_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(gcsfilter_large_test)
+{
+    // Enough elements for the hashes to be radix sorted
+    GCSFilter::ElementSet included_elements;
+    for (int i = 0; i < 5000; ++i) {
+        GCSFilter::Element element(32);
+        element[0] = i & 0xff;
+        element[1] = i >> 8;
+        included_elements.insert(std::move(element));
+    }
+
+    GCSFilter filter({0, 0, 19, 784931}, included_elements);
+    BOOST_CHECK_EQUAL(filter.GetN(), included_elements.size());
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+    }
+    BOOST_CHECK(filter.MatchAny(included_elements));
+}
+
 BOOST_AUTO_TEST_CASE(gcsfilter_default_constructor)
 {
     GCSFilter filter;
@@ -112,6 +131,34 @@ BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
     BOOST_CHECK_EQUAL(block_filter.GetFilterType(), block_filter2.GetFilterType());
     BOOST_CHECK_EQUAL(block_filter.GetBlockHash(), block_filter2.GetBlockHash());
     BOOST_CHECK(block_filter.GetEncodedFilter() == block_filter2.GetEncodedFilter());
+
+    // The contract filter has the basic elements and the contract elements
+    GCSFilter::Element contract_address(20, 0x11), log_topic(32, 0x22);
+    GCSFilter::ElementSet contract_elements{contract_address, log_topic};
+    BOOST_CHECK(!filter.Match(contract_address));
+
+    BlockFilter contract_filter(BlockFilterType::CONTRACT, block, block_undo, contract_elements);
+    for (const CScript& script : included_scripts) {
+        BOOST_CHECK(contract_filter.GetFilter().Match(GCSFilter::Element(script.begin(), script.end())));
+    }
+    BOOST_CHECK(contract_filter.GetFilter().Match(contract_address));
+    BOOST_CHECK(contract_filter.GetFilter().Match(log_topic));
+
+    // Other filter types ignore the contract elements
+    BlockFilter basic_filter(BlockFilterType::BASIC, block, block_undo, contract_elements);
+    BOOST_CHECK(basic_filter.GetEncodedFilter() == block_filter.GetEncodedFilter());
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::BASIC), "basic");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::CONTRACT), "contract");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(static_cast<BlockFilterType>(255)), "");
+
+    BlockFilterType filter_type;
+    BOOST_CHECK(BlockFilterTypeByName("contract", filter_type));
+    BOOST_CHECK_EQUAL(filter_type, BlockFilterType::CONTRACT);
+    BOOST_CHECK(!BlockFilterTypeByName("unknown", filter_type));
 }
 
 BOOST_AUTO_TEST_CASE(blockfilters_json_test)
@@ -80,7 +80,7 @@ public:
     void SelfTest() const
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
-        size_t ret = memusage::DynamicUsage(cacheCoins);
+        size_t ret = memusage::DynamicUsage(cacheCoins) + memusage::DynamicUsage(setPinnedCoins);
         size_t count = 0;
         for (const auto& entry : cacheCoins) {
             ret += entry.second.coin.DynamicMemoryUsage();
@@ -858,4 +858,43 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_pin)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    COutPoint pinned(InsecureRand256(), 0);
+    COutPoint unpinned(InsecureRand256(), 1);
+    COutPoint spent(InsecureRand256(), 2);
+    for (const COutPoint& outpoint : {pinned, unpinned, spent}) {
+        Coin coin;
+        coin.out.nValue = 100;
+        coin.nHeight = 1;
+        cache.AddCoin(outpoint, std::move(coin), false);
+    }
+
+    // Only coins of the view can be pinned
+    BOOST_CHECK(!cache.PinCoin(COutPoint(InsecureRand256(), 0)));
+    BOOST_CHECK(cache.PinCoin(pinned));
+    BOOST_CHECK(cache.PinCoin(spent));
+    BOOST_CHECK(cache.SpendCoin(spent));
+
+    BOOST_CHECK(cache.Flush());
+    cache.SelfTest();
+    BOOST_CHECK(cache.HaveCoinInCache(pinned));
+    BOOST_CHECK(!cache.HaveCoinInCache(unpinned));
+    BOOST_CHECK(!cache.HaveCoinInCache(spent));
+    BOOST_CHECK(cache.map().at(pinned).flags == 0);
+
+    // The pinned coin was written to the base
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(pinned, coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 100);
+
+    // Once spent it is flushed like any coin
+    BOOST_CHECK(cache.SpendCoin(pinned));
+    BOOST_CHECK(cache.Flush());
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,8 @@
 
 #include <crypto/aes.h>
 #include <crypto/chacha20.h>
+#include <crypto/keccak.h>
+#include <crypto/muhash.h>
 #include <crypto/ripemd160.h>
 #include <crypto/sha1.h>
 #include <crypto/sha256.h>
@@ -55,6 +57,7 @@ static void TestSHA1(const std::string &in, const std::string &hexout) { TestVec
 static void TestSHA256(const std::string &in, const std::string &hexout) { TestVector(CSHA256(), in, ParseHex(hexout));}
 static void TestSHA512(const std::string &in, const std::string &hexout) { TestVector(CSHA512(), in, ParseHex(hexout));}
 static void TestRIPEMD160(const std::string &in, const std::string &hexout) { TestVector(CRIPEMD160(), in, ParseHex(hexout));}
+static void TestKeccak256(const std::string &in, const std::string &hexout) { TestVector(CKeccak256(), in, ParseHex(hexout));}
 
 static void TestHMACSHA256(const std::string &hexkey, const std::string &hexin, const std::string &hexout) {
     std::vector<unsigned char> key = ParseHex(hexkey);
@@ -562,4 +565,119 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(sha256d_many)
+{
+    for (size_t n = 0; n <= 17; ++n) {
+        std::vector<std::vector<unsigned char>> msgs(n);
+        std::vector<const unsigned char*> in(n);
+        std::vector<size_t> lens(n);
+        for (size_t j = 0; j < n; ++j) {
+            msgs[j].resize(InsecureRandRange(300));
+            for (unsigned char& c : msgs[j]) {
+                c = InsecureRandBits(8);
+            }
+            in[j] = msgs[j].data();
+            lens[j] = msgs[j].size();
+        }
+        std::vector<unsigned char> out1(32 * n), out2(32 * n);
+        for (size_t j = 0; j < n; ++j) {
+            CHash256().Write(in[j], lens[j]).Finalize(out1.data() + 32 * j);
+        }
+        SHA256DMany(out2.data(), in.data(), lens.data(), n);
+        BOOST_CHECK(out1 == out2);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(keccak256_testvectors) {
+    TestKeccak256("", "c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470");
+    TestKeccak256("abc", "4e03657aea45a94fc7d47ba826c8d667c0d1e6e33a64a036ec44f58fa12d6c45");
+    TestKeccak256("message digest", "856ab8a3ad0f6168a4d0ba8d77487243f3655db6fc5b0e1669bc05b1287e0147");
+    TestKeccak256("The quick brown fox jumps over the lazy dog", "4d741b6f1eb29cb2a9b9911c82f56fa8d73b04959d3d9d222895df6c0b28aa15");
+    TestKeccak256(std::string(135, 'a'), "34367dc248bbd832f4e3e69dfaac2f92638bd0bbd18f2912ba4ef454919cf446");
+    TestKeccak256(std::string(136, 'a'), "a6c4d403279fe3e0af03729caada8374b5ca54d8065329a3ebcaeb4b60aa386e");
+    TestKeccak256(std::string(137, 'a'), "d869f639c7046b4929fc92a4d988a8b22c55fbadb802c0c66ebcd484f1915f39");
+    TestKeccak256(std::string(300, 'a'), "5b7e0e47a96f32a88b4f14ca177982790807c40e1a105742ba0fc1babe1ef826");
+}
+
+BOOST_AUTO_TEST_CASE(keccak256_many)
+{
+    for (size_t n = 0; n <= 9; ++n) {
+        std::vector<std::vector<unsigned char>> msgs(n);
+        std::vector<const unsigned char*> in(n);
+        std::vector<size_t> lens(n);
+        for (size_t j = 0; j < n; ++j) {
+            msgs[j].resize(InsecureRandRange(400) + 1);
+            for (unsigned char& c : msgs[j]) {
+                c = InsecureRandBits(8);
+            }
+            in[j] = msgs[j].data();
+            lens[j] = msgs[j].size();
+        }
+        std::vector<unsigned char> out1(32 * n), out2(32 * n);
+        for (size_t j = 0; j < n; ++j) {
+            CKeccak256().Write(in[j], lens[j]).Finalize(out1.data() + 32 * j);
+        }
+        Keccak256Many(out2.data(), in.data(), lens.data(), n);
+        BOOST_CHECK(out1 == out2);
+    }
+}
+
+static uint256 MuHashOf(const std::vector<std::vector<unsigned char>>& elements)
+{
+    MuHash3072 hash;
+    for (const auto& element : elements) {
+        hash.Insert(element.data(), element.size());
+    }
+    uint256 out;
+    hash.Finalize(out);
+    return out;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    std::vector<std::vector<unsigned char>> elements;
+    for (int i = 0; i < 8; i++) {
+        elements.push_back(g_insecure_rand_ctx.randbytes(1 + InsecureRandRange(100)));
+    }
+    uint256 all = MuHashOf(elements);
+    BOOST_CHECK(all != MuHashOf({}));
+
+    // The hash of a set does not depend on the order of its elements
+    std::vector<std::vector<unsigned char>> reversed(elements.rbegin(), elements.rend());
+    BOOST_CHECK(all == MuHashOf(reversed));
+
+    // Removing an element gives the hash of the set without it, in any order
+    MuHash3072 hash;
+    hash.Remove(elements[0].data(), elements[0].size());
+    for (const auto& element : elements) {
+        hash.Insert(element.data(), element.size());
+    }
+    uint256 out;
+    hash.Finalize(out);
+    BOOST_CHECK(out == MuHashOf(std::vector<std::vector<unsigned char>>(elements.begin() + 1, elements.end())));
+
+    // Sets combine into their union and divide back
+    MuHash3072 first, second;
+    for (size_t i = 0; i < elements.size(); i++) {
+        (i % 2 ? first : second).Insert(elements[i].data(), elements[i].size());
+    }
+    MuHash3072 combined = first;
+    combined *= second;
+    combined.Finalize(out);
+    BOOST_CHECK(out == all);
+    combined /= second;
+    uint256 out2;
+    combined.Finalize(out);
+    first.Finalize(out2);
+    BOOST_CHECK(out == out2);
+
+    // The serialized state restores the same hash
+    unsigned char serialized[MuHash3072::SERIALIZED_SIZE];
+    combined.ToBytes(serialized);
+    MuHash3072 restored;
+    restored.FromBytes(serialized);
+    restored.Finalize(out);
+    BOOST_CHECK(out == out2);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
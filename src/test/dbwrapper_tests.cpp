@@ -2,10 +2,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <arith_uint256.h>
 #include <dbwrapper.h>
 #include <uint256.h>
 #include <random.h>
 #include <test/test_bitcoin.h>
+#include <txdb.h>
+#include <validation.h>
 
 #include <memory>
 
@@ -319,4 +322,129 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
 
 
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    leveldb::Options range = GetDBOptions(1 << 20, DBProfile::RangeScans());
+    BOOST_CHECK_EQUAL(range.block_size, DB_RANGE_SCAN_BLOCK_SIZE);
+    BOOST_CHECK(range.compression == leveldb::kSnappyCompression);
+    BOOST_CHECK(range.filter_policy != nullptr);
+    delete range.filter_policy;
+    delete range.info_log;
+    delete range.block_cache;
+
+    // Point lookups take their bloom filter from -dbbloombits
+    gArgs.ForceSetArg("-dbbloombits", "0");
+    leveldb::Options point = GetDBOptions(1 << 20, DBProfile::PointLookups());
+    BOOST_CHECK(point.compression == leveldb::kNoCompression);
+    BOOST_CHECK(point.filter_policy == nullptr);
+    delete point.info_log;
+    delete point.block_cache;
+    gArgs.ForceSetArg("-dbbloombits", std::to_string(DEFAULT_DB_BLOOM_BITS));
+
+    // Databases with different profiles still store and read back the same data
+    fs::path ph = SetDataDir(std::string("dbwrapper_profiles"));
+    CDBWrapper dbw(ph, (1 << 20), true, false, false, DBProfile::RangeScans());
+    char key = 'k';
+    uint256 in = InsecureRand256();
+    uint256 res;
+    BOOST_CHECK(dbw.Write(key, in));
+    BOOST_CHECK(dbw.Read(key, res));
+    BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+}
+
+BOOST_AUTO_TEST_CASE(address_index_range)
+{
+    fs::path ph = SetDataDir("address_index_range");
+    CDBWrapper dbw(ph, (1 << 20), true, false, false);
+    uint256 address = uint256S("11");
+    uint256 other = uint256S("12");
+    std::vector<std::pair<CAddressIndexKey, CAmount>> written;
+    for (int height = 1; height <= 10; height++) {
+        written.push_back(std::make_pair(CAddressIndexKey(1, address, height, 1, uint256S("aa"), 0, false), (CAmount)height));
+        if (height == 5) {
+            written.push_back(std::make_pair(CAddressIndexKey(1, address, height, 1, uint256S("aa"), 1, true), (CAmount)-5));
+        }
+        written.push_back(std::make_pair(CAddressIndexKey(1, other, height, 2, uint256S("bb"), 0, true), (CAmount)-height));
+    }
+    CDBBatch batch(dbw);
+    WriteAddressIndexEntries(batch, written);
+    BOOST_CHECK(dbw.WriteBatch(batch));
+
+    auto read = [&](const CAddressIndexRange& range) {
+        std::unique_ptr<CDBIterator> it(const_cast<CDBWrapper&>(dbw).NewIterator());
+        std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+        BOOST_CHECK(ReadAddressIndexRange(dbw, *it, address, 1, range, entries));
+        std::vector<CAmount> values;
+        for (const auto& entry : entries) {
+            BOOST_CHECK(entry.first.hashBytes == address);
+            BOOST_CHECK(entry.first.txhash == uint256S("aa"));
+            values.push_back(entry.second);
+        }
+        return values;
+    };
+
+    CAddressIndexRange range;
+    BOOST_CHECK_EQUAL(read(range).size(), 11U);
+
+    // Pages in key order continue after the last entry of the page before
+    range.limit = 5;
+    std::vector<CAmount> page = read(range);
+    BOOST_CHECK(page == std::vector<CAmount>({1, 2, 3, 4, 5}));
+    range.hasAfter = true;
+    range.after = CAddressIndexKey(0, uint256(), 5, 1, uint256S("aa"), 0, false);
+    page = read(range);
+    BOOST_CHECK(page == std::vector<CAmount>({-5, 6, 7, 8, 9}));
+    range.includeAfter = true;
+    BOOST_CHECK(read(range).front() == 5);
+
+    // Descending pages start at the newest entry and stay within the heights
+    range = CAddressIndexRange();
+    range.descending = true;
+    range.limit = 3;
+    BOOST_CHECK(read(range) == std::vector<CAmount>({10, 9, 8}));
+    range.start = 4;
+    range.end = 6;
+    range.limit = 0;
+    BOOST_CHECK(read(range) == std::vector<CAmount>({6, -5, 5, 4}));
+    range.hasAfter = true;
+    range.after = CAddressIndexKey(0, uint256(), 5, 1, uint256S("aa"), 1, true);
+    BOOST_CHECK(read(range) == std::vector<CAmount>({5, 4}));
+}
+
+BOOST_AUTO_TEST_CASE(address_index_upgrade)
+{
+    fs::path ph = SetDataDir("address_index_upgrade");
+    CDBWrapper dbw(ph, (1 << 20), true, false, false);
+    // A 160 bit hash and a 256 bit one, entries of older versions are keyed by CAddressIndexKey under 'a'
+    uint256 address = uint256S("11");
+    uint256 script = uint256S("ff00000000000000000000000000000000000000000000000000000000000011");
+    for (int height = 1; height <= 3; height++) {
+        BOOST_CHECK(dbw.Write(std::make_pair('a', CAddressIndexKey(1, address, height, 1, ArithToUint256(height), 0, false)), (CAmount)(height * COIN)));
+        BOOST_CHECK(dbw.Write(std::make_pair('a', CAddressIndexKey(3, script, height, 2, ArithToUint256(height + 100), 1, true)), (CAmount)(-height * COIN)));
+    }
+
+    BOOST_CHECK(UpgradeAddressIndex(dbw));
+    std::unique_ptr<CDBIterator> old(const_cast<CDBWrapper&>(dbw).NewIterator());
+    old->Seek('a');
+    char prefix;
+    BOOST_CHECK(!old->Valid() || !old->GetKey(prefix) || prefix != 'a');
+
+    for (const auto& expected : {std::make_pair(1, address), std::make_pair(3, script)}) {
+        std::unique_ptr<CDBIterator> it(const_cast<CDBWrapper&>(dbw).NewIterator());
+        std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+        BOOST_CHECK(ReadAddressIndexRange(dbw, *it, expected.second, expected.first, CAddressIndexRange(), entries));
+        BOOST_CHECK_EQUAL(entries.size(), 3U);
+        for (size_t i = 0; i < entries.size(); i++) {
+            int height = i + 1;
+            BOOST_CHECK(entries[i].first.hashBytes == expected.second);
+            BOOST_CHECK_EQUAL(entries[i].first.blockHeight, height);
+            BOOST_CHECK(entries[i].first.txhash == ArithToUint256(expected.first == 1 ? height : height + 100));
+            BOOST_CHECK_EQUAL(entries[i].second, expected.first == 1 ? height * COIN : -height * COIN);
+        }
+    }
+
+    // Nothing is left to upgrade
+    BOOST_CHECK(UpgradeAddressIndex(dbw));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -290,6 +290,49 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     pool.removeRecursive(pool.mapTx.find(tx8.GetHash())->GetTx());
 }
 
+BOOST_AUTO_TEST_CASE(MempoolGasEvictionTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    /* pays the most, but all of it for gas */
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_CREATE;
+    tx1.vout[0].nValue = 0;
+    pool.addUnchecked(entry.Fee(1000000LL).GasLimit(100000).GasPrice(10).FromTx(tx1));
+
+    /* pays for its size only */
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx2.vout[0].nValue = COIN;
+    pool.addUnchecked(entry.Fee(10000LL).GasLimit(0).GasPrice(0).FromTx(tx2));
+
+    /* child of tx2 with a gas limit, its gas part is not counted for tx2 */
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].prevout = COutPoint(tx2.GetHash(), 0);
+    tx3.vin[0].scriptSig = CScript() << OP_11;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_1 << OP_CREATE;
+    tx3.vout[0].nValue = 0;
+    pool.addUnchecked(entry.Fee(501000LL).GasLimit(50000).GasPrice(10).FromTx(tx3));
+
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx2.GetHash())->GetGasFeesWithDescendants(), 500000);
+
+    std::vector<std::string> sortedOrder;
+    sortedOrder.push_back(tx1.GetHash().ToString());
+    sortedOrder.push_back(tx3.GetHash().ToString());
+    sortedOrder.push_back(tx2.GetHash().ToString());
+    CheckSort<descendant_score>(pool, sortedOrder);
+
+    // Removing the child takes its gas fee out of the parent
+    pool.removeRecursive(CTransaction(tx3));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(tx2.GetHash())->GetGasFeesWithDescendants(), 0);
+}
+
 BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
 {
     CTxMemPool pool;
@@ -749,4 +792,53 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 6ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorCacheTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+
+    // [tx1].0 <- [tx2].0 <- [tx3]
+    CTransactionRef tx1 = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef tx2 = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {tx1});
+    CTransactionRef tx3 = make_tx(/* output_values */ {8 * COIN}, /* inputs */ {tx2});
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx1));
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx2));
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx3));
+    CTxMemPool::txiter it1 = pool.mapTx.find(tx1->GetHash());
+    CTxMemPool::txiter it2 = pool.mapTx.find(tx2->GetHash());
+    CTxMemPool::txiter it3 = pool.mapTx.find(tx3->GetHash());
+
+    // The second walk is served by the cache and must agree with the first
+    for (int i = 0; i < 2; i++) {
+        CTxMemPool::setEntries ancestors;
+        BOOST_CHECK(pool.CalculateMemPoolAncestors(*it3, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+        BOOST_CHECK(ancestors == CTxMemPool::setEntries({it1, it2}));
+    }
+
+    // A new descendant sees the cached chain of its parent
+    CTransactionRef tx4 = make_tx(/* output_values */ {7 * COIN}, /* inputs */ {tx3});
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx4));
+    CTxMemPool::txiter it4 = pool.mapTx.find(tx4->GetHash());
+    CTxMemPool::setEntries ancestors;
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*it4, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+    BOOST_CHECK(ancestors == CTxMemPool::setEntries({it1, it2, it3}));
+
+    // Mining tx1 must not leave it in any cached set
+    pool.removeForBlock({tx1}, 1);
+    ancestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*it4, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+    BOOST_CHECK(ancestors == CTxMemPool::setEntries({it2, it3}));
+    ancestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(*it3, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false));
+    BOOST_CHECK(ancestors == CTxMemPool::setEntries({it2}));
+
+    // The descendants walk marks entries with the same epochs
+    CTxMemPool::setEntries descendants;
+    pool.CalculateDescendants(it2, descendants);
+    BOOST_CHECK(descendants == CTxMemPool::setEntries({it2, it3, it4}));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
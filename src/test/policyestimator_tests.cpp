@@ -180,4 +180,46 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+BOOST_AUTO_TEST_CASE(GasPriceEstimates)
+{
+    CBlockPolicyEstimator feeEst;
+    CTxMemPool mpool(&feeEst);
+    LOCK2(cs_main, mpool.cs);
+    TestMemPoolEntryHelper entry;
+    const uint64_t gasLimit = 250000;
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0;
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_CREATE;
+
+    // No contract txs seen yet
+    BOOST_CHECK_EQUAL(feeEst.estimateGasPrice(2, nullptr), 0);
+
+    // Contract txs paying 40 satoshis per gas are mined in the next block,
+    // the ones paying 20 satoshis per gas are never mined
+    std::vector<CTransactionRef> block;
+    int blocknum = 0;
+    while (blocknum < 100) {
+        for (int k = 0; k < 4; k++) {
+            tx.vin[0].prevout.n = 100 * blocknum + k;
+            mpool.addUnchecked(entry.Fee(40 * gasLimit).Time(GetTime()).Height(blocknum).GasLimit(gasLimit).FromTx(tx));
+            block.push_back(mpool.get(tx.GetHash()));
+            tx.vin[0].prevout.n = 100 * blocknum + 50 + k;
+            mpool.addUnchecked(entry.Fee(20 * gasLimit).Time(GetTime()).Height(blocknum).GasLimit(gasLimit).FromTx(tx));
+        }
+        mpool.removeForBlock(block, ++blocknum);
+        block.clear();
+    }
+
+    int returnedTarget = 0;
+    CAmount gasPrice = feeEst.estimateGasPrice(2, &returnedTarget);
+    BOOST_CHECK_EQUAL(returnedTarget, 2);
+    BOOST_CHECK(gasPrice >= 40 && gasPrice <= 41);
+
+    // The contract txs are kept out of the feerate estimates
+    BOOST_CHECK(feeEst.estimateFee(2) == CFeeRate(0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,118 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <key.h>
+#include <pos.h>
+#include <script/sigcache.h>
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pos_tests, BasicTestingSetup)
+
+static void CheckKernelCacheTimes(int nHeight, unsigned int nBits, CAmount nMaxAmount)
+{
+    CBlockIndex pindexPrev;
+    pindexPrev.nHeight = nHeight;
+
+    for (int i = 0; i < 200; i++) {
+        pindexPrev.nStakeModifier = InsecureRand256();
+        COutPoint prevout(InsecureRand256(), InsecureRand32() % 8);
+        uint32_t blockFromTime = 1500000000 + InsecureRand32() % 1000000;
+        CAmount amount = 1 + InsecureRandRange(nMaxAmount);
+        std::map<COutPoint, CStakeCache> cache;
+        cache.insert(std::make_pair(prevout, CStakeCache(blockFromTime, amount)));
+
+        std::vector<uint32_t> vTimeBlock;
+        std::vector<std::pair<uint32_t, uint256>> expected;
+        for (uint32_t nTimeBlock = blockFromTime + 16; nTimeBlock < blockFromTime + 16 * 5; nTimeBlock += 16) {
+            vTimeBlock.push_back(nTimeBlock);
+            uint256 hashProofOfStake, targetProofOfStake;
+            if (CheckStakeKernelHash(&pindexPrev, nBits, blockFromTime, amount, prevout, nTimeBlock, hashProofOfStake, targetProofOfStake)) {
+                expected.push_back(std::make_pair(nTimeBlock, hashProofOfStake));
+            }
+        }
+
+        std::vector<std::pair<uint32_t, uint256>> solved;
+        CheckKernelCache(&pindexPrev, nBits, vTimeBlock, prevout, cache, solved);
+        BOOST_CHECK(solved == expected);
+
+        solved.clear();
+        CheckKernelCache(&pindexPrev, nBits, vTimeBlock, prevout, CStakeCache(blockFromTime, amount), solved);
+        BOOST_CHECK(solved == expected);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(check_kernel_cache_times)
+{
+    const Consensus::Params& params = Params().GetConsensus();
+
+    // Target scaled by the weight, before nReduceBlocktimeHeight
+    CheckKernelCacheTimes(params.nReduceBlocktimeHeight - 2, 0x1d00ffff, 1 << 30);
+    // Proof of stake hash divided by the weight
+    CheckKernelCacheTimes(params.nReduceBlocktimeHeight, 0x1d00ffff, (CAmount)1 << 33);
+
+    // No cache entry, no kernel
+    CBlockIndex pindexPrev;
+    std::vector<std::pair<uint32_t, uint256>> solved;
+    CheckKernelCache(&pindexPrev, 0x207fffff, {1500000000}, COutPoint(InsecureRand256(), 0), std::map<COutPoint, CStakeCache>(), solved);
+    BOOST_CHECK(solved.empty());
+    CheckKernelCache(&pindexPrev, 0x207fffff, {1500000000}, COutPoint(InsecureRand256(), 0), CStakeCache(), solved);
+    BOOST_CHECK(solved.empty());
+}
+
+BOOST_AUTO_TEST_CASE(stake_seen_expiry)
+{
+    CStakeSeen stakes;
+    CStakeSeen::Stake stake1(COutPoint(InsecureRand256(), 0), 1500000000);
+    CStakeSeen::Stake stake2(COutPoint(InsecureRand256(), 1), 1500000016);
+
+    stakes.insert(stake1, 100);
+    stakes.insert(stake2, 101);
+    // The same stake in a higher header
+    stakes.insert(stake1, 105);
+    BOOST_CHECK_EQUAL(stakes.size(), 2U);
+    BOOST_CHECK_EQUAL(stakes.count(stake1), 1U);
+    BOOST_CHECK_EQUAL(stakes.count(CStakeSeen::Stake(stake1.first, stake1.second + 16)), 0U);
+
+    // stake1 is kept for the header at 105
+    stakes.Expire(102);
+    BOOST_CHECK_EQUAL(stakes.count(stake1), 1U);
+    BOOST_CHECK_EQUAL(stakes.count(stake2), 0U);
+
+    stakes.Expire(106);
+    BOOST_CHECK_EQUAL(stakes.size(), 0U);
+
+    stakes.insert(stake2, 110);
+    stakes.clear();
+    BOOST_CHECK_EQUAL(stakes.count(stake2), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(block_signature_key_recovery)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBlockHeader header;
+    header.nTime = 1500000000;
+    header.prevoutStake = COutPoint(InsecureRand256(), 1);
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(key.SignCompact(header.GetHashWithoutSign(), vchSig));
+    header.SetBlockSignature(vchSig);
+
+    CPubKey pubkey;
+    BOOST_CHECK(!GetCachedRecoveredKey(header.GetHashWithoutSign(), vchSig, pubkey));
+    BOOST_CHECK(RecoverBlockSignatureKey(header, pubkey));
+    BOOST_CHECK(pubkey == key.GetPubKey());
+
+    // The second recovery is served by the recovered key cache
+    CPubKey cached;
+    BOOST_CHECK(GetCachedRecoveredKey(header.GetHashWithoutSign(), vchSig, cached));
+    BOOST_CHECK(cached == key.GetPubKey());
+    BOOST_CHECK(RecoverBlockSignatureKey(header, cached));
+    BOOST_CHECK(cached == pubkey);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
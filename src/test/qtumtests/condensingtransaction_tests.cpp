@@ -194,7 +194,7 @@ void checkRes(ByteCodeExecResult& res, std::vector<dev::Address>& addresses, std
     }
 }
 
-void checkTx(CTransaction& tx, size_t sizeVin, size_t sizeVout, std::vector<CAmount> values){
+void checkTx(const CTransaction& tx, size_t sizeVin, size_t sizeVout, std::vector<CAmount> values){
     BOOST_CHECK(tx.vin.size() == sizeVin);
     BOOST_CHECK(tx.vout.size() == sizeVout);
 
@@ -233,7 +233,7 @@ BOOST_AUTO_TEST_CASE(condensingtransactionbehavior_tests){
     result = executeBC(txs);
     balances = {5000,2500,500};
     checkRes(result.second, addresses, balances, 1);
-    checkTx(result.second.valueTransfers[0], 1, 3, {2500,5000,500});
+    checkTx(*result.second.valueTransfers[0], 1, 3, {2500,5000,500});
 
     txs.clear();
     txs.push_back(createQtumTransaction(code[7], 2000, dev::u256(500000), dev::u256(1), hashTemp, addresses[0]));
@@ -241,8 +241,8 @@ BOOST_AUTO_TEST_CASE(condensingtransactionbehavior_tests){
     result = executeBC(txs);
     balances = {0,11500,500};
     checkRes(result.second, addresses, balances, 2);
-    checkTx(result.second.valueTransfers[0], 2, 1, {7000});
-    checkTx(result.second.valueTransfers[1], 3, 1, {11500});
+    checkTx(*result.second.valueTransfers[0], 2, 1, {7000});
+    checkTx(*result.second.valueTransfers[1], 3, 1, {11500});
 
     txs.clear();
     txs.push_back(createQtumTransaction(code[6], 2000, dev::u256(30000), dev::u256(1), hashTemp, addresses[1]));
@@ -250,8 +250,8 @@ BOOST_AUTO_TEST_CASE(condensingtransactionbehavior_tests){
     result = executeBC(txs);
     balances = {0,0,0};
     checkRes(result.second, addresses, balances, 2);
-    checkTx(result.second.valueTransfers[0], 1, 1, {2000});
-    checkTx(result.second.valueTransfers[1], 2, 1, {12000});
+    checkTx(*result.second.valueTransfers[0], 1, 1, {2000});
+    checkTx(*result.second.valueTransfers[1], 2, 1, {12000});
 }
 
 BOOST_AUTO_TEST_CASE(condensingtransactionbreadthways_tests){
@@ -275,8 +275,8 @@ BOOST_AUTO_TEST_CASE(condensingtransactionbreadthways_tests){
     result = executeBC(txs);
     std::vector<dev::u256> balances = {5000,5000,5000,0};
     checkRes(result.second, addresses, balances, 2);
-    checkTx(result.second.valueTransfers[0], 1, 1, {15000});
-    checkTx(result.second.valueTransfers[1], 1, 3, {5000,5000,5000});
+    checkTx(*result.second.valueTransfers[0], 1, 1, {15000});
+    checkTx(*result.second.valueTransfers[1], 1, 3, {5000,5000,5000});
 }
 
 BOOST_AUTO_TEST_CASE(condensingtransactiondeep_tests){
@@ -295,7 +295,7 @@ BOOST_AUTO_TEST_CASE(condensingtransactiondeep_tests){
     result = executeBC(txs);
     std::vector<dev::u256> balances = {1250,1250,2500,5000,10000};
     checkRes(result.second, addresses, balances, 1);
-    checkTx(result.second.valueTransfers[0], 1, 5, {10000,2500,1250,1250,5000});
+    checkTx(*result.second.valueTransfers[0], 1, 5, {10000,2500,1250,1250,5000});
 }
 
 BOOST_AUTO_TEST_CASE(condensingtransactionsuicide_tests){
@@ -317,7 +317,7 @@ BOOST_AUTO_TEST_CASE(condensingtransactionsuicide_tests){
     result = executeBC(txs);
     std::vector<dev::u256> balances = {13000,0};
     checkRes(result.second, addresses, balances, 1);
-    checkTx(result.second.valueTransfers[0], 1, 1, {13000});
+    checkTx(*result.second.valueTransfers[0], 1, 1, {13000});
 }
 
 BOOST_AUTO_TEST_CASE(condensingtransactionpaytopubkeyhash_tests){
@@ -337,9 +337,9 @@ BOOST_AUTO_TEST_CASE(condensingtransactionpaytopubkeyhash_tests){
     result = executeBC(txs);
     std::vector<dev::u256> balances = {6500,6500};
     checkRes(result.second, addresses, balances, 1);
-    checkTx(result.second.valueTransfers[0], 1, 2, {6500,6500});
-    BOOST_CHECK(result.second.valueTransfers[0].vout[0].scriptPubKey.IsPayToPubkeyHash());
-    BOOST_CHECK(result.second.valueTransfers[0].vout[1].scriptPubKey.HasOpCall());
+    checkTx(*result.second.valueTransfers[0], 1, 2, {6500,6500});
+    BOOST_CHECK(result.second.valueTransfers[0]->vout[0].scriptPubKey.IsPayToPubkeyHash());
+    BOOST_CHECK(result.second.valueTransfers[0]->vout[1].scriptPubKey.HasOpCall());
 }
 
 BOOST_AUTO_TEST_SUITE_END()
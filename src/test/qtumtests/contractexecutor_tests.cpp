@@ -0,0 +1,93 @@
+#include <boost/test/unit_test.hpp>
+#include <test/test_bitcoin.h>
+#include <qtum/contractexecutor.h>
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+
+BOOST_FIXTURE_TEST_SUITE(contractexecutor_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(contract_call_limits){
+    ContractCallExecutor executor(2);
+    executor.SetLimits(ContractCallClass::WALLET, {1, 1, 10000});
+
+    // Hold the one wallet slot, one more call may wait for it and the next is refused
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<int> running{0}, max_running{0};
+    auto blocking = [&] {
+        int now = ++running;
+        if (now > max_running) max_running = now;
+        released.wait();
+        --running;
+    };
+    std::string error1, error2;
+    bool ok1 = false, ok2 = false;
+    std::thread first([&] { ok1 = executor.Run(ContractCallClass::WALLET, blocking, error1); });
+    while (executor.GetStats(ContractCallClass::WALLET).running == 0) std::this_thread::yield();
+    std::thread second([&] { ok2 = executor.Run(ContractCallClass::WALLET, blocking, error2); });
+    while (executor.GetStats(ContractCallClass::WALLET).queued == 0) std::this_thread::yield();
+
+    std::string error;
+    BOOST_CHECK(!executor.Run(ContractCallClass::WALLET, [] {}, error));
+    BOOST_CHECK(!error.empty());
+
+    // The other class still has a free worker
+    bool ran = false;
+    BOOST_CHECK(executor.Run(ContractCallClass::RPC, [&] { ran = true; }, error));
+    BOOST_CHECK(ran);
+
+    release.set_value();
+    first.join();
+    second.join();
+    BOOST_CHECK(ok1 && ok2);
+    BOOST_CHECK_EQUAL(max_running, 1);
+    ContractCallClassStats stats = executor.GetStats(ContractCallClass::WALLET);
+    BOOST_CHECK_EQUAL(stats.completed, 2U);
+    BOOST_CHECK_EQUAL(stats.refused, 1U);
+
+    // Exceptions reach the caller
+    BOOST_CHECK_THROW(executor.Run(ContractCallClass::RPC, [] { throw std::runtime_error("call failed"); }, error), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(contract_call_priority_and_timeout){
+    ContractCallExecutor executor(1);
+    executor.SetLimits(ContractCallClass::WALLET, {1, 8, 10000});
+
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::string error;
+    std::thread busy([&] { executor.Run(ContractCallClass::RPC, [&] { released.wait(); }, error); });
+    while (executor.GetStats(ContractCallClass::RPC).running == 0) std::this_thread::yield();
+
+    // A call waiting longer than the timeout for the busy worker fails without running
+    executor.SetLimits(ContractCallClass::RPC, {1, 8, 50});
+    std::string timeoutError;
+    bool ran = false;
+    BOOST_CHECK(!executor.Run(ContractCallClass::RPC, [&] { ran = true; }, timeoutError));
+    BOOST_CHECK(!ran);
+    BOOST_CHECK_EQUAL(executor.GetStats(ContractCallClass::RPC).timedout, 1U);
+    executor.SetLimits(ContractCallClass::RPC, {1, 8, 10000});
+
+    // RPC calls run before the wallet calls queued earlier
+    std::mutex mutex;
+    std::vector<ContractCallClass> order;
+    std::string walletError, rpcError;
+    std::thread wallet([&] { executor.Run(ContractCallClass::WALLET, [&] { std::lock_guard<std::mutex> lock(mutex); order.push_back(ContractCallClass::WALLET); }, walletError); });
+    while (executor.GetStats(ContractCallClass::WALLET).queued == 0) std::this_thread::yield();
+    std::thread rpc([&] { executor.Run(ContractCallClass::RPC, [&] { std::lock_guard<std::mutex> lock(mutex); order.push_back(ContractCallClass::RPC); }, rpcError); });
+    while (executor.GetStats(ContractCallClass::RPC).queued == 0) std::this_thread::yield();
+
+    release.set_value();
+    busy.join();
+    wallet.join();
+    rpc.join();
+    BOOST_CHECK_EQUAL(order.size(), 2U);
+    BOOST_CHECK(order[0] == ContractCallClass::RPC);
+
+    executor.Stop();
+    BOOST_CHECK(!executor.Run(ContractCallClass::RPC, [] {}, error));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,79 @@
+#include <boost/test/unit_test.hpp>
+#include <test/test_bitcoin.h>
+#include <consensus/merkle.h>
+#include <qtum/receiptproof.h>
+#include <qtum/storageresults.h>
+#include <streams.h>
+#include <util/convert.h>
+
+static std::vector<ReceiptLeaf> makeReceipts(size_t count){
+    std::vector<ReceiptLeaf> receipts;
+    for(size_t i = 0; i < count; i++){
+        TransactionReceiptInfo receipt{};
+        receipt.transactionHash = InsecureRand256();
+        receipt.from = dev::h160(std::vector<unsigned char>(20, i + 1));
+        receipt.to = dev::h160(std::vector<unsigned char>(20, i + 2));
+        receipt.cumulativeGasUsed = 21000 * (i + 1);
+        receipt.gasUsed = 21000;
+        receipt.logs.push_back(dev::eth::LogEntry(receipt.to, {uintToh256(InsecureRand256())}, dev::bytes(i, 0xab)));
+        receipts.emplace_back(receipt, 0);
+    }
+    return receipts;
+}
+
+BOOST_FIXTURE_TEST_SUITE(receiptproof_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(receipt_leaf){
+    TransactionReceiptInfo receipt{};
+    receipt.transactionHash = InsecureRand256();
+    receipt.from = dev::h160(ParseHex("abababababababababababababababababababab"));
+    receipt.excepted = dev::eth::TransactionException::OutOfGas;
+    dev::h256 topic = uintToh256(InsecureRand256());
+    receipt.logs.push_back(dev::eth::LogEntry(receipt.from, {topic}, dev::bytes{1, 2, 3}));
+
+    ReceiptLeaf leaf(receipt, 1);
+    BOOST_CHECK(leaf.transactionHash == receipt.transactionHash);
+    BOOST_CHECK_EQUAL(leaf.n, 1U);
+    BOOST_CHECK(uintToh160(leaf.from) == receipt.from);
+    BOOST_CHECK_EQUAL(leaf.excepted, (uint32_t)dev::eth::TransactionException::OutOfGas);
+    BOOST_CHECK_EQUAL(leaf.logs.size(), 1U);
+    BOOST_CHECK(uintToh256(leaf.logs[0].topics[0]) == topic);
+    BOOST_CHECK(leaf.logs[0].data == std::vector<unsigned char>({1, 2, 3}));
+
+    // The position among the receipts of the transaction tells identical executions apart
+    BOOST_CHECK(ReceiptLeaf(receipt, 0).GetHash() != leaf.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(receipt_proof){
+    for(size_t count : {1, 2, 7, 16}){
+        std::vector<ReceiptLeaf> receipts = makeReceipts(count);
+        std::vector<uint256> hashes;
+        for(const ReceiptLeaf& leaf : receipts)
+            hashes.push_back(leaf.GetHash());
+        uint256 root = ReceiptMerkleRoot(hashes);
+
+        std::set<uint256> txids{receipts[0].transactionHash, receipts[count / 2].transactionHash};
+        CReceiptProof proof(InsecureRand256(), receipts, txids);
+        BOOST_CHECK_EQUAL(proof.receipts.size(), txids.size());
+
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << proof;
+        CReceiptProof received;
+        ss >> received;
+        BOOST_CHECK(received.hashBlock == proof.hashBlock);
+        BOOST_CHECK(received.Verify() == root);
+        BOOST_CHECK_EQUAL(received.tree.GetNumTransactions(), count);
+
+        // A receipt altered in transit no longer leads to the root
+        CReceiptProof tampered = received;
+        tampered.receipts.back().logs[0].data.push_back(0);
+        BOOST_CHECK(tampered.Verify().IsNull());
+        tampered = received;
+        tampered.receipts.pop_back();
+        BOOST_CHECK(tampered.Verify().IsNull());
+    }
+
+    BOOST_CHECK(ReceiptMerkleRoot({}).IsNull());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
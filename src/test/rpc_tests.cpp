@@ -4,6 +4,8 @@
 
 #include <rpc/server.h>
 #include <rpc/client.h>
+#include <rpc/jsonstream.h>
+#include <rpc/resultcache.h>
 #include <rpc/util.h>
 
 #include <core_io.h>
@@ -421,4 +423,78 @@ BOOST_AUTO_TEST_CASE(rpc_getblockstats_calculate_percentiles_by_weight)
     }
 }
 
+BOOST_AUTO_TEST_CASE(rpc_json_stream_writer)
+{
+    UniValue tx(UniValue::VOBJ);
+    tx.pushKV("txid", "ab\"cd");
+    tx.pushKV("vout", UniValue(UniValue::VARR));
+    UniValue block(UniValue::VOBJ);
+    block.pushKV("hash", "00");
+    block.pushKV("tx", UniValue(UniValue::VARR));
+    block.pushKV("height", 1);
+
+    // The members of the object keep their order, the streamed member is written in place
+    std::string out;
+    JSONStreamWriter writer(out);
+    writer.ObjectWithMember(block, "tx", [&] {
+        writer.BeginArray();
+        writer.Value(tx);
+        writer.Value(tx);
+        writer.EndArray();
+    });
+
+    UniValue txs(UniValue::VARR);
+    txs.push_back(tx);
+    txs.push_back(tx);
+    block.pushKV("tx", txs);
+    BOOST_CHECK_EQUAL(out, block.write());
+
+    std::string empty;
+    JSONStreamWriter emptyWriter(empty);
+    emptyWriter.BeginObject();
+    emptyWriter.Key("entries");
+    emptyWriter.BeginArray();
+    emptyWriter.EndArray();
+    emptyWriter.Key("cursor");
+    emptyWriter.Value(NullUniValue);
+    emptyWriter.EndObject();
+    BOOST_CHECK_EQUAL(empty, "{\"entries\":[],\"cursor\":null}");
+
+    BOOST_CHECK_EQUAL(JSONRPCRawReply(block.write(), UniValue(7)), JSONRPCReplyObj(block, NullUniValue, UniValue(7)).write());
+}
+
+BOOST_AUTO_TEST_CASE(rpc_result_cache)
+{
+    CUpdatedBlock tip = WITH_LOCK(cs_blockchange, return latestblock);
+    int span = Params().GetConsensus().MaxCheckpointSpan();
+    WITH_LOCK(cs_blockchange, latestblock.height = 10 * span);
+
+    RPCResultCache cache(1000);
+    std::string result;
+    BOOST_CHECK(!cache.Lookup("getblock", result));
+
+    // Results of blocks within the reorg window are not kept
+    cache.Insert("getblock", RPCResultBlock{uint256S("01"), 10 * span}, "\"recent\"");
+    BOOST_CHECK(!cache.Lookup("getblock", result));
+    cache.Insert("getblock", RPCResultBlock{uint256S("01"), span}, "\"final\"");
+    BOOST_CHECK(cache.Lookup("getblock", result));
+    BOOST_CHECK_EQUAL(result, "\"final\"");
+
+    // The least recently used results go first
+    cache.Insert("getblockheader", RPCResultBlock{uint256S("01"), span}, std::string(400, 'a'));
+    BOOST_CHECK(cache.Lookup("getblock", result));
+    cache.Insert("getrawtransaction", RPCResultBlock{uint256S("01"), span}, std::string(400, 'b'));
+    BOOST_CHECK(cache.Lookup("getblock", result));
+    BOOST_CHECK(!cache.Lookup("getblockheader", result));
+    BOOST_CHECK(cache.Lookup("getrawtransaction", result));
+
+    RPCResultCacheStats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.entries, 2U);
+    BOOST_CHECK_EQUAL(stats.hits, 4U);
+    BOOST_CHECK_EQUAL(stats.misses, 3U);
+    BOOST_CHECK(stats.usage <= stats.max_usage);
+
+    WITH_LOCK(cs_blockchange, latestblock = tip);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
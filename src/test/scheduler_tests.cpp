@@ -155,4 +155,27 @@ BOOST_AUTO_TEST_CASE(singlethreadedscheduler_ordered)
     BOOST_CHECK_EQUAL(counter2, 100);
 }
 
+BOOST_AUTO_TEST_CASE(scheduler_priority_lanes)
+{
+    CScheduler scheduler;
+
+    // all tasks are due before the thread starts, the high priority ones run first
+    boost::chrono::system_clock::time_point past = boost::chrono::system_clock::now() - boost::chrono::seconds(1);
+    std::vector<int> order;
+    for (int i = 0; i < 3; ++i) {
+        scheduler.schedule([i, &order] { order.push_back(i); }, past - boost::chrono::milliseconds(10 - i), CScheduler::PRIORITY_NORMAL);
+        scheduler.schedule([i, &order] { order.push_back(10 + i); }, past, CScheduler::PRIORITY_HIGH);
+    }
+
+    boost::thread_group threads;
+    threads.create_thread(std::bind(&CScheduler::serviceQueue, &scheduler));
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK(order == std::vector<int>({10, 11, 12, 0, 1, 2}));
+    BOOST_CHECK_EQUAL(scheduler.getLaneStats(CScheduler::PRIORITY_HIGH).nTasks.load(), 3U);
+    BOOST_CHECK_EQUAL(scheduler.getLaneStats(CScheduler::PRIORITY_NORMAL).nTasks.load(), 3U);
+    BOOST_CHECK(scheduler.getLaneStats(CScheduler::PRIORITY_NORMAL).nDelay.load() >= 3000000U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -176,4 +176,38 @@ BOOST_AUTO_TEST_CASE(findearliestatleast_edge_test)
     BOOST_CHECK(!chain.FindEarliestAtLeast(int64_t(std::numeric_limits<unsigned int>::max()) + 1));
 }
 
+BOOST_AUTO_TEST_CASE(blockindex_arena_test)
+{
+    CBlockIndexArena arena;
+
+    CBlockHeader header;
+    header.nTime = 1234;
+    header.vchBlockSigDlgt.assign(130, 0x55);
+    CBlockIndex* pindex = arena.New(header);
+    BOOST_CHECK_EQUAL(pindex->nTime, 1234U);
+    BOOST_CHECK(pindex->GetBlockHeader().vchBlockSigDlgt == header.vchBlockSigDlgt);
+
+    // A deleted entry is handed out again
+    arena.Delete(pindex);
+    CBlockIndex* pindexReused = arena.New();
+    BOOST_CHECK_EQUAL(pindexReused, pindex);
+    BOOST_CHECK_EQUAL(pindexReused->nTime, 0U);
+    BOOST_CHECK(pindexReused->vchBlockSigDlgt.empty());
+
+    // Entries beyond one slab stay valid
+    std::vector<CBlockIndex*> vIndexes{pindexReused};
+    for (int i = 1; i < 10000; i++) {
+        vIndexes.push_back(arena.New());
+        vIndexes.back()->nHeight = i;
+        vIndexes.back()->pprev = vIndexes[i - 1];
+    }
+    for (int i = 1; i < 10000; i++) {
+        BOOST_CHECK_EQUAL(vIndexes[i]->pprev->nHeight, i - 1);
+    }
+    for (CBlockIndex* p : vIndexes) {
+        arena.Delete(p);
+    }
+    arena.Clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -113,6 +113,33 @@ BOOST_AUTO_TEST_CASE(streams_vector_reader)
     BOOST_CHECK_THROW(new_reader >> d, std::ios_base::failure);
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader)
+{
+    std::vector<unsigned char> vch = {1, 255, 3, 4, 5, 6};
+
+    // Only the referenced part of the buffer is read.
+    SpanReader reader(SER_NETWORK, INIT_PROTO_VERSION, Span<const unsigned char>(vch.data() + 1, 4));
+    BOOST_CHECK_EQUAL(reader.size(), 4);
+    BOOST_CHECK(!reader.empty());
+
+    signed char b;
+    reader >> b;
+    BOOST_CHECK_EQUAL(b, -1);
+    BOOST_CHECK_EQUAL(reader.size(), 3);
+
+    // Reading past the end of the span throws even though the vector holds more bytes.
+    unsigned int c;
+    BOOST_CHECK_THROW(reader >> c, std::ios_base::failure);
+
+    uint16_t e;
+    reader >> e;
+    BOOST_CHECK_EQUAL(e, 1027); // 3,4 in little-endian base-256
+    unsigned char f;
+    reader >> f;
+    BOOST_CHECK_EQUAL(f, 5);
+    BOOST_CHECK(reader.empty());
+}
+
 BOOST_AUTO_TEST_CASE(bitstream_reader_writer)
 {
     CDataStream data(SER_NETWORK, INIT_PROTO_VERSION);
@@ -115,10 +115,12 @@ struct TestMemPoolEntryHelper
     bool spendsCoinbase;
     unsigned int sigOpCost;
     LockPoints lp;
+    uint64_t nGasLimit;
+    CAmount nMinGasPrice;
 
     TestMemPoolEntryHelper() :
         nFee(0), nTime(0), nHeight(1),
-        spendsCoinbase(false), sigOpCost(4) { }
+        spendsCoinbase(false), sigOpCost(4), nGasLimit(0), nMinGasPrice(0) { }
 
     CTxMemPoolEntry FromTx(const CMutableTransaction& tx);
     CTxMemPoolEntry FromTx(const CTransactionRef& tx);
@@ -129,6 +131,8 @@ struct TestMemPoolEntryHelper
     TestMemPoolEntryHelper &Height(unsigned int _height) { nHeight = _height; return *this; }
     TestMemPoolEntryHelper &SpendsCoinbase(bool _flag) { spendsCoinbase = _flag; return *this; }
     TestMemPoolEntryHelper &SigOpsCost(unsigned int _sigopsCost) { sigOpCost = _sigopsCost; return *this; }
+    TestMemPoolEntryHelper &GasLimit(uint64_t _gasLimit) { nGasLimit = _gasLimit; return *this; }
+    TestMemPoolEntryHelper &GasPrice(CAmount _gasPrice) { nMinGasPrice = _gasPrice; return *this; }
 };
 
 CBlock getBlock13b8a();
@@ -0,0 +1,115 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <random.h>
+#include <test/test_bitcoin.h>
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+static uint32_t RandomElement()
+{
+    uint32_t element = InsecureRand32();
+    return element ? element : 1;
+}
+
+BOOST_AUTO_TEST_CASE(pinsketch_decode)
+{
+    for (uint32_t capacity : {1, 2, 7, 20, 64}) {
+        for (uint32_t differences = 0; differences <= capacity + 2; differences++) {
+            PinSketch local(capacity), remote(capacity);
+            // Elements both sides have cancel out
+            for (int i = 0; i < 50; i++) {
+                uint32_t element = RandomElement();
+                local.Add(element);
+                remote.Add(element);
+            }
+            std::vector<uint32_t> expected;
+            for (uint32_t i = 0; i < differences; i++) {
+                expected.push_back(RandomElement());
+                (i % 2 ? local : remote).Add(expected.back());
+            }
+
+            // The sketch of the other side comes over the wire
+            PinSketch received(0);
+            BOOST_CHECK(PinSketch::Deserialize(remote.Serialize(), received));
+            BOOST_CHECK_EQUAL(received.GetCapacity(), capacity);
+            local.Merge(received);
+
+            std::vector<uint32_t> decoded;
+            if (differences <= capacity) {
+                BOOST_CHECK(local.Decode(decoded));
+                std::sort(decoded.begin(), decoded.end());
+                std::sort(expected.begin(), expected.end());
+                BOOST_CHECK(decoded == expected);
+            } else {
+                BOOST_CHECK(!local.Decode(decoded));
+                BOOST_CHECK(decoded.empty());
+            }
+        }
+    }
+
+    // Adding an element twice removes it
+    PinSketch sketch(4);
+    uint32_t element = RandomElement();
+    sketch.Add(element);
+    sketch.Add(element);
+    std::vector<uint32_t> decoded;
+    BOOST_CHECK(sketch.Decode(decoded) && decoded.empty());
+
+    PinSketch bad(0);
+    BOOST_CHECK(!PinSketch::Deserialize(std::vector<unsigned char>(7), bad));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_state)
+{
+    // Both sides derive the same short ids from the salts they exchanged
+    TxReconciliationState initiator(true, 1234, 5678);
+    TxReconciliationState responder(false, 5678, 1234);
+    BOOST_CHECK_EQUAL(initiator.m_k0, responder.m_k0);
+    BOOST_CHECK_EQUAL(initiator.m_k1, responder.m_k1);
+
+    std::vector<uint256> shared, initiator_only, responder_only;
+    for (int i = 0; i < 100; i++) shared.push_back(InsecureRand256());
+    for (int i = 0; i < 3; i++) initiator_only.push_back(InsecureRand256());
+    for (int i = 0; i < 4; i++) responder_only.push_back(InsecureRand256());
+    for (const uint256& txid : shared) {
+        BOOST_CHECK(responder.ShouldReconcile(txid, true));
+        initiator.m_local_set.insert(txid);
+        responder.m_local_set.insert(txid);
+    }
+    initiator.m_local_set.insert(initiator_only.begin(), initiator_only.end());
+    responder.m_local_set.insert(responder_only.begin(), responder_only.end());
+
+    initiator.Snapshot();
+    responder.Snapshot();
+    BOOST_CHECK(initiator.m_local_set.empty());
+    BOOST_CHECK_EQUAL(initiator.m_snapshot.size(), 103U);
+
+    uint32_t capacity = EstimateSketchCapacity(responder.m_snapshot.size(), initiator.m_snapshot.size(), (uint16_t)(RECON_DEFAULT_Q * Q_PRECISION));
+    BOOST_CHECK(capacity >= 7 && capacity <= MAX_SKETCH_CAPACITY);
+    PinSketch sketch = initiator.SketchSnapshot(capacity);
+    sketch.Merge(responder.SketchSnapshot(capacity));
+    std::vector<uint32_t> differences;
+    BOOST_CHECK(sketch.Decode(differences));
+    BOOST_CHECK_EQUAL(differences.size(), 7U);
+    size_t found_initiator = 0, found_responder = 0;
+    for (uint32_t short_id : differences) {
+        found_initiator += initiator.m_snapshot.count(short_id);
+        found_responder += responder.m_snapshot.count(short_id);
+    }
+    BOOST_CHECK_EQUAL(found_initiator, 3U);
+    BOOST_CHECK_EQUAL(found_responder, 4U);
+
+    // Full sets are announced instead
+    while (responder.m_local_set.size() < MAX_RECON_SET_SIZE) responder.m_local_set.insert(InsecureRand256());
+    BOOST_CHECK(!responder.ShouldReconcile(InsecureRand256(), true));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
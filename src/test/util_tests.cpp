@@ -156,6 +156,15 @@ BOOST_AUTO_TEST_CASE(util_HexStr)
                std::reverse_iterator<const uint8_t *>(ParseHex_expected)),
         "5f1df16b2b704c8a578d0bbaf74d385cde12c11ee50455f3c438ef4c3fbcf649b6de611feae06279a60939e028a8d65c10b73071a6f16719274855feb0fd8a6704"
     );
+
+    std::string hex = "0x";
+    HexStrAppend(hex, ParseHex_vec.begin(), ParseHex_vec.end());
+    HexStrAppend(hex, ParseHex_vec.begin(), ParseHex_vec.begin());
+    BOOST_CHECK_EQUAL(hex, "0x04678afdb0");
+    for (int i = 0; i < 256; i++) {
+        unsigned char c = i;
+        BOOST_CHECK_EQUAL(HexStr(&c, &c + 1), strprintf("%02x", i));
+    }
 }
 
 
@@ -6,6 +6,8 @@
 #include <txdb.h>
 
 #include <chainparams.h>
+#include <compressor.h>
+#include <crypto/muhash.h>
 #include <hash.h>
 #include <random.h>
 #include <pow.h>
@@ -15,6 +17,10 @@
 #include <ui_interface.h>
 #include <validation.h>
 
+#include <libdevcore/SHA3.h>
+
+#include <algorithm>
+#include <limits>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -26,15 +32,29 @@ static const char DB_BLOCK_INDEX = 'b';
 
 ////////////////////////////////////////// // qtum
 static const char DB_HEIGHTINDEX = 'h';
+static const char DB_LOGSBLOOMINDEX = 'L';
+static const char DB_LOGSBLOOMSECTION = 'M';
+static const char DB_LOGSBLOOMSTART = 'N';
+static const char DB_TOPICINDEX = 'o';
+static const char DB_TOPICINDEXSTART = 'O';
 static const char DB_STAKEINDEX = 's';
 static const char DB_DELEGATEINDEX = 'd';
+static const char DB_BLOCKSIGNATUREKEY = 'k';
+static const char DB_CONTRACTINDEX = 'r';
+static const char DB_CONTRACTHEIGHTINDEX = 'q';
 //////////////////////////////////////////
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_HEAD_BLOCKS = 'H';
+static const char DB_UTXO_SET_HASH = 'U';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_INDEX_SNAPSHOT = 'X';
+static const char DB_INDEX_SNAPSHOT_REPLAY = 'x';
+
+//! Format version of the block index snapshot file
+static const uint32_t INDEX_SNAPSHOT_VERSION = 1;
 
 ////////////////////////////////////////// // qtum
 static const char DB_ADDRESSINDEX = 'a';
@@ -42,6 +62,10 @@ static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 'S';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_ADDRESSBALANCEINDEX = 'A';
+static const char DB_ADDRESSBALANCEBEST = 'E';
+static const char DB_ADDRESSHISTORY = 'j';
+static const char DB_ADDRESSHISTORY_TXID = 'i';
 //////////////////////////////////////////
 
 namespace {
@@ -86,6 +110,123 @@ struct DelegateEntry {
     }
 };
 
+/** Address hashes of 160 bits, which most are, are stored in 20 bytes */
+template<typename Stream>
+void SerializeAddressHash(Stream& s, unsigned int type, const uint256& hashBytes)
+{
+    unsigned char size = std::all_of(hashBytes.begin() + 20, hashBytes.end(), [](unsigned char c) { return c == 0; }) ? 20 : 32;
+    ser_writedata8(s, type);
+    ser_writedata8(s, size);
+    s.write((const char*)hashBytes.begin(), size);
+}
+
+template<typename Stream>
+void UnserializeAddressHash(Stream& s, unsigned int& type, uint256& hashBytes)
+{
+    type = ser_readdata8(s);
+    unsigned char size = ser_readdata8(s);
+    if (size != 20 && size != 32)
+        throw std::ios_base::failure("invalid address hash size");
+    hashBytes.SetNull();
+    s.read((char*)hashBytes.begin(), size);
+}
+
+/**
+ * Key of an entry of the address history under DB_ADDRESSHISTORY. It is a CAddressIndexKey without
+ * the txid, which the entries of a transaction share under DB_ADDRESSHISTORY_TXID at their height and
+ * position in the block. Heights and positions stay big-endian so the entries of an address sort by height.
+ */
+struct AddressHistoryKey {
+    unsigned int type;
+    uint256 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    unsigned int index;
+    bool spending;
+
+    AddressHistoryKey() : type(0), blockHeight(0), txindex(0), index(0), spending(false) {}
+    explicit AddressHistoryKey(const CAddressIndexKey& key) :
+        type(key.type), hashBytes(key.hashBytes), blockHeight(key.blockHeight), txindex(key.txindex), index(key.index), spending(key.spending) {}
+
+    /** The entry, its txid still to be read */
+    CAddressIndexKey ToKey() const { return CAddressIndexKey(type, hashBytes, blockHeight, txindex, uint256(), index, spending); }
+
+    bool operator==(const AddressHistoryKey& other) const {
+        return type == other.type && hashBytes == other.hashBytes && blockHeight == other.blockHeight &&
+               txindex == other.txindex && index == other.index && spending == other.spending;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        SerializeAddressHash(s, type, hashBytes);
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+        s << VARINT(index);
+        ser_writedata8(s, spending);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        UnserializeAddressHash(s, type, hashBytes);
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+        s >> VARINT(index);
+        spending = ser_readdata8(s);
+    }
+};
+
+/** Start of the history of an address under DB_ADDRESSHISTORY, or of its entries from a height */
+struct AddressHistoryPrefix {
+    unsigned int type;
+    uint256 hashBytes;
+    bool fHeight;
+    int blockHeight;
+
+    AddressHistoryPrefix(unsigned int typeIn, const uint256& hashBytesIn) : type(typeIn), hashBytes(hashBytesIn), fHeight(false), blockHeight(0) {}
+    AddressHistoryPrefix(unsigned int typeIn, const uint256& hashBytesIn, int height) : type(typeIn), hashBytes(hashBytesIn), fHeight(true), blockHeight(height) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        SerializeAddressHash(s, type, hashBytes);
+        if (fHeight)
+            ser_writedata32be(s, blockHeight);
+    }
+};
+
+/** Amount of an entry of the address history, its sign is the one of the spending flag of the key */
+struct AddressHistoryAmount {
+    uint64_t nCompressed;
+
+    AddressHistoryAmount() : nCompressed(0) {}
+    explicit AddressHistoryAmount(CAmount amount) : nCompressed(CompressAmount(amount < 0 ? -amount : amount)) {}
+
+    CAmount GetAmount(bool spending) const {
+        CAmount amount = DecompressAmount(nCompressed);
+        return spending ? -amount : amount;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(VARINT(nCompressed));
+    }
+};
+
+/** Height and position in its block of a transaction with address history entries */
+struct AddressHistoryTxKey {
+    int blockHeight;
+    unsigned int txindex;
+
+    AddressHistoryTxKey(int height, unsigned int txindexIn) : blockHeight(height), txindex(txindexIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+    }
+};
+
 }
 
 CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true)
@@ -115,7 +256,33 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
+bool CCoinsViewDB::ReadUTXOSetHash(uint256 &hashBlock, MuHash3072 &hash) const {
+    std::pair<uint256, std::vector<unsigned char>> value;
+    if (!db.Read(DB_UTXO_SET_HASH, value) || value.second.size() != MuHash3072::SERIALIZED_SIZE) {
+        return false;
+    }
+    unsigned char data[MuHash3072::SERIALIZED_SIZE];
+    std::copy(value.second.begin(), value.second.end(), data);
+    hash.FromBytes(data);
+    hashBlock = value.first;
+    return true;
+}
+
+bool CCoinsViewDB::WriteUTXOSetHash(const uint256 &hashBlock, const MuHash3072 &hash) {
+    unsigned char data[MuHash3072::SERIALIZED_SIZE];
+    hash.ToBytes(data);
+    return db.Write(DB_UTXO_SET_HASH, std::make_pair(hashBlock, std::vector<unsigned char>(data, data + sizeof(data))));
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoinsImpl(mapCoins, &mapCoins, hashBlock);
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoinsImpl(mapCoins, nullptr, hashBlock);
+}
+
+bool CCoinsViewDB::WriteCoinsImpl(const CCoinsMap &mapCoins, CCoinsMap *mapErase, const uint256 &hashBlock) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -140,7 +307,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent())
@@ -150,8 +317,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        // Free the memory of written entries as we go, unless the map is still being read
+        if (mapErase)
+            it = mapErase->erase(it);
+        else
+            ++it;
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -176,12 +346,92 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+CCoinsViewBackgroundFlush::~CCoinsViewBackgroundFlush()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+bool CCoinsViewBackgroundFlush::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    if (m_flushing) {
+        CCoinsMap::const_iterator it = m_flushing->find(outpoint);
+        if (it != m_flushing->end()) {
+            if (it->second.coin.IsSpent())
+                return false;
+            coin = it->second.coin;
+            return true;
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewBackgroundFlush::HaveCoin(const COutPoint &outpoint) const {
+    if (m_flushing) {
+        CCoinsMap::const_iterator it = m_flushing->find(outpoint);
+        if (it != m_flushing->end())
+            return !it->second.coin.IsSpent();
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewBackgroundFlush::GetBestBlock() const {
+    if (m_flushing)
+        return m_flushing_block;
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundFlush::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    if (!Wait())
+        return false;
+    if (!m_background)
+        return base->BatchWrite(mapCoins, hashBlock);
+
+    m_flushing.reset(new CCoinsMap());
+    m_flushing->swap(mapCoins);
+    m_flushing_block = hashBlock;
+    m_flushing_usage = memusage::DynamicUsage(*m_flushing);
+    for (const CCoinsMap::value_type& entry : *m_flushing) {
+        m_flushing_usage += entry.second.coin.DynamicMemoryUsage();
+    }
+    m_done = false;
+    m_thread = std::thread([this] {
+        RenameThread("bitcoin-coinsflush");
+        try {
+            m_ok = m_db->WriteCoins(*m_flushing, m_flushing_block);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
+            m_ok = false;
+        }
+        m_done = true;
+    });
+    return true;
+}
+
+bool CCoinsViewBackgroundFlush::Reap(bool& fReaped) {
+    fReaped = false;
+    if (!m_flushing || !m_done)
+        return m_ok;
+    fReaped = true;
+    return Wait();
+}
+
+bool CCoinsViewBackgroundFlush::Wait() {
+    if (m_thread.joinable())
+        m_thread.join();
+    m_flushing.reset();
+    m_flushing_usage = 0;
+    return m_ok;
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" / "index" : GetBlocksDir() / "index", nCacheSize, fMemory, fWipe, false, DBProfile::RangeScans()), m_index_batch(*this) {
+    if (!fMemory) {
+        m_snapshot_path = (gArgs.IsArgSet("-blocksdir") ? GetDataDir() / "blocks" : GetBlocksDir()) / "index_snapshot.dat";
+    }
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -258,15 +508,22 @@ void CCoinsViewDBCursor::Next()
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
-    CDBBatch batch(*this);
+    // The queued block explorer indexes go out in the same synced batch as the block index
+    CDBBatch& batch = m_index_batch;
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+        // Entries written after the snapshot are loaded from here on top of it
+        if (m_index_snapshot)
+            batch.Write(std::make_pair(DB_INDEX_SNAPSHOT_REPLAY, (*it)->GetBlockHash()), '1');
     }
-    return WriteBatch(batch, true);
+    bool ret = WriteBatch(batch, true);
+    batch.Clear();
+    m_pending_logicalts.clear();
+    return ret;
 }
 
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
@@ -290,12 +547,28 @@ bool CBlockTreeDB::WriteHeightIndex(const CHeightTxIndexKey &heightIndex, const
 
 int CBlockTreeDB::ReadHeightIndex(int low, int high, int minconf,
         std::vector<std::vector<uint256>> &blocksOfHashes,
-        std::set<dev::h160> const &addresses) {
+        std::set<dev::h160> const &addresses,
+        std::vector<dev::h256> const &topics, bool matchAllTopics) {
 
     if ((high < low && high > -1) || (high == 0 && low == 0) || (high < -1 || low < 0)) {
        return -1;
     }
 
+    // Blocks whose logs bloom rules out the topics are still iterated, so the returned height
+    // advances as before, but their transactions are not collected
+    int bloomStart = -1;
+    std::vector<dev::h2048> topicBlooms;
+    if (!topics.empty() && ReadLogsBloomStart(bloomStart)) {
+        for (const dev::h256& topic : topics) {
+            dev::h2048 topicBloom;
+            topicBloom.shiftBloom<3>(dev::sha3(topic.ref()));
+            topicBlooms.push_back(topicBloom);
+        }
+    }
+    std::map<unsigned int, bool> sectionMatches;
+    int bloomHeight = -1;
+    bool bloomMatches = true;
+
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_HEIGHTINDEX, CHeightTxIndexIteratorKey(low)));
@@ -329,6 +602,28 @@ int CBlockTreeDB::ReadHeightIndex(int low, int high, int minconf,
             continue;
         }
 
+        if (!topicBlooms.empty() && nextHeight >= bloomStart) {
+            if (nextHeight != bloomHeight) {
+                bloomHeight = nextHeight;
+                unsigned int section = nextHeight / LOGS_BLOOM_SECTION_SIZE;
+                auto it = sectionMatches.find(section);
+                if (it == sectionMatches.end()) {
+                    dev::h2048 sectionBloom;
+                    ReadLogsBloom(DB_LOGSBLOOMSECTION, section, sectionBloom);
+                    it = sectionMatches.emplace(section, LogsBloomMatches(sectionBloom, topicBlooms, matchAllTopics)).first;
+                }
+                bloomMatches = it->second;
+                if (bloomMatches) {
+                    dev::h2048 blockBloom;
+                    ReadLogsBloom(DB_LOGSBLOOMINDEX, nextHeight, blockBloom);
+                    bloomMatches = LogsBloomMatches(blockBloom, topicBlooms, matchAllTopics);
+                }
+            }
+            if (!bloomMatches) {
+                continue;
+            }
+        }
+
         std::vector<uint256> hashesTx;
 
         if (!pcursor->GetValue(hashesTx)) {
@@ -343,6 +638,163 @@ int CBlockTreeDB::ReadHeightIndex(int low, int high, int minconf,
     return curheight;
 }
 
+bool CBlockTreeDB::LogsBloomMatches(const dev::h2048& bloom, const std::vector<dev::h2048>& topicBlooms, bool matchAll) {
+    for (const dev::h2048& topicBloom : topicBlooms) {
+        bool contains = bloom.contains(topicBloom);
+        if (contains != matchAll) {
+            return contains;
+        }
+    }
+    return matchAll;
+}
+
+bool CBlockTreeDB::ReadLogsBloom(char type, unsigned int index, dev::h2048& bloom) {
+    valtype value;
+    if (!Read(std::make_pair(type, CHeightTxIndexIteratorKey(index)), value) || value.size() != dev::h2048::size) {
+        bloom = dev::h2048();
+        return false;
+    }
+    bloom = dev::h2048(value);
+    return true;
+}
+
+bool CBlockTreeDB::ReadLogsBloomStart(int& height) {
+    return Read(DB_LOGSBLOOMSTART, height);
+}
+
+bool CBlockTreeDB::WriteLogsBloomStart(int height) {
+    return Write(DB_LOGSBLOOMSTART, height);
+}
+
+bool CBlockTreeDB::WriteLogsBloomIndex(unsigned int height, const dev::h2048& bloom) {
+    CDBBatch batch(*this);
+    // Blocks connected before the index existed have no bloom, queries only trust it from the first indexed height
+    int start;
+    if (!ReadLogsBloomStart(start)) {
+        batch.Write(DB_LOGSBLOOMSTART, int(height));
+    }
+    if (bloom) {
+        unsigned int section = height / LOGS_BLOOM_SECTION_SIZE;
+        dev::h2048 sectionBloom;
+        ReadLogsBloom(DB_LOGSBLOOMSECTION, section, sectionBloom);
+        sectionBloom |= bloom;
+        batch.Write(std::make_pair(DB_LOGSBLOOMINDEX, CHeightTxIndexIteratorKey(height)), bloom.asBytes());
+        batch.Write(std::make_pair(DB_LOGSBLOOMSECTION, CHeightTxIndexIteratorKey(section)), sectionBloom.asBytes());
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseLogsBloomIndex(unsigned int height) {
+    dev::h2048 bloom;
+    if (!ReadLogsBloom(DB_LOGSBLOOMINDEX, height, bloom)) {
+        return true;
+    }
+
+    // Blooms can not be subtracted, rebuild the section from the blocks left in it
+    CDBBatch batch(*this);
+    unsigned int section = height / LOGS_BLOOM_SECTION_SIZE;
+    dev::h2048 sectionBloom;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_LOGSBLOOMINDEX, CHeightTxIndexIteratorKey(section * LOGS_BLOOM_SECTION_SIZE)));
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CHeightTxIndexIteratorKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_LOGSBLOOMINDEX || key.second.height / LOGS_BLOOM_SECTION_SIZE != section) {
+            break;
+        }
+        valtype value;
+        if (key.second.height != height && pcursor->GetValue(value) && value.size() == dev::h2048::size) {
+            sectionBloom |= dev::h2048(value);
+        }
+    }
+    batch.Erase(std::make_pair(DB_LOGSBLOOMINDEX, CHeightTxIndexIteratorKey(height)));
+    if (sectionBloom) {
+        batch.Write(std::make_pair(DB_LOGSBLOOMSECTION, CHeightTxIndexIteratorKey(section)), sectionBloom.asBytes());
+    } else {
+        batch.Erase(std::make_pair(DB_LOGSBLOOMSECTION, CHeightTxIndexIteratorKey(section)));
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteTopicIndex(unsigned int height, const std::vector<std::pair<CTopicTxIndexKey, std::vector<uint256>>> &vect) {
+    CDBBatch batch(*this);
+    // Blocks connected before the index was enabled are not covered, queries only use it from the first indexed height
+    int start;
+    if (!ReadTopicIndexStart(start)) {
+        batch.Write(DB_TOPICINDEXSTART, int(height));
+    }
+    for (const auto& e : vect) {
+        batch.Write(std::make_pair(DB_TOPICINDEX, e.first), e.second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseTopicIndex(const std::vector<CTopicTxIndexKey> &vect) {
+    CDBBatch batch(*this);
+    for (const auto& key : vect) {
+        batch.Erase(std::make_pair(DB_TOPICINDEX, key));
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadTopicIndexStart(int& height) {
+    return Read(DB_TOPICINDEXSTART, height);
+}
+
+bool CBlockTreeDB::WriteTopicIndexStart(int height) {
+    return Write(DB_TOPICINDEXSTART, height);
+}
+
+bool CBlockTreeDB::EraseTopicIndexStart() {
+    return Erase(DB_TOPICINDEXSTART);
+}
+
+bool CBlockTreeDB::ReadTopicIndex(const dev::h256 &topic, int low, int high, int minconf,
+        std::map<std::pair<unsigned int, dev::h160>, std::vector<uint256>> &hashesByBlock,
+        std::set<dev::h160> const &addresses) {
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_TOPICINDEX, CTopicTxIndexIteratorKey(topic, low)));
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, CTopicTxIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_TOPICINDEX || key.second.topic != topic) {
+            break;
+        }
+
+        int nextHeight = key.second.height;
+
+        if (high > -1 && nextHeight > high) {
+            break;
+        }
+
+        if (minconf > 0) {
+            int conf = chainActive.Height() - nextHeight;
+            if (conf < minconf) {
+                break;
+            }
+        }
+
+        if (!addresses.empty() && addresses.find(key.second.address) == addresses.end()) {
+            continue;
+        }
+
+        std::vector<uint256> hashesTx;
+        if (!pcursor->GetValue(hashesTx)) {
+            return false;
+        }
+
+        std::vector<uint256>& hashes = hashesByBlock[std::make_pair(key.second.height, key.second.address)];
+        for (const uint256& hash : hashesTx) {
+            if (std::find(hashes.begin(), hashes.end(), hash) == hashes.end()) {
+                hashes.push_back(hash);
+            }
+        }
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::EraseHeightIndex(const unsigned int &height) {
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
@@ -386,6 +838,79 @@ bool CBlockTreeDB::WipeHeightIndex() {
 }
 
 
+bool CBlockTreeDB::WriteBlockSignatureKeys(const std::vector<std::pair<uint256, CPubKey>>& vect) {
+    CDBBatch batch(*this);
+    for (const auto& entry : vect)
+        batch.Write(std::make_pair(DB_BLOCKSIGNATUREKEY, entry.first), entry.second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadBlockSignatureKey(const uint256& hash, CPubKey& pubkey) {
+    return Read(std::make_pair(DB_BLOCKSIGNATUREKEY, hash), pubkey);
+}
+
+bool CBlockTreeDB::WriteContractIndex(const std::vector<std::pair<uint160, CContractIndexValue>> &vect) {
+    CDBBatch batch(*this);
+    for (const auto& e : vect) {
+        batch.Write(std::make_pair(DB_CONTRACTINDEX, e.first), e.second);
+        if (e.second.nHeight >= 0) {
+            // Lets a disconnected block find the contracts it created
+            batch.Write(std::make_pair(DB_CONTRACTHEIGHTINDEX, std::make_pair((unsigned int)e.second.nHeight, e.first)), '\0');
+        }
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseContractIndex(unsigned int height) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    CDBBatch batch(*this);
+
+    pcursor->Seek(std::make_pair(DB_CONTRACTHEIGHTINDEX, height));
+
+    while (pcursor->Valid()) {
+        std::pair<char, std::pair<unsigned int, uint160>> key;
+        if (!pcursor->GetKey(key) || key.first != DB_CONTRACTHEIGHTINDEX || key.second.first != height) {
+            break;
+        }
+        batch.Erase(key);
+        batch.Erase(std::make_pair(DB_CONTRACTINDEX, key.second.second));
+        pcursor->Next();
+    }
+
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadContractIndex(const uint160 &address, CContractIndexValue &value) {
+    return Read(std::make_pair(DB_CONTRACTINDEX, address), value);
+}
+
+bool CBlockTreeDB::ReadContractIndex(const uint160 &start, size_t skip, size_t count, std::vector<std::pair<uint160, CContractIndexValue>> &vect) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_CONTRACTINDEX, start));
+
+    while (pcursor->Valid() && vect.size() < count) {
+        boost::this_thread::interruption_point();
+        std::pair<char, uint160> key;
+        if (!pcursor->GetKey(key) || key.first != DB_CONTRACTINDEX) {
+            break;
+        }
+        if (skip > 0) {
+            skip--;
+            pcursor->Next();
+            continue;
+        }
+        CContractIndexValue value;
+        if (!pcursor->GetValue(value)) {
+            return error("failed to get contract index value");
+        }
+        vect.push_back(std::make_pair(key.second, value));
+        pcursor->Next();
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteStakeIndex(unsigned int height, uint160 address) {
     CDBBatch batch(*this);
     batch.Write(std::make_pair(DB_STAKEINDEX, height), address);
@@ -502,52 +1027,166 @@ bool CBlockTreeDB::EraseDelegateIndex(unsigned int height) {
     return WriteBatch(batch);
 }
 
+void WriteAddressIndexEntries(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &entries) {
+    for (size_t i = 0; i < entries.size(); i++) {
+        const CAddressIndexKey &key = entries[i].first;
+        batch.Write(std::make_pair(DB_ADDRESSHISTORY, AddressHistoryKey(key)), AddressHistoryAmount(entries[i].second));
+        // The entries of a transaction are adjacent, its txid is written once
+        if (i == 0 || entries[i - 1].first.blockHeight != key.blockHeight || entries[i - 1].first.txindex != key.txindex)
+            batch.Write(std::make_pair(DB_ADDRESSHISTORY_TXID, AddressHistoryTxKey(key.blockHeight, key.txindex)), key.txhash);
+    }
+}
+
+void EraseAddressIndexEntries(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &entries) {
+    for (size_t i = 0; i < entries.size(); i++) {
+        const CAddressIndexKey &key = entries[i].first;
+        batch.Erase(std::make_pair(DB_ADDRESSHISTORY, AddressHistoryKey(key)));
+        if (i == 0 || entries[i - 1].first.blockHeight != key.blockHeight || entries[i - 1].first.txindex != key.txindex)
+            batch.Erase(std::make_pair(DB_ADDRESSHISTORY_TXID, AddressHistoryTxKey(key.blockHeight, key.txindex)));
+    }
+}
+
+/** Fill in the txids of the entries read from first on, one read for the entries of each transaction */
+static bool ReadAddressIndexTxids(const CDBWrapper &db, std::vector<std::pair<CAddressIndexKey, CAmount> > &entries, size_t first) {
+    for (size_t i = first; i < entries.size(); i++) {
+        CAddressIndexKey &key = entries[i].first;
+        if (i > first && entries[i - 1].first.blockHeight == key.blockHeight && entries[i - 1].first.txindex == key.txindex) {
+            key.txhash = entries[i - 1].first.txhash;
+        } else if (!db.Read(std::make_pair(DB_ADDRESSHISTORY_TXID, AddressHistoryTxKey(key.blockHeight, key.txindex)), key.txhash)) {
+            return error("%s: no txid of the address index entries at height %d position %u", __func__, key.blockHeight, key.txindex);
+        }
+    }
+    return true;
+}
+
+bool UpgradeAddressIndex(CDBWrapper &db) {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey()));
+    std::pair<char, CAddressIndexKey> key;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX) {
+        return true;
+    }
+
+    // Each batch writes the new entries with the erasure of the old ones, an interrupted upgrade resumes at the next start
+    int64_t count = 0;
+    LogPrintf("Upgrading address index to the compact encoding...\n");
+    uiInterface.ShowProgress(_("Upgrading address index"), 0, true);
+    size_t batch_size = 1 << 24;
+    CDBBatch batch(db);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > entries(1);
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested()) {
+            break;
+        }
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX) {
+            break;
+        }
+        entries[0].first = key.second;
+        if (!pcursor->GetValue(entries[0].second)) {
+            return error("%s: cannot parse address index value", __func__);
+        }
+        WriteAddressIndexEntries(batch, entries);
+        batch.Erase(key);
+        count++;
+        if (batch.SizeEstimate() > batch_size) {
+            if (!db.WriteBatch(batch))
+                return error("%s: failed to write the upgraded address index entries", __func__);
+            batch.Clear();
+            LogPrintf("Upgraded %d address index entries\n", count);
+        }
+        pcursor->Next();
+    }
+    if (!db.WriteBatch(batch))
+        return error("%s: failed to write the upgraded address index entries", __func__);
+    db.CompactRange(DB_ADDRESSINDEX, (char)(DB_ADDRESSINDEX + 1));
+    uiInterface.ShowProgress("", 100, false);
+    LogPrintf("Upgraded %d address index entries [%s]\n", count, ShutdownRequested() ? "CANCELLED" : "DONE");
+    return !ShutdownRequested();
+}
+
 bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    WriteAddressIndexEntries(batch, vect);
     return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+    EraseAddressIndexEntries(batch, vect);
     return WriteBatch(batch);
 }
 
 bool CBlockTreeDB::ReadAddressIndex(uint256 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
+    CAddressIndexRange range;
+    if (start > 0 && end > 0)
+        range.start = start;
+    range.end = end;
+    return ReadAddressIndex(addressHash, type, range, addressIndex);
+}
 
+bool CBlockTreeDB::ReadAddressIndex(const uint256 &addressHash, int type, const CAddressIndexRange &range,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex) {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    return ReadAddressIndexRange(*this, *pcursor, addressHash, type, range, addressIndex);
+}
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+bool ReadAddressIndexRange(const CDBWrapper &db, CDBIterator &cursor, const uint256 &addressHash, int type, const CAddressIndexRange &range,
+                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex) {
+    // A position past the bound of the read order is the same as the bound
+    bool fromAfter = range.hasAfter && (range.descending ? (range.end == 0 || range.after.blockHeight <= range.end)
+                                                         : range.after.blockHeight >= range.start);
+    AddressHistoryKey after(range.after);
+    after.type = type;
+    after.hashBytes = addressHash;
+
+    if (fromAfter) {
+        cursor.Seek(std::make_pair(DB_ADDRESSHISTORY, after));
+    } else if (range.descending) {
+        cursor.Seek(std::make_pair(DB_ADDRESSHISTORY, AddressHistoryPrefix(type, addressHash, range.end > 0 ? range.end + 1 : std::numeric_limits<int>::max())));
+    } else if (range.start > 0) {
+        cursor.Seek(std::make_pair(DB_ADDRESSHISTORY, AddressHistoryPrefix(type, addressHash, range.start)));
     } else {
-        pcursor->Seek(std::make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+        cursor.Seek(std::make_pair(DB_ADDRESSHISTORY, AddressHistoryPrefix(type, addressHash)));
     }
 
-    while (pcursor->Valid()) {
+    // The seek lands on the first key at or past the position, step to the first entry to read
+    std::pair<char, AddressHistoryKey> key;
+    bool atAfter = fromAfter && cursor.Valid() && cursor.GetKey(key) && key.first == DB_ADDRESSHISTORY && key.second == after;
+    if (range.descending) {
+        if (!(atAfter && range.includeAfter)) {
+            if (cursor.Valid())
+                cursor.Prev();
+            else
+                cursor.SeekToLast();
+        }
+    } else if (atAfter && !range.includeAfter) {
+        cursor.Next();
+    }
+
+    size_t first = addressIndex.size();
+    size_t count = 0;
+    while (cursor.Valid() && (range.limit == 0 || count < range.limit)) {
         boost::this_thread::interruption_point();
-        std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
-            if (end > 0 && key.second.blockHeight > end) {
-                break;
-            }
-            CAmount nValue;
-            if (pcursor->GetValue(nValue)) {
-                addressIndex.push_back(std::make_pair(key.second, nValue));
-                pcursor->Next();
-            } else {
-                return error("failed to get address index value");
-            }
-        } else {
+        if (!cursor.GetKey(key) || key.first != DB_ADDRESSHISTORY || key.second.type != (unsigned int)type || key.second.hashBytes != addressHash)
             break;
-        }
+        if (range.descending ? (range.start > 0 && key.second.blockHeight < range.start)
+                             : (range.end > 0 && key.second.blockHeight > range.end))
+            break;
+        AddressHistoryAmount amount;
+        if (!cursor.GetValue(amount))
+            return error("failed to get address index value");
+        addressIndex.push_back(std::make_pair(key.second.ToKey(), amount.GetAmount(key.second.spending)));
+        count++;
+        if (range.descending)
+            cursor.Prev();
+        else
+            cursor.Next();
     }
 
-    return true;
+    return ReadAddressIndexTxids(db, addressIndex, first);
 }
 
 bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
@@ -562,6 +1201,78 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                             const std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > &balances,
+                                             const uint256 &hashBest) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        if (it->second.IsNull()) {
+            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+        } else {
+            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+        }
+    }
+    for (std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> >::const_iterator it=balances.begin(); it!=balances.end(); it++)
+        batch.Write(std::make_pair(DB_ADDRESSBALANCEINDEX, it->first), it->second);
+    batch.Write(DB_ADDRESSBALANCEBEST, hashBest);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressBalance(const uint256 &addressHash, int type, CAddressBalanceValue &value) {
+    return Read(std::make_pair(DB_ADDRESSBALANCEINDEX, CAddressIndexIteratorKey(type, addressHash)), value);
+}
+
+bool CBlockTreeDB::ReadAddressBalanceBest(uint256 &hashBest) {
+    return Read(DB_ADDRESSBALANCEBEST, hashBest);
+}
+
+bool CBlockTreeDB::BuildAddressBalanceIndex(int maxHeight, const uint256 &hashBest) {
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(DB_ADDRESSHISTORY);
+
+    // The history is sorted by address, the totals of one address are complete when the next one starts
+    CDBBatch batch(*this);
+    CAddressIndexIteratorKey current;
+    CAddressBalanceValue totals;
+    bool fCurrent = false;
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, AddressHistoryKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSHISTORY;
+        if (fCurrent && (!fValid || key.second.type != current.type || key.second.hashBytes != current.hashBytes)) {
+            batch.Write(std::make_pair(DB_ADDRESSBALANCEINDEX, current), totals);
+            fCurrent = false;
+            if (batch.SizeEstimate() > (1 << 24)) {
+                if (!WriteBatch(batch))
+                    return false;
+                batch.Clear();
+            }
+        }
+        if (!fValid)
+            break;
+
+        if (key.second.blockHeight <= maxHeight) {
+            AddressHistoryAmount amount;
+            if (!pcursor->GetValue(amount))
+                return error("failed to get address index value");
+            CAmount nValue = amount.GetAmount(key.second.spending);
+            if (!fCurrent) {
+                current = CAddressIndexIteratorKey(key.second.type, key.second.hashBytes);
+                totals.SetNull();
+                fCurrent = true;
+            }
+            totals.balance += nValue;
+            if (nValue > 0)
+                totals.received += nValue;
+            totals.utxos += key.second.spending ? -1 : 1;
+            totals.lastHeight = std::max(totals.lastHeight, key.second.blockHeight);
+        }
+        pcursor->Next();
+    }
+    batch.Write(DB_ADDRESSBALANCEBEST, hashBest);
+    return WriteBatch(batch, true);
+}
+
 bool CBlockTreeDB::ReadAddressUnspentIndex(uint256 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
 
@@ -587,6 +1298,40 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint256 addressHash, int type,
     return true;
 }
 
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint256 &addressHash, int type, const CAddressUnspentKey *after, bool includeAfter, size_t limit,
+                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    if (after) {
+        CAddressUnspentKey start(type, addressHash, after->txhash, after->index);
+        pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, start));
+        std::pair<char,CAddressUnspentKey> key;
+        if (!includeAfter && pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX &&
+            key.second.type == start.type && key.second.hashBytes == start.hashBytes &&
+            key.second.txhash == start.txhash && key.second.index == start.index) {
+            pcursor->Next();
+        }
+    } else {
+        pcursor->Seek(std::make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
+
+    size_t count = 0;
+    while (pcursor->Valid() && (limit == 0 || count < limit)) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CAddressUnspentKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSUNSPENTINDEX || key.second.type != (unsigned int)type || key.second.hashBytes != addressHash)
+            break;
+        CAddressUnspentValue nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address unspent value");
+        unspentOutputs.push_back(std::make_pair(key.second, nValue));
+        count++;
+        pcursor->Next();
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CDBBatch batch(*this);
     batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
@@ -628,6 +1373,12 @@ bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &block
 
 bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
 
+    std::map<uint256, unsigned int>::const_iterator it = m_pending_logicalts.find(hash);
+    if (it != m_pending_logicalts.end()) {
+        ltimestamp = it->second;
+        return true;
+    }
+
     CTimestampBlockIndexValue(lts);
     if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
        return false;
@@ -652,6 +1403,33 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
     return WriteBatch(batch);
 }
 
+void CBlockTreeDB::BatchAddressIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                       const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex,
+                                       const CTimestampIndexKey &timestampIndex,
+                                       const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
+    // Leveldb applies the batch in order, a later write or erase of a key queued earlier wins
+    WriteAddressIndexEntries(m_index_batch, addressIndex);
+    for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=spentIndex.begin(); it!=spentIndex.end(); it++) {
+        if (it->second.IsNull()) {
+            m_index_batch.Erase(std::make_pair(DB_SPENTINDEX, it->first));
+        } else {
+            m_index_batch.Write(std::make_pair(DB_SPENTINDEX, it->first), it->second);
+        }
+    }
+    m_index_batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
+    m_index_batch.Write(std::make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
+    m_pending_logicalts[blockhashIndex.blockHash] = logicalts.ltimestamp;
+}
+
+bool CBlockTreeDB::FlushIndexBatch() {
+    if (m_index_batch.SizeEstimate() == 0)
+        return true;
+    bool ret = WriteBatch(m_index_batch);
+    m_index_batch.Clear();
+    m_pending_logicalts.clear();
+    return ret;
+}
+
 bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
     LOCK(cs_main);
     BlockMap::iterator mi = mapBlockIndex.find(hash);
@@ -663,8 +1441,110 @@ bool CBlockTreeDB::blockOnchainActive(const uint256 &hash) {
 }
 ///////////////////////////////////////////////////////
 
+/** Fill the block index entry of hash from its disk representation */
+static bool LoadDiskBlockIndex(const CDiskBlockIndex& diskindex, const uint256& hash, bool fCheckProof, std::function<CBlockIndex*(const uint256&)>& insertBlockIndex)
+{
+    // Construct block index object
+    CBlockIndex* pindexNew = insertBlockIndex(hash);
+    pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+    pindexNew->nHeight        = diskindex.nHeight;
+    pindexNew->nFile          = diskindex.nFile;
+    pindexNew->nDataPos       = diskindex.nDataPos;
+    pindexNew->nUndoPos       = diskindex.nUndoPos;
+    pindexNew->nVersion       = diskindex.nVersion;
+    pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+    pindexNew->nTime          = diskindex.nTime;
+    pindexNew->nBits          = diskindex.nBits;
+    pindexNew->nNonce         = diskindex.nNonce;
+    pindexNew->nMoneySupply   = diskindex.nMoneySupply;
+    pindexNew->nBurnedCoins   = diskindex.nBurnedCoins;
+    pindexNew->nStatus        = diskindex.nStatus;
+    pindexNew->nTx            = diskindex.nTx;
+    pindexNew->hashStateRoot  = diskindex.hashStateRoot; // qtum
+    pindexNew->hashUTXORoot   = diskindex.hashUTXORoot; // qtum
+    pindexNew->nStakeModifier = diskindex.nStakeModifier;
+    pindexNew->prevoutStake   = diskindex.prevoutStake;
+    pindexNew->vchBlockSigDlgt    = diskindex.vchBlockSigDlgt; // qtum
+
+    if (fCheckProof && !CheckIndexProof(*pindexNew, Params().GetConsensus()))
+        return error("%s: CheckIndexProof failed: %s", __func__, pindexNew->ToString());
+
+    // NovaCoin: build setStakeSeen
+    if (pindexNew->IsProofOfStake())
+        setStakeSeen.insert(std::make_pair(pindexNew->prevoutStake, pindexNew->nTime), pindexNew->nHeight);
+    return true;
+}
+
+bool CBlockTreeDB::ReadBlockIndexSnapshot(const uint256& checksum, std::vector<std::pair<uint256, CDiskBlockIndex>>& entries)
+{
+    CAutoFile file(fsbridge::fopen(m_snapshot_path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: cannot open %s", __func__, m_snapshot_path.string());
+
+    try {
+        CHashVerifier<CAutoFile> verifier(&file);
+        uint32_t nVersion;
+        uint64_t nCount;
+        verifier >> nVersion >> nCount;
+        if (nVersion != INDEX_SNAPSHOT_VERSION)
+            return error("%s: unknown snapshot version %u", __func__, nVersion);
+        entries.resize(nCount);
+        for (std::pair<uint256, CDiskBlockIndex>& entry : entries) {
+            verifier >> entry.first >> entry.second;
+        }
+        uint256 hashFile;
+        file >> hashFile;
+        if (hashFile != verifier.GetHash() || hashFile != checksum)
+            return error("%s: checksum mismatch", __func__);
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
+    uint256 checksum;
+    if (!m_snapshot_path.empty() && Read(DB_INDEX_SNAPSHOT, checksum)) {
+        std::vector<std::pair<uint256, CDiskBlockIndex>> entries;
+        if (ReadBlockIndexSnapshot(checksum, entries)) {
+            // The snapshot was written from the validated index, its proofs are not checked again
+            for (const std::pair<uint256, CDiskBlockIndex>& entry : entries) {
+                LoadDiskBlockIndex(entry.second, entry.first, false, insertBlockIndex);
+            }
+            size_t nLoaded = entries.size();
+            entries.clear();
+
+            // Replay the entries written after the snapshot
+            size_t nReplayed = 0;
+            std::unique_ptr<CDBIterator> pcursor(NewIterator());
+            pcursor->Seek(std::make_pair(DB_INDEX_SNAPSHOT_REPLAY, uint256()));
+            while (pcursor->Valid()) {
+                boost::this_thread::interruption_point();
+                std::pair<char, uint256> key;
+                if (!pcursor->GetKey(key) || key.first != DB_INDEX_SNAPSHOT_REPLAY)
+                    break;
+                CDiskBlockIndex diskindex;
+                if (!Read(std::make_pair(DB_BLOCK_INDEX, key.second), diskindex))
+                    return error("%s: failed to read replayed entry %s", __func__, key.second.ToString());
+                if (!LoadDiskBlockIndex(diskindex, key.second, true, insertBlockIndex))
+                    return false;
+                nReplayed++;
+                pcursor->Next();
+            }
+            LogPrintf("Loaded %u block index entries from snapshot, %u replayed from the database\n", nLoaded, nReplayed);
+            m_index_snapshot = true;
+            return true;
+        }
+        LogPrintf("Ignoring the block index snapshot, loading the block index from the database\n");
+        // Stop recording replay entries for a snapshot that cannot be used
+        CDBBatch batch(*this);
+        batch.Erase(DB_INDEX_SNAPSHOT);
+        EraseSnapshotReplay(batch);
+        if (!WriteBatch(batch, true))
+            return error("%s: failed to discard the block index snapshot", __func__);
+    }
+
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
@@ -676,34 +1556,8 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
         if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nMoneySupply   = diskindex.nMoneySupply;
-                pindexNew->nBurnedCoins   = diskindex.nBurnedCoins;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-                pindexNew->hashStateRoot  = diskindex.hashStateRoot; // qtum
-                pindexNew->hashUTXORoot   = diskindex.hashUTXORoot; // qtum
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake   = diskindex.prevoutStake;
-                pindexNew->vchBlockSigDlgt    = diskindex.vchBlockSigDlgt; // qtum
-
-                if (!CheckIndexProof(*pindexNew, Params().GetConsensus()))
-                    return error("%s: CheckIndexProof failed: %s", __func__, pindexNew->ToString());
-
-                // NovaCoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(std::make_pair(pindexNew->prevoutStake, pindexNew->nTime));
+                if (!LoadDiskBlockIndex(diskindex, diskindex.GetBlockHash(), true, insertBlockIndex))
+                    return false;
                 pcursor->Next();
             } else {
                 return error("%s: failed to read value", __func__);
@@ -716,6 +1570,63 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
     return true;
 }
 
+void CBlockTreeDB::EraseSnapshotReplay(CDBBatch& batch)
+{
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(std::make_pair(DB_INDEX_SNAPSHOT_REPLAY, uint256()));
+    while (pcursor->Valid()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_INDEX_SNAPSHOT_REPLAY)
+            break;
+        batch.Erase(key);
+        pcursor->Next();
+    }
+}
+
+bool CBlockTreeDB::WriteBlockIndexSnapshot(const std::vector<const CBlockIndex*>& blockinfo)
+{
+    if (m_snapshot_path.empty())
+        return false;
+
+    fs::path pathTmp = m_snapshot_path;
+    pathTmp += ".new";
+    uint256 checksum;
+    {
+        CAutoFile file(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull())
+            return error("%s: cannot open %s", __func__, pathTmp.string());
+
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        try {
+            uint64_t nCount = blockinfo.size();
+            file << INDEX_SNAPSHOT_VERSION << nCount;
+            hasher << INDEX_SNAPSHOT_VERSION << nCount;
+            for (const CBlockIndex* pindex : blockinfo) {
+                CDiskBlockIndex diskindex(pindex);
+                file << pindex->GetBlockHash() << diskindex;
+                hasher << pindex->GetBlockHash() << diskindex;
+            }
+            checksum = hasher.GetHash();
+            file << checksum;
+        } catch (const std::exception& e) {
+            return error("%s: I/O error - %s", __func__, e.what());
+        }
+        if (!FileCommit(file.Get()))
+            return error("%s: failed to commit %s", __func__, pathTmp.string());
+    }
+    if (!RenameOver(pathTmp, m_snapshot_path))
+        return error("%s: cannot rename %s", __func__, pathTmp.string());
+
+    // From now on the snapshot plus the entries written after it make up the index
+    CDBBatch batch(*this);
+    batch.Write(DB_INDEX_SNAPSHOT, checksum);
+    EraseSnapshotReplay(batch);
+    if (!WriteBatch(batch, true))
+        return false;
+    m_index_snapshot = true;
+    return true;
+}
+
 namespace {
 
 //! Legacy class to deserialize pre-pertxout database entries without reindex.
@@ -846,5 +1757,11 @@ bool CBlockTreeDB::EraseBlockIndex(const std::vector<uint256> &vect)
     CDBBatch batch(*this);
     for (std::vector<uint256>::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Erase(std::make_pair(DB_BLOCK_INDEX, *it));
+    if (m_index_snapshot) {
+        // The snapshot still holds the erased entries, stop using it
+        batch.Erase(DB_INDEX_SNAPSHOT);
+        EraseSnapshotReplay(batch);
+        m_index_snapshot = false;
+    }
     return WriteBatch(batch);
 }
@@ -10,12 +10,15 @@
 #include <dbwrapper.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <pubkey.h>
 #include <libdevcore/Common.h>
 #include <libdevcore/FixedHash.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -23,12 +26,16 @@
 
 class CBlockIndex;
 class CCoinsViewDBCursor;
+class MuHash3072;
 class uint256;
 struct CHeightTxIndexKey;
 struct CHeightTxIndexIteratorKey;
+struct CTopicTxIndexKey;
+struct CContractIndexValue;
 
 //////////////////////////////////// //qtum
 struct CAddressIndexKey;
+struct CAddressIndexRange;
 struct CAddressUnspentKey;
 struct CAddressUnspentValue;
 struct CMempoolAddressDeltaKey;
@@ -57,8 +64,16 @@ static const int64_t nMaxBlockDBCache = 2;
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
 static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to all block filter index caches combined in MiB.
+static const int64_t max_filter_index_cache = 1024;
+//! -addressindexcache default (MiB)
+static const int64_t nDefaultAddressIndexCache = 64;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to the receipts DB specific cache, unless set with -receiptsdbcache (MiB)
+static const int64_t nMaxReceiptsDBCache = 64;
+//! Number of blocks covered by one section of the logs bloom index
+static const unsigned int LOGS_BLOOM_SECTION_SIZE = 1024;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -98,11 +113,65 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    //! Write the dirty entries of mapCoins like BatchWrite, but leave the map untouched so it can be read meanwhile
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const override;
 
+    //! The rolling hash of the coins of -utxosethash and the best block it was written at
+    bool ReadUTXOSetHash(uint256 &hashBlock, MuHash3072 &hash) const;
+    bool WriteUTXOSetHash(const uint256 &hashBlock, const MuHash3072 &hash);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
+    size_t DynamicMemoryUsage() const { return db.DynamicMemoryUsage(); }
     size_t EstimateSize() const override;
+
+private:
+    bool WriteCoinsImpl(const CCoinsMap &mapCoins, CCoinsMap *mapErase, const uint256 &hashBlock);
+};
+
+/**
+ * CCoinsView between the coins tip cache and the coin database that can
+ * write a flush in the background.
+ *
+ * When a background flush is requested, BatchWrite takes over the flushed
+ * entries and returns at once, and a thread writes them to the database.
+ * Until that write is reaped the entries keep answering lookups, so the
+ * view above sees the flushed state while the database is partially
+ * written. A further BatchWrite waits for the write in progress. All
+ * methods except the writer thread are called with cs_main held.
+ */
+class CCoinsViewBackgroundFlush final : public CCoinsViewBacked
+{
+public:
+    CCoinsViewBackgroundFlush(CCoinsView* view, CCoinsViewDB* db) : CCoinsViewBacked(view), m_db(db) {}
+    ~CCoinsViewBackgroundFlush();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+
+    //! Write the next BatchWrite in the background
+    void SetBackground(bool fBackground) { m_background = fBackground; }
+    //! Whether a background write has not been reaped yet
+    bool IsFlushing() const { return m_flushing != nullptr; }
+    //! Release a finished background write. Sets fReaped if one was released; returns false if it failed.
+    bool Reap(bool& fReaped);
+    //! Wait for a background write in progress and release it. Returns false if it failed.
+    bool Wait();
+    //! Memory held by entries being written in the background
+    size_t FlushingMemoryUsage() const { return m_flushing_usage; }
+
+private:
+    CCoinsViewDB* const m_db;
+    bool m_background{false};
+    std::unique_ptr<CCoinsMap> m_flushing;
+    uint256 m_flushing_block;
+    size_t m_flushing_usage{0};
+    std::thread m_thread;
+    std::atomic<bool> m_done{false};
+    std::atomic<bool> m_ok{true};
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -140,7 +209,14 @@ public:
     void ReadReindexing(bool &fReindexing);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    /**
+     * Load the block index. If a block index snapshot was written, it is read
+     * with one sequential pass and only the entries written since are loaded
+     * from the database.
+     */
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    /** Write a flat, checksummed snapshot of the whole block index, which must be flushed already */
+    bool WriteBlockIndexSnapshot(const std::vector<const CBlockIndex*>& blockinfo);
 
     ////////////////////////////////////////////////////////////////////////////// // qtum
     bool WriteHeightIndex(const CHeightTxIndexKey &heightIndex, const std::vector<uint256>& hash);
@@ -153,15 +229,44 @@ public:
      * @param minconf stop iterating of the block height does not have enough confirmations (ignored if <= 0)
      * @param blocksOfHashes transaction hashes in blocks iterated are collected into this vector.
      * @param addresses filter out a block unless it matches one of the addresses in this set.
+     * @param topics skip blocks whose logs bloom can not contain any of (all of, if matchAllTopics) these topics.
      *
      * @return the height of the latest block iterated. 0 if no block is iterated.
      */
     int ReadHeightIndex(int low, int high, int minconf,
             std::vector<std::vector<uint256>> &blocksOfHashes,
-            std::set<dev::h160> const &addresses);
+            std::set<dev::h160> const &addresses,
+            std::vector<dev::h256> const &topics = std::vector<dev::h256>(), bool matchAllTopics = false);
     bool EraseHeightIndex(const unsigned int &height);
     bool WipeHeightIndex();
 
+    /** Per block and per section bloom of the addresses and topics of all logs, used to skip blocks in ReadHeightIndex */
+    bool WriteLogsBloomIndex(unsigned int height, const dev::h2048& bloom);
+    bool EraseLogsBloomIndex(unsigned int height);
+    bool ReadLogsBloomStart(int& height);
+    bool WriteLogsBloomStart(int height);
+
+    /** Transactions with a log carrying a topic, by topic, height and contract address */
+    bool WriteTopicIndex(unsigned int height, const std::vector<std::pair<CTopicTxIndexKey, std::vector<uint256>>> &vect);
+    bool EraseTopicIndex(const std::vector<CTopicTxIndexKey> &vect);
+    bool ReadTopicIndexStart(int& height);
+    bool WriteTopicIndexStart(int height);
+    bool EraseTopicIndexStart();
+    /**
+     * Collects the transactions of blocks from low to high with a log carrying topic, merged by height and address
+     * into hashesByBlock. Same low, high, minconf and addresses semantics as ReadHeightIndex.
+     */
+    bool ReadTopicIndex(const dev::h256 &topic, int low, int high, int minconf,
+            std::map<std::pair<unsigned int, dev::h160>, std::vector<uint256>> &hashesByBlock,
+            std::set<dev::h160> const &addresses);
+
+
+    /** Contracts by address, with the height, transaction and creator that created them */
+    bool WriteContractIndex(const std::vector<std::pair<uint160, CContractIndexValue>> &vect);
+    bool EraseContractIndex(unsigned int height);
+    bool ReadContractIndex(const uint160 &address, CContractIndexValue &value);
+    /** Reads up to count contracts in address order, starting skip contracts after the first address not below start */
+    bool ReadContractIndex(const uint160 &start, size_t skip, size_t count, std::vector<std::pair<uint160, CContractIndexValue>> &vect);
 
     bool WriteStakeIndex(unsigned int height, uint160 address);
     bool ReadStakeIndex(unsigned int height, uint160& address);
@@ -172,6 +277,10 @@ public:
     bool ReadDelegateIndex(unsigned int height, uint160& address, uint8_t& fee);
     bool EraseDelegateIndex(unsigned int height);
 
+    //! Public keys recovered from the compact signatures of blocks, by block hash
+    bool WriteBlockSignatureKeys(const std::vector<std::pair<uint256, CPubKey>>& vect);
+    bool ReadBlockSignatureKey(const uint256& hash, CPubKey& pubkey);
+
     bool EraseBlockIndex(const std::vector<uint256>&vect);
 
     // Block explorer database functions
@@ -180,9 +289,21 @@ public:
     bool ReadAddressIndex(uint256 addressHash, int type,
                         std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                         int start = 0, int end = 0);
+    bool ReadAddressIndex(const uint256 &addressHash, int type, const CAddressIndexRange &range,
+                        std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
+    /** Writes the unspent index changes together with the new totals of the addresses they touch and the block the totals are at */
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                   const std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue> > &balances,
+                                   const uint256 &hashBest);
+    bool ReadAddressBalance(const uint256 &addressHash, int type, CAddressBalanceValue &value);
+    bool ReadAddressBalanceBest(uint256 &hashBest);
+    /** Sums the address history up to maxHeight into the address totals, which are then at block hashBest */
+    bool BuildAddressBalanceIndex(int maxHeight, const uint256 &hashBest);
     bool ReadAddressUnspentIndex(uint256 addressHash, int type,
                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+    bool ReadAddressUnspentIndex(const uint256 &addressHash, int type, const CAddressUnspentKey *after, bool includeAfter, size_t limit,
+                                std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
@@ -191,8 +312,56 @@ public:
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool blockOnchainActive(const uint256 &hash);
 
+    /**
+     * Queues the block explorer index entries of a connected block. They reach disk with the next
+     * FlushIndexBatch or WriteBatchSync, the range reads above do not see them before that.
+     * The address unspent index is read by ConnectBlock and is not queued. Callers must hold cs_main.
+     */
+    void BatchAddressIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                             const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex,
+                             const CTimestampIndexKey &timestampIndex,
+                             const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
+    bool FlushIndexBatch();
+    size_t IndexBatchSize() const { return m_index_batch.SizeEstimate(); }
+
+private:
+    //! Queued block explorer index writes, see BatchAddressIndexes
+    CDBBatch m_index_batch;
+    //! Logical timestamps queued in m_index_batch, ConnectBlock reads the one of the previous block
+    std::map<uint256, unsigned int> m_pending_logicalts;
+
+    //! Path of the block index snapshot file, empty for an in-memory database
+    fs::path m_snapshot_path;
+    //! Whether a block index snapshot is in use, so block index writes are recorded for replay
+    bool m_index_snapshot{false};
+
+    bool ReadBlockIndexSnapshot(const uint256& checksum, std::vector<std::pair<uint256, CDiskBlockIndex>>& entries);
+    void EraseSnapshotReplay(CDBBatch& batch);
+
+    bool ReadLogsBloom(char type, unsigned int index, dev::h2048& bloom);
+    static bool LogsBloomMatches(const dev::h2048& bloom, const std::vector<dev::h2048>& topicBlooms, bool matchAll);
+
     //////////////////////////////////////////////////////////////////////////////
 
 };
 
+/**
+ * The address history is kept by the block tree DB or the address index in a compact encoding: an
+ * entry is keyed by the address, 20 bytes for 160 bit hashes, and the height, position in the block
+ * and output of its transaction, and holds the compressed amount. The txid is stored once for all the
+ * entries of a transaction, at its height and position.
+ */
+void WriteAddressIndexEntries(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &entries);
+void EraseAddressIndexEntries(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &entries);
+
+/**
+ * Read a range of the address history of an address from an iterator of db. Only as many keys are
+ * visited as entries are read, and one txid is read for the entries of each transaction.
+ */
+bool ReadAddressIndexRange(const CDBWrapper &db, CDBIterator &cursor, const uint256 &addressHash, int type, const CAddressIndexRange &range,
+                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
+
+/** Convert the address history of db from the CAddressIndexKey keys of older versions. False when interrupted or on failure. */
+bool UpgradeAddressIndex(CDBWrapper &db);
+
 #endif // BITCOIN_TXDB_H
@@ -21,16 +21,21 @@
 #include <script/sign.h>
 #include <chainparams.h>
 
+/** Most ancestor sets CalculateMemPoolAncestors keeps between mempool changes */
+static const size_t MAX_ANCESTOR_CACHE_ENTRIES = 10000;
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
-                                 bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp, CAmount _nMinGasPrice)
+                                 bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp, CAmount _nMinGasPrice, uint64_t _nGasLimit,
+                                 std::shared_ptr<const CContractOutputs> _contractOutputs)
     : tx(_tx), nFee(_nFee), nTxWeight(GetTransactionWeight(*tx)), nUsageSize(RecursiveDynamicUsage(tx)), nTime(_nTime), entryHeight(_entryHeight),
     spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp),
-    nMinGasPrice(_nMinGasPrice)
+    nMinGasPrice(_nMinGasPrice), nGasLimit(_nGasLimit), contractOutputs(_contractOutputs)
 {
     nCountWithDescendants = 1;
     nSizeWithDescendants = GetTxSize();
     nModFeesWithDescendants = nFee;
+    nGasFeesWithDescendants = GetGasFee();
 
     feeDelta = 0;
 
@@ -89,17 +94,19 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
+    CAmount modifyGasFee = 0;
     for (txiter cit : setAllDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
+            modifyGasFee += cit->GetGasFee();
             modifyCount++;
             cachedDescendants[updateIt].insert(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
     }
-    mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
+    mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount, modifyGasFee));
 }
 
 // vHashesToUpdate is the set of transaction hashes from a disconnected block
@@ -152,37 +159,55 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
-    setEntries parentHashes;
     const CTransaction &tx = entry.GetTx();
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    const bool fCache = !fSearchForParents && setAncestors.empty() && limitAncestorCount == nNoLimit &&
+                        limitAncestorSize == nNoLimit && limitDescendantCount == nNoLimit && limitDescendantSize == nNoLimit;
+    txiter entryit;
+    if (!fSearchForParents) {
+        // If we're not searching for parents, we require this to be an
+        // entry in the mempool already.
+        entryit = mapTx.iterator_to(entry);
+        if (fCache) {
+            cacheMap::const_iterator cached = m_ancestor_cache.find(entryit);
+            if (cached != m_ancestor_cache.end()) {
+                setAncestors = cached->second;
+                return true;
+            }
+        }
+    }
 
+    const EpochGuard epoch(*this);
+    std::vector<txiter> stage;
     if (fSearchForParents) {
         // Get parents of this transaction that are in the mempool
         // GetMemPoolParents() is only valid for entries in the mempool, so we
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             boost::optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
-            if (piter) {
-                parentHashes.insert(*piter);
-                if (parentHashes.size() + 1 > limitAncestorCount) {
+            if (piter && !visited(*piter)) {
+                stage.push_back(*piter);
+                if (stage.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
                 }
             }
         }
     } else {
-        // If we're not searching for parents, we require this to be an
-        // entry in the mempool already.
-        txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (txiter piter : GetMemPoolParents(entryit)) {
+            if (!visited(piter)) {
+                stage.push_back(piter);
+            }
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
-    while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+    while (!stage.empty()) {
+        txiter stageit = stage.back();
+        stage.pop_back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -199,16 +224,22 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
         for (txiter phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!setAncestors.count(phash) && !visited(phash)) {
+                stage.push_back(phash);
             }
-            if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
+            if (stage.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
                 return false;
             }
         }
     }
 
+    if (fCache) {
+        if (m_ancestor_cache.size() >= MAX_ANCESTOR_CACHE_ENTRIES) {
+            m_ancestor_cache.clear();
+        }
+        m_ancestor_cache.emplace(entryit, setAncestors);
+    }
     return true;
 }
 
@@ -222,8 +253,9 @@ void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors
     const int64_t updateCount = (add ? 1 : -1);
     const int64_t updateSize = updateCount * it->GetTxSize();
     const CAmount updateFee = updateCount * it->GetModifiedFee();
+    const CAmount updateGasFee = updateCount * it->GetGasFee();
     for (txiter ancestorIt : setAncestors) {
-        mapTx.modify(ancestorIt, update_descendant_state(updateSize, updateFee, updateCount));
+        mapTx.modify(ancestorIt, update_descendant_state(updateSize, updateFee, updateCount, updateGasFee));
     }
 }
 
@@ -307,11 +339,12 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
     }
 }
 
-void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
+void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, CAmount modifyGasFee)
 {
     nSizeWithDescendants += modifySize;
     assert(int64_t(nSizeWithDescendants) > 0);
     nModFeesWithDescendants += modifyFee;
+    nGasFeesWithDescendants += modifyGasFee;
     nCountWithDescendants += modifyCount;
     assert(int64_t(nCountWithDescendants) > 0);
 }
@@ -328,7 +361,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), nFeesAdded(0), minerPolicyEstimator(estimator)
 {
     _clear(); //lock free clear
 
@@ -356,9 +389,16 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+CAmount CTxMemPool::GetFeesAdded() const
+{
+    LOCK(cs);
+    return nFeesAdded;
+}
+
 void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
 {
     NotifyEntryAdded(entry.GetSharedTx());
+    m_ancestor_cache.clear();
     // Add to memory pool without checking anything.
     // Used by AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
@@ -400,6 +440,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     UpdateEntryForAncestors(newit, setAncestors);
 
     nTransactionsUpdated++;
+    nFeesAdded += newit->GetModifiedFee();
     totalTxSize += entry.GetTxSize();
     if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(entry, validFeeEstimate);}
 
@@ -410,6 +451,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
     NotifyEntryRemoved(it->GetSharedTx(), reason);
+    m_ancestor_cache.clear();
     const uint256 hash = it->GetTx().GetHash();
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
@@ -430,6 +472,10 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
+    if (fAddressIndex) {
+        removeAddressIndex(hash);
+        removeSpentIndex(hash);
+    }
 }
 
 // Calculates descendants of entry that are not already in setDescendants, and adds to
@@ -440,22 +486,24 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
 {
-    setEntries stage;
+    const EpochGuard epoch(*this);
+    std::vector<txiter> stage;
     if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+        visited(entryit);
+        stage.push_back(entryit);
     }
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
+        stage.pop_back();
         setDescendants.insert(it);
-        stage.erase(it);
 
         const setEntries &setChildren = GetMemPoolChildren(it);
         for (txiter childiter : setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!setDescendants.count(childiter) && !visited(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -564,6 +612,10 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     }
     // Before the txs in the new block have been removed from the mempool, update policy estimates
     if (minerPolicyEstimator) {minerPolicyEstimator->processBlock(nBlockHeight, entries);}
+    // The address deltas of the block txs are removed together, removeUnchecked then finds none left
+    if (fAddressIndex) {
+        removeAddressIndex(vtx);
+    }
     for (const auto& tx : vtx)
     {
         txiter it = mapTx.find(tx->GetHash());
@@ -574,12 +626,6 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
         }
         removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
-
-        if(fAddressIndex) {
-            removeAddressIndex(tx->GetHash());
-            removeSpentIndex(tx->GetHash());
-        }
-
     }
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = true;
@@ -587,9 +633,14 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 
 void CTxMemPool::_clear()
 {
+    m_ancestor_cache.clear();
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapAddress.clear();
+    mapAddressInserted.clear();
+    mapSpent.clear();
+    mapSpentInserted.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -963,6 +1014,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, bool validFeeEstimat
 
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
+    m_ancestor_cache.clear();
     setEntries s;
     if (add && mapLinks[entry].children.insert(child).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
@@ -973,6 +1025,7 @@ void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
+    m_ancestor_cache.clear();
     setEntries s;
     if (add && mapLinks[entry].parents.insert(parent).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
@@ -1041,7 +1094,8 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
         // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        // The fees reserved for gas are left out, like in the descendant score.
+        CFeeRate removed(std::max(CAmount(0), it->GetModFeesWithDescendants() - it->GetGasFeesWithDescendants()), it->GetSizeWithDescendants());
         removed += incrementalRelayFee;
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
@@ -1113,7 +1167,17 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
 {
     LOCK(cs);
     const CTransaction& tx = entry.GetTx();
-    std::vector<CMempoolAddressDeltaKey> inserted;
+    std::vector<std::pair<uint256, int> > inserted;
+
+    auto insert = [&](const CMempoolAddressDeltaKey& key, const CMempoolAddressDelta& delta) {
+        std::pair<uint256, int> address(key.addressBytes, key.type);
+        addressDeltaVector& deltas = mapAddress[address];
+        // The deltas of a tx are added together, so the address was added for this tx if it has one of them last
+        if (deltas.empty() || deltas.back().first.txhash != key.txhash) {
+            inserted.push_back(address);
+        }
+        deltas.emplace_back(key, delta);
+    };
 
     uint256 txhash = tx.GetHash();
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
@@ -1129,9 +1193,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
             valtype addressBytes(32);
             std::copy(bytesID.begin(), bytesID.end(), addressBytes.begin());
             CMempoolAddressDeltaKey key(dest.which(), uint256(addressBytes), txhash, j, 1);
-            CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(std::make_pair(key, delta));
-            inserted.push_back(key);
+            insert(key, CMempoolAddressDelta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n));
         }
     }
 
@@ -1147,22 +1209,20 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
             valtype addressBytes(32);
             std::copy(bytesID.begin(), bytesID.end(), addressBytes.begin());
             CMempoolAddressDeltaKey key(dest.which(), uint256(addressBytes), txhash, k, 0);
-            mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+            insert(key, CMempoolAddressDelta(entry.GetTime(), out.nValue));
         }
     }
 
-    mapAddressInserted.insert(std::make_pair(txhash, inserted));
+    mapAddressInserted.emplace(txhash, std::move(inserted));
 }
 
 bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint256, int> > &addresses, std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
 {
     LOCK(cs);
-    for (std::vector<std::pair<uint256, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
-            results.push_back(*ait);
-            ait++;
+    for (const std::pair<uint256, int>& address : addresses) {
+        addressDeltaMap::const_iterator ait = mapAddress.find(address);
+        if (ait != mapAddress.end()) {
+            results.insert(results.end(), ait->second.begin(), ait->second.end());
         }
     }
     return true;
@@ -1174,9 +1234,17 @@ bool CTxMemPool::removeAddressIndex(const uint256 txhash)
     addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
 
     if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapAddress.erase(*mit);
+        for (const std::pair<uint256, int>& address : it->second) {
+            addressDeltaMap::iterator ait = mapAddress.find(address);
+            if (ait == mapAddress.end())
+                continue;
+            addressDeltaVector& deltas = ait->second;
+            deltas.erase(std::remove_if(deltas.begin(), deltas.end(), [&txhash](const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& delta) {
+                return delta.first.txhash == txhash;
+            }), deltas.end());
+            if (deltas.empty()) {
+                mapAddress.erase(ait);
+            }
         }
         mapAddressInserted.erase(it);
     }
@@ -1184,6 +1252,51 @@ bool CTxMemPool::removeAddressIndex(const uint256 txhash)
     return true;
 }
 
+void CTxMemPool::removeAddressIndex(const std::vector<CTransactionRef>& vtx)
+{
+    LOCK(cs);
+    std::set<uint256> setRemoved;
+    std::set<std::pair<uint256, int> > setAddresses;
+    for (const auto& tx : vtx) {
+        addressDeltaMapInserted::iterator it = mapAddressInserted.find(tx->GetHash());
+        if (it == mapAddressInserted.end())
+            continue;
+        setRemoved.insert(it->first);
+        setAddresses.insert(it->second.begin(), it->second.end());
+        mapAddressInserted.erase(it);
+    }
+
+    for (const std::pair<uint256, int>& address : setAddresses) {
+        addressDeltaMap::iterator ait = mapAddress.find(address);
+        if (ait == mapAddress.end())
+            continue;
+        addressDeltaVector& deltas = ait->second;
+        deltas.erase(std::remove_if(deltas.begin(), deltas.end(), [&setRemoved](const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& delta) {
+            return setRemoved.count(delta.first.txhash) != 0;
+        }), deltas.end());
+        if (deltas.empty()) {
+            mapAddress.erase(ait);
+        }
+    }
+}
+
+size_t CTxMemPool::AddressIndexUsage() const
+{
+    LOCK(cs);
+    size_t usage = memusage::DynamicUsage(mapAddress) + memusage::DynamicUsage(mapAddressInserted);
+    for (const auto& item : mapAddress) {
+        usage += memusage::DynamicUsage(item.second);
+    }
+    for (const auto& item : mapAddressInserted) {
+        usage += memusage::DynamicUsage(item.second);
+    }
+    usage += memusage::DynamicUsage(mapSpent) + memusage::DynamicUsage(mapSpentInserted);
+    for (const auto& item : mapSpentInserted) {
+        usage += memusage::DynamicUsage(item.second);
+    }
+    return usage;
+}
+
 void CTxMemPool::addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
 {
     LOCK(cs);
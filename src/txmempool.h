@@ -6,9 +6,11 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <string>
@@ -29,6 +31,7 @@
 #include <boost/signals2/signal.hpp>
 
 class CBlockIndex;
+struct CContractOutputs;
 extern CCriticalSection cs_main;
 
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
@@ -110,28 +113,6 @@ struct CMempoolAddressDeltaKey
     }
 };
 
-struct CMempoolAddressDeltaKeyCompare
-{
-    bool operator()(const CMempoolAddressDeltaKey& a, const CMempoolAddressDeltaKey& b) const {
-        if (a.type == b.type) {
-            if (a.addressBytes == b.addressBytes) {
-                if (a.txhash == b.txhash) {
-                    if (a.index == b.index) {
-                        return a.spending < b.spending;
-                    } else {
-                        return a.index < b.index;
-                    }
-                } else {
-                    return a.txhash < b.txhash;
-                }
-            } else {
-                return a.addressBytes < b.addressBytes;
-            }
-        } else {
-            return a.type < b.type;
-        }
-    }
-};
 ////////////////////////////////////////////////////////
 
 /** \class CTxMemPoolEntry
@@ -160,6 +141,8 @@ private:
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
     CAmount nMinGasPrice;      //!< The minimum gas price among the contract outputs of the tx
+    uint64_t nGasLimit;        //!< The total gas limit of the contract outputs of the tx
+    std::shared_ptr<const CContractOutputs> contractOutputs; //!< The contract outputs decoded when entering the mempool
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
@@ -167,6 +150,7 @@ private:
     uint64_t nCountWithDescendants;  //!< number of descendant transactions
     uint64_t nSizeWithDescendants;   //!< ... and size
     CAmount nModFeesWithDescendants; //!< ... and total fees (all including us)
+    CAmount nGasFeesWithDescendants; //!< ... and the part of them reserved for gas
 
     // Analogous statistics for ancestor transactions
     uint64_t nCountWithAncestors;
@@ -178,7 +162,8 @@ public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _entryHeight,
                     bool spendsCoinbase,
-                    int64_t nSigOpsCost, LockPoints lp, CAmount _nMinGasPrice = 0);
+                    int64_t nSigOpsCost, LockPoints lp, CAmount _nMinGasPrice = 0, uint64_t _nGasLimit = 0,
+                    std::shared_ptr<const CContractOutputs> _contractOutputs = nullptr);
 
     const CTransaction& GetTx() const { return *this->tx; }
     CTransactionRef GetSharedTx() const { return this->tx; }
@@ -192,9 +177,13 @@ public:
     size_t DynamicMemoryUsage() const { return nUsageSize; }
     const LockPoints& GetLockPoints() const { return lockPoints; }
     const CAmount& GetMinGasPrice() const { return nMinGasPrice; }
+    uint64_t GetGasLimit() const { return nGasLimit; }
+    //! The part of the fee reserved for the gas limit of the contract outputs, at the gas price of the tx
+    CAmount GetGasFee() const { return nMinGasPrice * (CAmount)nGasLimit; }
+    std::shared_ptr<const CContractOutputs> GetContractOutputs() const { return contractOutputs; }
 
     // Adjusts the descendant state.
-    void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
+    void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, CAmount modifyGasFee = 0);
     // Adjusts the ancestor state
     void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int64_t modifySigOps);
     // Updates the fee delta used for mining priority score, and the
@@ -206,6 +195,7 @@ public:
     uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
     uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
     CAmount GetModFeesWithDescendants() const { return nModFeesWithDescendants; }
+    CAmount GetGasFeesWithDescendants() const { return nGasFeesWithDescendants; }
 
     bool GetSpendsCoinbase() const { return spendsCoinbase; }
 
@@ -215,22 +205,24 @@ public:
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint64_t m_epoch = 0; //!< Last traversal of the mempool graph that visited the entry, see CTxMemPool::visited
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
 struct update_descendant_state
 {
-    update_descendant_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount) :
-        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount)
+    update_descendant_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount, CAmount _modifyGasFee = 0) :
+        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount), modifyGasFee(_modifyGasFee)
     {}
 
     void operator() (CTxMemPoolEntry &e)
-        { e.UpdateDescendantState(modifySize, modifyFee, modifyCount); }
+        { e.UpdateDescendantState(modifySize, modifyFee, modifyCount, modifyGasFee); }
 
     private:
         int64_t modifySize;
         CAmount modifyFee;
         int64_t modifyCount;
+        CAmount modifyGasFee;
 };
 
 struct update_ancestor_state
@@ -287,6 +279,9 @@ struct mempoolentry_txid
 /** \class CompareTxMemPoolEntryByDescendantScore
  *
  *  Sort an entry by max(score/size of entry's tx, score/size with all descendants).
+ *  The score leaves out the fees reserved for gas: they pay for the execution,
+ *  not for the space, so a contract tx with a large gas limit is not kept over
+ *  txs that pay more per byte.
  */
 class CompareTxMemPoolEntryByDescendantScore
 {
@@ -313,14 +308,16 @@ public:
     {
         // Compare feerate with descendants to feerate of the transaction, and
         // return the fee/size for the max.
-        double f1 = (double)a.GetModifiedFee() * a.GetSizeWithDescendants();
-        double f2 = (double)a.GetModFeesWithDescendants() * a.GetTxSize();
+        double fee = (double)a.GetModifiedFee() - a.GetGasFee();
+        double feeWithDescendants = (double)a.GetModFeesWithDescendants() - a.GetGasFeesWithDescendants();
+        double f1 = fee * a.GetSizeWithDescendants();
+        double f2 = feeWithDescendants * a.GetTxSize();
 
         if (f2 > f1) {
-            mod_fee = a.GetModFeesWithDescendants();
+            mod_fee = feeWithDescendants;
             size = a.GetSizeWithDescendants();
         } else {
-            mod_fee = a.GetModifiedFee();
+            mod_fee = fee;
             size = a.GetTxSize();
         }
     }
@@ -505,6 +502,18 @@ public:
     }
 };
 
+/** Hasher of the (address bytes, address type) keys of the mempool address index */
+class SaltedAddressHasher
+{
+private:
+    SaltedTxidHasher hasher;
+
+public:
+    size_t operator()(const std::pair<uint256, int>& address) const {
+        return hasher(address.first) ^ (size_t)address.second;
+    }
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -582,6 +591,7 @@ class CTxMemPool
 private:
     uint32_t nCheckFrequency GUARDED_BY(cs); //!< Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
+    CAmount nFeesAdded; //!< Sum of the modified fees of the transactions ever added, used by getblocktemplate to wake long polls
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
@@ -692,11 +702,49 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
+    /** The ancestors of in-mempool entries computed without limits, which the block assembler and
+     *  RPC calls ask for again and again while the mempool does not change. Cleared whenever an
+     *  entry is added or removed or a link between entries changes. */
+    mutable cacheMap m_ancestor_cache GUARDED_BY(cs);
+
+    mutable uint64_t m_epoch = 0;
+    mutable bool m_has_epoch_guard = false;
+
+    /** Starts a traversal of the mempool graph, entries marked by visited() during its lifetime are
+     *  known without a set of the entries walked. Traversals do not nest. */
+    class EpochGuard
+    {
+        const CTxMemPool& pool;
+    public:
+        explicit EpochGuard(const CTxMemPool& in) : pool(in)
+        {
+            assert(!pool.m_has_epoch_guard);
+            ++pool.m_epoch;
+            pool.m_has_epoch_guard = true;
+        }
+        ~EpochGuard() { pool.m_has_epoch_guard = false; }
+        EpochGuard(const EpochGuard&) = delete;
+        EpochGuard& operator=(const EpochGuard&) = delete;
+    };
+
+    /** Whether the current traversal visited the entry already, marking it visited */
+    bool visited(txiter it) const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        assert(m_has_epoch_guard);
+        bool ret = it->m_epoch >= m_epoch;
+        it->m_epoch = std::max(it->m_epoch, m_epoch);
+        return ret;
+    }
+
     //////////////////////////////////////////////////////////////// // qtum
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
+    // The deltas of each address, a lookup is a single hash probe and the
+    // deltas of an address are removed in one pass when a block is connected
+    typedef std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > addressDeltaVector;
+    typedef std::unordered_map<std::pair<uint256, int>, addressDeltaVector, SaltedAddressHasher> addressDeltaMap;
     addressDeltaMap mapAddress;
 
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
+    // The addresses each tx has deltas for
+    typedef std::unordered_map<uint256, std::vector<std::pair<uint256, int> >, SaltedTxidHasher> addressDeltaMapInserted;
     addressDeltaMapInserted mapAddressInserted;
 
     typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
@@ -743,6 +791,10 @@ public:
     bool getAddressIndex(std::vector<std::pair<uint256, int> > &addresses,
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
     bool removeAddressIndex(const uint256 txhash);
+    /** Remove the deltas of the txs of a connected block, visiting each address once */
+    void removeAddressIndex(const std::vector<CTransactionRef>& vtx);
+    /** Memory usage of the address and spent indexes */
+    size_t AddressIndexUsage() const;
 
     void addSpentIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
     bool getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
@@ -761,6 +813,7 @@ public:
     bool isSpent(const COutPoint& outpoint) const;
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+    CAmount GetFeesAdded() const;
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
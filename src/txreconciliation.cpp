@@ -0,0 +1,315 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <crypto/siphash.h>
+#include <hash.h>
+
+#include <algorithm>
+
+namespace {
+
+/** The field GF(2^32), modulo the irreducible x^32 + x^7 + x^3 + x^2 + 1 */
+inline uint32_t Reduce(uint64_t r)
+{
+    // x^32 = x^7 + x^3 + x^2 + 1, applied twice as the first pass leaves up to 7 bits above x^31
+    uint64_t high = r >> 32;
+    r = (r & 0xffffffff) ^ high ^ (high << 2) ^ (high << 3) ^ (high << 7);
+    high = r >> 32;
+    return (uint32_t)(r ^ high ^ (high << 2) ^ (high << 3) ^ (high << 7));
+}
+
+uint32_t GFMul(uint32_t a, uint32_t b)
+{
+    // Carry-less multiplication four bits of b at a time
+    uint64_t table[16];
+    table[0] = 0;
+    for (int k = 1; k < 16; k++) {
+        table[k] = (k & 1) ? table[k - 1] ^ a : table[k >> 1] << 1;
+    }
+    uint64_t r = 0;
+    for (int i = 28; i >= 0; i -= 4) {
+        r = (r << 4) ^ table[(b >> i) & 15];
+    }
+    return Reduce(r);
+}
+
+/** Multiplication by a constant with lookups only, for the inner loops that reuse one factor */
+class GFMulTable
+{
+    uint32_t m_table[8][16];
+
+public:
+    explicit GFMulTable(uint32_t c)
+    {
+        for (int i = 0; i < 8; i++) {
+            m_table[i][0] = 0;
+            for (int k = 1; k < 16; k++) {
+                // The bits of k above the lowest one are already in the table
+                int bit = 0;
+                while (!((k >> bit) & 1)) bit++;
+                m_table[i][k] = m_table[i][k & (k - 1)] ^ Reduce((uint64_t)c << bit);
+            }
+            c = Reduce((uint64_t)c << 4);
+        }
+    }
+
+    uint32_t operator()(uint32_t b) const
+    {
+        return m_table[0][b & 15] ^ m_table[1][(b >> 4) & 15] ^ m_table[2][(b >> 8) & 15] ^ m_table[3][(b >> 12) & 15] ^
+               m_table[4][(b >> 16) & 15] ^ m_table[5][(b >> 20) & 15] ^ m_table[6][(b >> 24) & 15] ^ m_table[7][b >> 28];
+    }
+};
+
+/** The inverse of a nonzero element, a^(2^32 - 2) */
+uint32_t GFInv(uint32_t a)
+{
+    uint32_t r = 1;
+    for (int i = 1; i < 32; i++) {
+        a = GFMul(a, a);
+        r = GFMul(r, a);
+    }
+    return r;
+}
+
+/** Polynomials over the field, lowest coefficient first, without leading zeros */
+typedef std::vector<uint32_t> Poly;
+
+void Trim(Poly& p)
+{
+    while (!p.empty() && p.back() == 0) p.pop_back();
+}
+
+void MakeMonic(Poly& p)
+{
+    uint32_t inv = GFInv(p.back());
+    for (uint32_t& c : p) c = GFMul(c, inv);
+}
+
+/** The remainder of a divided by the monic m, and the quotient if asked */
+Poly PolyDivMod(Poly a, const Poly& m, Poly* quotient = nullptr)
+{
+    if (quotient) quotient->assign(a.size() >= m.size() ? a.size() - m.size() + 1 : 0, 0);
+    while (a.size() >= m.size()) {
+        uint32_t c = a.back();
+        size_t shift = a.size() - m.size();
+        if (quotient) (*quotient)[shift] = c;
+        if (c) {
+            const GFMulTable mul(c);
+            for (size_t j = 0; j < m.size(); j++) a[shift + j] ^= mul(m[j]);
+        }
+        a.pop_back();
+    }
+    Trim(a);
+    return a;
+}
+
+Poly PolySqrMod(const Poly& a, const Poly& m)
+{
+    // Squaring is linear in characteristic 2, the cross terms cancel
+    Poly r(a.empty() ? 0 : 2 * a.size() - 1, 0);
+    for (size_t i = 0; i < a.size(); i++) r[2 * i] = GFMul(a[i], a[i]);
+    return PolyDivMod(std::move(r), m);
+}
+
+Poly PolyGCD(Poly a, Poly b)
+{
+    while (!b.empty()) {
+        MakeMonic(b);
+        a = PolyDivMod(std::move(a), b);
+        std::swap(a, b);
+    }
+    if (!a.empty()) MakeMonic(a);
+    return a;
+}
+
+/** Whether the monic f is a product of distinct linear factors, that is whether it divides x^(2^32) - x */
+bool HasDistinctRoots(const Poly& f)
+{
+    const Poly x = PolyDivMod({0, 1}, f);
+    Poly y = x;
+    for (int i = 0; i < 32; i++) y = PolySqrMod(y, f);
+    return y == x;
+}
+
+/**
+ * The roots of the monic f with distinct roots, by Berlekamp's trace algorithm: the trace
+ * Tr(bx) = bx + (bx)^2 + ... + (bx)^(2^31) is 0 on half of the field, so gcd(f, Tr(bx))
+ * splits f. Two distinct roots are told apart by the trace with some element of a basis.
+ */
+bool FindRoots(const Poly& f, std::vector<uint32_t>& roots)
+{
+    if (f.size() == 2) {
+        roots.push_back(f[0]);
+        return true;
+    }
+    for (int j = 0; j < 32; j++) {
+        Poly y = PolyDivMod({0, (uint32_t)1 << j}, f);
+        Poly trace = y;
+        for (int i = 1; i < 32; i++) {
+            y = PolySqrMod(y, f);
+            trace.resize(std::max(trace.size(), y.size()), 0);
+            for (size_t k = 0; k < y.size(); k++) trace[k] ^= y[k];
+        }
+        Trim(trace);
+        Poly g = PolyGCD(f, trace);
+        if (g.size() > 1 && g.size() < f.size()) {
+            Poly h;
+            PolyDivMod(f, g, &h);
+            return FindRoots(g, roots) && FindRoots(h, roots);
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+void PinSketch::Add(uint32_t element)
+{
+    const GFMulTable mul_square(GFMul(element, element));
+    uint32_t power = element;
+    for (uint32_t& syndrome : m_syndromes) {
+        syndrome ^= power;
+        power = mul_square(power);
+    }
+}
+
+void PinSketch::Merge(const PinSketch& other)
+{
+    for (size_t i = 0; i < std::min(m_syndromes.size(), other.m_syndromes.size()); i++) {
+        m_syndromes[i] ^= other.m_syndromes[i];
+    }
+}
+
+bool PinSketch::Decode(std::vector<uint32_t>& elements) const
+{
+    elements.clear();
+    const size_t capacity = m_syndromes.size();
+    if (std::all_of(m_syndromes.begin(), m_syndromes.end(), [](uint32_t s) { return s == 0; })) {
+        return true;
+    }
+
+    // The even power sums follow from the odd ones, s_2i = s_i^2
+    std::vector<uint32_t> sums(2 * capacity);
+    for (size_t n = 1; n <= 2 * capacity; n++) {
+        sums[n - 1] = (n & 1) ? m_syndromes[n / 2] : GFMul(sums[n / 2 - 1], sums[n / 2 - 1]);
+    }
+
+    // Berlekamp-Massey finds the locator polynomial, whose roots are the inverses of the elements
+    Poly locator{1}, prev{1};
+    size_t length = 0, shift = 1;
+    uint32_t prev_discrepancy = 1;
+    for (size_t n = 0; n < sums.size(); n++) {
+        uint32_t discrepancy = sums[n];
+        for (size_t i = 1; i <= length && i < locator.size(); i++) {
+            discrepancy ^= GFMul(locator[i], sums[n - i]);
+        }
+        if (discrepancy == 0) {
+            shift++;
+            continue;
+        }
+        const GFMulTable mul_coef(GFMul(discrepancy, GFInv(prev_discrepancy)));
+        Poly last = locator;
+        locator.resize(std::max(locator.size(), prev.size() + shift), 0);
+        for (size_t i = 0; i < prev.size(); i++) locator[i + shift] ^= mul_coef(prev[i]);
+        if (2 * length <= n) {
+            length = n + 1 - length;
+            prev = std::move(last);
+            prev_discrepancy = discrepancy;
+            shift = 1;
+        } else {
+            shift++;
+        }
+    }
+    Trim(locator);
+    if (length > capacity || locator.size() != length + 1) {
+        return false;
+    }
+
+    // The reversed locator is monic and has the elements themselves as roots
+    Poly poly(locator.rbegin(), locator.rend());
+    if (!HasDistinctRoots(poly) || !FindRoots(poly, elements) || elements.size() != length) {
+        elements.clear();
+        return false;
+    }
+
+    // More differences than the capacity can decode to a wrong set that happens to fit
+    PinSketch check(capacity);
+    for (uint32_t element : elements) check.Add(element);
+    if (check.m_syndromes != m_syndromes) {
+        elements.clear();
+        return false;
+    }
+    return true;
+}
+
+std::vector<unsigned char> PinSketch::Serialize() const
+{
+    std::vector<unsigned char> data;
+    data.reserve(m_syndromes.size() * 4);
+    for (uint32_t syndrome : m_syndromes) {
+        for (int i = 0; i < 4; i++) data.push_back(syndrome >> (8 * i));
+    }
+    return data;
+}
+
+bool PinSketch::Deserialize(const std::vector<unsigned char>& data, PinSketch& sketch)
+{
+    if (data.size() % 4) return false;
+    sketch.m_syndromes.assign(data.size() / 4, 0);
+    for (size_t i = 0; i < data.size(); i++) {
+        sketch.m_syndromes[i / 4] |= (uint32_t)data[i] << (8 * (i % 4));
+    }
+    return true;
+}
+
+uint32_t ComputeShortTxId(uint64_t k0, uint64_t k1, const uint256& txid)
+{
+    uint32_t short_id = SipHashUint256(k0, k1, txid);
+    return short_id ? short_id : 1;
+}
+
+uint32_t EstimateSketchCapacity(size_t local_size, size_t remote_size, uint16_t q)
+{
+    const size_t difference = local_size > remote_size ? local_size - remote_size : remote_size - local_size;
+    return difference + (uint32_t)(std::min(local_size, remote_size) * (double)q / Q_PRECISION) + 1;
+}
+
+TxReconciliationState::TxReconciliationState(bool we_initiate, uint64_t local_salt, uint64_t remote_salt) :
+    m_we_initiate(we_initiate)
+{
+    // Both sides compute the same keys, whatever order the salts were exchanged in
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << std::string("Tx Relay Salting") << std::min(local_salt, remote_salt) << std::max(local_salt, remote_salt);
+    const uint256 keys = ss.GetHash();
+    m_k0 = keys.GetUint64(0);
+    m_k1 = keys.GetUint64(1);
+}
+
+bool TxReconciliationState::ShouldReconcile(const uint256& txid, bool inbound) const
+{
+    if (m_local_set.size() >= MAX_RECON_SET_SIZE) return false;
+    // Outbound peers still get a share of the transactions at once, so they spread through the network
+    // at the speed of flooding and the reconciliations mostly find transactions both sides have
+    return inbound || SipHashUint256(m_k1, m_k0, txid) % OUTBOUND_FLOOD_RATIO != 0;
+}
+
+void TxReconciliationState::Snapshot()
+{
+    m_snapshot.clear();
+    for (const uint256& txid : m_local_set) {
+        m_snapshot.emplace(ComputeShortTxId(m_k0, m_k1, txid), txid);
+    }
+    m_local_set.clear();
+}
+
+PinSketch TxReconciliationState::SketchSnapshot(uint32_t capacity) const
+{
+    PinSketch sketch(capacity);
+    for (const auto& entry : m_snapshot) {
+        sketch.Add(entry.first);
+    }
+    return sketch;
+}
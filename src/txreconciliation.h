@@ -0,0 +1,101 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include <uint256.h>
+
+#include <map>
+#include <set>
+#include <stdint.h>
+#include <vector>
+
+/** Default for -txreconciliation */
+static const bool DEFAULT_TXRECONCILIATION_ENABLE = false;
+/** Version of the reconciliation protocol announced in sendrecon */
+static const uint32_t TXRECONCILIATION_PROTOCOL_VERSION = 1;
+/** Seconds between the reconciliations an initiator requests from a peer */
+static const int64_t RECON_REQUEST_INTERVAL = 8;
+/** Seconds an initiator waits for a sketch before it gives up and announces its set */
+static const int64_t RECON_RESPONSE_TIMEOUT = 60;
+/** Most transactions waiting for the next reconciliation with a peer, the others are announced */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** Most differences a sketch can be decoded to, larger differences fall back to announcing the sets */
+static const uint32_t MAX_SKETCH_CAPACITY = 200;
+/** Share of the smaller set expected to differ, scaled by Q_PRECISION, sent in reqrecon */
+static const uint16_t Q_PRECISION = (2 << 14) - 1;
+static const double RECON_DEFAULT_Q = 0.25;
+/** One in this many transactions is announced to an outbound reconciling peer rather than reconciled */
+static const unsigned int OUTBOUND_FLOOD_RATIO = 4;
+
+/**
+ * A PinSketch of a set of nonzero 32 bit elements, as described in "Fuzzy Extractors" by Dodis, Reyzin
+ * and Smith and used by minisketch: the odd power sums s_1, s_3, ..., s_2c-1 of the elements in GF(2^32).
+ * The sketches of two sets combine with Merge into the sketch of their symmetric difference, which
+ * Decode recovers as long as it has at most c elements. A sketch of capacity c is 4c bytes whatever
+ * the size of the set, so two peers reconcile sets that mostly overlap for the size of the difference.
+ */
+class PinSketch
+{
+public:
+    explicit PinSketch(uint32_t capacity) : m_syndromes(capacity, 0) {}
+
+    uint32_t GetCapacity() const { return m_syndromes.size(); }
+
+    /** Add an element, or remove it when it is already in the set. Precondition: element != 0 */
+    void Add(uint32_t element);
+    /** Become the sketch of the symmetric difference with the set of other, of the same capacity */
+    void Merge(const PinSketch& other);
+    /** The elements of the set, or false if it has more than the capacity */
+    bool Decode(std::vector<uint32_t>& elements) const;
+
+    std::vector<unsigned char> Serialize() const;
+    /** Restore a sketch of the capacity of the data, false if it is not a whole number of syndromes */
+    static bool Deserialize(const std::vector<unsigned char>& data, PinSketch& sketch);
+
+private:
+    std::vector<uint32_t> m_syndromes;
+};
+
+/** Short id of a transaction in the sketches of a peer, never 0 */
+uint32_t ComputeShortTxId(uint64_t k0, uint64_t k1, const uint256& txid);
+
+/**
+ * Sketch capacity for reconciling sets of local_size and remote_size transactions, given the
+ * expected share q of the smaller set that differs, as in BIP330
+ */
+uint32_t EstimateSketchCapacity(size_t local_size, size_t remote_size, uint16_t q);
+
+/**
+ * The transactions a node reconciles with one peer instead of announcing them, and the
+ * reconciliation in flight. The side that made the connection initiates the reconciliations.
+ */
+struct TxReconciliationState
+{
+    TxReconciliationState(bool we_initiate, uint64_t local_salt, uint64_t remote_salt);
+
+    /** Whether we request the sketches, it is the outbound side */
+    const bool m_we_initiate;
+    /** SipHash keys of the short ids, from both salts */
+    uint64_t m_k0;
+    uint64_t m_k1;
+
+    /** Transactions to reconcile at the next reconciliation */
+    std::set<uint256> m_local_set;
+    /** The set the reconciliation in flight is about, by short id */
+    std::map<uint32_t, uint256> m_snapshot;
+    /** Initiator: a reqrecon is waiting for its sketch since this time, 0 if none */
+    int64_t m_request_time{0};
+    int64_t m_next_request{0};
+
+    /** Whether a transaction for the peer goes to the set rather than being announced */
+    bool ShouldReconcile(const uint256& txid, bool inbound) const;
+    /** Move the set to the snapshot of a new reconciliation */
+    void Snapshot();
+    /** The sketch of the snapshot */
+    PinSketch SketchSnapshot(uint32_t capacity) const;
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
@@ -118,6 +118,9 @@ public:
 
     /** Banlist did change. */
     ADD_SIGNALS_DECL_WRAPPER(BannedListChanged, void, void);
+
+    /** The DGP_CACHE values did change. */
+    ADD_SIGNALS_DECL_WRAPPER(NotifyDgpCacheChanged, void, void);
 };
 
 /** Show warning message **/
@@ -120,22 +120,35 @@ NODISCARD bool ParseUInt64(const std::string& str, uint64_t *out);
  */
 NODISCARD bool ParseDouble(const std::string& str, double *out);
 
+/** The two hex digits of every byte value, byte b at 2 * b */
+extern const char p_util_hexpairs[513];
+
+/** Append the hex encoding of a range of bytes to out, sized once and filled from a table */
 template<typename T>
-std::string HexStr(const T itbegin, const T itend, bool fSpaces=false)
+void HexStrAppend(std::string& out, const T itbegin, const T itend, bool fSpaces=false)
 {
-    std::string rv;
-    static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
-                                     '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
-    rv.reserve((itend-itbegin)*3);
+    size_t nBytes = itend - itbegin;
+    if (nBytes == 0)
+        return;
+    size_t pos = out.size();
+    out.resize(pos + (fSpaces ? nBytes * 3 - 1 : nBytes * 2));
+    char* p = &out[pos];
     for(T it = itbegin; it < itend; ++it)
     {
-        unsigned char val = (unsigned char)(*it);
         if(fSpaces && it != itbegin)
-            rv.push_back(' ');
-        rv.push_back(hexmap[val>>4]);
-        rv.push_back(hexmap[val&15]);
+            *p++ = ' ';
+        const char* pair = p_util_hexpairs + 2 * (unsigned char)(*it);
+        p[0] = pair[0];
+        p[1] = pair[1];
+        p += 2;
     }
+}
 
+template<typename T>
+std::string HexStr(const T itbegin, const T itend, bool fSpaces=false)
+{
+    std::string rv;
+    HexStrAppend(rv, itbegin, itend, fSpaces);
     return rv;
 }
 
@@ -16,11 +16,14 @@
 #include <consensus/params.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/muhash.h>
 #include <cuckoocache.h>
 #include <hash.h>
+#include <index/addressindex.h>
 #include <index/txindex.h>
 #include <libethcore/ABI.h>
 #include <net_processing.h>
+#include <node/blockfilereader.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -55,12 +58,17 @@
 #include <wallet/wallet.h>
 
 #include <algorithm>
+#include <condition_variable>
 #include <future>
+#include <list>
 #include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
 
+#include <zlib.h>
+
 #if defined(NDEBUG)
 #error "HYDRA cannot be compiled without assertions."
 #endif
@@ -80,12 +88,15 @@
 #include <locktrip/economy.h>
 #include <locktrip/lydra.h>
 #include <locktrip/price-oracle.h>
+#include <metrics.h>
+#include <qtum/contractprofiler.h>
+#include <qtum/qtumdelegation.h>
+#include <qtum/vmlogwriter.h>
 #include <univalue.h>
 
 std::unique_ptr<QtumState> globalState;
 std::shared_ptr<dev::eth::SealEngineFace> globalSealEngine;
 bool fRecordLogOpcodes = false;
-bool fIsVMlogFile = false;
 bool fGettingValuesDGP = false;
 //////////////////////////////
 
@@ -182,10 +193,52 @@ private:
      */
     CCriticalSection m_cs_chainstate;
 
+    /**
+     * The containers ConnectBlock fills for every block. They are cleared rather than destroyed
+     * between blocks, so the capacity of one block is there for the next during a sync.
+     */
+    struct ConnectBlockScratch {
+        CBlockUndo blockundo;
+        std::vector<int> prevheights;
+        std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+        std::vector<PrecomputedTransactionData> txdata;
+        std::vector<CScriptCheck> vChecks;
+        std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> addressUnspentIndex;
+        std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>> spentIndex;
+        std::vector<CTxOut> checkVouts;
+        std::vector<CTxOut> dividends;
+        std::vector<dev::Address> contractAddresses;
+        std::vector<dev::Address> contractOwners;
+        std::vector<TransactionReceiptInfo> receipts;
+
+        void Clear()
+        {
+            blockundo.vtxundo.clear();
+            prevheights.clear();
+            vPos.clear();
+            txdata.clear();
+            vChecks.clear();
+            addressIndex.clear();
+            addressUnspentIndex.clear();
+            spentIndex.clear();
+            checkVouts.clear();
+            dividends.clear();
+            contractAddresses.clear();
+            contractOwners.clear();
+            receipts.clear();
+        }
+    };
+    ConnectBlockScratch m_connect_scratch GUARDED_BY(cs_main);
+
+    /** The coins created and spent by the last ConnectBlock or DisconnectBlock, for the UTXO set hash */
+    MuHash3072 m_utxo_hash_delta GUARDED_BY(cs_main);
+
 public:
     CChain chainActive;
     BlockMap mapBlockIndex GUARDED_BY(cs_main);
-    std::set<std::pair<COutPoint, unsigned int>> setStakeSeen;
+    CStakeSeen setStakeSeen;
+    std::set<std::pair<int, CBlockIndex*>> setRecentBlockIndex;
     std::multimap<CBlockIndex*, CBlockIndex*> mapBlocksUnlinked;
     CBlockIndex* pindexBestInvalid = nullptr;
 
@@ -260,12 +313,16 @@ private:
 RecursiveMutex cs_main;
 
 BlockMap& mapBlockIndex = g_chainstate.mapBlockIndex;
-std::set<std::pair<COutPoint, unsigned int>>& setStakeSeen = g_chainstate.setStakeSeen;
+CBlockIndexArena g_block_index_arena;
+CStakeSeen& setStakeSeen = g_chainstate.setStakeSeen;
+std::set<std::pair<int, CBlockIndex*>>& setRecentBlockIndex = g_chainstate.setRecentBlockIndex;
 CChain& chainActive = g_chainstate.chainActive;
 CBlockIndex* pindexBestHeader = nullptr;
 Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
+//! Read and written with std::atomic_load and std::atomic_store, see GetTipSnapshot
+static std::shared_ptr<const TipSnapshot> g_tip_snapshot;
 int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
@@ -273,18 +330,25 @@ std::atomic_bool fReindex(false);
 bool fAddressIndex = true; // qtum
 
 bool fLogEvents = true;
+bool fLogTopicIndex = DEFAULT_LOGTOPICINDEX;
 bool fHavePruned = false;
 bool fPruneMode = false;
+bool fCompressUndo = DEFAULT_COMPRESS_UNDO;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+DBCacheSizes g_dbcache_sizes;
+size_t nAddressIndexCacheSize = nDefaultAddressIndexCache << 20;
+std::atomic<bool> fAddressBalanceIndex{false};
+bool fUTXOSetHash = DEFAULT_UTXOSETHASH;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
 
 uint256 hashAssumeValid;
+uint256 hashAssumeValidState;
 arith_uint256 nMinimumChainWork;
 
 CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
@@ -344,6 +408,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 std::unique_ptr<CCoinsViewDB> pcoinsdbview;
+std::unique_ptr<CCoinsViewBackgroundFlush> pcoinsflush;
 std::unique_ptr<CCoinsViewCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
 std::unique_ptr<StorageResults> pstorageresult;
@@ -358,6 +423,7 @@ enum class FlushStateMode {
 // See definition for documentation
 static int GetWitnessCommitmentIndex(const CBlock& block);
 static bool FlushStateToDisk(const CChainParams& chainParams, CValidationState& state, FlushStateMode mode, int nManualPruneHeight = 0);
+static bool FlushBlockSignatureKeys();
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
 
@@ -365,6 +431,44 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
 
 static FILE* OpenUndoFile(const CDiskBlockPos& pos, bool fReadOnly = false);
 
+/** Number of the last connected blocks kept in memory, so short reorgs don't read them back from disk */
+static const size_t MAX_RECENT_CONNECTED_BLOCKS = 6;
+
+struct CConnectedBlock
+{
+    const CBlockIndex* pindex;
+    std::shared_ptr<const CBlock> pblock;
+    CBlockUndo blockundo;
+    //! Decoded contract outputs of the contract transactions of the block
+    std::map<uint256, CContractOutputsRef> mapContractOutputs;
+};
+
+static std::list<CConnectedBlock> listRecentConnectedBlocks GUARDED_BY(cs_main);
+/** Decoded contract outputs of the transactions of disconnected blocks or of the saved mempool, until they are accepted to the mempool */
+static std::map<uint256, CContractOutputsRef> mapDisconnectedContractOutputs GUARDED_BY(cs_main);
+
+static std::list<CConnectedBlock>::iterator FindRecentConnectedBlock(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    return std::find_if(listRecentConnectedBlocks.begin(), listRecentConnectedBlocks.end(),
+        [pindex](const CConnectedBlock& connected) { return connected.pindex == pindex; });
+}
+
+static void AddRecentConnectedBlock(const CBlockIndex* pindex, const CBlockUndo& blockundo, std::map<uint256, CContractOutputsRef>&& mapContractOutputs) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    auto it = FindRecentConnectedBlock(pindex);
+    if (it != listRecentConnectedBlocks.end())
+        listRecentConnectedBlocks.erase(it);
+    listRecentConnectedBlocks.push_back(CConnectedBlock{pindex, nullptr, blockundo, std::move(mapContractOutputs)});
+    while (listRecentConnectedBlocks.size() > MAX_RECENT_CONNECTED_BLOCKS)
+        listRecentConnectedBlocks.pop_front();
+}
+
+static CContractOutputsRef GetDisconnectedContractOutputs(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    auto it = mapDisconnectedContractOutputs.find(hash);
+    return it != mapDisconnectedContractOutputs.end() ? it->second : nullptr;
+}
+
 int64_t FutureDrift(uint32_t nTime, int nHeight, const Consensus::Params& consensusParams)
 {
     return nTime + consensusParams.StakeTimestampMask(nHeight);
@@ -499,8 +603,11 @@ static void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age)
         LogPrint(BCLog::MEMPOOL, "Expired %i transactions from the memory pool\n", expired);
     }
 
+    // Trim a batch below the limit, so the admissions after an overflow don't each run an eviction pass
     std::vector<COutPoint> vNoSpendsRemaining;
-    pool.TrimToSize(limit, &vNoSpendsRemaining);
+    if (pool.DynamicMemoryUsage() > limit) {
+        pool.TrimToSize(limit - limit / 100 * MEMPOOL_TRIM_BATCH_PERCENT, &vNoSpendsRemaining);
+    }
     for (const COutPoint& removed : vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
@@ -565,6 +672,7 @@ static void UpdateMempoolForReorg(DisconnectedBlockTransactions& disconnectpool,
         ++it;
     }
     disconnectpool.queuedTx.clear();
+    mapDisconnectedContractOutputs.clear();
     // AcceptToMemoryPool/addUnchecked all assume that new mempool entries have
     // no in-mempool children, which is generally not true when adding
     // previously-confirmed transactions back to the mempool.
@@ -614,12 +722,130 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
+/** Locked LYDRA collateral of every key hash destination in addrhash_dest, resolved in one batch */
+static std::map<uint256, uint64_t> GetLockedHydraAmounts(const std::map<uint256, CTxDestination>& addrhash_dest)
+{
+    std::map<uint256, std::string> addressHexes;
+    std::set<std::string> addresses;
+    for (const auto& hash_dest : addrhash_dest) {
+        const CKeyID* keyID = boost::get<CKeyID>(&hash_dest.second);
+        if (keyID) {
+            std::string hex = keyID->GetReverseHex();
+            addressHexes[hash_dest.first] = hex;
+            addresses.insert(hex);
+        }
+    }
+
+    Lydra l;
+    std::map<std::string, uint64_t> amounts;
+    l.getLockedHydraAmounts(addresses, amounts);
+
+    std::map<uint256, uint64_t> lockedAmounts;
+    for (const auto& hash_hex : addressHexes) {
+        lockedAmounts[hash_hex.first] = amounts[hash_hex.second];
+    }
+    return lockedAmounts;
+}
+
+static MempoolAcceptStats mempoolAcceptStats[MEMPOOL_TX_TYPES] GUARDED_BY(cs_main);
+
+const char* MempoolTxTypeName(int type)
+{
+    switch (type) {
+    case MEMPOOL_TX_PLAIN: return "plain";
+    case MEMPOOL_TX_CREATE: return "create";
+    case MEMPOOL_TX_CALL: return "call";
+    case MEMPOOL_TX_LYDRA: return "lydra";
+    }
+    return "";
+}
+
+const char* MempoolAcceptStageName(int stage)
+{
+    switch (stage) {
+    case MEMPOOL_STAGE_PRECHECKS: return "prechecks";
+    case MEMPOOL_STAGE_INPUTS: return "inputs";
+    case MEMPOOL_STAGE_CONTRACT: return "contract";
+    case MEMPOOL_STAGE_POLICY: return "policy";
+    case MEMPOOL_STAGE_SCRIPTS: return "scripts";
+    case MEMPOOL_STAGE_INSERT: return "insert";
+    }
+    return "";
+}
+
+static void AddStageTime(MempoolStageStats& stats, int64_t nTime)
+{
+    stats.nCount++;
+    stats.nTime += nTime;
+    stats.nMaxTime = std::max(stats.nMaxTime, nTime);
+    int nBucket = 0;
+    while (nBucket < MEMPOOL_LATENCY_BUCKETS - 1 && nTime >= (int64_t{1} << nBucket)) {
+        nBucket++;
+    }
+    stats.histogram[nBucket]++;
+}
+
+std::vector<MempoolAcceptStats> GetMempoolAcceptStats()
+{
+    LOCK(cs_main);
+    return std::vector<MempoolAcceptStats>(std::begin(mempoolAcceptStats), std::end(mempoolAcceptStats));
+}
+
+/** Times the stages of a mempool admission and records them when the admission returns */
+class MempoolAcceptTimer
+{
+public:
+    MempoolTxType type;
+    bool fAccepted = false;
+
+    explicit MempoolAcceptTimer(const CTransaction& tx) :
+        type(tx.HasOpCreate() ? MEMPOOL_TX_CREATE : tx.HasOpCall() ? MEMPOOL_TX_CALL : MEMPOOL_TX_PLAIN),
+        nStart(GetTimeMicros()), nStageStart(nStart) {}
+
+    //! End the current stage and start the next one
+    void Stage(MempoolAcceptStage next)
+    {
+        int64_t nNow = GetTimeMicros();
+        nTimes[stage] += nNow - nStageStart;
+        fReached[stage] = true;
+        stage = next;
+        nStageStart = nNow;
+    }
+
+    ~MempoolAcceptTimer() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        Stage(stage);
+        MempoolAcceptStats& stats = mempoolAcceptStats[type];
+        if (fAccepted) {
+            stats.nAccepted++;
+        } else {
+            stats.nRejected++;
+        }
+        AddStageTime(stats.total, nStageStart - nStart);
+        g_metrics.mempoolAccepts[type]++;
+        for (int i = 0; i < MEMPOOL_STAGES; i++) {
+            if (!fReached[i])
+                continue;
+            AddStageTime(stats.stages[i], nTimes[i]);
+            g_metrics.mempoolAcceptTime[type][i] += nTimes[i];
+        }
+    }
+
+private:
+    const int64_t nStart;
+    int64_t nStageStart;
+    MempoolAcceptStage stage = MEMPOOL_STAGE_PRECHECKS;
+    int64_t nTimes[MEMPOOL_STAGES] = {};
+    bool fReached[MEMPOOL_STAGES] = {};
+};
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept, bool rawTx) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
     AssertLockHeld(cs_main);
     LOCK(pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+    MempoolAcceptTimer timer(tx);
     if (pfMissingInputs) {
         *pfMissingInputs = false;
     }
@@ -720,6 +946,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         std::map<uint256, CTxDestination> addrhash_dest;
 
         // do all inputs exist?
+        timer.Stage(MEMPOOL_STAGE_INPUTS);
         for (const CTxIn& txin : tx.vin) {
             if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
                 coins_to_uncache.push_back(txin.prevout);
@@ -740,15 +967,20 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             }
         }
 
+        // Contract outputs of the tx decoded by the converter, kept on the mempool entry.
+        // A tx resurrected by a reorg reuses the outputs decoded when its block was connected.
+        CContractOutputsRef contractOutputs = GetDisconnectedContractOutputs(hash);
+        timer.Stage(MEMPOOL_STAGE_CONTRACT);
         if (chainActive.Height() >= chainparams.GetConsensus().nLydraHeight) {
             if (tx.HasOpCall()) {
                 std::vector<dev::Address> lydra_tx_senders{};
                 unsigned int contractflags = GetContractScriptFlags(GetSpendHeight(view), chainparams.GetConsensus());
-                QtumTxConverter converter(tx, NULL, NULL, contractflags);
+                QtumTxConverter converter(tx, NULL, NULL, contractflags, contractOutputs);
                 ExtractQtumTX resultConverter;
                 if (!converter.extractionQtumTransactions(resultConverter)) {
                     return state.DoS(100, error("AcceptToMempool(): Contract transaction of the wrong format"), REJECT_INVALID, "bad-tx-bad-contract-format");
                 }
+                contractOutputs = converter.GetContractOutputs();
 
                 std::vector<QtumTransaction> qtumTransactions = resultConverter.first;
                 for (QtumTransaction qtumTransaction : qtumTransactions) {
@@ -758,9 +990,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                 }
 
                 if (!lydra_tx_senders.empty()) {
+                    timer.type = MEMPOOL_TX_LYDRA;
                     for (auto it = pool.mapTx.begin(); it != pool.mapTx.end(); it++) {
                         const CTransaction& currTx = it->GetTx();
-                        QtumTxConverter converter(currTx, NULL, NULL, contractflags);
+                        QtumTxConverter converter(currTx, NULL, NULL, contractflags, it->GetContractOutputs());
                         ExtractQtumTX resultConverter;
                         converter.extractionQtumTransactions(resultConverter);
                         std::vector<QtumTransaction> qtumTransactions = resultConverter.first;
@@ -807,30 +1040,27 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                 }
             }
 
+            std::map<uint256, uint64_t> locked_amounts = GetLockedHydraAmounts(addrhash_dest);
             for (const auto& addr_pair : addresses_index) {
-                // Get address utxos
-                std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-                if (!GetAddressUnspent(addr_pair.first, addr_pair.second, unspentOutputs)) {
-                    //throw error("No information available for address");
-                }
-
-                // Add the utxos to the list if they are mature and at least the minimum value
-                int coinbaseMaturity = Params().GetConsensus().CoinbaseMaturity(chainActive.Height() + 1);
                 CAmount rembalance = 0;
-                for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator i=unspentOutputs.begin(); i!=unspentOutputs.end(); i++) {
-
-                    int nDepth = chainActive.Height() - i->second.blockHeight + 1;
-                    //if (nDepth < coinbaseMaturity)
-                        //continue;
+                CAddressBalanceValue totals;
+                if (GetAddressBalance(addr_pair.first, addr_pair.second, totals)) {
+                    rembalance = totals.balance;
+                } else {
+                    // Get address utxos
+                    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+                    if (!GetAddressUnspent(addr_pair.first, addr_pair.second, unspentOutputs)) {
+                        //throw error("No information available for address");
+                    }
 
-                    rembalance += i->second.satoshis;
+                    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator i=unspentOutputs.begin(); i!=unspentOutputs.end(); i++) {
+                        rembalance += i->second.satoshis;
+                    }
                 }
                 
                 auto all_inputs = addresses_inputs[addrhash_dest[addr_pair.first]];
                 auto all_outputs = addresses_outputs[addrhash_dest[addr_pair.first]];
-                Lydra l;
-                uint64_t locked_hydra_amount;
-                l.getLockedHydraAmountPerAddress(boost::get<CKeyID>(&addrhash_dest[addr_pair.first])->GetReverseHex(), locked_hydra_amount);
+                uint64_t locked_hydra_amount = locked_amounts[addr_pair.first];
 
                 if (rembalance - all_inputs + all_outputs < locked_hydra_amount) {
                     LogPrintf("Address -> %s | rembalance -> %d | spent -> %d | locked -> %d/n", 
@@ -843,6 +1073,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         }
 
         // Bring the best block into scope
+        timer.Stage(MEMPOOL_STAGE_POLICY);
         view.GetBestBlock();
 
         // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
@@ -872,8 +1103,10 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
 
         dev::u256 txMinGasPrice = 0;
+        dev::u256 gasAllTxs = 0;
 
         //////////////////////////////////////////////////////////// // locktrip
+        timer.Stage(MEMPOOL_STAGE_CONTRACT);
         if (!CheckOpSender(tx, chainparams, GetSpendHeight(view))) {
             return state.DoS(100, false, REJECT_INVALID, "bad-txns-invalid-sender");
         }
@@ -884,16 +1117,17 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
             QtumDGP qtumDGP(globalState.get(), fGettingValuesDGP);
             uint64_t minGasPrice = qtumDGP.getMinGasPrice(chainActive.Tip()->nHeight + 1);
-            uint64_t blockGasLimit = qtumDGP.getBlockGasLimit(chainActive.Tip()->nHeight + 1);
+            uint64_t blockGasLimit = GetBlockDGPParams(chainActive.Tip(), chainActive.Tip()->nHeight + 1).blockGasLimit;
             size_t count = 0;
             for (const CTxOut& o : tx.vout)
                 count += o.scriptPubKey.HasOpCreate() || o.scriptPubKey.HasOpCall() ? 1 : 0;
             unsigned int contractflags = GetContractScriptFlags(GetSpendHeight(view), chainparams.GetConsensus());
-            QtumTxConverter converter(tx, NULL, NULL, contractflags);
+            QtumTxConverter converter(tx, NULL, NULL, contractflags, contractOutputs);
             ExtractQtumTX resultConverter;
             if (!converter.extractionQtumTransactions(resultConverter)) {
                 return state.DoS(100, error("AcceptToMempool(): Contract transaction of the wrong format"), REJECT_INVALID, "bad-tx-bad-contract-format");
             }
+            contractOutputs = converter.GetContractOutputs();
 
             if (!CheckQtumTransaction(resultConverter, state)) {
                 return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
@@ -905,7 +1139,6 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             std::vector<EthTransactionParams> qtumETP = resultConverter.second;
 
             dev::u256 sumGas = dev::u256(0);
-            dev::u256 gasAllTxs = dev::u256(0);
             for (QtumTransaction qtumTransaction : qtumTransactions) {
                 sumGas += qtumTransaction.gas() * qtumTransaction.gasPrice();
 
@@ -964,6 +1197,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                     strprintf("%d > %d", nFees, nAbsurdFee));
         }
         ////////////////////////////////////////////////////////////
+        timer.Stage(MEMPOOL_STAGE_POLICY);
 
         // nModifiedFees includes any fee deltas from PrioritiseTransaction
         CAmount nModifiedFees = nFees;
@@ -981,7 +1215,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         }
 
         CTxMemPoolEntry entry(ptx, nFees, nAcceptTime, chainActive.Height(),
-            fSpendsCoinbase, nSigOpsCost, lp, CAmount(txMinGasPrice));
+            fSpendsCoinbase, nSigOpsCost, lp, CAmount(txMinGasPrice), uint64_t(gasAllTxs), contractOutputs);
         unsigned int nSize = entry.GetTxSize();
 
         // Check that the transaction doesn't have an excessive number of
@@ -993,8 +1227,9 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
                 strprintf("%d", nSigOpsCost));
 
+        // The rolling minimum fee is bumped by the evicted fees without their gas part, compare it the same way
         CAmount mempoolRejectFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
-        if (!bypass_limits && mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) {
+        if (!bypass_limits && mempoolRejectFee > 0 && nModifiedFees - entry.GetGasFee() < mempoolRejectFee) {
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", nModifiedFees, mempoolRejectFee));
         }
 
@@ -1148,6 +1383,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+        timer.Stage(MEMPOOL_STAGE_SCRIPTS);
         PrecomputedTransactionData txdata(tx);
         if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
@@ -1185,9 +1421,12 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
         if (test_accept) {
             // Tx was accepted, but not added
+            timer.fAccepted = true;
             return true;
         }
 
+        timer.Stage(MEMPOOL_STAGE_INSERT);
+
         // Remove conflicting transactions from the mempool
         for (CTxMemPool::txiter it : allConflicting) {
             LogPrint(BCLog::MEMPOOL, "replacing tx %s with %s for %s HYDRA additional fees, %d delta bytes\n",
@@ -1229,6 +1468,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
     GetMainSignals().TransactionAddedToMempool(ptx);
 
+    timer.fAccepted = true;
     return true;
 }
 
@@ -1388,16 +1628,27 @@ bool ReadBlockFromDisk(Block& block, const CDiskBlockPos& pos, const Consensus::
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    std::shared_ptr<const MappedBlockFile> mapped;
+    Span<const unsigned char> record;
+    if (g_block_file_reader.ReadRecord("blk", pos, 0, mapped, record)) {
+        // Deserialize straight from the mapped history file
+        try {
+            SpanReader(SER_DISK, CLIENT_VERSION, record) >> block;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
 
-    // Read block
-    try {
-        filein >> block;
-    } catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        } catch (const std::exception& e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -1409,6 +1660,7 @@ bool ReadBlockFromDisk(Block& block, const CDiskBlockPos& pos, const Consensus::
     }
     return true;
 }
+template bool ReadBlockFromDisk<CBlock>(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
@@ -1428,6 +1680,19 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
 
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
+    std::shared_ptr<const MappedBlockFile> mapped;
+    Span<const unsigned char> record;
+    if (g_block_file_reader.ReadRecord("blk", pos, 0, mapped, record)) {
+        const unsigned char* blk_start = record.data() - 8;
+        if (memcmp(blk_start, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+            return error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
+                HexStr(blk_start, blk_start + CMessageHeader::MESSAGE_START_SIZE),
+                HexStr(message_start, message_start + CMessageHeader::MESSAGE_START_SIZE));
+        }
+        block.assign(record.begin(), record.end());
+        return true;
+    }
+
     CDiskBlockPos hpos = pos;
     hpos.nPos -= 8; // Seek back 8 bytes for meta header
     CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
@@ -1859,36 +2124,150 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+/**
+ * Compressed undo records hold the size of the serialized CBlockUndo as a
+ * uint32 followed by its zlib stream. The header in front of the record and
+ * the checksum behind it are the same as for plain records, and the checksum
+ * covers the uncompressed serialization.
+ */
+bool CompressUndo(const CBlockUndo& blockundo, std::vector<unsigned char>& record)
+{
+    std::vector<unsigned char> raw;
+    CVectorWriter(SER_DISK, CLIENT_VERSION, raw, 0, blockundo);
+    uLongf nCompressed = compressBound(raw.size());
+    record.resize(4 + nCompressed);
+    WriteLE32(record.data(), raw.size());
+    // The fastest level already removes most of the redundancy of scripts and txids
+    if (compress2(record.data() + 4, &nCompressed, raw.data(), raw.size(), Z_BEST_SPEED) != Z_OK)
+        return false;
+    record.resize(4 + nCompressed);
+    return true;
+}
+
+/** Decompress a record written by CompressUndo into the serialized CBlockUndo */
+bool DecompressUndo(Span<const unsigned char> record, std::vector<unsigned char>& raw)
 {
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull()) {
-        return error("%s: no undo data available", __func__);
-    }
+    if (record.size() < 4)
+        return false;
+    uLongf nRawSize = ReadLE32(record.data());
+    if (nRawSize > MAX_SIZE)
+        return false;
+    raw.resize(nRawSize);
+    if (uncompress(raw.data(), &nRawSize, record.data() + 4, record.size() - 4) != Z_OK || nRawSize != raw.size())
+        return false;
+    return true;
+}
 
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
+bool UndoWriteCompressedToDisk(const CBlockUndo& blockundo, const std::vector<unsigned char>& record, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // Open history file to append
+    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
 
+    // Write index header
+    unsigned int nSize = record.size();
+    fileout << messageStart << nSize;
+
+    // Write compressed undo data
+    long fileOutPos = ftell(fileout.Get());
+    if (fileOutPos < 0)
+        return error("%s: ftell failed", __func__);
+    pos.nPos = (unsigned int)fileOutPos;
+    fileout.write((const char*)record.data(), record.size());
+
+    // calculate & write checksum
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << hashBlock;
+    hasher << blockundo;
+    fileout << hasher.GetHash();
+
+    return true;
+}
+
+template <typename Stream>
+static bool UndoReadFromStream(CBlockUndo& blockundo, const CBlockIndex* pindex, Stream& filein)
+{
     // Read block
     uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+    CHashVerifier<Stream> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
     try {
         verifier << pindex->pprev->GetBlockHash();
         verifier >> blockundo;
         filein >> hashChecksum;
     } catch (const std::exception& e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+        return error("UndoReadFromDisk: Deserialize or I/O error - %s", e.what());
     }
 
     // Verify checksum
     if (hashChecksum != verifier.GetHash())
-        return error("%s: Checksum mismatch", __func__);
+        return error("UndoReadFromDisk: Checksum mismatch");
 
     return true;
 }
 
+static bool UndoReadCompressedFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex, const CDiskBlockPos& pos)
+{
+    // Collect the compressed record followed by the checksum
+    std::vector<unsigned char> buffer;
+    std::shared_ptr<const MappedBlockFile> mapped;
+    Span<const unsigned char> record;
+    if (g_block_file_reader.ReadRecord("rev", pos, sizeof(uint256), mapped, record)) {
+        buffer.assign(record.begin(), record.end());
+    } else {
+        CDiskBlockPos hpos = pos;
+        hpos.nPos -= 4; // Seek back 4 bytes for the record size
+        CAutoFile filein(OpenUndoFile(hpos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenUndoFile failed", __func__);
+        try {
+            unsigned int nSize;
+            filein >> nSize;
+            if (nSize > MAX_SIZE)
+                return error("%s: Undo record too large", __func__);
+            buffer.resize(nSize + sizeof(uint256));
+            filein.read((char*)buffer.data(), buffer.size());
+        } catch (const std::exception& e) {
+            return error("%s: I/O error - %s", __func__, e.what());
+        }
+    }
+
+    std::vector<unsigned char> raw;
+    if (!DecompressUndo(Span<const unsigned char>(buffer.data(), buffer.size() - sizeof(uint256)), raw))
+        return error("%s: Decompression failed", __func__);
+    raw.insert(raw.end(), buffer.end() - sizeof(uint256), buffer.end());
+
+    VectorReader filein(SER_DISK, CLIENT_VERSION, raw, 0);
+    return UndoReadFromStream(blockundo, pindex, filein);
+}
+
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    CDiskBlockPos pos = pindex->GetUndoPos();
+    if (pos.IsNull()) {
+        return error("%s: no undo data available", __func__);
+    }
+
+    if (pindex->nStatus & BLOCK_UNDO_COMPRESSED) {
+        return UndoReadCompressedFromDisk(blockundo, pindex, pos);
+    }
+
+    std::shared_ptr<const MappedBlockFile> mapped;
+    Span<const unsigned char> record;
+    if (g_block_file_reader.ReadRecord("rev", pos, sizeof(uint256), mapped, record)) {
+        // Deserialize straight from the mapped undo file, followed by the checksum
+        SpanReader filein(SER_DISK, CLIENT_VERSION, record);
+        return UndoReadFromStream(blockundo, pindex, filein);
+    }
+
+    // Open history file to read
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenUndoFile failed", __func__);
+
+    return UndoReadFromStream(blockundo, pindex, filein);
+}
+
 /** Abort with a message */
 static bool AbortNode(const std::string& strMessage, const std::string& userMessage = "")
 {
@@ -1909,6 +2288,52 @@ static bool AbortNode(CValidationState& state, const std::string& strMessage, co
 
 } // namespace
 
+/** The UTXO set hash of -utxosethash and the block it is at, null while it is not known */
+static MuHash3072 g_utxo_set_hash GUARDED_BY(cs_main);
+static uint256 g_utxo_set_hash_block GUARDED_BY(cs_main);
+
+/** Add or remove a coin of the UTXO set hash, the outpoint and the coin serialized as in gettxoutsetinfo */
+static void HashUTXOSetCoin(MuHash3072& hash, const COutPoint& outpoint, const Coin& coin, bool fInsert)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << (uint32_t)((coin.nHeight << 2) + (coin.fCoinBase ? 1u : 0u) + (coin.fCoinStake ? 2u : 0u));
+    ss << coin.out;
+    const unsigned char* data = (const unsigned char*)ss.data();
+    if (fInsert) {
+        hash.Insert(data, ss.size());
+    } else {
+        hash.Remove(data, ss.size());
+    }
+}
+
+/** Move the UTXO set hash from a block to the next or previous one, it is lost when it was not at pindexFrom */
+static void UpdateUTXOSetHash(const CBlockIndex* pindexFrom, const CBlockIndex* pindexTo, const MuHash3072& delta) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!fUTXOSetHash)
+        return;
+    if (!pindexFrom && pindexTo) {
+        // The genesis block, its outputs are not spendable and the set is empty
+        g_utxo_set_hash = MuHash3072();
+        g_utxo_set_hash_block = pindexTo->GetBlockHash();
+    } else if (pindexFrom && pindexTo && g_utxo_set_hash_block == pindexFrom->GetBlockHash()) {
+        g_utxo_set_hash *= delta;
+        g_utxo_set_hash_block = pindexTo->GetBlockHash();
+    } else {
+        g_utxo_set_hash_block.SetNull();
+    }
+}
+
+/** Store the UTXO set hash with the coins database when it is at the same block */
+static void WriteUTXOSetHash() EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!fUTXOSetHash || g_utxo_set_hash_block.IsNull() || g_utxo_set_hash_block != pcoinsdbview->GetBestBlock())
+        return;
+    if (!pcoinsdbview->WriteUTXOSetHash(g_utxo_set_hash_block, g_utxo_set_hash)) {
+        LogPrintf("%s: failed to write the UTXO set hash\n", __func__);
+    }
+}
+
 /**
  * Restore the UTXO in a Coin at a given COutPoint
  * @param undo The Coin to be restored.
@@ -1943,8 +2368,106 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
+typedef std::map<std::pair<dev::h256, dev::Address>, std::vector<uint256>> TopicIndexes;
+
+/** Add the topics of a transaction's logs to the topic index entries of its block */
+static void AddTopicIndexes(TopicIndexes& topicIndexes, const dev::eth::LogEntries& logs, const uint256& hashTx)
+{
+    for (const dev::eth::LogEntry& log : logs) {
+        for (const dev::h256& topic : log.topics) {
+            std::vector<uint256>& hashes = topicIndexes[std::make_pair(topic, log.address)];
+            if (hashes.empty() || hashes.back() != hashTx) {
+                hashes.push_back(hashTx);
+            }
+        }
+    }
+}
+
+/** Erase the receipts of a block's transactions and the log indexes at its height, for a block that is disconnected or pruned */
+static void EraseBlockLogs(const CBlock& block, int nHeight)
+{
+    if (fLogTopicIndex) {
+        // The topics to erase are only known from the receipts, read them before they are deleted
+        TopicIndexes topicIndexes;
+        for (const CTransactionRef& tx : block.vtx) {
+            for (const TransactionReceiptInfo& receipt : pstorageresult->getResult(uintToh256(tx->GetHash()))) {
+                AddTopicIndexes(topicIndexes, receipt.logs, tx->GetHash());
+            }
+        }
+        std::vector<CTopicTxIndexKey> topicKeys;
+        for (const auto& e : topicIndexes) {
+            topicKeys.push_back(CTopicTxIndexKey(e.first.first, nHeight, e.first.second));
+        }
+        pblocktree->EraseTopicIndex(topicKeys);
+    }
+    pstorageresult->deleteResults(block.vtx);
+    pblocktree->EraseHeightIndex(nHeight);
+    pblocktree->EraseLogsBloomIndex(nHeight);
+}
+
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  When FAILED is returned, view is left in an indeterminate state. */
+/**
+ * Writes the unspent index changes of a connected (or disconnected) block and applies its address history to the
+ * address totals. The totals record the block they are at, so a block replayed after an unclean shutdown is not
+ * counted twice. Totals that do not follow the chain are dropped and rebuilt at the next start.
+ */
+static bool UpdateAddressUnspentAndBalances(const CBlockIndex* pindex, bool fDisconnect,
+                                            const std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex,
+                                            const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& addressUnspentIndex)
+{
+    AssertLockHeld(cs_main);
+
+    if (!fAddressBalanceIndex)
+        return pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex);
+
+    uint256 hashBest;
+    pblocktree->ReadAddressBalanceBest(hashBest);
+    const CBlockIndex* pindexBest = hashBest.IsNull() ? nullptr : LookupBlockIndex(hashBest);
+
+    bool fApply, fApplied;
+    if (!fDisconnect) {
+        fApply = pindexBest == pindex->pprev;
+        fApplied = pindexBest && pindexBest->GetAncestor(pindex->nHeight) == pindex;
+    } else {
+        fApply = pindexBest == pindex;
+        fApplied = pindexBest && pindexBest->nHeight < pindex->nHeight && pindex->GetAncestor(pindexBest->nHeight) == pindexBest;
+    }
+    if (!fApply) {
+        if (!fApplied) {
+            LogPrintf("%s: address totals are not at an ancestor of block %s, they will be rebuilt at the next start\n", __func__, pindex->GetBlockHash().ToString());
+            fAddressBalanceIndex = false;
+            pblocktree->WriteFlag("addressbalanceindex", false);
+        }
+        return pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex);
+    }
+
+    std::map<std::pair<unsigned int, uint256>, CAddressBalanceValue> deltas;
+    for (const auto& entry : addressIndex) {
+        CAddressBalanceValue& delta = deltas[std::make_pair(entry.first.type, entry.first.hashBytes)];
+        delta.balance += entry.second;
+        if (entry.second > 0)
+            delta.received += entry.second;
+        delta.utxos += entry.first.spending ? -1 : 1;
+    }
+
+    std::vector<std::pair<CAddressIndexIteratorKey, CAddressBalanceValue>> balances;
+    balances.reserve(deltas.size());
+    for (const auto& delta : deltas) {
+        CAddressBalanceValue totals;
+        pblocktree->ReadAddressBalance(delta.first.second, delta.first.first, totals);
+        const int sign = fDisconnect ? -1 : 1;
+        totals.balance += sign * delta.second.balance;
+        totals.received += sign * delta.second.received;
+        totals.utxos += sign * delta.second.utxos;
+        totals.lastHeight = fDisconnect ? pindex->nHeight - 1 : pindex->nHeight;
+        balances.push_back(std::make_pair(CAddressIndexIteratorKey(delta.first.first, delta.first.second), totals));
+    }
+
+    const uint256 hashNewBest = fDisconnect ? pindex->pprev->GetBlockHash() : pindex->GetBlockHash();
+    return pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex, balances, hashNewBest);
+}
+
 DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
 {
     assert(pindex->GetBlockHash() == view.GetBestBlock());
@@ -1952,8 +2475,12 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         *pfClean = false;
     bool fClean = true;
 
+    // The undo data of the last connected blocks is still in memory
     CBlockUndo blockUndo;
-    if (!UndoReadFromDisk(blockUndo, pindex)) {
+    auto itConnected = FindRecentConnectedBlock(pindex);
+    if (itConnected != listRecentConnectedBlocks.end()) {
+        blockUndo = itConnected->blockundo;
+    } else if (!UndoReadFromDisk(blockUndo, pindex)) {
         error("DisconnectBlock(): failure reading undo data");
         return DISCONNECT_FAILED;
     }
@@ -1967,6 +2494,8 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> addressUnspentIndex;
     ///////////////////////////////////////////////////////////
+    bool fHashCoins = pfClean == NULL && fUTXOSetHash;
+    MuHash3072 utxoHashDelta;
 
     // undo transactions in reverse order
     for (int i = block.vtx.size() - 1; i >= 0; i--) {
@@ -1985,6 +2514,9 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
                 if (!is_spent || tx.vout[o] != coin.out || pindex->nHeight != coin.nHeight || is_coinbase != coin.fCoinBase || is_coinstake != coin.fCoinStake) {
                     fClean = false; // transaction output mismatch
                 }
+                if (is_spent && fHashCoins) {
+                    HashUTXOSetCoin(utxoHashDelta, out, coin, false);
+                }
             }
         }
 
@@ -2022,6 +2554,9 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
                 int res = ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out);
                 if (res == DISCONNECT_FAILED) return DISCONNECT_FAILED;
                 fClean = fClean && res != DISCONNECT_UNCLEAN;
+                if (fHashCoins) {
+                    HashUTXOSetCoin(utxoHashDelta, out, view.AccessCoin(out), true);
+                }
 
                 if (pfClean == NULL && fAddressIndex) {
                     const auto& undo = txundo.vprevout[j];
@@ -2055,8 +2590,12 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
     globalState->setRootUTXO(uintToh256(pindex->pprev->hashUTXORoot)); // qtum
 
     if (pfClean == NULL && fLogEvents) {
-        pstorageresult->deleteResults(block.vtx);
-        pblocktree->EraseHeightIndex(pindex->nHeight);
+        EraseBlockLogs(block, pindex->nHeight);
+        DelegationIndex().DisconnectBlock(pindex->GetBlockHash(), pindex->pprev->GetBlockHash());
+    }
+
+    if (pfClean == NULL) {
+        pblocktree->EraseContractIndex(pindex->nHeight);
     }
 
     // The stake and delegate index is needed for MPoS, update it while MPoS is active
@@ -2065,21 +2604,32 @@ DisconnectResult CChainState::DisconnectBlock(const CBlock& block, const CBlockI
         pblocktree->EraseStakeIndex(pindex->nHeight);
         if (pindex->IsProofOfStake() && pindex->HasProofOfDelegation())
             pblocktree->EraseDelegateIndex(pindex->nHeight);
+        DisconnectMPoSScript(pindex, chainparams.GetConsensus());
     }
 
     //////////////////////////////////////////////////// // qtum
     if (pfClean == NULL && fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
+        // Entries queued by ConnectBlock must land before they are erased
+        if (!pblocktree->FlushIndexBatch()) {
+            error("Failed to write address index");
+            return DISCONNECT_FAILED;
+        }
+        // The background address index rewinds its own entries
+        if (!g_addressindex && !pblocktree->EraseAddressIndex(addressIndex)) {
             error("Failed to delete address index");
             return DISCONNECT_FAILED;
         }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
+        if (!UpdateAddressUnspentAndBalances(pindex, true, addressIndex, addressUnspentIndex)) {
             error("Failed to write address unspent index");
             return DISCONNECT_FAILED;
         }
     }
     ////////////////////////////////////////////////////
 
+    if (fHashCoins) {
+        m_utxo_hash_delta = utxoHashDelta;
+    }
+
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
@@ -2106,6 +2656,11 @@ void static FlushBlockFile(bool fFinalize = false)
         fclose(fileOld);
     }
 
+    if (fFinalize) {
+        // Mappings past the truncated end would fault when touched
+        g_block_file_reader.Invalidate(nLastBlockFile);
+    }
+
     if (!status) {
         AbortNode("Flushing block file to disk failed. This is likely the result of an I/O error.");
     }
@@ -2118,14 +2673,26 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
         CDiskBlockPos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, CLIENT_VERSION) + 40))
+        std::vector<unsigned char> record;
+        bool fCompressed = fCompressUndo && CompressUndo(blockundo, record);
+        size_t nRecordSize = fCompressed ? record.size() : ::GetSerializeSize(blockundo, CLIENT_VERSION);
+        if (!FindUndoPos(state, pindex->nFile, _pos, nRecordSize + 40))
             return error("ConnectBlock(): FindUndoPos failed");
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+        if (fCompressed) {
+            if (!UndoWriteCompressedToDisk(blockundo, record, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+                return AbortNode(state, "Failed to write undo data");
+        } else if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart())) {
             return AbortNode(state, "Failed to write undo data");
+        }
 
         // update nUndoPos in block index
         pindex->nUndoPos = _pos.nPos;
         pindex->nStatus |= BLOCK_HAVE_UNDO;
+        if (fCompressed) {
+            pindex->nStatus |= BLOCK_UNDO_COMPRESSED;
+        } else {
+            pindex->nStatus &= ~BLOCK_UNDO_COMPRESSED;
+        }
         setDirtyBlockIndex.insert(pindex);
     }
 
@@ -2259,10 +2826,83 @@ static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
 static int64_t nTimeConnect = 0;
+static int64_t nTimeInputs = 0;
+static int64_t nTimeScriptWait = 0;
 static int64_t nTimeIndex = 0;
+static int64_t nTimeReceiptsCommit = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
+static ConnectBlockStats connectBlockStats GUARDED_BY(cs_main);
+
+/** Contract executions of a transaction, see BlockExecutionRecord */
+struct TxExecutionRecord {
+    std::vector<ResultExecute> resultExec;
+    ByteCodeExecResult bcer;
+    std::map<dev::Address, CAmount> dividendByContract;
+};
+
+/**
+ * Contract executions of the last block checked with fJustCheck, the block template checked by
+ * TestBlockValidity. When the same block is then connected on the same state, ConnectBlock takes
+ * the results from here instead of executing the contracts again, and moves the state to the roots
+ * the executions ended at. Every other check of the block runs as usual, including the comparison
+ * of the expected transactions and roots with the block.
+ */
+struct BlockExecutionRecord {
+    uint256 hashKey;
+    //! Roots the executions started from
+    dev::h256 oldHashStateRoot;
+    dev::h256 oldHashUTXORoot;
+    //! Executions of the contract transactions in block order
+    std::vector<TxExecutionRecord> txs;
+    //! Roots after the last contract transaction
+    dev::h256 hashStateRoot;
+    dev::h256 hashUTXORoot;
+};
+static std::unique_ptr<BlockExecutionRecord> g_block_execution_record GUARDED_BY(cs_main);
+
+//! Whether the state databases have the roots of the block, an empty trie has no node to look up
+static bool HaveStateRoots(const CBlockIndex* pindex)
+{
+    dev::h256 hashStateRoot = uintToh256(pindex->hashStateRoot);
+    dev::h256 hashUTXORoot = uintToh256(pindex->hashUTXORoot);
+    return (!hashStateRoot || hashStateRoot == dev::EmptyTrie || globalState->db().exists(hashStateRoot)) &&
+           (!hashUTXORoot || hashUTXORoot == dev::EmptyTrie || globalState->dbUtxo().exists(hashUTXORoot));
+}
+
+/** Everything the contract executions read from a block: the header fields of the EVM environment, the coinbase
+ *  outputs and the transactions. The coinbase input is left out, so a template mined with a new extra nonce keeps it */
+static uint256 BlockExecutionKey(const CBlock& block)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << block.hashPrevBlock << block.nTime << block.nBits << block.vtx[0]->vout;
+    for (size_t i = 1; i < block.vtx.size(); i++)
+        ss << block.vtx[i]->GetHash();
+    return ss.GetHash();
+}
+
+static void AddPhaseTime(ConnectBlockPhase& phase, int64_t nTimePhaseStart)
+{
+    phase.nTime += GetTimeMicros() - nTimePhaseStart;
+    phase.nCount++;
+}
+
+//! Add the time a phase took in the block to its total and log both
+static void LogPhaseTime(const char* strPhase, const ConnectBlockPhase& blockPhase, ConnectBlockPhase& totalPhase) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    totalPhase.nTime += blockPhase.nTime;
+    totalPhase.nCount += blockPhase.nCount;
+    LogPrint(BCLog::BENCH, "%s: %.2fms [%.2fs (%.2fms/blk)]\n", strPhase, MILLI * blockPhase.nTime, totalPhase.nTime * MICRO, totalPhase.nTime * MILLI / nBlocksTotal);
+}
+
+ConnectBlockStats GetConnectBlockStats()
+{
+    LOCK(cs_main);
+    ConnectBlockStats stats = connectBlockStats;
+    stats.nBlocks = nBlocksTotal;
+    return stats;
+}
 
 /////////////////////////////////////////////////////////////////////// qtum
 bool GetSpentCoinFromBlock(const CBlockIndex* pindex, COutPoint prevout, Coin* coin)
@@ -2409,20 +3049,40 @@ bool CheckSenderScript(const CCoinsViewCache& view, const CTransaction& tx)
     return true;
 }
 
+namespace {
+/** Coinbase/coinstake skeleton of the active tip, the block context of read-only contract calls */
+struct TipCallBlock {
+    uint256 hash;
+    CBlock block;
+};
+TipCallBlock tipCallBlock GUARDED_BY(cs_main);
+}
+
+static CBlock GetTipCallBlock(const CBlockIndex* pblockindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (tipCallBlock.hash != pblockindex->GetBlockHash()) {
+        CBlock block;
+        ReadBlockFromDisk(block, pblockindex, Params().GetConsensus());
+        if (block.IsProofOfStake())
+            block.vtx.erase(block.vtx.begin() + 2, block.vtx.end());
+        else
+            block.vtx.erase(block.vtx.begin() + 1, block.vtx.end());
+
+        tipCallBlock.block = block;
+        tipCallBlock.hash = pblockindex->GetBlockHash();
+    }
+    return tipCallBlock.block;
+}
+
 std::vector<ResultExecute> CallContract(const dev::Address& addrContract, std::vector<unsigned char> opcode, const dev::Address& sender, uint64_t gasLimit, uint64_t blockGasLimit, CAmount nAmount)
 {
-    CBlock block;
+    LOCK(cs_main);
     CMutableTransaction tx;
 
-    CBlockIndex* pblockindex = mapBlockIndex[chainActive.Tip()->GetBlockHash()];
-    ReadBlockFromDisk(block, pblockindex, Params().GetConsensus());
+    CBlockIndex* pblockindex = chainActive.Tip();
+    CBlock block = GetTipCallBlock(pblockindex);
     block.nTime = GetAdjustedTime();
 
-    if (block.IsProofOfStake())
-        block.vtx.erase(block.vtx.begin() + 2, block.vtx.end());
-    else
-        block.vtx.erase(block.vtx.begin() + 1, block.vtx.end());
-
     if (blockGasLimit == 0) {
         QtumDGP qtumDGP(globalState.get(), fGettingValuesDGP);
         blockGasLimit = qtumDGP.getBlockGasLimit(chainActive.Tip()->nHeight + 1);
@@ -2451,6 +3111,107 @@ std::vector<ResultExecute> CallContract(const dev::Address& addrContract, std::v
     return exec.getResult();
 }
 
+void TakeContractCallSnapshot(ContractCallSnapshot& snapshot, uint64_t blockGasLimit)
+{
+    {
+        LOCK(cs_main);
+        snapshot.pindex = chainActive.Tip();
+        snapshot.block = GetTipCallBlock(snapshot.pindex);
+
+        const Consensus::Params& consensusParams = Params().GetConsensus();
+        int nHeight = snapshot.pindex->nHeight;
+        QtumDGP qtumDGP(globalState.get(), fGettingValuesDGP);
+        snapshot.schedule = qtumDGP.getGasSchedule(nHeight + (nHeight + 1 >= consensusParams.QIP7Height ? 0 : 1), consensusParams, Params().NetworkIDString());
+        snapshot.blockGasLimit = blockGasLimit != 0 ? blockGasLimit : qtumDGP.getBlockGasLimit(nHeight + 1);
+
+        snapshot.state.reset(new QtumState(*globalState));
+    }
+    snapshot.block.nTime = GetAdjustedTime();
+}
+
+std::unique_ptr<QtumState> TakeStateSnapshot(const CBlockIndex* pindex)
+{
+    std::unique_ptr<QtumState> state;
+    {
+        LOCK(cs_main);
+        state = MakeUnique<QtumState>(*globalState);
+    }
+    if (pindex)
+        state->restoreRoots(uintToh256(pindex->hashStateRoot), uintToh256(pindex->hashUTXORoot));
+    return state;
+}
+
+std::vector<ResultExecute> CallContractOnSnapshot(const ContractCallSnapshot& snapshot, const dev::Address& addrContract, std::vector<unsigned char> opcode, const dev::Address& sender, uint64_t gasLimit, CAmount nAmount)
+{
+    static thread_local std::unique_ptr<dev::eth::SealEngineFace> sealEngine;
+    if (!sealEngine) {
+        dev::eth::ChainParams cp((Params().EVMGenesisInfo(dev::eth::Network::qtumMainNetwork)));
+        sealEngine = std::unique_ptr<dev::eth::SealEngineFace>(cp.createSealEngine());
+    }
+    sealEngine->setQtumSchedule(snapshot.schedule);
+
+    dev::Address senderAddress = sender == dev::Address() ? dev::Address("ffffffffffffffffffffffffffffffffffffffff") : sender;
+    QtumState state(*snapshot.state);
+    dev::u256 nonce = state.getNonce(senderAddress);
+
+    if (gasLimit == 0) {
+        gasLimit = snapshot.blockGasLimit - 1;
+    }
+
+    CBlock block = snapshot.block;
+    CMutableTransaction tx;
+    tx.vout.push_back(CTxOut(nAmount, CScript() << OP_DUP << OP_HASH160 << senderAddress.asBytes() << OP_EQUALVERIFY << OP_CHECKSIG));
+    block.vtx.push_back(MakeTransactionRef(CTransaction(tx)));
+
+    QtumTransaction callTransaction;
+    if (addrContract == dev::Address()) {
+        callTransaction = QtumTransaction(nAmount, 1, dev::u256(gasLimit), opcode, nonce);
+    } else {
+        callTransaction = QtumTransaction(nAmount, 1, dev::u256(gasLimit), addrContract, opcode, nonce);
+    }
+    callTransaction.forceSender(senderAddress);
+    callTransaction.setVersion(VersionVM::GetEVMDefault());
+
+    // The snapshot is of the tip, the height chainActive had when it was taken
+    QtumExecutionContext context(snapshot.pindex->nHeight);
+    ByteCodeExec exec(block, std::vector<QtumTransaction>(1, callTransaction), snapshot.blockGasLimit, snapshot.pindex, &state, sealEngine.get(), &context);
+    exec.performByteCode(dev::eth::Permanence::Reverted);
+    return exec.getResult();
+}
+
+std::vector<ResultExecute> CallContractOnSnapshot(const dev::Address& addrContract, std::vector<unsigned char> opcode, const dev::Address& sender, uint64_t gasLimit, uint64_t blockGasLimit, CAmount nAmount)
+{
+    ContractCallSnapshot snapshot;
+    TakeContractCallSnapshot(snapshot, blockGasLimit);
+    return CallContractOnSnapshot(snapshot, addrContract, std::move(opcode), sender, gasLimit, nAmount);
+}
+
+static CBlockDGPParams cachedDGPParams GUARDED_BY(cs_main);
+
+const CBlockDGPParams& GetBlockDGPParams(const CBlockIndex* pindexPrev, int nHeight)
+{
+    AssertLockHeld(cs_main);
+
+    if(cachedDGPParams.hashTip != pindexPrev->GetBlockHash())
+    {
+        CBlockDGPParams params;
+        QtumDGP qtumDGP(globalState.get(), fGettingValuesDGP);
+        params.blockSize = qtumDGP.getBlockSize(nHeight);
+        params.blockGasLimit = qtumDGP.getBlockGasLimit(nHeight);
+
+        Dgp dgp;
+        dgp.hasVoteInProgress(params.voteInProgress);
+        if(params.voteInProgress) {
+            dgp.getVoteBlockExpiration(params.voteExpiration);
+        }
+
+        params.hashTip = pindexPrev->GetBlockHash();
+        cachedDGPParams = params;
+    }
+
+    return cachedDGPParams;
+}
+
 bool CheckMinGasPrice(std::vector<EthTransactionParams>& etps, const uint64_t& minGasPrice)
 {
     for (EthTransactionParams& etp : etps) {
@@ -2611,117 +3372,104 @@ valtype GetSenderAddress(const CTransaction& tx, const CCoinsViewCache* coinsVie
     return valtype();
 }
 
-UniValue vmLogToJSON(const ResultExecute& execRes, const CTransaction& tx, const CBlock& block)
+void writeVMlog(const std::vector<ResultExecute>& res, const CTransaction& tx, const CBlock& block)
 {
-    UniValue result(UniValue::VOBJ);
+    if (!g_vmlog_writer)
+        return;
+
+    VMLogRecord context;
     if (tx != CTransaction())
-        result.pushKV("txid", tx.GetHash().GetHex());
-    result.pushKV("address", execRes.execRes.newAddress.hex());
+        context.txid = tx.GetHash();
     if (block.GetHash() != CBlock().GetHash()) {
-        result.pushKV("time", block.GetBlockTime());
-        result.pushKV("blockhash", block.GetHash().GetHex());
-        result.pushKV("blockheight", chainActive.Tip()->nHeight + 1);
-    } else {
-        result.pushKV("time", GetAdjustedTime());
-        result.pushKV("blockheight", chainActive.Tip()->nHeight);
-    }
-    UniValue logEntries(UniValue::VARR);
-    dev::eth::LogEntries logs = execRes.txRec.log();
-    for (dev::eth::LogEntry log : logs) {
-        UniValue logEntrie(UniValue::VOBJ);
-        logEntrie.pushKV("address", log.address.hex());
-        UniValue topics(UniValue::VARR);
-        for (dev::h256 l : log.topics) {
-            UniValue topicPair(UniValue::VOBJ);
-            topicPair.pushKV("raw", l.hex());
-            topics.push_back(topicPair);
-            // TODO add "pretty" field for human readable data
-        }
-        UniValue dataPair(UniValue::VOBJ);
-        dataPair.pushKV("raw", HexStr(log.data));
-        logEntrie.pushKV("data", dataPair);
-        logEntrie.pushKV("topics", topics);
-        logEntries.push_back(logEntrie);
-    }
-    result.pushKV("entries", logEntries);
-    return result;
-}
-
-void writeVMlog(const std::vector<ResultExecute>& res, const CTransaction& tx, const CBlock& block)
-{
-    boost::filesystem::path qtumDir = GetDataDir() / "vmExecLogs.json";
-    std::stringstream ss;
-    if (fIsVMlogFile) {
-        ss << ",";
+        context.blockhash = block.GetHash();
+        context.time = block.GetBlockTime();
+        context.height = chainActive.Tip()->nHeight + 1;
     } else {
-        std::ofstream file(qtumDir.string(), std::ios::out | std::ios::app);
-        file << "{\"logs\":[]}";
-        file.close();
+        context.time = GetAdjustedTime();
+        context.height = chainActive.Tip()->nHeight;
     }
 
+    // The JSON is built by the writer thread, only the logs are copied here
+    std::vector<VMLogRecord> records(res.size(), context);
     for (size_t i = 0; i < res.size(); i++) {
-        ss << vmLogToJSON(res[i], tx, block).write();
-        if (i != res.size() - 1) {
-            ss << ",";
-        } else {
-            ss << "]}";
-        }
+        records[i].address = res[i].execRes.newAddress;
+        records[i].logs = res[i].txRec.log();
     }
-
-    std::ofstream file(qtumDir.string(), std::ios::in | std::ios::out);
-    file.seekp(-2, std::ios::end);
-    file << ss.str();
-    file.close();
-    fIsVMlogFile = true;
+    g_vmlog_writer->Push(std::move(records));
 }
 
 LastHashes::LastHashes()
 {
 }
 
+namespace {
+// Last hashes of the most recently used tip, shared by every ByteCodeExec built on it
+Mutex cs_lastHashesCache;
+uint256 lastHashesCacheTip GUARDED_BY(cs_lastHashesCache);
+std::shared_ptr<const dev::h256s> lastHashesCache GUARDED_BY(cs_lastHashesCache);
+}
+
 void LastHashes::set(const CBlockIndex* tip)
 {
     clear();
+    if (!tip)
+        return;
 
-    m_lastHashes.resize(256);
-    for (int i = 0; i < 256; i++) {
-        if (!tip)
-            break;
-        m_lastHashes[i] = uintToh256(*tip->phashBlock);
-        tip = tip->pprev;
+    LOCK(cs_lastHashesCache);
+    if (!lastHashesCache || lastHashesCacheTip != tip->GetBlockHash()) {
+        std::shared_ptr<dev::h256s> hashes = std::make_shared<dev::h256s>(256);
+        const CBlockIndex* pindex = tip;
+        for (int i = 0; i < 256 && pindex; i++) {
+            (*hashes)[i] = uintToh256(*pindex->phashBlock);
+            pindex = pindex->pprev;
+        }
+        lastHashesCache = hashes;
+        lastHashesCacheTip = tip->GetBlockHash();
     }
+    m_lastHashes = lastHashesCache;
 }
 
 dev::h256s LastHashes::precedingHashes(const dev::h256&) const
 {
-    return m_lastHashes;
+    return m_lastHashes ? *m_lastHashes : dev::h256s();
 }
 
 void LastHashes::clear()
 {
-    m_lastHashes.clear();
+    m_lastHashes.reset();
 }
 
-bool ByteCodeExec::performByteCode(dev::eth::Permanence type)
+bool ByteCodeExec::performByteCode(dev::eth::Permanence type, bool fCommitDB)
 {
+    // The environment only depends on the block and its parent, execute() takes it by const reference
+    dev::eth::EnvInfo envInfo(BuildEVMEnvironment());
     for (QtumTransaction& tx : txs) {
         // validate VM version
         if (tx.getVersion().toRaw() != VersionVM::GetEVMDefault().toRaw()) {
             return false;
         }
-        dev::eth::EnvInfo envInfo(BuildEVMEnvironment());
-        if (!tx.isCreation() && !globalState->addressInUse(tx.receiveAddress())) {
+        if (!tx.isCreation() && !state->addressInUse(tx.receiveAddress())) {
             dev::eth::ExecutionResult execRes;
             execRes.excepted = dev::eth::TransactionException::Unknown;
             result.push_back(ResultExecute{execRes, QtumTransactionReceipt(dev::h256(), dev::h256(), dev::u256(), dev::eth::LogEntries()),
                 CTransaction()});
             continue;
         }
-        result.push_back(globalState->execute(envInfo, *globalSealEngine.get(), tx, type, OnOpFunc()));
+        if (profiler) {
+            int64_t nTimeStart = GetTimeMicros();
+            result.push_back(state->execute(envInfo, *sealEngine, tx, context, type, profiler->StorageCounter()));
+            dev::Address address = tx.isCreation() ? result.back().execRes.newAddress : tx.receiveAddress();
+            profiler->AddExecution(address, uint64_t(result.back().execRes.gasUsed), GetTimeMicros() - nTimeStart);
+            continue;
+        }
+        result.push_back(state->execute(envInfo, *sealEngine, tx, context, type, OnOpFunc()));
     }
-    globalState->db().commit();
-    globalState->dbUtxo().commit();
-    globalSealEngine.get()->deleteAddresses.clear();
+    // Snapshots share the state database with globalState and never write back to it
+    if (fCommitDB && state == globalState.get()) {
+        state->db().commit();
+        state->dbUtxo().commit();
+    }
+    sealEngine->deleteAddresses.clear();
     return true;
 }
 
@@ -2741,7 +3489,7 @@ bool ByteCodeExec::processingResults(ByteCodeExecResult& resultBCE)
                 tx.vin.push_back(CTxIn(h256Touint(txs[i].getHashWith()), txs[i].getNVout(), CScript() << OP_SPEND));
                 CScript script(CScript() << OP_DUP << OP_HASH160 << txs[i].sender().asBytes() << OP_EQUALVERIFY << OP_CHECKSIG);
                 tx.vout.push_back(CTxOut(CAmount(txs[i].value()), script));
-                resultBCE.valueTransfers.push_back(CTransaction(tx));
+                resultBCE.valueTransfers.push_back(MakeTransactionRef(std::move(tx)));
             }
 
             if (!(chainActive.Height() >= consensusParams.QIP7Height && result[i].execRes.excepted == dev::eth::TransactionException::RevertInstruction)) {
@@ -2791,7 +3539,7 @@ bool ByteCodeExec::processingResults(ByteCodeExecResult& resultBCE)
         }
 
         if (result[i].tx != CTransaction()) {
-            resultBCE.valueTransfers.push_back(result[i].tx);
+            resultBCE.valueTransfers.push_back(MakeTransactionRef(result[i].tx));
         }
     }
 
@@ -2839,7 +3587,7 @@ dev::eth::EnvInfo ByteCodeExec::BuildEVMEnvironment()
     }
 
     dev::u256 gasUsed;
-    dev::eth::EnvInfo env(header, lastHashes, gasUsed, globalSealEngine->chainParams().chainID);
+    dev::eth::EnvInfo env(header, lastHashes, gasUsed, sealEngine->chainParams().chainID);
 
     return env;
 }
@@ -2868,14 +3616,35 @@ bool QtumTxConverter::extractionQtumTransactions(ExtractQtumTX& qtumtx)
     // Extract contract transactions
     std::vector<QtumTransaction> resultTX;
     std::vector<EthTransactionParams> resultETP;
+    if (contractOutputs && contractOutputs->nFlags == nFlags) {
+        // The scripts are already decoded, only the gas price depends on the chain
+        for (const CContractOutput& output : contractOutputs->outputs) {
+            EthTransactionParams params = output.params;
+            if (!setEthTXGasPrice(params)) {
+                return false;
+            }
+            opcode = params.type;
+            resultTX.push_back(createEthTX(params, output.nOut));
+            resultETP.push_back(std::move(params));
+        }
+        qtumtx = std::make_pair(resultTX, resultETP);
+        return true;
+    }
+
+    std::shared_ptr<CContractOutputs> outputs = std::make_shared<CContractOutputs>();
+    outputs->nFlags = nFlags;
     for (size_t i = 0; i < txBit.vout.size(); i++) {
         if (txBit.vout[i].scriptPubKey.HasOpCreate() || txBit.vout[i].scriptPubKey.HasOpCall() ||
             txBit.vout[i].scriptPubKey.HasOpCoinstakeCall()) {
             if (receiveStack(txBit.vout[i].scriptPubKey)) {
                 EthTransactionParams params;
                 if (parseEthTXParams(params)) {
+                    outputs->outputs.push_back({(uint32_t)i, params});
+                    if (!setEthTXGasPrice(params)) {
+                        return false;
+                    }
                     resultTX.push_back(createEthTX(params, i));
-                    resultETP.push_back(params);
+                    resultETP.push_back(std::move(params));
                 } else {
                     return false;
                 }
@@ -2884,22 +3653,72 @@ bool QtumTxConverter::extractionQtumTransactions(ExtractQtumTX& qtumtx)
             }
         }
     }
+    contractOutputs = outputs;
     qtumtx = std::make_pair(resultTX, resultETP);
     return true;
 }
 
+/**
+ * Push the items of a contract output script onto stack as spans into the script, without copying them.
+ * Only scripts EvalScript would run as plain data pushes up to the contract opcode are handled, with the
+ * same stack, returns false when the script has to be executed instead.
+ */
+static bool ParseContractScript(const CScript& script, unsigned int flags, std::vector<Span<const unsigned char>>& stack)
+{
+    if (script.size() > MAX_SCRIPT_SIZE || (flags & SCRIPT_VERIFY_MINIMALDATA))
+        return false;
+
+    size_t nSize = stack.size();
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    while (pc < script.end()) {
+        CScript::const_iterator pop = pc;
+        if (!script.GetOp(pc, opcode))
+            break;
+        const unsigned char* end = script.data() + (pc - script.begin());
+        if (opcode <= OP_PUSHDATA4) {
+            size_t header = opcode < OP_PUSHDATA1 ? 1 : opcode == OP_PUSHDATA1 ? 2 : opcode == OP_PUSHDATA2 ? 3 : 5;
+            size_t size = (pc - pop) - header;
+            if (size > MAX_SCRIPT_ELEMENT_SIZE || stack.size() + 1 > MAX_STACK_SIZE)
+                break;
+            stack.emplace_back(end - size, end);
+        } else if (opcode == OP_SENDER && (flags & SCRIPT_OUTPUT_SENDER)) {
+            continue;
+        } else if (opcode == OP_CREATE || opcode == OP_CALL || opcode == OP_COINSTAKE_CALL) {
+            // EvalScript pushes the rest of the script, from the contract opcode
+            stack.emplace_back(end - 1, script.data() + script.size());
+            return true;
+        } else {
+            break;
+        }
+    }
+    stack.resize(nSize);
+    return false;
+}
+
 bool QtumTxConverter::receiveStack(const CScript& scriptPubKey)
 {
     sender = false;
-    EvalScript(stack, scriptPubKey, nFlags, BaseSignatureChecker(), SigVersion::BASE, nullptr);
+    if (!ParseContractScript(scriptPubKey, nFlags, stack)) {
+        std::vector<valtype> evalStack;
+        for (const Span<const unsigned char>& item : stack) {
+            evalStack.emplace_back(item.begin(), item.end());
+        }
+        EvalScript(evalStack, scriptPubKey, nFlags, BaseSignatureChecker(), SigVersion::BASE, nullptr);
+        stack.clear();
+        for (valtype& item : evalStack) {
+            stackStorage.push_back(std::move(item));
+            stack.push_back(MakeSpan(stackStorage.back()));
+        }
+    }
     if (stack.empty())
         return false;
 
-    CScript scriptRest(stack.back().begin(), stack.back().end());
+    Span<const unsigned char> scriptRest = stack.back();
     stack.pop_back();
     sender = scriptPubKey.HasOpSender();
 
-    opcode = (opcodetype)(*scriptRest.begin());
+    opcode = scriptRest.size() > 0 ? (opcodetype)scriptRest[0] : OP_0;
     if ((opcode == OP_CREATE && stack.size() < correctedStackSize(3)) || (opcode == OP_CALL && stack.size() < correctedStackSize(4)) ||
         (opcode == OP_COINSTAKE_CALL && stack.size() < correctedStackSize(3))) {
         stack.clear();
@@ -2914,9 +3733,8 @@ bool QtumTxConverter::parseEthTXParams(EthTransactionParams& params)
 {
     try {
         dev::Address receiveAddress;
-        valtype vecAddr;
         if (opcode == OP_CALL || opcode == OP_COINSTAKE_CALL) {
-            vecAddr = stack.back();
+            valtype vecAddr(stack.back().begin(), stack.back().end());
             stack.pop_back();
             receiveAddress = dev::Address(vecAddr);
         }
@@ -2927,39 +3745,29 @@ bool QtumTxConverter::parseEthTXParams(EthTransactionParams& params)
         if (stack.back().size() < 1) {
             return false;
         }
-        valtype code(stack.back());
+        // The bytecode is copied once, from the script into the params
+        Span<const unsigned char> code = stack.back();
         stack.pop_back();
 
-        uint64_t gasPrice;
         uint64_t gasLimit;
         if (opcode == OP_COINSTAKE_CALL) {
-            gasPrice = 1;
             gasLimit = INT32_MAX;
         } else {
-            PriceOracle oracle;
-            uint64_t oracleGasPrice;
-            oracle.getPrice(oracleGasPrice);
-            gasPrice = oracleGasPrice;
-            gasLimit = CScriptNum::vch_to_uint64(stack.back());
+            gasLimit = CScriptNum::vch_to_uint64(valtype(stack.back().begin(), stack.back().end()));
             stack.pop_back();
-            if (gasPrice > INT64_MAX || gasLimit > INT64_MAX) {
+            if (gasLimit > INT64_MAX) {
                 return false;
             }
         }
-        // we track this as CAmount in some places, which is an int64_t, so constrain to INT64_MAX
-        if (gasPrice != 0 && gasLimit > INT64_MAX / gasPrice) {
-            // overflows past 64bits, reject this tx
-            return false;
-        }
         if (stack.back().size() > 4) {
             return false;
         }
-        VersionVM version = VersionVM::fromRaw((uint32_t)CScriptNum::vch_to_uint64(stack.back()));
+        VersionVM version = VersionVM::fromRaw((uint32_t)CScriptNum::vch_to_uint64(valtype(stack.back().begin(), stack.back().end())));
         stack.pop_back();
         params.version = version;
-        params.gasPrice = dev::u256(gasPrice);
+        params.gasPrice = dev::u256(0);
         params.receiveAddress = receiveAddress;
-        params.code = code;
+        params.code.assign(code.begin(), code.end());
         params.type = opcode;
         params.gasLimit = dev::u256(gasLimit);
         return true;
@@ -2969,6 +3777,28 @@ bool QtumTxConverter::parseEthTXParams(EthTransactionParams& params)
     }
 }
 
+bool QtumTxConverter::setEthTXGasPrice(EthTransactionParams& params)
+{
+    uint64_t gasPrice;
+    if (params.type == OP_COINSTAKE_CALL) {
+        gasPrice = 1;
+    } else {
+        if (!GetCachedOracleGasPrice(gasPrice)) {
+            return false;
+        }
+        if (gasPrice > INT64_MAX) {
+            return false;
+        }
+    }
+    // we track this as CAmount in some places, which is an int64_t, so constrain to INT64_MAX
+    if (gasPrice != 0 && params.gasLimit > dev::u256(INT64_MAX / gasPrice)) {
+        // overflows past 64bits, reject this tx
+        return false;
+    }
+    params.gasPrice = dev::u256(gasPrice);
+    return true;
+}
+
 QtumTransaction QtumTxConverter::createEthTX(const EthTransactionParams& etp, uint32_t nOut)
 {
     QtumTransaction txEth;
@@ -3067,22 +3897,68 @@ bool CheckDelegationOutput(const CBlock& block, bool& delegateOutputExist, CCoin
     return true;
 }
 
-bool CheckBlockLydraSpending(std::vector<CTransactionRef> vtx)
-{
-    std::map<CTxDestination, CAmount> addresses_balances;
+/** Address lists shorter than this have their balances read on the validation thread */
+static const size_t MIN_PARALLEL_ADDRESS_BALANCES = 16;
+
+/**
+ * Sum the unspent outputs of each address in the address unspent index, leaving out the
+ * coinstakes with fewer than coinbaseMaturity confirmations at nTipHeight. Long lists are
+ * read on as many threads as the script checks use. Returns false when the index of one of
+ * the addresses could not be read, its balance then holds the outputs read before that.
+ */
+static bool ReadAddressBalances(const std::vector<std::pair<uint256, int>>& addresses, int nTipHeight, int coinbaseMaturity, std::vector<CAmount>& balances)
+{
+    balances.assign(addresses.size(), 0);
+    std::vector<char> read(addresses.size(), true);
+    auto readBalances = [&addresses, &balances, &read, nTipHeight, coinbaseMaturity](size_t start, size_t step) {
+        for (size_t i = start; i < addresses.size(); i += step) {
+            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+            read[i] = GetAddressUnspent(addresses[i].first, addresses[i].second, unspentOutputs);
+            for (const auto& output : unspentOutputs) {
+                int nDepth = nTipHeight - output.second.blockHeight + 1;
+                if (output.second.coinStake && nDepth < coinbaseMaturity)
+                    continue;
+                balances[i] += output.second.satoshis;
+            }
+        }
+    };
+
+    if (nScriptCheckThreads <= 0 || addresses.size() < MIN_PARALLEL_ADDRESS_BALANCES) {
+        readBalances(0, 1);
+    } else {
+        std::vector<std::future<void>> workers;
+        for (int t = 0; t < nScriptCheckThreads; t++) {
+            workers.push_back(std::async(std::launch::async, readBalances, (size_t)t, (size_t)nScriptCheckThreads));
+        }
+        for (std::future<void>& worker : workers)
+            worker.wait();
+    }
+    return std::find(read.begin(), read.end(), false) == read.end();
+}
 
+bool CheckBlockLydraSpending(const std::vector<CTransactionRef>& vtx)
+{
+    // The amounts each transaction spends from and sends to its input addresses
+    struct TxLydraAmounts {
+        std::map<CTxDestination, CAmount> inputs;
+        std::map<CTxDestination, CAmount> outputs;
+        std::set<std::pair<uint256, int>> addresses_index;
+    };
+    std::vector<TxLydraAmounts> txs_amounts;
+    std::map<uint256, CTxDestination> addrhash_dest;
+    std::vector<std::pair<uint256, int>> block_addresses;
+    std::vector<CTxDestination> block_dests;
+    std::set<CTxDestination> seen_dests;
+
+    // Collect the addresses of the whole block first, so their balances and locked amounts are read in one batch
+    CCoinsViewCache view(pcoinsTip.get());
     for (unsigned int i = 0; i < vtx.size(); i++)
     {
         const CTransaction &tx = *(vtx[i]);
         if (tx.IsCoinBase() || tx.IsCoinStake()) continue;
-        std::map<CTxDestination, CAmount> addresses_inputs;
-        std::map<CTxDestination, CAmount> addresses_outputs;
-        std::set<std::pair<uint256, int>> addresses_index;
-        std::map<uint256, CTxDestination> addrhash_dest;
-		std::set<uint256> addresses_index_checked;
+        TxLydraAmounts amounts;
         for (const CTxIn& txin : tx.vin) {
             CTxDestination dest;
-            CCoinsViewCache view(pcoinsTip.get());
             const CTxOut& prevout = view.GetOutputFor(txin);
             if (ExtractDestination(txin.prevout, prevout.scriptPubKey, dest)) {
                 uint256 hashBytes;
@@ -3090,50 +3966,48 @@ bool CheckBlockLydraSpending(std::vector<CTransactionRef> vtx)
                 if (!DecodeIndexKey(EncodeDestination(dest), hashBytes, type)) {
                     return false;
                 }
-                addresses_index.insert(std::make_pair(hashBytes, type));
+                amounts.addresses_index.insert(std::make_pair(hashBytes, type));
                 addrhash_dest[hashBytes] = dest;
-                if (addresses_inputs.find(dest) != addresses_inputs.end())
-                    addresses_inputs[dest] += prevout.nValue;
-                else
-                    addresses_inputs[dest] = prevout.nValue;
-                if(!addresses_balances.count(dest)) {
-                    // Get address utxos
-                    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-                    if (!GetAddressUnspent(hashBytes, type, unspentOutputs)) {
-                        return false;
-                    }
-                    // Add the utxos to the list if they are mature and at least the minimum value
-                    int coinbaseMaturity = Params().GetConsensus().CoinbaseMaturity(chainActive.Height() + 1);
-                    CAmount rembalance = 0;
-                    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator i=unspentOutputs.begin(); i!=unspentOutputs.end(); i++) {
-                        int nDepth = chainActive.Height() - i->second.blockHeight + 1;
-                        if (i->second.coinStake && nDepth < coinbaseMaturity)
-                            continue;
-                        rembalance += i->second.satoshis;
-                    }
-                    addresses_balances.insert({dest, rembalance});
+                amounts.inputs[dest] += prevout.nValue;
+                if (seen_dests.insert(dest).second) {
+                    block_addresses.push_back(std::make_pair(hashBytes, type));
+                    block_dests.push_back(dest);
                 }
             }
         }
         for (size_t j = 0; j < tx.vout.size(); j++) {
             const CTxOut& out = tx.vout[j];
             CTxDestination dest;
-            if (ExtractDestination(out.scriptPubKey, dest)) {	
-                if (addresses_outputs.find(dest) != addresses_outputs.end())
-                    addresses_outputs[dest] += out.nValue;
-                else
-                    addresses_outputs[dest] = out.nValue;
-            }
-        }
-        for (const auto& addr_pair : addresses_index) {
-            // if(addresses_balances.count(addrhash_dest[addr_pair.first]) && 
-            //     addresses_inputs.count(addrhash_dest[addr_pair.first]) &&
-            //     addresses_outputs.count(addrhash_dest[addr_pair.first])) {
-            auto all_inputs = addresses_inputs[addrhash_dest[addr_pair.first]];
-            auto all_outputs = addresses_outputs[addrhash_dest[addr_pair.first]];
-            Lydra l;
-            uint64_t locked_hydra_amount;
-            l.getLockedHydraAmountPerAddress(boost::get<CKeyID>(&addrhash_dest[addr_pair.first])->GetReverseHex(), locked_hydra_amount);
+            if (ExtractDestination(out.scriptPubKey, dest)) {
+                amounts.outputs[dest] += out.nValue;
+            }
+        }
+        txs_amounts.push_back(std::move(amounts));
+    }
+    if (txs_amounts.empty())
+        return true;
+
+    // Get the mature balances of the addresses before the block
+    std::vector<CAmount> balances;
+    int coinbaseMaturity = Params().GetConsensus().CoinbaseMaturity(chainActive.Height() + 1);
+    if (!ReadAddressBalances(block_addresses, chainActive.Height(), coinbaseMaturity, balances)) {
+        return false;
+    }
+    std::map<CTxDestination, CAmount> addresses_balances;
+    for (size_t i = 0; i < block_dests.size(); i++) {
+        addresses_balances[block_dests[i]] = balances[i];
+    }
+
+    // The check runs before the contracts of the block, the locked amounts do not change during it
+    std::map<uint256, uint64_t> locked_amounts = GetLockedHydraAmounts(addrhash_dest);
+
+    for (TxLydraAmounts& amounts : txs_amounts)
+    {
+        std::set<uint256> addresses_index_checked;
+        for (const auto& addr_pair : amounts.addresses_index) {
+            auto all_inputs = amounts.inputs[addrhash_dest[addr_pair.first]];
+            auto all_outputs = amounts.outputs[addrhash_dest[addr_pair.first]];
+            uint64_t locked_hydra_amount = locked_amounts[addr_pair.first];
             if (!addresses_index_checked.count(addr_pair.first) && addresses_balances[addrhash_dest[addr_pair.first]] - all_inputs + all_outputs < locked_hydra_amount) {
                 return false;
             }
@@ -3142,7 +4016,6 @@ bool CheckBlockLydraSpending(std::vector<CTransactionRef> vtx)
                     addresses_balances[addrhash_dest[addr_pair.first]] - all_inputs + all_outputs;
                 addresses_index_checked.insert(addr_pair.first);
             }
-            // }
         }
     }
 
@@ -3160,6 +4033,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     int64_t nTimeStart = GetTimeMicros();
 
     ///////////////////////////////////////////////// // qtum
+    ConnectBlockStats blockStats;
+    if (g_contract_profiler && !fJustCheck)
+        g_contract_profiler->BeginBlock();
     QtumDGP qtumDGP(globalState.get(), fGettingValuesDGP);
     globalSealEngine->setQtumSchedule(qtumDGP.getGasSchedule(pindex->nHeight + (pindex->nHeight + 1 >= chainparams.GetConsensus().QIP7Height ? 0 : 1),
         chainparams.GetConsensus(), chainparams.NetworkIDString()));
@@ -3168,8 +4044,10 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     uint64_t blockGasLimit = qtumDGP.getBlockGasLimit(pindex->nHeight + (pindex->nHeight + 1 >= chainparams.GetConsensus().QIP7Height ? 0 : 1));
     dgpMaxBlockSize = sizeBlockDGP ? sizeBlockDGP : dgpMaxBlockSize;
     updateBlockSizeParams(dgpMaxBlockSize);
+    ConnectBlockScratch& scratch = m_connect_scratch;
+    scratch.Clear();
     CBlock checkBlock(block.GetBlockHeader());
-    std::vector<CTxOut> checkVouts;
+    std::vector<CTxOut>& checkVouts = scratch.checkVouts;
 
     Dgp dgp;
     uint64_t cached_coinBurnPercentage;
@@ -3177,6 +4055,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         cached_coinBurnPercentage = 0;
     else
         dgp.getDgpParam(BURN_RATE, cached_coinBurnPercentage);
+    AddPhaseTime(blockStats.proxyCalls, nTimeStart);
 
     uint64_t countCumulativeGasUsed = 0;
     /////////////////////////////////////////////////
@@ -3275,6 +4154,21 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         }
     }
 
+    // With -assumevalidstate, the proof-of-stake blocks of the assumed chain whose header roots are already in the
+    // state databases, such as a contract state copied from a trusted node, are connected without executing their
+    // contract transactions. The block hash commits to the roots, and the outputs of the executions are in the block,
+    // so only the checks that need the execution results are skipped: the expected transactions and the reward.
+    bool fTrustStateRoots = false;
+    if (!fJustCheck && !hashAssumeValidState.IsNull() && block.IsProofOfStake() &&
+        pindex->hashStateRoot != uint256() && pindex->hashUTXORoot != uint256()) {
+        BlockMap::const_iterator it = mapBlockIndex.find(hashAssumeValidState);
+        if (it != mapBlockIndex.end() && it->second->GetAncestor(pindex->nHeight) == pindex &&
+            pindexBestHeader->GetAncestor(pindex->nHeight) == pindex &&
+            pindexBestHeader->nChainWork >= nMinimumChainWork) {
+            fTrustStateRoots = HaveStateRoots(pindex);
+        }
+    }
+
     int64_t nTime1 = GetTimeMicros();
     nTimeCheck += nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime1 - nTimeStart),
@@ -3383,29 +4277,38 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     nTimeForks += nTime2 - nTime1;
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
-    CBlockUndo blockundo;
+    CBlockUndo& blockundo = scratch.blockundo;
+    std::map<uint256, CContractOutputsRef> mapContractOutputs;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+    // The script checks of the queue run on the script-checking threads while the contracts are executed here
+    unsigned int nBlockInputs = 0;
+    for (size_t i = 1; i < block.vtx.size(); i++)
+        nBlockInputs += block.vtx[i]->vin.size();
+    bool fScriptCheckQueue = fScriptChecks && nScriptCheckThreads && nBlockInputs >= MIN_SCRIPTCHECK_QUEUE_INPUTS;
+    CCheckQueueControl<CScriptCheck> control(fScriptCheckQueue ? &scriptcheckqueue : nullptr);
+    int64_t nTimeBlockInputs = 0;
 
-    std::vector<int> prevheights;
+    std::vector<int>& prevheights = scratch.prevheights;
     CAmount nFees = 0;
     CAmount nActualStakeReward = 0;
     CAmount nValueCoinPrev = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos>> vPos;
+    std::vector<std::pair<uint256, CDiskTxPos>>& vPos = scratch.vPos;
     vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
 
     ///////////////////////////////////////////////////////// // qtum
-    std::vector<std::pair<CAddressIndexKey, CAmount>> addressIndex;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> addressUnspentIndex;
-    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>> spentIndex;
+    std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex = scratch.addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& addressUnspentIndex = scratch.addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue>>& spentIndex = scratch.spentIndex;
     std::map<dev::Address, std::pair<CHeightTxIndexKey, std::vector<uint256>>> heightIndexes;
+    dev::eth::LogBloom logsBloom;
+    TopicIndexes topicIndexes;
     /////////////////////////////////////////////////////////
 
-    std::vector<PrecomputedTransactionData> txdata;
+    std::vector<PrecomputedTransactionData>& txdata = scratch.txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
     uint64_t blockGasUsed = 0;
     CAmount gasRefunds = 0;
@@ -3414,10 +4317,11 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     uint64_t nValueOut = 0;
     uint64_t nValueIn = 0;
 
-    std::vector<CTxOut> dividends;
+    std::vector<CTxOut>& dividends = scratch.dividends;
     std::map<dev::Address, CAmount> dividendsPerAddress;
-    std::vector<dev::Address> contractAddresses;
-    std::vector<dev::Address> contractOwners;
+    std::vector<dev::Address>& contractAddresses = scratch.contractAddresses;
+    std::map<uint160, CContractIndexValue> contractIndex;
+    std::vector<dev::Address>& contractOwners = scratch.contractOwners;
     int refundTransactionsCount = 0;
 
     if (block.IsProofOfStake()) {
@@ -3429,11 +4333,43 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     }
 
     if(pindex->nHeight >= chainparams.GetConsensus().nLydraOverspendingFixHeight) {
+        int64_t nTimeLydraStart = GetTimeMicros();
         if(!CheckBlockLydraSpending(block.vtx))
             return state.DoS(100, error("%s: LYDRA overspending detected", __func__), 
                             REJECT_INVALID, "bad-txns-lydra-overspending");
+        AddPhaseTime(blockStats.lydra, nTimeLydraStart);
+    }
+
+    // A block checked with fJustCheck records its contract executions, and connecting it replays them when
+    // the state did not move in between. Coinstake contract calls read the state between the executions,
+    // so blocks with them are executed every time.
+    std::unique_ptr<BlockExecutionRecord> record;
+    std::unique_ptr<BlockExecutionRecord> replay;
+    size_t nReplayedTxs = 0;
+    if (!fTrustStateRoots && !(block.IsProofOfStake() && block.vtx[1]->HasOpCoinstakeCall())) {
+        uint256 hashKey = BlockExecutionKey(block);
+        if (fJustCheck) {
+            record = MakeUnique<BlockExecutionRecord>();
+            record->hashKey = hashKey;
+            record->oldHashStateRoot = globalState->rootHash();
+            record->oldHashUTXORoot = globalState->rootHashUTXO();
+        } else {
+            std::unique_ptr<BlockExecutionRecord> checked = std::move(g_block_execution_record);
+            if (checked && checked->hashKey == hashKey && checked->oldHashStateRoot == globalState->rootHash() &&
+                checked->oldHashUTXORoot == globalState->rootHashUTXO()) {
+                replay = std::move(checked);
+            }
+        }
     }
 
+    // Only the UTXO root of the whole block is checked, the per transaction roots are only kept in the
+    // receipts. Without receipts to store, the UTXO trie is written once after the last execution.
+    // A recorded execution keeps the per transaction roots for the receipts of the replay.
+    DeferredUTXOCommit deferUTXO(*globalState, !(fLogEvents && (!fJustCheck || record)));
+
+    // Balances of the addresses the block spends from in the address index, for the LYDRA checks
+    std::map<std::pair<uint256, int>, CAmount> lydraBalances;
+
     for (unsigned int i = 0; i < block.vtx.size(); i++) {
         const CTransaction& tx = *(block.vtx[i]);
 
@@ -3506,29 +4442,27 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
                 if (pindex->nHeight >= chainparams.GetConsensus().nLydraHeight) {
                     if (!tx.IsCoinStake()) {
-                        for (const auto& addr_pair : addresses_index) {
-                            // Get address utxos
-                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-                            if (!GetAddressUnspent(addr_pair.first, addr_pair.second, unspentOutputs)) {
-                                //throw error("No information available for address");
-                            }
+                        int64_t nTimeLydraStart = GetTimeMicros();
+                        std::map<uint256, uint64_t> locked_amounts = GetLockedHydraAmounts(addrhash_dest);
 
-                            // Add the utxos to the list if they are mature and at least the minimum value
-                            int coinbaseMaturity = Params().GetConsensus().CoinbaseMaturity(chainActive.Height() + 1);
-                            CAmount rembalance = 0;
-                            for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator i=unspentOutputs.begin(); i!=unspentOutputs.end(); i++) {
-
-                                int nDepth = chainActive.Height() - i->second.blockHeight + 1;
-                                //if (nDepth < coinbaseMaturity)
-                                    //continue;
+                        // The address index is written after the block, so the balance of an address is read
+                        // once for the block. All the utxos count, failed reads are not an error.
+                        std::vector<std::pair<uint256, int>> unreadAddresses;
+                        for (const auto& addr_pair : addresses_index) {
+                            if (!lydraBalances.count(addr_pair))
+                                unreadAddresses.push_back(addr_pair);
+                        }
+                        std::vector<CAmount> balances;
+                        ReadAddressBalances(unreadAddresses, chainActive.Height(), 0, balances);
+                        for (size_t k = 0; k < unreadAddresses.size(); k++) {
+                            lydraBalances[unreadAddresses[k]] = balances[k];
+                        }
 
-                                rembalance += i->second.satoshis;
-                            }
+                        for (const auto& addr_pair : addresses_index) {
+                            CAmount rembalance = lydraBalances[addr_pair];
                             auto all_inputs = addresses_inputs[addrhash_dest[addr_pair.first]];
                             auto all_outputs = addresses_outputs[addrhash_dest[addr_pair.first]];
-                            Lydra l;
-                            uint64_t locked_hydra_amount;
-                            l.getLockedHydraAmountPerAddress(boost::get<CKeyID>(&addrhash_dest[addr_pair.first])->GetReverseHex(), locked_hydra_amount);
+                            uint64_t locked_hydra_amount = locked_amounts[addr_pair.first];
 
                             if (rembalance - all_inputs + all_outputs < locked_hydra_amount) {
                                 LogPrintf("Address -> %s | rembalance -> %d | spent -> %d | locked -> %d/n", 
@@ -3537,6 +4471,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                                 return error("%s: Spending more than available HYDRA amount. The rest is locked for LYDRA tokens.", __func__);
                             }
                         }
+                        AddPhaseTime(blockStats.lydra, nTimeLydraStart);
                     }
                 }
 
@@ -3580,13 +4515,18 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             if (tx.IsCoinStake())
                 nActualStakeReward = tx.GetValueOut() - view.GetValueIn(tx);
 
-            std::vector<CScriptCheck> vChecks;
+            // The checks handed to the queue leave empty ones behind
+            std::vector<CScriptCheck>& vChecks = scratch.vChecks;
+            vChecks.clear();
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
             // note that coinbase and coinstake can not contain any contract opcodes, this is checked in CheckBlock
+            // the scripts of contract txs are verified on this thread before their contracts are executed
+            int64_t nTimeInputsStart = GetTimeMicros();
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i],
-                    (hasOpSpend || tx.HasCreateOrCall()) ? nullptr : (nScriptCheckThreads ? &vChecks : nullptr))) // nScriptCheckThreads ? &vChecks : nullptr))
+                    (hasOpSpend || tx.HasCreateOrCall()) ? nullptr : (fScriptCheckQueue ? &vChecks : nullptr)))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
+            nTimeBlockInputs += GetTimeMicros() - nTimeInputsStart;
             control.Add(vChecks);
 
             for (const CTxIn& j : tx.vin) {
@@ -3632,17 +4572,27 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             continue;
         }
 
-        if (tx.HasCreateOrCall() && !hasOpSpend) {
+        if (tx.HasCreateOrCall() && !hasOpSpend && !fTrustStateRoots) {
             if (!CheckSenderScript(view, tx)) {
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-invalid-sender-script");
             }
 
-            QtumTxConverter convert(tx, &view, &block.vtx, contractflags);
+            int64_t nTimeExtractStart = GetTimeMicros();
+            // Reuse the contract outputs decoded when the tx entered the mempool
+            CContractOutputsRef contractOutputs;
+            {
+                LOCK(mempool.cs);
+                CTxMemPool::txiter it = mempool.mapTx.find(tx.GetHash());
+                if (it != mempool.mapTx.end())
+                    contractOutputs = it->GetContractOutputs();
+            }
+            QtumTxConverter convert(tx, &view, &block.vtx, contractflags, contractOutputs);
 
             ExtractQtumTX resultConvertQtumTX;
             if (!convert.extractionQtumTransactions(resultConvertQtumTX)) {
                 return state.DoS(100, error("ConnectBlock(): Contract transaction of the wrong format"), REJECT_INVALID, "bad-tx-bad-contract-format");
             }
+            mapContractOutputs[tx.GetHash()] = convert.GetContractOutputs();
 
             if (!CheckQtumTransaction(resultConvertQtumTX, state)) {
                 return state.Invalid(false, state.GetRejectCode(), state.GetRejectReason(),
@@ -3657,6 +4607,8 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
             dev::u256 gasAllTxs = dev::u256(0);
             ByteCodeExec exec(block, resultConvertQtumTX.first, blockGasLimit, pindex->pprev);
+            if (g_contract_profiler && !fJustCheck)
+                exec.profiler = g_contract_profiler.get();
             // validate VM version and other ETH params before execution
             // Reject anything unknown (could be changed later by DGP)
             // TODO evaluate if this should be relaxed for soft-fork purposes
@@ -3714,21 +4666,44 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                     return state.DoS(100, error("ConnectBlock(): Version 0 contract executions are not allowed unless created by the AAL "), REJECT_INVALID, "bad-tx-improper-version-0");
                 }
             }
+            AddPhaseTime(blockStats.extract, nTimeExtractStart);
 
-            if (!exec.performByteCode()) {
-                return state.DoS(100, error("ConnectBlock(): Unknown error during contract execution"), REJECT_INVALID, "bad-tx-unknown-error");
-            }
-
-            std::vector<ResultExecute> resultExec(exec.getResult());
+            std::vector<ResultExecute> resultExec;
             ByteCodeExecResult bcer;
-            if (!exec.processingResults(bcer)) {
-                return state.DoS(100, error("ConnectBlock(): Error processing VM execution results"), REJECT_INVALID, "bad-vm-exec-processing");
+            std::map<dev::Address, CAmount> dividendByContract;
+            if (replay) {
+                // Same block and state as the recorded executions, so the same transactions execute in the same order
+                assert(nReplayedTxs < replay->txs.size());
+                TxExecutionRecord& txExec = replay->txs[nReplayedTxs++];
+                resultExec = std::move(txExec.resultExec);
+                bcer = std::move(txExec.bcer);
+                dividendByContract = std::move(txExec.dividendByContract);
+            } else {
+                int64_t nTimeContractsStart = GetTimeMicros();
+                if (!exec.performByteCode(dev::eth::Permanence::Committed, false)) {
+                    return state.DoS(100, error("ConnectBlock(): Unknown error during contract execution"), REJECT_INVALID, "bad-tx-unknown-error");
+                }
+
+                resultExec = exec.getResult();
+                if (!exec.processingResults(bcer)) {
+                    return state.DoS(100, error("ConnectBlock(): Error processing VM execution results"), REJECT_INVALID, "bad-vm-exec-processing");
+                }
+                dividendByContract = exec.dividendByContract;
+                AddPhaseTime(blockStats.execute, nTimeContractsStart);
+                if (record)
+                    record->txs.push_back(TxExecutionRecord{resultExec, bcer, dividendByContract});
             }
+            int64_t nTimeReceiptsStart = GetTimeMicros();
 
             countCumulativeGasUsed += bcer.usedGas;
-            std::vector<TransactionReceiptInfo> tri;
+            std::vector<TransactionReceiptInfo>& tri = scratch.receipts;
+            tri.clear();
             if (fLogEvents && !fJustCheck) {
                 for (size_t k = 0; k < resultConvertQtumTX.first.size(); k++) {
+                    logsBloom |= resultExec[k].txRec.bloom();
+                    if (fLogTopicIndex) {
+                        AddTopicIndexes(topicIndexes, resultExec[k].txRec.log(), tx.GetHash());
+                    }
                     for (auto& log : resultExec[k].txRec.log()) {
                         if (!heightIndexes.count(log.address)) {
                             heightIndexes[log.address].first = CHeightTxIndexKey(pindex->nHeight, log.address);
@@ -3755,7 +4730,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
                 pstorageresult->addResult(uintToh256(tx.GetHash()), tri);
             }
+            AddPhaseTime(blockStats.receipts, nTimeReceiptsStart);
 
+            int64_t nTimeTransfersStart = GetTimeMicros();
             blockGasUsed += bcer.usedGas;
             if (blockGasUsed > blockGasLimit) {
                 return state.DoS(1000, error("ConnectBlock(): Block exceeds gas limit"), REJECT_INVALID, "bad-blk-gaslimit");
@@ -3768,12 +4745,23 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
             checkVouts.insert(checkVouts.end(), bcer.refundOutputs.begin(), bcer.refundOutputs.end());
 
+            for (size_t j = 0; j < bcer.contractAddresses.size() && j < bcer.contractOwners.size(); j++) {
+                contractIndex.emplace(h160Touint(bcer.contractAddresses[j]),
+                    CContractIndexValue(pindex->nHeight, tx.GetHash(), h160Touint(bcer.contractOwners[j])));
+            }
+            // Contracts created by other contracts are credited to the sender of the transaction
+            for (size_t k = 0; k < resultExec.size() && k < resultConvertQtumTX.first.size(); k++) {
+                for (const dev::Address& address : resultExec[k].createdContracts) {
+                    contractIndex.emplace(h160Touint(address),
+                        CContractIndexValue(pindex->nHeight, tx.GetHash(), h160Touint(resultConvertQtumTX.first[k].sender())));
+                }
+            }
             contractAddresses.insert(std::end(contractAddresses), std::begin(bcer.contractAddresses),
                 std::end(bcer.contractAddresses));
             contractOwners.insert(std::end(contractOwners), std::begin(bcer.contractOwners),
                 std::end(bcer.contractOwners));
 
-            for (const auto& pair : exec.dividendByContract) {
+            for (const auto& pair : dividendByContract) {
                 if (dividendsPerAddress.count(pair.first)) {
                     dividendsPerAddress[pair.first] += pair.second;
                 } else {
@@ -3781,9 +4769,12 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 }
             }
 
-            for (CTransaction& t : bcer.valueTransfers) {
-                checkBlock.vtx.push_back(MakeTransactionRef(std::move(t)));
+            for (const CTransactionRef& t : bcer.valueTransfers) {
+                // Keep the block's own copy of a matching transaction, see the merkle root of checkBlock below
+                size_t pos = checkBlock.vtx.size();
+                checkBlock.vtx.push_back(pos < block.vtx.size() && block.vtx[pos]->GetHash() == t->GetHash() ? block.vtx[pos] : t);
             }
+            AddPhaseTime(blockStats.valueTransfers, nTimeTransfersStart);
             if (fRecordLogOpcodes && !fJustCheck) {
                 writeVMlog(resultExec, tx, block);
             }
@@ -3825,10 +4816,27 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
     }
 
+    if (replay) {
+        assert(nReplayedTxs == replay->txs.size());
+        globalState->restoreRoots(replay->hashStateRoot, replay->hashUTXORoot);
+    } else if (record) {
+        globalState->commitUTXO();
+        record->hashStateRoot = globalState->rootHash();
+        record->hashUTXORoot = globalState->rootHashUTXO();
+    }
+
     if (block.IsProofOfStake()) {
         const CTransaction& tx = *(block.vtx[1]);
-        // Execute coinstake contract calls
-        if (tx.HasOpCoinstakeCall()) {
+        if (tx.HasOpCoinstakeCall() && fTrustStateRoots) {
+            // Only the state the calls leave is taken from the header, the coinstake still updates the coins
+            blockundo.vtxundo.insert(blockundo.vtxundo.begin(), CTxUndo());
+            UpdateCoins(tx, view, blockundo.vtxundo.front(), pindex->nHeight);
+
+            vPos.push_back(std::make_pair(tx.GetHash(), pos));
+            pos.nTxOffset += ::GetSerializeSize(tx, CLIENT_VERSION);
+        } else if (tx.HasOpCoinstakeCall()) {
+            // Execute coinstake contract calls
+            int64_t nTimeExtractStart = GetTimeMicros();
             QtumTxConverter convert(tx, &view, &block.vtx);
             ExtractQtumTX resultConvertQtumTX;
             if (!convert.extractionQtumTransactions(resultConvertQtumTX)) {
@@ -3842,6 +4850,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                         state.GetDebugMessage()));
             }
 
+            AddPhaseTime(blockStats.extract, nTimeExtractStart);
+
+            int64_t nTimeProxyStart = GetTimeMicros();
             std::vector<QtumTransaction> qtumTransactions = resultConvertQtumTX.first;
             if (!CheckDgp(qtumTransactions, state, pindex))
                 return error("%s: Consensus::CheckDgp: %s", __func__, FormatStateMessage(state));
@@ -3858,9 +4869,16 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                         __func__);
                 }
             }
+            AddPhaseTime(blockStats.proxyCalls, nTimeProxyStart);
 
+            // Contract state is not prefetched on a helper thread: OverlayDB lookups read the
+            // in-memory node map without a lock while this thread commits into it, and the
+            // account cache is dropped on every commit, so warming it here would not survive.
             ByteCodeExec exec(block, resultConvertQtumTX.first, INT64_MAX, pindex);
-            if (!exec.performByteCode()) {
+            if (g_contract_profiler && !fJustCheck)
+                exec.profiler = g_contract_profiler.get();
+            int64_t nTimeContractsStart = GetTimeMicros();
+            if (!exec.performByteCode(dev::eth::Permanence::Committed, false)) {
                 return state.DoS(100, error("ConnectBlock(): Unknown error during contract execution"), REJECT_INVALID,
                     "bad-tx-unknown-error");
             }
@@ -3871,11 +4889,17 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 return state.DoS(100, error("ConnectBlock(): Error processing VM execution results"), REJECT_INVALID,
                     "bad-vm-exec-processing");
             }
+            AddPhaseTime(blockStats.execute, nTimeContractsStart);
+            int64_t nTimeReceiptsStart = GetTimeMicros();
 
             std::vector<TransactionReceiptInfo> tri;
             if (fLogEvents && !fJustCheck) {
                 for (size_t k = 0; k < resultConvertQtumTX.first.size(); k++) {
                     dev::Address key = resultExec[k].execRes.newAddress;
+                    logsBloom |= resultExec[k].txRec.bloom();
+                    if (fLogTopicIndex) {
+                        AddTopicIndexes(topicIndexes, resultExec[k].txRec.log(), tx.GetHash());
+                    }
                     if (!heightIndexes.count(key)) {
                         heightIndexes[key].first = CHeightTxIndexKey(pindex->nHeight, resultExec[k].execRes.newAddress);
                     }
@@ -3892,6 +4916,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
 
                 pstorageresult->addResult(uintToh256(tx.GetHash()), tri);
             }
+            AddPhaseTime(blockStats.receipts, nTimeReceiptsStart);
 
             if (fRecordLogOpcodes && !fJustCheck) {
                 writeVMlog(resultExec, tx, block);
@@ -3916,13 +4941,21 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n",
         (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(),
         nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs - 1), nTimeConnect * 0.000001);
+    nTimeInputs += nTimeBlockInputs;
+    LogPrint(BCLog::BENCH, "        - Check inputs: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * nTimeBlockInputs, nTimeInputs * MICRO, nTimeInputs * MILLI / nBlocksTotal);
+    LogPhaseTime("        - LYDRA spending checks", blockStats.lydra, connectBlockStats.lydra);
+    LogPhaseTime("        - Extract contracts", blockStats.extract, connectBlockStats.extract);
+    LogPhaseTime("        - Execute contracts", blockStats.execute, connectBlockStats.execute);
+    LogPhaseTime("        - Contract receipts", blockStats.receipts, connectBlockStats.receipts);
+    LogPhaseTime("        - Value transfers and refunds", blockStats.valueTransfers, connectBlockStats.valueTransfers);
 
     if (nFees < gasRefunds) { // make sure it won't overflow
         return state.DoS(1000, error("ConnectBlock(): Less total fees than gas refund fees"), REJECT_INVALID,
             "bad-blk-fees-greater-gasrefund");
     }
 
-    if (block.IsProofOfStake()) {
+    if (block.IsProofOfStake() && !fTrustStateRoots) {
+        int64_t nTimeProxyStart = GetTimeMicros();
         Economy e;
         dev::Address contractOwner;
         // AddDividentsToCoinstakeTransaction
@@ -3957,33 +4990,68 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 checkVouts.push_back(CTxOut(0, scriptPubKey));
             }
         }
+        AddPhaseTime(blockStats.proxyCalls, nTimeProxyStart);
     }
+    LogPhaseTime("      - DGP and Economy calls", blockStats.proxyCalls, connectBlockStats.proxyCalls);
 
     CAmount burnedCoins = 0;
 
-    if (!CheckReward(block, state, pindex->nHeight, chainparams.GetConsensus(), nFees, gasRefunds,
+    int64_t nTimeRewardStart = GetTimeMicros();
+    if (fTrustStateRoots) {
+        // The gas refunds and dividends are not known without the executions. The block minted the subsidy less
+        // the burned fees, see CheckReward.
+        burnedCoins = GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus()) - (CAmount)(nValueOut - nValueIn);
+    } else if (!CheckReward(block, state, pindex->nHeight, chainparams.GetConsensus(), nFees, gasRefunds,
             contractOwnersDividents, nActualStakeReward, checkVouts, cached_coinBurnPercentage,
             nValueOut, nValueIn, burnedCoins, nValueCoinPrev, delegateOutputExist))
         return state.DoS(100, error("ConnectBlock(): Reward check failed"));
+    AddPhaseTime(blockStats.checkReward, nTimeRewardStart);
+    LogPhaseTime("      - Check reward", blockStats.checkReward, connectBlockStats.checkReward);
 
+    int64_t nTimeWaitStart = GetTimeMicros();
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
     int64_t nTime4 = GetTimeMicros();
+    nTimeScriptWait += nTime4 - nTimeWaitStart;
+    LogPrint(BCLog::BENCH, "      - Wait for script checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime4 - nTimeWaitStart), nTimeScriptWait * MICRO, nTimeScriptWait * MILLI / nBlocksTotal);
     nTimeVerify += nTime4 - nTime2;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs - 1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
 
     ///////////////////////////////////n/////////////////////////////// // qtum
     if (pindex->nHeight == chainparams.GetConsensus().nOfflineStakeHeight ||
         pindex->nHeight == chainparams.GetConsensus().nDelegationsGasFixHeight) {
+        uint160 delegationsAddress = chainparams.GetConsensus().GetDelegationsAddress(pindex->nHeight);
+        if (!globalState->addressInUse(uintToh160(delegationsAddress)))
+            contractIndex.emplace(delegationsAddress, CContractIndexValue(pindex->nHeight, uint256(), uint160()));
         globalState->deployDelegationsContract(pindex->nHeight);
     }
 
-    checkBlock.hashMerkleRoot = BlockMerkleRoot(checkBlock);
+    if (fTrustStateRoots) {
+        globalState->restoreRoots(uintToh256(block.hashStateRoot), uintToh256(block.hashUTXORoot));
+    }
+
+    // CheckBlock verified the merkle root of the block. When the expected transactions are all the block's
+    // own, the expected root is that root, and the tree only needs hashing again to report a mismatch.
+    if (checkBlock.vtx.size() == block.vtx.size() && std::equal(checkBlock.vtx.begin(), checkBlock.vtx.end(), block.vtx.begin())) {
+        checkBlock.hashMerkleRoot = block.hashMerkleRoot;
+    } else {
+        checkBlock.hashMerkleRoot = BlockMerkleRoot(checkBlock);
+    }
+    int64_t nTimeStateRootStart = GetTimeMicros();
+    globalState->commitUTXO();
     checkBlock.hashStateRoot = h256Touint(globalState->rootHash());
     checkBlock.hashUTXORoot = h256Touint(globalState->rootHashUTXO());
 
+    // The contract executions above left their trie nodes in the state overlays. Write them in one batch
+    // now that the final roots of the block are known; nodes of intermediate states that the later
+    // executions replaced are dropped by the overlay instead of being written.
+    globalState->db().commit();
+    globalState->dbUtxo().commit();
+    AddPhaseTime(blockStats.stateRoot, nTimeStateRootStart);
+    LogPhaseTime("    - State root commit", blockStats.stateRoot, connectBlockStats.stateRoot);
+
     // If this error happens, it probably means that something with AAL created transactions didn't match up to what is expected
-    if ((checkBlock.GetHash() != block.GetHash()) && !fJustCheck) {
+    if ((checkBlock.GetHash() != block.GetHash()) && !fJustCheck && !fTrustStateRoots) {
         LogPrintf("Actual block data does not match block expected by AAL\n");
         // Something went wrong with AAL, compare different elements and determine what the problem is
         if (checkBlock.hashMerkleRoot != block.hashMerkleRoot) {
@@ -4045,8 +5113,9 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             prevHashStateRoot = uintToh256(pindex->pprev->hashStateRoot);
             prevHashUTXORoot = uintToh256(pindex->pprev->hashUTXORoot);
         }
-        globalState->setRoot(prevHashStateRoot);
-        globalState->setRootUTXO(prevHashUTXORoot);
+        globalState->restoreRoots(prevHashStateRoot, prevHashUTXORoot);
+        if (record)
+            g_block_execution_record = std::move(record);
         return true;
     }
     //////////////////////////////////////////////////////////////////
@@ -4054,6 +5123,25 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     pindex->nMoneySupply = (pindex->pprev ? pindex->pprev->nMoneySupply : 0) + nValueOut - nValueIn;
     pindex->nBurnedCoins = (pindex->pprev ? pindex->pprev->nBurnedCoins : 0) + burnedCoins;
 
+    if (fUTXOSetHash) {
+        // The coins the block created and spent, ConnectTip applies them to the UTXO set hash
+        m_utxo_hash_delta = MuHash3072();
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            const CTransaction& tx = *block.vtx[i];
+            for (size_t o = 0; o < tx.vout.size(); o++) {
+                if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                    HashUTXOSetCoin(m_utxo_hash_delta, COutPoint(tx.GetHash(), o), Coin(tx.vout[o], pindex->nHeight, tx.IsCoinBase(), tx.IsCoinStake()), true);
+                }
+            }
+            if (i > 0 && i - 1 < blockundo.vtxundo.size()) {
+                const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+                for (size_t j = 0; j < tx.vin.size() && j < txundo.vprevout.size(); j++) {
+                    HashUTXOSetCoin(m_utxo_hash_delta, tx.vin[j].prevout, txundo.vprevout[j], false);
+                }
+            }
+        }
+    }
+
     if (!WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
         return false;
 
@@ -4062,11 +5150,40 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         setDirtyBlockIndex.insert(pindex);
     }
 
+    if (!contractIndex.empty()) {
+        // The code of a contract is only known once the block has executed
+        std::vector<std::pair<uint160, CContractIndexValue>> vContractIndex;
+        for (auto& e : contractIndex) {
+            e.second.codeHash = h256Touint(globalState->codeHash(uintToh160(e.first)));
+            vContractIndex.push_back(e);
+        }
+        if (!pblocktree->WriteContractIndex(vContractIndex))
+            return AbortNode(state, "Failed to write contract index");
+    }
+
     if (fLogEvents) {
         for (const auto& e : heightIndexes) {
             if (!pblocktree->WriteHeightIndex(e.second.first, e.second.second))
                 return AbortNode(state, "Failed to write height index");
         }
+        if (!pblocktree->WriteLogsBloomIndex(pindex->nHeight, logsBloom))
+            return AbortNode(state, "Failed to write logs bloom index");
+        if (fLogTopicIndex) {
+            std::vector<std::pair<CTopicTxIndexKey, std::vector<uint256>>> topicIndex;
+            for (const auto& e : topicIndexes) {
+                topicIndex.push_back(std::make_pair(CTopicTxIndexKey(e.first.first, pindex->nHeight, e.first.second), e.second));
+            }
+            if (!pblocktree->WriteTopicIndex(pindex->nHeight, topicIndex))
+                return AbortNode(state, "Failed to write topic index");
+        }
+
+        // Apply the delegation events of the block to the delegations index
+        std::vector<uint256> delegationTxs;
+        auto itDelegations = heightIndexes.find(uintToh160(chainparams.GetConsensus().GetDelegationsAddress(pindex->nHeight)));
+        if (itDelegations != heightIndexes.end()) {
+            delegationTxs = itDelegations->second.second;
+        }
+        DelegationIndex().ConnectBlock(pindex->nHeight, pindex->GetBlockHash(), pindex->pprev->GetBlockHash(), delegationTxs);
     }
 
     // The stake and delegate index is needed for MPoS, update it while MPoS is active
@@ -4082,12 +5199,13 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
                 pblocktree->WriteStakeIndex(pindex->nHeight, uint160());
             }
 
+            uint160 address;
+            uint8_t fee = 0;
             if (block.HasProofOfDelegation()) {
-                uint160 address;
-                uint8_t fee = 0;
                 GetBlockDelegation(block, pkh, address, fee, view);
                 pblocktree->WriteDelegateIndex(pindex->nHeight, address, fee);
             }
+            ConnectMPoSScript(pindex, pkh, block.HasProofOfDelegation(), address, fee, chainparams.GetConsensus());
         } else {
             pblocktree->WriteStakeIndex(pindex->nHeight, uint160());
         }
@@ -4096,16 +5214,13 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     assert(pindex->phashBlock);
     ///////////////////////////////////////////////////////////// // qtum
     if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
-            return AbortNode(state, "Failed to write address index");
-        }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
+        // The locked amount checks above read the unspent index, it must be current for the next block
+        if (!UpdateAddressUnspentAndBalances(pindex, false, addressIndex, addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
-
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
-            return AbortNode(state, "Failed to write transaction index");
-
+    }
+    // The other explorer indexes are written in the background when the address index is enabled
+    if (fAddressIndex && !g_addressindex) {
         unsigned int logicalTS = pindex->nTime;
         unsigned int prevLogicalTS = 0;
 
@@ -4119,11 +5234,15 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
             LogPrint(BCLog::INDEX, "%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
         }
 
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
-            return AbortNode(state, "Failed to write timestamp index");
-
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
-            return AbortNode(state, "Failed to write blockhash index");
+        // Queue the indexes, during IBD they are written with the block index in FlushStateToDisk
+        // unless they outgrow -addressindexcache
+        pblocktree->BatchAddressIndexes(addressIndex, spentIndex,
+                                        CTimestampIndexKey(logicalTS, pindex->GetBlockHash()),
+                                        CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS));
+        if (!IsInitialBlockDownload() || pblocktree->IndexBatchSize() > nAddressIndexCacheSize) {
+            if (!pblocktree->FlushIndexBatch())
+                return AbortNode(state, "Failed to write address index");
+        }
     }
     /////////////////////////////////////////////////////////////
     // add this block to the view's block chain
@@ -4137,9 +5256,22 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     nTimeCallbacks += nTime6 - nTime5;
     LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime6 - nTime5), nTimeCallbacks * MICRO, nTimeCallbacks * MILLI / nBlocksTotal);
 
-    if (fLogEvents)
+    if (fLogEvents) {
         pstorageresult->commitResults();
 
+        int64_t nTime7 = GetTimeMicros();
+        nTimeReceiptsCommit += nTime7 - nTime6;
+        LogPrint(BCLog::BENCH, "    - Receipts writing: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime7 - nTime6), nTimeReceiptsCommit * MICRO, nTimeReceiptsCommit * MILLI / nBlocksTotal);
+    }
+
+    if (g_contract_profiler)
+        g_contract_profiler->ConnectBlock(pindex->nHeight);
+    g_metrics.blocksConnected++;
+    g_metrics.contractTxs += blockStats.execute.nCount;
+    g_metrics.evmTime += blockStats.execute.nTime;
+
+    AddRecentConnectedBlock(pindex, blockundo, std::move(mapContractOutputs));
+
     return true;
 }
 
@@ -4188,8 +5320,21 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState&
             if (nLastFlush == 0) {
                 nLastFlush = nNow;
             }
+            // Release a background coins write that has finished meanwhile
+            bool fReaped = false;
+            if (pcoinsflush && !pcoinsflush->Reap(fReaped))
+                return AbortNode(state, "Failed to write to coin database");
+            if (fReaped)
+                full_flush_completed = true;
             int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
             int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR;
+            if (pcoinsflush)
+                cacheSize += pcoinsflush->FlushingMemoryUsage();
+            g_metrics.coinsCacheUsage = pcoinsTip->DynamicMemoryUsage();
+            g_metrics.blockTreeDBUsage = pblocktree->DynamicMemoryUsage();
+            g_metrics.chainstateDBUsage = pcoinsdbview->DynamicMemoryUsage();
+            if (pstorageresult)
+                g_metrics.receiptsDBUsage = pstorageresult->DynamicMemoryUsage();
             int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
             // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
             bool fCacheLarge = mode == FlushStateMode::PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -4225,6 +5370,9 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState&
                     if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                         return AbortNode(state, "Failed to write to block index database");
                     }
+                    if (!FlushBlockSignatureKeys()) {
+                        return AbortNode(state, "Failed to write block signature keys to block index database");
+                    }
                 }
                 // Finally remove any pruned files
                 if (fFlushForPrune)
@@ -4241,10 +5389,20 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState&
                 if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                     return state.Error("out of disk space");
                 // Flush the chainstate (which may refer to block index entries).
-                if (!pcoinsTip->Flush())
+                // Flushes that are only due to the cache size or age are written in the
+                // background once synced, validation continues on top of the flushed entries.
+                bool fBackground = pcoinsflush && mode == FlushStateMode::PERIODIC && !fFlushForPrune && !IsInitialBlockDownload();
+                if (pcoinsflush)
+                    pcoinsflush->SetBackground(fBackground);
+                bool fFlushed = pcoinsTip->Flush();
+                if (pcoinsflush)
+                    pcoinsflush->SetBackground(false);
+                if (!fFlushed)
                     return AbortNode(state, "Failed to write to coin database");
+                WriteUTXOSetHash();
                 nLastFlush = nNow;
-                full_flush_completed = true;
+                if (!fBackground)
+                    full_flush_completed = true;
             }
         }
         if (full_flush_completed) {
@@ -4266,6 +5424,24 @@ void FlushStateToDisk()
     }
 }
 
+void WriteBlockIndexSnapshot()
+{
+    LOCK(cs_main);
+    if (!pblocktree || !setDirtyBlockIndex.empty() || !setDirtyFileInfo.empty())
+        return; // Only a fully flushed block index is written
+
+    int64_t nStart = GetTimeMillis();
+    std::vector<const CBlockIndex*> vBlocks;
+    vBlocks.reserve(mapBlockIndex.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        vBlocks.push_back(item.second);
+    }
+    // Loading in height order allocates each entry right after its parent
+    std::sort(vBlocks.begin(), vBlocks.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+    if (pblocktree->WriteBlockIndexSnapshot(vBlocks))
+        LogPrintf("Wrote block index snapshot of %u entries in %dms\n", vBlocks.size(), GetTimeMillis() - nStart);
+}
+
 void PruneAndFlush()
 {
     CValidationState state;
@@ -4294,10 +5470,41 @@ static void AppendWarning(std::string& res, const std::string& warn)
 }
 
 /** Check warning conditions and do some notifications on new chain tip set. */
-void static UpdateTip(const CBlockIndex* pindexNew, const CChainParams& chainParams)
+void UpdateTipSnapshot(const CBlockIndex* pindex)
 {
-    // New best block
+    AssertLockHeld(cs_main);
+    if (!pindex)
+        return;
+
+    auto snapshot = std::make_shared<TipSnapshot>();
+    snapshot->nHeight = pindex->nHeight;
+    snapshot->hash = pindex->GetBlockHash();
+    snapshot->nTime = pindex->GetBlockTime();
+    snapshot->nMedianTimePast = pindex->GetMedianTimePast();
+    snapshot->nBits = pindex->nBits;
+    snapshot->hashStateRoot = pindex->hashStateRoot;
+    snapshot->hashUTXORoot = pindex->hashUTXORoot;
+    snapshot->nDgpFiatGasPrice = DGP_CACHE_FIAT_GAS_PRICE;
+    snapshot->nDgpBurnRate = DGP_CACHE_BURN_RATE;
+    snapshot->nDgpEconomyDividend = DGP_CACHE_ECONOMY_DIVIDEND;
+    snapshot->nDgpBlockSize = DGP_CACHE_BLOCK_SIZE;
+    snapshot->nDgpBlockGasLimit = DGP_CACHE_BLOCK_GAS_LIMIT;
+    snapshot->nDgpFiatBytePrice = DGP_CACHE_FIAT_BYTE_PRICE;
+    std::atomic_store(&g_tip_snapshot, std::shared_ptr<const TipSnapshot>(std::move(snapshot)));
+}
+
+std::shared_ptr<const TipSnapshot> GetTipSnapshot()
+{
+    return std::atomic_load(&g_tip_snapshot);
+}
+
+void static UpdateTip(const CBlockIndex* pindexNew, const CChainParams& chainParams)
+{
+    // New best block
     mempool.AddTransactionsUpdated(1);
+    g_metrics.tipHeight = pindexNew->nHeight;
+    g_metrics.tipTime = GetTimeMicros();
+    UpdateTipSnapshot(pindexNew);
 
     {
         LOCK(g_best_block_mutex);
@@ -4305,6 +5512,9 @@ void static UpdateTip(const CBlockIndex* pindexNew, const CChainParams& chainPar
         g_best_block_cv.notify_all();
     }
 
+    // Forks below the synchronized checkpoint are rejected, so their stakes need not be kept
+    setStakeSeen.Expire(pindexNew->nHeight - chainParams.GetConsensus().CheckpointSpan(pindexNew->nHeight));
+
     std::string warningMessages;
     if (!IsInitialBlockDownload()) {
         int nUpgraded = 0;
@@ -4355,11 +5565,18 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
 {
     CBlockIndex* pindexDelete = chainActive.Tip();
     assert(pindexDelete);
-    // Read block from disk.
-    std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-    CBlock& block = *pblock;
-    if (!ReadBlockFromDisk(block, pindexDelete, chainparams.GetConsensus()))
-        return AbortNode(state, "Failed to read block");
+    // Read block from disk, unless it was connected recently.
+    std::shared_ptr<const CBlock> pblock;
+    auto itConnected = FindRecentConnectedBlock(pindexDelete);
+    if (itConnected != listRecentConnectedBlocks.end() && itConnected->pblock) {
+        pblock = itConnected->pblock;
+    } else {
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, pindexDelete, chainparams.GetConsensus()))
+            return AbortNode(state, "Failed to read block");
+        pblock = pblockRead;
+    }
+    const CBlock& block = *pblock;
     // Apply the block atomically to the chain state.
     int64_t nStart = GetTimeMicros();
     {
@@ -4370,8 +5587,15 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         bool flushed = view.Flush();
         assert(flushed);
+        UpdateUTXOSetHash(pindexDelete, pindexDelete->pprev, m_utxo_hash_delta);
     }
     LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * MILLI);
+    itConnected = FindRecentConnectedBlock(pindexDelete);
+    if (itConnected != listRecentConnectedBlocks.end()) {
+        if (disconnectpool)
+            mapDisconnectedContractOutputs.insert(itConnected->mapContractOutputs.begin(), itConnected->mapContractOutputs.end());
+        listRecentConnectedBlocks.erase(itConnected);
+    }
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(chainparams, state, FlushStateMode::IF_NEEDED))
         return false;
@@ -4509,16 +5733,27 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
             if (state.IsInvalid())
                 InvalidBlockFound(pindexNew, state);
 
-            globalState->setRoot(oldHashStateRoot);    // qtum
-            globalState->setRootUTXO(oldHashUTXORoot); // qtum
+            globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot); // qtum
             pstorageresult->clearCacheResult();
             return error("%s: ConnectBlock %s failed, %s", __func__, pindexNew->GetBlockHash().ToString(), FormatStateMessage(state));
         }
         nTime3 = GetTimeMicros();
         nTimeConnectTotal += nTime3 - nTime2;
+        auto itConnected = FindRecentConnectedBlock(pindexNew);
+        if (itConnected != listRecentConnectedBlocks.end())
+            itConnected->pblock = pthisBlock;
         LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
         bool flushed = view.Flush();
         assert(flushed);
+        UpdateUTXOSetHash(pindexNew->pprev, pindexNew, m_utxo_hash_delta);
+    }
+    // The coinstake outputs are likely to be staked again, keep them cached across flushes
+    if (blockConnecting.IsProofOfStake()) {
+        const CTransaction& coinstake = *blockConnecting.vtx[1];
+        for (size_t i = 0; i < coinstake.vout.size(); i++) {
+            if (coinstake.vout[i].nValue >= DEFAULT_STAKING_MIN_UTXO_VALUE)
+                pcoinsTip->PinCoin(COutPoint(coinstake.GetHash(), i));
+        }
     }
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
@@ -5014,6 +6249,39 @@ void ResetBlockFailureFlags(CBlockIndex* pindex)
     return g_chainstate.ResetBlockFailureFlags(pindex);
 }
 
+void CStakeSeen::insert(const Stake& stake, int nHeight)
+{
+    auto it = mapStakes.find(stake);
+    if (it != mapStakes.end()) {
+        if (it->second >= nHeight)
+            return;
+        it->second = nHeight;
+    } else {
+        mapStakes.emplace(stake, nHeight);
+    }
+    mapStakesByHeight[nHeight].push_back(stake);
+}
+
+void CStakeSeen::Expire(int nHeight)
+{
+    auto it = mapStakesByHeight.begin();
+    while (it != mapStakesByHeight.end() && it->first < nHeight) {
+        for (const Stake& stake : it->second) {
+            // The stake stays while it is seen in a higher header
+            auto mi = mapStakes.find(stake);
+            if (mi != mapStakes.end() && mi->second == it->first)
+                mapStakes.erase(mi);
+        }
+        it = mapStakesByHeight.erase(it);
+    }
+}
+
+void CStakeSeen::clear()
+{
+    mapStakes.clear();
+    mapStakesByHeight.clear();
+}
+
 CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
 {
     AssertLockHeld(cs_main);
@@ -5025,14 +6293,12 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = g_block_index_arena.New(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
     BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    if (pindexNew->IsProofOfStake())
-        setStakeSeen.insert(std::make_pair(pindexNew->prevoutStake, pindexNew->nTime));
     pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end()) {
@@ -5040,6 +6306,10 @@ CBlockIndex* CChainState::AddToBlockIndex(const CBlockHeader& block)
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
     }
+    if (pindexNew->IsProofOfStake())
+        setStakeSeen.insert(std::make_pair(pindexNew->prevoutStake, pindexNew->nTime), pindexNew->nHeight);
+    if (!IsInitialBlockDownload())
+        setRecentBlockIndex.insert(std::make_pair(pindexNew->nHeight, pindexNew));
     pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
     pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
     pindexNew->nStakeModifier = ComputeStakeModifier(pindexNew->pprev, block.IsProofOfWork() ? hash : block.prevoutStake.hash);
@@ -5364,6 +6634,47 @@ bool GetBlockDelegation(const CBlock& block, const uint160& staker, uint160& add
     return true;
 }
 
+/** Maximum number of recovered block signature keys waiting to be written to the block tree database */
+static const size_t MAX_DIRTY_BLOCK_SIGNATURE_KEYS = 50000;
+
+static CCriticalSection cs_blocksignaturekeys;
+/** Block signature keys recovered since the last flush, by block hash */
+static std::map<uint256, CPubKey> mapDirtyBlockSignatureKeys GUARDED_BY(cs_blocksignaturekeys);
+
+bool RecoverBlockSignatureKey(const CBlockHeader& block, CPubKey& pubkey)
+{
+    uint256 hash = block.GetHashWithoutSign();
+    std::vector<unsigned char> vchBlockSig = block.GetBlockSignature();
+    if (GetCachedRecoveredKey(hash, vchBlockSig, pubkey))
+        return true;
+
+    // The block hash commits to the signature, so the key stored for it can't go stale
+    uint256 hashBlock = block.GetHash();
+    if (pblocktree && pblocktree->ReadBlockSignatureKey(hashBlock, pubkey)) {
+        AddCachedRecoveredKey(hash, vchBlockSig, pubkey);
+        return true;
+    }
+
+    if (!CachedRecoverCompact(hash, vchBlockSig, pubkey))
+        return false;
+
+    LOCK(cs_blocksignaturekeys);
+    if (mapDirtyBlockSignatureKeys.size() < MAX_DIRTY_BLOCK_SIGNATURE_KEYS)
+        mapDirtyBlockSignatureKeys.emplace(hashBlock, pubkey);
+    return true;
+}
+
+static bool FlushBlockSignatureKeys()
+{
+    std::vector<std::pair<uint256, CPubKey>> vKeys;
+    {
+        LOCK(cs_blocksignaturekeys);
+        vKeys.assign(mapDirtyBlockSignatureKeys.begin(), mapDirtyBlockSignatureKeys.end());
+        mapDirtyBlockSignatureKeys.clear();
+    }
+    return vKeys.empty() || pblocktree->WriteBlockSignatureKeys(vKeys);
+}
+
 bool CheckBlockSignature(const CBlock& block)
 {
     std::vector<unsigned char> vchBlockSig = block.GetBlockSignature();
@@ -5379,11 +6690,11 @@ bool CheckBlockSignature(const CBlock& block)
 
     if (vchBlockSig.size() == CPubKey::COMPACT_SIGNATURE_SIZE) {
         CPubKey pubkey;
-        if (pubkey.RecoverCompact(hash, vchBlockSig) && pubkey == CPubKey(vchPubKey))
+        if (RecoverBlockSignatureKey(block, pubkey) && pubkey == CPubKey(vchPubKey))
             return true;
     }
 
-    return CPubKey(vchPubKey).Verify(hash, vchBlockSig);
+    return CachedVerifySignature(hash, vchBlockSig, CPubKey(vchPubKey));
 }
 
 static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& consensusParams, bool fCheckPOW = true, bool fCheckPOS = true)
@@ -5892,6 +7203,37 @@ bool CChainState::AcceptBlockHeader(const CBlockHeader& block, CValidationState&
     return true;
 }
 
+/** Header lists shorter than this have their block signature keys recovered by the header checks */
+static const size_t MIN_PARALLEL_HEADER_SIGNATURES = 16;
+
+/**
+ * Recover the keys of the compact block signatures of a header list on the script-checking
+ * threads before the headers are accepted, so that the serial header checks find the keys
+ * in the recovered key cache. The stake kernels read the coins view and are still checked
+ * one header at a time under cs_main.
+ */
+static void RecoverHeaderSignatureKeys(const std::vector<CBlockHeader>& headers)
+{
+    if (nScriptCheckThreads <= 0 || headers.size() < MIN_PARALLEL_HEADER_SIGNATURES)
+        return;
+
+    std::vector<std::future<void>> workers;
+    for (int t = 0; t < nScriptCheckThreads; t++) {
+        workers.push_back(std::async(std::launch::async, [&headers, t]() {
+            for (size_t i = t; i < headers.size(); i += nScriptCheckThreads) {
+                const CBlockHeader& header = headers[i];
+                std::vector<unsigned char> vchBlockSig = header.GetBlockSignature();
+                if (!header.IsProofOfStake() || vchBlockSig.size() != CPubKey::COMPACT_SIGNATURE_SIZE)
+                    continue;
+                CPubKey pubkey;
+                RecoverBlockSignatureKey(header, pubkey);
+            }
+        }));
+    }
+    for (std::future<void>& worker : workers)
+        worker.wait();
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex, CBlockHeader* first_invalid, const CBlockIndex** pindexFirst)
 {
@@ -5906,6 +7248,10 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
         }
     }
 
+    // The proof of stake of the headers is only checked after the initial block download
+    if (!IsInitialBlockDownload())
+        RecoverHeaderSignatureKeys(headers);
+
     {
         LOCK(cs_main);
         bool bFirst = true;
@@ -6177,8 +7523,7 @@ bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams,
     dev::h256 oldHashUTXORoot(globalState->rootHashUTXO()); // qtum
 
     if (!g_chainstate.ConnectBlock(block, state, &indexDummy, viewNew, chainparams, true)) {
-        globalState->setRoot(oldHashStateRoot);    // qtum
-        globalState->setRootUTXO(oldHashUTXORoot); // qtum
+        globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot); // qtum
         pstorageresult->clearCacheResult();
         return false;
     }
@@ -6206,13 +7551,32 @@ uint64_t CalculateCurrentUsage()
 /* Prune a block file (modify associated database entries)*/
 void PruneOneBlockFile(const int fileNumber)
 {
+    // The receipts and log indexes of the pruned blocks of the active chain go with them. Their
+    // transactions are only known from the block data, so this runs before it is unlinked.
+    if (fLogEvents) {
+        int nBlocks = 0;
+        for (const auto& entry : mapBlockIndex) {
+            const CBlockIndex* pindex = entry.second;
+            if (pindex->nFile != fileNumber || !(pindex->nStatus & BLOCK_HAVE_DATA) || !chainActive.Contains(pindex))
+                continue;
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
+                LogPrintf("Prune: %s could not read block %s, its receipts are kept\n", __func__, pindex->GetBlockHash().ToString());
+                continue;
+            }
+            EraseBlockLogs(block, pindex->nHeight);
+            nBlocks++;
+        }
+        LogPrint(BCLog::PRUNE, "Prune: erased the receipts and log indexes of %d blocks of blk/rev (%05u)\n", nBlocks, fileNumber);
+    }
+
     LOCK(cs_LastBlockFile);
 
     for (const auto& entry : mapBlockIndex) {
         CBlockIndex* pindex = entry.second;
         if (pindex->nFile == fileNumber) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
-            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nStatus &= ~(BLOCK_HAVE_UNDO | BLOCK_UNDO_COMPRESSED);
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
@@ -6242,6 +7606,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        g_block_file_reader.Invalidate(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -6414,7 +7779,7 @@ CBlockIndex* CChainState::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = g_block_index_arena.New();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -6543,6 +7908,7 @@ bool LoadChainTip(const CChainParams& chainparams)
         return false;
     }
     chainActive.SetTip(pindex);
+    UpdateTipSnapshot(pindex);
 
     g_chainstate.PruneBlockIndexCandidates();
 
@@ -6628,6 +7994,10 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView* coinsview,
                 }
             }
         }
+        // check level 3: the contract state of the block is stored, without executing its contracts
+        if (nCheckLevel >= 3 && !HaveStateRoots(pindex)) {
+            return error("VerifyDB(): *** missing contract state at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
         if (nCheckLevel >= 3 && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetBlockHash());
@@ -6672,15 +8042,13 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView* coinsview,
             dev::h256 oldHashUTXORoot(globalState->rootHashUTXO()); // qtum
 
             if (!g_chainstate.ConnectBlock(block, state, pindex, coins, chainparams)) {
-                globalState->setRoot(oldHashStateRoot);    // qtum
-                globalState->setRootUTXO(oldHashUTXORoot); // qtum
+                globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot); // qtum
                 pstorageresult->clearCacheResult();
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s (%s)", pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
             }
         }
     } else {
-        globalState->setRoot(oldHashStateRoot);    // qtum
-        globalState->setRootUTXO(oldHashUTXORoot); // qtum
+        globalState->restoreRoots(oldHashStateRoot, oldHashUTXORoot); // qtum
     }
     LogPrintf("[DONE].\n");
     LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", block_count, nGoodTransactions);
@@ -6688,6 +8056,272 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView* coinsview,
     return true;
 }
 
+void VerifyDBReconnect(const CChainParams& chainparams, int nCheckDepth)
+{
+    LOCK(cs_main);
+    LogPrintf("Reconnecting the last blocks in the background\n");
+    if (!CVerifyDB().VerifyDB(chainparams, pcoinsTip.get(), 4, nCheckDepth)) {
+        globalState->restoreRoots(uintToh256(chainActive.Tip()->hashStateRoot), uintToh256(chainActive.Tip()->hashUTXORoot));
+        AbortNode("Corrupted block database detected", _("Corrupted block database detected"));
+        return;
+    }
+    // The disconnects moved the UTXO trie to roots the contract UTXO filter does not cover
+    globalState->buildUTXOFilter();
+}
+
+namespace {
+
+/** A block of the range -rebuildreceipts executes, with the DGP values it was connected with */
+struct ReceiptsRebuildBlock {
+    CBlockIndex* pindex;
+    uint64_t blockGasLimit;
+};
+
+/** Execute the contract transactions of a block on a state at its parent's roots and write their receipts and log indexes */
+bool RebuildBlockReceipts(const CChainParams& chainparams, const ReceiptsRebuildBlock& item, QtumState& state, dev::eth::SealEngineFace& sealEngine, std::mutex& mutexResults)
+{
+    CBlockIndex* pindex = item.pindex;
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+    bool fContracts = false;
+    for (const CTransactionRef& tx : block.vtx) {
+        fContracts |= tx->HasCreateOrCall() || tx->HasOpCoinstakeCall();
+    }
+    if (!fContracts)
+        return true;
+
+    // The senders of the executions are read from the coins the block spent
+    CBlockUndo blockundo;
+    if (!UndoReadFromDisk(blockundo, pindex))
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    CCoinsView viewDummy;
+    CCoinsViewCache view(&viewDummy);
+    for (size_t i = 1; i < block.vtx.size() && i - 1 < blockundo.vtxundo.size(); i++) {
+        const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        for (size_t j = 0; j < block.vtx[i]->vin.size() && j < txundo.vprevout.size(); j++) {
+            view.AddCoin(block.vtx[i]->vin[j].prevout, Coin(txundo.vprevout[j]), true);
+        }
+    }
+
+    const Consensus::Params& consensusParams = chainparams.GetConsensus();
+    int nHeight = pindex->nHeight;
+    QtumDGP qtumDGP(&state, fGettingValuesDGP);
+    sealEngine.setQtumSchedule(qtumDGP.getGasSchedule(nHeight + (nHeight + 1 >= consensusParams.QIP7Height ? 0 : 1), consensusParams, chainparams.NetworkIDString()));
+    // ConnectBlock runs with the parent as the tip of chainActive
+    QtumExecutionContext context(nHeight - 1);
+    unsigned int contractflags = GetContractScriptFlags(nHeight, consensusParams);
+    CBlockIndex* pindexPrev = pindex->pprev;
+
+    state.setRoot(uintToh256(pindexPrev->hashStateRoot));
+    state.setRootUTXO(uintToh256(pindexPrev->hashUTXORoot));
+
+    uint64_t countCumulativeGasUsed = 0;
+    std::vector<std::pair<uint256, std::vector<TransactionReceiptInfo>>> results;
+    std::map<dev::Address, std::pair<CHeightTxIndexKey, std::vector<uint256>>> heightIndexes;
+    dev::eth::LogBloom logsBloom;
+    TopicIndexes topicIndexes;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *(block.vtx[i]);
+        if (tx.HasOpCoinstakeCall() || !tx.HasCreateOrCall() || tx.HasOpSpend())
+            continue;
+
+        QtumTxConverter convert(tx, &view, &block.vtx, contractflags);
+        ExtractQtumTX resultConvertQtumTX;
+        if (!convert.extractionQtumTransactions(resultConvertQtumTX))
+            return error("%s: contract transaction %s of the wrong format", __func__, tx.GetHash().ToString());
+        ByteCodeExec exec(block, resultConvertQtumTX.first, item.blockGasLimit, pindexPrev, &state, &sealEngine, &context);
+        if (!exec.performByteCode(dev::eth::Permanence::Committed, false))
+            return error("%s: execution of %s failed", __func__, tx.GetHash().ToString());
+        std::vector<ResultExecute>& resultExec = exec.getResult();
+
+        std::vector<TransactionReceiptInfo> tri;
+        for (size_t k = 0; k < resultConvertQtumTX.first.size(); k++) {
+            // Each execution counts its gas once, reverted or not, see ByteCodeExec::processingResults
+            countCumulativeGasUsed += uint64_t(resultExec[k].execRes.gasUsed);
+        }
+        for (size_t k = 0; k < resultConvertQtumTX.first.size(); k++) {
+            logsBloom |= resultExec[k].txRec.bloom();
+            if (fLogTopicIndex) {
+                AddTopicIndexes(topicIndexes, resultExec[k].txRec.log(), tx.GetHash());
+            }
+            for (auto& log : resultExec[k].txRec.log()) {
+                if (!heightIndexes.count(log.address)) {
+                    heightIndexes[log.address].first = CHeightTxIndexKey(nHeight, log.address);
+                }
+                heightIndexes[log.address].second.push_back(tx.GetHash());
+            }
+            tri.push_back(TransactionReceiptInfo{
+                block.GetHash(),
+                uint32_t(nHeight),
+                tx.GetHash(),
+                uint32_t(i),
+                resultConvertQtumTX.first[k].from(),
+                resultConvertQtumTX.first[k].to(),
+                countCumulativeGasUsed,
+                uint64_t(resultExec[k].execRes.gasUsed),
+                resultExec[k].execRes.newAddress,
+                resultExec[k].txRec.log(),
+                resultExec[k].execRes.excepted,
+                exceptedMessage(resultExec[k].execRes.excepted, resultExec[k].execRes.output),
+                resultExec[k].txRec.bloom(),
+                resultExec[k].txRec.stateRoot(),
+                resultExec[k].txRec.utxoRoot()});
+        }
+        results.emplace_back(tx.GetHash(), std::move(tri));
+    }
+
+    if (block.IsProofOfStake() && block.vtx[1]->HasOpCoinstakeCall()) {
+        const CTransaction& tx = *(block.vtx[1]);
+        QtumTxConverter convert(tx, &view, &block.vtx);
+        ExtractQtumTX resultConvertQtumTX;
+        if (!convert.extractionQtumTransactions(resultConvertQtumTX))
+            return error("%s: coinstake contract call %s of the wrong format", __func__, tx.GetHash().ToString());
+        ByteCodeExec exec(block, resultConvertQtumTX.first, INT64_MAX, pindex, &state, &sealEngine, &context);
+        if (!exec.performByteCode(dev::eth::Permanence::Committed, false))
+            return error("%s: execution of %s failed", __func__, tx.GetHash().ToString());
+        std::vector<ResultExecute>& resultExec = exec.getResult();
+
+        std::vector<TransactionReceiptInfo> tri;
+        for (size_t k = 0; k < resultConvertQtumTX.first.size(); k++) {
+            dev::Address key = resultExec[k].execRes.newAddress;
+            logsBloom |= resultExec[k].txRec.bloom();
+            if (fLogTopicIndex) {
+                AddTopicIndexes(topicIndexes, resultExec[k].txRec.log(), tx.GetHash());
+            }
+            if (!heightIndexes.count(key)) {
+                heightIndexes[key].first = CHeightTxIndexKey(nHeight, resultExec[k].execRes.newAddress);
+            }
+            heightIndexes[key].second.push_back(tx.GetHash());
+            tri.push_back(TransactionReceiptInfo{block.GetHash(), uint32_t(nHeight), tx.GetHash(),
+                uint32_t(1), resultConvertQtumTX.first[k].from(),
+                resultConvertQtumTX.first[k].to(),
+                countCumulativeGasUsed,
+                uint64_t(resultExec[k].execRes.gasUsed),
+                resultExec[k].execRes.newAddress, resultExec[k].txRec.log(),
+                resultExec[k].execRes.excepted});
+        }
+        results.emplace_back(tx.GetHash(), std::move(tri));
+    }
+
+    // The executions must end at the roots the block was connected with, except at the heights that deploy the delegations contract
+    state.commitUTXO();
+    if (nHeight != consensusParams.nOfflineStakeHeight && nHeight != consensusParams.nDelegationsGasFixHeight &&
+        (state.rootHash() != uintToh256(pindex->hashStateRoot) || state.rootHashUTXO() != uintToh256(pindex->hashUTXORoot))) {
+        return error("%s: executions of block %s do not match its state roots", __func__, pindex->GetBlockHash().ToString());
+    }
+    // The nodes of the executed states are in the database already
+    state.db().rollback();
+    state.dbUtxo().rollback();
+
+    {
+        std::lock_guard<std::mutex> lock(mutexResults);
+        EraseBlockLogs(block, nHeight);
+        for (auto& result : results) {
+            pstorageresult->addResult(uintToh256(result.first), result.second);
+        }
+        pstorageresult->commitResults();
+    }
+    for (const auto& e : heightIndexes) {
+        if (!pblocktree->WriteHeightIndex(e.second.first, e.second.second))
+            return error("%s: failed to write height index", __func__);
+    }
+    if (!pblocktree->WriteLogsBloomIndex(nHeight, logsBloom))
+        return error("%s: failed to write logs bloom index", __func__);
+    if (fLogTopicIndex) {
+        std::vector<std::pair<CTopicTxIndexKey, std::vector<uint256>>> topicIndex;
+        for (const auto& e : topicIndexes) {
+            topicIndex.push_back(std::make_pair(CTopicTxIndexKey(e.first.first, nHeight, e.first.second), e.second));
+        }
+        if (!pblocktree->WriteTopicIndex(nHeight, topicIndex))
+            return error("%s: failed to write topic index", __func__);
+    }
+    return true;
+}
+
+} // namespace
+
+bool RebuildReceipts(const CChainParams& chainparams, int nStartHeight, int nThreads)
+{
+    std::vector<ReceiptsRebuildBlock> blocks;
+    std::unique_ptr<QtumState> base;
+    {
+        LOCK(cs_main);
+        if (chainActive.Tip() == nullptr)
+            return true;
+        nStartHeight = std::max(1, nStartHeight);
+        if (nStartHeight > chainActive.Height())
+            return true;
+        LogPrintf("Rebuilding the receipts and log indexes of blocks %d to %d\n", nStartHeight, chainActive.Height());
+        uiInterface.InitMessage(_("Rebuilding receipts..."));
+
+        // The DGP is read through globalState, so the block gas limits are read here at the parent of each block
+        const Consensus::Params& consensusParams = chainparams.GetConsensus();
+        {
+            TemporaryState ts(globalState);
+            QtumDGP qtumDGP(globalState.get(), fGettingValuesDGP);
+            for (int nHeight = nStartHeight; nHeight <= chainActive.Height(); nHeight++) {
+                CBlockIndex* pindex = chainActive[nHeight];
+                ts.SetRoot(uintToh256(pindex->pprev->hashStateRoot), uintToh256(pindex->pprev->hashUTXORoot));
+                blocks.push_back(ReceiptsRebuildBlock{pindex, qtumDGP.getBlockGasLimit(nHeight + (nHeight + 1 >= consensusParams.QIP7Height ? 0 : 1))});
+                if (ShutdownRequested())
+                    return false;
+            }
+        }
+        base = MakeUnique<QtumState>(*globalState);
+
+        // Queries trust the bloom and topic indexes from their start heights, which now cover the rebuilt blocks
+        int nIndexStart;
+        if (!pblocktree->ReadLogsBloomStart(nIndexStart) || nIndexStart > nStartHeight)
+            pblocktree->WriteLogsBloomStart(nStartHeight);
+        if (fLogTopicIndex && (!pblocktree->ReadTopicIndexStart(nIndexStart) || nIndexStart > nStartHeight))
+            pblocktree->WriteTopicIndexStart(nStartHeight);
+    }
+
+    // Workers take whole bloom sections, which are read and rewritten when a block in them is indexed
+    std::mutex mutexResults;
+    std::atomic<unsigned int> nNextSection{0};
+    std::atomic<int> nBlocksDone{0};
+    std::atomic<bool> fFailed{false};
+    const unsigned int nFirstSection = nStartHeight / LOGS_BLOOM_SECTION_SIZE;
+    auto worker = [&]() {
+        QtumState state(*base);
+        dev::eth::ChainParams cp((chainparams.EVMGenesisInfo(dev::eth::Network::qtumMainNetwork)));
+        std::unique_ptr<dev::eth::SealEngineFace> sealEngine(cp.createSealEngine());
+        while (!fFailed && !ShutdownRequested()) {
+            int nSectionStart = (nFirstSection + nNextSection++) * LOGS_BLOOM_SECTION_SIZE;
+            size_t nBegin = std::max(nSectionStart, nStartHeight) - nStartHeight;
+            size_t nEnd = std::min<size_t>(nSectionStart + LOGS_BLOOM_SECTION_SIZE - nStartHeight, blocks.size());
+            if (nBegin >= blocks.size())
+                return;
+            for (size_t i = nBegin; i < nEnd && !fFailed; i++) {
+                try {
+                    if (!RebuildBlockReceipts(chainparams, blocks[i], state, *sealEngine, mutexResults))
+                        fFailed = true;
+                } catch (const std::exception& e) {
+                    LogPrintf("RebuildReceipts: block at height %d: %s\n", blocks[i].pindex->nHeight, e.what());
+                    fFailed = true;
+                }
+            }
+            int nDone = nBlocksDone += int(nEnd - nBegin);
+            LogPrintf("Rebuilt the receipts of blocks %d to %d, %d of %u blocks done\n", blocks[nBegin].pindex->nHeight, blocks[nEnd - 1].pindex->nHeight, nDone, blocks.size());
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < std::max(1, nThreads); i++) {
+        threads.emplace_back(&TraceThread<decltype(worker)>, "rebuildrcpt", worker);
+    }
+    for (std::thread& thread : threads) thread.join();
+
+    if (fFailed)
+        return error("%s: rebuilding the receipts failed", __func__);
+    if (ShutdownRequested())
+        return false;
+    LogPrintf("Rebuilt the receipts and log indexes of %u blocks\n", blocks.size());
+    return true;
+}
+
 /** Apply the effects of a block on the utxo cache, ignoring that it may already have been applied. */
 bool CChainState::RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& inputs, const CChainParams& params)
 {
@@ -6790,7 +8424,7 @@ void CChainState::EraseBlockData(CBlockIndex* index)
     // Reduce validity
     index->nStatus = std::min<unsigned int>(index->nStatus & BLOCK_VALID_MASK, BLOCK_VALID_TREE) | (index->nStatus & ~BLOCK_VALID_MASK);
     // Remove have-data flags.
-    index->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+    index->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_UNDO_COMPRESSED);
     // Remove storage location.
     index->nFile = 0;
     index->nDataPos = 0;
@@ -6935,6 +8569,10 @@ void CChainState::UnloadBlockIndex()
     nBlockSequenceId = 1;
     m_failed_blocks.clear();
     setBlockIndexCandidates.clear();
+    setStakeSeen.clear();
+    setRecentBlockIndex.clear();
+    listRecentConnectedBlocks.clear();
+    mapDisconnectedContractOutputs.clear();
 }
 
 // May NOT be used after any connections are up as much
@@ -6958,9 +8596,10 @@ void UnloadBlockIndex()
     }
 
     for (const BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
+        g_block_index_arena.Delete(entry.second);
     }
     mapBlockIndex.clear();
+    g_block_index_arena.Clear();
     fHavePruned = false;
 
     g_chainstate.UnloadBlockIndex();
@@ -7019,10 +8658,84 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+// Map of disk positions for blocks with unknown parent (only used for reindex)
+static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+
+/**
+ * Import one block read from a block file, and any earlier encountered
+ * successors of it. Returns false if importing should stop.
+ */
+static bool ImportBlock(const CChainParams& chainparams, const std::shared_ptr<CBlock>& pblock, const uint256& hash, CDiskBlockPos* dbp, int& nLoaded)
+{
+    const CBlock& block = *pblock;
+    {
+        LOCK(cs_main);
+        // detect out of order blocks, and store them for later
+        if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
+            LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                block.hashPrevBlock.ToString());
+            if (dbp)
+                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        CBlockIndex* pindex = LookupBlockIndex(hash);
+        if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+            CValidationState state;
+            if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
+                nLoaded++;
+            }
+            if (state.IsError()) {
+                return false;
+            }
+        } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+            LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
+        }
+    }
+
+    // In Bitcoin this only needed to be done for genesis and at the end of block indexing
+    // But for LockTrip PoS we need to sync this after every block to ensure txdb is populated for
+    // validating PoS proofs
+    {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus())) {
+                LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                    head.ToString());
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr)) {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+    return true;
+}
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos* dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
@@ -7065,70 +8778,8 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 blkdat >> block;
                 nRewind = blkdat.GetPos();
 
-                uint256 hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                        continue;
-                    }
-
-                    // process in case the block isn't known yet
-                    CBlockIndex* pindex = LookupBlockIndex(hash);
-                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                        CValidationState state;
-                        if (g_chainstate.AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
-                            nLoaded++;
-                        }
-                        if (state.IsError()) {
-                            break;
-                        }
-                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                        LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
-                    }
-                }
-
-                // In Bitcoin this only needed to be done for genesis and at the end of block indexing
-                // But for LockTrip PoS we need to sync this after every block to ensure txdb is populated for
-                // validating PoS proofs
-                {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
-                }
-
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus())) {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (g_chainstate.AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr)) {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
-                }
+                if (!ImportBlock(chainparams, pblock, block.GetHash(), dbp, nLoaded))
+                    break;
             } catch (const std::exception& e) {
                 LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
@@ -7141,6 +8792,167 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
     return nLoaded > 0;
 }
 
+namespace {
+
+/** A block deserialized and hashed ahead of import by a reindex reader thread */
+struct ParsedBlock {
+    std::shared_ptr<CBlock> block;
+    uint256 hash;
+    unsigned int nPos;
+    unsigned int nSize;
+};
+
+/** The blocks of one block file, in file order */
+struct ParsedBlockFile {
+    bool mapped{false};
+    std::vector<ParsedBlock> blocks;
+};
+
+/**
+ * Scan a memory mapped block file for blocks the same way
+ * LoadExternalBlockFile does: find the message start, read the size and
+ * deserialize, resuming one byte after a bad header or block.
+ */
+void ParseBlockFile(const CChainParams& chainparams, const MappedBlockFile& file, ParsedBlockFile& parsed)
+{
+    const Span<const unsigned char> data = file.Data();
+    const unsigned char* message_start = (const unsigned char*)chainparams.MessageStart();
+    size_t nRewind = 0;
+    while (nRewind + 8 <= (size_t)data.size() && !ShutdownRequested()) {
+        const unsigned char* found = (const unsigned char*)memchr(data.data() + nRewind, message_start[0], data.size() - nRewind);
+        if (!found) break;
+        size_t nHeaderPos = found - data.data();
+        nRewind = nHeaderPos + 1;
+        if (nHeaderPos + 8 > (size_t)data.size()) break;
+        if (memcmp(found, message_start, CMessageHeader::MESSAGE_START_SIZE))
+            continue;
+        unsigned int nSize = ReadLE32(found + CMessageHeader::MESSAGE_START_SIZE);
+        // The block size limit is checked by the importer, as it can change while reindexing
+        if (nSize < 80 || nSize > MAX_SIZE)
+            continue;
+        size_t nBlockPos = nHeaderPos + 8;
+        if (nBlockPos + nSize > (size_t)data.size())
+            continue;
+        try {
+            SpanReader reader(SER_DISK, CLIENT_VERSION, data.subspan(nBlockPos, nSize));
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            reader >> *pblock;
+            nRewind = nBlockPos + nSize - reader.size();
+            parsed.blocks.push_back(ParsedBlock{pblock, pblock->GetHash(), (unsigned int)nBlockPos, nSize});
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize error - %s\n", __func__, e.what());
+        }
+    }
+}
+
+} // namespace
+
+void ReindexBlockFiles(const CChainParams& chainparams)
+{
+    const int nReaders = std::max(1, std::min(GetNumCores() - 1, MAX_REINDEX_READER_THREADS));
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::map<int, ParsedBlockFile> parsed_files; // guarded by mutex
+    int nNextFile = 0;                           // guarded by mutex
+    int nEndFile = std::numeric_limits<int>::max(); // guarded by mutex
+    int nImportFile = 0;                         // guarded by mutex
+    bool fStop = false;                          // guarded by mutex
+
+    // Reader threads deserialize and hash whole block files, staying at most
+    // nReaders files ahead of the importer to bound memory use.
+    auto reader = [&]() {
+        while (true) {
+            int nFile;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [&] { return fStop || nNextFile >= nEndFile || nNextFile < nImportFile + nReaders; });
+                if (fStop || nNextFile >= nEndFile) return;
+                nFile = nNextFile++;
+            }
+            ParsedBlockFile parsed;
+            bool fExists = fs::exists(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+            if (fExists) {
+                std::shared_ptr<const MappedBlockFile> file = BlockFileReader::MapFile("blk", nFile);
+                if (file) {
+                    parsed.mapped = true;
+                    ParseBlockFile(chainparams, *file, parsed);
+                }
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!fExists) {
+                nEndFile = std::min(nEndFile, nFile);
+            } else {
+                parsed_files[nFile] = std::move(parsed);
+            }
+            cond.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nReaders; i++) {
+        threads.emplace_back(&TraceThread<decltype(reader)>, "loadblkrd", reader);
+    }
+    auto stop_readers = [&]() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            fStop = true;
+        }
+        cond.notify_all();
+        for (std::thread& thread : threads) thread.join();
+        threads.clear();
+    };
+
+    try {
+        for (int nFile = 0; ; nFile++) {
+            ParsedBlockFile parsed;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                nImportFile = nFile;
+                cond.notify_all();
+                while (!parsed_files.count(nFile) && nFile < nEndFile) {
+                    cond.wait_for(lock, std::chrono::milliseconds(100));
+                    boost::this_thread::interruption_point();
+                }
+                if (nFile >= nEndFile) break; // No block files left to reindex
+                parsed = std::move(parsed_files[nFile]);
+                parsed_files.erase(nFile);
+            }
+
+            CDiskBlockPos pos(nFile, 0);
+            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+            if (!parsed.mapped) {
+                FILE* file = OpenBlockFile(pos, true);
+                if (!file)
+                    break; // This error is logged in OpenBlockFile
+                LoadExternalBlockFile(chainparams, file, &pos);
+                continue;
+            }
+
+            int64_t nStart = GetTimeMillis();
+            int nLoaded = 0;
+            for (const ParsedBlock& parsed_block : parsed.blocks) {
+                boost::this_thread::interruption_point();
+                if (parsed_block.nSize > dgpMaxBlockSerSize)
+                    continue;
+                pos.nPos = parsed_block.nPos;
+                try {
+                    if (!ImportBlock(chainparams, parsed_block.block, parsed_block.hash, &pos, nLoaded))
+                        break;
+                } catch (const std::exception& e) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                }
+            }
+            if (nLoaded > 0)
+                LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+        }
+    } catch (...) {
+        stop_readers();
+        throw;
+    }
+    stop_readers();
+}
+
 void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 {
     if (!fCheckBlockIndex) {
@@ -7366,6 +9178,8 @@ bool CChainState::RemoveBlockIndex(CBlockIndex* pindex)
 
     setBlockIndexCandidates.erase(pindex);
 
+    setRecentBlockIndex.erase(std::make_pair(pindex->nHeight, pindex));
+
     m_failed_blocks.erase(pindex);
 
     setDirtyBlockIndex.erase(pindex);
@@ -7411,7 +9225,115 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** Version 2 adds the decoded contract outputs of each transaction, version 1 files are still loaded */
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+static void WriteContractOutputs(CAutoFile& file, const CContractOutputsRef& contractOutputs)
+{
+    bool fOutputs = contractOutputs != nullptr;
+    file << fOutputs;
+    if (!fOutputs)
+        return;
+    file << contractOutputs->nFlags;
+    WriteCompactSize(file, contractOutputs->outputs.size());
+    for (const CContractOutput& output : contractOutputs->outputs) {
+        VersionVM version = output.params.version;
+        file << output.nOut;
+        file << version.toRaw();
+        file << u256Touint(output.params.gasLimit);
+        file << u256Touint(output.params.gasPrice);
+        file << output.params.code;
+        file << h160Touint(output.params.receiveAddress);
+        file << (uint8_t)output.params.type;
+    }
+}
+
+static CContractOutputsRef ReadContractOutputs(CAutoFile& file)
+{
+    bool fOutputs;
+    file >> fOutputs;
+    if (!fOutputs)
+        return nullptr;
+    std::shared_ptr<CContractOutputs> contractOutputs = std::make_shared<CContractOutputs>();
+    file >> contractOutputs->nFlags;
+    contractOutputs->outputs.resize(ReadCompactSize(file));
+    for (CContractOutput& output : contractOutputs->outputs) {
+        uint32_t version;
+        uint256 gasLimit, gasPrice;
+        uint160 receiveAddress;
+        uint8_t type;
+        file >> output.nOut >> version >> gasLimit >> gasPrice >> output.params.code >> receiveAddress >> type;
+        output.params.version = VersionVM::fromRaw(version);
+        output.params.gasLimit = uintTou256(gasLimit);
+        output.params.gasPrice = uintTou256(gasPrice);
+        output.params.receiveAddress = uintToh160(receiveAddress);
+        output.params.type = (opcodetype)type;
+    }
+    return contractOutputs;
+}
+
+/** Transaction of the saved mempool */
+struct MempoolDumpEntry {
+    CTransactionRef tx;
+    int64_t nTime;
+    int64_t nFeeDelta;
+    CContractOutputsRef contractOutputs;
+};
+
+/**
+ * Verify the input scripts of the saved transactions on the script check threads, storing the valid
+ * signatures in the signature cache, so that accepting them to the mempool one by one under cs_main
+ * only looks the signatures up. The inputs are the coins of the tip or the outputs of saved parents.
+ */
+static void WarmMempoolSignatureCache(const std::vector<MempoolDumpEntry>& entries, int64_t nExpiry)
+{
+    if (nScriptCheckThreads <= 0 || entries.empty())
+        return;
+
+    // The checks point to their transaction data, which must not move
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(entries.size());
+    std::map<uint256, CTransactionRef> mapSaved;
+    for (const MempoolDumpEntry& entry : entries) {
+        mapSaved.emplace(entry.tx->GetHash(), entry.tx);
+    }
+
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    {
+        LOCK(cs_main);
+        for (const MempoolDumpEntry& entry : entries) {
+            const CTransaction& tx = *entry.tx;
+            if (entry.nTime <= nExpiry || tx.IsCoinBase() || tx.IsCoinStake())
+                continue;
+
+            std::vector<CTxOut> spent;
+            spent.reserve(tx.vin.size());
+            for (const CTxIn& txin : tx.vin) {
+                Coin coin;
+                if (pcoinsTip->GetCoin(txin.prevout, coin)) {
+                    spent.push_back(coin.out);
+                    continue;
+                }
+                auto it = mapSaved.find(txin.prevout.hash);
+                if (it == mapSaved.end() || txin.prevout.n >= it->second->vout.size())
+                    break;
+                spent.push_back(it->second->vout[txin.prevout.n]);
+            }
+            if (spent.size() != tx.vin.size())
+                continue;
+
+            txdata.emplace_back(tx);
+            std::vector<CScriptCheck> vChecks;
+            vChecks.reserve(tx.vin.size());
+            for (unsigned int i = 0; i < tx.vin.size(); i++) {
+                vChecks.emplace_back(spent[i], tx, i, STANDARD_SCRIPT_VERIFY_FLAGS, true /* cacheStore */, &txdata.back());
+            }
+            control.Add(vChecks);
+        }
+    }
+    // A failed check only leaves the signatures of the remaining checks out of the cache
+    control.Wait();
+}
 
 bool LoadMempool()
 {
@@ -7433,29 +9355,48 @@ bool LoadMempool()
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != 1 && version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
         uint64_t num;
         file >> num;
+        std::vector<MempoolDumpEntry> entries;
+        entries.reserve(std::min<uint64_t>(num, 1 << 20));
         while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
+            MempoolDumpEntry entry;
+            file >> entry.tx;
+            file >> entry.nTime;
+            file >> entry.nFeeDelta;
+            if (version >= 2) {
+                entry.contractOutputs = ReadContractOutputs(file);
+            }
+            entries.push_back(std::move(entry));
+        }
+        std::map<uint256, CAmount> mapDeltas;
+        file >> mapDeltas;
+
+        WarmMempoolSignatureCache(entries, nNow - nExpiryTimeout);
+
+        for (const MempoolDumpEntry& entry : entries) {
+            const CTransactionRef& tx = entry.tx;
+            CAmount amountdelta = entry.nFeeDelta;
             if (amountdelta) {
                 mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
             }
             CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
+            if (entry.nTime + nExpiryTimeout > nNow) {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
+                // The saved contract outputs are reused like the ones of a disconnected block,
+                // the converter only decodes the scripts again when the script flags changed
+                if (entry.contractOutputs) {
+                    mapDisconnectedContractOutputs.emplace(tx->GetHash(), entry.contractOutputs);
+                }
+                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, entry.nTime,
                     nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
                     false /* test_accept */);
+                if (entry.contractOutputs) {
+                    mapDisconnectedContractOutputs.erase(tx->GetHash());
+                }
                 if (state.IsValid()) {
                     ++count;
                 } else {
@@ -7475,8 +9416,6 @@ bool LoadMempool()
             if (ShutdownRequested())
                 return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
 
         for (const auto& i : mapDeltas) {
             mempool.PrioritiseTransaction(i.first, i.second);
@@ -7496,6 +9435,7 @@ bool DumpMempool()
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
+    std::vector<CContractOutputsRef> vContractOutputs;
 
     static Mutex dump_mutex;
     LOCK(dump_mutex);
@@ -7506,6 +9446,11 @@ bool DumpMempool()
             mapDeltas[i.first] = i.second;
         }
         vinfo = mempool.infoAll();
+        vContractOutputs.reserve(vinfo.size());
+        for (const auto& i : vinfo) {
+            auto it = mempool.mapTx.find(i.tx->GetHash());
+            vContractOutputs.push_back(it != mempool.mapTx.end() ? it->GetContractOutputs() : nullptr);
+        }
     }
 
     int64_t mid = GetTimeMicros();
@@ -7522,10 +9467,12 @@ bool DumpMempool()
         file << version;
 
         file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
+        for (size_t n = 0; n < vinfo.size(); n++) {
+            const auto& i = vinfo[n];
             file << *(i.tx);
             file << (int64_t)i.nTime;
             file << (int64_t)i.nFeeDelta;
+            WriteContractOutputs(file, vContractOutputs[n]);
             mapDeltas.erase(i.tx->GetHash());
         }
 
@@ -7608,12 +9555,35 @@ bool GetAddressIndex(uint256 addressHash, int type, std::vector<std::pair<CAddre
     if (!fAddressIndex)
         return error("address index not enabled");
 
+    if (g_addressindex) {
+        if (!g_addressindex->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+            return error("unable to get txids for address");
+        return true;
+    }
+
     if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
         return error("unable to get txids for address");
 
     return true;
 }
 
+bool GetAddressIndex(uint256 addressHash, int type, const CAddressIndexRange& range, std::vector<std::pair<CAddressIndexKey, CAmount>>& addressIndex)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (g_addressindex) {
+        if (!g_addressindex->ReadAddressIndex(addressHash, type, range, addressIndex))
+            return error("unable to get txids for address");
+        return true;
+    }
+
+    if (!pblocktree->ReadAddressIndex(addressHash, type, range, addressIndex))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
 bool GetSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value)
 {
     if (!fAddressIndex)
@@ -7622,6 +9592,9 @@ bool GetSpentIndex(CSpentIndexKey& key, CSpentIndexValue& value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
+    if (g_addressindex)
+        return g_addressindex->ReadSpentIndex(key, value);
+
     if (!pblocktree->ReadSpentIndex(key, value))
         return false;
 
@@ -7639,63 +9612,268 @@ bool GetAddressUnspent(uint256 addressHash, int type, std::vector<std::pair<CAdd
     return true;
 }
 
+bool GetAddressUnspent(uint256 addressHash, int type, const CAddressUnspentKey* after, bool includeAfter, size_t limit, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("address index not enabled");
+
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, after, includeAfter, limit, unspentOutputs))
+        return error("unable to get txids for address");
+
+    return true;
+}
+
+bool GetAddressBalance(uint256 addressHash, int type, CAddressBalanceValue& value)
+{
+    if (!fAddressIndex || !fAddressBalanceIndex)
+        return false;
+
+    // An address without a record has no history
+    value.SetNull();
+    pblocktree->ReadAddressBalance(addressHash, type, value);
+    return true;
+}
+
+bool InitAddressBalanceIndex()
+{
+    LOCK(cs_main);
+
+    if (!fAddressIndex)
+        return true;
+
+    bool fBuilt = false;
+    pblocktree->ReadFlag("addressbalanceindex", fBuilt);
+    if (!fBuilt) {
+        if (chainActive.Tip() && g_addressindex) {
+            // The address history of the block tree DB is not kept up to date with -asyncaddressindex
+            LogPrintf("Address totals can not be built with -asyncaddressindex, use -reindex to build them\n");
+            return true;
+        }
+        if (chainActive.Tip()) {
+            LogPrintf("Building address totals from the address index at height %d...\n", chainActive.Height());
+            if (!pblocktree->BuildAddressBalanceIndex(chainActive.Height(), chainActive.Tip()->GetBlockHash()))
+                return error("%s: failed to build the address totals", __func__);
+        }
+        if (!pblocktree->WriteFlag("addressbalanceindex", true))
+            return error("%s: failed to write the address totals flag", __func__);
+    }
+    fAddressBalanceIndex = true;
+    return true;
+}
+
+bool InitContractIndex()
+{
+    LOCK(cs_main);
+
+    bool fBuilt = false;
+    pblocktree->ReadFlag("contractindex", fBuilt);
+    if (fBuilt)
+        return true;
+
+    // The creation of the contracts of an older node is not known, index them as found in the state
+    std::vector<std::pair<uint160, CContractIndexValue>> contractIndex;
+    if (chainActive.Tip() && globalState) {
+        LogPrintf("Indexing the contracts of the state at height %d...\n", chainActive.Height());
+        for (const auto& e : globalState->addresses()) {
+            uint160 address = h160Touint(e.first);
+            CContractIndexValue value;
+            if (pblocktree->ReadContractIndex(address, value))
+                continue;
+            value.codeHash = h256Touint(globalState->codeHash(e.first));
+            contractIndex.push_back(std::make_pair(address, value));
+        }
+    }
+    if (!pblocktree->WriteContractIndex(contractIndex))
+        return error("%s: failed to write the contract index", __func__);
+    if (!pblocktree->WriteFlag("contractindex", true))
+        return error("%s: failed to write the contract index flag", __func__);
+    return true;
+}
+
+bool InitUTXOSetHash()
+{
+    if (!fUTXOSetHash)
+        return true;
+
+    CValidationState state;
+    if (!FlushStateToDisk(Params(), state, FlushStateMode::ALWAYS))
+        return error("%s: failed to flush the coins", __func__);
+
+    LOCK(cs_main);
+    const uint256 hashBestBlock = pcoinsdbview->GetBestBlock();
+    uint256 hashBlock;
+    MuHash3072 hash;
+    if (pcoinsdbview->ReadUTXOSetHash(hashBlock, hash) && hashBlock == hashBestBlock) {
+        g_utxo_set_hash = hash;
+        g_utxo_set_hash_block = hashBlock;
+        return true;
+    }
+
+    // The hash was not kept or is behind the coins, hash the whole set once
+    LogPrintf("Computing the UTXO set hash at height %d...\n", chainActive.Height());
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || !pcursor->GetValue(coin))
+            return error("%s: unable to read the coins", __func__);
+        HashUTXOSetCoin(hash, key, coin, true);
+        pcursor->Next();
+    }
+    g_utxo_set_hash = hash;
+    g_utxo_set_hash_block = hashBestBlock;
+    WriteUTXOSetHash();
+    return true;
+}
+
+bool GetUTXOSetHash(uint256& hashBlock, uint256& hash)
+{
+    MuHash3072 muhash;
+    {
+        LOCK(cs_main);
+        if (!fUTXOSetHash || g_utxo_set_hash_block.IsNull())
+            return false;
+        muhash = g_utxo_set_hash;
+        hashBlock = g_utxo_set_hash_block;
+    }
+    muhash.Finalize(hash);
+    return true;
+}
+
 bool GetTimestampIndex(const unsigned int& high, const unsigned int& low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int>>& hashes)
 {
     if (!fAddressIndex)
         return error("Timestamp index not enabled");
 
+    if (g_addressindex) {
+        if (!g_addressindex->ReadTimestampIndex(high, low, fActiveOnly, hashes))
+            return error("Unable to get hashes for timestamps");
+        return true;
+    }
+
     if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
 
     return true;
 }
 
+struct CAddressUtxo
+{
+    COutPoint prevout;
+    int blockHeight;
+    CAmount amount;
+};
+
+struct CAddressUtxoCache
+{
+    // Last block that changed the address totals when the utxos were read
+    uint256 lastBlockHash;
+    std::vector<CAddressUtxo> utxos;
+};
+
+static const size_t MAX_ADDRESS_UTXO_CACHE = 10000;
+static std::map<std::pair<uint256, int>, CAddressUtxoCache> mapAddressUtxoCache GUARDED_BY(cs_main);
+
+static std::map<COutPoint, uint32_t> mapImmatureStakes GUARDED_BY(cs_main);
+static uint256 hashImmatureStakesTip GUARDED_BY(cs_main);
+static int nImmatureStakesMaturity GUARDED_BY(cs_main) = 0;
+
 bool GetAddressWeight(uint256 addressHash, int type, const std::map<COutPoint, uint32_t>& immatureStakes, int32_t nHeight, uint64_t& nWeight)
 {
+    AssertLockHeld(cs_main);
+
     nWeight = 0;
 
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    // Get address utxos
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> unspentOutputs;
-    if (!GetAddressUnspent(addressHash, type, unspentOutputs)) {
-        throw error("No information available for address");
+    // The utxos of the address are read again only when a block changed its totals
+    CAddressBalanceValue totals;
+    CBlockIndex* pindexLast = nullptr;
+    if (GetAddressBalance(addressHash, type, totals)) {
+        pindexLast = chainActive[totals.lastHeight];
+    }
+    std::pair<uint256, int> key(addressHash, type);
+    auto it = mapAddressUtxoCache.find(key);
+    if (!pindexLast || it == mapAddressUtxoCache.end() || it->second.lastBlockHash != pindexLast->GetBlockHash()) {
+        // Get address utxos
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>> unspentOutputs;
+        if (!GetAddressUnspent(addressHash, type, unspentOutputs)) {
+            throw error("No information available for address");
+        }
+
+        if (mapAddressUtxoCache.size() > MAX_ADDRESS_UTXO_CACHE) {
+            mapAddressUtxoCache.clear();
+        }
+        CAddressUtxoCache& cache = mapAddressUtxoCache[key];
+        cache.lastBlockHash = pindexLast ? pindexLast->GetBlockHash() : uint256();
+        cache.utxos.clear();
+        for (const auto& output : unspentOutputs) {
+            cache.utxos.push_back({COutPoint(output.first.txhash, output.first.index), output.second.blockHeight, output.second.satoshis});
+        }
+        it = mapAddressUtxoCache.find(key);
     }
 
     // Add the utxos to the list if they are mature
     const Consensus::Params& consensusParams = Params().GetConsensus();
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue>>::const_iterator i = unspentOutputs.begin(); i != unspentOutputs.end(); i++) {
-        int nDepth = nHeight - i->second.blockHeight + 1;
+    for (const CAddressUtxo& utxo : it->second.utxos) {
+        int nDepth = nHeight - utxo.blockHeight + 1;
         if (nDepth < consensusParams.CoinbaseMaturity(nHeight + 1))
             continue;
 
-        if (i->second.satoshis < 0)
+        if (utxo.amount < 0)
             continue;
 
-        COutPoint prevout = COutPoint(i->first.txhash, i->first.index);
-        if (immatureStakes.find(prevout) == immatureStakes.end()) {
-            nWeight += i->second.satoshis;
+        if (immatureStakes.find(utxo.prevout) == immatureStakes.end()) {
+            nWeight += utxo.amount;
         }
     }
 
+    if (!pindexLast) {
+        // Without the address totals the utxos can not be checked for changes
+        mapAddressUtxoCache.erase(it);
+    }
+
     return true;
 }
 
 std::map<COutPoint, uint32_t> GetImmatureStakes()
 {
-    std::map<COutPoint, uint32_t> immatureStakes;
-    int height = chainActive.Height();
+    AssertLockHeld(cs_main);
+
+    CBlockIndex* pindexTip = chainActive.Tip();
+    if (!pindexTip) {
+        return std::map<COutPoint, uint32_t>();
+    }
+
+    int height = pindexTip->nHeight;
     int coinbaseMaturity = Params().GetConsensus().CoinbaseMaturity(height + 1);
-    for (int i = 0; i < coinbaseMaturity - 1; i++) {
-        CBlockIndex* block = chainActive[height - i];
-        if (block) {
-            immatureStakes[block->prevoutStake] = block->nTime;
+    if (pindexTip->GetBlockHash() != hashImmatureStakesTip) {
+        // When the tip moves by one block, add its stake and remove the one of the block that is now mature.
+        // The proof of work blocks have no stake, so the list is built again if one of them is involved.
+        CBlockIndex* pindexMatured = chainActive[height - coinbaseMaturity + 1];
+        bool fUpdate = pindexTip->pprev && pindexTip->pprev->GetBlockHash() == hashImmatureStakesTip &&
+                       coinbaseMaturity == nImmatureStakesMaturity && pindexMatured &&
+                       !pindexTip->prevoutStake.IsNull() && !pindexMatured->prevoutStake.IsNull();
+        if (fUpdate) {
+            mapImmatureStakes.erase(pindexMatured->prevoutStake);
+            mapImmatureStakes[pindexTip->prevoutStake] = pindexTip->nTime;
         } else {
-            break;
+            mapImmatureStakes.clear();
+            for (int i = 0; i < coinbaseMaturity - 1; i++) {
+                CBlockIndex* block = chainActive[height - i];
+                if (block) {
+                    mapImmatureStakes[block->prevoutStake] = block->nTime;
+                } else {
+                    break;
+                }
+            }
         }
+        hashImmatureStakesTip = pindexTip->GetBlockHash();
+        nImmatureStakesMaturity = coinbaseMaturity;
     }
-    return immatureStakes;
+    return mapImmatureStakes;
 }
 
 CAmount GetTxGasFee(const CMutableTransaction& _tx)
@@ -17,11 +17,13 @@
 #include <policy/feerate.h>
 #include <protocol.h> // For CMessageHeader::MessageStartChars
 #include <script/script_error.h>
+#include <span.h>
 #include <sync.h>
 #include <txdb.h>
 #include <versionbits.h>
 
 #include <algorithm>
+#include <deque>
 #include <exception>
 #include <map>
 #include <memory>
@@ -50,7 +52,6 @@ class CWalletTx;
 extern std::unique_ptr<QtumState> globalState;
 extern std::shared_ptr<dev::eth::SealEngineFace> globalSealEngine;
 extern bool fRecordLogOpcodes;
-extern bool fIsVMlogFile;
 extern bool fGettingValuesDGP;
 
 struct EthTransactionParams;
@@ -59,6 +60,7 @@ typedef std::pair<std::vector<QtumTransaction>, std::vector<EthTransactionParams
 ///////////////////////////////////////////
 
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
 class CChainParams;
 class CCoinsViewDB;
@@ -104,6 +106,8 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 1;
+/** Percentage of -maxmempool freed below the limit when the mempool overflows */
+static const unsigned int MEMPOOL_TRIM_BATCH_PERCENT = 5;
 /** Maximum kilobytes for transactions to store for processing during reorg */
 static const unsigned int MAX_DISCONNECTED_TX_POOL_SIZE = 20000;
 /** The maximum size of a blk?????.dat file (since 0.8) */
@@ -117,8 +121,15 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of threads reading block files ahead of the importer during -reindex */
+static const int MAX_REINDEX_READER_THREADS = 4;
+/** Blocks with fewer inputs verify their scripts on the connecting thread instead of the script-checking threads */
+static const unsigned int MIN_SCRIPTCHECK_QUEUE_INPUTS = 4;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Upper bound of the blocks in flight from a single peer during initial block download, when the
+ *  limit is sized from the peer's round trip time and block delivery rate. */
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 128;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -134,6 +145,8 @@ static const int MAX_BLOCKTXN_DEPTH = 10;
  *  degree of disordering of blocks on disk (which make reindexing and pruning harder). We'll probably
  *  want to make this a per-peer adaptive value at some point. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Upper bound of the block download window of a peer that keeps more than MAX_BLOCKS_IN_TRANSIT_PER_PEER blocks in flight. */
+static const unsigned int MAX_BLOCK_DOWNLOAD_WINDOW = 8 * BLOCK_DOWNLOAD_WINDOW;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -153,13 +166,20 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_ASYNCADDRESSINDEX = false;
+static const bool DEFAULT_CONTRACTTXINDEX = false;
+static const bool DEFAULT_UTXOSETHASH = false;
+static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 
 static const bool DEFAULT_ADDRINDEX = true;
 
 static const bool DEFAULT_LOGEVENTS = true;
+static const bool DEFAULT_LOGTOPICINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -compressundo */
+static const bool DEFAULT_COMPRESS_UNDO = false;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Default for using fee filter */
@@ -204,8 +224,41 @@ extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
 extern std::atomic_bool g_is_mempool_loaded;
 typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+
+/**
+ * Proof-of-stake pairs of the known block headers, used to detect duplicate stakes.
+ * The pairs are kept by height so they can expire when they fall below the reorg window.
+ */
+class CStakeSeen
+{
+public:
+    typedef std::pair<COutPoint, unsigned int> Stake;
+
+    void insert(const Stake& stake, int nHeight);
+    size_t count(const Stake& stake) const { return mapStakes.count(stake); }
+    //! Remove the stakes of the headers below nHeight
+    void Expire(int nHeight);
+    void clear();
+    size_t size() const { return mapStakes.size(); }
+
+private:
+    class StakeHasher : private SaltedOutpointHasher
+    {
+    public:
+        size_t operator()(const Stake& stake) const { return SaltedOutpointHasher::operator()(stake.first) ^ stake.second; }
+    };
+
+    //! Highest header height of each stake
+    std::unordered_map<Stake, int, StakeHasher> mapStakes;
+    std::map<int, std::vector<Stake>> mapStakesByHeight;
+};
+
 extern BlockMap& mapBlockIndex GUARDED_BY(cs_main);
-extern std::set<std::pair<COutPoint, unsigned int>>& setStakeSeen;
+/** Allocator of the entries of mapBlockIndex */
+extern CBlockIndexArena g_block_index_arena GUARDED_BY(cs_main);
+extern CStakeSeen& setStakeSeen;
+/** Block indexes, by height, that the block index cleanup checks until they are settled below the checkpoint span */
+extern std::set<std::pair<int, CBlockIndex*>>& setRecentBlockIndex GUARDED_BY(cs_main);
 extern const std::string strMessageMagic;
 extern Mutex g_best_block_mutex;
 extern std::condition_variable g_best_block_cv;
@@ -215,11 +268,27 @@ extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fAddressIndex;
 extern bool fLogEvents;
+extern bool fLogTopicIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Share of -dbcache given to each database at startup, in bytes */
+struct DBCacheSizes {
+    int64_t block_tree_db = 0;
+    int64_t tx_index = 0;
+    int64_t address_index = 0;
+    int64_t receipts_db = 0;
+    int64_t coins_db = 0;
+};
+extern DBCacheSizes g_dbcache_sizes;
+/** Size in bytes the address index writes queued during IBD may reach before ConnectBlock writes them out */
+extern size_t nAddressIndexCacheSize;
+/** Whether the per address totals are in sync with the unspent index, see GetAddressBalance */
+extern std::atomic<bool> fAddressBalanceIndex;
+/** Whether a rolling hash of the UTXO set is kept with the tip, see GetUTXOSetHash */
+extern bool fUTXOSetHash;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in satoshis) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -231,6 +300,9 @@ extern bool fEnableReplacement;
 /** Block hash whose ancestors we will assume to have valid scripts without checking them. */
 extern uint256 hashAssumeValid;
 
+/** Block hash whose ancestors are connected with the contract state roots of their headers, set by -assumevalidstate */
+extern uint256 hashAssumeValidState;
+
 /** Minimum work we will assume exists on some valid chain. */
 extern arith_uint256 nMinimumChainWork;
 
@@ -245,6 +317,8 @@ static const uint64_t nMinDiskSpace = 52428800;
 extern bool fHavePruned;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
+/** Whether newly written undo data is compressed (-compressundo) */
+extern bool fCompressUndo;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
@@ -254,6 +328,10 @@ static const unsigned int NODE_NETWORK_LIMITED_MIN_BLOCKS = 288;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Default for -deferreconnectcheck */
+static const bool DEFAULT_DEFER_RECONNECT_CHECK = false;
+/** Default for -assumevalidstate */
+static const bool DEFAULT_ASSUME_VALID_STATE = false;
 
 // Require that user allocate at least 550 MiB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 288 blocks = 288MB.
@@ -311,6 +389,8 @@ FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = nullptr);
+/** Rebuild the block index from the block files for -reindex, parsing files ahead of the import on reader threads */
+void ReindexBlockFiles(const CChainParams& chainparams);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk,
@@ -353,6 +433,8 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Write the flushed block index as a snapshot that the next startup loads in one pass. */
+void WriteBlockIndexSnapshot();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
 /** Prune block files up to a given height */
@@ -437,6 +519,82 @@ struct CHeightTxIndexKey {
     }
 };
 
+struct CTopicTxIndexIteratorKey {
+    dev::h256 topic;
+    unsigned int height;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 37;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << topic.asBytes();
+        ser_writedata32be(s, height);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        valtype tmp;
+        s >> tmp;
+        topic = dev::h256(tmp);
+        height = ser_readdata32be(s);
+    }
+
+    CTopicTxIndexIteratorKey(dev::h256 _topic, unsigned int _height) {
+        topic = _topic;
+        height = _height;
+    }
+
+    CTopicTxIndexIteratorKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        topic.clear();
+        height = 0;
+    }
+};
+
+struct CTopicTxIndexKey {
+    dev::h256 topic;
+    unsigned int height;
+    dev::h160 address;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 58;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        s << topic.asBytes();
+        ser_writedata32be(s, height);
+        s << address.asBytes();
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        valtype tmp;
+        s >> tmp;
+        topic = dev::h256(tmp);
+        height = ser_readdata32be(s);
+        s >> tmp;
+        address = dev::h160(tmp);
+    }
+
+    CTopicTxIndexKey(dev::h256 _topic, unsigned int _height, dev::h160 _address) {
+        topic = _topic;
+        height = _height;
+        address = _address;
+    }
+
+    CTopicTxIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        topic.clear();
+        height = 0;
+        address.clear();
+    }
+};
+
 struct CTimestampIndexIteratorKey {
     unsigned int timestamp;
 
@@ -639,6 +797,72 @@ struct CAddressUnspentValue {
     }
 };
 
+/** Totals of an address, kept up to date with its unspent index entries */
+struct CAddressBalanceValue {
+    CAmount balance;
+    CAmount received;
+    int64_t utxos;
+    int lastHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(utxos);
+        READWRITE(lastHeight);
+    }
+
+    CAddressBalanceValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        utxos = 0;
+        lastHeight = 0;
+    }
+};
+
+/** Creation of a contract, by contract address in the contract index */
+struct CContractIndexValue {
+    //! Height of the block that created the contract, -1 when it was indexed from the state of an older node
+    int nHeight;
+    uint256 txid;
+    uint160 creator;
+    uint256 codeHash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nHeight);
+        READWRITE(txid);
+        READWRITE(creator);
+        READWRITE(codeHash);
+    }
+
+    CContractIndexValue() {
+        SetNull();
+    }
+
+    CContractIndexValue(int _nHeight, const uint256& _txid, const uint160& _creator) {
+        nHeight = _nHeight;
+        txid = _txid;
+        creator = _creator;
+        codeHash.SetNull();
+    }
+
+    void SetNull() {
+        nHeight = -1;
+        txid.SetNull();
+        creator.SetNull();
+        codeHash.SetNull();
+    }
+};
+
 struct CAddressIndexKey {
     unsigned int type;
     uint256 hashBytes;
@@ -702,6 +926,21 @@ struct CAddressIndexKey {
 
 };
 
+/** Which entries of the address history of one address to read */
+struct CAddressIndexRange {
+    //! Lowest and highest height, 0 for no bound
+    int start = 0;
+    int end = 0;
+    //! Most entries to read, 0 for all
+    size_t limit = 0;
+    //! Read the newest entries first
+    bool descending = false;
+    //! Only read the entries past after in the read order, and the entry at after itself with includeAfter
+    bool hasAfter = false;
+    bool includeAfter = false;
+    CAddressIndexKey after;
+};
+
 struct CAddressIndexIteratorHeightKey {
     unsigned int type;
     uint256 hashBytes;
@@ -862,11 +1101,32 @@ bool GetAddressIndex(uint256 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                      int start = 0, int end = 0);
 
+/** Reads one page of the address history, see CAddressIndexRange */
+bool GetAddressIndex(uint256 addressHash, int type, const CAddressIndexRange &range,
+                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex);
+
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 
 bool GetAddressUnspent(uint256 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
 
+/** Reads at most limit (0 for all) unspent outputs of an address in key order that come after the key after, or start at it with includeAfter */
+bool GetAddressUnspent(uint256 addressHash, int type, const CAddressUnspentKey *after, bool includeAfter, size_t limit,
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+
+/** Reads the totals of an address. Returns false when the totals are not available, callers then sum GetAddressUnspent. */
+bool GetAddressBalance(uint256 addressHash, int type, CAddressBalanceValue &value);
+/** Builds the address totals from the block tree address history if they are not there yet */
+bool InitAddressBalanceIndex();
+/** Indexes the contracts of the state of the active tip if the contract index is not there yet */
+bool InitContractIndex();
+/** Loads the UTXO set hash of -utxosethash written with the coins, or computes it from the coins when it is not there */
+bool InitUTXOSetHash();
+/**
+ * The MuHash3072 of the UTXO set at the active tip and the tip it belongs to, kept up to date by
+ * connecting and disconnecting blocks. Returns false without -utxosethash, and while it is not known.
+ */
+bool GetUTXOSetHash(uint256& hashBlock, uint256& hash);
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 
 bool GetAddressWeight(uint256 addressHash, int type, const std::map<COutPoint, uint32_t>& immatureStakes, int32_t nHeight, uint64_t& nWeight);
@@ -879,6 +1139,7 @@ std::map<COutPoint, uint32_t> GetImmatureStakes();
 template <typename Block>
 bool ReadBlockFromDisk(Block& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 bool CheckIndexProof(const CBlockIndex& block, const Consensus::Params& consensusParams);
@@ -892,6 +1153,8 @@ bool GetBlockPublicKey(const CBlock& block, std::vector<unsigned char>& vchPubKe
 bool GetBlockDelegation(const CBlock& block, const uint160& staker, uint160& address, uint8_t& fee, CCoinsViewCache& view);
 bool SignBlock(std::shared_ptr<CBlock> pblock, CWallet& wallet, const CAmount& nTotalFees, uint32_t nTime, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins, std::vector<COutPoint>& setSelectedCoins, std::vector<COutPoint>& setDelegateCoins, bool selectedOnly = false, bool tryOnly = false);
 bool CheckCanonicalBlockSignature(const CBlockHeader* pblock);
+/** Recover the public key of the compact signature of a block through the recovered key cache and the block tree database */
+bool RecoverBlockSignatureKey(const CBlockHeader& block, CPubKey& pubkey);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block) */
 bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -919,6 +1182,17 @@ public:
     bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
 };
 
+/** The reconnect of check level 4 when -deferreconnectcheck moves it after startup, run from the scheduler */
+void VerifyDBReconnect(const CChainParams& chainparams, int nCheckDepth);
+
+/**
+ * Re-execute the contract transactions of the active chain from nStartHeight and write their receipts and the
+ * height, logs bloom and topic indexes again, for -rebuildreceipts. Ranges of blocks run on nThreads threads, each
+ * from the stored state roots of the range start. The coins and the contract state are not written.
+ * Runs at startup before the chain can move.
+ */
+bool RebuildReceipts(const CChainParams& chainparams, int nStartHeight, int nThreads);
+
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
@@ -951,6 +1225,9 @@ extern CChain& chainActive;
 /** Global variable that points to the coins database (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 
+/** Global variable that points to the view writing coins flushes in the background (protected by cs_main) */
+extern std::unique_ptr<CCoinsViewBackgroundFlush> pcoinsflush;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern std::unique_ptr<CCoinsViewCache> pcoinsTip;
 
@@ -1014,13 +1291,157 @@ bool GetSpentCoinFromMainChain(const CBlockIndex* pforkPrev, COutPoint prevoutSt
 
 std::vector<ResultExecute> CallContract(const dev::Address& addrContract, std::vector<unsigned char> opcode, const dev::Address& sender = dev::Address(), uint64_t gasLimit=0, uint64_t blockGasLimit=0, CAmount nAmount=0);
 
+/** The tip state and block context pinned for a series of read-only contract calls */
+struct ContractCallSnapshot {
+    CBlockIndex* pindex = nullptr;
+    CBlock block;
+    std::unique_ptr<QtumState> state;
+    dev::eth::EVMSchedule schedule;
+    uint64_t blockGasLimit = 0;
+};
+
+/** Copy the tip state and the call context of the block after the tip, only needs cs_main while copying */
+void TakeContractCallSnapshot(ContractCallSnapshot& snapshot, uint64_t blockGasLimit=0);
+
+/**
+ * Run a read-only call on a copy of the snapshot state with a thread local seal engine. The
+ * snapshot is not changed, so calls on the same snapshot may run at the same time and all see
+ * the same height.
+ */
+std::vector<ResultExecute> CallContractOnSnapshot(const ContractCallSnapshot& snapshot, const dev::Address& addrContract, std::vector<unsigned char> opcode, const dev::Address& sender = dev::Address(), uint64_t gasLimit=0, CAmount nAmount=0);
+
+/**
+ * Same as CallContract, but only holds cs_main while copying the tip state; the call itself runs
+ * on the copy with a thread local seal engine, so concurrent read-only calls do not serialize
+ * on cs_main and never touch globalState.
+ */
+std::vector<ResultExecute> CallContractOnSnapshot(const dev::Address& addrContract, std::vector<unsigned char> opcode, const dev::Address& sender = dev::Address(), uint64_t gasLimit=0, uint64_t blockGasLimit=0, CAmount nAmount=0);
+
+/**
+ * A copy of the state at the roots of a block of the active chain, or of the tip when pindex is null.
+ * The copy opens its own tries on the shared state databases and never writes to them, so reads of
+ * old roots run without cs_main and leave globalState alone. Only copying takes cs_main.
+ */
+std::unique_ptr<QtumState> TakeStateSnapshot(const CBlockIndex* pindex = nullptr);
+
 bool CheckOpSender(const CTransaction& tx, const CChainParams& chainparams, int nHeight);
 
 bool CheckSenderScript(const CCoinsViewCache& view, const CTransaction& tx);
 
 bool CheckMinGasPrice(std::vector<EthTransactionParams>& etps, const uint64_t& minGasPrice);
 
+/**
+ * DGP values read before the transactions of the next block are executed.
+ * They only depend on the state of the tip, so they are read once for each tip
+ * by block assembly and mempool acceptance instead of calling the DGP contract every time.
+ */
+struct CBlockDGPParams
+{
+    uint256 hashTip;
+    uint32_t blockSize = 0;
+    uint64_t blockGasLimit = 0;
+    bool voteInProgress = false;
+    uint64_t voteExpiration = 0;
+};
+
+const CBlockDGPParams& GetBlockDGPParams(const CBlockIndex* pindexPrev, int nHeight) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/** Time in microseconds spent in a phase of ConnectBlock and the number of times it ran */
+struct ConnectBlockPhase {
+    int64_t nTime = 0;
+    uint64_t nCount = 0;
+};
+
+/** Hydra specific phases of ConnectBlock, logged with -debug=bench and returned by getvalidationstats */
+struct ConnectBlockStats {
+    uint64_t nBlocks = 0;
+    ConnectBlockPhase extract;        //!< Contract transaction extraction and gas checks
+    ConnectBlockPhase execute;        //!< ByteCodeExec of the contract transactions
+    ConnectBlockPhase proxyCalls;     //!< DGP, oracle and Economy contract calls
+    ConnectBlockPhase valueTransfers; //!< Gas refund, value transfer and dividend bookkeeping
+    ConnectBlockPhase checkReward;    //!< CheckReward
+    ConnectBlockPhase lydra;          //!< LYDRA locked amount spending checks
+    ConnectBlockPhase receipts;       //!< Receipt staging
+    ConnectBlockPhase stateRoot;      //!< State root computation and commit
+};
+
+/** Totals of the ConnectBlock phases since startup */
+ConnectBlockStats GetConnectBlockStats();
+
+/**
+ * The active chain tip and the DGP_CACHE values at the time it became the tip. A new immutable
+ * snapshot is published at every tip change and when the DGP_CACHE values are refreshed, so the
+ * wallet, the GUI, the RPCs and the staker read them without taking cs_main.
+ */
+struct TipSnapshot {
+    int nHeight = -1;
+    uint256 hash;
+    int64_t nTime = 0;
+    int64_t nMedianTimePast = 0;
+    uint32_t nBits = 0;
+    uint256 hashStateRoot;
+    uint256 hashUTXORoot;
+
+    uint64_t nDgpFiatGasPrice = 0;
+    uint64_t nDgpBurnRate = 0;
+    uint64_t nDgpEconomyDividend = 0;
+    uint64_t nDgpBlockSize = 0;
+    uint64_t nDgpBlockGasLimit = 0;
+    uint64_t nDgpFiatBytePrice = 0;
+};
+
+/** Publish the snapshot of pindex as the tip snapshot */
+void UpdateTipSnapshot(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** The last published tip snapshot, null until the chain is loaded. Lock free */
+std::shared_ptr<const TipSnapshot> GetTipSnapshot();
+
+/** Transaction types the mempool admission latency is split by */
+enum MempoolTxType {
+    MEMPOOL_TX_PLAIN,
+    MEMPOOL_TX_CREATE,
+    MEMPOOL_TX_CALL,
+    MEMPOOL_TX_LYDRA,   //!< Calls to the LYDRA contract
+    MEMPOOL_TX_TYPES
+};
+
+/** Stages of AcceptToMemoryPoolWorker */
+enum MempoolAcceptStage {
+    MEMPOOL_STAGE_PRECHECKS,    //!< Standardness, finality and conflict checks
+    MEMPOOL_STAGE_INPUTS,       //!< Fetch of the inputs into the coins cache
+    MEMPOOL_STAGE_CONTRACT,     //!< Converter, OP_SENDER, DGP, gas and LYDRA checks
+    MEMPOOL_STAGE_POLICY,       //!< Input checks, fees, ancestor limits and replacement
+    MEMPOOL_STAGE_SCRIPTS,      //!< Script checks
+    MEMPOOL_STAGE_INSERT,       //!< Mempool insertion and trimming
+    MEMPOOL_STAGES
+};
+
+/** Buckets of the admission latency histograms, bucket i counts times below 2^i microseconds */
+static const int MEMPOOL_LATENCY_BUCKETS = 24;
+
+/** Latency of a stage of the mempool admission, times in microseconds */
+struct MempoolStageStats {
+    uint64_t nCount = 0;
+    int64_t nTime = 0;
+    int64_t nMaxTime = 0;
+    uint64_t histogram[MEMPOOL_LATENCY_BUCKETS] = {};
+};
+
+/** Mempool admission latency of a transaction type. A rejected transaction counts the stages it reached. */
+struct MempoolAcceptStats {
+    uint64_t nAccepted = 0;
+    uint64_t nRejected = 0;
+    MempoolStageStats total;
+    MempoolStageStats stages[MEMPOOL_STAGES];
+};
+
+const char* MempoolTxTypeName(int type);
+const char* MempoolAcceptStageName(int stage);
+
+/** Admission latency of each transaction type since startup */
+std::vector<MempoolAcceptStats> GetMempoolAcceptStats();
+
 struct ByteCodeExecResult;
+class ContractProfiler;
 
 void EnforceContractVoutLimit(ByteCodeExecResult& bcer, ByteCodeExecResult& bcerOut, const dev::h256& oldHashQtumRoot,
     const dev::h256& oldHashStateRoot, const std::vector<QtumTransaction>& transactions);
@@ -1050,11 +1471,24 @@ struct EthTransactionParams{
     }
 };
 
+/** Contract output of a tx decoded from its script, the gas price is set when it is converted */
+struct CContractOutput{
+    uint32_t nOut;
+    EthTransactionParams params;
+};
+
+/** Contract outputs of a tx and the script flags they were decoded with */
+struct CContractOutputs{
+    unsigned int nFlags;
+    std::vector<CContractOutput> outputs;
+};
+typedef std::shared_ptr<const CContractOutputs> CContractOutputsRef;
+
 struct ByteCodeExecResult{
     uint64_t usedGas = 0;
     CAmount refundSender = 0;
     std::vector<CTxOut> refundOutputs;
-    std::vector<CTransaction> valueTransfers;
+    std::vector<CTransactionRef> valueTransfers;
     std::vector<dev::Address> contractAddresses;
     std::vector<dev::Address> contractOwners;
     std::vector<dev::eth::TransactionException> execExceptions;
@@ -1065,28 +1499,38 @@ class QtumTxConverter{
 
 public:
 
-    QtumTxConverter(CTransaction tx, CCoinsViewCache* v = NULL, const std::vector<CTransactionRef>* blockTxs = NULL, unsigned int flags = SCRIPT_EXEC_BYTE_CODE) : txBit(tx), view(v), blockTransactions(blockTxs), sender(false), nFlags(flags){}
+    QtumTxConverter(const CTransaction& tx, CCoinsViewCache* v = NULL, const std::vector<CTransactionRef>* blockTxs = NULL, unsigned int flags = SCRIPT_EXEC_BYTE_CODE, CContractOutputsRef outputs = nullptr) : txBit(tx), view(v), blockTransactions(blockTxs), sender(false), nFlags(flags), contractOutputs(outputs){}
 
     bool extractionQtumTransactions(ExtractQtumTX& qtumTx);
 
+    // Contract outputs decoded by the last extraction, they can be passed to the next converter of the tx
+    CContractOutputsRef GetContractOutputs() const { return contractOutputs; }
+
 private:
 
     bool receiveStack(const CScript& scriptPubKey);
 
     bool parseEthTXParams(EthTransactionParams& params);
 
+    bool setEthTXGasPrice(EthTransactionParams& params);
+
     QtumTransaction createEthTX(const EthTransactionParams& etp, const uint32_t nOut);
 
     size_t correctedStackSize(size_t size);
 
-    const CTransaction txBit;
+    // The converter is scoped to a call, the tx outlives it
+    const CTransaction& txBit;
     const CCoinsViewCache* view;
-    std::vector<valtype> stack;
+    // Items of the contract scripts, they point into the scripts of txBit or into stackStorage
+    std::vector<Span<const unsigned char>> stack;
+    // Items the interpreter produced for scripts that are not plain pushes
+    std::deque<valtype> stackStorage;
     opcodetype opcode;
     const std::vector<CTransactionRef> *blockTransactions;
     bool sender;
     dev::Address refundSender;
     unsigned int nFlags;
+    CContractOutputsRef contractOutputs;
 };
 
 class LastHashes: public dev::eth::LastBlockHashesFace
@@ -1101,16 +1545,31 @@ public:
     void clear();
 
 private:
-    dev::h256s m_lastHashes;
+    std::shared_ptr<const dev::h256s> m_lastHashes;
 };
 
+/**
+ * Executes the contract transactions of one block transaction against globalState.
+ *
+ * Execution is strictly sequential and must stay so until the state gains isolated overlays:
+ * every receipt records the state and UTXO roots reached after its transaction, the seal
+ * engine's deleteAddresses set accumulates the senders and block author of all previous
+ * transactions and is applied on each commit, and condensing transactions spend the UTXO
+ * state left behind by the transaction before them.
+ */
 class ByteCodeExec {
 
 public:
 
-    ByteCodeExec(const CBlock& _block, std::vector<QtumTransaction> _txs, const uint64_t _blockGasLimit, CBlockIndex* _pindex) : txs(_txs), block(_block), blockGasLimit(_blockGasLimit), pindex(_pindex) {}
+    /** Without a context the executions are gated on the height of chainActive, which then needs cs_main */
+    ByteCodeExec(const CBlock& _block, std::vector<QtumTransaction> _txs, const uint64_t _blockGasLimit, CBlockIndex* _pindex, QtumState* _state = nullptr, dev::eth::SealEngineFace* _sealEngine = nullptr, const QtumExecutionContext* _context = nullptr) :
+        txs(_txs), block(_block), blockGasLimit(_blockGasLimit), pindex(_pindex),
+        state(_state ? _state : globalState.get()), sealEngine(_sealEngine ? _sealEngine : globalSealEngine.get()),
+        context(_context ? *_context : QtumExecutionContext(chainActive.Height())) {}
 
-    bool performByteCode(dev::eth::Permanence type = dev::eth::Permanence::Committed);
+    /** Execute the transactions. With fCommitDB unset the touched trie nodes stay in the state overlays
+     *  until the caller commits them, so that the executions of a whole block are written in one batch */
+    bool performByteCode(dev::eth::Permanence type = dev::eth::Permanence::Committed, bool fCommitDB = true);
 
     bool processingResults(ByteCodeExecResult& result);
 
@@ -1118,6 +1577,9 @@ public:
 
     std::map<dev::Address, CAmount> dividendByContract;
 
+    /** Profiler the executions are recorded to, set for the blocks connected with -contractprofile */
+    ContractProfiler* profiler = nullptr;
+
 private:
 
     dev::eth::EnvInfo BuildEVMEnvironment();
@@ -1134,6 +1596,13 @@ private:
 
     CBlockIndex* pindex;
 
+    /** State and seal engine to execute on, globalState and globalSealEngine unless overridden */
+    QtumState* state;
+
+    dev::eth::SealEngineFace* sealEngine;
+
+    const QtumExecutionContext context;
+
     LastHashes lastHashes;
 
 };
@@ -11,43 +11,74 @@
 #include <util/system.h>
 #include <validation.h>
 
+#include <algorithm>
 #include <list>
 #include <atomic>
 #include <future>
 #include <utility>
+#include <vector>
 
 #include <boost/signals2/signal.hpp>
 
-struct ValidationInterfaceConnections {
-    boost::signals2::scoped_connection UpdatedBlockTip;
-    boost::signals2::scoped_connection TransactionAddedToMempool;
-    boost::signals2::scoped_connection BlockConnected;
-    boost::signals2::scoped_connection BlockDisconnected;
-    boost::signals2::scoped_connection TransactionRemovedFromMempool;
-    boost::signals2::scoped_connection ChainStateFlushed;
-    boost::signals2::scoped_connection Broadcast;
-    boost::signals2::scoped_connection BlockChecked;
-    boost::signals2::scoped_connection NewPoWValidBlock;
+/**
+ * A registered interface with its own callback queue. Every subscriber sees the callbacks in the
+ * order they were generated, but a slow subscriber only holds up its own queue; the queues are
+ * serviced by all threads of the scheduler.
+ */
+struct ValidationInterfaceSubscriber {
+    CValidationInterface* const m_iface;
+    //! Cleared on unregistering, the callbacks still queued for the interface are then dropped
+    std::atomic<bool> m_connected{true};
+    SingleThreadedSchedulerClient m_queue;
+
+    ValidationInterfaceSubscriber(CValidationInterface* iface, CScheduler* pscheduler, CScheduler::Priority priority) : m_iface(iface), m_queue(pscheduler, priority) {}
 };
 
 struct MainSignalsInstance {
-    boost::signals2::signal<void (const CBlockIndex *, const CBlockIndex *, bool fInitialDownload)> UpdatedBlockTip;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionAddedToMempool;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &, const CBlockIndex *pindex, const std::vector<CTransactionRef>&)> BlockConnected;
-    boost::signals2::signal<void (const std::shared_ptr<const CBlock> &)> BlockDisconnected;
-    boost::signals2::signal<void (const CTransactionRef &)> TransactionRemovedFromMempool;
-    boost::signals2::signal<void (const CBlockLocator &)> ChainStateFlushed;
-    boost::signals2::signal<void (int64_t nBestBlockTime, CConnman* connman)> Broadcast;
-    boost::signals2::signal<void (const CBlock&, const CValidationState&)> BlockChecked;
-    boost::signals2::signal<void (const CBlockIndex *, const std::shared_ptr<const CBlock>&)> NewPoWValidBlock;
-
-    // We are not allowed to assume the scheduler only runs in one thread,
-    // but must ensure all callbacks happen in-order, so we end up creating
-    // our own queue here :(
+    CScheduler* m_pscheduler;
+
+    CCriticalSection m_cs_subscribers;
+    std::unordered_map<CValidationInterface*, std::shared_ptr<ValidationInterfaceSubscriber>> m_subscribers GUARDED_BY(m_cs_subscribers);
+    // The scheduler may still run the queue of an unregistered interface, so it is only freed
+    // with the instance, once the scheduler is stopped
+    std::vector<std::shared_ptr<ValidationInterfaceSubscriber>> m_retired GUARDED_BY(m_cs_subscribers);
+
+    // Runs the functions queued with CallFunctionInValidationInterfaceQueue while nothing is subscribed
     SingleThreadedSchedulerClient m_schedulerClient;
-    std::unordered_map<CValidationInterface*, ValidationInterfaceConnections> m_connMainSignals;
 
-    explicit MainSignalsInstance(CScheduler *pscheduler) : m_schedulerClient(pscheduler) {}
+    explicit MainSignalsInstance(CScheduler *pscheduler) : m_pscheduler(pscheduler), m_schedulerClient(pscheduler) {}
+
+    //! Queue a callback for every subscriber, in the same order on all queues
+    void Enqueue(const std::function<void (CValidationInterface&)>& func)
+    {
+        LOCK(m_cs_subscribers);
+        for (const auto& entry : m_subscribers) {
+            ValidationInterfaceSubscriber* subscriber = entry.second.get();
+            subscriber->m_queue.AddToProcessQueue([subscriber, func] {
+                if (subscriber->m_connected) func(*subscriber->m_iface);
+            });
+        }
+    }
+
+    //! Call every subscriber on this thread. The list is copied so no lock is held by the callbacks
+    void Call(const std::function<void (CValidationInterface&)>& func)
+    {
+        std::vector<std::shared_ptr<ValidationInterfaceSubscriber>> subscribers;
+        {
+            LOCK(m_cs_subscribers);
+            for (const auto& entry : m_subscribers)
+                subscribers.push_back(entry.second);
+        }
+        for (const auto& subscriber : subscribers) {
+            if (subscriber->m_connected) func(*subscriber->m_iface);
+        }
+    }
+
+    void Retire(std::shared_ptr<ValidationInterfaceSubscriber> subscriber) EXCLUSIVE_LOCKS_REQUIRED(m_cs_subscribers)
+    {
+        subscriber->m_connected = false;
+        m_retired.push_back(std::move(subscriber));
+    }
 };
 
 static CMainSignals g_signals;
@@ -68,13 +99,35 @@ void CMainSignals::UnregisterBackgroundSignalScheduler() {
 
 void CMainSignals::FlushBackgroundCallbacks() {
     if (m_internals) {
+        std::vector<std::shared_ptr<ValidationInterfaceSubscriber>> subscribers;
+        {
+            LOCK(m_internals->m_cs_subscribers);
+            for (const auto& entry : m_internals->m_subscribers)
+                subscribers.push_back(entry.second);
+            subscribers.insert(subscribers.end(), m_internals->m_retired.begin(), m_internals->m_retired.end());
+        }
+        for (const auto& subscriber : subscribers)
+            subscriber->m_queue.EmptyQueue();
         m_internals->m_schedulerClient.EmptyQueue();
     }
 }
 
 size_t CMainSignals::CallbacksPending() {
     if (!m_internals) return 0;
-    return m_internals->m_schedulerClient.CallbacksPending();
+    size_t nDeepest = m_internals->m_schedulerClient.CallbacksPending();
+    LOCK(m_internals->m_cs_subscribers);
+    for (const auto& entry : m_internals->m_subscribers)
+        nDeepest = std::max(nDeepest, entry.second->m_queue.CallbacksPending());
+    return nDeepest;
+}
+
+size_t CMainSignals::CallbacksPendingTotal() {
+    if (!m_internals) return 0;
+    size_t nTotal = m_internals->m_schedulerClient.CallbacksPending();
+    LOCK(m_internals->m_cs_subscribers);
+    for (const auto& entry : m_internals->m_subscribers)
+        nTotal += entry.second->m_queue.CallbacksPending();
+    return nTotal;
 }
 
 void CMainSignals::RegisterWithMempoolSignals(CTxMemPool& pool) {
@@ -93,22 +146,25 @@ CMainSignals& GetMainSignals()
     return g_signals;
 }
 
-void RegisterValidationInterface(CValidationInterface* pwalletIn) {
-    ValidationInterfaceConnections& conns = g_signals.m_internals->m_connMainSignals[pwalletIn];
-    conns.UpdatedBlockTip = g_signals.m_internals->UpdatedBlockTip.connect(std::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-    conns.TransactionAddedToMempool = g_signals.m_internals->TransactionAddedToMempool.connect(std::bind(&CValidationInterface::TransactionAddedToMempool, pwalletIn, std::placeholders::_1));
-    conns.BlockConnected = g_signals.m_internals->BlockConnected.connect(std::bind(&CValidationInterface::BlockConnected, pwalletIn, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
-    conns.BlockDisconnected = g_signals.m_internals->BlockDisconnected.connect(std::bind(&CValidationInterface::BlockDisconnected, pwalletIn, std::placeholders::_1));
-    conns.TransactionRemovedFromMempool = g_signals.m_internals->TransactionRemovedFromMempool.connect(std::bind(&CValidationInterface::TransactionRemovedFromMempool, pwalletIn, std::placeholders::_1));
-    conns.ChainStateFlushed = g_signals.m_internals->ChainStateFlushed.connect(std::bind(&CValidationInterface::ChainStateFlushed, pwalletIn, std::placeholders::_1));
-    conns.Broadcast = g_signals.m_internals->Broadcast.connect(std::bind(&CValidationInterface::ResendWalletTransactions, pwalletIn, std::placeholders::_1, std::placeholders::_2));
-    conns.BlockChecked = g_signals.m_internals->BlockChecked.connect(std::bind(&CValidationInterface::BlockChecked, pwalletIn, std::placeholders::_1, std::placeholders::_2));
-    conns.NewPoWValidBlock = g_signals.m_internals->NewPoWValidBlock.connect(std::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, std::placeholders::_1, std::placeholders::_2));
+void RegisterValidationInterface(CValidationInterface* pwalletIn, bool fHighPriority) {
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_cs_subscribers);
+    std::shared_ptr<ValidationInterfaceSubscriber>& subscriber = internals.m_subscribers[pwalletIn];
+    if (subscriber) {
+        internals.Retire(std::move(subscriber));
+    }
+    subscriber = std::make_shared<ValidationInterfaceSubscriber>(pwalletIn, internals.m_pscheduler, fHighPriority ? CScheduler::PRIORITY_HIGH : CScheduler::PRIORITY_NORMAL);
 }
 
 void UnregisterValidationInterface(CValidationInterface* pwalletIn) {
     if (g_signals.m_internals) {
-        g_signals.m_internals->m_connMainSignals.erase(pwalletIn);
+        MainSignalsInstance& internals = *g_signals.m_internals;
+        LOCK(internals.m_cs_subscribers);
+        auto it = internals.m_subscribers.find(pwalletIn);
+        if (it != internals.m_subscribers.end()) {
+            internals.Retire(std::move(it->second));
+            internals.m_subscribers.erase(it);
+        }
     }
 }
 
@@ -116,11 +172,25 @@ void UnregisterAllValidationInterfaces() {
     if (!g_signals.m_internals) {
         return;
     }
-    g_signals.m_internals->m_connMainSignals.clear();
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_cs_subscribers);
+    for (auto& entry : internals.m_subscribers)
+        internals.Retire(std::move(entry.second));
+    internals.m_subscribers.clear();
 }
 
 void CallFunctionInValidationInterfaceQueue(std::function<void ()> func) {
-    g_signals.m_internals->m_schedulerClient.AddToProcessQueue(std::move(func));
+    // func runs once every queue is past the callbacks queued before it, on the thread of the last one
+    MainSignalsInstance& internals = *g_signals.m_internals;
+    LOCK(internals.m_cs_subscribers);
+    auto remaining = std::make_shared<std::atomic<size_t>>(internals.m_subscribers.size() + 1);
+    auto shared_func = std::make_shared<std::function<void ()>>(std::move(func));
+    auto barrier = [remaining, shared_func] {
+        if (--*remaining == 0) (*shared_func)();
+    };
+    internals.m_schedulerClient.AddToProcessQueue(barrier);
+    for (const auto& entry : internals.m_subscribers)
+        entry.second->m_queue.AddToProcessQueue(barrier);
 }
 
 void SyncWithValidationInterfaceQueue() {
@@ -135,8 +205,8 @@ void SyncWithValidationInterfaceQueue() {
 
 void CMainSignals::MempoolEntryRemoved(CTransactionRef ptx, MemPoolRemovalReason reason) {
     if (reason != MemPoolRemovalReason::BLOCK && reason != MemPoolRemovalReason::CONFLICT) {
-        m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-            m_internals->TransactionRemovedFromMempool(ptx);
+        m_internals->Enqueue([ptx](CValidationInterface& iface) {
+            iface.TransactionRemovedFromMempool(ptx);
         });
     }
 }
@@ -146,43 +216,49 @@ void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockInd
     // the chain actually updates. One way to ensure this is for the caller to invoke this signal
     // in the same critical section where the chain is updated
 
-    m_internals->m_schedulerClient.AddToProcessQueue([pindexNew, pindexFork, fInitialDownload, this] {
-        m_internals->UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
+    m_internals->Enqueue([pindexNew, pindexFork, fInitialDownload](CValidationInterface& iface) {
+        iface.UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
     });
 }
 
 void CMainSignals::TransactionAddedToMempool(const CTransactionRef &ptx) {
-    m_internals->m_schedulerClient.AddToProcessQueue([ptx, this] {
-        m_internals->TransactionAddedToMempool(ptx);
+    m_internals->Enqueue([ptx](CValidationInterface& iface) {
+        iface.TransactionAddedToMempool(ptx);
     });
 }
 
 void CMainSignals::BlockConnected(const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex, const std::shared_ptr<const std::vector<CTransactionRef>>& pvtxConflicted) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, pindex, pvtxConflicted, this] {
-        m_internals->BlockConnected(pblock, pindex, *pvtxConflicted);
+    m_internals->Enqueue([pblock, pindex, pvtxConflicted](CValidationInterface& iface) {
+        iface.BlockConnected(pblock, pindex, *pvtxConflicted);
     });
 }
 
 void CMainSignals::BlockDisconnected(const std::shared_ptr<const CBlock> &pblock) {
-    m_internals->m_schedulerClient.AddToProcessQueue([pblock, this] {
-        m_internals->BlockDisconnected(pblock);
+    m_internals->Enqueue([pblock](CValidationInterface& iface) {
+        iface.BlockDisconnected(pblock);
     });
 }
 
 void CMainSignals::ChainStateFlushed(const CBlockLocator &locator) {
-    m_internals->m_schedulerClient.AddToProcessQueue([locator, this] {
-        m_internals->ChainStateFlushed(locator);
+    m_internals->Enqueue([locator](CValidationInterface& iface) {
+        iface.ChainStateFlushed(locator);
     });
 }
 
 void CMainSignals::Broadcast(int64_t nBestBlockTime, CConnman* connman) {
-    m_internals->Broadcast(nBestBlockTime, connman);
+    m_internals->Call([nBestBlockTime, connman](CValidationInterface& iface) {
+        iface.ResendWalletTransactions(nBestBlockTime, connman);
+    });
 }
 
 void CMainSignals::BlockChecked(const CBlock& block, const CValidationState& state) {
-    m_internals->BlockChecked(block, state);
+    m_internals->Call([&block, &state](CValidationInterface& iface) {
+        iface.BlockChecked(block, state);
+    });
 }
 
 void CMainSignals::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &block) {
-    m_internals->NewPoWValidBlock(pindex, block);
+    m_internals->Call([pindex, &block](CValidationInterface& iface) {
+        iface.NewPoWValidBlock(pindex, block);
+    });
 }
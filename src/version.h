@@ -9,7 +9,7 @@
  * network protocol versioning
  */
 
-static const int PROTOCOL_VERSION = 70024;
+static const int PROTOCOL_VERSION = 70026;
 
 //! initial proto version, to be increased after version/verack negotiation
 static const int INIT_PROTO_VERSION = 209;
@@ -66,4 +66,10 @@ static const int SHORT_IDS_BLOCKS_VERSION = 70014;
 //! not banning for invalid compact blocks starts with this version
 static const int INVALID_CB_NO_BAN_VERSION = 70015;
 
+//! "sendheaders2" and "headers2" start with this version
+static const int COMPACT_HEADERS_VERSION = 70025;
+
+//! "sendrecon", "reqrecon", "sketch" and "reconcildiff" start with this version
+static const int TXRECONCILIATION_VERSION = 70026;
+
 #endif // BITCOIN_VERSION_H
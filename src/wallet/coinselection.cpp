@@ -291,6 +291,52 @@ bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& group
     return true;
 }
 
+static bool LowerValue(const OutputGroup& group, const CAmount& value)
+{
+    return group.m_value < value;
+}
+
+// Smallest group in the value sorted range paying the target exactly or leaving at least MIN_CHANGE,
+// or else the smallest one that pays the target
+static std::vector<OutputGroup>::iterator FindCoveringGroup(std::vector<OutputGroup>::iterator begin, std::vector<OutputGroup>::iterator end, const CAmount& nTargetValue)
+{
+    std::vector<OutputGroup>::iterator it = std::lower_bound(begin, end, nTargetValue, LowerValue);
+    if (it != end && it->m_value != nTargetValue) {
+        std::vector<OutputGroup>::iterator with_change = std::lower_bound(it, end, nTargetValue + MIN_CHANGE, LowerValue);
+        if (with_change != end) it = with_change;
+    }
+    return it;
+}
+
+bool SelectCoinsSorted(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet)
+{
+    setCoinsRet.clear();
+    nValueRet = 0;
+
+    std::sort(groups.begin(), groups.end(), [](const OutputGroup& a, const OutputGroup& b) {
+        return a.m_value < b.m_value;
+    });
+
+    // Every input adds to the size the byte price is paid for, so take the largest groups until the
+    // rest can be paid by a single smaller group
+    std::vector<OutputGroup>::iterator end = groups.end();
+    while (end != groups.begin()) {
+        std::vector<OutputGroup>::iterator it = FindCoveringGroup(groups.begin(), end, nTargetValue - nValueRet);
+        if (it != end) {
+            util::insert(setCoinsRet, it->m_outputs);
+            nValueRet += it->m_value;
+            return true;
+        }
+        --end;
+        util::insert(setCoinsRet, end->m_outputs);
+        nValueRet += end->m_value;
+    }
+
+    setCoinsRet.clear();
+    nValueRet = 0;
+    return false;
+}
+
 /******************************************************************************
 
  OutputGroup
@@ -13,6 +13,8 @@
 static constexpr CAmount MIN_CHANGE{COIN / 100};
 //! final minimum change amount after paying for fees
 static const CAmount MIN_FINAL_CHANGE = MIN_CHANGE/2;
+//! largest pool the knapsack solver is used for, larger pools are selected by sorted value
+static const size_t MAX_KNAPSACK_GROUPS = 5000;
 
 class CInputCoin {
 public:
@@ -98,4 +100,7 @@ bool SelectCoinsBnB(std::vector<OutputGroup>& utxo_pool, const CAmount& target_v
 // Original coin selection algorithm as a fallback
 bool KnapsackSolver(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet);
 
+// Selection by sorted value for large pools, picks as few groups as possible in O(n log n)
+bool SelectCoinsSorted(const CAmount& nTargetValue, std::vector<OutputGroup>& groups, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet);
+
 #endif // BITCOIN_WALLET_COINSELECTION_H
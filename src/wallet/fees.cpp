@@ -106,3 +106,12 @@ CFeeRate GetDiscardRate(const CWallet& wallet, const CBlockPolicyEstimator& esti
     //return discard_rate;
     return CFeeRate(10000);
 }
+
+CAmount GetContractGasPrice(const CWallet& wallet, const CBlockPolicyEstimator& estimator, CAmount defaultGasPrice, CAmount gasPriceBuffer)
+{
+    CAmount estimate = estimator.estimateGasPrice(wallet.m_confirm_target, nullptr);
+    if (estimate <= 0) {
+        return defaultGasPrice + gasPriceBuffer;
+    }
+    return std::max(estimate, defaultGasPrice);
+}
@@ -44,4 +44,11 @@ CFeeRate GetMinimumFeeRate(const CWallet& wallet, const CCoinControl& coin_contr
  */
 CFeeRate GetDiscardRate(const CWallet& wallet, const CBlockPolicyEstimator& estimator);
 
+/**
+ * Return the gas price to budget for the contract outputs of a tx: the gas price
+ * estimated for the wallet confirmation target, not below the current gas price,
+ * or the current gas price with its buffer when there is no estimate
+ */
+CAmount GetContractGasPrice(const CWallet& wallet, const CBlockPolicyEstimator& estimator, CAmount defaultGasPrice, CAmount gasPriceBuffer);
+
 #endif // BITCOIN_WALLET_FEES_H
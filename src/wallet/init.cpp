@@ -53,6 +53,8 @@ void WalletInit::AddWalletOptions() const
     gArgs.AddArg("-paytxfee=<amt>", strprintf("Fee (in %s/kB) to add to transactions you send (default: %s)",
                                                             CURRENCY_UNIT, FormatMoney(CFeeRate{DEFAULT_PAY_TX_FEE}.GetFeePerK())), false, OptionsCategory::WALLET);
     gArgs.AddArg("-rescan", "Rescan the block chain for missing wallet transactions on startup", false, OptionsCategory::WALLET);
+    gArgs.AddArg("-rescanaddressindex", strprintf("Use the address index to read only the blocks that touch wallet addresses during a rescan, outputs without an address are not found (default: %u)", DEFAULT_RESCAN_ADDRESS_INDEX), false, OptionsCategory::WALLET);
+    gArgs.AddArg("-rescanthreads=<n>", strprintf("Set the number of threads reading and matching blocks during a rescan (up to %d, 0 = auto, <0 = leave that many cores free, default: %d)", MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS), false, OptionsCategory::WALLET);
     gArgs.AddArg("-salvagewallet", "Attempt to recover private keys from a corrupt wallet on startup", false, OptionsCategory::WALLET);
     gArgs.AddArg("-spendzeroconfchange", strprintf("Spend unconfirmed change when sending transactions (default: %u)", DEFAULT_SPEND_ZEROCONF_CHANGE), false, OptionsCategory::WALLET);
     gArgs.AddArg("-txconfirmtarget=<n>", strprintf("If paytxfee is not set, include enough fee so transactions begin confirmation on average within n blocks (default: %u)", DEFAULT_TX_CONFIRM_TARGET), false, OptionsCategory::WALLET);
@@ -77,6 +79,8 @@ void WalletInit::AddWalletOptions() const
     gArgs.AddArg("-stakingminfee=<n>", strprintf("The min fee (in percentage) to accept when super staking (default: %u)", DEFAULT_STAKING_MIN_FEE), false, OptionsCategory::WALLET);
     gArgs.AddArg("-superstaking=<true/false>", strprintf("Enables or disables super staking (default: %u)", DEFAULT_SUPER_STAKE), false, OptionsCategory::WALLET);
     gArgs.AddArg("-minstakerutxosize=<amt>", strprintf("The min value of utxo (in %s) selected for staking (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_STAKER_MIN_UTXO_SIZE)), false, OptionsCategory::WALLET);
+    gArgs.AddArg("-stakingledger", strprintf("Run the wallet as a super staker ledger that stakes the delegated coins read from the address index without loading or tracking wallet transactions (default: %u)", DEFAULT_STAKING_LEDGER), false, OptionsCategory::WALLET);
+    gArgs.AddArg("-stakingsignthreads=<n>", strprintf("Set the number of threads signing the inputs of a coinstake (up to %d, 0 = auto, <0 = leave that many cores free, default: %d)", MAX_STAKING_SIGN_THREADS, DEFAULT_STAKING_SIGN_THREADS), false, OptionsCategory::WALLET);
     gArgs.AddArg("-maxstakerutxoscriptcache=<n>", strprintf("Set max staker utxo script cache for staking (default: %d)", DEFAULT_STAKER_MAX_UTXO_SCRIPT_CACHE), false, OptionsCategory::WALLET);
     gArgs.AddArg("-maxstakerwaitforbestheader=<n>", strprintf("Set max staker wait for best header in milliseconds (default: %d)", DEFAULT_MAX_STAKER_WAIT_FOR_BEST_BLOCK_HEADER), false, OptionsCategory::WALLET);
 }
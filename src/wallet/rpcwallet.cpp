@@ -40,6 +40,7 @@
 #include <validation.h>
 #include <wallet/coincontrol.h>
 #include <wallet/feebumper.h>
+#include <wallet/fees.h>
 #include <wallet/psbtwallet.h>
 #include <wallet/rpcwallet.h>
 #include <wallet/wallet.h>
@@ -814,7 +815,7 @@ static UniValue createcontract(const JSONRPCRequest& request)
     Dgp dgp;
     CAmount gasPriceBuffer;
     dgp.calculateGasPriceBuffer(defaultGasPrice, gasPriceBuffer);
-    CAmount nGasPrice = gasPriceBuffer + defaultGasPrice;
+    CAmount nGasPrice = GetContractGasPrice(*pwallet, ::feeEstimator, defaultGasPrice, gasPriceBuffer);
 
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 6)
         throw std::runtime_error(
@@ -1039,7 +1040,7 @@ UniValue SendToContract(interfaces::Chain::Lock& locked_chain, CWallet* const pw
     Dgp dgp;
     CAmount gasPriceBuffer;
     dgp.calculateGasPriceBuffer(defaultGasPrice, gasPriceBuffer);
-    CAmount nGasPrice = gasPriceBuffer + defaultGasPrice;
+    CAmount nGasPrice = GetContractGasPrice(*pwallet, ::feeEstimator, defaultGasPrice, gasPriceBuffer);
 
     std::string contractaddress = params[0].get_str();
 
@@ -574,6 +574,40 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(sorted_selection_test)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+    std::vector<CInputCoin> utxo_pool;
+
+    for (int i = 1; i <= 10; i++)
+        add_coin(i * COIN, i, utxo_pool);
+
+    // Exact match
+    BOOST_CHECK(SelectCoinsSorted(4 * COIN, GroupCoins(utxo_pool), setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 4 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+    // Smallest single coin leaving change
+    BOOST_CHECK(SelectCoinsSorted(4.5 * COIN, GroupCoins(utxo_pool), setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+    // Largest coins first, the rest paid by the smallest covering coin
+    BOOST_CHECK(SelectCoinsSorted(21.5 * COIN, GroupCoins(utxo_pool), setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 22 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 3U);
+
+    // Everything
+    BOOST_CHECK(SelectCoinsSorted(55 * COIN, GroupCoins(utxo_pool), setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 55 * COIN);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 10U);
+
+    // Not enough
+    BOOST_CHECK(!SelectCoinsSorted(56 * COIN, GroupCoins(utxo_pool), setCoinsRet, nValueRet));
+    BOOST_CHECK(setCoinsRet.empty());
+}
+
 // Tests that with the ideal conditions, the coin selector will always be able to find a solution that can pay the target value
 BOOST_AUTO_TEST_CASE(SelectCoins_test)
 {
@@ -117,6 +117,39 @@ BOOST_FIXTURE_TEST_CASE(scan_for_wallet_transactions, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(scan_for_wallet_transactions_threads, TestChain100Setup)
+{
+    auto chain = interfaces::MakeChain();
+
+    LockAnnotation lock(::cs_main);
+    auto locked_chain = chain->lock();
+
+    // Reading the blocks inline, on helper threads or through the address index finds the same outputs
+    CAmount expected = -1;
+    for (const std::string& threads : {"1", "4"}) {
+        for (const std::string& use_index : {"0", "1"}) {
+            gArgs.ForceSetArg("-rescanthreads", threads);
+            gArgs.ForceSetArg("-rescanaddressindex", use_index);
+            CWallet wallet(*chain, WalletLocation(), WalletDatabase::CreateDummy());
+            AddKey(wallet, coinbaseKey);
+            WalletRescanReserver reserver(&wallet);
+            reserver.reserve();
+            CWallet::ScanResult result = wallet.ScanForWalletTransactions(chainActive.Genesis()->GetBlockHash(), {} /* stop_block */, reserver, false /* update */);
+            BOOST_CHECK_EQUAL(result.status, CWallet::ScanResult::SUCCESS);
+            BOOST_CHECK(result.last_failed_block.IsNull());
+            BOOST_CHECK_EQUAL(result.last_scanned_block, chainActive.Tip()->GetBlockHash());
+            BOOST_CHECK_EQUAL(*result.last_scanned_height, chainActive.Height());
+            if (expected < 0) {
+                expected = wallet.GetImmatureBalance();
+                BOOST_CHECK(expected > 0);
+            }
+            BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), expected);
+        }
+    }
+    gArgs.ForceSetArg("-rescanthreads", std::to_string(DEFAULT_RESCAN_THREADS));
+    gArgs.ForceSetArg("-rescanaddressindex", std::to_string(DEFAULT_RESCAN_ADDRESS_INDEX));
+}
+
 BOOST_FIXTURE_TEST_CASE(importmulti_rescan, TestChain100Setup)
 {
     auto chain = interfaces::MakeChain();
@@ -275,7 +308,7 @@ static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64
     if (blockTime > 0) {
         LockAnnotation lock(::cs_main);
         auto locked_chain = wallet.chain().lock();
-        auto inserted = mapBlockIndex.emplace(GetRandHash(), new CBlockIndex);
+        auto inserted = mapBlockIndex.emplace(GetRandHash(), g_block_index_arena.New());
         assert(inserted.second);
         const uint256& hash = inserted.first->first;
         block = inserted.first->second;
@@ -337,6 +370,45 @@ BOOST_AUTO_TEST_CASE(LoadReceiveRequests)
     BOOST_CHECK_EQUAL(values[1], "val_rr1");
 }
 
+BOOST_AUTO_TEST_CASE(GetTokenTxEntries)
+{
+    auto token_tx = [](const std::string& contract, const std::string& sender, const std::string& receiver, int64_t height) {
+        CTokenTx tokenTx;
+        tokenTx.strContractAddress = contract;
+        tokenTx.strSenderAddress = sender;
+        tokenTx.strReceiverAddress = receiver;
+        tokenTx.blockNumber = height;
+        return tokenTx;
+    };
+    LOCK(m_wallet.cs_wallet);
+    m_wallet.LoadTokenTx(token_tx("c1", "a", "b", 30));
+    m_wallet.LoadTokenTx(token_tx("c1", "b", "c", 10));
+    m_wallet.LoadTokenTx(token_tx("c1", "c", "d", 20));
+    m_wallet.LoadTokenTx(token_tx("c2", "a", "b", 5));
+
+    auto entries = m_wallet.GetTokenTxEntries("c1");
+    BOOST_CHECK_EQUAL(entries.size(), 3U);
+    BOOST_CHECK_EQUAL(entries[0].blockNumber, 10);
+    BOOST_CHECK_EQUAL(entries[1].blockNumber, 20);
+    BOOST_CHECK_EQUAL(entries[2].blockNumber, 30);
+
+    entries = m_wallet.GetTokenTxEntries("c1", "b");
+    BOOST_CHECK_EQUAL(entries.size(), 2U);
+    BOOST_CHECK_EQUAL(entries[0].blockNumber, 10);
+    BOOST_CHECK_EQUAL(entries[1].blockNumber, 30);
+
+    // Reloading an entry at another height moves it in the order
+    CTokenTx moved = token_tx("c1", "b", "c", 10);
+    moved.blockNumber = 40;
+    m_wallet.LoadTokenTx(moved);
+    entries = m_wallet.GetTokenTxEntries("c1", "c");
+    BOOST_CHECK_EQUAL(entries.size(), 2U);
+    BOOST_CHECK_EQUAL(entries[0].blockNumber, 20);
+    BOOST_CHECK_EQUAL(entries[1].blockNumber, 40);
+
+    BOOST_CHECK(m_wallet.GetTokenTxEntries("c2", "c").empty());
+}
+
 class ListCoinsTestingSetup : public TestChain100Setup
 {
 public:
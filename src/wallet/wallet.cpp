@@ -36,10 +36,13 @@
 #include <miner.h>
 #include <locktrip/price-oracle.h>
 #include <locktrip/lydra.h>
+#include <rpc/contract_util.h>
 
 #include <algorithm>
 #include <assert.h>
 #include <future>
+#include <thread>
+#include <tuple>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -571,6 +574,11 @@ bool CWallet::ChangeWalletPassphrase(const SecureString& strOldWalletPassphrase,
 
 void CWallet::ChainStateFlushed(const CBlockLocator& loc)
 {
+    // Keep the best block of the last full wallet run, so the wallet transactions missed
+    // while running as a staking ledger are found again by the startup rescan
+    if (m_staking_ledger)
+        return;
+
     WalletBatch batch(*database);
     batch.WriteBestBlock(loc);
 }
@@ -1138,6 +1146,8 @@ void CWallet::LoadToWallet(const CWalletTx& wtxIn)
         wtx.m_it_wtxOrdered = wtxOrdered.insert(std::make_pair(wtx.nOrderPos, &wtx));
     }
     AddToSpends(hash);
+    setStakeCandidates.insert(hash);
+    setCoinCandidates.insert(hash);
     for (const CTxIn& txin : wtx.tx->vin) {
         auto it = mapWallet.find(txin.prevout.hash);
         if (it != mapWallet.end()) {
@@ -1155,6 +1165,9 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransactionRef& ptx, const uint256
     {
         AssertLockHeld(cs_wallet);
 
+        if (m_staking_ledger)
+            return false;
+
         if (!block_hash.IsNull()) {
             for (const CTxIn& txin : tx.vin) {
                 std::pair<TxSpends::const_iterator, TxSpends::const_iterator> range = mapTxSpends.equal_range(txin.prevout);
@@ -1392,6 +1405,7 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
         SyncTransaction(pblock->vtx[i], pindex->GetBlockHash(), i);
         TransactionRemovedFromMempool(pblock->vtx[i]);
     }
+    SyncTokenTransfers(*pblock, pindex);
 
     m_last_block_processed = pindex->GetBlockHash();
 }
@@ -1404,6 +1418,18 @@ void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock) {
         int posInBlock = ptx->IsCoinStake() ? -1 : 0;
         SyncTransaction(ptx, {} /* block hash */, posInBlock /* position in block */);
     }
+
+    // The receipts of the block are gone by now, so a balance that includes it is seeded again
+    WalletBatch batch(*database, "r+", false);
+    uint256 blockHash = pblock->GetHash();
+    for (auto& item : mapToken) {
+        CTokenInfo& token = item.second;
+        if (token.balanceBlockHash == blockHash) {
+            token.balanceBlockHash.SetNull();
+            batch.WriteToken(token);
+            NotifyTokenBalanceChanged(this, item.first);
+        }
+    }
 }
 
 
@@ -1871,11 +1897,134 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+namespace {
+//! Blocks read and matched ahead of the one being applied
+const size_t RESCAN_CHUNK_BLOCKS = 64;
+
+//! A block of a rescan chunk, read and matched on the helper threads
+struct RescanBlock
+{
+    uint256 hash;
+    int height = 0;
+    CDiskBlockPos pos;
+    CBlock block;
+    bool read = false;
+    //! Per transaction whether one of its outputs is mine, spends are matched in block order
+    std::vector<bool> mine;
+};
+
+struct RescanChunk
+{
+    std::vector<RescanBlock> blocks;
+    //! Last block the chunk covers, including the ones the address index lets it skip
+    uint256 last_hash;
+    int last_height = -1;
+    //! Size of the key store when the chunk was planned, the outputs were matched against at least that
+    size_t keystore_size = 0;
+};
+
+//! Read the blocks of a chunk and match their outputs against the wallet keys on up to the given threads
+void ReadRescanChunk(const CWallet& wallet, RescanChunk& chunk, int threads)
+{
+    std::atomic<size_t> next{0};
+    auto work = [&wallet, &chunk, &next] {
+        const Consensus::Params& consensusParams = Params().GetConsensus();
+        for (size_t i = next++; i < chunk.blocks.size(); i = next++) {
+            RescanBlock& item = chunk.blocks[i];
+            if (item.pos.IsNull() || !ReadBlockFromDisk(item.block, item.pos, consensusParams) || item.block.GetHash() != item.hash) {
+                item.block.SetNull();
+                continue;
+            }
+            item.read = true;
+            item.mine.resize(item.block.vtx.size());
+            for (size_t posInBlock = 0; posInBlock < item.block.vtx.size(); ++posInBlock) {
+                item.mine[posInBlock] = wallet.IsMine(*item.block.vtx[posInBlock]);
+            }
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    for (int i = 1; i < threads && (size_t)i < chunk.blocks.size(); i++) {
+        helpers.emplace_back(work);
+    }
+    work();
+    for (std::thread& helper : helpers) {
+        helper.join();
+    }
+}
+} // namespace
+
+size_t CWallet::GetKeyStoreSize() const
+{
+    LOCK(cs_KeyStore);
+    return mapKeys.size() + mapCryptedKeys.size() + mapWatchKeys.size() + mapScripts.size() + setWatchOnly.size();
+}
+
+std::set<std::pair<uint256, int>> CWallet::GetAddressIndexKeys() const
+{
+    std::vector<CTxDestination> dests;
+    {
+        LOCK(cs_KeyStore);
+        auto add_key = [&dests](const CKeyID& keyid) {
+            dests.push_back(keyid);
+            dests.push_back(WitnessV0KeyHash(keyid));
+        };
+        for (const auto& item : mapKeys) add_key(item.first);
+        for (const auto& item : mapCryptedKeys) add_key(item.first);
+        for (const auto& item : mapWatchKeys) add_key(item.first);
+        for (const auto& item : mapScripts) {
+            dests.push_back(item.first);
+            dests.push_back(WitnessV0ScriptHash(item.second));
+        }
+        for (const CScript& script : setWatchOnly) {
+            CTxDestination dest;
+            if (ExtractDestination(script, dest)) {
+                dests.push_back(dest);
+            }
+        }
+    }
+
+    // Keyed the way ConnectBlock writes the address index
+    std::set<std::pair<uint256, int>> keys;
+    for (const CTxDestination& dest : dests) {
+        valtype bytesID(boost::apply_visitor(DataVisitor(), dest));
+        if (bytesID.empty() || bytesID.size() > 32) {
+            continue;
+        }
+        valtype addressBytes(32);
+        std::copy(bytesID.begin(), bytesID.end(), addressBytes.begin());
+        keys.emplace(uint256(addressBytes), dest.which());
+    }
+    return keys;
+}
+
+bool CWallet::IsRescanSpend(const CTransaction& tx) const
+{
+    AssertLockHeld(cs_wallet);
+
+    // What AddToWalletIfInvolvingMe looks at besides the outputs: known transactions, debits and conflicts
+    if (mapWallet.count(tx.GetHash())) {
+        return true;
+    }
+    for (const CTxIn& txin : tx.vin) {
+        if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * Scan the block chain (starting in start_block) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  *
+ * The blocks are read and their outputs matched on -rescanthreads helper
+ * threads a chunk ahead of the block being applied, and the matches are
+ * applied in block order so that spends find the outputs received before
+ * them. With -rescanaddressindex only the blocks that touch a wallet
+ * destination in the address index are read.
+ *
  * @param[in] start_block Scan starting block. If block is not on the active
  *                        chain, the scan will return SUCCESS immediately.
  * @param[in] stop_block  Scan ending block. If block is not on the active
@@ -1909,6 +2058,7 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
         uint256 tip_hash;
         // The way the 'block_height' is initialized is just a workaround for the gcc bug #47679 since version 4.6.0.
         Optional<int> block_height = MakeOptional(false, int());
+        Optional<int> stop_height = MakeOptional(false, int());
         double progress_begin;
         double progress_end;
         {
@@ -1917,21 +2067,156 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
                 tip_hash = locked_chain->getBlockHash(*tip_height);
             }
             block_height = locked_chain->getBlockHeight(block_hash);
+            if (!stop_block.IsNull()) {
+                stop_height = locked_chain->getBlockHeight(stop_block);
+            }
             progress_begin = chain().guessVerificationProgress(block_hash);
             progress_end = chain().guessVerificationProgress(stop_block.IsNull() ? tip_hash : stop_block);
         }
         double progress_current = progress_begin;
-        while (block_height && !fAbortRescan && !ShutdownRequested()) {
-            if (*block_height % 100 == 0 && progress_end - progress_begin > 0.0) {
-                ShowProgress(strprintf("%s " + _("Rescanning..."), GetDisplayName()), std::max(1, std::min(99, (int)((progress_current - progress_begin) / (progress_end - progress_begin) * 100))));
+
+        int threads = gArgs.GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+        if (threads <= 0) {
+            threads += GetNumCores();
+        }
+        threads = std::max(1, std::min(threads, MAX_RESCAN_THREADS));
+
+        // Heights at which the address index has activity for the destinations queried so far, up to index_end
+        bool use_index = fAddressIndex && gArgs.GetBoolArg("-rescanaddressindex", DEFAULT_RESCAN_ADDRESS_INDEX);
+        std::set<std::pair<uint256, int>> index_keys;
+        std::set<int> index_heights;
+        int index_end = -1;
+        auto query_index = [&index_heights](const std::pair<uint256, int>& key, int from_height, int to_height) {
+            CAddressIndexRange range;
+            range.start = from_height;
+            range.end = to_height;
+            std::vector<std::pair<CAddressIndexKey, CAmount>> entries;
+            if (GetAddressIndex(key.first, key.second, range, entries)) {
+                for (const auto& entry : entries) {
+                    index_heights.insert(entry.first.blockHeight);
+                }
+            }
+        };
+        auto learn_index_keys = [&](int from_height) {
+            for (const auto& key : GetAddressIndexKeys()) {
+                if (index_keys.insert(key).second && index_end >= from_height) {
+                    query_index(key, from_height, index_end);
+                }
+            }
+        };
+
+        // Take the next blocks of the active chain after prev_hash, false once the scan is complete
+        auto plan_chunk = [&](int height, const uint256& prev_hash, RescanChunk& chunk) {
+            chunk = RescanChunk();
+            auto locked_chain = chain().lock();
+            Optional<int> tip_height = locked_chain->getHeight();
+            if (!tip_height || (!prev_hash.IsNull() && !locked_chain->getBlockHeight(prev_hash))) {
+                // previous block is no longer on the chain due to a reorg
+                return false;
+            }
+            const uint256 prev_tip_hash = tip_hash;
+            tip_hash = locked_chain->getBlockHash(*tip_height);
+            if (stop_block.IsNull() && prev_tip_hash != tip_hash) {
+                // in case the tip has changed, update progress max
+                progress_end = chain().guessVerificationProgress(tip_hash);
+            }
+            int end_height = stop_height ? std::min(*stop_height, *tip_height) : *tip_height;
+            if (height > end_height) {
+                return false;
+            }
+
+            chunk.keystore_size = GetKeyStoreSize();
+            std::vector<int> heights;
+            if (use_index) {
+                if (index_end < end_height) {
+                    learn_index_keys(height);
+                    for (const auto& key : index_keys) {
+                        query_index(key, std::max(index_end + 1, height), end_height);
+                    }
+                    index_end = end_height;
+                }
+                for (auto it = index_heights.lower_bound(height); it != index_heights.end() && *it <= end_height && heights.size() < RESCAN_CHUNK_BLOCKS; ++it) {
+                    heights.push_back(*it);
+                }
+                chunk.last_height = heights.size() < RESCAN_CHUNK_BLOCKS ? end_height : heights.back();
+            } else {
+                chunk.last_height = std::min<int>(end_height, height + RESCAN_CHUNK_BLOCKS - 1);
+                for (int h = height; h <= chunk.last_height; h++) {
+                    heights.push_back(h);
+                }
+            }
+            chunk.last_hash = locked_chain->getBlockHash(chunk.last_height);
+
+            for (int h : heights) {
+                RescanBlock item;
+                item.hash = locked_chain->getBlockHash(h);
+                item.height = h;
+                const CBlockIndex* pindex = LookupBlockIndex(item.hash);
+                if (pindex && (pindex->nStatus & BLOCK_HAVE_DATA)) {
+                    item.pos = pindex->GetBlockPos();
+                }
+                chunk.blocks.push_back(std::move(item));
+            }
+            return true;
+        };
+
+        // Read the next chunk on the helper threads while the current one is applied
+        RescanChunk chunks[2];
+        std::future<void> reading;
+        auto read_chunk = [&](RescanChunk& chunk) {
+            if (threads > 1) {
+                reading = std::async(std::launch::async, [this, &chunk, threads] { ReadRescanChunk(*this, chunk, threads); });
+            } else {
+                ReadRescanChunk(*this, chunk, 1);
             }
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                WalletLogPrintf("Still rescanning. At block %d. Progress=%f\n", *block_height, progress_current);
+        };
+        auto wait_chunk = [&reading] {
+            if (reading.valid()) {
+                reading.get();
             }
+        };
+
+        int current = 0;
+        bool planned = block_height && plan_chunk(*block_height, uint256(), chunks[current]);
+        if (planned) {
+            read_chunk(chunks[current]);
+        }
+        while (planned && !fAbortRescan && !ShutdownRequested()) {
+            wait_chunk();
+            RescanChunk& chunk = chunks[current];
+            RescanChunk& next = chunks[1 - current];
+            bool next_planned = plan_chunk(chunk.last_height + 1, chunk.last_hash, next);
+            if (next_planned) {
+                read_chunk(next);
+            }
+
+            bool stop = false;
+            bool replan = false;
+            for (RescanBlock& item : chunk.blocks) {
+                if (fAbortRescan || ShutdownRequested()) {
+                    stop = true;
+                    break;
+                }
+                block_hash = item.hash;
+                block_height = item.height;
+                if (*block_height % 100 == 0 || GetTime() >= nNow + 60) {
+                    progress_current = chain().guessVerificationProgress(block_hash);
+                }
+                if (*block_height % 100 == 0 && progress_end - progress_begin > 0.0) {
+                    ShowProgress(strprintf("%s " + _("Rescanning..."), GetDisplayName()), std::max(1, std::min(99, (int)((progress_current - progress_begin) / (progress_end - progress_begin) * 100))));
+                }
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    WalletLogPrintf("Still rescanning. At block %d. Progress=%f\n", *block_height, progress_current);
+                }
+
+                if (!item.read) {
+                    // could not scan block, keep scanning but record this block as the most recent failure
+                    result.last_failed_block = block_hash;
+                    result.status = ScanResult::FAILURE;
+                    continue;
+                }
 
-            CBlock block;
-            if (chain().findBlock(block_hash, &block) && !block.IsNull()) {
                 auto locked_chain = chain().lock();
                 LOCK(cs_wallet);
                 if (!locked_chain->getBlockHeight(block_hash)) {
@@ -1941,44 +2226,52 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
                     // https://github.com/bitcoin/bitcoin/pull/14711#issuecomment-458342518
                     result.last_failed_block = block_hash;
                     result.status = ScanResult::FAILURE;
+                    stop = true;
                     break;
                 }
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    SyncTransaction(block.vtx[posInBlock], block_hash, posInBlock, fUpdate);
+                // Keys learnt while applying, like keypool keys marked used, make the matches made before incomplete
+                bool exact = GetKeyStoreSize() != chunk.keystore_size;
+                for (size_t posInBlock = 0; posInBlock < item.block.vtx.size(); ++posInBlock) {
+                    const CTransactionRef& ptx = item.block.vtx[posInBlock];
+                    if (exact || item.mine[posInBlock] || IsRescanSpend(*ptx)) {
+                        SyncTransaction(ptx, block_hash, posInBlock, fUpdate);
+                        exact = exact || GetKeyStoreSize() != chunk.keystore_size;
+                    }
                 }
                 // scan succeeded, record block as most recent successfully scanned
                 result.last_scanned_block = block_hash;
                 result.last_scanned_height = *block_height;
-            } else {
-                // could not scan block, keep scanning but record this block as the most recent failure
-                result.last_failed_block = block_hash;
-                result.status = ScanResult::FAILURE;
+
+                if (use_index && exact) {
+                    // The blocks skipped ahead may touch the new keys
+                    learn_index_keys(item.height + 1);
+                    wait_chunk();
+                    next_planned = plan_chunk(item.height + 1, block_hash, next);
+                    if (next_planned) {
+                        read_chunk(next);
+                    }
+                    replan = true;
+                    break;
+                }
             }
-            if (block_hash == stop_block) {
+            if (stop) {
                 break;
             }
-            {
+            if (use_index && !replan && (chunk.blocks.empty() || chunk.blocks.back().height != chunk.last_height)) {
+                // the blocks after the last read one have no wallet activity
                 auto locked_chain = chain().lock();
-                Optional<int> tip_height = locked_chain->getHeight();
-                if (!tip_height || *tip_height <= block_height || !locked_chain->getBlockHeight(block_hash)) {
-                    // break successfully when rescan has reached the tip, or
-                    // previous block is no longer on the chain due to a reorg
-                    break;
-                }
-
-                // increment block and verification progress
-                block_hash = locked_chain->getBlockHash(++*block_height);
-                progress_current = chain().guessVerificationProgress(block_hash);
-
-                // handle updated tip hash
-                const uint256 prev_tip_hash = tip_hash;
-                tip_hash = locked_chain->getBlockHash(*tip_height);
-                if (stop_block.IsNull() && prev_tip_hash != tip_hash) {
-                    // in case the tip has changed, update progress max
-                    progress_end = chain().guessVerificationProgress(tip_hash);
+                if (locked_chain->getBlockHeight(chunk.last_hash)) {
+                    block_hash = chunk.last_hash;
+                    block_height = chunk.last_height;
+                    result.last_scanned_block = block_hash;
+                    result.last_scanned_height = *block_height;
                 }
             }
+
+            planned = next_planned;
+            current = 1 - current;
         }
+        wait_chunk();
         ShowProgress(strprintf("%s " + _("Rescanning..."), GetDisplayName()), 100); // hide progress dialog in GUI
         if (block_height && fAbortRescan) {
             WalletLogPrintf("Rescan aborted at block %d. Progress=%f\n", *block_height, progress_current);
@@ -2054,6 +2347,25 @@ std::set<uint256> CWalletTx::GetConflicts() const
     return result;
 }
 
+void CWalletTx::MarkDirty()
+{
+    fCreditCached = false;
+    fAvailableCreditCached = false;
+    fImmatureCreditCached = false;
+    fWatchDebitCached = false;
+    fWatchCreditCached = false;
+    fAvailableWatchCreditCached = false;
+    fImmatureWatchCreditCached = false;
+    fDebitCached = false;
+    fChangeCached = false;
+
+    // The credit of the transaction may have changed, check it again for staking and coin selection
+    if (pwallet) {
+        pwallet->MarkStakeCandidate(GetHash());
+        pwallet->MarkCoinCandidate(GetHash());
+    }
+}
+
 CAmount CWalletTx::GetDebit(const isminefilter& filter) const
 {
     if (tx->vin.empty())
@@ -2442,6 +2754,23 @@ CAmount CWallet::GetAvailableBalance(const CCoinControl* coinControl) const
     return balance;
 }
 
+//! Whether a matured wallet transaction has no output of ours left unspent, it only gets one again when marked dirty
+static bool HasNoCoinsLeft(interfaces::Chain::Lock& locked_chain, const CWallet& wallet, const CWalletTx& wtx) EXCLUSIVE_LOCKS_REQUIRED(wallet.cs_wallet)
+{
+    if (wtx.GetBlocksToMaturity(locked_chain) > 0 ||
+        wtx.GetAvailableCredit(locked_chain, true, ISMINE_SPENDABLE) != 0 ||
+        wtx.GetAvailableCredit(locked_chain, true, ISMINE_WATCH_ONLY) != 0) {
+        return false;
+    }
+    // Zero value outputs do not show in the credit
+    for (unsigned int i = 0; i < wtx.tx->vout.size(); i++) {
+        if (wtx.tx->vout[i].nValue == 0 && wallet.IsMine(wtx.tx->vout[i]) != ISMINE_NO && !wallet.IsSpent(locked_chain, wtx.GetHash(), i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void CWallet::AvailableCoins(interfaces::Chain::Lock& locked_chain, std::vector<COutput> &vCoins, bool fOnlySafe, const CCoinControl *coinControl, const CAmount &nMinimumAmount, const CAmount &nMaximumAmount, const CAmount &nMinimumSumAmount, const uint64_t nMaximumCount, const int nMinDepth, const int nMaxDepth, const CTxDestination& signSenderAddress, const CTxDestination& senderAddress) const
 {
     AssertLockHeld(cs_main);
@@ -2450,10 +2779,18 @@ void CWallet::AvailableCoins(interfaces::Chain::Lock& locked_chain, std::vector<
     vCoins.clear();
     CAmount nTotal = 0;
 
-    for (const auto& entry : mapWallet)
+    // The candidates are in txid order like mapWallet, but skip the transactions that were spent long ago
+    for (std::set<uint256>::const_iterator it = setCoinCandidates.begin(); it != setCoinCandidates.end();)
     {
-        const uint256& wtxid = entry.first;
-        const CWalletTx* pcoin = &entry.second;
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(*it);
+        if (mi == mapWallet.end() || HasNoCoinsLeft(locked_chain, *this, mi->second)) {
+            it = setCoinCandidates.erase(it);
+            continue;
+        }
+        ++it;
+
+        const uint256& wtxid = mi->first;
+        const CWalletTx* pcoin = &mi->second;
 
         if (!CheckFinalTx(*pcoin->tx))
             continue;
@@ -2514,10 +2851,10 @@ void CWallet::AvailableCoins(interfaces::Chain::Lock& locked_chain, std::vector<
             if (pcoin->tx->vout[i].nValue < nMinimumAmount || pcoin->tx->vout[i].nValue > nMaximumAmount)
                 continue;
 
-            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(entry.first, i)))
+            if (coinControl && coinControl->HasSelected() && !coinControl->fAllowOtherInputs && !coinControl->IsSelected(COutPoint(wtxid, i)))
                 continue;
 
-            if (IsLockedCoin(entry.first, i))
+            if (IsLockedCoin(wtxid, i))
                 continue;
 
             if (IsSpent(locked_chain, wtxid, i))
@@ -2726,6 +3063,10 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const CoinEligibil
             utxo_pool.push_back(group);
         }
         bnb_used = false;
+        // The knapsack approximation walks the pool a thousand times, select large pools by sorted value instead
+        if (utxo_pool.size() > MAX_KNAPSACK_GROUPS) {
+            return SelectCoinsSorted(nTargetValue, utxo_pool, setCoinsRet, nValueRet);
+        }
         return KnapsackSolver(nTargetValue, utxo_pool, setCoinsRet, nValueRet);
     }
 }
@@ -2991,6 +3332,8 @@ bool CWallet::CreateTransaction(interfaces::Chain::Lock& locked_chain, const std
     PriceOracle oracle;
     uint64_t bytePrice = 0;
     oracle.getBytePrice(bytePrice);
+    // Without a gas fee the transaction pays the byte price for its size, so value the inputs with it
+    const bool fPayBytePrice = nGasFee == 0;
 
     CAmount nValue = 0;
     int nChangePosRequest = nChangePosInOut;
@@ -3148,6 +3491,9 @@ bool CWallet::CreateTransaction(interfaces::Chain::Lock& locked_chain, const std
                         coin_selection_params.change_spend_size = (size_t)change_spend_size;
                     }
                     coin_selection_params.effective_fee = nFeeRateNeeded;
+                    if (fPayBytePrice && CFeeRate((CAmount)bytePrice * 1000) > nFeeRateNeeded) {
+                        coin_selection_params.effective_fee = CFeeRate((CAmount)bytePrice * 1000);
+                    }
                     if (!SelectCoins(vAvailableCoins, nValueToSelect, setCoins, nValueIn, coin_control, coin_selection_params, bnb_used))
                     {
                         // If BnB was used, it was the first pass. No longer the first pass and continue loop with knapsack.
@@ -3817,18 +4163,49 @@ bool CWallet::CreateCoinStakeFromMine(interfaces::Chain::Lock& locked_chain, con
     }
 
     // Sign the input coins
-    int nIn = 0;
-    for(const CWalletTx* pcoin : vwtxPrev)
-    {
-        if (!SignSignature(*this, *pcoin->tx, txNew, nIn++, SIGHASH_ALL))
-            return error("CreateCoinStake : failed to sign coinstake");
-    }
+    if (!SignCoinStake(txNew, vwtxPrev))
+        return error("CreateCoinStake : failed to sign coinstake");
 
     // Successfully generated coinstake
     tx = txNew;
     return true;
 }
 
+bool CWallet::SignCoinStake(CMutableTransaction& txNew, const std::vector<const CWalletTx*>& vwtxPrev) const
+{
+    // Signing an input only writes that input and its signature hash does not read the scripts of the
+    // other inputs, so many combined inputs are signed on separate threads
+    size_t listSize = vwtxPrev.size();
+    int numThreads = std::min(m_staking_sign_threads, (int)(listSize / MIN_STAKING_SIGN_INPUTS_PER_THREAD));
+    if(numThreads < 2)
+    {
+        for(size_t nIn = 0; nIn < listSize; nIn++)
+        {
+            if (!SignSignature(*this, *vwtxPrev[nIn]->tx, txNew, nIn, SIGHASH_ALL))
+                return false;
+        }
+        return true;
+    }
+
+    std::atomic<bool> ret{true};
+    size_t chunk = listSize / numThreads;
+    for(int i = 0; i < numThreads; i++)
+    {
+        size_t from = i * chunk;
+        size_t to = i == (numThreads -1) ? listSize : from + chunk;
+        threads.create_thread([this, from, to, &txNew, &vwtxPrev, &ret]{
+            for(size_t nIn = from; nIn < to && ret; nIn++)
+            {
+                if (!SignSignature(*this, *vwtxPrev[nIn]->tx, txNew, nIn, SIGHASH_ALL))
+                    ret = false;
+            }
+        });
+    }
+    threads.join_all();
+
+    return ret;
+}
+
 bool CWallet::CreateCoinStakeFromDelegate(interfaces::Chain::Lock& locked_chain, const CKeyStore &keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins, std::vector<COutPoint>& setDelegateCoins, std::vector<unsigned char>& vchPoD, COutPoint& headerPrevout)
 {
     CBlockIndex* pindexPrev = chainActive.Tip();
@@ -4015,12 +4392,8 @@ bool CWallet::CreateCoinStakeFromDelegate(interfaces::Chain::Lock& locked_chain,
     }
 
     // Sign the input coins
-    int nIn = 0;
-    for(const CWalletTx* pcoin : vwtxPrev)
-    {
-        if (!SignSignature(*this, *pcoin->tx, txNew, nIn++, SIGHASH_ALL))
-            return error("CreateCoinStake : failed to sign coinstake");
-    }
+    if (!SignCoinStake(txNew, vwtxPrev))
+        return error("CreateCoinStake : failed to sign coinstake");
 
     // Successfully generated coinstake
     tx = txNew;
@@ -5106,6 +5479,7 @@ std::shared_ptr<CWallet> CWallet::CreateWalletFromFile(interfaces::Chain& chain,
     // TODO: Can't use std::make_shared because we need a custom deleter but
     // should be possible to use std::allocate_shared.
     std::shared_ptr<CWallet> walletInstance(new CWallet(chain, location, WalletDatabase::Create(location.GetPath())), ReleaseWallet);
+    walletInstance->m_staking_ledger = gArgs.GetBoolArg("-stakingledger", DEFAULT_STAKING_LEDGER);
     DBErrors nLoadWalletRet = walletInstance->LoadWallet(fFirstRun);
     if (nLoadWalletRet != DBErrors::LOAD_OK)
     {
@@ -5317,6 +5691,11 @@ std::shared_ptr<CWallet> CWallet::CreateWalletFromFile(interfaces::Chain& chain,
         walletInstance->m_staking_min_fee = nStakingMinFee;
     }
     walletInstance->m_staker_max_utxo_script_cache = gArgs.GetArg("-maxstakerutxoscriptcache", DEFAULT_STAKER_MAX_UTXO_SCRIPT_CACHE);
+    int nSignThreads = gArgs.GetArg("-stakingsignthreads", DEFAULT_STAKING_SIGN_THREADS);
+    if (nSignThreads <= 0) {
+        nSignThreads += GetNumCores();
+    }
+    walletInstance->m_staking_sign_threads = std::max(1, std::min(nSignThreads, MAX_STAKING_SIGN_THREADS));
     walletInstance->m_num_threads = 1;
     walletInstance->m_num_threads = std::max(1, walletInstance->m_num_threads);
 
@@ -5329,7 +5708,12 @@ std::shared_ptr<CWallet> CWallet::CreateWalletFromFile(interfaces::Chain& chain,
     LOCK(walletInstance->cs_wallet);
 
     int rescan_height = 0;
-    if (!gArgs.GetBoolArg("-rescan", false))
+    if (walletInstance->m_staking_ledger)
+    {
+        // The staking ledger keeps no wallet transactions, there is nothing to rescan
+        rescan_height = locked_chain->getHeight().get_value_or(0);
+    }
+    else if (!gArgs.GetBoolArg("-rescan", false))
     {
         WalletBatch batch(*walletInstance->database);
         CBlockLocator locator;
@@ -5416,7 +5800,8 @@ std::shared_ptr<CWallet> CWallet::CreateWalletFromFile(interfaces::Chain& chain,
     uiInterface.LoadWallet(walletInstance);
 
     // Register with the validation interface. It's ok to do this after rescan since we're still holding cs_main.
-    RegisterValidationInterface(walletInstance.get());
+    // The staker works from the coins of the wallet, so its notifications take the high priority lane.
+    RegisterValidationInterface(walletInstance.get(), true);
 
     walletInstance->SetBroadcastTransactions(gArgs.GetBoolArg("-walletbroadcast", DEFAULT_WALLETBROADCAST));
 
@@ -5471,16 +5856,91 @@ bool CWallet::LoadToken(const CTokenInfo &token)
 bool CWallet::LoadTokenTx(const CTokenTx &tokenTx)
 {
     uint256 hash = tokenTx.GetHash();
+    auto it = mapTokenTx.find(hash);
+    if(it != mapTokenTx.end())
+    {
+        RemoveFromTokenTxIndex(hash, it->second);
+    }
     mapTokenTx[hash] = tokenTx;
+    AddToTokenTxIndex(hash, tokenTx);
 
     return true;
 }
 
+static void EraseIndexEntry(std::multimap<std::string, uint256>& index, const std::string& key, const uint256& hash)
+{
+    auto range = index.equal_range(key);
+    for(auto it = range.first; it != range.second; it++)
+    {
+        if(it->second == hash)
+        {
+            index.erase(it);
+            return;
+        }
+    }
+}
+
+void CWallet::AddToTokenTxIndex(const uint256& hash, const CTokenTx& tokenTx)
+{
+    mapTokenTxByContract.emplace(tokenTx.strContractAddress, hash);
+    mapTokenTxByAddress.emplace(tokenTx.strSenderAddress, hash);
+    if(tokenTx.strReceiverAddress != tokenTx.strSenderAddress)
+    {
+        mapTokenTxByAddress.emplace(tokenTx.strReceiverAddress, hash);
+    }
+}
+
+void CWallet::RemoveFromTokenTxIndex(const uint256& hash, const CTokenTx& tokenTx)
+{
+    EraseIndexEntry(mapTokenTxByContract, tokenTx.strContractAddress, hash);
+    EraseIndexEntry(mapTokenTxByAddress, tokenTx.strSenderAddress, hash);
+    if(tokenTx.strReceiverAddress != tokenTx.strSenderAddress)
+    {
+        EraseIndexEntry(mapTokenTxByAddress, tokenTx.strReceiverAddress, hash);
+    }
+}
+
+std::vector<CTokenTx> CWallet::GetTokenTxEntries(const std::string& strContractAddress, const std::string& strAddress) const
+{
+    LOCK(cs_wallet);
+
+    // An address narrows the entries down more than the contract
+    auto range = mapTokenTxByContract.equal_range(strContractAddress);
+    if(!strAddress.empty())
+    {
+        range = mapTokenTxByAddress.equal_range(strAddress);
+    }
+
+    std::vector<std::pair<int64_t, uint256>> entries;
+    for(auto it = range.first; it != range.second; it++)
+    {
+        auto mi = mapTokenTx.find(it->second);
+        if(mi == mapTokenTx.end() || mi->second.strContractAddress != strContractAddress)
+            continue;
+        entries.emplace_back(mi->second.blockNumber, mi->first);
+    }
+    std::sort(entries.begin(), entries.end());
+
+    std::vector<CTokenTx> result;
+    result.reserve(entries.size());
+    for(const auto& entry : entries)
+    {
+        result.push_back(mapTokenTx.at(entry.second));
+    }
+    return result;
+}
+
 bool CWallet::AddTokenEntry(const CTokenInfo &token, bool fFlushOnClose)
 {
     LOCK(cs_wallet);
 
     WalletBatch batch(*database, "r+", fFlushOnClose);
+    return AddTokenEntry(batch, token);
+}
+
+bool CWallet::AddTokenEntry(WalletBatch& batch, const CTokenInfo& token)
+{
+    AssertLockHeld(cs_wallet);
 
     uint256 hash = token.GetHash();
 
@@ -5503,6 +5963,13 @@ bool CWallet::AddTokenEntry(const CTokenInfo &token, bool fFlushOnClose)
         wtoken.nCreateTime = it->second.nCreateTime;
     }
 
+    if(!fInsertedNew)
+    {
+        // Keep the balance tracked from the connected blocks
+        wtoken.nBalance = it->second.nBalance;
+        wtoken.balanceBlockHash = it->second.balanceBlockHash;
+    }
+
     if (!batch.WriteToken(wtoken))
         return false;
 
@@ -5513,10 +5980,10 @@ bool CWallet::AddTokenEntry(const CTokenInfo &token, bool fFlushOnClose)
     // Refresh token tx
     if(fInsertedNew)
     {
-        for(auto it = mapTokenTx.begin(); it != mapTokenTx.end(); it++)
+        auto range = mapTokenTxByContract.equal_range(wtoken.strContractAddress);
+        for(auto it = range.first; it != range.second; it++)
         {
-            uint256 tokenTxHash = it->second.GetHash();
-            NotifyTokenTransactionChanged(this, tokenTxHash, CT_UPDATED);
+            NotifyTokenTransactionChanged(this, it->second, CT_UPDATED);
         }
     }
 
@@ -5530,6 +5997,12 @@ bool CWallet::AddTokenTxEntry(const CTokenTx &tokenTx, bool fFlushOnClose)
     LOCK(cs_wallet);
 
     WalletBatch batch(*database, "r+", fFlushOnClose);
+    return AddTokenTxEntry(batch, tokenTx);
+}
+
+bool CWallet::AddTokenTxEntry(WalletBatch& batch, const CTokenTx& tokenTx)
+{
+    AssertLockHeld(cs_wallet);
 
     uint256 hash = tokenTx.GetHash();
 
@@ -5553,7 +6026,12 @@ bool CWallet::AddTokenTxEntry(const CTokenTx &tokenTx, bool fFlushOnClose)
     if (!batch.WriteTokenTx(wtokenTx))
         return false;
 
+    if(!fInsertedNew)
+    {
+        RemoveFromTokenTxIndex(hash, it->second);
+    }
     mapTokenTx[hash] = wtokenTx;
+    AddToTokenTxIndex(hash, wtokenTx);
 
     NotifyTokenTransactionChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -5562,6 +6040,198 @@ bool CWallet::AddTokenTxEntry(const CTokenTx &tokenTx, bool fFlushOnClose)
     return true;
 }
 
+bool CWallet::AddTokenTxEntries(const std::vector<CTokenTx>& tokenTxs, bool fFlushOnClose)
+{
+    LOCK(cs_wallet);
+
+    if (tokenTxs.empty())
+        return true;
+
+    // Write all the entries in one database transaction
+    WalletBatch batch(*database, "r+", fFlushOnClose);
+    if (!batch.TxnBegin())
+        return false;
+    for (const CTokenTx& tokenTx : tokenTxs) {
+        if (!AddTokenTxEntry(batch, tokenTx)) {
+            batch.TxnAbort();
+            return false;
+        }
+    }
+    return batch.TxnCommit();
+}
+
+// Transfer(address,address,uint256)
+static const dev::h256 TOKEN_TRANSFER_TOPIC("ddf252ad1be2c89b69c2b068fc378daa952ba7f163c4a11628f55a4df523b3ef");
+
+//! Get the holder of a token entry as it appears in the indexed topics of the token logs
+static bool GetTokenHolder(const CTokenInfo& token, dev::Address& contract, dev::Address& holder)
+{
+    if (token.strContractAddress.size() != 40 || !IsHex(token.strContractAddress))
+        return false;
+    CTxDestination dest = DecodeDestination(token.strSenderAddress);
+    const CKeyID* keyid = boost::get<CKeyID>(&dest);
+    if (!keyid)
+        return false;
+    contract = dev::Address(token.strContractAddress);
+    holder = dev::Address(HexStr(keyid->begin(), keyid->end()));
+    return true;
+}
+
+bool CWallet::GetTokenBalance(const uint256& tokenHash, uint256& balance)
+{
+    if (!fLogEvents)
+        return false;
+
+    dev::Address contract, holder;
+    {
+        LOCK(cs_wallet);
+        auto it = mapToken.find(tokenHash);
+        if (it == mapToken.end() || !GetTokenHolder(it->second, contract, holder))
+            return false;
+        if (!it->second.balanceBlockHash.IsNull()) {
+            balance = it->second.nBalance;
+            return true;
+        }
+    }
+
+    // Seed the balance with one balanceOf call, the connected blocks keep it current from there
+    ContractCallSnapshot snapshot;
+    TakeContractCallSnapshot(snapshot);
+    std::vector<unsigned char> opcode = ParseHex("70a08231000000000000000000000000" + holder.hex());
+    std::vector<ResultExecute> execResults;
+    std::string error;
+    if (!RunContractCall(ContractCallClass::WALLET, [&] { execResults = CallContractOnSnapshot(snapshot, contract, opcode, holder, 0, 0); }, error))
+        return false;
+    if (execResults.empty() || execResults[0].execRes.excepted != dev::eth::TransactionException::None || execResults[0].execRes.output.size() < 32)
+        return false;
+    dev::u256 seeded = dev::fromBigEndian<dev::u256>(dev::bytesConstRef(execResults[0].execRes.output.data(), 32));
+
+    LOCK(cs_wallet);
+    auto it = mapToken.find(tokenHash);
+    if (it == mapToken.end())
+        return false;
+    CTokenInfo& token = it->second;
+    if (token.balanceBlockHash.IsNull()) {
+        token.nVersion = CTokenInfo::CURRENT_VERSION;
+        token.nBalance = u256Touint(seeded);
+        token.balanceBlockHash = snapshot.pindex->GetBlockHash();
+        WalletBatch(*database).WriteToken(token);
+    }
+    balance = token.nBalance;
+    return true;
+}
+
+void CWallet::SyncTokenTransfers(const CBlock& block, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    if (!fLogEvents || mapToken.empty())
+        return;
+
+    struct TrackedToken {
+        const uint256* hash;
+        CTokenInfo* info;
+        dev::Address contract;
+        dev::Address holder;
+        dev::u256 balance;
+        bool advance;
+        bool changed;
+    };
+
+    // A balance advances only from the block before this one; one seeded at this block or later
+    // already includes it, and one the wallet can no longer reach is seeded again
+    uint256 hashPrev = pindex->pprev ? pindex->pprev->GetBlockHash() : uint256();
+    std::vector<TrackedToken> tokens;
+    for (auto& item : mapToken) {
+        TrackedToken token{&item.first, &item.second, {}, {}, 0, false, false};
+        if (!GetTokenHolder(*token.info, token.contract, token.holder))
+            continue;
+        uint256& balanceBlockHash = token.info->balanceBlockHash;
+        if (!balanceBlockHash.IsNull() && balanceBlockHash != hashPrev) {
+            const CBlockIndex* pindexBalance = LookupBlockIndex(balanceBlockHash);
+            if (!pindexBalance || !chainActive.Contains(pindexBalance) || pindexBalance->nHeight < pindex->nHeight) {
+                balanceBlockHash.SetNull();
+                token.changed = true;
+            }
+        }
+        token.advance = !balanceBlockHash.IsNull() && balanceBlockHash == hashPrev;
+        token.balance = uintTou256(token.info->nBalance);
+        tokens.push_back(token);
+    }
+    if (tokens.empty())
+        return;
+
+    WalletBatch batch(*database, "r+", false);
+    batch.TxnBegin();
+    for (const auto& receipts : ReadBlockReceipts(block)) {
+        for (const TransactionReceiptInfo& receipt : receipts.second) {
+            for (const dev::eth::LogEntry& log : receipt.logs) {
+                if (log.topics.size() < 3 || log.topics[0] != TOKEN_TRANSFER_TOPIC || log.data.size() < 32)
+                    continue;
+                dev::Address from = dev::right160(log.topics[1]);
+                dev::Address to = dev::right160(log.topics[2]);
+                dev::u256 value = dev::fromBigEndian<dev::u256>(dev::bytesConstRef(log.data.data(), 32));
+
+                for (TrackedToken& token : tokens) {
+                    if (log.address != token.contract || (from != token.holder && to != token.holder))
+                        continue;
+
+                    CTokenTx tokenTx;
+                    tokenTx.strContractAddress = token.info->strContractAddress;
+                    tokenTx.strSenderAddress = EncodeDestination(CKeyID(h160Touint(from)));
+                    tokenTx.strReceiverAddress = EncodeDestination(CKeyID(h160Touint(to)));
+                    tokenTx.nValue = u256Touint(value);
+                    tokenTx.transactionHash = receipts.first;
+                    tokenTx.blockHash = pindex->GetBlockHash();
+                    tokenTx.blockNumber = pindex->nHeight;
+                    AddTokenTxEntry(batch, tokenTx);
+
+                    if (!token.advance)
+                        continue;
+                    if (from == token.holder) {
+                        if (token.balance < value) {
+                            // The logs do not add up to the seeded balance, ask the contract again
+                            token.advance = false;
+                            token.info->balanceBlockHash.SetNull();
+                            token.changed = true;
+                            continue;
+                        }
+                        token.balance -= value;
+                    }
+                    if (to == token.holder) {
+                        token.balance += value;
+                    }
+                }
+            }
+        }
+    }
+
+    // Only a balance that moved or has to be seeded again is announced
+    std::vector<const uint256*> balanceChanged;
+    for (TrackedToken& token : tokens) {
+        if (token.advance) {
+            uint256 nBalance = u256Touint(token.balance);
+            if (nBalance != token.info->nBalance)
+                balanceChanged.push_back(token.hash);
+            token.info->nVersion = CTokenInfo::CURRENT_VERSION;
+            token.info->nBalance = nBalance;
+            token.info->balanceBlockHash = pindex->GetBlockHash();
+            token.changed = true;
+        } else if (token.changed) {
+            balanceChanged.push_back(token.hash);
+        }
+        if (token.changed) {
+            batch.WriteToken(*token.info);
+        }
+    }
+    batch.TxnCommit();
+
+    for (const uint256* hash : balanceChanged) {
+        NotifyTokenBalanceChanged(this, *hash);
+    }
+}
+
 CKeyPool::CKeyPool()
 {
     nTime = GetTime();
@@ -5811,15 +6481,16 @@ bool CWallet::RemoveTokenEntry(const uint256 &tokenHash, bool fFlushOnClose)
         if (!batch.EraseToken(tokenHash))
             return false;
 
+        std::string strContractAddress = it->second.strContractAddress;
         mapToken.erase(it);
 
         NotifyTokenChanged(this, tokenHash, CT_DELETED);
 
         // Refresh token tx
-        for(auto it = mapTokenTx.begin(); it != mapTokenTx.end(); it++)
+        auto range = mapTokenTxByContract.equal_range(strContractAddress);
+        for(auto itTx = range.first; itTx != range.second; itTx++)
         {
-            uint256 tokenTxHash = it->second.GetHash();
-            NotifyTokenTransactionChanged(this, tokenTxHash, CT_UPDATED);
+            NotifyTokenTransactionChanged(this, itTx->second, CT_UPDATED);
         }
     }
 
@@ -5832,58 +6503,53 @@ bool CWallet::CleanTokenTxEntries(bool fFlushOnClose)
 {
     LOCK(cs_wallet);
 
-    // Open db
-    WalletBatch batch(*database, "r+", fFlushOnClose);
-
-    // Get all token transaction hashes
+    // Keep the entry with the highest value among the ones for the same transfer
+    typedef std::tuple<std::string, std::string, std::string, uint256, int64_t, uint256> TokenTxKey;
+    std::map<TokenTxKey, std::map<uint256, CTokenTx>::iterator> mapKeep;
     std::vector<uint256> tokenTxHashes;
     for(auto it = mapTokenTx.begin(); it != mapTokenTx.end(); it++)
     {
-        tokenTxHashes.push_back(it->first);
+        const CTokenTx& tokenTx = it->second;
+        TokenTxKey key(tokenTx.strContractAddress, tokenTx.strSenderAddress, tokenTx.strReceiverAddress, tokenTx.blockHash, tokenTx.blockNumber, tokenTx.transactionHash);
+        auto ret = mapKeep.emplace(key, it);
+        if(ret.second) continue;
+
+        auto& itKeep = ret.first->second;
+        if(uintTou256(itKeep->second.nValue) < uintTou256(tokenTx.nValue))
+        {
+            tokenTxHashes.push_back(itKeep->first);
+            itKeep = it;
+        }
+        else
+        {
+            tokenTxHashes.push_back(it->first);
+        }
     }
+    if(tokenTxHashes.empty())
+        return true;
 
-    // Remove existing entries
-    for(size_t i = 0; i < tokenTxHashes.size(); i++)
+    // Remove the duplicates from disk in one database transaction
+    WalletBatch batch(*database, "r+", fFlushOnClose);
+    if (!batch.TxnBegin())
+        return false;
+    for(const uint256& hashTx : tokenTxHashes)
     {
-        // Get the I entry
-        uint256 hashTxI = tokenTxHashes[i];
-        auto itTxI = mapTokenTx.find(hashTxI);
-        if(itTxI == mapTokenTx.end()) continue;
-        CTokenTx tokenTxI = itTxI->second;
-
-        for(size_t j = 0; j < tokenTxHashes.size(); j++)
+        if (!batch.EraseTokenTx(hashTx))
         {
-            // Skip the same entry
-            if(i == j) continue;
-
-            // Get the J entry
-            uint256 hashTxJ = tokenTxHashes[j];
-            auto itTxJ = mapTokenTx.find(hashTxJ);
-            if(itTxJ == mapTokenTx.end()) continue;
-            CTokenTx tokenTxJ = itTxJ->second;
-
-            // Compare I and J entries
-            if(tokenTxI.strContractAddress != tokenTxJ.strContractAddress) continue;
-            if(tokenTxI.strSenderAddress != tokenTxJ.strSenderAddress) continue;
-            if(tokenTxI.strReceiverAddress != tokenTxJ.strReceiverAddress) continue;
-            if(tokenTxI.blockHash != tokenTxJ.blockHash) continue;
-            if(tokenTxI.blockNumber != tokenTxJ.blockNumber) continue;
-            if(tokenTxI.transactionHash != tokenTxJ.transactionHash) continue;
-
-            // Delete the lower entry from disk
-            size_t nLower = uintTou256(tokenTxI.nValue) < uintTou256(tokenTxJ.nValue) ? i : j;
-            auto itTx = nLower == i ? itTxI : itTxJ;
-            uint256 hashTx = nLower == i ? hashTxI : hashTxJ;
-
-            if (!batch.EraseTokenTx(hashTx))
-                return false;
-
-            mapTokenTx.erase(itTx);
+            batch.TxnAbort();
+            return false;
+        }
+    }
+    if (!batch.TxnCommit())
+        return false;
 
-            NotifyTokenTransactionChanged(this, hashTx, CT_DELETED);
+    for(const uint256& hashTx : tokenTxHashes)
+    {
+        auto it = mapTokenTx.find(hashTx);
+        RemoveFromTokenTxIndex(hashTx, it->second);
+        mapTokenTx.erase(it);
 
-            break;
-        }
+        NotifyTokenTransactionChanged(this, hashTx, CT_DELETED);
     }
 
     return true;
@@ -5954,6 +6620,12 @@ bool CWallet::AddDelegationEntry(const CDelegationInfo& delegation, bool fFlushO
     LOCK(cs_wallet);
 
     WalletBatch batch(*database, "r+", fFlushOnClose);
+    return AddDelegationEntry(batch, delegation);
+}
+
+bool CWallet::AddDelegationEntry(WalletBatch& batch, const CDelegationInfo& delegation)
+{
+    AssertLockHeld(cs_wallet);
 
     uint256 hash = delegation.GetHash();
 
@@ -6034,6 +6706,12 @@ bool CWallet::AddSuperStakerEntry(const CSuperStakerInfo& superStaker, bool fFlu
     LOCK(cs_wallet);
 
     WalletBatch batch(*database, "r+", fFlushOnClose);
+    return AddSuperStakerEntry(batch, superStaker);
+}
+
+bool CWallet::AddSuperStakerEntry(WalletBatch& batch, const CSuperStakerInfo& superStaker)
+{
+    AssertLockHeld(cs_wallet);
 
     uint256 hash = superStaker.GetHash();
 
@@ -6060,6 +6738,8 @@ bool CWallet::AddSuperStakerEntry(const CSuperStakerInfo& superStaker, bool fFlu
         return false;
 
     mapSuperStaker[hash] = wsuperStaker;
+    // The delegations of a staker depend on its configuration
+    m_delegations_staker_version = 0;
 
     NotifySuperStakerChanged(this, hash, fInsertedNew ? CT_NEW : CT_UPDATED);
 
@@ -6067,10 +6747,6 @@ bool CWallet::AddSuperStakerEntry(const CSuperStakerInfo& superStaker, bool fFlu
     {
         LogPrintf("AddSuperStakerEntry %s\n", wsuperStaker.GetHash().ToString());
     }
-    else
-    {
-        fUpdatedSuperStaker = true;
-    }
 
     return true;
 }
@@ -6096,6 +6772,7 @@ bool CWallet::RemoveSuperStakerEntry(const uint256& superStakerHash, bool fFlush
             return false;
 
         mapSuperStaker.erase(it);
+        m_delegations_staker_version = 0;
 
         NotifySuperStakerChanged(this, superStakerHash, CT_DELETED);
     }
@@ -6141,6 +6818,7 @@ bool CWallet::IsStakeClosing()
 void CWallet::updateDelegationsStaker(const std::map<uint160, Delegation> &delegations_staker)
 {
     LOCK(cs_wallet);
+    std::set<uint160> stakers;
 
     // Notify for updated and deleted delegation items
     for (std::map<uint160, Delegation>::iterator it=m_delegations_staker.begin(); it!=m_delegations_staker.end();)
@@ -6149,6 +6827,7 @@ void CWallet::updateDelegationsStaker(const std::map<uint160, Delegation> &deleg
         std::map<uint160, Delegation>::const_iterator delegation = delegations_staker.find(addressDelegate);
         if(delegation == delegations_staker.end())
         {
+            stakers.insert(it->second.staker);
             it = m_delegations_staker.erase(it);
             m_delegations_weight.erase(addressDelegate);
             NotifyDelegationsStakerChanged(this, addressDelegate, CT_DELETED);
@@ -6157,6 +6836,8 @@ void CWallet::updateDelegationsStaker(const std::map<uint160, Delegation> &deleg
         {
             if(delegation->second != it->second)
             {
+                stakers.insert(it->second.staker);
+                stakers.insert(delegation->second.staker);
                 it->second = delegation->second;
                 NotifyDelegationsStakerChanged(this, addressDelegate, CT_UPDATED);
             }
@@ -6170,14 +6851,56 @@ void CWallet::updateDelegationsStaker(const std::map<uint160, Delegation> &deleg
         if(m_delegations_staker.find(it->first) == m_delegations_staker.end())
         {
             m_delegations_staker[it->first] = it->second;
+            stakers.insert(it->second.staker);
             NotifyDelegationsStakerChanged(this, it->first, CT_NEW);
         }
     }
+
+    notifySuperStakersChanged(stakers);
+}
+
+void CWallet::updateDelegationsStakerChanges(const std::map<uint160, Delegation> &changes)
+{
+    LOCK(cs_wallet);
+    std::set<uint160> stakers;
+
+    // A null delegation is removed or no longer for a staker of the wallet
+    for (std::map<uint160, Delegation>::const_iterator mi = changes.begin(); mi != changes.end(); mi++)
+    {
+        const uint160& addressDelegate = mi->first;
+        std::map<uint160, Delegation>::iterator it = m_delegations_staker.find(addressDelegate);
+        if(mi->second.IsNull())
+        {
+            if(it != m_delegations_staker.end())
+            {
+                stakers.insert(it->second.staker);
+                m_delegations_staker.erase(it);
+                m_delegations_weight.erase(addressDelegate);
+                NotifyDelegationsStakerChanged(this, addressDelegate, CT_DELETED);
+            }
+        }
+        else if(it == m_delegations_staker.end())
+        {
+            m_delegations_staker[addressDelegate] = mi->second;
+            stakers.insert(mi->second.staker);
+            NotifyDelegationsStakerChanged(this, addressDelegate, CT_NEW);
+        }
+        else if(it->second != mi->second)
+        {
+            stakers.insert(it->second.staker);
+            stakers.insert(mi->second.staker);
+            it->second = mi->second;
+            NotifyDelegationsStakerChanged(this, addressDelegate, CT_UPDATED);
+        }
+    }
+
+    notifySuperStakersChanged(stakers);
 }
 
 void CWallet::updateDelegationsWeight(const std::map<uint160, CAmount>& delegations_weight)
 {
     LOCK(cs_wallet);
+    std::set<uint160> stakers;
 
     for (std::map<uint160, CAmount>::const_iterator mi = delegations_weight.begin(); mi != delegations_weight.end(); mi++)
     {
@@ -6195,16 +6918,30 @@ void CWallet::updateDelegationsWeight(const std::map<uint160, CAmount>& delegati
 
         m_delegations_weight[delegate] = weight;
 
-        if(updated && m_delegations_staker.find(delegate) != m_delegations_staker.end())
+        std::map<uint160, Delegation>::const_iterator it_delegation = m_delegations_staker.find(delegate);
+        if(updated && it_delegation != m_delegations_staker.end())
         {
+            stakers.insert(it_delegation->second.staker);
             NotifyDelegationsStakerChanged(this, delegate, CT_UPDATED);
         }
     }
 
+    notifySuperStakersChanged(stakers);
+}
+
+void CWallet::notifySuperStakersChanged(const std::set<uint160>& stakers)
+{
+    AssertLockHeld(cs_wallet);
+
+    if(stakers.empty())
+        return;
+
     for (std::map<uint256, CSuperStakerInfo>::iterator mi = mapSuperStaker.begin(); mi != mapSuperStaker.end(); mi++)
     {
-        uint256 hash = mi->first;
-        NotifySuperStakerChanged(this, hash, CT_UPDATED);
+        if(stakers.count(mi->second.stakerAddress))
+        {
+            NotifySuperStakerChanged(this, mi->first, CT_UPDATED);
+        }
     }
 }
 
@@ -6313,7 +7050,8 @@ void CWallet::GetStakerAddressBalance(interfaces::Chain::Lock &locked_chain, con
 void CWallet::updateHaveCoinSuperStaker(const std::set<std::pair<const CWalletTx *, unsigned int> > &setCoins)
 {
     LOCK(cs_wallet);
-    m_have_coin_superstaker.clear();
+    std::map<uint160, bool> have_coin_superstaker;
+    have_coin_superstaker.swap(m_have_coin_superstaker);
 
     COutPoint prevout;
     CAmount nValueRet = 0;
@@ -6323,6 +7061,17 @@ void CWallet::updateHaveCoinSuperStaker(const std::set<std::pair<const CWalletTx
             m_have_coin_superstaker[entry.second.stakerAddress] = true;
         }
     }
+
+    // The delegations weight of a super staker only counts while it has a coin to stake with
+    std::set<uint160> stakers;
+    for (const auto& entry : mapSuperStaker) {
+        const uint160& staker = entry.second.stakerAddress;
+        if(have_coin_superstaker.count(staker) != m_have_coin_superstaker.count(staker))
+        {
+            stakers.insert(staker);
+        }
+    }
+    notifySuperStakersChanged(stakers);
 }
 
 void CWallet::UpdateMinerStakeCache(bool fStakeCache, const std::vector<COutPoint> &prevouts, CBlockIndex *pindexPrev )
@@ -6338,6 +7087,14 @@ void CWallet::UpdateMinerStakeCache(bool fStakeCache, const std::vector<COutPoin
             boost::this_thread::interruption_point();
             CacheKernel(minerStakeCache, prevoutStake, pindexPrev, *pcoinsTip);
         }
+
+        // Lay the entries out in the prevouts order so the kernel search reads them sequentially
+        minerStakeTable.resize(prevouts.size());
+        for(size_t i = 0; i < prevouts.size(); i++)
+        {
+            auto it = minerStakeCache.find(prevouts[i]);
+            minerStakeTable[i] = it != minerStakeCache.end() ? it->second : CStakeCache();
+        }
         if(!fHasMinerStakeCache) fHasMinerStakeCache = true;
     }
 }
@@ -6440,16 +7197,31 @@ bool CWallet::SelectCoinsForStaking(interfaces::Chain::Lock &locked_chain, CAmou
     int coinbaseMaturity = Params().GetConsensus().CoinbaseMaturity(nHeight);
     std::map<COutPoint, uint32_t> immatureStakes = locked_chain.getImmatureStakes();
     std::vector<uint256> maturedTx;
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    for (std::set<uint256>::const_iterator it = setStakeCandidates.begin(); it != setStakeCandidates.end();)
     {
+        std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(*it);
+        if (mi == mapWallet.end())
+        {
+            it = setStakeCandidates.erase(it);
+            continue;
+        }
+
         // Check the cached data for available coins for the tx
-        const CWalletTx* pcoin = &(*it).second;
+        const CWalletTx* pcoin = &(*mi).second;
         const CAmount tx_credit_mine{pcoin->GetAvailableCredit(locked_chain, /* fUseCache */ true, ISMINE_SPENDABLE | ISMINE_NO)};
+        const uint256& wtxid = mi->first;
+        int nDepth = pcoin->GetDepthInMainChain(locked_chain);
+
         if(tx_credit_mine == 0)
+        {
+            // No coins left once matured, the transaction is marked dirty again when one of its outputs become unspent
+            if (nDepth >= coinbaseMaturity && pcoin->GetBlocksToMaturity(locked_chain) == 0)
+                it = setStakeCandidates.erase(it);
+            else
+                ++it;
             continue;
-
-        const uint256& wtxid = it->first;
-        int nDepth = pcoin->GetDepthInMainChain(locked_chain);
+        }
+        ++it;
 
         if (nDepth < 1)
             continue;
@@ -6528,6 +7300,66 @@ bool CWallet::SelectCoinsForStaking(interfaces::Chain::Lock &locked_chain, CAmou
     return true;
 }
 
+void CWallet::MarkStakeCandidate(const uint256& hash) const
+{
+    setStakeCandidates.insert(hash);
+}
+
+void CWallet::MarkCoinCandidate(const uint256& hash) const
+{
+    setCoinCandidates.insert(hash);
+}
+
+bool CWallet::GetDelegateUtxos(const uint160& keyid, std::vector<CDelegateUtxo>& utxos) const
+{
+    // Decode address
+    uint256 hashBytes;
+    int type = 0;
+    if (!DecodeIndexKey(EncodeDestination(CKeyID(keyid)), hashBytes, type)) {
+        return error("Invalid address");
+    }
+
+    // The totals of the address are updated with its unspent outputs, use the cached utxos while
+    // the last block that changed them is the same
+    CAddressBalanceValue totals;
+    CBlockIndex* pindexLast = nullptr;
+    if (GetAddressBalance(hashBytes, type, totals)) {
+        pindexLast = chainActive[totals.lastHeight];
+    }
+    if (pindexLast) {
+        LOCK(cs_worker);
+        auto it = mapDelegateUtxoCache.find(keyid);
+        if (it != mapDelegateUtxoCache.end() && it->second.lastBlockHash == pindexLast->GetBlockHash()) {
+            utxos = it->second.utxos;
+            return true;
+        }
+    }
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    if (!GetAddressUnspent(hashBytes, type, unspentOutputs)) {
+        throw error("No information available for address");
+    }
+
+    utxos.clear();
+    utxos.reserve(unspentOutputs.size());
+    for (const auto& output : unspentOutputs) {
+        CDelegateUtxo utxo;
+        utxo.prevout = COutPoint(output.first.txhash, output.first.index);
+        utxo.blockHeight = output.second.blockHeight;
+        utxo.amount = output.second.satoshis;
+        utxos.push_back(utxo);
+    }
+
+    if (pindexLast) {
+        LOCK(cs_worker);
+        CDelegateUtxoCache& cache = mapDelegateUtxoCache[keyid];
+        cache.lastBlockHash = pindexLast->GetBlockHash();
+        cache.utxos = utxos;
+    }
+
+    return true;
+}
+
 bool CWallet::AvailableDelegateCoinsForStaking(const std::vector<uint160>& delegations, size_t from, size_t to, int32_t height, const std::map<COutPoint, uint32_t>& immatureStakes,  const std::map<uint256, CSuperStakerInfo>& mapStakers, std::vector<std::pair<COutPoint,CAmount>>& vUnsortedDelegateCoins, std::map<uint160, CAmount> &mDelegateWeight) const
 {
     for(size_t i = from; i < to; i++)
@@ -6562,35 +7394,27 @@ bool CWallet::AvailableDelegateCoinsForStaking(const std::vector<uint160>& deleg
         if(delegation->fee < staking_min_fee)
             continue;
 
-        // Decode address
-        uint256 hashBytes;
-        int type = 0;
-        if (!DecodeIndexKey(EncodeDestination(keyid), hashBytes, type)) {
-            return error("Invalid address");
-        }
-
         // Get address utxos
-        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
-        if (!GetAddressUnspent(hashBytes, type, unspentOutputs)) {
-            throw error("No information available for address");
+        std::vector<CDelegateUtxo> utxos;
+        if (!GetDelegateUtxos(keyid, utxos)) {
+            return false;
         }
 
         // Add the utxos to the list if they are mature and at least the minimum value
         int coinbaseMaturity = Params().GetConsensus().CoinbaseMaturity(height + 1);
-        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator i=unspentOutputs.begin(); i!=unspentOutputs.end(); i++) {
+        for (const CDelegateUtxo& utxo : utxos) {
 
-            int nDepth = height - i->second.blockHeight + 1;
+            int nDepth = height - utxo.blockHeight + 1;
             if (nDepth < coinbaseMaturity)
                 continue;
 
-            if(i->second.satoshis < staking_min_utxo_value)
+            if(utxo.amount < staking_min_utxo_value)
                 continue;
 
-            COutPoint prevout = COutPoint(i->first.txhash, i->first.index);
-            if(immatureStakes.find(prevout) == immatureStakes.end())
+            if(immatureStakes.find(utxo.prevout) == immatureStakes.end())
             {
-                vUnsortedDelegateCoins.push_back(std::make_pair(prevout, i->second.satoshis));
-                weight+= i->second.satoshis;
+                vUnsortedDelegateCoins.push_back(std::make_pair(utxo.prevout, utxo.amount));
+                weight+= utxo.amount;
             }
         }
 
@@ -6623,6 +7447,18 @@ bool CWallet::SelectDelegateCoinsForStaking(interfaces::Chain::Lock &locked_chai
     {
         delegations.push_back(it->first);
     }
+
+    // Remove the cached utxos of the removed delegations
+    {
+        LOCK(cs_worker);
+        for (auto it = mapDelegateUtxoCache.begin(); it != mapDelegateUtxoCache.end();)
+        {
+            if (m_delegations_staker.find(it->first) == m_delegations_staker.end())
+                it = mapDelegateUtxoCache.erase(it);
+            else
+                ++it;
+        }
+    }
     size_t listSize = delegations.size();
     int numThreads = std::min(m_num_threads, (int)listSize);
     bool ret = true;
@@ -114,6 +114,23 @@ static const CAmount DEFAULT_STAKER_MIN_UTXO_SIZE{COIN/10};
 //! -maxstakerutxoscriptcache default
 static const int32_t DEFAULT_STAKER_MAX_UTXO_SCRIPT_CACHE = 200000;
 
+//! -stakingsignthreads default, 0 = one per core
+static const int DEFAULT_STAKING_SIGN_THREADS = 0;
+//! Maximum number of threads signing the coinstake inputs
+static const int MAX_STAKING_SIGN_THREADS = 16;
+//! Least number of coinstake inputs worth signing on an own thread
+static const size_t MIN_STAKING_SIGN_INPUTS_PER_THREAD = 8;
+
+//! -stakingledger default
+static const bool DEFAULT_STAKING_LEDGER = false;
+
+//! -rescanthreads default, 0 = one per core
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of threads reading and matching blocks during a rescan
+static const int MAX_RESCAN_THREADS = 16;
+//! -rescanaddressindex default
+static const bool DEFAULT_RESCAN_ADDRESS_INDEX = false;
+
 class CCoinControl;
 class COutput;
 class CReserveKey;
@@ -509,18 +526,8 @@ public:
     }
 
     //! make sure balances are recalculated
-    void MarkDirty()
-    {
-        fCreditCached = false;
-        fAvailableCreditCached = false;
-        fImmatureCreditCached = false;
-        fWatchDebitCached = false;
-        fWatchCreditCached = false;
-        fAvailableWatchCreditCached = false;
-        fImmatureWatchCreditCached = false;
-        fDebitCached = false;
-        fChangeCached = false;
-    }
+    //! Also marks the transaction as a stake candidate of the wallet
+    void MarkDirty();
 
     void BindWallet(CWallet *pwalletIn)
     {
@@ -667,6 +674,43 @@ struct CScriptCache{
     bool solvable = false;
 };
 
+struct CDelegateUtxo{
+    COutPoint prevout;
+    int blockHeight = 0;
+    CAmount amount = 0;
+};
+
+struct CDelegateUtxoCache{
+    // Last block that changed the address totals when the utxos were read
+    uint256 lastBlockHash;
+    std::vector<CDelegateUtxo> utxos;
+};
+
+/** Performance of the staker of a wallet, times in microseconds */
+struct StakerStats {
+    //! Kernel hashes checked and the time spent checking them
+    std::atomic<uint64_t> nKernelChecks{0};
+    std::atomic<int64_t> nKernelTime{0};
+    //! Refreshes of the staking coins and the empty block after a tip change
+    std::atomic<uint64_t> nUpdates{0};
+    std::atomic<int64_t> nUpdateTime{0};
+    std::atomic<int64_t> nLastUpdateTime{0};
+    //! Templates built with transactions for a solved slot
+    std::atomic<uint64_t> nTemplates{0};
+    std::atomic<int64_t> nTemplateTime{0};
+    std::atomic<int64_t> nLastTemplateTime{0};
+    //! Signatures of the filled blocks
+    std::atomic<uint64_t> nSignatures{0};
+    std::atomic<int64_t> nSignTime{0};
+    std::atomic<int64_t> nLastSignTime{0};
+    //! Delay from a tip change to the first kernel scan on it
+    std::atomic<uint64_t> nTipScans{0};
+    std::atomic<int64_t> nTipDelayTime{0};
+    std::atomic<int64_t> nLastTipDelay{0};
+    //! Slots at the same tip that passed without a kernel scan
+    std::atomic<uint64_t> nMissedSlots{0};
+};
+
 class WalletRescanReserver; //forward declarations for ScanForWalletTransactions/RescanFromTime
 /**
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
@@ -696,6 +740,14 @@ private:
     std::map<COutPoint, CStakeCache> stakeDelegateCache;
     bool fHasMinerStakeCache = false;
     mutable std::map<COutPoint, CScriptCache> prevoutScriptCache;
+    // Wallet transactions that may have coins for staking, protected by cs_wallet
+    // A transaction is removed once all its matured outputs are spent and added again when marked dirty
+    mutable std::set<uint256> setStakeCandidates;
+    // Wallet transactions that may have coins for AvailableCoins, protected by cs_wallet
+    // A transaction is removed once it is matured and none of its outputs of ours is unspent, and added again when marked dirty
+    mutable std::set<uint256> setCoinCandidates;
+    // Delegate utxos, read again from the address index only when the address totals changed
+    mutable std::map<uint160, CDelegateUtxoCache> mapDelegateUtxoCache;
 
     /**
      * Used to keep track of spent outpoints, and
@@ -709,6 +761,17 @@ private:
     void AddToSpends(const uint256& wtxid) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
     void RemoveFromSpends(const uint256& wtxid) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
+    /* Rescan helpers: the address index keys of the destinations the wallet can recognize, and whether
+     * a transaction spends from the wallet */
+    std::set<std::pair<uint256, int>> GetAddressIndexKeys() const;
+    bool IsRescanSpend(const CTransaction& tx) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /* Indexes of mapTokenTx by contract address and by sender and receiver address */
+    std::multimap<std::string, uint256> mapTokenTxByContract;
+    std::multimap<std::string, uint256> mapTokenTxByAddress;
+    void AddToTokenTxIndex(const uint256& hash, const CTokenTx& tokenTx);
+    void RemoveFromTokenTxIndex(const uint256& hash, const CTokenTx& tokenTx);
+
     /**
      * Add a transaction to the wallet, or update it.  pIndex and posInBlock should
      * be set when the transaction was known to be included in a block.  When
@@ -872,10 +935,11 @@ public:
 
     std::map<uint256, CSuperStakerInfo> mapSuperStaker;
 
-    bool fUpdatedSuperStaker = false;
-
     std::map<COutPoint, CStakeCache> minerStakeCache;
 
+    // Cache entries of the staker prevouts, in the same order as the prevouts passed to UpdateMinerStakeCache
+    std::vector<CStakeCache> minerStakeTable;
+
     std::map<uint160, bool> mapAddressUnspentCache;
 
     bool fUpdateAddressUnspentCache = false;
@@ -898,6 +962,9 @@ public:
      */
     void AvailableCoinsForStaking(interfaces::Chain::Lock& locked_chain, const std::vector<uint256>& maturedTx, size_t from, size_t to, const std::map<COutPoint, uint32_t>& immatureStakes, std::vector<std::pair<const CWalletTx *, unsigned int> >& vCoins, std::map<COutPoint, CScriptCache>* insertScriptCache) const;
     void AvailableCoins(interfaces::Chain::Lock& locked_chain, std::vector<COutput>& vCoins, bool fOnlySafe=true, const CCoinControl *coinControl = nullptr, const CAmount& nMinimumAmount = 1, const CAmount& nMaximumAmount = MAX_MONEY, const CAmount& nMinimumSumAmount = MAX_MONEY, const uint64_t nMaximumCount = 0, const int nMinDepth = 0, const int nMaxDepth = 9999999, const CTxDestination& signSenderAddress=CNoDestination(), const CTxDestination& senderAddess=CNoDestination()) const EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+    void MarkStakeCandidate(const uint256& hash) const;
+    void MarkCoinCandidate(const uint256& hash) const;
+    bool GetDelegateUtxos(const uint160& keyid, std::vector<CDelegateUtxo>& utxos) const;
     bool AvailableDelegateCoinsForStaking(const std::vector<uint160>& delegations, size_t from, size_t to, int32_t height, const std::map<COutPoint, uint32_t>& immatureStakes,  const std::map<uint256, CSuperStakerInfo>& mapStakers, std::vector<std::pair<COutPoint,CAmount>>& vUnsortedDelegateCoins, std::map<uint160, CAmount> &mDelegateWeight) const;
     bool GetSuperStaker(CSuperStakerInfo &info, const uint160& stakerAddress) const;
     void GetStakerAddressBalance(interfaces::Chain::Lock& locked_chain, const CKeyID& staker, CAmount& balance, CAmount& stake, CAmount& weight) const;
@@ -1102,11 +1169,16 @@ public:
     CAmount m_reserve_balance{DEFAULT_RESERVE_BALANCE};
     int64_t m_last_coin_stake_search_time{0};
     int64_t m_last_coin_stake_search_interval{0};
+    StakerStats m_staker_stats;
     std::atomic<bool> m_enabled_staking{false};
     CAmount m_staking_min_utxo_value{DEFAULT_STAKING_MIN_UTXO_VALUE};
     CAmount m_staker_min_utxo_size{DEFAULT_STAKER_MIN_UTXO_SIZE};
     int32_t m_staker_max_utxo_script_cache{DEFAULT_STAKER_MAX_UTXO_SCRIPT_CACHE};
     uint8_t m_staking_min_fee{DEFAULT_STAKING_MIN_FEE};
+    int m_staking_sign_threads{1};
+    // Staking ledger mode: no wallet transactions are loaded or tracked, the wallet only
+    // stakes the delegated utxos read from the address index
+    bool m_staking_ledger{DEFAULT_STAKING_LEDGER};
     std::atomic<bool> m_stop_staking_thread{false};
 
     bool NewKeyPool();
@@ -1135,6 +1207,7 @@ public:
     bool GetKeyFromPool(CPubKey &key, bool internal = false);
     bool CreateCoinStakeFromMine(interfaces::Chain::Lock& locked_chain, const CKeyStore &keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins, std::vector<COutPoint>& setSelectedCoins, bool selectedOnly, COutPoint& headerPrevout);
     bool CreateCoinStakeFromDelegate(interfaces::Chain::Lock& locked_chain, const CKeyStore &keystore, unsigned int nBits, const CAmount& nTotalFees, uint32_t nTimeBlock, CMutableTransaction& tx, CKey& key, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins, std::vector<COutPoint>& setDelegateCoins, std::vector<unsigned char>& vchPoD, COutPoint& headerPrevout);
+    bool SignCoinStake(CMutableTransaction& txNew, const std::vector<const CWalletTx*>& vwtxPrev) const;
     bool GetDelegationStaker(const uint160& keyid, Delegation& delegation);
     const CWalletTx* GetCoinSuperStaker(const std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins, const CKeyID& superStaker, COutPoint& prevout, CAmount& nValueRet);
     int64_t GetOldestKeyPoolTime();
@@ -1259,6 +1332,12 @@ public:
     boost::signals2::signal<void (CWallet *wallet, const uint256 &hashToken,
             ChangeType status)> NotifyTokenChanged;
 
+    /**
+     * Tracked balance of a token entry changed, or has to be seeded again.
+     * @note called with lock cs_wallet held.
+     */
+    boost::signals2::signal<void (CWallet *wallet, const uint256 &hashToken)> NotifyTokenBalanceChanged;
+
     /** Contract book entry changed. */
     boost::signals2::signal<void (CWallet *wallet, const std::string &address,
             const std::string &label, const std::string &abi,
@@ -1384,9 +1463,23 @@ public:
 
     /* Add token entry into the wallet */
     bool AddTokenEntry(const CTokenInfo& token, bool fFlushOnClose=true);
+    bool AddTokenEntry(WalletBatch& batch, const CTokenInfo& token) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     /* Add token tx entry into the wallet */
     bool AddTokenTxEntry(const CTokenTx& tokenTx, bool fFlushOnClose=true);
+    bool AddTokenTxEntry(WalletBatch& batch, const CTokenTx& tokenTx) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
+
+    /* Get the token tx entries of a contract, only the ones of an address when it is not empty, ordered by block height */
+    std::vector<CTokenTx> GetTokenTxEntries(const std::string& strContractAddress, const std::string& strAddress = "") const;
+
+    /* Add token tx entries into the wallet in one database transaction */
+    bool AddTokenTxEntries(const std::vector<CTokenTx>& tokenTxs, bool fFlushOnClose=true);
+
+    /* Get the tracked balance of a token entry, seeded with a single balanceOf call when not known yet */
+    bool GetTokenBalance(const uint256& tokenHash, uint256& balance);
+
+    /* Add the token transfers of a connected block and advance the tracked token balances */
+    void SyncTokenTransfers(const CBlock& block, const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     /* Get details token tx entry into the wallet */
     bool GetTokenTxDetails(const CTokenTx &wtx, uint256& credit, uint256& debit, std::string& tokenSymbol, uint8_t& decimals) const;
@@ -1402,6 +1495,7 @@ public:
 
     /* Add delegation entry into the wallet */
     bool AddDelegationEntry(const CDelegationInfo& delegation, bool fFlushOnClose=true);
+    bool AddDelegationEntry(WalletBatch& batch, const CDelegationInfo& delegation) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     /* Remove delegation entry from the wallet */
     bool RemoveDelegationEntry(const uint256& delegationHash, bool fFlushOnClose=true);
@@ -1411,6 +1505,7 @@ public:
 
     /* Add super staker entry into the wallet */
     bool AddSuperStakerEntry(const CSuperStakerInfo& superStaker, bool fFlushOnClose=true);
+    bool AddSuperStakerEntry(WalletBatch& batch, const CSuperStakerInfo& superStaker) EXCLUSIVE_LOCKS_REQUIRED(cs_wallet);
 
     /* Remove super staker entry from the wallet */
     bool RemoveSuperStakerEntry(const uint256& superStakerHash, bool fFlushOnClose=true);
@@ -1432,11 +1527,20 @@ public:
 
     static CConnman* defaultConnman;
 
+    /* Size of the key store, to notice the keys learnt since a point in time */
+    size_t GetKeyStoreSize() const;
+
     void updateDelegationsStaker(const std::map<uint160, Delegation>& delegations_staker);
+    void updateDelegationsStakerChanges(const std::map<uint160, Delegation>& changes);
     void updateDelegationsWeight(const std::map<uint160, CAmount>& delegations_weight);
     void updateHaveCoinSuperStaker(const std::set<std::pair<const CWalletTx*,unsigned int> >& setCoins);
+    /* Notify the super stakers whose delegations weight changed */
+    void notifySuperStakersChanged(const std::set<uint160>& stakers);
 
     std::map<uint160, Delegation> m_delegations_staker;
+    // Delegation index version and key store size m_delegations_staker is up to date with, a zero version gets all the delegations again
+    uint64_t m_delegations_staker_version = 0;
+    size_t m_delegations_staker_keys = 0;
     std::map<uint160, CAmount> m_delegations_weight;
     std::map<uint160, Delegation> m_my_delegations;
     std::map<uint160, bool> m_have_coin_superstaker;
@@ -1548,7 +1652,7 @@ int64_t CalculateMaximumSignedTxSize(const CTransaction &tx, const CWallet *wall
 class CTokenInfo
 {
 public:
-    static const int CURRENT_VERSION=1;
+    static const int CURRENT_VERSION=2;
     int nVersion;
     std::string strContractAddress;
     std::string strTokenName;
@@ -1561,6 +1665,11 @@ public:
     uint256 blockHash;
     int64_t blockNumber;
 
+    // Balance of the sender address as of balanceBlockHash, kept current from the Transfer
+    // logs of the connected blocks. A null balanceBlockHash means the balance is not known yet.
+    uint256 nBalance;
+    uint256 balanceBlockHash;
+
     CTokenInfo()
     {
         SetNull();
@@ -1578,6 +1687,11 @@ public:
             READWRITE(strTokenSymbol);
             READWRITE(blockHash);
             READWRITE(blockNumber);
+            if (nVersion >= 2)
+            {
+                READWRITE(nBalance);
+                READWRITE(balanceBlockHash);
+            }
         }
         READWRITE(nDecimals);
         READWRITE(strContractAddress);
@@ -1595,6 +1709,8 @@ public:
         strSenderAddress = "";
         blockHash.SetNull();
         blockNumber = -1;
+        nBalance.SetNull();
+        balanceBlockHash.SetNull();
     }
 
     uint256 GetHash() const;
@@ -163,6 +163,7 @@ public:
     unsigned int nWatchKeys{0};
     unsigned int nKeyMeta{0};
     unsigned int m_unknown_records{0};
+    unsigned int nSkippedTxs{0};
     bool fIsEncrypted{false};
     bool fAnyUnordered{false};
     int nFileVersion{0};
@@ -193,6 +194,11 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             ssKey >> strAddress;
             ssValue >> pwallet->mapAddressBook[DecodeDestination(strAddress)].purpose;
         }
+        else if (strType == "tx" && pwallet->m_staking_ledger)
+        {
+            // The staking ledger does not keep wallet transactions
+            wss.nSkippedTxs++;
+        }
         else if (strType == "tx")
         {
             uint256 hash;
@@ -585,6 +591,9 @@ DBErrors WalletBatch::LoadWallet(CWallet* pwallet)
     pwallet->WalletLogPrintf("Keys: %u plaintext, %u encrypted, %u w/ metadata, %u total. Unknown wallet records: %u\n",
            wss.nKeys, wss.nCKeys, wss.nKeyMeta, wss.nKeys + wss.nCKeys, wss.m_unknown_records);
 
+    if (pwallet->m_staking_ledger)
+        pwallet->WalletLogPrintf("Staking ledger: %u wallet transactions not loaded\n", wss.nSkippedTxs);
+
     // nTimeFirstKey is only reliable if all keys have metadata
     if ((wss.nKeys + wss.nCKeys + wss.nWatchKeys) != wss.nKeyMeta)
         pwallet->UpdateTimeFirstKey(1);
@@ -0,0 +1,715 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <websocket.h>
+
+#include <chain.h>
+#include <chainparamsbase.h>
+#include <core_io.h>
+#include <crypto/sha1.h>
+#include <httprpc.h>
+#include <httpserver.h>
+#include <netbase.h>
+#include <qtum/storageresults.h>
+#include <rpc/blockchain.h>
+#include <rpc/contract_util.h>
+#include <rpc/protocol.h>
+#include <rpc/server.h>
+#include <sync.h>
+#include <util/convert.h>
+#include <util/strencodings.h>
+#include <util/system.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <univalue.h>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/util.h>
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <boost/algorithm/string.hpp>
+
+enum WSTopic {
+    WS_HEADERS,
+    WS_MEMPOOL,
+    WS_RECEIPTS,
+    WS_LOGS,
+    WS_TOPICS
+};
+
+static const char* const wsTopicNames[WS_TOPICS] = {"headers", "mempool", "receipts", "logs"};
+
+static const uint8_t WS_OP_CONTINUATION = 0x0;
+static const uint8_t WS_OP_TEXT = 0x1;
+static const uint8_t WS_OP_CLOSE = 0x8;
+static const uint8_t WS_OP_PING = 0x9;
+static const uint8_t WS_OP_PONG = 0xa;
+
+static const uint16_t WS_CLOSE_NORMAL = 1000;
+static const uint16_t WS_CLOSE_PROTOCOL_ERROR = 1002;
+static const uint16_t WS_CLOSE_UNSUPPORTED = 1003;
+static const uint16_t WS_CLOSE_TOO_BIG = 1009;
+
+static const char* const WS_ACCEPT_GUID = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+static const size_t MAX_HANDSHAKE_SIZE = 8192;
+static const size_t MAX_LOG_FILTER_SIZE = 100;
+static const int WS_TIMEOUT = 60;
+
+/** A log subscription matches the logs of one of the addresses carrying one of the topics, an empty set matches all */
+struct WSSubscription {
+    WSTopic topic;
+    std::set<dev::h160> addresses;
+    std::set<dev::h256> topics;
+};
+
+/** A notification encoded once, with what the log filters are matched against */
+struct WSEvent {
+    //! Bits of the topics whose subscribers receive it
+    uint32_t topicMask;
+    std::shared_ptr<const std::string> frame;
+    //! A log, matched against the filters of the log subscriptions
+    bool fLog;
+    dev::h160 address;
+    std::vector<dev::h256> logTopics;
+};
+
+/** A client connection, only used on the event loop thread */
+struct WSClient {
+    uint64_t id;
+    struct bufferevent* bev;
+    CService peer;
+    bool upgraded = false;
+    bool closing = false;
+    //! The fragments of the message being received
+    bool inMessage = false;
+    uint8_t messageOpcode = 0;
+    std::string message;
+    uint64_t nextSubscription = 1;
+    std::map<uint64_t, WSSubscription> subscriptions;
+
+    bool Matches(const WSEvent& event) const
+    {
+        for (const auto& entry : subscriptions) {
+            const WSSubscription& sub = entry.second;
+            if (!(event.topicMask & (1u << sub.topic)))
+                continue;
+            if (sub.topic != WS_LOGS || !event.fLog)
+                return true;
+            if (!sub.addresses.empty() && !sub.addresses.count(event.address))
+                continue;
+            if (!sub.topics.empty() && std::none_of(event.logTopics.begin(), event.logTopics.end(), [&sub](const dev::h256& topic) { return sub.topics.count(topic) > 0; }))
+                continue;
+            return true;
+        }
+        return false;
+    }
+};
+
+static std::vector<struct evconnlistener*> wsListeners;
+//! The connections, only used on the event loop thread
+static std::map<uint64_t, std::unique_ptr<WSClient>> wsClients;
+static uint64_t nNextClientId = 0;
+static size_t nMaxConnections = DEFAULT_WEBSOCKET_MAX_CONNECTIONS;
+static size_t nMaxBuffer = (size_t)DEFAULT_WEBSOCKET_MAX_BUFFER << 20;
+static bool fWebSocketStarted = false;
+
+//! Subscriptions by topic, so nothing is encoded for a topic without subscribers
+static std::atomic<int> wsSubscribers[WS_TOPICS];
+
+static Mutex cs_wsQueue;
+static std::deque<WSEvent> wsQueue GUARDED_BY(cs_wsQueue);
+//! Moves the queued notifications to the clients on the event loop thread
+static std::unique_ptr<HTTPEvent> wsDispatch GUARDED_BY(cs_wsQueue);
+
+static std::string EncodeFrame(uint8_t opcode, const std::string& payload)
+{
+    std::string frame;
+    frame.reserve(payload.size() + 10);
+    frame.push_back((char)(0x80 | opcode));
+    if (payload.size() < 126) {
+        frame.push_back((char)payload.size());
+    } else if (payload.size() <= 0xffff) {
+        frame.push_back((char)126);
+        frame.push_back((char)(payload.size() >> 8));
+        frame.push_back((char)(payload.size() & 0xff));
+    } else {
+        frame.push_back((char)127);
+        for (int i = 7; i >= 0; i--)
+            frame.push_back((char)((uint64_t)payload.size() >> (8 * i)));
+    }
+    frame += payload;
+    return frame;
+}
+
+static std::shared_ptr<const std::string> EncodeNotification(WSTopic topic, const UniValue& data)
+{
+    UniValue notification(UniValue::VOBJ);
+    notification.pushKV("topic", wsTopicNames[topic]);
+    notification.pushKV("data", data);
+    return std::make_shared<const std::string>(EncodeFrame(WS_OP_TEXT, notification.write()));
+}
+
+static void QueueEvents(std::vector<WSEvent>&& events)
+{
+    if (events.empty())
+        return;
+    LOCK(cs_wsQueue);
+    if (!wsDispatch)
+        return;
+    for (WSEvent& event : events)
+        wsQueue.push_back(std::move(event));
+    wsDispatch->trigger(nullptr);
+}
+
+static void ReleaseFrame(const void*, size_t, void* arg)
+{
+    delete static_cast<std::shared_ptr<const std::string>*>(arg);
+}
+
+static void RemoveSubscriptions(WSClient& client)
+{
+    for (const auto& entry : client.subscriptions)
+        wsSubscribers[entry.second.topic]--;
+    client.subscriptions.clear();
+}
+
+static void FreeClient(WSClient* client)
+{
+    LogPrint(BCLog::HTTP, "WebSocket connection from %s closed\n", client->peer.ToString());
+    RemoveSubscriptions(*client);
+    bufferevent_free(client->bev);
+    wsClients.erase(client->id);
+}
+
+static void ws_close_write_cb(struct bufferevent*, void* arg)
+{
+    // The reply or close frame was written
+    FreeClient(static_cast<WSClient*>(arg));
+}
+
+static void ws_event_cb(struct bufferevent*, short what, void* arg)
+{
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR | BEV_EVENT_TIMEOUT))
+        FreeClient(static_cast<WSClient*>(arg));
+}
+
+/** Stop reading and free the connection once its output is written, there is always a reply or close frame in it */
+static void StartClosing(WSClient& client)
+{
+    client.closing = true;
+    RemoveSubscriptions(client);
+    bufferevent_disable(client.bev, EV_READ);
+    bufferevent_setcb(client.bev, nullptr, ws_close_write_cb, ws_event_cb, &client);
+}
+
+static void SendFrame(WSClient& client, uint8_t opcode, const std::string& payload)
+{
+    const std::string frame = EncodeFrame(opcode, payload);
+    bufferevent_write(client.bev, frame.data(), frame.size());
+}
+
+static void CloseClient(WSClient& client, uint16_t code)
+{
+    if (client.closing)
+        return;
+    std::string payload;
+    payload.push_back((char)(code >> 8));
+    payload.push_back((char)(code & 0xff));
+    SendFrame(client, WS_OP_CLOSE, payload);
+    StartClosing(client);
+}
+
+static void SendHTTPError(WSClient& client, const std::string& status, const std::string& extraHeaders = "")
+{
+    const std::string reply = "HTTP/1.1 " + status + "\r\nConnection: close\r\nContent-Length: 0\r\n" + extraHeaders + "\r\n";
+    bufferevent_write(client.bev, reply.data(), reply.size());
+    StartClosing(client);
+}
+
+static void ParseLogFilter(const UniValue& filter, WSSubscription& sub)
+{
+    if (filter.isNull())
+        return;
+    if (!filter.isObject())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid log filter");
+    const UniValue& addresses = find_value(filter, "addresses");
+    if (!addresses.isNull()) {
+        if (!addresses.isArray() || addresses.size() > MAX_LOG_FILTER_SIZE)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid addresses filter");
+        for (const UniValue& address : addresses.getValues()) {
+            if (!address.isStr() || address.get_str().size() != 40 || !IsHex(address.get_str()))
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid contract address");
+            sub.addresses.insert(dev::h160(address.get_str()));
+        }
+    }
+    const UniValue& topics = find_value(filter, "topics");
+    if (!topics.isNull()) {
+        if (!topics.isArray() || topics.size() > MAX_LOG_FILTER_SIZE)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid topics filter");
+        for (const UniValue& topic : topics.getValues()) {
+            if (!topic.isStr() || topic.get_str().size() != 64 || !IsHex(topic.get_str()))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid topic");
+            sub.topics.insert(dev::h256(topic.get_str()));
+        }
+    }
+}
+
+static UniValue HandleRequest(WSClient& client, const std::string& method, const UniValue& params)
+{
+    if (method == "subscribe") {
+        if (params.empty() || !params[0].isStr())
+            throw JSONRPCError(RPC_INVALID_PARAMS, "Expected a topic");
+        WSSubscription sub;
+        const std::string& name = params[0].get_str();
+        const char* const* found = std::find(wsTopicNames, wsTopicNames + WS_TOPICS, name);
+        if (found == wsTopicNames + WS_TOPICS)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown topic " + name);
+        sub.topic = (WSTopic)(found - wsTopicNames);
+        if ((sub.topic == WS_RECEIPTS || sub.topic == WS_LOGS) && !fLogEvents)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Events indexing disabled");
+        if (sub.topic == WS_LOGS && params.size() > 1)
+            ParseLogFilter(params[1], sub);
+        if (client.subscriptions.size() >= MAX_WEBSOCKET_SUBSCRIPTIONS)
+            throw JSONRPCError(RPC_INVALID_REQUEST, "Too many subscriptions");
+        uint64_t id = client.nextSubscription++;
+        wsSubscribers[sub.topic]++;
+        client.subscriptions.emplace(id, std::move(sub));
+        return UniValue(id);
+    }
+    if (method == "unsubscribe") {
+        if (params.empty() || !params[0].isNum())
+            throw JSONRPCError(RPC_INVALID_PARAMS, "Expected a subscription");
+        auto it = client.subscriptions.find(params[0].get_int64());
+        if (it == client.subscriptions.end())
+            return UniValue(false);
+        wsSubscribers[it->second.topic]--;
+        client.subscriptions.erase(it);
+        return UniValue(true);
+    }
+    throw JSONRPCError(RPC_METHOD_NOT_FOUND, "Method not found");
+}
+
+static void HandleMessage(WSClient& client, const std::string& message)
+{
+    UniValue request;
+    UniValue id;
+    UniValue reply;
+    try {
+        if (!request.read(message) || !request.isObject())
+            throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
+        id = find_value(request, "id");
+        const UniValue& method = find_value(request, "method");
+        if (!method.isStr())
+            throw JSONRPCError(RPC_INVALID_REQUEST, "Method must be a string");
+        const UniValue& params = find_value(request, "params");
+        if (!params.isNull() && !params.isArray())
+            throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
+        reply = JSONRPCReplyObj(HandleRequest(client, method.get_str(), params.isNull() ? UniValue(UniValue::VARR) : params), NullUniValue, id);
+    } catch (const UniValue& objError) {
+        reply = JSONRPCReplyObj(NullUniValue, objError, id);
+    } catch (const std::exception& e) {
+        reply = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_PARSE_ERROR, e.what()), id);
+    }
+    SendFrame(client, WS_OP_TEXT, reply.write());
+}
+
+/** Answer the upgrade request once its headers are in. Returns false while they are incomplete */
+static bool ReadHandshake(WSClient& client)
+{
+    struct evbuffer* input = bufferevent_get_input(client.bev);
+    struct evbuffer_ptr end = evbuffer_search(input, "\r\n\r\n", 4, nullptr);
+    if (end.pos < 0) {
+        if (evbuffer_get_length(input) > MAX_HANDSHAKE_SIZE)
+            SendHTTPError(client, "431 Request Header Fields Too Large");
+        return false;
+    }
+    if ((size_t)end.pos > MAX_HANDSHAKE_SIZE) {
+        SendHTTPError(client, "431 Request Header Fields Too Large");
+        return false;
+    }
+    std::string request((size_t)end.pos + 4, '\0');
+    evbuffer_remove(input, &request[0], request.size());
+
+    std::vector<std::string> lines;
+    boost::split(lines, request, boost::is_any_of("\n"));
+    std::map<std::string, std::string> headers;
+    for (size_t i = 1; i < lines.size(); i++) {
+        size_t colon = lines[i].find(':');
+        if (colon == std::string::npos)
+            continue;
+        std::string name = lines[i].substr(0, colon);
+        std::string value = lines[i].substr(colon + 1);
+        boost::trim(name);
+        boost::trim(value);
+        headers[boost::to_lower_copy(name)] = value;
+    }
+
+    const std::string& key = headers["sec-websocket-key"];
+    if (request.compare(0, 4, "GET ") != 0 || boost::to_lower_copy(headers["upgrade"]) != "websocket" ||
+        boost::to_lower_copy(headers["connection"]).find("upgrade") == std::string::npos || key.empty()) {
+        SendHTTPError(client, "400 Bad Request");
+        return false;
+    }
+    if (headers["sec-websocket-version"] != "13") {
+        SendHTTPError(client, "426 Upgrade Required", "Sec-WebSocket-Version: 13\r\n");
+        return false;
+    }
+    std::string user;
+    if (!RPCAuthorized(headers["authorization"], user)) {
+        LogPrintf("ThreadRPCServer incorrect password attempt from %s\n", client.peer.ToString());
+        SendHTTPError(client, "401 Unauthorized", "WWW-Authenticate: Basic realm=\"jsonrpc\"\r\n");
+        return false;
+    }
+
+    const std::string accept = key + WS_ACCEPT_GUID;
+    unsigned char hash[CSHA1::OUTPUT_SIZE];
+    CSHA1().Write((const unsigned char*)accept.data(), accept.size()).Finalize(hash);
+    const std::string reply = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: " +
+                              EncodeBase64(hash, sizeof(hash)) + "\r\n\r\n";
+    bufferevent_write(client.bev, reply.data(), reply.size());
+    client.upgraded = true;
+    // Subscribers may stay idle, only a client that stops reading its notifications times out
+    struct timeval tv = {WS_TIMEOUT, 0};
+    bufferevent_set_timeouts(client.bev, nullptr, &tv);
+    LogPrint(BCLog::HTTP, "WebSocket connection from %s upgraded for %s\n", client.peer.ToString(), user);
+    return true;
+}
+
+/** Handle the complete frames in the input of an upgraded connection */
+static void ReadFrames(WSClient& client)
+{
+    struct evbuffer* input = bufferevent_get_input(client.bev);
+    while (!client.closing) {
+        unsigned char header[14];
+        size_t avail = evbuffer_get_length(input);
+        if (avail < 2)
+            return;
+        evbuffer_copyout(input, header, std::min(avail, sizeof(header)));
+        bool fin = header[0] & 0x80;
+        uint8_t opcode = header[0] & 0x0f;
+        uint64_t len = header[1] & 0x7f;
+        size_t pos = 2;
+        if (len == 126) {
+            if (avail < 4)
+                return;
+            len = ((uint64_t)header[2] << 8) | header[3];
+            pos = 4;
+        } else if (len == 127) {
+            if (avail < 10)
+                return;
+            len = 0;
+            for (int i = 0; i < 8; i++)
+                len = (len << 8) | header[2 + i];
+            pos = 10;
+        }
+        // Frames of clients are masked and use no extension
+        if (!(header[1] & 0x80) || (header[0] & 0x70)) {
+            CloseClient(client, WS_CLOSE_PROTOCOL_ERROR);
+            return;
+        }
+        if (len > MAX_WEBSOCKET_MESSAGE_SIZE || client.message.size() + len > MAX_WEBSOCKET_MESSAGE_SIZE) {
+            CloseClient(client, WS_CLOSE_TOO_BIG);
+            return;
+        }
+        if (avail < pos + 4 + len)
+            return;
+        unsigned char mask[4];
+        std::copy(header + pos, header + pos + 4, mask);
+        evbuffer_drain(input, pos + 4);
+        std::string payload((size_t)len, '\0');
+        if (len > 0)
+            evbuffer_remove(input, &payload[0], payload.size());
+        for (size_t i = 0; i < payload.size(); i++)
+            payload[i] ^= mask[i % 4];
+
+        if (opcode & 0x8) {
+            if (!fin || len > 125) {
+                CloseClient(client, WS_CLOSE_PROTOCOL_ERROR);
+            } else if (opcode == WS_OP_CLOSE) {
+                CloseClient(client, WS_CLOSE_NORMAL);
+            } else if (opcode == WS_OP_PING) {
+                SendFrame(client, WS_OP_PONG, payload);
+            } else if (opcode != WS_OP_PONG) {
+                CloseClient(client, WS_CLOSE_PROTOCOL_ERROR);
+            }
+            continue;
+        }
+        if ((opcode == WS_OP_CONTINUATION) != client.inMessage) {
+            CloseClient(client, WS_CLOSE_PROTOCOL_ERROR);
+            return;
+        }
+        if (opcode != WS_OP_CONTINUATION) {
+            client.inMessage = true;
+            client.messageOpcode = opcode;
+        }
+        client.message += payload;
+        if (fin) {
+            client.inMessage = false;
+            if (client.messageOpcode == WS_OP_TEXT) {
+                HandleMessage(client, client.message);
+            } else {
+                CloseClient(client, WS_CLOSE_UNSUPPORTED);
+            }
+            client.message.clear();
+        }
+    }
+}
+
+static void ws_read_cb(struct bufferevent*, void* arg)
+{
+    WSClient& client = *static_cast<WSClient*>(arg);
+    if (!client.upgraded && !ReadHandshake(client))
+        return;
+    ReadFrames(client);
+}
+
+static void ws_accept_cb(struct evconnlistener*, evutil_socket_t fd, struct sockaddr* address, int, void*)
+{
+    CService peer;
+    peer.SetSockAddr(address);
+    if (!ClientAllowed(peer)) {
+        LogPrint(BCLog::HTTP, "WebSocket connection from %s not allowed\n", peer.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+    if (wsClients.size() >= nMaxConnections) {
+        LogPrint(BCLog::HTTP, "WebSocket connection from %s refused, -wsmaxconnections reached\n", peer.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+    struct bufferevent* bev = bufferevent_socket_new(EventBase(), fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+    std::unique_ptr<WSClient> client = MakeUnique<WSClient>();
+    client->id = nNextClientId++;
+    client->bev = bev;
+    client->peer = peer;
+    bufferevent_setcb(bev, ws_read_cb, nullptr, ws_event_cb, client.get());
+    struct timeval tv;
+    tv.tv_sec = gArgs.GetArg("-rpcservertimeout", DEFAULT_HTTP_SERVER_TIMEOUT);
+    tv.tv_usec = 0;
+    bufferevent_set_timeouts(bev, &tv, &tv);
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+    wsClients.emplace(client->id, std::move(client));
+}
+
+/** Add the queued notifications to the output of their subscribers, on the event loop thread */
+static void DispatchEvents()
+{
+    std::deque<WSEvent> events;
+    {
+        LOCK(cs_wsQueue);
+        events.swap(wsQueue);
+    }
+    std::vector<WSClient*> dropped;
+    for (const WSEvent& event : events) {
+        for (const auto& entry : wsClients) {
+            WSClient& client = *entry.second;
+            if (client.closing || !client.upgraded || !client.Matches(event))
+                continue;
+            struct evbuffer* output = bufferevent_get_output(client.bev);
+            if (evbuffer_get_length(output) + event.frame->size() > nMaxBuffer) {
+                LogPrint(BCLog::HTTP, "WebSocket client %s does not keep up with its notifications, dropped\n", client.peer.ToString());
+                client.closing = true;
+                dropped.push_back(&client);
+                continue;
+            }
+            auto ref = new std::shared_ptr<const std::string>(event.frame);
+            if (evbuffer_add_reference(output, (*ref)->data(), (*ref)->size(), ReleaseFrame, ref) != 0)
+                delete ref;
+        }
+    }
+    for (WSClient* client : dropped)
+        FreeClient(client);
+}
+
+class WebSocketNotifier final : public CValidationInterface
+{
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+    {
+        if (wsSubscribers[WS_HEADERS] == 0 || fInitialDownload)
+            return;
+        UniValue header;
+        {
+            LOCK(cs_main);
+            header = blockheaderToJSON(chainActive.Tip(), pindexNew);
+        }
+        QueueEvents({WSEvent{1u << WS_HEADERS, EncodeNotification(WS_HEADERS, header), false, dev::h160(), {}}});
+    }
+
+    void TransactionAddedToMempool(const CTransactionRef& tx) override
+    {
+        if (wsSubscribers[WS_MEMPOOL] == 0)
+            return;
+        UniValue entry(UniValue::VOBJ);
+        TxToUniv(*tx, uint256(), entry, true, RPCSerializationFlags());
+        QueueEvents({WSEvent{1u << WS_MEMPOOL, EncodeNotification(WS_MEMPOOL, entry), false, dev::h160(), {}}});
+    }
+
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) override
+    {
+        bool fReceipts = wsSubscribers[WS_RECEIPTS] > 0;
+        bool fLogs = wsSubscribers[WS_LOGS] > 0;
+        if (!fLogEvents || !pstorageresult || (!fReceipts && !fLogs))
+            return;
+
+        // The receipts are committed before the block connection is notified
+        std::vector<WSEvent> events;
+        UniValue receipts(UniValue::VARR);
+        for (const auto& txReceipts : ReadBlockReceipts(*block)) {
+            uint32_t logIndex = 0;
+            for (const TransactionReceiptInfo& receipt : txReceipts.second) {
+                if (fReceipts) {
+                    UniValue entry(UniValue::VOBJ);
+                    transactionReceiptInfoToJSON(receipt, entry);
+                    receipts.push_back(entry);
+                }
+                if (!fLogs)
+                    continue;
+                for (const dev::eth::LogEntry& log : receipt.logs) {
+                    UniValue entry(UniValue::VOBJ);
+                    entry.pushKV("blockHash", pindex->GetBlockHash().GetHex());
+                    entry.pushKV("blockNumber", pindex->nHeight);
+                    entry.pushKV("transactionHash", txReceipts.first.GetHex());
+                    entry.pushKV("transactionIndex", (uint64_t)receipt.transactionIndex);
+                    entry.pushKV("logIndex", (uint64_t)logIndex++);
+                    assignJSON(entry, log, true);
+                    events.push_back(WSEvent{1u << WS_LOGS, EncodeNotification(WS_LOGS, entry), true, log.address, log.topics});
+                }
+            }
+        }
+        if (fReceipts) {
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("blockHash", pindex->GetBlockHash().GetHex());
+            entry.pushKV("blockNumber", pindex->nHeight);
+            entry.pushKV("receipts", receipts);
+            events.push_back(WSEvent{1u << WS_RECEIPTS, EncodeNotification(WS_RECEIPTS, entry), false, dev::h160(), {}});
+        }
+        QueueEvents(std::move(events));
+    }
+
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override
+    {
+        if (wsSubscribers[WS_RECEIPTS] == 0 && wsSubscribers[WS_LOGS] == 0)
+            return;
+        // The receipts and logs of the block are no longer in the chain
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("blockHash", block->GetHash().GetHex());
+        entry.pushKV("removed", true);
+        UniValue notification(UniValue::VOBJ);
+        notification.pushKV("topic", "removed");
+        notification.pushKV("data", entry);
+        auto frame = std::make_shared<const std::string>(EncodeFrame(WS_OP_TEXT, notification.write()));
+        QueueEvents({WSEvent{(1u << WS_RECEIPTS) | (1u << WS_LOGS), frame, false, dev::h160(), {}}});
+    }
+};
+
+static std::unique_ptr<WebSocketNotifier> wsNotifier;
+
+/** Bind the WebSocket listeners, to loopback unless -rpcallowip and -wsbind are given, as HTTPBindAddresses */
+static bool WebSocketBindAddresses()
+{
+    int ws_port = gArgs.GetArg("-wsport", BaseParams().RPCPort() + 1);
+    std::vector<std::pair<std::string, uint16_t>> endpoints;
+    if (!(gArgs.IsArgSet("-rpcallowip") && gArgs.IsArgSet("-wsbind"))) {
+        endpoints.push_back(std::make_pair("::1", ws_port));
+        endpoints.push_back(std::make_pair("127.0.0.1", ws_port));
+        if (gArgs.IsArgSet("-wsbind")) {
+            LogPrintf("WARNING: option -wsbind was ignored because -rpcallowip was not specified, refusing to allow everyone to connect\n");
+        }
+    } else {
+        for (const std::string& strBind : gArgs.GetArgs("-wsbind")) {
+            int port = ws_port;
+            std::string host;
+            SplitHostPort(strBind, port, host);
+            endpoints.push_back(std::make_pair(host, port));
+        }
+    }
+
+    for (const auto& endpoint : endpoints) {
+        CService addr;
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        if (!Lookup(endpoint.first.empty() ? "::" : endpoint.first.c_str(), addr, endpoint.second, false) ||
+            !addr.GetSockAddr((struct sockaddr*)&sockaddr, &len)) {
+            LogPrintf("Binding WebSocket on address %s port %i failed.\n", endpoint.first, endpoint.second);
+            continue;
+        }
+        LogPrint(BCLog::HTTP, "Binding WebSocket on address %s port %i\n", endpoint.first, endpoint.second);
+        struct evconnlistener* listener = evconnlistener_new_bind(EventBase(), ws_accept_cb, nullptr,
+            LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE | LEV_OPT_THREADSAFE, -1, (struct sockaddr*)&sockaddr, len);
+        if (listener) {
+            wsListeners.push_back(listener);
+        } else {
+            LogPrintf("Binding WebSocket on address %s port %i failed.\n", endpoint.first, endpoint.second);
+        }
+    }
+    return !wsListeners.empty();
+}
+
+bool StartWebSocketServer()
+{
+    nMaxConnections = std::max<int64_t>(gArgs.GetArg("-wsmaxconnections", DEFAULT_WEBSOCKET_MAX_CONNECTIONS), 0);
+    nMaxBuffer = (size_t)std::max<int64_t>(gArgs.GetArg("-wsmaxbuffer", DEFAULT_WEBSOCKET_MAX_BUFFER), 1) << 20;
+    for (std::atomic<int>& subscribers : wsSubscribers)
+        subscribers = 0;
+    {
+        LOCK(cs_wsQueue);
+        wsDispatch = MakeUnique<HTTPEvent>(EventBase(), false, nullptr, DispatchEvents);
+    }
+    if (!WebSocketBindAddresses()) {
+        LOCK(cs_wsQueue);
+        wsDispatch.reset();
+        return false;
+    }
+    wsNotifier = MakeUnique<WebSocketNotifier>();
+    RegisterValidationInterface(wsNotifier.get());
+    fWebSocketStarted = true;
+    LogPrintf("WebSocket server started, up to %u connections\n", nMaxConnections);
+    return true;
+}
+
+void StopWebSocketServer()
+{
+    if (!fWebSocketStarted)
+        return;
+    fWebSocketStarted = false;
+    UnregisterValidationInterface(wsNotifier.get());
+
+    // The listeners and connections belong to the event loop, close them there
+    std::promise<void> closed;
+    HTTPEvent* ev = new HTTPEvent(EventBase(), true, nullptr, [&closed] {
+        std::unique_ptr<HTTPEvent> dispatch;
+        {
+            LOCK(cs_wsQueue);
+            dispatch = std::move(wsDispatch);
+            wsQueue.clear();
+        }
+        dispatch.reset();
+        for (struct evconnlistener* listener : wsListeners)
+            evconnlistener_free(listener);
+        wsListeners.clear();
+        while (!wsClients.empty())
+            FreeClient(wsClients.begin()->second.get());
+        closed.set_value();
+    });
+    ev->trigger(nullptr);
+    closed.get_future().wait();
+    wsNotifier.reset();
+    LogPrint(BCLog::HTTP, "Stopped WebSocket server\n");
+}
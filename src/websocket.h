@@ -0,0 +1,41 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WEBSOCKET_H
+#define BITCOIN_WEBSOCKET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Default for -ws, accepting WebSocket subscriptions on -wsport */
+static const bool DEFAULT_WEBSOCKET_ENABLE = false;
+/** Default for -wsmaxconnections */
+static const int DEFAULT_WEBSOCKET_MAX_CONNECTIONS = 1000;
+/** Default for -wsmaxbuffer, the MiB of notifications queued for a client before it is dropped */
+static const int DEFAULT_WEBSOCKET_MAX_BUFFER = 16;
+/** Largest message a client may send, subscriptions are small */
+static const size_t MAX_WEBSOCKET_MESSAGE_SIZE = 64 * 1024;
+/** Most subscriptions of a client */
+static const size_t MAX_WEBSOCKET_SUBSCRIPTIONS = 64;
+
+/**
+ * WebSocket subscriptions to new headers, mempool transactions, block receipts and filtered logs,
+ * for clients that can not use ZMQ and would otherwise hold an RPC worker in waitfornewblock or
+ * waitforlogs. The connections are served by the event loop of the HTTP server, they are
+ * authenticated and allowed like JSON-RPC connections. Each notification is encoded once into a
+ * frame that the output buffers of all its subscribers refer to.
+ *
+ * Clients send text messages {"id": <id>, "method": "subscribe", "params": [<topic>, <filter>]}
+ * with topic one of "headers", "mempool", "receipts" or "logs", the filter of logs being
+ * {"addresses": [...], "topics": [...]}, and {"id": <id>, "method": "unsubscribe", "params": [<subscription>]}.
+ * Notifications are {"topic": <topic>, "data": <object>}, a connection receives each notification
+ * once however many of its subscriptions match it.
+ */
+
+/** Bind -wsport and start serving. Precondition: the HTTP server has been started */
+bool StartWebSocketServer();
+/** Close the connections and listening sockets. Precondition: the HTTP server has not been stopped yet */
+void StopWebSocketServer();
+
+#endif // BITCOIN_WEBSOCKET_H
@@ -2,13 +2,19 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
+
 #include <chain.h>
 #include <chainparams.h>
+#include <locktrip/dgp.h>
 #include <streams.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
 #include <util/system.h>
 #include <rpc/server.h>
+#include <qtum/storageresults.h>
+#include <util/convert.h>
+#include <util/strencodings.h>
 
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
@@ -16,6 +22,11 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_CONTRACTLOG = "contractlog";
+static const char *MSG_CONTRACTLOGREMOVED = "contractlogremoved";
+static const char *MSG_RAWRECEIPT = "rawreceipt";
+static const char *MSG_RAWRECEIPTREMOVED = "rawreceiptremoved";
+static const char *MSG_DGPUPDATE = "dgpupdate";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -206,3 +217,133 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+CZMQPublishContractLogNotifier::CZMQPublishContractLogNotifier()
+{
+    for (const std::string& address : gArgs.GetArgs("-zmqpubcontractlogaddress")) {
+        if (address.size() == 40 && IsHex(address)) {
+            addresses.insert(dev::h160(address));
+        } else {
+            LogPrintf("zmq: Ignoring invalid contract log address filter %s\n", address);
+        }
+    }
+    for (const std::string& topic : gArgs.GetArgs("-zmqpubcontractlogtopic")) {
+        if (topic.size() == 64 && IsHex(topic)) {
+            topics.insert(dev::h256(topic));
+        } else {
+            LogPrintf("zmq: Ignoring invalid contract log topic filter %s\n", topic);
+        }
+    }
+}
+
+bool CZMQPublishContractLogNotifier::NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex)
+{
+    if (!fLogEvents || !pstorageresult)
+        return true;
+
+    for (const CTransactionRef& tx : block.vtx) {
+        if (!tx->HasCreateOrCall())
+            continue;
+
+        // The receipts are committed before the block connection is notified
+        uint32_t logIndex = 0;
+        for (const TransactionReceiptInfo& receipt : pstorageresult->readCommittedResult(uintToh256(tx->GetHash()))) {
+            for (const dev::eth::LogEntry& log : receipt.logs) {
+                uint32_t index = logIndex++;
+                if (!addresses.empty() && !addresses.count(log.address))
+                    continue;
+                if (!topics.empty() && std::none_of(log.topics.begin(), log.topics.end(), [this](const dev::h256& topic) { return topics.count(topic) > 0; }))
+                    continue;
+
+                std::vector<valtype> logTopics;
+                for (const dev::h256& topic : log.topics)
+                    logTopics.push_back(topic.asBytes());
+
+                CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+                ss << pindex->GetBlockHash() << uint32_t(pindex->nHeight) << tx->GetHash() << receipt.transactionIndex << index;
+                ss << log.address.asBytes() << logTopics << log.data;
+                if (!SendMessage(MSG_CONTRACTLOG, &(*ss.begin()), ss.size()))
+                    return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool CZMQPublishContractLogNotifier::NotifyBlockDisconnected(const CBlock &block)
+{
+    uint256 hash = block.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish contractlogremoved %s\n", hash.GetHex());
+    char data[32];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    return SendMessage(MSG_CONTRACTLOGREMOVED, data, 32);
+}
+
+bool CZMQPublishRawReceiptNotifier::NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex)
+{
+    if (!fLogEvents || !pstorageresult)
+        return true;
+
+    // The receipts are committed before the block connection is notified
+    std::vector<uint256> txids;
+    std::vector<dev::h256> hashes;
+    for (const CTransactionRef& tx : block.vtx) {
+        if (tx->HasCreateOrCall()) {
+            txids.push_back(tx->GetHash());
+            hashes.push_back(uintToh256(tx->GetHash()));
+        }
+    }
+    std::vector<std::vector<TransactionReceiptInfo>> results = pstorageresult->readCommittedResults(hashes);
+    std::vector<std::pair<uint256, std::vector<unsigned char>>> receipts;
+    for (size_t i = 0; i < txids.size(); i++) {
+        if (!results[i].empty())
+            receipts.emplace_back(txids[i], pstorageresult->serializeResult(results[i]));
+    }
+
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawreceipt %s (%u transactions)\n", pindex->GetBlockHash().GetHex(), receipts.size());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << pindex->GetBlockHash() << uint32_t(pindex->nHeight) << receipts;
+    return SendMessage(MSG_RAWRECEIPT, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishRawReceiptNotifier::NotifyBlockDisconnected(const CBlock &block)
+{
+    uint256 hash = block.GetHash();
+    LogPrint(BCLog::ZMQ, "zmq: Publish rawreceiptremoved %s\n", hash.GetHex());
+    char data[32];
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    return SendMessage(MSG_RAWRECEIPTREMOVED, data, 32);
+}
+
+bool CZMQPublishDGPUpdateNotifier::NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex)
+{
+    // Reading the contract takes cs_main, leave it until the chain has caught up
+    if (IsInitialBlockDownload())
+        return true;
+
+    // The contract is read at the current tip, which is this block unless more were connected since
+    Dgp dgp;
+    bool inProgress = voteInProgress;
+    dgp.hasVoteInProgress(inProgress);
+    bool voteFinished = voteInProgress && !inProgress;
+    voteInProgress = inProgress;
+
+    if (!dgp.updateDgpCache() && !voteFinished)
+        return true;
+
+    std::vector<std::pair<uint32_t, uint64_t>> params = {
+        {FIAT_GAS_PRICE, DGP_CACHE_FIAT_GAS_PRICE},
+        {BURN_RATE, DGP_CACHE_BURN_RATE},
+        {ECONOMY_DIVIDEND, DGP_CACHE_ECONOMY_DIVIDEND},
+        {BLOCK_SIZE_DGP_PARAM, DGP_CACHE_BLOCK_SIZE},
+        {BLOCK_GAS_LIMIT_DGP_PARAM, DGP_CACHE_BLOCK_GAS_LIMIT},
+        {FIAT_BYTE_PRICE, DGP_CACHE_FIAT_BYTE_PRICE},
+    };
+
+    LogPrint(BCLog::ZMQ, "zmq: Publish dgpupdate %s\n", pindex->GetBlockHash().GetHex());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << pindex->GetBlockHash() << uint32_t(pindex->nHeight) << voteFinished << params;
+    return SendMessage(MSG_DGPUPDATE, &(*ss.begin()), ss.size());
+}
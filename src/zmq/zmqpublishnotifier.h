@@ -7,6 +7,10 @@
 
 #include <zmq/zmqabstractnotifier.h>
 
+#include <libdevcore/FixedHash.h>
+
+#include <set>
+
 class CBlockIndex;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
@@ -52,4 +56,46 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+/**
+ * Publishes every contract log of a connected block that passes the
+ * -zmqpubcontractlogaddress and -zmqpubcontractlogtopic filters, and the
+ * hash of every disconnected block so subscribers can drop its logs.
+ */
+class CZMQPublishContractLogNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    CZMQPublishContractLogNotifier();
+
+    bool NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex) override;
+    bool NotifyBlockDisconnected(const CBlock &block) override;
+
+private:
+    std::set<dev::h160> addresses;
+    std::set<dev::h256> topics;
+};
+
+/**
+ * Publishes the receipts of the contract transactions of each connected block
+ * in one message, and the hash of every disconnected block.
+ */
+class CZMQPublishRawReceiptNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex) override;
+    bool NotifyBlockDisconnected(const CBlock &block) override;
+};
+
+/**
+ * Publishes the cached DGP parameters when a connected block finished a vote
+ * or changed any of them.
+ */
+class CZMQPublishDGPUpdateNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyBlockConnected(const CBlock &block, const CBlockIndex *pindex) override;
+
+private:
+    bool voteInProgress {false};
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
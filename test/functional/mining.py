@@ -125,5 +125,19 @@ class MiningTest(BitcoinTestFramework):
         bad_block.hashPrevBlock = 123
         assert_template(node, bad_block, 'inconclusive-not-best-prevblk')
 
+        self.log.info("getblocktemplate: Test template deltas")
+        tmpl = node.getblocktemplate({'rules': ['segwit']})
+        delta = node.getblocktemplate({'rules': ['segwit'], 'templateid': tmpl['templateid']})
+        assert_equal(delta['templateid'], tmpl['templateid'])
+        assert_equal(delta['transactions'], [])
+        assert_equal(delta['removed'], [])
+        assert_equal(delta['txids'], [tx['txid'] for tx in tmpl['transactions']])
+        # A template of an older block gets the whole new template
+        node.generate(1)
+        full = node.getblocktemplate({'rules': ['segwit'], 'templateid': tmpl['templateid']})
+        assert full['templateid'] != tmpl['templateid']
+        assert 'removed' not in full
+        assert 'txids' not in full
+
 if __name__ == '__main__':
     MiningTest().main()
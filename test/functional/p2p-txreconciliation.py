@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The LockTrip developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test transaction relay by set reconciliation with -txreconciliation."""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+class TxReconciliationTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+        self.extra_args = [["-txreconciliation"], ["-txreconciliation"], []]
+
+    def setup_network(self):
+        self.setup_nodes()
+        # Node 0 makes the connection to node 1 so it requests the sketches, node 2 does not reconcile
+        connect_nodes(self.nodes[0], 1)
+        connect_nodes(self.nodes[2], 0)
+        self.sync_all()
+
+    def run_test(self):
+        self.log.info("Reconciliation is negotiated between the peers that both set the service bit")
+        wait_until(lambda: all(p['txreconciliation'] for p in self.nodes[1].getpeerinfo()), timeout=30)
+        peers = {p['inbound']: p for p in self.nodes[0].getpeerinfo()}
+        assert_equal(peers[False]['txreconciliation'], True)
+        assert_equal(peers[True]['txreconciliation'], False)
+        assert_equal(int(self.nodes[0].getnetworkinfo()['localservices'], 16) & (1 << 11), 1 << 11)
+        assert_equal(int(self.nodes[2].getnetworkinfo()['localservices'], 16) & (1 << 11), 0)
+
+        self.log.info("Transactions reach every node whichever side of a reconciling connection they start on")
+        txids = []
+        for node in self.nodes:
+            for _ in range(5):
+                txids.append(node.sendtoaddress(node.getnewaddress(), 1))
+        wait_until(lambda: all(set(txids) <= set(node.getrawmempool()) for node in self.nodes), timeout=90)
+
+        self.log.info("The reconciliation messages were exchanged")
+        bytes_sent = {p['inbound']: p['bytessent_per_msg'] for p in self.nodes[0].getpeerinfo()}
+        assert 'reqrecon' in bytes_sent[False]
+        assert 'reqrecon' not in bytes_sent[True]
+        assert 'sketch' in [p['bytessent_per_msg'] for p in self.nodes[1].getpeerinfo()][0]
+
+if __name__ == '__main__':
+    TxReconciliationTest().main()
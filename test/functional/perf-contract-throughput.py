@@ -0,0 +1,200 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The LockTrip developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+""" HYDRA contract throughput performance test
+
+Fills blocks with token transfers, contract creations, LYDRA mint/burn and DGP votes
+on node0 and measures:
+  - the mempool admission rate of the contract transactions on node0,
+  - the wall time of generate on node0,
+  - the wall time of submitblock of the same blocks on node1, which is not connected,
+  - the ConnectBlock phases of both nodes from getvalidationstats,
+  - the latency of searchlogs over the filled blocks.
+
+The results are written as JSON to --output, so runs of different versions can be compared.
+It is not part of the base or extended suites, run it with test_runner.py --perf.
+"""
+
+import json
+import time
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+from test_framework.qtum import *
+
+# A token with only a transfer: any call moves the amount in the second argument from
+# the caller to the address in the first argument and logs a QRC20 Transfer event.
+# The creator is given 2^64 - 1 tokens.
+TOKEN_BYTECODE = "67ffffffffffffffff33556041601760003960416000f360243533548190033355600435805482019055600052600435337fddf252ad1be2c89b69c2b068fc378daa952ba7f163c4a11628f55a4df523b3ef60206000a300"
+TRANSFER_TOPIC = "ddf252ad1be2c89b69c2b068fc378daa952ba7f163c4a11628f55a4df523b3ef"
+DGP_ADDRESS = "0000000000000000000000000000000000000091"
+ORACLE_ADDRESS = "0000000000000000000000000000000000000092"
+
+def uint256_hex(value):
+    return format(value, 'x').zfill(64)
+
+class ContractThroughputTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        # The transactions of a block spend the change of each other, allow long chains of them in the mempool
+        args = ["-logevents", "-limitancestorcount=1000", "-limitdescendantcount=1000",
+                "-limitancestorsize=10000", "-limitdescendantsize=10000"]
+        self.extra_args = [args, args]
+
+    def add_options(self, parser):
+        parser.add_option("--blocks", dest="blocks", default=5, type='int',
+                          help="number of filled blocks to measure (default: %default)")
+        parser.add_option("--txsperblock", dest="txsperblock", default=100, type='int',
+                          help="contract transactions sent for each filled block (default: %default)")
+        parser.add_option("--output", dest="output", default=None,
+                          help="file the JSON results are written to (default: perf-contract-throughput.json in the test directory)")
+
+    def setup_network(self):
+        self.setup_nodes()
+        connect_nodes_bi(self.nodes, 0, 1)
+
+    def setup_contracts(self):
+        node = self.nodes[0]
+        self.sender = node.getnewaddress()
+        self.sender_hex = node.gethexaddress(self.sender)
+        self.receivers = [node.gethexaddress(node.getnewaddress()) for _ in range(10)]
+        for _ in range(20):
+            node.sendtoaddress(self.sender, 1000)
+
+        # DGP and oracle admin, as in dgp-vote.py, and a vote on the burn rate to vote on
+        backup_hex = node.gethexaddress(node.getnewaddress())
+        callstring = "7fd05e2a" + uint256_hex(int(self.sender_hex, 16)) + uint256_hex(int(backup_hex, 16))
+        node.sendtocontract(DGP_ADDRESS, callstring)
+        node.sendtocontract(ORACLE_ADDRESS, callstring)
+        node.generate(1)
+        node.sendtocontract(DGP_ADDRESS, "7adbf973" + uint256_hex(int(ORACLE_ADDRESS, 16)), 0, 2500000, self.sender)
+        node.sendtocontract(ORACLE_ADDRESS, "85d5f882" + uint256_hex(int(DGP_ADDRESS, 16)), 0, 2500000, self.sender)
+        node.generate(1)
+        node.sendtocontract(DGP_ADDRESS, "70eb3901" + uint256_hex(3) + uint256_hex(33) + uint256_hex(1000), 0, 2500000, self.sender)
+
+        self.token = node.createcontract(TOKEN_BYTECODE, 2500000, self.sender)['address']
+        node.generate(1)
+        assert node.getaccountinfo(self.token)['code'].startswith("602435")
+
+        # LYDRA is only active from nLydraHeight, which regtest may not reach
+        try:
+            node.mintlydra(self.sender, 1)
+            self.lydra = True
+        except JSONRPCException as e:
+            self.log.info("LYDRA mint/burn left out: %s" % e.error['message'])
+            self.lydra = False
+        node.generate(1)
+
+    def send_contract_txs(self, count):
+        """Send count contract transactions of the mixed workload, return the number accepted"""
+        node = self.nodes[0]
+        accepted = 0
+        for i in range(count):
+            kind = i % 10
+            try:
+                if kind < 6:
+                    callstring = "a9059cbb" + uint256_hex(int(self.receivers[i % len(self.receivers)], 16)) + uint256_hex(1)
+                    node.sendtocontract(self.token, callstring, 0, 100000, self.sender)
+                elif kind < 8:
+                    node.createcontract(TOKEN_BYTECODE, 2500000, self.sender)
+                elif kind == 8 and self.lydra:
+                    if (i // 10) % 2 == 0:
+                        node.mintlydra(self.sender, 1)
+                    else:
+                        node.burnlydra(self.sender, 1)
+                else:
+                    node.sendtocontract(DGP_ADDRESS, "4b9f5c98" + uint256_hex(i % 2), 0.00000001, 2500000, self.sender)
+                accepted += 1
+            except JSONRPCException as e:
+                self.log.debug("Transaction %d of kind %d not sent: %s" % (i, kind, e.error['message']))
+        return accepted
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generate(COINBASE_MATURITY + 50)
+        self.setup_contracts()
+        self.sync_all()
+        disconnect_nodes(self.nodes[0], 1)
+        disconnect_nodes(self.nodes[1], 0)
+
+        start_height = node.getblockcount() + 1
+        stats_before = [n.getvalidationstats() for n in self.nodes]
+        accepts_before = node.getmempoolacceptstats()
+
+        results = {
+            "blocks": [],
+            "txs_sent": 0,
+            "txs_accepted": 0,
+            "mempool_seconds": 0.0,
+            "generate_seconds": 0.0,
+            "submitblock_seconds": 0.0,
+        }
+        for _ in range(self.options.blocks):
+            send_start = time.time()
+            accepted = self.send_contract_txs(self.options.txsperblock)
+            send_time = time.time() - send_start
+            mempool_size = node.getmempoolinfo()['size']
+
+            generate_start = time.time()
+            block_hash = node.generate(1)[0]
+            generate_time = time.time() - generate_start
+
+            block_hex = node.getblock(block_hash, 0)
+            submit_start = time.time()
+            assert_equal(self.nodes[1].submitblock(block_hex), None)
+            submit_time = time.time() - submit_start
+            assert_equal(self.nodes[1].getbestblockhash(), block_hash)
+
+            block = node.getblock(block_hash)
+            results["blocks"].append({
+                "height": block['height'],
+                "txs": len(block['tx']),
+                "size": block['size'],
+                "mempool_txs": mempool_size,
+                "mempool_txs_left": node.getmempoolinfo()['size'],
+                "mempool_seconds": send_time,
+                "generate_seconds": generate_time,
+                "submitblock_seconds": submit_time,
+            })
+            results["txs_sent"] += self.options.txsperblock
+            results["txs_accepted"] += accepted
+            results["mempool_seconds"] += send_time
+            results["generate_seconds"] += generate_time
+            results["submitblock_seconds"] += submit_time
+            self.log.info("Block %d: %d txs, mempool %.2fs, generate %.2fs, submitblock %.2fs" %
+                          (block['height'], len(block['tx']), send_time, generate_time, submit_time))
+        end_height = node.getblockcount()
+
+        # Rate of the whole send RPC, the wallet work included; mempool_accept has the admission itself
+        results["mempool_txs_per_second"] = results["txs_accepted"] / results["mempool_seconds"] if results["mempool_seconds"] else 0
+        accepts_after = node.getmempoolacceptstats()
+        results["mempool_accept"] = {}
+        for tx_type, after in accepts_after.items():
+            before = accepts_before.get(tx_type, {"accepted": 0, "rejected": 0, "total": {"time": 0}})
+            results["mempool_accept"][tx_type] = {
+                "accepted": after['accepted'] - before['accepted'],
+                "rejected": after['rejected'] - before['rejected'],
+                "microseconds": after['total']['time'] - before['total']['time'],
+            }
+
+        # The ConnectBlock phases of the measured blocks, on the node that generated them and on the one they were submitted to
+        for name, n, before in (("connectblock_generate", self.nodes[0], stats_before[0]), ("connectblock_submitblock", self.nodes[1], stats_before[1])):
+            after = n.getvalidationstats()
+            results[name] = {phase: after[phase]['time'] - before[phase]['time'] for phase in after if phase != 'blocks'}
+
+        searchlogs_start = time.time()
+        logs = node.searchlogs(start_height, end_height, {"addresses": [self.token]}, {"topics": [TRANSFER_TOPIC]})
+        results["searchlogs_seconds"] = time.time() - searchlogs_start
+        results["searchlogs_receipts"] = len(logs)
+        assert len(logs) > 0
+
+        output = self.options.output or os.path.join(self.options.tmpdir, "perf-contract-throughput.json")
+        with open(output, 'w', encoding='utf8') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+        self.log.info("Results written to %s" % output)
+
+if __name__ == '__main__':
+    ContractThroughputTest().main()
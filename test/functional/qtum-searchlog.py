@@ -80,6 +80,21 @@ class QtumRPCSearchlogsTest(BitcoinTestFramework):
 
         assert_equal(self.nodes[0].searchlogs(604,604,addresses,topics),[])
 
+        # Paging through the results with a cursor returns the same receipts as a single call
+        expected = self.nodes[0].searchlogs(0,-1,{},{})
+        assert(len(expected) > 1)
+        entries = []
+        cursor = None
+        while True:
+            page = self.nodes[0].searchlogs(0,-1,{},{},0,1,cursor)
+            assert(len(page['entries']) <= 1)
+            entries += page['entries']
+            cursor = page['cursor']
+            if cursor is None:
+                break
+        assert_equal(entries, expected)
+        assert_raises_rpc_error(-8, "Invalid cursor", self.nodes[0].searchlogs, 0, -1, {}, {}, 0, 1, "zz")
+
 
 if __name__ == '__main__':
     QtumRPCSearchlogsTest().main()
@@ -89,6 +89,7 @@ BASE_SCRIPTS= [
     'mempool_persist.py',
     'multiwallet.py',
     'httpbasics.py',
+    'websocket.py',
     'multi_rpc.py',
     'proxy_test.py',
     'signrawtransactions.py',
@@ -99,6 +100,7 @@ BASE_SCRIPTS= [
     'net.py',
     'keypool.py',
     'p2p-mempool.py',
+    'p2p-txreconciliation.py',
     'prioritise_transaction.py',
     'invalidblockrequest.py', 
     'invalidtxrequest.py',
@@ -215,8 +217,14 @@ EXTENDED_SCRIPTS = [
     #'replace-by-fee.py', #TODO: min relay fee not met
 ]
 
+PERF_SCRIPTS = [
+    # These tests measure throughput and write their results as JSON, they are only run with --perf.
+    # Run them one at a time so they do not slow each other down.
+    'perf-contract-throughput.py',
+]
+
 # Place EXTENDED_SCRIPTS first since it has the 3 longest running tests
-ALL_SCRIPTS = EXTENDED_SCRIPTS + BASE_SCRIPTS
+ALL_SCRIPTS = EXTENDED_SCRIPTS + BASE_SCRIPTS + PERF_SCRIPTS
 
 NON_SCRIPTS = [
     # These are python files that live in the functional tests directory, but are not test scripts.
@@ -239,6 +247,7 @@ def main():
     parser.add_argument('--force', '-f', action='store_true', help='run tests even on platforms where they are disabled by default (e.g. windows).')
     parser.add_argument('--help', '-h', '-?', action='store_true', help='print help text and exit')
     parser.add_argument('--jobs', '-j', type=int, default=4, help='how many test scripts to run in parallel. Default=4.')
+    parser.add_argument('--perf', action='store_true', help='run only the performance tests, one at a time')
     parser.add_argument('--keepcache', '-k', action='store_true', help='the default behavior is to flush the cache directory on startup. --keepcache retains the cache from the previous testrun.')
     parser.add_argument('--quiet', '-q', action='store_true', help='only print results summary and failure logs')
     parser.add_argument('--tmpdirprefix', '-t', default=tempfile.gettempdir(), help="Root directory for datadirs")
@@ -295,7 +304,10 @@ def main():
         # No individual tests have been specified.
         # Run all base tests, and optionally run extended tests.
         test_list = BASE_SCRIPTS
-        if args.extended:
+        if args.perf:
+            test_list = PERF_SCRIPTS
+            args.jobs = 1
+        elif args.extended:
             # place the EXTENDED_SCRIPTS first since the three longest ones
             # are there and the list is shorter
             test_list = EXTENDED_SCRIPTS + test_list
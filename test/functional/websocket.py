@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The LockTrip developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the WebSocket subscriptions of -ws."""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+from test_framework.qtum import *
+
+import base64
+import hashlib
+import json
+import os
+import socket
+import struct
+import urllib.parse
+
+class WebSocketClient():
+    def __init__(self, host, port, authpair):
+        self.sock = socket.create_connection((host, port), timeout=30)
+        key = base64.b64encode(os.urandom(16)).decode()
+        request = ("GET / HTTP/1.1\r\nHost: %s:%d\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n" % (host, port, key))
+        if authpair is not None:
+            request += "Authorization: Basic %s\r\n" % str_to_b64str(authpair)
+        self.sock.sendall((request + "\r\n").encode())
+        response = b""
+        while b"\r\n\r\n" not in response:
+            data = self.sock.recv(4096)
+            if not data:
+                break
+            response += data
+        self.status = int(response.split(b" ")[1])
+        if self.status == 101:
+            accept = base64.b64encode(hashlib.sha1((key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11").encode()).digest()).decode()
+            assert ("Sec-WebSocket-Accept: " + accept).encode() in response
+
+    def send(self, message):
+        payload = json.dumps(message).encode()
+        mask = os.urandom(4)
+        header = bytes([0x81])
+        if len(payload) < 126:
+            header += bytes([0x80 | len(payload)])
+        else:
+            header += bytes([0x80 | 126]) + struct.pack(">H", len(payload))
+        masked = bytes(b ^ mask[i % 4] for i, b in enumerate(payload))
+        self.sock.sendall(header + mask + masked)
+
+    def recv_exact(self, n):
+        data = b""
+        while len(data) < n:
+            chunk = self.sock.recv(n - len(data))
+            assert chunk, "connection closed"
+            data += chunk
+        return data
+
+    def recv(self):
+        first, second = self.recv_exact(2)
+        assert_equal(first & 0x0f, 1)
+        length = second & 0x7f
+        if length == 126:
+            length = struct.unpack(">H", self.recv_exact(2))[0]
+        elif length == 127:
+            length = struct.unpack(">Q", self.recv_exact(8))[0]
+        return json.loads(self.recv_exact(length).decode())
+
+    def request(self, id, method, params):
+        self.send({"id": id, "method": method, "params": params})
+        reply = self.recv()
+        assert_equal(reply['id'], id)
+        return reply
+
+class WebSocketTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.ws_port = rpc_port(0) + PORT_RANGE
+        self.extra_args = [["-ws", "-wsport=%d" % self.ws_port, "-logevents"]]
+
+    def run_test(self):
+        node = self.nodes[0]
+        url = urllib.parse.urlparse(node.url)
+        authpair = url.username + ':' + url.password
+
+        self.log.info("Upgrade needs the JSON-RPC credentials")
+        assert_equal(WebSocketClient(url.hostname, self.ws_port, None).status, 401)
+        assert_equal(WebSocketClient(url.hostname, self.ws_port, url.username + ':wrong').status, 401)
+        client = WebSocketClient(url.hostname, self.ws_port, authpair)
+        assert_equal(client.status, 101)
+
+        self.log.info("Subscribe and unsubscribe")
+        reply = client.request(1, "unknown", [])
+        assert_equal(reply['error']['code'], -32601)
+        reply = client.request(2, "subscribe", ["nothing"])
+        assert_equal(reply['error']['code'], -8)
+        headers_sub = client.request(3, "subscribe", ["headers"])['result']
+        mempool_sub = client.request(4, "subscribe", ["mempool"])['result']
+        assert mempool_sub != headers_sub
+        assert_equal(client.request(5, "subscribe", ["logs", {"addresses": ["zz"]}])['error']['code'], -5)
+
+        self.log.info("New headers and mempool transactions are sent once to a second client too")
+        other = WebSocketClient(url.hostname, self.ws_port, authpair)
+        other.request(1, "subscribe", ["headers"])
+        block_hash = node.generate(1)[0]
+        for c in (client, other):
+            notification = c.recv()
+            assert_equal(notification['topic'], 'headers')
+            assert_equal(notification['data']['hash'], block_hash)
+            assert_equal(notification['data']['height'], 1)
+
+        node.generate(COINBASE_MATURITY)
+        for _ in range(COINBASE_MATURITY):
+            client.recv()
+        txid = node.sendtoaddress(node.getnewaddress(), 1)
+        notification = client.recv()
+        assert_equal(notification['topic'], 'mempool')
+        assert_equal(notification['data']['txid'], txid)
+
+        self.log.info("Unsubscribed topics are no longer sent")
+        assert_equal(client.request(6, "unsubscribe", [mempool_sub])['result'], True)
+        assert_equal(client.request(7, "unsubscribe", [mempool_sub])['result'], False)
+        node.sendtoaddress(node.getnewaddress(), 1)
+        block_hash = node.generate(1)[0]
+        notification = client.recv()
+        assert_equal(notification['topic'], 'headers')
+        assert_equal(notification['data']['hash'], block_hash)
+
+if __name__ == '__main__':
+    WebSocketTest().main()